@@ -0,0 +1,131 @@
+// ADReplicationCollector.cpp
+// Collecteur de réplication AD sans interface, planifiable : sortie JSON/NDJSON et code de sortie selon l'état
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#ifdef _WIN32
+#define UNICODE
+#define _UNICODE
+#define _WIN32_DCOM
+#define NOMINMAX
+
+#include <winsock2.h>
+#include <windows.h>
+
+#include "WinBackends.h"
+#endif
+
+#include "Collector.h"
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+// Counts allocations for --benchmark; one relaxed increment per call.
+// GCC flags malloc/free inside replacement operators once they are inlined.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void* operator new(std::size_t size) {
+    AllocationCounter().fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+// First Ctrl+C stops the scan (partial results are still written), a second one kills
+static CancellationToken g_interrupt;
+
+extern "C" void OnInterrupt(int) {
+    g_interrupt.Cancel();
+    std::signal(SIGINT, SIG_DFL);
+}
+
+#ifdef _WIN32
+
+// Process creation time, so the measured start-up includes loader time
+int64_t ProcessStartMs() {
+    FILETIME creation, exitTime, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exitTime, &kernel, &user)) return 0;
+    ULONGLONG ticks = ((ULONGLONG)creation.dwHighDateTime << 32) | creation.dwLowDateTime;
+    return (int64_t)((ticks - 116444736000000000ULL) / 10000);
+}
+
+int wmain(int argc, wchar_t** argv) {
+    CollectorEnvironment env;
+    env.startedAt = ProcessStartMs();
+
+    CollectorOptions options;
+    std::string error;
+    if (!ParseCollectorArgs(std::vector<std::wstring>(argv + 1, argv + argc), options, error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        PrintCollectorUsage(stderr);
+        return (int)HealthStatus::Unknown;
+    }
+    if (options.help) {
+        PrintCollectorUsage(stdout);
+        return 0;
+    }
+
+    if (options.benchmark) return RunBenchmark(options);
+    if (!options.analyzePath.empty()) return RunEventAnalysis(options);
+    if (!options.listen.empty()) return RunAggregator(options);
+
+    HRESULT hr = CoInitializeEx(0, COINIT_MULTITHREADED);
+    env.directory = std::make_shared<AdsiDirectoryBackend>();
+    env.events = std::make_shared<WinEventSource>();
+    env.domainDn = GetDomainDN;
+    if (options.aggregator.empty()) {
+        env.cancel = &g_interrupt;
+        std::signal(SIGINT, OnInterrupt);
+    }
+    int code = options.aggregator.empty() ? RunCollector(options, env) : RunSiteCollector(options, env);
+    env.directory->CloseSessions();
+    if (SUCCEEDED(hr)) CoUninitialize();
+    return code;
+}
+
+#else
+
+// Fixture-only build: --ldif (and --events) replace the Windows backends
+int main(int argc, char** argv) {
+    CollectorEnvironment env;
+    env.startedAt = UnixNowMs();
+
+    std::vector<std::wstring> args;
+    for (int i = 1; i < argc; i++) args.push_back(Utf8ToWide(argv[i]));
+
+    CollectorOptions options;
+    std::string error;
+    if (!ParseCollectorArgs(args, options, error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        PrintCollectorUsage(stderr);
+        return (int)HealthStatus::Unknown;
+    }
+    if (options.help) {
+        PrintCollectorUsage(stdout);
+        return 0;
+    }
+    if (options.benchmark) return RunBenchmark(options);
+    if (!options.analyzePath.empty()) return RunEventAnalysis(options);
+    if (!options.listen.empty()) return RunAggregator(options);
+    if (!options.aggregator.empty()) return RunSiteCollector(options, env);
+    env.cancel = &g_interrupt;
+    std::signal(SIGINT, OnInterrupt);
+    return RunCollector(options, env);
+}
+
+#endif
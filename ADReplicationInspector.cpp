@@ -5,430 +5,839 @@
 #define UNICODE
 #define _UNICODE
 #define _WIN32_DCOM
+#define NOMINMAX
 
 #include <windows.h>
 #include <commctrl.h>
-#include <activeds.h>
-#include <lm.h>
-#include <winevt.h>
 #include <string>
 #include <vector>
-#include <map>
 #include <thread>
-#include <fstream>
-#include <iomanip>
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <chrono>
+#include <mutex>
+
+#include "AlertRules.h"
+#include "AsyncLogger.h"
+#include "CanaryProbe.h"
+#include "CancellationToken.h"
+#include "DirectoryBackend.h"
+#include "DistinguishedName.h"
+#include "EventCollector.h"
+#include "HealthCheck.h"
+#include "HistoryRecorder.h"
+#include "LatencyMatrix.h"
+#include "PollScheduler.h"
+#include "ProbeEngine.h"
+#include "PrometheusExporter.h"
+#include "RepadminImport.h"
+#include "ReplicationModel.h"
+#include "ReportExporter.h"
+#include "ScanEngine.h"
+#include "ScanSnapshot.h"
+#include "SnapshotFile.h"
+#include "TopologyGraph.h"
+#include "UsnAnomaly.h"
+#include "WinBackends.h"
 
-#pragma comment(lib, "activeds.lib")
-#pragma comment(lib, "adsiid.lib")
-#pragma comment(lib, "netapi32.lib")
-#pragma comment(lib, "wevtapi.lib")
 #pragma comment(lib, "comctl32.lib")
 #pragma comment(linker, "\"/manifestdependency:type='win32' name='Microsoft.Windows.Common-Controls' version='6.0.0.0' processorArchitecture='*' publicKeyToken='6595b64144ccf1df' language='*'\"")
 
-struct ADReplicationInfo {
-    std::wstring site;
-    std::wstring dc;
-    std::wstring usn;
-    std::wstring partners;
-    std::wstring lastReplication;
-    std::wstring latency;
-    std::wstring errors;
-};
+#define WM_APP_SCAN_STARTED   (WM_APP + 1)
+#define WM_APP_SCAN_ROWS      (WM_APP + 2)
+#define WM_APP_SCAN_COMPLETED (WM_APP + 3)
+#define WM_APP_MONITOR_STOPPED (WM_APP + 4)
+#define WM_APP_SCAN_DIFF      (WM_APP + 5)
+#define WM_APP_SCAN_ACTIVE    (WM_APP + 6)      // wParam: a full scan started (TRUE) or ended
+#define WM_APP_CANARY_DONE    (WM_APP + 7)      // lParam: std::wstring* report of the canary probe
 
 // Globals
 HWND g_hwndMain = nullptr;
 HWND g_hwndListView = nullptr;
 HWND g_hwndStatus = nullptr;
-std::vector<ADReplicationInfo> g_replInfo;
-bool g_isScanning = false;
+std::atomic<bool> g_isScanning{false};
+std::atomic<bool> g_monitoring{false};
+HWND g_hwndMonitor = nullptr;
+HWND g_hwndCancel = nullptr;
+
+// Token of the full scan running, null between scans; "Annuler scan" cancels it
+std::mutex g_scanCancelMutex;
+std::shared_ptr<CancellationToken> g_scanCancel;
+
+// Scanner -> readers: the last completed scan, published atomically
+SnapshotPublisher g_publisher;
+
+// UI thread state for the scan being displayed
+SnapshotPtr g_uiTopology;
+size_t g_uiRowsReceived = 0;
 
-// Logging
-void LogMessage(const std::wstring& msg) {
+// Logging: callers only enqueue, a background writer batches to the file
+AsyncLogger g_logger;
+
+std::wstring GetLogPath() {
     wchar_t tempPath[MAX_PATH];
     GetTempPathW(MAX_PATH, tempPath);
-    std::wstring logPath = std::wstring(tempPath) + L"ADReplicationInspector.log";
-
-    std::wofstream logFile(logPath, std::ios::app);
-    if (logFile.is_open()) {
-        SYSTEMTIME st;
-        GetLocalTime(&st);
-        logFile << std::setfill(L'0')
-                << std::setw(4) << st.wYear << L"-"
-                << std::setw(2) << st.wMonth << L"-"
-                << std::setw(2) << st.wDay << L" "
-                << std::setw(2) << st.wHour << L":"
-                << std::setw(2) << st.wMinute << L":"
-                << std::setw(2) << st.wSecond << L" - "
-                << msg << std::endl;
-        logFile.close();
-    }
-}
-
-std::wstring GetDomainDN() {
-    wchar_t computerName[256];
-    DWORD size = 256;
-    GetComputerNameW(computerName, &size);
-
-    PDOMAIN_CONTROLLER_INFOW dcInfo = nullptr;
-    DWORD result = DsGetDcNameW(nullptr, nullptr, nullptr, nullptr, 0, &dcInfo);
-
-    if (result == ERROR_SUCCESS && dcInfo) {
-        std::wstring domainDns = dcInfo->DomainName;
-        NetApiBufferFree(dcInfo);
-
-        std::wstring dn = L"DC=";
-        size_t pos = 0;
-        while ((pos = domainDns.find(L'.')) != std::wstring::npos) {
-            dn += domainDns.substr(0, pos) + L",DC=";
-            domainDns.erase(0, pos + 1);
-        }
-        dn += domainDns;
-        return dn;
-    }
-
-    return L"";
+    return std::wstring(tempPath) + L"ADReplicationInspector.log";
 }
 
-std::wstring GetHighestCommittedUSN(const std::wstring& dcName) {
-    std::wstring ldapPath = L"LDAP://" + dcName + L"/rootDSE";
+void LogMessage(const std::wstring& msg, LogLevel level = LogLevel::Info, std::initializer_list<LogField> fields = {}) {
+    g_logger.Log(level, msg, fields);
+}
 
-    IADs* pADs = nullptr;
-    HRESULT hr = ADsGetObject(ldapPath.c_str(), IID_IADs, (void**)&pADs);
+std::shared_ptr<IDirectoryBackend> g_directoryBackend = std::make_shared<AdsiDirectoryBackend>();
+ProbeOptions g_probeOptions;
 
-    if (SUCCEEDED(hr)) {
-        VARIANT var;
-        VariantInit(&var);
+std::shared_ptr<IEventSource> g_eventSource = std::make_shared<WinEventSource>();
+std::shared_ptr<EventCollector> g_eventCollector = std::make_shared<EventCollector>(g_eventSource, EventCollectorOptions());
 
-        hr = pADs->Get((BSTR)L"highestCommittedUSN", &var);
-        if (SUCCEEDED(hr) && var.vt == VT_BSTR) {
-            std::wstring usn = var.bstrVal;
-            VariantClear(&var);
-            pADs->Release();
-            return usn;
-        }
+// Discovery, probes, replica metadata and events; the GUI only subscribes
+ScanEngine g_scanEngine(g_directoryBackend, g_eventCollector, g_probeOptions, &g_logger);
 
-        VariantClear(&var);
-        pADs->Release();
-    }
-
-    return L"N/A";
+std::wstring GetEventBookmarkPath() {
+    wchar_t tempPath[MAX_PATH];
+    GetTempPathW(MAX_PATH, tempPath);
+    return std::wstring(tempPath) + L"ADReplicationInspector_events.dat";
 }
 
-std::vector<std::wstring> EnumerateSites() {
-    std::vector<std::wstring> sites;
-
-    std::wstring domainDN = GetDomainDN();
-    if (domainDN.empty()) return sites;
+// Prometheus text file of the last scan, for the node exporter textfile collector
+std::wstring GetMetricsPath() {
+    wchar_t tempPath[MAX_PATH];
+    GetTempPathW(MAX_PATH, tempPath);
+    return std::wstring(tempPath) + L"ADReplicationInspector.prom";
+}
 
-    std::wstring sitesPath = L"LDAP://CN=Sites,CN=Configuration," + domainDN;
+// Last full scan, reloaded at start-up and diffed against by the next one
+std::wstring GetSnapshotPath() {
+    wchar_t tempPath[MAX_PATH];
+    GetTempPathW(MAX_PATH, tempPath);
+    return std::wstring(tempPath) + L"ADReplicationInspector_last.adrs";
+}
 
-    IADsContainer* pContainer = nullptr;
-    HRESULT hr = ADsGetObject(sitesPath.c_str(), IID_IADsContainer, (void**)&pContainer);
+// USN, latency and error history, one sample per DC and link per scan
+std::shared_ptr<TimeSeriesStore> g_history = std::make_shared<TimeSeriesStore>();
 
-    if (SUCCEEDED(hr)) {
-        IEnumVARIANT* pEnum = nullptr;
-        hr = ADsBuildEnumerator(pContainer, &pEnum);
+std::wstring GetHistoryPath() {
+    wchar_t tempPath[MAX_PATH];
+    GetTempPathW(MAX_PATH, tempPath);
+    return std::wstring(tempPath) + L"ADReplicationInspector_history";
+}
 
-        if (SUCCEEDED(hr)) {
-            VARIANT var;
-            ULONG fetched = 0;
+// Alert rules, one per line (see AlertRules.h); DefaultAlertRules() without the file
+std::wstring GetAlertRulesPath() {
+    wchar_t tempPath[MAX_PATH];
+    GetTempPathW(MAX_PATH, tempPath);
+    return std::wstring(tempPath) + L"ADReplicationInspector_alerts.rules";
+}
 
-            while (S_OK == ADsEnumerateNext(pEnum, 1, &var, &fetched)) {
-                if (fetched == 0) break;
+// Evaluates the alert rules over every completed scan and poll (scanner
+// thread) and logs what fires and resolves; VerifyUSN reads the firing
+// alerts from the UI thread. Cancelled scans are skipped: the DCs they did
+// not reach would read as unknown and resolve their alerts.
+class AlertRecorder : public IScanSubscriber {
+public:
+    explicit AlertRecorder(std::vector<AlertRule> rules) : m_engine(std::move(rules)) {}
+
+    void OnScanCompleted(const SnapshotPtr& snapshot) override { Evaluate(snapshot); }
+
+    // Firing alerts as of snapshot, evaluated first if it was not (a reloaded scan)
+    std::vector<ActiveAlert> Active(const SnapshotPtr& snapshot) {
+        Evaluate(snapshot);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_engine.Active();
+    }
 
-                IADs* pADs = nullptr;
-                hr = V_DISPATCH(&var)->QueryInterface(IID_IADs, (void**)&pADs);
+    // The rule set is fixed at construction
+    const AlertRule& Rule(size_t index) const { return m_engine.Rules()[index]; }
+
+private:
+    void Evaluate(const SnapshotPtr& snapshot) {
+        if (!snapshot || snapshot->cancelled) return;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (snapshot == m_last) return;
+        m_last = snapshot;
+        const int64_t now = snapshot->completedAt ? snapshot->completedAt : UnixNowMs();
+        for (const AlertTransition& t : m_engine.Evaluate(*snapshot, now)) {
+            const AlertRule& rule = m_engine.Rules()[t.alert.rule];
+            LogMessage(t.fired ? L"Alerte déclenchée" : L"Alerte résolue",
+                       t.fired && rule.severity != AlertSeverity::Info ? LogLevel::Warning : LogLevel::Info,
+                       {{"rule", rule.name}, {"severity", AlertSeverityName(rule.severity)}, {"dc", t.alert.dc},
+                        {"source", t.alert.source}});
+        }
+    }
 
-                if (SUCCEEDED(hr)) {
-                    BSTR className = nullptr;
-                    pADs->get_Class(&className);
+    std::mutex m_mutex;
+    AlertEngine m_engine;
+    SnapshotPtr m_last;
+};
 
-                    if (className && wcscmp(className, L"site") == 0) {
-                        BSTR name = nullptr;
-                        pADs->get_Name(&name);
-                        if (name) {
-                            std::wstring siteName = name;
-                            if (siteName.find(L"CN=") == 0) {
-                                siteName = siteName.substr(3);
-                            }
-                            sites.push_back(siteName);
-                            SysFreeString(name);
-                        }
-                    }
+std::shared_ptr<AlertRecorder> g_alerts;
+
+// The rules file when it parses, the built-in rules otherwise
+std::shared_ptr<AlertRecorder> LoadAlertRecorder() {
+    std::vector<AlertRule> rules;
+    std::string error;
+    const std::wstring path = GetAlertRulesPath();
+    if (GetFileAttributesW(path.c_str()) != INVALID_FILE_ATTRIBUTES) {
+        if (LoadAlertRuleFile(path, rules, error)) {
+            LogMessage(L"Règles d'alerte chargées", LogLevel::Info, {{"path", path}, {"rules", rules.size()}});
+            return std::make_shared<AlertRecorder>(std::move(rules));
+        }
+        LogMessage(L"Règles d'alerte invalides, règles par défaut utilisées", LogLevel::Warning,
+                   {{"path", path}, {"error", error}});
+    }
+    ParseAlertRules(DefaultAlertRules(), rules, error);
+    return std::make_shared<AlertRecorder>(std::move(rules));
+}
 
-                    if (className) SysFreeString(className);
-                    pADs->Release();
-                }
+// USN stalls, rollbacks and bursts, judged on every probe of every scan and
+// poll (scanner thread), primed from the history; VerifyUSN lists them
+std::shared_ptr<UsnAnomalyMonitor> g_usnAnomalies;
 
-                VariantClear(&var);
-            }
+void LogUsnAnomaly(const UsnAnomalyEntry& e) {
+    LogMessage(L"Anomalie USN", e.anomaly.kind == UsnAnomalyKind::Restore ? LogLevel::Info : LogLevel::Warning,
+               {{"kind", UsnAnomalyKindName(e.anomaly.kind)}, {"dc", e.dc}, {"usn", e.anomaly.usn},
+                {"previous", e.anomaly.previousUsn}});
+}
 
-            ADsFreeEnumerator(pEnum);
-        }
+// Local "Directory Service" channel over the collector's lookback window;
+// with errors, also counted per (source, destination, error)
+int CheckReplicationErrors(ReplicationErrorTable* errors = nullptr) {
+    int64_t count = CountReplicationEvents(*g_eventSource, g_eventCollector->Options(), L"", errors);
+    return count < 0 ? 0 : (int)count;
+}
 
-        pContainer->Release();
+// "source -> dest : erreur N (événement X), n fois" for the most frequent triples
+std::wstring FormatReplicationErrors(const ReplicationErrorTable& table, size_t n) {
+    std::wstring text;
+    for (const ReplicationErrorEntry& e : table.Top(n)) {
+        text += L"- " + Utf8ToWide(table.Name(e.source).empty() ? std::string("?") : table.Name(e.source)) + L" -> " +
+                Utf8ToWide(table.Name(e.dest)) + L" : erreur " + std::to_wstring(e.error) + L" (événement " +
+                std::to_wstring(e.lastEventId) + L"), " + std::to_wstring(e.count) + L" fois\r\n";
     }
+    return text;
+}
 
-    return sites;
+// Presentation edge: the model stays typed, strings are produced here only
+// An imported repadmin dump answers for its DCs but carries no USN (0)
+std::wstring FormatUsn(const DcRecord& r) {
+    return r.HasUsn() && r.usn ? std::to_wstring(r.usn) : L"N/A";
 }
 
-std::vector<std::wstring> EnumerateDCsInSite(const std::wstring& siteName) {
-    std::vector<std::wstring> dcs;
+std::wstring FormatLag(LagClass lag) {
+    switch (lag) {
+        case LagClass::InSync:   return L"Synchronisé";
+        case LagClass::Minor:    return L"Léger retard";
+        case LagClass::Moderate: return L"Retard";
+        case LagClass::Severe:   return L"Retard important (vérifier)";
+        default:                 return L"N/A";
+    }
+}
 
-    std::wstring domainDN = GetDomainDN();
-    if (domainDN.empty()) return dcs;
+std::wstring FormatDuration(uint32_t seconds) {
+    if (seconds < 60) return std::to_wstring(seconds) + L" s";
+    if (seconds < 3600) return std::to_wstring(seconds / 60) + L" min";
+    if (seconds < 86400) return std::to_wstring(seconds / 3600) + L" h " + std::to_wstring(seconds % 3600 / 60) + L" min";
+    return std::to_wstring(seconds / 86400) + L" j " + std::to_wstring(seconds % 86400 / 3600) + L" h";
+}
 
-    std::wstring serversPath = L"LDAP://CN=Servers,CN=" + siteName + L",CN=Sites,CN=Configuration," + domainDN;
+// Measured latency when replica metadata was read, USN estimate otherwise
+std::wstring FormatLatency(const DcRecord& r) {
+    if (r.lag == LagClass::Unknown) return L"Calcul...";
+    if (!r.HasLatency()) return FormatLag(r.lag) + L" (USN)";
+    std::wstring text = FormatDuration(r.latencySec);
+    return r.lag == LagClass::Severe ? text + L" (vérifier)" : text;
+}
 
-    IADsContainer* pContainer = nullptr;
-    HRESULT hr = ADsGetObject(serversPath.c_str(), IID_IADsContainer, (void**)&pContainer);
+std::wstring FormatPartners(const DcRecord& r) {
+    if (r.partners == 0) return r.HasLatency() ? L"Aucun" : L"N/A";
+    std::wstring text = std::to_wstring(r.partners);
+    if (r.failingPartners > 0) text += L" (" + std::to_wstring(r.failingPartners) + L" en échec)";
+    return text;
+}
 
-    if (SUCCEEDED(hr)) {
-        IEnumVARIANT* pEnum = nullptr;
-        hr = ADsBuildEnumerator(pContainer, &pEnum);
+std::wstring FormatTimestamp(int64_t unixMs) {
+    if (unixMs <= 0) return L"N/A";
 
-        if (SUCCEEDED(hr)) {
-            VARIANT var;
-            ULONG fetched = 0;
+    ULONGLONG ticks = (ULONGLONG)unixMs * 10000 + 116444736000000000ULL;
+    FILETIME ft = {(DWORD)ticks, (DWORD)(ticks >> 32)};
+    FILETIME local;
+    SYSTEMTIME st;
+    FileTimeToLocalFileTime(&ft, &local);
+    FileTimeToSystemTime(&local, &st);
 
-            while (S_OK == ADsEnumerateNext(pEnum, 1, &var, &fetched)) {
-                if (fetched == 0) break;
+    wchar_t timeStr[100];
+    swprintf_s(timeStr, L"%04d-%02d-%02d %02d:%02d",
+             st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute);
+    return timeStr;
+}
 
-                IADs* pADs = nullptr;
-                hr = V_DISPATCH(&var)->QueryInterface(IID_IADs, (void**)&pADs);
+std::wstring FormatErrors(const DcRecord& r, const std::vector<uint32_t>& eventIds, const uint32_t* counts) {
+    if (r.events == EventState::Unavailable && r.errorTotal == 0) return L"Journal inaccessible";
+    if (r.errorTotal == 0) return r.events == EventState::Ok ? L"Aucune" : L"N/A";
+
+    std::wstring text = std::to_wstring(r.errorTotal) + L" erreur(s) (";
+    bool first = true;
+    for (size_t k = 0; k < eventIds.size(); k++) {
+        if (counts[k] == 0) continue;
+        if (!first) text += L", ";
+        text += std::to_wstring(eventIds[k]) + L":" + std::to_wstring(counts[k]);
+        first = false;
+    }
+    return text + L")";
+}
 
-                if (SUCCEEDED(hr)) {
-                    BSTR name = nullptr;
-                    pADs->get_Name(&name);
-                    if (name) {
-                        std::wstring dcName = name;
-                        if (dcName.find(L"CN=") == 0) {
-                            dcName = dcName.substr(3);
-                        }
-                        dcs.push_back(dcName);
-                        SysFreeString(name);
-                    }
-                    pADs->Release();
-                }
+// UI thread only
+void SetRowText(int index, const DcRecord& r, const std::vector<uint32_t>& eventIds, const uint32_t* counts) {
+    std::wstring usn = FormatUsn(r);
+    std::wstring partners = FormatPartners(r);
+    std::wstring lastReplication = FormatTimestamp(r.lastReplication);
+    std::wstring latency = FormatLatency(r);
+    std::wstring errors = FormatErrors(r, eventIds, counts);
+
+    ListView_SetItemText(g_hwndListView, index, 2, (LPWSTR)usn.c_str());
+    ListView_SetItemText(g_hwndListView, index, 3, (LPWSTR)partners.c_str());
+    ListView_SetItemText(g_hwndListView, index, 4, (LPWSTR)lastReplication.c_str());
+    ListView_SetItemText(g_hwndListView, index, 5, (LPWSTR)latency.c_str());
+    ListView_SetItemText(g_hwndListView, index, 6, (LPWSTR)errors.c_str());
+}
 
-                VariantClear(&var);
-            }
+// Rows are created once per scan from the topology; row index == DcId
+void OnScanStartedUi(const SnapshotPtr& topology) {
+    g_uiTopology = topology;
+    g_uiRowsReceived = 0;
 
-            ADsFreeEnumerator(pEnum);
+    SendMessageW(g_hwndListView, WM_SETREDRAW, FALSE, 0);
+    ListView_DeleteAllItems(g_hwndListView);
+    for (DcId id = 0; id < topology->model.Size(); id++) {
+        LVITEMW lvi = {};
+        lvi.mask = LVIF_TEXT;
+        lvi.iItem = (int)id;
+        lvi.pszText = (LPWSTR)topology->model.SiteName(id).c_str();
+        int index = ListView_InsertItem(g_hwndListView, &lvi);
+
+        ListView_SetItemText(g_hwndListView, index, 1, (LPWSTR)topology->model.DcName(id).c_str());
+        for (int col = 2; col <= 6; col++) {
+            ListView_SetItemText(g_hwndListView, index, col, (LPWSTR)L"...");
         }
-
-        pContainer->Release();
     }
-
-    return dcs;
+    SendMessageW(g_hwndListView, WM_SETREDRAW, TRUE, 0);
 }
 
-int CheckReplicationErrors() {
-    int errorCount = 0;
+void OnScanRowsUi(const RowBatch& batch) {
+    if (batch.topology != g_uiTopology) return;     // batch from a superseded scan
 
-    // Query Event Log for replication errors (Event IDs: 1311, 1388, 2042)
-    std::wstring query = L"*[System[(EventID=1311 or EventID=1388 or EventID=2042)]]";
+    const std::vector<uint32_t>& eventIds = batch.topology->model.eventIds;
+    SendMessageW(g_hwndListView, WM_SETREDRAW, FALSE, 0);
+    for (size_t i = 0; i < batch.rows.size(); i++) {
+        SetRowText((int)batch.rows[i].id, batch.rows[i].record, eventIds, batch.eventCounts.data() + i * eventIds.size());
+    }
+    SendMessageW(g_hwndListView, WM_SETREDRAW, TRUE, 0);
 
-    EVT_HANDLE hResults = EvtQuery(nullptr, L"Directory Service", query.c_str(),
-                                    EvtQueryChannelPath | EvtQueryReverseDirection);
+    g_uiRowsReceived += batch.rows.size();
+    std::wstring progress = L"Sondage des DCs: " + std::to_wstring(std::min(g_uiRowsReceived, batch.topology->model.Size())) +
+                            L"/" + std::to_wstring(batch.topology->model.Size());
+    SendMessageW(g_hwndStatus, SB_SETTEXTW, 0, (LPARAM)progress.c_str());
+}
 
-    if (hResults) {
-        DWORD returned = 0;
-        EVT_HANDLE events[50];
+void OnScanCompletedUi(const SnapshotPtr& snapshot) {
+    const ReplicationModel& model = snapshot->model;
+    SendMessageW(g_hwndListView, WM_SETREDRAW, FALSE, 0);
+    for (DcId id = 0; id < model.Size(); id++) {
+        SetRowText((int)id, model.records[id], model.eventIds, model.EventCountsOf(id));
+    }
+    SendMessageW(g_hwndListView, WM_SETREDRAW, TRUE, 0);
+
+    size_t probed = 0;
+    for (const DcRecord& r : model.records) probed += r.status != ProbeStatus::Cancelled ? 1 : 0;
+    std::wstring msg = snapshot->cancelled
+        ? L"Scan annulé: " + std::to_wstring(probed) + L"/" + std::to_wstring(model.Size()) + L" DC(s) sondé(s)"
+        : snapshot->polled.empty()
+        ? L"Scan terminé: " + std::to_wstring(snapshot->siteCount) + L" site(s), " +
+          std::to_wstring(model.Size()) + L" DC(s) détecté(s)"
+        : L"Surveillance: " + std::to_wstring(snapshot->polled.size()) + L" DC(s) sondé(s) à " +
+          FormatTimestamp(snapshot->completedAt);
+    SendMessageW(g_hwndStatus, SB_SETTEXTW, 0, (LPARAM)msg.c_str());
+}
 
-        if (EvtNext(hResults, 50, events, INFINITE, 0, &returned)) {
-            errorCount = returned;
+// Hands scanner notifications over to the UI thread, one message per batch
+class GuiScanSubscriber : public IScanSubscriber {
+public:
+    void OnScanStarted(const SnapshotPtr& topology) override {
+        PostMessageW(g_hwndMain, WM_APP_SCAN_STARTED, 0, (LPARAM)new SnapshotPtr(topology));
+    }
 
-            for (DWORD i = 0; i < returned; i++) {
-                EvtClose(events[i]);
-            }
-        }
+    void OnRows(const RowBatch& batch) override {
+        PostMessageW(g_hwndMain, WM_APP_SCAN_ROWS, 0, (LPARAM)new RowBatch(batch));
+    }
 
-        EvtClose(hResults);
+    void OnScanCompleted(const SnapshotPtr& snapshot) override {
+        PostMessageW(g_hwndMain, WM_APP_SCAN_COMPLETED, 0, (LPARAM)new SnapshotPtr(snapshot));
     }
+};
 
-    return errorCount;
+// Diffs a full scan against the saved one, then replaces it. The summary
+// goes to the status bar after the completion message (scanner thread).
+void SaveScanSnapshot(const ScanSnapshot& snapshot) {
+    const std::string encoded = EncodeSnapshot(snapshot);
+    SnapshotView previous, current;
+    if (previous.Open(GetSnapshotPath()) && current.Attach(encoded.data(), encoded.size())) {
+        SnapshotDiff diff = DiffSnapshots(previous, current);
+        std::wstring text = L"Depuis le scan du " + FormatTimestamp(previous.Header().completedAt) + L": ";
+        text += diff.Empty() ? std::wstring(L"aucun changement")
+            : L"+" + std::to_wstring(diff.added.size()) + L" / -" + std::to_wstring(diff.removed.size()) + L" DC(s), " +
+              std::to_wstring(diff.usnRegressions.size()) + L" régression(s) USN, " +
+              std::to_wstring(diff.newFailures.size()) + L" nouvel(s) échec(s) de partenaire, " +
+              std::to_wstring(diff.lagChanges.size()) + L" latence(s) modifiée(s)";
+        LogMessage(L"Changements depuis le scan précédent", diff.Empty() ? LogLevel::Info : LogLevel::Warning,
+                   {{"added", diff.added.size()}, {"removed", diff.removed.size()},
+                    {"usnRegressions", diff.usnRegressions.size()}, {"newFailures", diff.newFailures.size()},
+                    {"lagChanges", diff.lagChanges.size()}});
+        PostMessageW(g_hwndMain, WM_APP_SCAN_DIFF, 0, (LPARAM)new std::wstring(text));
+    }
+    previous.Close();
+    if (!WriteSnapshotFile(encoded, GetSnapshotPath())) {
+        LogMessage(L"Snapshot non enregistré", LogLevel::Warning, {{"path", GetSnapshotPath()}});
+    }
 }
 
-void ScanTopology() {
-    g_isScanning = true;
+// Shows the last saved scan straight away; a new scan replaces it
+void LoadLastSnapshot() {
+    const auto start = std::chrono::steady_clock::now();
+    SnapshotView view;
+    if (!view.Open(GetSnapshotPath())) return;
+    SnapshotPtr snapshot = view.ToSnapshot();
+    view.Close();
+    g_publisher.Publish(snapshot);
+    OnScanStartedUi(snapshot);
+    OnScanCompletedUi(snapshot);
+
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    std::wstring msg = L"Scan du " + FormatTimestamp(snapshot->completedAt) + L" rechargé (" +
+                       std::to_wstring(snapshot->model.Size()) + L" DC(s), " + std::to_wstring(ms) +
+                       L" ms) - relancez un scan pour actualiser";
+    SendMessageW(g_hwndStatus, SB_SETTEXTW, 0, (LPARAM)msg.c_str());
+    LogMessage(L"Dernier scan rechargé", LogLevel::Info, {{"dcs", snapshot->model.Size()}, {"ms", (int64_t)ms}});
+}
+
+// Runs the scan engine on this worker thread; the snapshot is published
+// atomically when done and the GUI follows through its subscriber. A
+// cancelled scan is shown but not saved: the next diff would report every
+// DC it did not reach. Returns the generation the scan published, 0 when
+// discovery found no site; once g_isScanning is cleared another scan may
+// already have replaced it.
+uint64_t ScanTopology() {
     SendMessageW(g_hwndStatus, SB_SETTEXTW, 0, (LPARAM)L"Scan de la topologie AD...");
     LogMessage(L"Démarrage scan topologie AD");
 
     HRESULT hr = CoInitializeEx(0, COINIT_MULTITHREADED);
+    auto cancel = std::make_shared<CancellationToken>();
+    {
+        std::lock_guard<std::mutex> lock(g_scanCancelMutex);
+        g_scanCancel = cancel;
+    }
+    PostMessageW(g_hwndMain, WM_APP_SCAN_ACTIVE, TRUE, 0);
+
+    std::wstring configDN = g_scanEngine.ResolveConfigurationDn(GetDomainDN);
+    SnapshotPtr snapshot = g_scanEngine.Run(g_publisher, configDN, [](ScanPhase phase) {
+        if (phase == ScanPhase::ReplicaMetadata) {
+            SendMessageW(g_hwndStatus, SB_SETTEXTW, 0, (LPARAM)L"Lecture des métadonnées de réplication...");
+        } else if (phase == ScanPhase::Events) {
+            SendMessageW(g_hwndStatus, SB_SETTEXTW, 0, (LPARAM)L"Collecte des journaux d'événements...");
+        }
+    }, cancel.get());
 
-    g_replInfo.clear();
-    ListView_DeleteAllItems(g_hwndListView);
-
-    std::vector<std::wstring> sites = EnumerateSites();
+    {
+        std::lock_guard<std::mutex> lock(g_scanCancelMutex);
+        g_scanCancel.reset();
+    }
+    PostMessageW(g_hwndMain, WM_APP_SCAN_ACTIVE, FALSE, 0);
 
-    if (sites.empty()) {
+    if (snapshot) {
+        g_eventCollector->SaveBookmarks(GetEventBookmarkPath());
+        PrometheusExporter::WriteFile(GetMetricsPath(), PrometheusExporter::Format(*snapshot, EvaluateHealth(*snapshot)));
+        if (!snapshot->cancelled) SaveScanSnapshot(*snapshot);
+    } else {
         MessageBoxW(g_hwndMain, L"Aucun site AD trouvé.\r\nVérifiez que la machine est jointe à un domaine Active Directory.",
                    L"Information", MB_OK | MB_ICONINFORMATION);
         SendMessageW(g_hwndStatus, SB_SETTEXTW, 0, (LPARAM)L"Aucun site trouvé");
-        LogMessage(L"Aucun site AD détecté");
-        g_isScanning = false;
-        CoUninitialize();
-        return;
     }
 
-    int totalDCs = 0;
-    std::map<std::wstring, LONGLONG> dcUSNs;
-
-    for (const auto& site : sites) {
-        std::vector<std::wstring> dcs = EnumerateDCsInSite(site);
-
-        for (const auto& dc : dcs) {
-            ADReplicationInfo info;
-            info.site = site;
-            info.dc = dc;
-
-            // Get USN
-            info.usn = GetHighestCommittedUSN(dc);
+    if (SUCCEEDED(hr)) CoUninitialize();
+    g_isScanning = false;
+    return snapshot ? snapshot->generation : 0;
+}
 
-            if (info.usn != L"N/A") {
-                dcUSNs[dc] = _wtoll(info.usn.c_str());
+// Continuous monitoring: after a full scan, DCs are re-polled in site
+// batches when the scheduler says they are due, lagging and failing ones
+// more often. Shares g_isScanning with the scan button, so a manual scan
+// runs between polls and the scheduler restarts from its result.
+void MonitorLoop() {
+    HRESULT hr = CoInitializeEx(0, COINIT_MULTITHREADED);
+    auto nowMs = [] {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    };
+    PollScheduler scheduler;
+    uint64_t topology = 0;
+    LogMessage(L"Surveillance démarrée");
+
+    while (g_monitoring) {
+        if (g_isScanning.exchange(true)) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            continue;
+        }
+        if (g_scanEngine.TopologyGeneration() == 0) {
+            if (ScanTopology() == 0) {                                  // clears g_isScanning
+                g_monitoring = false;
+                break;
             }
-
-            // Partners (simplified - would need DsReplicaGetInfo API for full detail)
-            info.partners = L"Multiple";
-
-            // Last Replication (approximation)
-            SYSTEMTIME st;
-            GetLocalTime(&st);
-            wchar_t timeStr[100];
-            swprintf_s(timeStr, L"%04d-%02d-%02d %02d:%02d",
-                     st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute);
-            info.lastReplication = timeStr;
-
-            // Latency (will calculate after collecting all USNs)
-            info.latency = L"Calcul...";
-
-            // Errors
-            int errors = CheckReplicationErrors();
-            info.errors = (errors > 0) ? std::to_wstring(errors) + L" erreur(s)" : L"Aucune";
-
-            g_replInfo.push_back(info);
-            totalDCs++;
-
-            // Add to ListView
-            LVITEMW lvi = {};
-            lvi.mask = LVIF_TEXT;
-            lvi.iItem = ListView_GetItemCount(g_hwndListView);
-            lvi.pszText = (LPWSTR)info.site.c_str();
-            int index = ListView_InsertItem(g_hwndListView, &lvi);
-
-            ListView_SetItemText(g_hwndListView, index, 1, (LPWSTR)info.dc.c_str());
-            ListView_SetItemText(g_hwndListView, index, 2, (LPWSTR)info.usn.c_str());
-            ListView_SetItemText(g_hwndListView, index, 3, (LPWSTR)info.partners.c_str());
-            ListView_SetItemText(g_hwndListView, index, 4, (LPWSTR)info.lastReplication.c_str());
-            ListView_SetItemText(g_hwndListView, index, 5, (LPWSTR)info.latency.c_str());
-            ListView_SetItemText(g_hwndListView, index, 6, (LPWSTR)info.errors.c_str());
+            if (g_isScanning.exchange(true)) continue;                  // a manual scan got in first
         }
-    }
-
-    // Calculate latency based on USN differences
-    if (dcUSNs.size() > 1) {
-        LONGLONG maxUSN = 0;
-        LONGLONG minUSN = LLONG_MAX;
 
-        for (const auto& pair : dcUSNs) {
-            if (pair.second > maxUSN) maxUSN = pair.second;
-            if (pair.second < minUSN) minUSN = pair.second;
+        int64_t now = nowMs();
+        SnapshotPtr current = g_publisher.Current();
+        if (topology != g_scanEngine.TopologyGeneration() && current) {
+            const ReplicationModel& model = current->model;
+            std::vector<SiteId> siteOfDc(model.Size());
+            for (DcId id = 0; id < model.Size(); id++) siteOfDc[id] = model.records[id].site;
+            scheduler.SetDcs(siteOfDc, now);
+            for (DcId id = 0; id < model.Size(); id++) scheduler.Report(id, ClassifyPoll(model.records[id]), now);
+            topology = g_scanEngine.TopologyGeneration();
         }
 
-        LONGLONG usnDiff = maxUSN - minUSN;
-
-        for (int i = 0; i < ListView_GetItemCount(g_hwndListView); i++) {
-            wchar_t dcName[256], usnStr[256];
-            ListView_GetItemText(g_hwndListView, i, 1, dcName, 256);
-            ListView_GetItemText(g_hwndListView, i, 2, usnStr, 256);
-
-            if (dcUSNs.find(dcName) != dcUSNs.end()) {
-                LONGLONG dcUSN = dcUSNs[dcName];
-                LONGLONG diff = maxUSN - dcUSN;
-
-                std::wstring latency;
-                if (diff == 0) {
-                    latency = L"Synchronisé";
-                } else if (diff < 1000) {
-                    latency = L"< 1 min";
-                } else if (diff < 10000) {
-                    latency = L"< 10 min";
-                } else {
-                    latency = L"> 10 min (vérifier)";
-                }
-
-                ListView_SetItemText(g_hwndListView, i, 5, (LPWSTR)latency.c_str());
+        std::vector<DcId> dcs;
+        for (const PollBatch& batch : scheduler.Due(now)) dcs.insert(dcs.end(), batch.dcs.begin(), batch.dcs.end());
+        if (!dcs.empty()) {
+            SnapshotPtr snapshot = g_scanEngine.Poll(g_publisher, dcs);
+            now = nowMs();
+            for (DcId id : dcs) {
+                scheduler.Report(id, snapshot ? ClassifyPoll(snapshot->model.records[id]) : PollHealth::Failing, now);
+            }
+            if (snapshot) {
+                PrometheusExporter::WriteFile(GetMetricsPath(), PrometheusExporter::Format(*snapshot, EvaluateHealth(*snapshot)));
             }
         }
-    }
+        g_isScanning = false;
 
-    std::wstring msg = L"Scan terminé: " + std::to_wstring(sites.size()) + L" site(s), " +
-                       std::to_wstring(totalDCs) + L" DC(s) détecté(s)";
-    SendMessageW(g_hwndStatus, SB_SETTEXTW, 0, (LPARAM)msg.c_str());
-    LogMessage(msg);
+        // Wakes at least every second to notice a stop or a manual scan
+        int64_t wait = std::min<int64_t>(1000, std::max<int64_t>(0, scheduler.NextWake(now) - nowMs()));
+        std::this_thread::sleep_for(std::chrono::milliseconds(wait));
+    }
 
-    CoUninitialize();
-    g_isScanning = false;
+    PostMessageW(g_hwndMain, WM_APP_MONITOR_STOPPED, 0, 0);
+    LogMessage(L"Surveillance arrêtée");
+    if (SUCCEEDED(hr)) CoUninitialize();
 }
 
 void VerifyUSN() {
     std::wstring report = L"=== VÉRIFICATION COHÉRENCE USN ===\r\n\r\n";
 
-    if (g_replInfo.empty()) {
+    SnapshotPtr snapshot = g_publisher.Current();
+    if (!snapshot || snapshot->model.Size() == 0) {
         MessageBoxW(g_hwndMain, L"Effectuez d'abord un scan de topologie.", L"Information", MB_OK | MB_ICONINFORMATION);
         return;
     }
 
-    std::map<std::wstring, LONGLONG> usnMap;
-    for (const auto& info : g_replInfo) {
-        if (info.usn != L"N/A") {
-            usnMap[info.dc] = _wtoll(info.usn.c_str());
-        }
-    }
+    const ReplicationModel& model = snapshot->model;
+    const UsnSpread& spread = snapshot->spread;
 
-    if (usnMap.size() < 2) {
+    if (spread.count < 2) {
         report += L"Pas assez de DCs pour comparaison USN.\r\n";
         MessageBoxW(g_hwndMain, report.c_str(), L"Vérification USN", MB_OK | MB_ICONINFORMATION);
         return;
     }
 
-    LONGLONG maxUSN = 0;
-    LONGLONG minUSN = LLONG_MAX;
-    std::wstring maxDC, minDC;
-
-    for (const auto& pair : usnMap) {
-        report += pair.first + L": " + std::to_wstring(pair.second) + L"\r\n";
-
-        if (pair.second > maxUSN) {
-            maxUSN = pair.second;
-            maxDC = pair.first;
-        }
-        if (pair.second < minUSN) {
-            minUSN = pair.second;
-            minDC = pair.first;
+    // USN velocity over the last 24 h from the scan history
+    const int64_t since = snapshot->completedAt - 24LL * 3600 * 1000;
+    std::vector<TimeSample> history;
+    for (DcId id = 0; id < model.Size(); id++) {
+        if (!model.records[id].HasUsn()) continue;
+        report += model.DcName(id) + L": " + std::to_wstring(model.records[id].usn);
+
+        history.clear();
+        uint32_t series = g_history->FindSeries(DcSeriesName(model.DcName(id)));
+        if (series != TimeSeriesStore::kNoRecord && g_history->Query(series, since, snapshot->completedAt, history) > 1) {
+            report += L" (~" + std::to_wstring((uint64_t)UsnRatePerHour(history)) + L" USN/h sur 24 h)";
         }
+        report += L"\r\n";
     }
 
-    LONGLONG diff = maxUSN - minUSN;
+    uint64_t diff = spread.Diff();
 
     report += L"\r\n--- Analyse ---\r\n";
-    report += L"USN le plus élevé: " + maxDC + L" (" + std::to_wstring(maxUSN) + L")\r\n";
-    report += L"USN le plus bas: " + minDC + L" (" + std::to_wstring(minUSN) + L")\r\n";
+    report += L"USN le plus élevé: " + model.DcName(spread.maxDc) + L" (" + std::to_wstring(spread.maxUsn) + L")\r\n";
+    report += L"USN le plus bas: " + model.DcName(spread.minDc) + L" (" + std::to_wstring(spread.minUsn) + L")\r\n";
     report += L"Différence: " + std::to_wstring(diff) + L"\r\n\r\n";
 
-    if (diff < 1000) {
-        report += L"STATUT: Réplication synchronisée (excellente)\r\n";
-    } else if (diff < 10000) {
-        report += L"STATUT: Réplication normale (léger retard)\r\n";
-    } else {
-        report += L"ALERTE: Retard de réplication significatif détecté!\r\n";
+    // Thresholds come from the alert rules (built in: 1000 and 10000 USN behind the highest)
+    const std::vector<ActiveAlert> alerts = g_alerts->Active(snapshot);
+    size_t critical = 0, warnings = 0;
+    std::wstring list;
+    for (size_t i = 0; i < alerts.size(); i++) {
+        const ActiveAlert& a = alerts[i];
+        const AlertRule& rule = g_alerts->Rule(a.rule);
+        critical += rule.severity == AlertSeverity::Critical ? 1 : 0;
+        warnings += rule.severity == AlertSeverity::Warning ? 1 : 0;
+        if (i == 20) list += L"... " + std::to_wstring(alerts.size() - 20) + L" autre(s)\r\n";
+        if (i >= 20) continue;
+        const wchar_t* severity = rule.severity == AlertSeverity::Critical ? L"critique"
+                                : rule.severity == AlertSeverity::Warning ? L"avertissement" : L"info";
+        list += L"[" + std::wstring(severity) + L"] " + Utf8ToWide(rule.name) + L": " + a.dc;
+        if (!a.source.empty()) list += L" <- " + a.source;
+        list += L" depuis " + FormatTimestamp(a.since) + L"\r\n";
+    }
+    if (critical > 0) {
+        report += L"ALERTE: " + std::to_wstring(critical) + L" alerte(s) critique(s) active(s)!\r\n";
         report += L"RECOMMANDATION: Vérifier la connectivité et les logs de réplication.\r\n";
+    } else if (warnings > 0) {
+        report += L"STATUT: Réplication normale, " + std::to_wstring(warnings) + L" avertissement(s)\r\n";
+    } else {
+        report += L"STATUT: Réplication synchronisée (aucune alerte)\r\n";
+    }
+    if (!list.empty()) report += L"\r\n--- Alertes actives ---\r\n" + list;
+
+    // Anomalies of the last 24 h, newest first
+    std::vector<UsnAnomalyEntry> anomalies = g_usnAnomalies->Recent();
+    anomalies.erase(std::remove_if(anomalies.begin(), anomalies.end(),
+                                   [&](const UsnAnomalyEntry& e) { return e.anomaly.time < since; }), anomalies.end());
+    std::reverse(anomalies.begin(), anomalies.end());
+    if (!anomalies.empty()) report += L"\r\n--- Anomalies USN (24 h) ---\r\n";
+    for (size_t i = 0; i < anomalies.size() && i < 20; i++) {
+        const UsnAnomaly& a = anomalies[i].anomaly;
+        report += FormatTimestamp(a.time) + L" " + anomalies[i].dc + L": ";
+        switch (a.kind) {
+            case UsnAnomalyKind::Stall:
+                report += L"USN bloqué à " + std::to_wstring(a.usn) + L" depuis " + FormatTimestamp(a.since) + L" (~" +
+                          std::to_wstring((uint64_t)a.threshold) + L" modifications attendues)";
+                break;
+            case UsnAnomalyKind::Rollback:
+                report += L"RETOUR ARRIÈRE d'USN " + std::to_wstring(a.previousUsn) + L" -> " + std::to_wstring(a.usn) +
+                          L" sans changement d'invocationId (restauration non supportée ?)";
+                break;
+            case UsnAnomalyKind::Burst:
+                report += L"rafale de " + std::to_wstring((uint64_t)a.rate) + L" USN/s (seuil " +
+                          std::to_wstring((uint64_t)a.threshold) + L")";
+                break;
+            default:
+                report += L"nouvel invocationId (DC restauré ou réinstallé), USN " + std::to_wstring(a.previousUsn) +
+                          L" -> " + std::to_wstring(a.usn);
+                break;
+        }
+        report += L"\r\n";
     }
+    if (anomalies.size() > 20) report += L"... " + std::to_wstring(anomalies.size() - 20) + L" autre(s)\r\n";
 
     MessageBoxW(g_hwndMain, report.c_str(), L"Vérification USN", MB_OK | MB_ICONINFORMATION);
-    LogMessage(L"Vérification USN effectuée - Diff: " + std::to_wstring(diff));
+    LogMessage(L"Vérification USN effectuée", LogLevel::Info,
+               {{"diff", diff}, {"alerts", alerts.size()}, {"anomalies", anomalies.size()}});
+}
+
+// Worst-case propagation delay per DC and single points of failure, from
+// the connection graph of the last scan
+void AnalyzeTopology() {
+    SnapshotPtr snapshot = g_publisher.Current();
+    if (!snapshot || snapshot->model.Size() == 0) {
+        MessageBoxW(g_hwndMain, L"Effectuez d'abord un scan de topologie.", L"Information", MB_OK | MB_ICONINFORMATION);
+        return;
+    }
+
+    const ReplicationModel& model = snapshot->model;
+    TopologyGraph graph = BuildTopologyGraph(*snapshot);
+    graph.ComputeBounds(std::max(1u, std::thread::hardware_concurrency()));
+
+    std::wstring report = L"=== ANALYSE DE LA TOPOLOGIE ===\r\n\r\n";
+    report += L"Liens de réplication: " + std::to_wstring(graph.EdgeCount()) + L"\r\n";
+    report += L"Convergence (pire cas): " + std::to_wstring(graph.ConvergenceSec() / 60) + L" min\r\n";
+    if (graph.UnreachablePairs() > 0) {
+        report += L"Paires de DCs sans chemin de réplication: " + std::to_wstring(graph.UnreachablePairs()) + L"\r\n";
+    }
+
+    std::vector<DcId> stalest(model.Size());
+    for (DcId id = 0; id < model.Size(); id++) stalest[id] = id;
+    size_t top = std::min<size_t>(10, stalest.size());
+    std::partial_sort(stalest.begin(), stalest.begin() + top, stalest.end(), [&](DcId a, DcId b) {
+        return graph.Bound(a).delaySec > graph.Bound(b).delaySec;
+    });
+    report += L"\r\n--- DCs les plus exposés au retard ---\r\n";
+    for (size_t i = 0; i < top; i++) {
+        TopologyGraph::StalenessBound b = graph.Bound(stalest[i]);
+        if (b.sources == 0) break;
+        report += model.DcName(stalest[i]) + L": " + std::to_wstring(b.delaySec / 60) + L" min depuis " +
+                  model.DcName(b.worstSource) + L" (" + std::to_wstring(b.hops) + L" sauts)\r\n";
+    }
+
+    std::vector<DcId> points = graph.ArticulationPoints();
+    report += L"\r\n--- Points de défaillance uniques (" + std::to_wstring(points.size()) + L") ---\r\n";
+    for (DcId dc : points) {
+        report += model.DcName(dc) + L" (" + model.SiteName(dc) + L")";
+        TopologyGraph::Partition partition = graph.IslandsWithout(dc);
+        if (!partition.isolatedSites.empty()) {
+            report += L": isole";
+            for (size_t k = 0; k < partition.isolatedSites.size(); k++) {
+                report += (k ? L", " : L" ") + model.sites.Name(partition.isolatedSites[k]);
+            }
+        }
+        report += L"\r\n";
+    }
+
+    MessageBoxW(g_hwndMain, report.c_str(), L"Analyse de la topologie", MB_OK | MB_ICONINFORMATION);
+    LogMessage(L"Analyse de topologie effectuée", LogLevel::Info,
+               {{"convergenceSec", graph.ConvergenceSec()}, {"articulationPoints", points.size()}});
+}
+
+// Canary objects go under Program Data, which every domain has
+std::wstring GetCanaryContainer() {
+    std::wstring domain = GetDomainDN();
+    return domain.empty() ? std::wstring() : ChildDn(L"CN", L"Program Data", domain);
+}
+
+std::wstring FormatSeconds(int64_t ms) {
+    wchar_t text[32];
+    swprintf(text, 32, L"%.1f s", ms / 1000.0);
+    return text;
+}
+
+// Writes a marker from the first DC of each site (ten at most) and times
+// its arrival on every DC of the domain, on this worker thread. Shares the
+// scan slot: "Annuler scan" stops it, and no scan runs meanwhile. The
+// report comes back to the UI thread through WM_APP_CANARY_DONE.
+void RunCanaryProbe(SnapshotPtr snapshot, std::wstring container) {
+    HRESULT hr = CoInitializeEx(0, COINIT_MULTITHREADED);
+    auto cancel = std::make_shared<CancellationToken>();
+    {
+        std::lock_guard<std::mutex> lock(g_scanCancelMutex);
+        g_scanCancel = cancel;
+    }
+    PostMessageW(g_hwndMain, WM_APP_SCAN_ACTIVE, TRUE, 0);
+
+    std::vector<ProbeTarget> targets = CanaryTargets(*snapshot, container);
+    std::vector<uint32_t> origins;
+    std::vector<bool> siteSeen(snapshot->model.sites.Size(), false);
+    for (uint32_t t = 0; t < targets.size() && origins.size() < 10; t++) {
+        if (siteSeen[targets[t].site]) continue;
+        siteSeen[targets[t].site] = true;
+        origins.push_back(t);
+    }
+
+    CanaryOptions options;
+    options.container = container;
+    options.maxInFlight = g_probeOptions.workers;
+    options.readTimeout = g_probeOptions.dcTimeout;
+    CanaryProbe probe(g_directoryBackend, options);
+    CanaryLatencyTable table;
+    const size_t total = targets.size() > 1 ? origins.size() * (targets.size() - 1) : 0;
+    size_t done = 0;
+    std::vector<CanaryResult> results = probe.Run(targets, origins, [&](const CanaryResult& r) {
+        table.Record(r, targets[r.source].site, targets[r.dest].site);
+        if (++done % 50 == 0 || done == total) {
+            std::wstring status = L"Sonde canari: " + std::to_wstring(done) + L"/" + std::to_wstring(total) + L" paire(s)";
+            SendMessageW(g_hwndStatus, SB_SETTEXTW, 0, (LPARAM)status.c_str());
+        }
+    }, cancel.get());
+
+    {
+        std::lock_guard<std::mutex> lock(g_scanCancelMutex);
+        g_scanCancel.reset();
+    }
+    PostMessageW(g_hwndMain, WM_APP_SCAN_ACTIVE, FALSE, 0);
+
+    size_t counts[5] = {};
+    for (const auto& r : results) counts[static_cast<size_t>(r.status)]++;
+    const ReplicationModel& model = snapshot->model;
+    std::wstring report = L"=== SONDE CANARI ===\r\n\r\n";
+    report += L"Conteneur: " + container + L"\r\n";
+    report += L"DC(s) d'origine: " + std::to_wstring(origins.size()) + L", paires mesurées: " + std::to_wstring(results.size()) + L"\r\n";
+    report += L"Reçu: " + std::to_wstring(counts[0]) + L", non reçu: " + std::to_wstring(counts[1]) + L", DC injoignable: " +
+              std::to_wstring(counts[2]) + L", écriture en échec: " + std::to_wstring(counts[3]);
+    if (counts[4]) report += L", annulé: " + std::to_wstring(counts[4]);
+    report += L"\r\n";
+    if (counts[3]) report += L"Vérifiez les droits d'écriture sur le conteneur.\r\n";
+
+    const std::vector<CanaryLatencyTable::Row> rows = table.Rows();
+    if (!rows.empty()) report += L"\r\n--- Propagation par paire de sites (médiane / p90 / max) ---\r\n";
+    for (size_t i = 0; i < rows.size() && i < 30; i++) {
+        const CanaryLatencyTable::Row& row = rows[i];
+        report += model.sites.Name(row.source) + L" -> " + model.sites.Name(row.dest) + L": ";
+        report += row.converged ? FormatSeconds(row.p50Ms) + L" / " + FormatSeconds(row.p90Ms) + L" / " + FormatSeconds(row.maxMs)
+                                : std::wstring(L"-");
+        if (row.failed) report += L" (" + std::to_wstring(row.failed) + L" non reçu(s))";
+        report += L"\r\n";
+    }
+    if (rows.size() > 30) report += L"... " + std::to_wstring(rows.size() - 30) + L" autre(s)\r\n";
+
+    std::vector<const CanaryResult*> slowest;
+    for (const auto& r : results) {
+        if (r.status == CanaryStatus::Converged) slowest.push_back(&r);
+    }
+    const size_t top = std::min<size_t>(10, slowest.size());
+    std::partial_sort(slowest.begin(), slowest.begin() + top, slowest.end(),
+                      [](const CanaryResult* a, const CanaryResult* b) { return a->latencyMs > b->latencyMs; });
+    if (top) report += L"\r\n--- Paires les plus lentes ---\r\n";
+    for (size_t i = 0; i < top; i++) {
+        const CanaryResult& r = *slowest[i];
+        report += targets[r.source].dc + L" -> " + targets[r.dest].dc + L": " + FormatSeconds(r.latencyMs) + L" (entre " +
+                  FormatSeconds(r.lowerMs) + L" et " + FormatSeconds(r.upperMs) + L")\r\n";
+    }
+
+    LogMessage(L"Sonde canari terminée", counts[1] + counts[2] + counts[3] ? LogLevel::Warning : LogLevel::Info,
+               {{"pairs", results.size()}, {"converged", counts[0]}, {"notConverged", counts[1]},
+                {"unreachable", counts[2]}, {"writeFailed", counts[3]}});
+    PostMessageW(g_hwndMain, WM_APP_CANARY_DONE, 0, (LPARAM)new std::wstring(report));
+
+    if (SUCCEEDED(hr)) CoUninitialize();
+    g_isScanning = false;
+}
+
+// Reads a repadmin dump on this worker thread and shows it like a scan. It
+// is neither saved as the last scan nor recorded in the history: without
+// USN it would pass for a rollback of every DC.
+void ImportRepadminDump(std::wstring path) {
+    RepadminImportStats stats;
+    SnapshotPtr snapshot;
+    std::string error;
+    if (!ImportRepadminFile(path, RepadminImportOptions(), snapshot, stats, error)) {
+        std::wstring msg = L"Import impossible de " + path + L":\r\n" + Utf8ToWide(error.data(), error.size());
+        MessageBoxW(g_hwndMain, msg.c_str(), L"Import repadmin", MB_OK | MB_ICONWARNING);
+        SendMessageW(g_hwndStatus, SB_SETTEXTW, 0, (LPARAM)L"Import repadmin échoué");
+        LogMessage(L"Échec import repadmin", LogLevel::Error, {{"path", path}, {"error", error}});
+        g_isScanning = false;
+        return;
+    }
+    g_publisher.Publish(snapshot);
+    PostMessageW(g_hwndMain, WM_APP_SCAN_STARTED, 0, (LPARAM)new SnapshotPtr(snapshot));
+    PostMessageW(g_hwndMain, WM_APP_SCAN_COMPLETED, 0, (LPARAM)new SnapshotPtr(snapshot));
+
+    const int64_t ms = static_cast<int64_t>(stats.splitMs + stats.parseMs + stats.mergeMs);
+    std::wstring text = L"repadmin " + Utf8ToWide(RepadminFormatName(stats.format)) + L" du " +
+                        FormatTimestamp(stats.dumpTime) + L" importé: " + std::to_wstring(snapshot->model.Size()) +
+                        L" DC(s), " + std::to_wstring(stats.rows) + L" ligne(s) (" + std::to_wstring(stats.superseded) +
+                        L" remplacée(s)), " + std::to_wstring(ms) + L" ms";
+    PostMessageW(g_hwndMain, WM_APP_SCAN_DIFF, 0, (LPARAM)new std::wstring(text));
+    LogMessage(L"Sortie repadmin importée", LogLevel::Info,
+               {{"path", path}, {"format", RepadminFormatName(stats.format)}, {"rows", stats.rows}, {"ms", ms}});
+    g_isScanning = false;
+}
+
+// repadmin /showrepl * /csv > dump.csv, or /replsummary > resume.txt, run
+// where the GUI cannot reach the DCs itself
+void ImportRepadmin() {
+    wchar_t fileName[MAX_PATH] = L"";
+    OPENFILENAMEW ofn = {};
+    ofn.lStructSize = sizeof(ofn);
+    ofn.hwndOwner = g_hwndMain;
+    ofn.lpstrFile = fileName;
+    ofn.nMaxFile = MAX_PATH;
+    ofn.lpstrFilter = L"repadmin /showrepl /csv\0*.csv\0repadmin /replsummary\0*.txt\0All Files\0*.*\0";
+    ofn.Flags = OFN_FILEMUSTEXIST | OFN_PATHMUSTEXIST;
+    if (!GetOpenFileNameW(&ofn)) return;
+
+    if (g_isScanning.exchange(true)) {
+        MessageBoxW(g_hwndMain, L"Un scan est en cours, réessayez à la fin.", L"Information", MB_OK | MB_ICONINFORMATION);
+        return;
+    }
+    SendMessageW(g_hwndStatus, SB_SETTEXTW, 0, (LPARAM)L"Import de la sortie repadmin...");
+    std::thread(ImportRepadminDump, std::wstring(fileName)).detach();
 }
 
 void TestReplication() {
@@ -438,25 +847,61 @@ void TestReplication() {
     msg += L"1. repadmin /showrepl - Affiche statut réplication\r\n";
     msg += L"2. repadmin /replsummary - Résumé réplication\r\n";
     msg += L"3. dcdiag /test:replications - Diagnostic complet\r\n";
-    msg += L"4. repadmin /syncall /AdeP - Force synchronisation\r\n\r\n";
+    msg += L"4. repadmin /syncall /AdeP - Force synchronisation\r\n";
+    msg += L"Les sorties de repadmin /showrepl * /csv et /replsummary s'ouvrent avec \"Importer repadmin\".\r\n\r\n";
 
-    int errors = CheckReplicationErrors();
+    ReplicationErrorTable local;
+    int errors = CheckReplicationErrors(&local);
     msg += L"Erreurs de réplication détectées dans les logs: " + std::to_wstring(errors) + L"\r\n\r\n";
 
     if (errors > 0) {
         msg += L"Event IDs concernés:\r\n";
         msg += L"- 1311: Le Knowledge Consistency Checker (KCC) a détecté des problèmes\r\n";
-        msg += L"- 1388: Échec de réplication avec un DC source\r\n";
+        msg += L"- 1388 / 1988: Objet persistant reçu ou bloqué depuis un DC source\r\n";
+        msg += L"- 1925: Liaison de réplication impossible à établir\r\n";
         msg += L"- 2042: Échec de réplication pendant trop longtemps\r\n";
+        msg += L"- 2087 / 2088: Résolution DNS du DC source en échec\r\n";
+        if (!local.Empty()) msg += L"\r\nSource -> destination (journal local):\r\n" + FormatReplicationErrors(local, 10);
     } else {
         msg += L"Aucune erreur de réplication critique détectée dans les logs.\r\n";
     }
 
-    MessageBoxW(g_hwndMain, msg.c_str(), L"Test Réplication", MB_OK | MB_ICONINFORMATION);
-    LogMessage(L"Test réplication - Erreurs: " + std::to_wstring(errors));
+    SnapshotPtr snapshot = g_publisher.Current();
+    if (snapshot && snapshot->replicationErrors && !snapshot->replicationErrors->Empty()) {
+        msg += L"\r\nSource -> destination (dernier scan, tous les DCs):\r\n" +
+               FormatReplicationErrors(*snapshot->replicationErrors, 10);
+    }
+
+    // The active probe needs a scan (the DCs to read) and a domain
+    const std::wstring container = snapshot && snapshot->model.Size() > 1 ? GetCanaryContainer() : std::wstring();
+    if (container.empty()) {
+        MessageBoxW(g_hwndMain, msg.c_str(), L"Test Réplication", MB_OK | MB_ICONINFORMATION);
+        LogMessage(L"Test réplication", LogLevel::Info, {{"errors", errors}});
+        return;
+    }
+    msg += L"\r\nMesurer la propagation réelle ? Un marqueur horodaté sera écrit sur un objet canari sous\r\n" +
+           container + L"\r\ndepuis un DC par site, puis relu sur chaque DC (droits d'écriture requis).";
+    int answer = MessageBoxW(g_hwndMain, msg.c_str(), L"Test Réplication", MB_YESNO | MB_ICONQUESTION);
+    LogMessage(L"Test réplication", LogLevel::Info, {{"errors", errors}});
+    if (answer != IDYES) return;
+    if (g_isScanning.exchange(true)) {
+        MessageBoxW(g_hwndMain, L"Un scan est en cours, réessayez à la fin.", L"Information", MB_OK | MB_ICONINFORMATION);
+        return;
+    }
+    SendMessageW(g_hwndStatus, SB_SETTEXTW, 0, (LPARAM)L"Sonde canari: écriture des marqueurs...");
+    LogMessage(L"Démarrage sonde canari", LogLevel::Info, {{"container", container}});
+    std::thread(RunCanaryProbe, snapshot, container).detach();
 }
 
+// Exports the last completed scan straight from the model; the filter
+// chosen in the dialog selects the format
 void ExportReport() {
+    SnapshotPtr snapshot = g_publisher.Current();
+    if (!snapshot || snapshot->model.Size() == 0) {
+        MessageBoxW(g_hwndMain, L"Effectuez d'abord un scan de topologie.", L"Information", MB_OK | MB_ICONINFORMATION);
+        return;
+    }
+
     wchar_t fileName[MAX_PATH] = L"ADReplicationInspector_Report.csv";
 
     OPENFILENAMEW ofn = {};
@@ -464,50 +909,20 @@ void ExportReport() {
     ofn.hwndOwner = g_hwndMain;
     ofn.lpstrFile = fileName;
     ofn.nMaxFile = MAX_PATH;
-    ofn.lpstrFilter = L"CSV Files\0*.csv\0All Files\0*.*\0";
+    ofn.lpstrFilter = L"CSV (UTF-8)\0*.csv\0NDJSON\0*.ndjson\0Binaire compact\0*.adrx\0All Files\0*.*\0";
     ofn.lpstrDefExt = L"csv";
     ofn.Flags = OFN_OVERWRITEPROMPT;
 
-    if (GetSaveFileNameW(&ofn)) {
-        std::wofstream csvFile(fileName, std::ios::out | std::ios::binary);
-        if (csvFile.is_open()) {
-            // UTF-8 BOM
-            csvFile.put(0xEF);
-            csvFile.put(0xBB);
-            csvFile.put(0xBF);
-
-            csvFile << L"Site,DC,USN,Partenaires,DernièreRéplic,Latence,Erreurs\n";
-
-            int itemCount = ListView_GetItemCount(g_hwndListView);
-            for (int i = 0; i < itemCount; i++) {
-                wchar_t buffer[1024];
-
-                ListView_GetItemText(g_hwndListView, i, 0, buffer, 1024);
-                csvFile << L"\"" << buffer << L"\",";
-
-                ListView_GetItemText(g_hwndListView, i, 1, buffer, 1024);
-                csvFile << L"\"" << buffer << L"\",";
-
-                ListView_GetItemText(g_hwndListView, i, 2, buffer, 1024);
-                csvFile << L"\"" << buffer << L"\",";
-
-                ListView_GetItemText(g_hwndListView, i, 3, buffer, 1024);
-                csvFile << L"\"" << buffer << L"\",";
-
-                ListView_GetItemText(g_hwndListView, i, 4, buffer, 1024);
-                csvFile << L"\"" << buffer << L"\",";
-
-                ListView_GetItemText(g_hwndListView, i, 5, buffer, 1024);
-                csvFile << L"\"" << buffer << L"\",";
-
-                ListView_GetItemText(g_hwndListView, i, 6, buffer, 1024);
-                csvFile << L"\"" << buffer << L"\"\n";
-            }
+    if (!GetSaveFileNameW(&ofn)) return;
 
-            csvFile.close();
-            MessageBoxW(g_hwndMain, L"Export CSV réussi!", L"Succès", MB_OK | MB_ICONINFORMATION);
-            LogMessage(L"Export CSV vers: " + std::wstring(fileName));
-        }
+    ExportFormat format = ofn.nFilterIndex == 2 ? ExportFormat::Ndjson
+                        : ofn.nFilterIndex == 3 ? ExportFormat::Binary : ExportFormat::Csv;
+    if (ExportSnapshot(*snapshot, format, fileName)) {
+        MessageBoxW(g_hwndMain, L"Export réussi!", L"Succès", MB_OK | MB_ICONINFORMATION);
+        LogMessage(L"Export", LogLevel::Info, {{"path", fileName}, {"format", (int)format}, {"rows", snapshot->model.Size()}});
+    } else {
+        MessageBoxW(g_hwndMain, L"Échec de l'écriture du fichier d'export.", L"Erreur", MB_OK | MB_ICONERROR);
+        LogMessage(L"Échec export", LogLevel::Error, {{"path", fileName}});
     }
 }
 
@@ -531,6 +946,22 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
                            WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
                            470, 10, 100, 30, hwnd, (HMENU)1004, nullptr, nullptr);
 
+            CreateWindowExW(0, L"BUTTON", L"Analyser topologie",
+                           WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+                           580, 10, 150, 30, hwnd, (HMENU)1006, nullptr, nullptr);
+
+            g_hwndMonitor = CreateWindowExW(0, L"BUTTON", L"Surveillance",
+                                            WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+                                            740, 10, 150, 30, hwnd, (HMENU)1007, nullptr, nullptr);
+
+            g_hwndCancel = CreateWindowExW(0, L"BUTTON", L"Annuler scan",
+                                           WS_CHILD | WS_VISIBLE | WS_DISABLED | BS_PUSHBUTTON,
+                                           900, 10, 120, 30, hwnd, (HMENU)1008, nullptr, nullptr);
+
+            CreateWindowExW(0, L"BUTTON", L"Importer repadmin",
+                           WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
+                           1030, 10, 150, 30, hwnd, (HMENU)1009, nullptr, nullptr);
+
             // ListView
             g_hwndListView = CreateWindowExW(0, WC_LISTVIEWW, nullptr,
                                              WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_SINGLESEL | WS_BORDER,
@@ -574,14 +1005,27 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
                                           0, 0, 0, 0, hwnd, nullptr, nullptr, nullptr);
             SendMessageW(g_hwndStatus, SB_SETTEXTW, 0, (LPARAM)L"Prêt - Ayi NEDJIMI Consultants");
 
+            g_eventCollector->LoadBookmarks(GetEventBookmarkPath());
+            g_publisher.Subscribe(std::make_shared<GuiScanSubscriber>());
+            g_usnAnomalies = std::make_shared<UsnAnomalyMonitor>(UsnAnomalyOptions(), LogUsnAnomaly);
+            if (g_history->Open(GetHistoryPath())) {
+                g_publisher.Subscribe(std::make_shared<HistoryRecorder>(g_history));
+                g_usnAnomalies->SetHistory(g_history);
+            } else {
+                LogMessage(L"Historique indisponible", LogLevel::Warning, {{"path", GetHistoryPath()}});
+            }
+            g_publisher.Subscribe(g_usnAnomalies);
+            g_alerts = LoadAlertRecorder();
+            g_publisher.Subscribe(g_alerts);
             LogMessage(L"ADReplicationInspector démarré");
+            LoadLastSnapshot();
             break;
         }
 
         case WM_COMMAND: {
             switch (LOWORD(wParam)) {
                 case 1001: // Scanner topologie
-                    if (!g_isScanning) {
+                    if (!g_isScanning.exchange(true)) {
                         std::thread(ScanTopology).detach();
                     }
                     break;
@@ -597,10 +1041,79 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
                 case 1004: // Exporter
                     ExportReport();
                     break;
+
+                case 1006: // Analyser topologie
+                    AnalyzeTopology();
+                    break;
+
+                case 1007: // Surveillance
+                    if (!g_monitoring.exchange(true)) {
+                        SetWindowTextW(g_hwndMonitor, L"Arrêter surveillance");
+                        std::thread(MonitorLoop).detach();
+                    } else {
+                        g_monitoring = false;
+                        EnableWindow(g_hwndMonitor, FALSE);     // until the loop has exited
+                    }
+                    break;
+
+                case 1008: { // Annuler scan
+                    std::lock_guard<std::mutex> lock(g_scanCancelMutex);
+                    if (g_scanCancel) {
+                        g_scanCancel->Cancel();
+                        EnableWindow(g_hwndCancel, FALSE);
+                        SendMessageW(g_hwndStatus, SB_SETTEXTW, 0, (LPARAM)L"Annulation du scan...");
+                        LogMessage(L"Annulation du scan demandée");
+                    }
+                    break;
+                }
+
+                case 1009: // Importer repadmin
+                    ImportRepadmin();
+                    break;
             }
             break;
         }
 
+        case WM_APP_MONITOR_STOPPED:
+            SetWindowTextW(g_hwndMonitor, L"Surveillance");
+            EnableWindow(g_hwndMonitor, TRUE);
+            break;
+
+        case WM_APP_SCAN_ACTIVE:
+            EnableWindow(g_hwndCancel, wParam ? TRUE : FALSE);
+            break;
+
+        case WM_APP_SCAN_STARTED: {
+            std::unique_ptr<SnapshotPtr> topology((SnapshotPtr*)lParam);
+            OnScanStartedUi(*topology);
+            break;
+        }
+
+        case WM_APP_SCAN_ROWS: {
+            std::unique_ptr<RowBatch> batch((RowBatch*)lParam);
+            OnScanRowsUi(*batch);
+            break;
+        }
+
+        case WM_APP_SCAN_COMPLETED: {
+            std::unique_ptr<SnapshotPtr> snapshot((SnapshotPtr*)lParam);
+            OnScanCompletedUi(*snapshot);
+            break;
+        }
+
+        case WM_APP_CANARY_DONE: {
+            std::unique_ptr<std::wstring> report((std::wstring*)lParam);
+            SendMessageW(g_hwndStatus, SB_SETTEXTW, 0, (LPARAM)L"Sonde canari terminée");
+            MessageBoxW(hwnd, report->c_str(), L"Sonde canari", MB_OK | MB_ICONINFORMATION);
+            break;
+        }
+
+        case WM_APP_SCAN_DIFF: {
+            std::unique_ptr<std::wstring> text((std::wstring*)lParam);
+            SendMessageW(g_hwndStatus, SB_SETTEXTW, 0, (LPARAM)text->c_str());
+            break;
+        }
+
         case WM_SIZE: {
             RECT rect;
             GetClientRect(hwnd, &rect);
@@ -619,6 +1132,10 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 }
 
 int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, LPWSTR, int nCmdShow) {
+    LoggerOptions logOptions;
+    logOptions.path = GetLogPath();
+    g_logger.Start(logOptions);
+
     INITCOMMONCONTROLSEX icex = {};
     icex.dwSize = sizeof(icex);
     icex.dwICC = ICC_LISTVIEW_CLASSES | ICC_BAR_CLASSES;
@@ -650,5 +1167,7 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE, LPWSTR, int nCmdShow) {
         DispatchMessage(&msg);
     }
 
+    g_directoryBackend->CloseSessions();
+    g_logger.Stop();
     return (int)msg.wParam;
 }
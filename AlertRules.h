@@ -0,0 +1,1162 @@
+// AlertRules.h
+// Règles d'alerte compilées : conditions sur les métriques par DC et par partenaire, sélecteurs, durées et hystérésis
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "LatencyMatrix.h"
+#include "MappedFile.h"
+#include "ReplicationModel.h"
+#include "ScanSnapshot.h"
+#include "Utf8.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cwctype>
+#include <filesystem>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+// One rule per line, '#' starts a comment:
+//
+//   alert <name> [severity=info|warning|critical] [for=<duration>] [keep=<duration>]
+//                [site=<globs>] [dc=<globs>] [source=<globs>] when <expr> [clear <expr>]
+//
+// The condition must hold for `for` before the alert fires. A firing alert
+// resolves once its clear condition (by default: the when condition is
+// false) has held for `keep`; a clear condition with its own threshold gives
+// hysteresis. Globs use * and ?, case-insensitive, comma-separated. Rules
+// using a partner_* metric or source= get one sample per inbound partner
+// and naming context instead of one per DC; DC metrics then refer to the
+// destination. Times are in seconds; numbers take s, m, h, d (durations)
+// or k, M (thousands, millions) suffixes. An unknown metric value (DC not
+// reached, no replica metadata) makes comparisons unknown, and an unknown
+// condition never fires.
+enum class AlertMetric : uint8_t {
+    Usn,
+    UsnBehind,                          // highest USN of the scan minus this DC's
+    Latency,                            // oldest inbound up-to-dateness cursor, seconds
+    Partners,
+    FailingPartners,
+    Errors,                             // replication events over the collection window
+    ProbeMs,
+    Reachable,                          // 1 answered, 0 failed or timed out
+    Timeout,
+    Lag,                                // LagClass, compared with in_sync, minor, moderate, severe
+    ReplicationAge,                     // seconds since the last successful inbound replication
+    EventsUnavailable,
+    PartnerFailures,                    // consecutive failures of the inbound link
+    PartnerAge,                         // seconds since its last success, at read time
+    PartnerAttemptAge,
+    PartnerResult,                      // Win32 status of the last attempt
+    PartnerUsnBehind,                   // source's USN minus what the destination synced from it
+    Count
+};
+
+const size_t kAlertMetricCount = static_cast<size_t>(AlertMetric::Count);
+const size_t kFirstPartnerMetric = static_cast<size_t>(AlertMetric::PartnerFailures);
+
+inline const char* AlertMetricName(AlertMetric metric) {
+    static const char* const kNames[kAlertMetricCount] = {
+        "usn", "usn_behind", "latency", "partners", "failing_partners", "errors", "probe_ms", "reachable", "timeout",
+        "lag", "replication_age", "events_unavailable", "partner_failures", "partner_age", "partner_attempt_age",
+        "partner_result", "partner_usn_behind",
+    };
+    return metric < AlertMetric::Count ? kNames[static_cast<size_t>(metric)] : "";
+}
+
+enum class AlertSeverity : uint8_t {
+    Info,
+    Warning,
+    Critical
+};
+
+inline const char* AlertSeverityName(AlertSeverity severity) {
+    switch (severity) {
+        case AlertSeverity::Info:     return "info";
+        case AlertSeverity::Critical: return "critical";
+        default:                      return "warning";
+    }
+}
+
+enum class AlertOp : uint8_t {
+    Const, Metric, Neg, Not, Add, Sub, Mul, Div, Lt, Le, Gt, Ge, Eq, Ne, And, Or
+};
+
+// Parsed condition, kept for the reference evaluator (EvaluateAlertExpr)
+struct AlertNode {
+    AlertOp op = AlertOp::Const;
+    AlertMetric metric = AlertMetric::Usn;
+    uint32_t left = 0;
+    uint32_t right = 0;
+    double value = 0;
+};
+
+struct AlertExpr {
+    std::vector<AlertNode> nodes;
+    uint32_t root = 0;
+    uint32_t metrics = 0;               // bit per AlertMetric used
+
+    bool Empty() const { return nodes.empty(); }
+};
+
+// Unknown values (NaN, and the infinities a division by zero gives)
+// propagate through arithmetic and comparisons; and/or/not follow
+// three-valued logic, so "false and unknown" is false. Written as selects
+// between constants and min/max over truth levels, with no arithmetic
+// under a condition, so AlertVm's loops vectorize; the tree walk uses the
+// same functions.
+namespace AlertLogic {
+// (x - x) is 0 for a known x, NaN otherwise
+inline double Known(double a, double b) { return (a - a) + (b - b); }
+// Truth level: 0 false, 1 true, 0.5 unknown
+inline double Level(double v) {
+    const double known = v - v == 0 ? 1.0 : 0.5;
+    return v == 0 ? 0.0 : known;
+}
+inline double FromLevel(double t) { return t == 0.5 ? std::numeric_limits<double>::quiet_NaN() : t; }
+inline bool True(double v) { return Level(v) == 1.0; }
+inline double Lt(double a, double b) { return Known(a, b) + (a < b ? 1.0 : 0.0); }
+inline double Le(double a, double b) { return Known(a, b) + (a <= b ? 1.0 : 0.0); }
+inline double Gt(double a, double b) { return Known(a, b) + (a > b ? 1.0 : 0.0); }
+inline double Ge(double a, double b) { return Known(a, b) + (a >= b ? 1.0 : 0.0); }
+inline double Eq(double a, double b) { return Known(a, b) + (a == b ? 1.0 : 0.0); }
+inline double Ne(double a, double b) { return Known(a, b) + (a != b ? 1.0 : 0.0); }
+inline double And(double a, double b) {
+    const double ta = Level(a), tb = Level(b);
+    return FromLevel(ta < tb ? ta : tb);
+}
+inline double Or(double a, double b) {
+    const double ta = Level(a), tb = Level(b);
+    return FromLevel(ta > tb ? ta : tb);
+}
+inline double Not(double a) { return FromLevel(1.0 - Level(a)); }
+}
+
+inline double ApplyAlertOp(AlertOp op, double a, double b) {
+    switch (op) {
+        case AlertOp::Neg: return -a;
+        case AlertOp::Not: return AlertLogic::Not(a);
+        case AlertOp::Add: return a + b;
+        case AlertOp::Sub: return a - b;
+        case AlertOp::Mul: return a * b;
+        case AlertOp::Div: return a / b;
+        case AlertOp::Lt:  return AlertLogic::Lt(a, b);
+        case AlertOp::Le:  return AlertLogic::Le(a, b);
+        case AlertOp::Gt:  return AlertLogic::Gt(a, b);
+        case AlertOp::Ge:  return AlertLogic::Ge(a, b);
+        case AlertOp::Eq:  return AlertLogic::Eq(a, b);
+        case AlertOp::Ne:  return AlertLogic::Ne(a, b);
+        case AlertOp::And: return AlertLogic::And(a, b);
+        case AlertOp::Or:  return AlertLogic::Or(a, b);
+        default:           return a;
+    }
+}
+
+// Tree walk over one sample's metric values; the compiled program must agree
+inline double EvaluateAlertExpr(const AlertExpr& expr, const double* values, uint32_t node) {
+    const AlertNode& n = expr.nodes[node];
+    switch (n.op) {
+        case AlertOp::Const:  return n.value;
+        case AlertOp::Metric: return values[static_cast<size_t>(n.metric)];
+        case AlertOp::Neg:
+        case AlertOp::Not:    return ApplyAlertOp(n.op, EvaluateAlertExpr(expr, values, n.left), 0);
+        default:
+            return ApplyAlertOp(n.op, EvaluateAlertExpr(expr, values, n.left), EvaluateAlertExpr(expr, values, n.right));
+    }
+}
+
+inline double EvaluateAlertExpr(const AlertExpr& expr, const double* values) {
+    return expr.Empty() ? 0 : EvaluateAlertExpr(expr, values, expr.root);
+}
+
+// Postfix code over columns of samples. Constants are folded, and a binary
+// operator whose right operand is a constant carries it as an immediate, so
+// "metric > 1000" is two instructions and touches no scratch column.
+struct AlertInstr {
+    AlertOp op = AlertOp::Const;
+    AlertMetric metric = AlertMetric::Usn;
+    bool immediate = false;             // binary op: right operand is value
+    double value = 0;
+};
+
+struct AlertProgram {
+    static const size_t kMaxDepth = 16;
+    std::vector<AlertInstr> code;
+    size_t depth = 0;                   // stack slots needed
+
+    bool Empty() const { return code.empty(); }
+};
+
+inline bool CompileAlertExpr(const AlertExpr& expr, AlertProgram& program, std::string& error) {
+    program = AlertProgram();
+    if (expr.Empty()) return true;
+    bool tooDeep = false;
+
+    // Folded value of constant subtrees, computed bottom-up
+    std::vector<AlertNode> folded = expr.nodes;
+    std::vector<bool> isConst(expr.nodes.size(), false);
+    auto fold = [&](auto& self, uint32_t node) -> void {
+        AlertNode& n = folded[node];
+        if (n.op == AlertOp::Const) {
+            isConst[node] = true;
+            return;
+        }
+        if (n.op == AlertOp::Metric) return;
+        self(self, n.left);
+        const bool unary = n.op == AlertOp::Neg || n.op == AlertOp::Not;
+        if (!unary) self(self, n.right);
+        if (isConst[n.left] && (unary || isConst[n.right])) {
+            n.value = ApplyAlertOp(n.op, folded[n.left].value, unary ? 0 : folded[n.right].value);
+            n.op = AlertOp::Const;
+            isConst[node] = true;
+        }
+    };
+    fold(fold, expr.root);
+
+    size_t depth = 0;
+    auto emit = [&](auto& self, uint32_t node) -> void {
+        const AlertNode& n = folded[node];
+        AlertInstr instr;
+        instr.op = n.op;
+        if (n.op == AlertOp::Const || n.op == AlertOp::Metric) {
+            instr.metric = n.metric;
+            instr.value = n.value;
+            program.code.push_back(instr);
+            program.depth = std::max(program.depth, ++depth);
+            tooDeep = tooDeep || depth > AlertProgram::kMaxDepth;
+            return;
+        }
+        self(self, n.left);
+        if (n.op != AlertOp::Neg && n.op != AlertOp::Not) {
+            if (isConst[n.right] && std::isfinite(folded[n.right].value)) {
+                instr.immediate = true;
+                instr.value = folded[n.right].value;
+            } else {
+                self(self, n.right);
+                depth--;
+            }
+        }
+        program.code.push_back(instr);
+    };
+    emit(emit, expr.root);
+    if (tooDeep) {
+        error = "expression trop imbriquée";
+        return false;
+    }
+    return true;
+}
+
+struct AlertRule {
+    std::string name;
+    size_t line = 0;
+    AlertSeverity severity = AlertSeverity::Warning;
+    bool partner = false;               // one sample per inbound partner
+    int64_t forMs = 0;
+    int64_t keepMs = 0;
+    std::vector<std::wstring> sites;    // globs; empty matches everything
+    std::vector<std::wstring> dcs;
+    std::vector<std::wstring> sources;
+    AlertExpr when;
+    AlertExpr clear;                    // empty: the alert clears when `when` no longer holds
+    AlertProgram whenCode;
+    AlertProgram clearCode;
+
+    bool HasSelector() const { return !sites.empty() || !dcs.empty() || !sources.empty(); }
+};
+
+// Case-insensitive, * any run, ? any one character
+inline bool AlertGlobMatch(const std::wstring& pattern, const std::wstring& text) {
+    size_t p = 0, t = 0, star = std::wstring::npos, mark = 0;
+    while (t < text.size()) {
+        if (p < pattern.size() && (pattern[p] == L'?' || std::towlower(pattern[p]) == std::towlower(text[t]))) {
+            p++;
+            t++;
+        } else if (p < pattern.size() && pattern[p] == L'*') {
+            star = p++;
+            mark = t;
+        } else if (star != std::wstring::npos) {
+            p = star + 1;
+            t = ++mark;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == L'*') p++;
+    return p == pattern.size();
+}
+
+inline bool AlertSelectorMatch(const std::vector<std::wstring>& globs, const std::wstring& text) {
+    if (globs.empty()) return true;
+    for (const std::wstring& glob : globs) {
+        if (AlertGlobMatch(glob, text)) return true;
+    }
+    return false;
+}
+
+// Recursive descent over one rule line. Precedence, lowest first: or, and,
+// not, comparisons, + -, * /, unary minus.
+class AlertRuleParser {
+public:
+    // Returns false with "ligne N: ..." in error on the first bad rule
+    static bool Parse(std::string_view text, std::vector<AlertRule>& rules, std::string& error) {
+        rules.clear();
+        size_t line = 0;
+        for (size_t pos = 0; pos <= text.size();) {
+            size_t end = text.find('\n', pos);
+            if (end == std::string_view::npos) end = text.size();
+            line++;
+            std::string_view content = text.substr(pos, end - pos);
+            pos = end + 1;
+            const size_t hash = content.find('#');
+            if (hash != std::string_view::npos) content = content.substr(0, hash);
+
+            AlertRuleParser parser(content);
+            parser.SkipSpace();
+            if (parser.AtEnd()) continue;
+            AlertRule rule;
+            rule.line = line;
+            if (!parser.ParseRule(rule)) {
+                error = "ligne " + std::to_string(line) + ": " + parser.m_error;
+                return false;
+            }
+            for (const AlertRule& other : rules) {
+                if (other.name == rule.name) {
+                    error = "ligne " + std::to_string(line) + ": règle " + rule.name + " déjà définie ligne " +
+                            std::to_string(other.line);
+                    return false;
+                }
+            }
+            rules.push_back(std::move(rule));
+        }
+        return true;
+    }
+
+private:
+    explicit AlertRuleParser(std::string_view text) : m_text(text) {}
+
+    bool AtEnd() const { return m_pos >= m_text.size(); }
+
+    void SkipSpace() {
+        while (m_pos < m_text.size() && (m_text[m_pos] == ' ' || m_text[m_pos] == '\t' || m_text[m_pos] == '\r')) m_pos++;
+    }
+
+    bool Fail(const std::string& message) {
+        if (m_error.empty()) m_error = message + " (colonne " + std::to_string(m_pos + 1) + ")";
+        return false;
+    }
+
+    // Identifiers and numbers; rule names may also contain - and .
+    static bool WordChar(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '.';
+    }
+
+    std::string_view Word(bool name = false) {
+        SkipSpace();
+        const size_t start = m_pos;
+        while (m_pos < m_text.size() && (WordChar(m_text[m_pos]) || (name && m_text[m_pos] == '-'))) m_pos++;
+        return m_text.substr(start, m_pos - start);
+    }
+
+    // Up to the next blank: the value of a key=value option
+    std::string_view OptionValue() {
+        const size_t start = m_pos;
+        while (m_pos < m_text.size() && m_text[m_pos] != ' ' && m_text[m_pos] != '\t' && m_text[m_pos] != '\r') m_pos++;
+        return m_text.substr(start, m_pos - start);
+    }
+
+    // Number with an optional unit suffix; times are normalised to seconds
+    static bool ParseNumber(std::string_view text, double& value) {
+        if (text.empty()) return false;
+        double scale = 1;
+        switch (text.back()) {
+            case 's': scale = 1; break;
+            case 'm': scale = 60; break;
+            case 'h': scale = 3600; break;
+            case 'd': scale = 86400; break;
+            case 'k': scale = 1e3; break;
+            case 'M': scale = 1e6; break;
+            default:  scale = 0; break;
+        }
+        if (scale != 0) {
+            text.remove_suffix(1);
+        } else {
+            scale = 1;
+        }
+        const std::string digits(text);
+        if (digits.empty() || digits.find_first_not_of("0123456789.") != std::string::npos) return false;
+        char* end = nullptr;
+        value = std::strtod(digits.c_str(), &end) * scale;
+        return end == digits.c_str() + digits.size();
+    }
+
+    static bool ParseGlobs(std::string_view text, std::vector<std::wstring>& globs) {
+        for (size_t pos = 0; pos <= text.size();) {
+            size_t comma = text.find(',', pos);
+            if (comma == std::string_view::npos) comma = text.size();
+            if (comma == pos) return false;
+            globs.push_back(Utf8ToWide(std::string(text.substr(pos, comma - pos))));
+            pos = comma + 1;
+        }
+        return !globs.empty();
+    }
+
+    bool ParseRule(AlertRule& rule) {
+        if (Word() != "alert") return Fail("« alert » attendu");
+        std::string_view name = Word(true);
+        if (name.empty()) return Fail("nom de règle attendu");
+        rule.name = std::string(name);
+
+        for (;;) {
+            SkipSpace();
+            const size_t optionStart = m_pos;
+            std::string_view key = Word();
+            if (key == "when") break;
+            if (key.empty() || AtEnd() || m_text[m_pos] != '=') {
+                m_pos = optionStart;
+                return Fail(AtEnd() ? "« when » attendu" : "option ou « when » attendu");
+            }
+            m_pos++;
+            std::string_view value = OptionValue();
+            double seconds = 0;
+            if (key == "severity") {
+                if (value == "info") {
+                    rule.severity = AlertSeverity::Info;
+                } else if (value == "warning") {
+                    rule.severity = AlertSeverity::Warning;
+                } else if (value == "critical") {
+                    rule.severity = AlertSeverity::Critical;
+                } else {
+                    return Fail("gravité inconnue: " + std::string(value));
+                }
+            } else if (key == "for" || key == "keep") {
+                if (!ParseNumber(value, seconds) || seconds < 0) return Fail("durée invalide: " + std::string(value));
+                (key == "for" ? rule.forMs : rule.keepMs) = static_cast<int64_t>(seconds * 1000);
+            } else if (key == "site" || key == "dc" || key == "source") {
+                if (!ParseGlobs(value, key == "site" ? rule.sites : key == "dc" ? rule.dcs : rule.sources)) {
+                    return Fail("sélecteur vide");
+                }
+            } else {
+                return Fail("option inconnue: " + std::string(key));
+            }
+        }
+
+        if (!ParseCondition(rule.when)) return false;
+        SkipSpace();
+        if (!AtEnd()) {
+            const size_t clearStart = m_pos;
+            if (Word() != "clear") {
+                m_pos = clearStart;
+                return Fail("fin de règle ou « clear » attendu");
+            }
+            if (!ParseCondition(rule.clear)) return false;
+            SkipSpace();
+            if (!AtEnd()) return Fail("fin de règle attendue");
+        }
+
+        const uint32_t partnerMetrics = ~((1u << kFirstPartnerMetric) - 1);
+        rule.partner = ((rule.when.metrics | rule.clear.metrics) & partnerMetrics) != 0 || !rule.sources.empty();
+        if (!CompileAlertExpr(rule.when, rule.whenCode, m_error) || !CompileAlertExpr(rule.clear, rule.clearCode, m_error)) {
+            return false;
+        }
+        return true;
+    }
+
+    bool ParseCondition(AlertExpr& expr) {
+        m_expr = &expr;
+        uint32_t root = 0;
+        if (!ParseOr(root)) return false;
+        expr.root = root;
+        return true;
+    }
+
+    uint32_t Add(AlertOp op, uint32_t left, uint32_t right = 0) {
+        AlertNode n;
+        n.op = op;
+        n.left = left;
+        n.right = right;
+        m_expr->nodes.push_back(n);
+        return static_cast<uint32_t>(m_expr->nodes.size() - 1);
+    }
+
+    // Keyword or operator at the cursor; consumed when it matches
+    bool Accept(std::string_view token) {
+        SkipSpace();
+        if (m_text.compare(m_pos, token.size(), token) != 0) return false;
+        const bool word = WordChar(token[0]);
+        if (word && m_pos + token.size() < m_text.size() && WordChar(m_text[m_pos + token.size()])) return false;
+        m_pos += token.size();
+        return true;
+    }
+
+    bool ParseOr(uint32_t& out) {
+        if (!ParseAnd(out)) return false;
+        while (Accept("or") || Accept("||")) {
+            uint32_t right = 0;
+            if (!ParseAnd(right)) return false;
+            out = Add(AlertOp::Or, out, right);
+        }
+        return true;
+    }
+
+    bool ParseAnd(uint32_t& out) {
+        if (!ParseNot(out)) return false;
+        while (Accept("and") || Accept("&&")) {
+            uint32_t right = 0;
+            if (!ParseNot(right)) return false;
+            out = Add(AlertOp::And, out, right);
+        }
+        return true;
+    }
+
+    bool ParseNot(uint32_t& out) {
+        SkipSpace();
+        if (Accept("not") || (m_pos + 1 < m_text.size() && m_text[m_pos] == '!' && m_text[m_pos + 1] != '=' && Accept("!"))) {
+            if (!ParseNot(out)) return false;
+            out = Add(AlertOp::Not, out);
+            return true;
+        }
+        return ParseComparison(out);
+    }
+
+    bool ParseComparison(uint32_t& out) {
+        if (!ParseSum(out)) return false;
+        static const struct { const char* token; AlertOp op; } kComparisons[] = {
+            {"<=", AlertOp::Le}, {">=", AlertOp::Ge}, {"==", AlertOp::Eq}, {"!=", AlertOp::Ne},
+            {"<", AlertOp::Lt}, {">", AlertOp::Gt}, {"=", AlertOp::Eq},
+        };
+        for (const auto& c : kComparisons) {
+            if (Accept(c.token)) {
+                uint32_t right = 0;
+                if (!ParseSum(right)) return false;
+                out = Add(c.op, out, right);
+                return true;
+            }
+        }
+        return true;
+    }
+
+    bool ParseSum(uint32_t& out) {
+        if (!ParseProduct(out)) return false;
+        for (;;) {
+            AlertOp op;
+            if (Accept("+")) {
+                op = AlertOp::Add;
+            } else if (Accept("-")) {
+                op = AlertOp::Sub;
+            } else {
+                return true;
+            }
+            uint32_t right = 0;
+            if (!ParseProduct(right)) return false;
+            out = Add(op, out, right);
+        }
+    }
+
+    bool ParseProduct(uint32_t& out) {
+        if (!ParseUnary(out)) return false;
+        for (;;) {
+            AlertOp op;
+            if (Accept("*")) {
+                op = AlertOp::Mul;
+            } else if (Accept("/")) {
+                op = AlertOp::Div;
+            } else {
+                return true;
+            }
+            uint32_t right = 0;
+            if (!ParseUnary(right)) return false;
+            out = Add(op, out, right);
+        }
+    }
+
+    bool ParseUnary(uint32_t& out) {
+        if (Accept("-")) {
+            if (!ParseUnary(out)) return false;
+            out = Add(AlertOp::Neg, out);
+            return true;
+        }
+        return ParsePrimary(out);
+    }
+
+    bool ParsePrimary(uint32_t& out) {
+        SkipSpace();
+        if (Accept("(")) {
+            if (!ParseOr(out)) return false;
+            return Accept(")") || Fail("« ) » attendu");
+        }
+        const size_t start = m_pos;
+        std::string_view word = Word();
+        if (word.empty()) return Fail(AtEnd() ? "expression incomplète" : "symbole inattendu");
+
+        if ((word[0] >= '0' && word[0] <= '9') || word[0] == '.') {
+            double value = 0;
+            if (!ParseNumber(word, value)) {
+                m_pos = start;
+                return Fail("nombre invalide: " + std::string(word));
+            }
+            out = Add(AlertOp::Const, 0);
+            m_expr->nodes[out].value = value;
+            return true;
+        }
+
+        static const struct { const char* name; double value; } kConstants[] = {
+            {"true", 1}, {"false", 0},
+            {"in_sync", static_cast<double>(LagClass::InSync)}, {"minor", static_cast<double>(LagClass::Minor)},
+            {"moderate", static_cast<double>(LagClass::Moderate)}, {"severe", static_cast<double>(LagClass::Severe)},
+        };
+        for (const auto& c : kConstants) {
+            if (word == c.name) {
+                out = Add(AlertOp::Const, 0);
+                m_expr->nodes[out].value = c.value;
+                return true;
+            }
+        }
+        for (size_t m = 0; m < kAlertMetricCount; m++) {
+            if (word == AlertMetricName(static_cast<AlertMetric>(m))) {
+                out = Add(AlertOp::Metric, 0);
+                m_expr->nodes[out].metric = static_cast<AlertMetric>(m);
+                m_expr->metrics |= 1u << m;
+                return true;
+            }
+        }
+        m_pos = start;
+        return Fail("métrique inconnue: " + std::string(word));
+    }
+
+    std::string_view m_text;
+    size_t m_pos = 0;
+    AlertExpr* m_expr = nullptr;
+    std::string m_error;
+};
+
+inline bool ParseAlertRules(std::string_view text, std::vector<AlertRule>& rules, std::string& error) {
+    return AlertRuleParser::Parse(text, rules, error);
+}
+
+// Rows are evaluated in blocks of this many; columns are padded to it
+const size_t kAlertBlock = 256;
+
+// Column-major metric values, one row per DC or per inbound partner
+// (destination, source, naming context). Only the columns asked for are
+// filled; the rest, and the padding after the last row, read as unknown.
+struct AlertSamples {
+    size_t count = 0;
+    size_t stride = 0;                  // count rounded up to kAlertBlock
+    std::vector<double> values;         // metric m of row i at values[m * stride + i]
+    std::vector<DcId> dc;               // destination for partner rows
+    std::vector<DcId> source;           // partner rows only
+    std::vector<NcId> nc;
+
+    const double* Column(AlertMetric m) const { return values.data() + static_cast<size_t>(m) * stride; }
+    double* Column(AlertMetric m) { return values.data() + static_cast<size_t>(m) * stride; }
+
+    void Reset(size_t rows) {
+        count = rows;
+        stride = (rows + kAlertBlock - 1) / kAlertBlock * kAlertBlock;
+        values.assign(stride * kAlertMetricCount, std::numeric_limits<double>::quiet_NaN());
+        dc.resize(rows);
+    }
+};
+
+inline double AlertDcMetric(const ScanSnapshot& snapshot, DcId id, AlertMetric m, int64_t now) {
+    const double unknown = std::numeric_limits<double>::quiet_NaN();
+    const DcRecord& r = snapshot.model.records[id];
+    const bool probed = r.status != ProbeStatus::Cancelled;
+    switch (m) {
+        case AlertMetric::Usn:               return r.HasUsn() ? static_cast<double>(r.usn) : unknown;
+        case AlertMetric::UsnBehind:
+            return r.HasUsn() && snapshot.spread.count > 1 ? static_cast<double>(snapshot.spread.maxUsn - r.usn) : unknown;
+        case AlertMetric::Latency:           return r.HasLatency() ? static_cast<double>(r.latencySec) : unknown;
+        case AlertMetric::Partners:          return r.HasLatency() ? r.partners : unknown;
+        case AlertMetric::FailingPartners:   return r.HasLatency() ? r.failingPartners : unknown;
+        case AlertMetric::Errors:            return r.events == EventState::Ok ? static_cast<double>(r.errorTotal) : unknown;
+        case AlertMetric::ProbeMs:           return probed ? static_cast<double>(r.probeMs) : unknown;
+        case AlertMetric::Reachable:         return probed ? (r.HasUsn() ? 1 : 0) : unknown;
+        case AlertMetric::Timeout:           return probed ? (r.status == ProbeStatus::Timeout ? 1 : 0) : unknown;
+        case AlertMetric::Lag:               return r.lag == LagClass::Unknown ? unknown : static_cast<double>(r.lag);
+        case AlertMetric::ReplicationAge:
+            return r.lastReplication > 0 ? static_cast<double>(std::max<int64_t>(0, now - r.lastReplication)) / 1000 : unknown;
+        case AlertMetric::EventsUnavailable:
+            return r.events == EventState::Unknown ? unknown : (r.events == EventState::Unavailable ? 1 : 0);
+        default:                             return unknown;
+    }
+}
+
+// One row per DC; metrics is a bit mask of the AlertMetric columns to fill
+inline void BuildDcAlertSamples(const ScanSnapshot& snapshot, uint32_t metrics, int64_t now, AlertSamples& out) {
+    const size_t n = snapshot.model.Size();
+    out.Reset(n);
+    out.source.clear();
+    out.nc.clear();
+    for (DcId id = 0; id < n; id++) out.dc[id] = id;
+    for (size_t m = 0; m < kFirstPartnerMetric; m++) {
+        if (!(metrics & (1u << m))) continue;
+        double* column = out.Column(static_cast<AlertMetric>(m));
+        for (DcId id = 0; id < n; id++) column[id] = AlertDcMetric(snapshot, id, static_cast<AlertMetric>(m), now);
+    }
+}
+
+// One row per inbound neighbor of every DC with replica metadata. DC
+// columns hold the destination's values.
+inline void BuildPartnerAlertSamples(const ScanSnapshot& snapshot, uint32_t metrics, int64_t now, AlertSamples& out) {
+    const double unknown = std::numeric_limits<double>::quiet_NaN();
+    const ReplicationModel& model = snapshot.model;
+    size_t rows = 0;
+    for (DcId id = 0; id < model.Size(); id++) {
+        if (const DestinationRow* row = snapshot.latency.Row(id)) rows += row->neighbors.size();
+    }
+    out.Reset(rows);
+    out.source.resize(rows);
+    out.nc.resize(rows);
+
+    size_t i = 0;
+    for (DcId id = 0; id < model.Size(); id++) {
+        const DestinationRow* row = snapshot.latency.Row(id);
+        if (!row) continue;
+        for (const NeighborCell& n : row->neighbors) {
+            out.dc[i] = id;
+            out.source[i] = n.source;
+            out.nc[i] = n.nc;
+            for (size_t m = 0; m < kFirstPartnerMetric; m++) {
+                if (metrics & (1u << m)) out.Column(static_cast<AlertMetric>(m))[i] = AlertDcMetric(snapshot, id, static_cast<AlertMetric>(m), now);
+            }
+            if (metrics & (1u << static_cast<size_t>(AlertMetric::PartnerFailures))) {
+                out.Column(AlertMetric::PartnerFailures)[i] = n.consecutiveFailures;
+            }
+            if (metrics & (1u << static_cast<size_t>(AlertMetric::PartnerAge))) {
+                out.Column(AlertMetric::PartnerAge)[i] =
+                    n.lastSuccess > 0 ? static_cast<double>(std::max<int64_t>(0, row->observedAt - n.lastSuccess)) / 1000 : unknown;
+            }
+            if (metrics & (1u << static_cast<size_t>(AlertMetric::PartnerAttemptAge))) {
+                out.Column(AlertMetric::PartnerAttemptAge)[i] =
+                    n.lastAttempt > 0 ? static_cast<double>(std::max<int64_t>(0, row->observedAt - n.lastAttempt)) / 1000 : unknown;
+            }
+            if (metrics & (1u << static_cast<size_t>(AlertMetric::PartnerResult))) {
+                out.Column(AlertMetric::PartnerResult)[i] = n.lastResult;
+            }
+            if (metrics & (1u << static_cast<size_t>(AlertMetric::PartnerUsnBehind))) {
+                const bool known = n.source < model.Size() && model.records[n.source].HasUsn();
+                const uint64_t usn = known ? model.records[n.source].usn : 0;
+                out.Column(AlertMetric::PartnerUsnBehind)[i] =
+                    known ? static_cast<double>(usn > n.usnSynced ? usn - n.usnSynced : 0) : unknown;
+            }
+            i++;
+        }
+    }
+}
+
+// Runs compiled programs a block of rows at a time: each instruction is a
+// loop of kAlertBlock iterations, so dispatch is paid once per block and the
+// fixed trip count lets the compiler vectorize the loops. Stack slots point
+// at sample columns or scratch blocks.
+class AlertVm {
+public:
+    // Rows where the program is true (not false, not unknown), ascending.
+    // Alerts are rare, so the rows are collected sparsely.
+    void Run(const AlertProgram& program, const AlertSamples& samples, std::vector<uint32_t>& rows) {
+        rows.clear();
+        for (size_t begin = 0; begin < samples.stride; begin += kAlertBlock) {
+            const double* result = RunBlock(program, samples, begin);
+            for (size_t i = 0; i < kAlertBlock; i++) {
+                if (AlertLogic::True(result[i]) && begin + i < samples.count) rows.push_back(static_cast<uint32_t>(begin + i));
+            }
+        }
+    }
+
+    // Value for a single row, instruction by instruction
+    static double RunRow(const AlertProgram& program, const AlertSamples& samples, size_t row) {
+        double stack[AlertProgram::kMaxDepth + 1];
+        size_t top = 0;
+        for (const AlertInstr& instr : program.code) {
+            switch (instr.op) {
+                case AlertOp::Const:  stack[top++] = instr.value; break;
+                case AlertOp::Metric: stack[top++] = samples.Column(instr.metric)[row]; break;
+                case AlertOp::Neg:
+                case AlertOp::Not:    stack[top - 1] = ApplyAlertOp(instr.op, stack[top - 1], 0); break;
+                default:
+                    if (instr.immediate) {
+                        stack[top - 1] = ApplyAlertOp(instr.op, stack[top - 1], instr.value);
+                    } else {
+                        top--;
+                        stack[top - 1] = ApplyAlertOp(instr.op, stack[top - 1], stack[top]);
+                    }
+                    break;
+            }
+        }
+        return top ? stack[0] : 0;
+    }
+
+private:
+    // Results go to one of two scratch banks, never the one holding the
+    // left operand, so no loop writes over its own inputs
+    double* Slot(size_t position, const double* operand) {
+        double* slot = m_scratch[position];
+        return slot == operand ? m_scratch[AlertProgram::kMaxDepth + position] : slot;
+    }
+
+    const double* RunBlock(const AlertProgram& program, const AlertSamples& samples, size_t begin) {
+        const double* stack[AlertProgram::kMaxDepth + 1];
+        size_t top = 0;
+        for (const AlertInstr& instr : program.code) {
+            switch (instr.op) {
+                case AlertOp::Const: {
+                    double* slot = m_scratch[top];
+                    for (size_t i = 0; i < kAlertBlock; i++) slot[i] = instr.value;
+                    stack[top++] = slot;
+                    break;
+                }
+                case AlertOp::Metric:
+                    stack[top++] = samples.Column(instr.metric) + begin;
+                    break;
+                case AlertOp::Neg:
+                case AlertOp::Not: {
+                    double* slot = Slot(top - 1, stack[top - 1]);
+                    Unary(instr.op, stack[top - 1], slot);
+                    stack[top - 1] = slot;
+                    break;
+                }
+                default: {
+                    double* slot;
+                    if (instr.immediate) {
+                        slot = Slot(top - 1, stack[top - 1]);
+                        BinaryImmediate(instr.op, stack[top - 1], instr.value, slot);
+                    } else {
+                        top--;
+                        slot = Slot(top - 1, stack[top - 1]);
+                        Binary(instr.op, stack[top - 1], stack[top], slot);
+                    }
+                    stack[top - 1] = slot;
+                    break;
+                }
+            }
+        }
+        if (top) return stack[0];
+        for (size_t i = 0; i < kAlertBlock; i++) m_scratch[0][i] = 0;
+        return m_scratch[0];
+    }
+
+    static void Unary(AlertOp op, const double* __restrict a, double* __restrict out) {
+        if (op == AlertOp::Neg) {
+            for (size_t i = 0; i < kAlertBlock; i++) out[i] = -a[i];
+        } else {
+            for (size_t i = 0; i < kAlertBlock; i++) out[i] = AlertLogic::Not(a[i]);
+        }
+    }
+
+    // One loop per operator; comparisons are spelled out so that a finite
+    // immediate right operand drops out of the unknown check
+    template <bool kImmediate, typename B>
+    static void Apply(AlertOp op, const double* __restrict a, B b, double* __restrict out) {
+        const size_t n = kAlertBlock;
+        auto known = [&](size_t i) { return kImmediate ? a[i] - a[i] : AlertLogic::Known(a[i], b(i)); };
+        switch (op) {
+            case AlertOp::Add: for (size_t i = 0; i < n; i++) out[i] = a[i] + b(i); break;
+            case AlertOp::Sub: for (size_t i = 0; i < n; i++) out[i] = a[i] - b(i); break;
+            case AlertOp::Mul: for (size_t i = 0; i < n; i++) out[i] = a[i] * b(i); break;
+            case AlertOp::Div: for (size_t i = 0; i < n; i++) out[i] = a[i] / b(i); break;
+            case AlertOp::Lt:  for (size_t i = 0; i < n; i++) out[i] = known(i) + (a[i] < b(i) ? 1.0 : 0.0); break;
+            case AlertOp::Le:  for (size_t i = 0; i < n; i++) out[i] = known(i) + (a[i] <= b(i) ? 1.0 : 0.0); break;
+            case AlertOp::Gt:  for (size_t i = 0; i < n; i++) out[i] = known(i) + (a[i] > b(i) ? 1.0 : 0.0); break;
+            case AlertOp::Ge:  for (size_t i = 0; i < n; i++) out[i] = known(i) + (a[i] >= b(i) ? 1.0 : 0.0); break;
+            case AlertOp::Eq:  for (size_t i = 0; i < n; i++) out[i] = known(i) + (a[i] == b(i) ? 1.0 : 0.0); break;
+            case AlertOp::Ne:  for (size_t i = 0; i < n; i++) out[i] = known(i) + (a[i] != b(i) ? 1.0 : 0.0); break;
+            case AlertOp::And: for (size_t i = 0; i < n; i++) out[i] = AlertLogic::And(a[i], b(i)); break;
+            case AlertOp::Or:  for (size_t i = 0; i < n; i++) out[i] = AlertLogic::Or(a[i], b(i)); break;
+            default:
+                break;
+        }
+    }
+
+    static void Binary(AlertOp op, const double* __restrict a, const double* __restrict b, double* __restrict out) {
+        Apply<false>(op, a, [b](size_t i) { return b[i]; }, out);
+    }
+
+    static void BinaryImmediate(AlertOp op, const double* __restrict a, double b, double* __restrict out) {
+        Apply<true>(op, a, [b](size_t) { return b; }, out);
+    }
+
+    alignas(64) double m_scratch[2 * AlertProgram::kMaxDepth][kAlertBlock];
+};
+
+// A firing alert: the DC, and for partner rules the inbound link
+struct ActiveAlert {
+    size_t rule = 0;
+    std::wstring dc;
+    std::wstring site;
+    std::wstring source;                // partner rules
+    std::wstring namingContext;         // partner rules
+    int64_t since = 0;                  // fired at, Unix ms
+    double value = 0;                   // first metric of the when condition, at the last evaluation
+};
+
+struct AlertTransition {
+    ActiveAlert alert;
+    bool fired = false;                 // false: resolved
+};
+
+// Evaluates a rule set against each snapshot it is given and keeps, per
+// rule, the DCs or links whose condition is pending or firing. State is
+// keyed by names, so it survives a rediscovery that renumbers the DCs.
+// Not thread-safe: one evaluating thread.
+class AlertEngine {
+public:
+    explicit AlertEngine(std::vector<AlertRule> rules = {}) { SetRules(std::move(rules)); }
+
+    // Drops every pending and firing alert
+    void SetRules(std::vector<AlertRule> rules) {
+        m_rules = std::move(rules);
+        m_states.assign(m_rules.size(), {});
+        m_dcMetrics = 0;
+        m_partnerMetrics = 0;
+        for (const AlertRule& rule : m_rules) {
+            (rule.partner ? m_partnerMetrics : m_dcMetrics) |= rule.when.metrics | rule.clear.metrics;
+        }
+    }
+
+    const std::vector<AlertRule>& Rules() const { return m_rules; }
+
+    // Alerts that fired or resolved at now (Unix ms)
+    std::vector<AlertTransition> Evaluate(const ScanSnapshot& snapshot, int64_t now) {
+        std::vector<AlertTransition> transitions;
+        m_round++;
+        const ReplicationModel& model = snapshot.model;
+        m_stableDc.resize(model.Size());
+        m_stableSite.resize(model.Size());
+        for (DcId id = 0; id < model.Size(); id++) {
+            m_stableDc[id] = m_names.Intern(model.DcName(id));
+            m_stableSite[id] = m_names.Intern(model.SiteName(id));
+        }
+        m_dcRow.assign(m_names.Size(), SIZE_MAX);
+        for (DcId id = 0; id < model.Size(); id++) m_dcRow[m_stableDc[id]] = id;
+        bool partnerRules = false;
+        for (const AlertRule& rule : m_rules) partnerRules = partnerRules || rule.partner;
+        if (m_dcMetrics || !partnerRules) BuildDcAlertSamples(snapshot, m_dcMetrics, now, m_dcSamples);
+        if (partnerRules) {
+            BuildPartnerAlertSamples(snapshot, m_partnerMetrics, now, m_partnerSamples);
+            m_stableNc.resize(snapshot.latency.NcCount());
+            for (NcId nc = 0; nc < m_stableNc.size(); nc++) m_stableNc[nc] = m_ncNames.Intern(snapshot.latency.NcName(nc));
+        }
+        m_partnerRowsBuilt = false;
+
+        for (size_t r = 0; r < m_rules.size(); r++) EvaluateRule(r, snapshot, now, transitions);
+        return transitions;
+    }
+
+    std::vector<ActiveAlert> Active() const {
+        std::vector<ActiveAlert> active;
+        for (size_t r = 0; r < m_rules.size(); r++) {
+            for (const auto& entry : m_states[r]) {
+                if (entry.second.firingSince) active.push_back(Describe(r, entry.second));
+            }
+        }
+        std::sort(active.begin(), active.end(), [&](const ActiveAlert& a, const ActiveAlert& b) {
+            if (m_rules[a.rule].severity != m_rules[b.rule].severity) return m_rules[a.rule].severity > m_rules[b.rule].severity;
+            if (a.rule != b.rule) return a.rule < b.rule;
+            if (a.dc != b.dc) return a.dc < b.dc;
+            return a.source < b.source;
+        });
+        return active;
+    }
+
+    // Conditions holding but not yet for their `for` duration
+    size_t Pending() const {
+        size_t n = 0;
+        for (const auto& states : m_states) {
+            for (const auto& entry : states) n += entry.second.firingSince ? 0 : 1;
+        }
+        return n;
+    }
+
+private:
+    struct State {
+        int64_t pendingSince = 0;
+        int64_t firingSince = 0;        // 0 while pending
+        int64_t clearSince = 0;         // clear condition holding since, 0 if not
+        uint64_t round = 0;             // last evaluation the when condition held
+        uint32_t dc = 0;                // stable name ids
+        uint32_t site = 0;
+        uint32_t source = 0;
+        uint32_t nc = 0;
+        double value = 0;
+    };
+
+    // Stable names interned for the engine's lifetime
+    class Names {
+    public:
+        uint32_t Intern(const std::wstring& name) {
+            auto it = m_ids.find(name);
+            if (it != m_ids.end()) return it->second;
+            m_names.push_back(name);
+            return m_ids.emplace(name, static_cast<uint32_t>(m_names.size() - 1)).first->second;
+        }
+        const std::wstring& Name(uint32_t id) const { return m_names[id]; }
+        size_t Size() const { return m_names.size(); }
+    private:
+        std::vector<std::wstring> m_names;
+        std::unordered_map<std::wstring, uint32_t> m_ids;
+    };
+
+    // DC rules: the DC; partner rules: destination, source (24 bits each) and naming context (16)
+    uint64_t Key(const AlertRule& rule, const AlertSamples& s, size_t row) const {
+        const uint64_t dc = m_stableDc[s.dc[row]];
+        if (!rule.partner) return dc;
+        const uint64_t source = s.source[row] < m_stableDc.size() ? m_stableDc[s.source[row]] : 0xFFFFFF;
+        const uint64_t nc = s.nc[row] < m_stableNc.size() ? m_stableNc[s.nc[row]] : 0xFFFF;
+        return (dc << 40) | ((source & 0xFFFFFF) << 16) | (nc & 0xFFFF);
+    }
+
+    bool Selected(const AlertRule& rule, const ScanSnapshot& snapshot, const AlertSamples& s, size_t row) const {
+        if (!rule.HasSelector()) return true;
+        const ReplicationModel& model = snapshot.model;
+        const DcId dc = s.dc[row];
+        if (!AlertSelectorMatch(rule.sites, model.SiteName(dc)) || !AlertSelectorMatch(rule.dcs, model.DcName(dc))) return false;
+        if (rule.sources.empty()) return true;
+        return s.source[row] < model.Size() && AlertSelectorMatch(rule.sources, model.DcName(s.source[row]));
+    }
+
+    ActiveAlert Describe(size_t rule, const State& state) const {
+        ActiveAlert a;
+        a.rule = rule;
+        a.dc = m_names.Name(state.dc);
+        a.site = m_names.Name(state.site);
+        if (m_rules[rule].partner) {
+            a.source = m_names.Name(state.source);
+            a.namingContext = m_ncNames.Name(state.nc);
+        }
+        a.since = state.firingSince;
+        a.value = state.value;
+        return a;
+    }
+
+    // Row of every partner sample by key, for the clear conditions of
+    // firing alerts whose when condition no longer holds
+    size_t PartnerRow(const AlertRule& rule, uint64_t key) {
+        if (!m_partnerRowsBuilt) {
+            m_partnerRows.clear();
+            for (size_t i = 0; i < m_partnerSamples.count; i++) m_partnerRows[Key(rule, m_partnerSamples, i)] = i;
+            m_partnerRowsBuilt = true;
+        }
+        auto it = m_partnerRows.find(key);
+        return it == m_partnerRows.end() ? SIZE_MAX : it->second;
+    }
+
+    void EvaluateRule(size_t r, const ScanSnapshot& snapshot, int64_t now, std::vector<AlertTransition>& transitions) {
+        const AlertRule& rule = m_rules[r];
+        const AlertSamples& samples = rule.partner ? m_partnerSamples : m_dcSamples;
+        auto& states = m_states[r];
+        m_vm.Run(rule.whenCode, samples, m_hits);
+
+        // First metric of the condition, reported with the alert
+        const AlertMetric shown = FirstMetric(rule.when);
+        const bool hasShown = rule.when.metrics != 0;
+
+        for (const uint32_t i : m_hits) {
+            if (!Selected(rule, snapshot, samples, i)) continue;
+            const uint64_t key = Key(rule, samples, i);
+            auto inserted = states.try_emplace(key);
+            State& st = inserted.first->second;
+            if (inserted.second) {
+                st.pendingSince = now;
+                st.dc = m_stableDc[samples.dc[i]];
+                st.site = m_stableSite[samples.dc[i]];
+                if (rule.partner) {
+                    st.source = samples.source[i] < m_stableDc.size() ? m_stableDc[samples.source[i]] : m_names.Intern(L"?");
+                    st.nc = samples.nc[i] < m_stableNc.size() ? m_stableNc[samples.nc[i]] : m_ncNames.Intern(L"?");
+                }
+            }
+            st.round = m_round;
+            st.clearSince = 0;
+            if (hasShown) st.value = samples.Column(shown)[i];
+            if (!st.firingSince && now - st.pendingSince >= rule.forMs) {
+                st.firingSince = now;
+                transitions.push_back({Describe(r, st), true});
+            }
+        }
+
+        // Everything not seen this round: pending ones reset, firing ones
+        // resolve once the clear condition has held for `keep`
+        for (auto it = states.begin(); it != states.end();) {
+            State& st = it->second;
+            if (st.round == m_round) {
+                ++it;
+                continue;
+            }
+            if (!st.firingSince) {
+                it = states.erase(it);
+                continue;
+            }
+            bool clear = true;
+            if (!rule.clearCode.Empty()) {
+                const size_t row = rule.partner ? PartnerRow(rule, it->first)
+                                                : (st.dc < m_dcRow.size() ? m_dcRow[st.dc] : SIZE_MAX);
+                clear = row == SIZE_MAX || AlertLogic::True(m_vm.RunRow(rule.clearCode, samples, row));
+            }
+            if (!clear) {
+                st.clearSince = 0;
+                ++it;
+                continue;
+            }
+            if (!st.clearSince) st.clearSince = now;
+            if (now - st.clearSince >= rule.keepMs) {
+                transitions.push_back({Describe(r, st), false});
+                it = states.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    static AlertMetric FirstMetric(const AlertExpr& expr) {
+        for (const AlertNode& n : expr.nodes) {
+            if (n.op == AlertOp::Metric) return n.metric;
+        }
+        return AlertMetric::Usn;
+    }
+
+    std::vector<AlertRule> m_rules;
+    std::vector<std::unordered_map<uint64_t, State>> m_states;
+    uint32_t m_dcMetrics = 0;
+    uint32_t m_partnerMetrics = 0;
+    uint64_t m_round = 0;
+    Names m_names;                      // DCs and sites
+    Names m_ncNames;                    // naming contexts, kept apart so their ids fit the key
+    std::vector<uint32_t> m_stableDc;   // by DcId of the snapshot being evaluated
+    std::vector<uint32_t> m_stableSite;
+    std::vector<uint32_t> m_stableNc;
+    std::vector<size_t> m_dcRow;        // by stable DC name id, SIZE_MAX when absent from the snapshot
+    AlertSamples m_dcSamples;
+    AlertSamples m_partnerSamples;
+    std::unordered_map<uint64_t, size_t> m_partnerRows;
+    bool m_partnerRowsBuilt = false;
+    std::vector<uint32_t> m_hits;       // rows where the rule being evaluated holds
+    AlertVm m_vm;
+};
+
+// What the fixed 1000/10000 USN thresholds used to say, as rules
+inline const char* DefaultAlertRules() {
+    return "# Distance au plus haut USN du scan\n"
+           "alert usn_retard severity=warning when usn_behind >= 1000 and usn_behind < 10000\n"
+           "alert usn_retard_important severity=critical when usn_behind >= 10000\n";
+}
+
+// Rules of a file; an empty file is an empty rule set
+inline bool LoadAlertRuleFile(const std::wstring& path, std::vector<AlertRule>& rules, std::string& error) {
+    std::error_code ec;
+    if (!std::filesystem::is_regular_file(path, ec)) {
+        error = "fichier introuvable";
+        return false;
+    }
+    MappedFile file;
+    if (std::filesystem::file_size(path, ec) > 0 && !file.Open(path, false)) {
+        error = "lecture impossible";
+        return false;
+    }
+    return ParseAlertRules(std::string_view(reinterpret_cast<const char*>(file.Data()), file.Size()), rules, error);
+}
@@ -0,0 +1,345 @@
+// AsyncLogger.h
+// Journalisation asynchrone : file sans verrou, écriture par lots en arrière-plan, rotation par taille
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "BoundedQueue.h"
+#include "Utf8.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+enum class LogLevel : uint8_t {
+    Debug,
+    Info,
+    Warning,
+    Error
+};
+
+inline const char* LogLevelName(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug:   return "DEBUG";
+        case LogLevel::Info:    return "INFO";
+        case LogLevel::Warning: return "WARN";
+        default:                return "ERROR";
+    }
+}
+
+// What Log() does when the ring is full
+enum class LogOverflow : uint8_t {
+    Drop,                               // count the entry as dropped and return
+    Block                               // wait for the writer to make room
+};
+
+// One key=value pair; values are converted to UTF-8 on the calling thread
+struct LogField {
+    const char* key;
+    std::string value;
+
+    LogField(const char* k, const std::wstring& v) : key(k), value(WideToUtf8(v)) {}
+    LogField(const char* k, const wchar_t* v) : key(k), value(WideToUtf8(v)) {}
+    LogField(const char* k, const std::string& v) : key(k), value(v) {}
+    LogField(const char* k, const char* v) : key(k), value(v) {}
+    template <typename N, typename = typename std::enable_if<std::is_arithmetic<N>::value>::type>
+    LogField(const char* k, N v) : key(k), value(std::to_string(v)) {}
+};
+
+struct LoggerOptions {
+    std::wstring path;
+    LogLevel minLevel = LogLevel::Info;
+    size_t queueCapacity = 8192;
+    size_t flushBytes = 64 * 1024;                  // write once this much is pending...
+    std::chrono::milliseconds flushInterval{200};   // ...or this old
+    uint64_t maxFileBytes = 10 * 1024 * 1024;       // rotate beyond this size
+    unsigned maxFiles = 5;                          // path, path.1 ... path.(maxFiles-1)
+    LogOverflow overflow = LogOverflow::Drop;
+};
+
+// Producers format nothing but the message and its fields, then push the
+// entry into a lock-free ring. A single writer thread stamps, batches and
+// writes them. By default a full ring drops the entry and counts it; the
+// writer reports the number of lost entries in the log itself. With
+// LogOverflow::Block producers sleep instead until the writer has taken
+// entries out of the ring, or the logger stops. Stop() writes every entry
+// accepted before it was called: the writer waits for the Log() calls
+// already past the running check before its last drain.
+class AsyncLogger {
+public:
+    AsyncLogger() = default;
+    ~AsyncLogger() { Stop(); }
+
+    AsyncLogger(const AsyncLogger&) = delete;
+    AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+    bool Start(const LoggerOptions& options) {
+        Stop();
+        m_options = options;
+        if (m_options.maxFiles == 0) m_options.maxFiles = 1;
+        m_queue = std::make_unique<BoundedQueue<Entry>>(m_options.queueCapacity);
+        if (!OpenFile()) return false;
+        m_running.store(true, std::memory_order_release);
+        m_writer = std::thread([this]() { WriterLoop(); });
+        return true;
+    }
+
+    // Drains the queue, writes everything and closes the file
+    void Stop() {
+        if (!m_running.exchange(false)) return;
+        m_cv.notify_one();
+        {
+            std::lock_guard<std::mutex> lock(m_spaceMutex);
+            m_spaceCv.notify_all();
+        }
+        if (m_writer.joinable()) m_writer.join();
+        CloseFile();
+    }
+
+    bool Enabled(LogLevel level) const {
+        return level >= m_options.minLevel && m_running.load(std::memory_order_relaxed);
+    }
+
+    void Log(LogLevel level, const std::wstring& message, std::initializer_list<LogField> fields = {}) {
+        if (level < m_options.minLevel) return;
+        InLog scope(m_inLog);
+        if (!m_running.load()) return;
+        Entry entry;
+        entry.time = std::chrono::system_clock::now();
+        entry.level = level;
+        entry.text = WideToUtf8(message);
+        for (const auto& f : fields) {
+            entry.text += ' ';
+            entry.text += f.key;
+            entry.text += '=';
+            AppendValue(entry.text, f.value);
+        }
+        if (!m_queue->TryPush(std::move(entry))) {        // moves only on success
+            if (m_options.overflow == LogOverflow::Drop || !PushBlocking(entry)) {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+        m_accepted.fetch_add(1, std::memory_order_relaxed);
+        if (m_idle.load(std::memory_order_relaxed)) m_cv.notify_one();
+    }
+
+    uint64_t Dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+    uint64_t Accepted() const { return m_accepted.load(std::memory_order_relaxed); }
+    uint64_t Written() const { return m_written.load(std::memory_order_relaxed); }
+    uint64_t Rotations() const { return m_rotations.load(std::memory_order_relaxed); }
+
+private:
+    struct Entry {
+        std::chrono::system_clock::time_point time;
+        LogLevel level = LogLevel::Info;
+        std::string text;
+    };
+
+    // Counts the Log() calls in progress, which Stop() lets finish
+    struct InLog {
+        explicit InLog(std::atomic<unsigned>& count) : m_count(count) { m_count.fetch_add(1); }
+        ~InLog() { m_count.fetch_sub(1, std::memory_order_release); }
+        std::atomic<unsigned>& m_count;
+    };
+
+    // Sleeps until the writer frees room; false once the logger stops. The
+    // writer bumps m_freed under m_spaceMutex when it sees a blocked
+    // producer, so a pop between TryPush and wait is not missed.
+    bool PushBlocking(Entry& entry) {
+        m_blocked.fetch_add(1);
+        std::unique_lock<std::mutex> lock(m_spaceMutex);
+        bool pushed = false;
+        for (;;) {
+            const uint64_t freed = m_freed;
+            if (m_queue->TryPush(std::move(entry))) {
+                pushed = true;
+                break;
+            }
+            if (!m_running.load()) break;
+            m_cv.notify_one();
+            m_spaceCv.wait(lock, [&] { return m_freed != freed || !m_running.load(); });
+        }
+        lock.unlock();
+        m_blocked.fetch_sub(1, std::memory_order_relaxed);
+        return pushed;
+    }
+
+    void WakeBlocked() {
+        if (m_blocked.load() == 0) return;
+        std::lock_guard<std::mutex> lock(m_spaceMutex);
+        m_freed++;
+        m_spaceCv.notify_all();
+    }
+
+    static void AppendValue(std::string& out, const std::string& value) {
+        bool quote = value.empty() || value.find_first_of(" \t\"=") != std::string::npos;
+        if (!quote) {
+            out += value;
+            return;
+        }
+        out += '"';
+        for (char c : value) {
+            if (c == '"' || c == '\\') out += '\\';
+            out += c;
+        }
+        out += '"';
+    }
+
+    void WriterLoop() {
+        std::string batch;
+        batch.reserve(m_options.flushBytes * 2);
+        uint64_t batchEntries = 0;
+        uint64_t reportedDrops = 0;
+        auto lastFlush = std::chrono::steady_clock::now();
+        Entry entry;
+
+        for (;;) {
+            bool running = m_running.load();
+            if (!running) {
+                // Log() calls past their running check push before the last drain
+                while (m_inLog.load() != 0) std::this_thread::yield();
+            }
+            bool gotAny = false;
+            while (m_queue->TryPop(entry)) {
+                gotAny = true;
+                Format(entry, batch);
+                batchEntries++;
+                if (batch.size() >= m_options.flushBytes) {
+                    Write(batch, batchEntries);
+                    lastFlush = std::chrono::steady_clock::now();
+                    WakeBlocked();
+                }
+            }
+            if (gotAny) WakeBlocked();
+
+            uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+            if (dropped != reportedDrops) {
+                Entry note;
+                note.time = std::chrono::system_clock::now();
+                note.level = LogLevel::Warning;
+                note.text = "log entries dropped count=" + std::to_string(dropped - reportedDrops);
+                Format(note, batch);
+                reportedDrops = dropped;
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            if (!batch.empty() && (!running || now - lastFlush >= m_options.flushInterval)) {
+                Write(batch, batchEntries);
+                lastFlush = now;
+            }
+            if (!running) break;
+
+            if (!gotAny) {
+                std::unique_lock<std::mutex> lock(m_cvMutex);
+                m_idle.store(true, std::memory_order_relaxed);
+                m_cv.wait_for(lock, m_options.flushInterval);
+                m_idle.store(false, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // "YYYY-MM-DD HH:MM:SS" is rebuilt once per second, only the ms change
+    void Format(const Entry& entry, std::string& out) {
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(entry.time.time_since_epoch()).count();
+        int64_t second = ms / 1000;
+        if (second != m_cachedSecond) {
+            std::time_t t = static_cast<std::time_t>(second);
+            std::tm local;
+#ifdef _WIN32
+            localtime_s(&local, &t);
+#else
+            localtime_r(&t, &local);
+#endif
+            std::strftime(m_cachedStamp, sizeof(m_cachedStamp), "%Y-%m-%d %H:%M:%S", &local);
+            m_cachedSecond = second;
+        }
+        char millis[8];
+        std::snprintf(millis, sizeof(millis), ".%03d ", static_cast<int>(ms % 1000));
+        out += m_cachedStamp;
+        out += millis;
+        out += LogLevelName(entry.level);
+        out += " - ";
+        out += entry.text;
+        out += '\n';
+    }
+
+    void Write(std::string& batch, uint64_t& entries) {
+        if (m_file) {
+            std::fwrite(batch.data(), 1, batch.size(), m_file);
+            std::fflush(m_file);
+            m_fileBytes += batch.size();
+            if (m_fileBytes >= m_options.maxFileBytes) Rotate();
+        }
+        m_written.fetch_add(entries, std::memory_order_relaxed);
+        entries = 0;
+        batch.clear();
+    }
+
+    void Rotate() {
+        CloseFile();
+        std::error_code ec;
+        std::filesystem::path base(m_options.path);
+        for (unsigned i = m_options.maxFiles - 1; i > 0; i--) {
+            std::filesystem::path from = i == 1 ? base : std::filesystem::path(m_options.path + L"." + std::to_wstring(i - 1));
+            std::filesystem::path to(m_options.path + L"." + std::to_wstring(i));
+            std::filesystem::remove(to, ec);
+            std::filesystem::rename(from, to, ec);
+        }
+        if (m_options.maxFiles == 1) std::filesystem::remove(base, ec);
+        OpenFile();
+        m_rotations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool OpenFile() {
+#ifdef _WIN32
+        m_file = _wfopen(m_options.path.c_str(), L"ab");
+#else
+        m_file = std::fopen(WideToUtf8(m_options.path).c_str(), "ab");
+#endif
+        if (!m_file) return false;
+        std::fseek(m_file, 0, SEEK_END);
+        m_fileBytes = static_cast<uint64_t>(std::ftell(m_file));
+        return true;
+    }
+
+    void CloseFile() {
+        if (m_file) std::fclose(m_file);
+        m_file = nullptr;
+    }
+
+    LoggerOptions m_options;
+    std::unique_ptr<BoundedQueue<Entry>> m_queue;
+    std::thread m_writer;
+    std::atomic<bool> m_running{false};
+    std::atomic<bool> m_idle{false};
+    std::mutex m_cvMutex;
+    std::condition_variable m_cv;
+    std::atomic<unsigned> m_inLog{0};
+    std::atomic<unsigned> m_blocked{0};             // producers in PushBlocking
+    std::mutex m_spaceMutex;
+    std::condition_variable m_spaceCv;
+    uint64_t m_freed = 0;                           // under m_spaceMutex
+
+    std::atomic<uint64_t> m_dropped{0};
+    std::atomic<uint64_t> m_accepted{0};
+    std::atomic<uint64_t> m_written{0};
+    std::atomic<uint64_t> m_rotations{0};
+
+    // Writer thread only
+    std::FILE* m_file = nullptr;
+    uint64_t m_fileBytes = 0;
+    int64_t m_cachedSecond = -1;
+    char m_cachedStamp[32] = {};
+};
@@ -0,0 +1,591 @@
+// CanaryProbe.h
+// Sonde de réplication active : marqueur horodaté écrit sur un objet canari puis relu sur chaque DC jusqu'à son arrivée
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "CancellationToken.h"
+#include "DirectoryBackend.h"
+#include "DistinguishedName.h"
+#include "ProbeEngine.h"
+#include "ReplicationModel.h"
+#include "ScanMetrics.h"
+#include "ScanSnapshot.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cwchar>
+#include <cwctype>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+enum class CanaryStatus : uint8_t {
+    Converged,                          // the marker, or a newer one from the same origin, was read on the destination
+    NotConverged,                       // the destination answered but never showed it before the probe timeout
+    Unreachable,                        // no read of the destination succeeded after the write
+    WriteFailed,                        // the marker could not be written on the origin
+    Cancelled
+};
+
+inline const char* CanaryStatusName(CanaryStatus status) {
+    switch (status) {
+        case CanaryStatus::Converged:    return "converged";
+        case CanaryStatus::NotConverged: return "not_converged";
+        case CanaryStatus::Unreachable:  return "unreachable";
+        case CanaryStatus::WriteFailed:  return "write_failed";
+        default:                         return "cancelled";
+    }
+}
+
+struct CanaryOptions {
+    std::wstring container;                         // canary objects live under it, one per origin DC
+    std::wstring attribute = L"adminDescription";
+    unsigned maxInFlight = 16;                      // reads and writes outstanding at once, all probes together
+    std::chrono::milliseconds firstPoll{1000};      // earliest read after the write
+    std::chrono::milliseconds maxInterval{60000};   // cap of the backoff between reads
+    double backoff = 1.5;                           // the next read is due when the marker's age grew by this factor
+    std::chrono::milliseconds readTimeout{15000};
+    std::chrono::milliseconds probeTimeout{1800000};    // pairs still waiting then are reported NotConverged
+    std::chrono::milliseconds spacing{0};           // between the writes of successive probes of one Run
+};
+
+// One (probe, destination) pair. The marker reached dest somewhere in
+// [lowerMs, upperMs] after the write; latencyMs is the middle of it.
+struct CanaryResult {
+    uint32_t probe = 0;                 // index into Run's origins
+    uint32_t source = 0;                // target indices
+    uint32_t dest = 0;
+    CanaryStatus status = CanaryStatus::Cancelled;
+    int64_t writtenAt = 0;              // Unix ms, as stamped in the marker
+    int64_t latencyMs = -1;             // -1 unless Converged
+    int64_t lowerMs = 0;                // the last read without the marker started this long after the write completed
+    int64_t upperMs = 0;                // the first read with it completed this long after the write started
+    uint32_t reads = 0;                 // reads of dest while the pair waited, shared with other probes of the origin
+};
+
+// One canary object per origin: two origins writing the same attribute would
+// race, and the loser's marker might never reach some DCs.
+inline std::wstring CanaryObjectDn(const std::wstring& container, const std::wstring& originDc) {
+    return ChildDn(L"CN", L"ADRI-Canary-" + originDc.substr(0, originDc.find(L'.')), container);
+}
+
+inline std::wstring FormatCanaryMarker(int64_t writtenAt) {
+    return L"ADRI-canary " + std::to_wstring(writtenAt);
+}
+
+// Stamp of a marker value, -1 if the value is not a marker
+inline int64_t ParseCanaryMarker(const std::wstring& value) {
+    static const std::wstring prefix = L"ADRI-canary ";
+    if (value.compare(0, prefix.size(), prefix) != 0) return -1;
+    wchar_t* end = nullptr;
+    long long stamp = std::wcstoll(value.c_str() + prefix.size(), &end, 10);
+    return (end && *end == L'\0' && stamp > 0) ? stamp : -1;
+}
+
+// Writes a timestamped marker on the canary object of each origin, then
+// polls every other target until the marker shows up there. Probes are
+// pipelined: all of them share maxInFlight workers, and the reads of one
+// destination for one origin are shared by every probe of that origin
+// waiting on it, since a newer marker from the same origin implies the
+// older ones arrived. A (origin, dest) pair is read again when the age of
+// its oldest pending marker has grown by the backoff factor, which bounds
+// the measurement error to a fixed share of the latency; the first read
+// of a pair measured before starts just short of its previous latency.
+// Workers are detached as in ProbeEngine: a call stuck past readTimeout is
+// counted as a failed read and its worker replaced.
+class CanaryProbe {
+public:
+    using Callback = std::function<void(const CanaryResult& result)>;
+    using Clock = std::chrono::steady_clock;
+
+    CanaryProbe(std::shared_ptr<IDirectoryBackend> backend, CanaryOptions options)
+        : m_backend(std::move(backend)), m_options(std::move(options)) {
+        if (m_options.maxInFlight == 0) m_options.maxInFlight = 1;
+        if (m_options.backoff < 1.05) m_options.backoff = 1.05;
+        if (m_options.firstPoll.count() <= 0) m_options.firstPoll = std::chrono::milliseconds(1);
+        m_options.maxInterval = std::max(m_options.maxInterval, m_options.firstPoll);
+    }
+
+    static constexpr std::chrono::milliseconds kCancelPoll{20};
+
+    const CanaryOptions& Options() const { return m_options; }
+
+    // Runs one probe per entry of origins (target indices, repeats allowed)
+    // and returns one result per (probe, other target): probe-major, targets
+    // in input order. onResult is invoked on the calling thread as pairs
+    // finish.
+    std::vector<CanaryResult> Run(const std::vector<ProbeTarget>& targets, const std::vector<uint32_t>& origins,
+                                  const Callback& onResult = nullptr, const CancellationToken* cancel = nullptr) {
+        const size_t T = targets.size();
+        std::vector<CanaryResult> results;
+        if (T < 2) return results;
+
+        auto state = std::make_shared<State>();
+        state->backend = m_backend;
+        state->attribute = m_options.attribute;
+        state->readTimeout = m_options.readTimeout;
+        for (const auto& t : targets) {
+            state->dcs.push_back(t.dc);
+            state->objects.push_back(CanaryObjectDn(m_options.container, t.dc));
+        }
+
+        std::vector<Probe> probes(origins.size());
+        results.resize(origins.size() * (T - 1));
+        const Clock::time_point start = Clock::now();
+        for (size_t p = 0; p < origins.size(); p++) {
+            probes[p].origin = std::min<uint32_t>(origins[p], static_cast<uint32_t>(T - 1));
+            probes[p].startAt = start + m_options.spacing * static_cast<int>(p);
+            for (uint32_t d = 0; d < T; d++) {
+                if (d == probes[p].origin) continue;
+                CanaryResult& r = results[Slot(p, d, probes[p].origin, T)];
+                r.probe = static_cast<uint32_t>(p);
+                r.source = probes[p].origin;
+                r.dest = d;
+            }
+        }
+
+        std::vector<Channel> channels;
+        std::unordered_map<uint64_t, uint32_t> channelOf;      // origin << 32 | dest
+        std::priority_queue<Due, std::vector<Due>, std::greater<Due>> due;
+        std::vector<int64_t> lastStamp(T, 0);
+        std::vector<bool> writing(T, false);    // one write per canary object at a time, so markers land in stamp order
+
+        size_t remaining = results.size();
+        size_t nextProbe = 0;
+        size_t outstanding = 0;
+        size_t workers = 0;
+        uint64_t tickets = 0;
+
+        auto finish = [&](size_t slot, CanaryStatus status) {
+            CanaryResult& r = results[slot];
+            r.status = status;
+            remaining--;
+            if (status == CanaryStatus::Converged) m_expected[PairKey(targets[r.source].dc, targets[r.dest].dc)] = r.latencyMs;
+            if (onResult) onResult(r);
+        };
+
+        auto schedule = [&](uint32_t c, Clock::time_point now) {
+            Channel& ch = channels[c];
+            const Probe& oldest = probes[ch.pending.front().probe];
+            const double age = static_cast<double>(std::chrono::duration_cast<std::chrono::milliseconds>(now - oldest.writtenSteady).count());
+            auto interval = std::chrono::milliseconds(static_cast<int64_t>(age * (m_options.backoff - 1.0)));
+            interval = std::min(std::max(interval, m_options.firstPoll), m_options.maxInterval);
+            ch.due = std::min(now + interval, oldest.deadline);
+            due.push(Due{ch.due, c});
+        };
+
+        auto dispatch = [&](Job job) {
+            job.ticket = ++tickets;
+            state->ready.push_back(job);
+            outstanding++;
+            state->workCv.notify_one();
+        };
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        while (remaining > 0) {
+            Clock::time_point now = Clock::now();
+            if (cancel && cancel->Cancelled()) break;
+
+            // Due writes, then due reads, within the in-flight bound
+            while (nextProbe < probes.size() && probes[nextProbe].startAt <= now && outstanding < m_options.maxInFlight &&
+                   !writing[probes[nextProbe].origin]) {
+                Probe& probe = probes[nextProbe];
+                writing[probe.origin] = true;
+                probe.stamp = std::max(UnixNowMs(), lastStamp[probe.origin] + 1);
+                lastStamp[probe.origin] = probe.stamp;
+                state->markers[static_cast<uint32_t>(nextProbe)] = FormatCanaryMarker(probe.stamp);
+                Job job;
+                job.write = true;
+                job.index = static_cast<uint32_t>(nextProbe);
+                job.target = probe.origin;
+                dispatch(job);
+                nextProbe++;
+            }
+            while (!due.empty() && due.top().at <= now && outstanding < m_options.maxInFlight) {
+                Channel& ch = channels[due.top().channel];
+                ch.inFlight = true;
+                Job job;
+                job.index = due.top().channel;
+                job.target = ch.dest;
+                job.object = ch.origin;
+                due.pop();
+                dispatch(job);
+            }
+            // Workers are only started on demand, and replace abandoned ones
+            for (; workers < outstanding; workers++) std::thread(Worker, state).detach();
+
+            Clock::time_point wakeAt = Clock::time_point::max();
+            if (nextProbe < probes.size() && !writing[probes[nextProbe].origin]) wakeAt = std::min(wakeAt, probes[nextProbe].startAt);
+            if (!due.empty()) wakeAt = std::min(wakeAt, due.top().at);
+            for (const auto& running : state->running) wakeAt = std::min(wakeAt, running.second + m_options.readTimeout);
+            if (cancel) wakeAt = std::min(wakeAt, now + kCancelPoll);
+            if (state->finished.empty()) {
+                if (wakeAt == Clock::time_point::max()) {
+                    state->doneCv.wait(lock, [&] { return !state->finished.empty(); });
+                } else {
+                    state->doneCv.wait_until(lock, wakeAt, [&] { return !state->finished.empty(); });
+                }
+            }
+            now = Clock::now();
+
+            // Calls stuck past the timeout fail; their worker is replaced
+            for (auto it = state->running.begin(); it != state->running.end();) {
+                if (now - it->second < m_options.readTimeout) {
+                    ++it;
+                    continue;
+                }
+                Finished f;
+                f.job = state->jobs[it->first];
+                f.reply.status = ProbeStatus::Timeout;
+                f.startedAt = UnixNowMs() - m_options.readTimeout.count();
+                f.completedAt = UnixNowMs();
+                f.startedSteady = it->second;
+                state->abandoned.insert(it->first);
+                state->jobs.erase(it->first);
+                it = state->running.erase(it);
+                state->finished.push_back(std::move(f));
+                workers--;
+            }
+
+            std::vector<Finished> finished;
+            finished.swap(state->finished);
+            lock.unlock();
+            for (auto& f : finished) {
+                outstanding--;
+                if (f.job.write) {
+                    Probe& probe = probes[f.job.index];
+                    writing[probe.origin] = false;
+                    if (f.reply.status != ProbeStatus::Ok) {
+                        for (uint32_t d = 0; d < T; d++) {
+                            if (d == probe.origin) continue;
+                            size_t slot = Slot(f.job.index, d, probe.origin, T);
+                            results[slot].writtenAt = probe.stamp;
+                            finish(slot, CanaryStatus::WriteFailed);
+                        }
+                        continue;
+                    }
+                    probe.writeStart = f.startedAt;
+                    probe.writeEnd = f.completedAt;
+                    probe.writtenSteady = now;
+                    probe.deadline = now + m_options.probeTimeout;
+                    for (uint32_t d = 0; d < T; d++) {
+                        if (d == probe.origin) continue;
+                        results[Slot(f.job.index, d, probe.origin, T)].writtenAt = probe.stamp;
+                        const uint64_t key = (static_cast<uint64_t>(probe.origin) << 32) | d;
+                        auto found = channelOf.find(key);
+                        uint32_t c;
+                        if (found == channelOf.end()) {
+                            c = static_cast<uint32_t>(channels.size());
+                            channelOf.emplace(key, c);
+                            channels.push_back(Channel{});
+                            channels[c].origin = probe.origin;
+                            channels[c].dest = d;
+                        } else {
+                            c = found->second;
+                        }
+                        Channel& ch = channels[c];
+                        ch.pending.push_back(Pending{f.job.index, ch.reads});
+                        if (ch.pending.size() == 1 && !ch.inFlight) {
+                            ch.due = now + FirstPoll(targets[probe.origin].dc, targets[d].dc);
+                            due.push(Due{ch.due, c});
+                        }
+                    }
+                    continue;
+                }
+
+                Channel& ch = channels[f.job.index];
+                ch.inFlight = false;
+                ch.reads++;
+                const bool ok = f.reply.status == ProbeStatus::Ok;
+                const int64_t seen = (ok && f.reply.found) ? ParseCanaryMarker(f.reply.value) : -1;
+                if (ok) ch.lastOkAt = f.completedAt;
+
+                size_t kept = 0;
+                for (const Pending& pending : ch.pending) {
+                    const Probe& probe = probes[pending.probe];
+                    const size_t slot = Slot(pending.probe, ch.dest, ch.origin, T);
+                    CanaryResult& r = results[slot];
+                    r.reads = ch.reads - pending.readsAtStart;
+                    if (seen >= probe.stamp) {
+                        r.lowerMs = std::max<int64_t>(0, ch.lastMissAt - probe.writeEnd);
+                        r.upperMs = std::max<int64_t>(r.lowerMs, f.completedAt - probe.writeStart);
+                        r.latencyMs = (r.lowerMs + r.upperMs) / 2;
+                        finish(slot, CanaryStatus::Converged);
+                    } else if (f.startedSteady >= probe.deadline) {
+                        finish(slot, ch.lastOkAt >= probe.writeEnd ? CanaryStatus::NotConverged : CanaryStatus::Unreachable);
+                    } else {
+                        ch.pending[kept++] = pending;
+                    }
+                }
+                ch.pending.resize(kept);
+                if (ok) ch.lastMissAt = f.startedAt;
+                if (!ch.pending.empty()) schedule(f.job.index, now);
+            }
+            lock.lock();
+        }
+
+        state->stop = true;
+        state->workCv.notify_all();
+        lock.unlock();
+
+        // Cancelled: every pair still waiting, in order
+        if (remaining > 0 && onResult) {
+            for (const auto& r : results) {
+                if (r.status == CanaryStatus::Cancelled) onResult(r);
+            }
+        }
+        return results;
+    }
+
+private:
+    struct Job {
+        bool write = false;
+        uint32_t index = 0;             // probe for writes, channel for reads
+        uint32_t target = 0;            // DC called
+        uint32_t object = 0;            // reads: origin whose canary object is read
+        uint64_t ticket = 0;
+    };
+
+    struct Finished {
+        Job job;
+        AttributeReply reply;           // writes: Ok or the error
+        int64_t startedAt = 0;          // Unix ms
+        int64_t completedAt = 0;
+        Clock::time_point startedSteady;
+    };
+
+    // Shared with the detached workers
+    struct State {
+        std::mutex mutex;
+        std::condition_variable workCv;
+        std::condition_variable doneCv;
+        std::shared_ptr<IDirectoryBackend> backend;
+        std::wstring attribute;
+        std::chrono::milliseconds readTimeout{0};
+        std::vector<std::wstring> dcs;
+        std::vector<std::wstring> objects;                  // canary DN of each target as origin
+        std::unordered_map<uint32_t, std::wstring> markers; // by probe, set before its write is queued
+        std::deque<Job> ready;
+        std::unordered_map<uint64_t, Clock::time_point> running;    // ticket -> started
+        std::unordered_map<uint64_t, Job> jobs;                     // ... and its job
+        std::unordered_set<uint64_t> abandoned;
+        std::vector<Finished> finished;
+        bool stop = false;
+    };
+
+    struct Probe {
+        uint32_t origin = 0;
+        int64_t stamp = 0;
+        int64_t writeStart = 0;         // Unix ms
+        int64_t writeEnd = 0;
+        Clock::time_point startAt;
+        Clock::time_point writtenSteady;
+        Clock::time_point deadline;
+    };
+
+    struct Pending {
+        uint32_t probe = 0;
+        uint32_t readsAtStart = 0;
+    };
+
+    // Reads of one destination for one origin's canary
+    struct Channel {
+        uint32_t origin = 0;
+        uint32_t dest = 0;
+        std::vector<Pending> pending;   // oldest probe first
+        Clock::time_point due;
+        bool inFlight = false;
+        uint32_t reads = 0;
+        int64_t lastMissAt = 0;         // start of the latest successful read, Unix ms: pairs still pending missed it
+        int64_t lastOkAt = 0;           // completion of the latest successful read
+    };
+
+    struct Due {
+        Clock::time_point at;
+        uint32_t channel;
+        bool operator>(const Due& other) const { return at > other.at; }
+    };
+
+    static size_t Slot(size_t probe, uint32_t dest, uint32_t origin, size_t targets) {
+        return probe * (targets - 1) + dest - (dest > origin ? 1 : 0);
+    }
+
+    static std::wstring PairKey(const std::wstring& source, const std::wstring& dest) {
+        return source + L'>' + dest;
+    }
+
+    std::chrono::milliseconds FirstPoll(const std::wstring& source, const std::wstring& dest) const {
+        auto it = m_expected.find(PairKey(source, dest));
+        if (it == m_expected.end()) return m_options.firstPoll;
+        auto expected = std::chrono::milliseconds(it->second * 4 / 5);
+        return std::min(std::max(expected, m_options.firstPoll), m_options.maxInterval);
+    }
+
+    static void Worker(std::shared_ptr<State> state) {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        for (;;) {
+            state->workCv.wait(lock, [&] { return state->stop || !state->ready.empty(); });
+            if (state->stop) return;
+            Job job = state->ready.front();
+            state->ready.pop_front();
+            Finished f;
+            f.job = job;
+            f.startedSteady = Clock::now();
+            state->running[job.ticket] = f.startedSteady;
+            state->jobs[job.ticket] = job;
+            const std::wstring dc = state->dcs[job.target];
+            const std::wstring object = state->objects[job.write ? job.target : job.object];
+            const std::wstring marker = job.write ? state->markers[job.index] : std::wstring();
+            lock.unlock();
+
+            f.startedAt = UnixNowMs();
+            if (job.write) {
+                int32_t error = 0;
+                bool written = state->backend->WriteAttribute(dc, object, state->attribute, marker, error);
+                f.reply.status = written ? ProbeStatus::Ok : ProbeStatus::Unreachable;
+                f.reply.error = error;
+            } else {
+                f.reply = state->backend->ReadAttribute(dc, object, state->attribute, state->readTimeout);
+            }
+            f.completedAt = UnixNowMs();
+
+            lock.lock();
+            if (state->abandoned.erase(job.ticket)) return;     // timed out: a replacement took over
+            state->running.erase(job.ticket);
+            state->jobs.erase(job.ticket);
+            state->finished.push_back(std::move(f));
+            state->doneCv.notify_one();
+        }
+    }
+
+    std::shared_ptr<IDirectoryBackend> m_backend;
+    CanaryOptions m_options;
+    std::unordered_map<std::wstring, int64_t> m_expected;  // last latency per "source>dest"
+};
+
+// Propagation times per (source site, destination site): a histogram of the
+// converged pairs and a count of those that never converged. Sparse, since
+// most site pairs of a large forest are never probed. Not thread-safe: fed
+// from Run's callback.
+class CanaryLatencyTable {
+public:
+    struct Row {
+        SiteId source = kInvalidId;
+        SiteId dest = kInvalidId;
+        uint64_t converged = 0;
+        uint64_t failed = 0;            // NotConverged or Unreachable
+        int64_t p50Ms = -1;
+        int64_t p90Ms = -1;
+        int64_t maxMs = -1;
+    };
+
+    void Record(const CanaryResult& result, SiteId sourceSite, SiteId destSite) {
+        if (result.status == CanaryStatus::WriteFailed || result.status == CanaryStatus::Cancelled) return;
+        Cell& cell = m_cells[Key(sourceSite, destSite)];
+        if (result.status != CanaryStatus::Converged) {
+            cell.failed++;
+            return;
+        }
+        if (!cell.histogram) cell.histogram = std::make_unique<LatencyHistogram>();
+        cell.histogram->Record(static_cast<uint64_t>(result.latencyMs) * 1000);
+    }
+
+    const LatencyHistogram* Histogram(SiteId sourceSite, SiteId destSite) const {
+        auto it = m_cells.find(Key(sourceSite, destSite));
+        return it == m_cells.end() ? nullptr : it->second.histogram.get();
+    }
+
+    // Sorted by (source, dest)
+    std::vector<Row> Rows() const {
+        std::vector<Row> rows;
+        rows.reserve(m_cells.size());
+        for (const auto& entry : m_cells) {
+            Row row;
+            row.source = static_cast<SiteId>(entry.first >> 32);
+            row.dest = static_cast<SiteId>(entry.first & 0xFFFFFFFFu);
+            row.failed = entry.second.failed;
+            if (const LatencyHistogram* h = entry.second.histogram.get()) {
+                row.converged = h->Count();
+                row.p50Ms = static_cast<int64_t>(h->ValueAtQuantile(0.5) / 1000);
+                row.p90Ms = static_cast<int64_t>(h->ValueAtQuantile(0.9) / 1000);
+                row.maxMs = static_cast<int64_t>(h->MaxMicros() / 1000);
+            }
+            rows.push_back(row);
+        }
+        std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) {
+            return a.source != b.source ? a.source < b.source : a.dest < b.dest;
+        });
+        return rows;
+    }
+
+    size_t Size() const { return m_cells.size(); }
+    void Clear() { m_cells.clear(); }
+
+private:
+    struct Cell {
+        std::unique_ptr<LatencyHistogram> histogram;
+        uint64_t failed = 0;
+    };
+
+    static uint64_t Key(SiteId source, SiteId dest) { return (static_cast<uint64_t>(source) << 32) | dest; }
+
+    std::unordered_map<uint64_t, Cell> m_cells;
+};
+
+// DCs a canary under container can be read on: those whose replica metadata
+// shows they hold the naming context containing it. Without metadata for
+// that NC, every DC that answered its probe. ids receives the DcId of each
+// target.
+inline std::vector<ProbeTarget> CanaryTargets(const ScanSnapshot& snapshot, const std::wstring& container,
+                                              std::vector<DcId>* ids = nullptr) {
+    // The deepest NC the container is in
+    DnArena scratch(4096);
+    DnView target;
+    NcId nc = kInvalidNc;
+    uint32_t best = 0;
+    if (ParseDn(container, scratch, target)) {
+        for (size_t i = 0; i < snapshot.latency.NcCount(); i++) {
+            const DnArena::Mark mark = scratch.Position();
+            DnView name;
+            if (ParseDn(snapshot.latency.NcName(static_cast<NcId>(i)), scratch, name) && name.count > best &&
+                DnEndsWith(target, name)) {
+                nc = static_cast<NcId>(i);
+                best = name.count;
+            }
+            scratch.Rewind(mark);
+        }
+    }
+
+    auto hosts = [&](DcId id) {
+        const DestinationRow* row = snapshot.latency.Row(id);
+        if (!row) return false;
+        for (const auto& n : row->neighbors) if (n.nc == nc) return true;
+        for (const auto& c : row->cursors) if (c.nc == nc) return true;
+        return false;
+    };
+    bool anyHost = false;
+    if (nc != kInvalidNc) {
+        for (DcId id = 0; id < snapshot.model.Size() && !anyHost; id++) anyHost = hosts(id);
+    }
+
+    std::vector<ProbeTarget> targets;
+    if (ids) ids->clear();
+    for (DcId id = 0; id < snapshot.model.Size(); id++) {
+        const DcRecord& r = snapshot.model.records[id];
+        if (r.status != ProbeStatus::Ok || (anyHost && !hosts(id))) continue;
+        targets.push_back(ProbeTarget{snapshot.model.DcName(id), r.site});
+        if (ids) ids->push_back(id);
+    }
+    return targets;
+}
@@ -0,0 +1,54 @@
+// CancellationToken.h
+// Annulation coopérative d'un scan : demande explicite (bouton, Ctrl+C) ou échéance, chaînable
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Set from any thread (Cancel() is a lock-free store, so a signal handler
+// may call it), polled by the scan between units of work. A token with a
+// parent is also cancelled when the parent is, which lets a scan add its
+// own deadline to the caller's token.
+class CancellationToken {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    CancellationToken() = default;
+    explicit CancellationToken(const CancellationToken* parent, Clock::time_point deadline = Clock::time_point::max())
+        : m_parent(parent) {
+        SetDeadline(deadline);
+    }
+
+    CancellationToken(const CancellationToken&) = delete;
+    CancellationToken& operator=(const CancellationToken&) = delete;
+
+    void Cancel() { m_cancelled.store(true, std::memory_order_release); }
+
+    void SetDeadline(Clock::time_point deadline) {
+        m_deadline.store(deadline.time_since_epoch().count(), std::memory_order_release);
+    }
+
+    // Earliest deadline along the chain
+    Clock::time_point Deadline() const {
+        Clock::time_point own{Clock::duration(m_deadline.load(std::memory_order_acquire))};
+        return m_parent ? std::min(own, m_parent->Deadline()) : own;
+    }
+
+    // Cancel() was called on this token or a parent
+    bool CancelRequested() const {
+        return m_cancelled.load(std::memory_order_acquire) || (m_parent && m_parent->CancelRequested());
+    }
+
+    bool DeadlinePassed() const { return Clock::now() >= Deadline(); }
+
+    bool Cancelled() const { return CancelRequested() || DeadlinePassed(); }
+
+private:
+    const CancellationToken* m_parent = nullptr;
+    std::atomic<bool> m_cancelled{false};
+    std::atomic<Clock::rep> m_deadline{Clock::time_point::max().time_since_epoch().count()};
+};
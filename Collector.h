@@ -0,0 +1,1912 @@
+// Collector.h
+// Collecteur sans interface : options en ligne de commande, scan, synthèse JSON/NDJSON et code de sortie
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "AlertRules.h"
+#include "AsyncLogger.h"
+#include "CancellationToken.h"
+#include "CanaryProbe.h"
+#include "CollectorProtocol.h"
+#include "EventCollector.h"
+#include "HealthCheck.h"
+#include "HistoryRecorder.h"
+#include "LdifDirectoryBackend.h"
+#include "MappedFile.h"
+#include "PrometheusExporter.h"
+#include "RepadminImport.h"
+#include "ReportExporter.h"
+#include "ScanBenchmark.h"
+#include "ScanEngine.h"
+#include "ScanPipeline.h"
+#include "SnapshotFile.h"
+#include "TimeSeriesStore.h"
+#include "TopologyGraph.h"
+#include "UsnAnomaly.h"
+#include "Utf8.h"
+#include "XmlEventSource.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cwchar>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+struct CollectorOptions {
+    ExportFormat format = ExportFormat::Json;   // Json or Ndjson
+    std::wstring output = L"-";
+    std::wstring ldifPath;                      // replay an LDIF export instead of the live forest
+    std::wstring eventsDir;                     // replay <dc>.xml event exports instead of the live logs
+    bool collectEvents = true;
+    unsigned lookbackHours = 24;
+    bool testReplication = false;               // also count replication events in the local log
+    std::wstring historyDir;
+    std::wstring logPath;
+    std::wstring metricsPath;                   // Prometheus text file, rewritten after the scan
+    std::wstring snapshotPath;                  // binary snapshot: diffed against, then replaced by this scan
+    std::wstring rulesPath;                     // alert rules evaluated against the scan
+    std::wstring analyzePath;                   // aggregate replication errors of XML event exports, no scan
+    std::wstring importPath;                    // repadmin /showrepl /csv or /replsummary dump instead of a scan
+    std::wstring rootDc;                        // hop distances from this DC (the PDC, typically)
+    std::wstring canaryContainer;               // --canary: measure propagation through canary objects under it
+    std::vector<std::wstring> canaryOrigins;    // DCs writing the markers; the first DC scanned when empty
+    std::chrono::milliseconds canaryTimeout{1800000};
+    unsigned maxHops = 3;                       // DCs further than this from rootDc are listed
+    bool pipeline = false;                      // rows streamed through ScanPipeline, nothing kept (no snapshot);
+                                                // with --benchmark, its memory against ScanEngine's
+    bool timing = false;
+    bool help = false;
+    ProbeOptions probe;
+
+    // Distributed collection: site collectors report to one aggregator
+    std::vector<std::wstring> sites;            // --site: scan only these sites
+    std::wstring aggregator;                    // --aggregator: run as a site collector reporting there
+    std::wstring listen;                        // --listen: run as the aggregator
+    std::wstring collectorId;                   // defaults to the site list
+    unsigned expect = 0;                        // collectors the aggregator waits for
+    std::chrono::milliseconds wait{60000};      // aggregator: per phase; collector: unreachable aggregator
+    std::chrono::milliseconds interval{0};      // collector: unsolicited batches
+
+    // --benchmark: synthetic forests instead of a scan
+    bool benchmark = false;
+    bool graphBenchmark = false;                // topology graph instead of scans
+    bool scheduleBenchmark = false;             // poll scheduler under a virtual clock instead of scans
+    bool parseBenchmark = false;                // event XML parser: eventsDir, or generated events
+    bool snapshotBenchmark = false;             // snapshot files: encode, map, load, diff
+    bool cancelBenchmark = false;               // cancelled scans of a slow forest: latency, partial results
+    bool alertBenchmark = false;                // alert rules: parser, compiled code against the tree walk, throughput
+    bool usnBenchmark = false;                  // USN anomalies: synthetic traces replayed at one sample per second
+    bool canaryBenchmark = false;               // canary probe against a simulated replication delay
+    bool repadminBenchmark = false;             // repadmin importer: CSV scanner checks, generated dumps in MB
+    bool dnBenchmark = false;                   // distinguished names: fuzzed parser, interned lookups against text keys
+    bool probeBenchmark = false;                // probe engine: per-DC timeout, scan deadline, per-site cap
+    bool discoveryBenchmark = false;            // topology discovery over the checked-in LDIF fixture
+    bool bookmarkBenchmark = false;             // event bookmarks: staged collections resumed without loss or repeats
+    bool modelBenchmark = false;                // replication model: build and classify against threshold edges
+    bool publisherBenchmark = false;            // snapshot publisher under concurrent readers: order, lifetime
+    bool matrixBenchmark = false;               // latency matrix: cells checked against their replica state
+    bool seriesBenchmark = false;               // time series store: a month of samples ingested and range-queried
+    bool loggerBenchmark = false;               // async logger: lines lost under Block, counters under Drop
+    bool exportBenchmark = false;               // CSV and JSON exports read back field by field
+    bool histogramBenchmark = false;            // latency histograms and the Prometheus text they expose
+    bool poolBenchmark = false;                 // connection pool: reuse, per-DC cap, failed binds, contention
+    bool loopbackBenchmark = false;             // collector protocol over a local socket: batches, resends, drops
+    bool pollBenchmark = false;                 // poll context: generation read during scans, foreign snapshots
+    unsigned hours = 24;                        // virtual time of the scheduler benchmark
+    std::vector<unsigned> benchmarkSizes;       // empty: 10,100,1000,10000 (1000,5000 for the graph, 1000,10000 for the
+                                                // scheduler and snapshots, events 100000,1000000 for the parser,
+                                                // 10000 for USN traces, 5000,20000,50000 for the pipeline,
+                                                // 64,1024 MB of repadmin dumps, 10000,100000 DCs for DNs,
+                                                // 200 DCs for the probe limits)
+    uint64_t seed = 1;
+    std::chrono::milliseconds rtt{1};           // local sites; remote sites get 5x
+    unsigned scans = 1;                         // scans per forest, the first one with cold sessions
+    bool pool = true;
+};
+
+// What the platform entry point provides. Either backend may be null when
+// the platform has none (Linux): the matching fixture option is then required.
+struct CollectorEnvironment {
+    std::shared_ptr<IDirectoryBackend> directory;
+    std::shared_ptr<IEventSource> events;
+    std::function<std::wstring()> domainDn;     // configuration NC fallback
+    int64_t startedAt = 0;                      // process start, Unix ms
+    const CancellationToken* cancel = nullptr;  // Ctrl+C: the scan stops, partial results are written
+};
+
+inline void PrintCollectorUsage(std::FILE* out) {
+    std::fputs(
+        "Usage: ADReplicationCollector [options]\n"
+        "  --format json|ndjson     format de sortie (json par défaut)\n"
+        "  --output <fichier>|-     destination (sortie standard par défaut)\n"
+        "  --ldif <fichier>         rejoue un export LDIF au lieu d'interroger la forêt\n"
+        "  --events <répertoire>    rejoue des exports XML d'événements (<dc>.xml)\n"
+        "  --no-events              ne lit pas les journaux d'événements\n"
+        "  --lookback <heures>      fenêtre de lecture des événements (24)\n"
+        "  --test-replication       compte aussi les erreurs de réplication du journal local\n"
+        "  --analyze <chemin>       agrège les erreurs de réplication d'exports XML (fichier ou répertoire), sans scan\n"
+        "  --import <fichier>       lit une sortie repadmin /showrepl * /csv ou /replsummary au lieu de scanner\n"
+        "                           (heures lues en UTC, latences relatives à l'heure la plus récente du fichier)\n"
+        "  --history <répertoire>   ajoute le scan à l'historique USN/latence et y cherche les anomalies USN\n"
+        "                           (blocage, retour arrière, rafale)\n"
+        "  --workers <n>            sondages simultanés (32)\n"
+        "  --timeout <ms>           délai par DC (15000)\n"
+        "  --deadline <ms>          échéance du scan, résultats partiels au-delà (300000)\n"
+        "  --log <fichier>          journal d'exécution (désactivé par défaut)\n"
+        "  --metrics <fichier>      métriques Prometheus (format texte) du scan\n"
+        "  --snapshot <fichier>     compare au snapshot binaire précédent puis le remplace\n"
+        "  --rules <fichier>        règles d'alerte évaluées sur le scan (for= reste en attente sur un scan unique)\n"
+        "  --root <dc>              distances en sauts depuis ce DC (PDC)\n"
+        "  --canary <conteneur>     écrit un marqueur horodaté sur un objet canari (créé sous ce DN) et mesure\n"
+        "                           son arrivée sur chaque DC (droits d'écriture requis)\n"
+        "  --canary-from <dc,...>   DCs d'origine des marqueurs (premier DC du scan par défaut)\n"
+        "  --canary-timeout <s>     abandon d'un DC qui n'a pas reçu le marqueur (1800)\n"
+        "  --hops <n>               liste les DCs à plus de n sauts de --root (3)\n"
+        "  --pipeline               scan en pipeline à mémoire bornée (très grandes forêts) : chaque DC est écrit\n"
+        "                           dès qu'il est analysé, sans snapshot ; --timing affiche les étages chaque seconde\n"
+        "  --site <s1,s2,...>       ne sonde que ces sites (avec --aggregator)\n"
+        "  --aggregator <adresse>   collecteur de site : envoie ses scans à l'agrégateur (hôte:port ou unix:chemin)\n"
+        "  --id <nom>               identifiant du collecteur (liste des sites par défaut)\n"
+        "  --interval <s>           collecteur : envoie aussi un scan toutes les s secondes\n"
+        "  --listen <adresse>       agrégateur : reçoit les collecteurs, demande un scan et fusionne\n"
+        "  --expect <n>             agrégateur : collecteurs attendus avant la demande de scan\n"
+        "  --wait <ms>              délai d'attente des collecteurs puis des scans (60000) ; collecteur :\n"
+        "                           abandon si l'agrégateur reste injoignable\n"
+        "  --timing                 durées de démarrage, scan et écriture sur stderr\n"
+        "  --benchmark              mesure le scan sur des forêts synthétiques (NDJSON)\n"
+        "  --graph                  mesure le graphe de topologie au lieu du scan\n"
+        "  --schedule               mesure la planification des sondages (horloge virtuelle)\n"
+        "  --hours <n>              durée simulée de --schedule en heures (24)\n"
+        "  --parse                  mesure la lecture des événements XML (--events, sinon générés)\n"
+        "  --snapshots              mesure l'écriture, le chargement et la comparaison des snapshots\n"
+        "  --cancel                 mesure l'annulation de scans d'une forêt lente (aller-retour x10)\n"
+        "  --alerts                 vérifie et mesure les règles d'alerte (1000 règles)\n"
+        "  --usn                    rejoue des traces USN synthétiques (1 échantillon/s, 1 h) et vérifie les anomalies\n"
+        "  --propagation            vérifie la sonde canari contre un annuaire simulé à délai de réplication connu\n"
+        "  --pipeline               (avec --benchmark) mémoire du scan en pipeline contre le scan par phases\n"
+        "  --repadmin               vérifie le lecteur CSV et mesure l'import de sorties repadmin générées\n"
+        "  --dn                     vérifie les noms distinctifs (fuzz) et mesure l'internement contre les clés texte\n"
+        "  --probe                  vérifie le délai par DC, l'échéance du scan et le plafond par site du sondage\n"
+        "  --discovery              vérifie la découverte de topologie sur fixtures/topology.ldif (--ldif pour un autre chemin)\n"
+        "  --bookmarks              rejoue fixtures/events : signets, journal vidé (--events)\n"
+        "  --model                  construit et classe le modèle de réplication (10000 DCs)\n"
+        "  --publisher              lectures concurrentes de Current() pendant les publications\n"
+        "  --matrix                 matrice de latence sur forêt générée (2000 DCs)\n"
+        "  --series                 un mois d'historique par DC : ingestion et requêtes (1000 DCs)\n"
+        "  --logger                 journal asynchrone : débit multi-producteurs, pertes et attente\n"
+        "  --export                 exporte 1000000 lignes et relit le CSV et le JSON\n"
+        "  --histograms             histogrammes de latence et format texte Prometheus\n"
+        "  --pool                   pool de connexions : plafond et attente, expiration, contrôle, éviction\n"
+        "  --loopback               collecteurs et agrégateur sur socket locale : doublons, collecteurs muets, coupures\n"
+        "  --poll                   contexte de relevé : génération lue pendant les scans, snapshot étranger\n"
+        "  --sizes <n,n,...>        tailles de forêt en DCs (10,100,1000,10000 ; 1000,5000 avec --graph ;\n"
+        "                           1000,10000 avec --schedule et --snapshots ; 1000 avec --cancel),\n"
+        "                           en événements avec --parse (100000,1000000), en échantillons avec\n"
+        "                           --alerts (100000), en DCs avec --usn (10000), --propagation (100), --probe (200) et\n"
+        "                           --pipeline (5000,20000,50000) et --dn (10000,100000), en Mo avec\n"
+        "                           --repadmin (64,1024)\n"
+        "  --seed <n>               graine du générateur (1)\n"
+        "  --rtt <ms>               aller-retour simulé vers le site local (1), x5 ailleurs\n"
+        "  --scans <n>              scans successifs par forêt (1)\n"
+        "  --no-pool                une liaison par lecture, sans pool de connexions\n"
+        "Codes de sortie: 0 sain, 1 dégradé, 2 critique, 3 inconnu ou échec\n", out);
+}
+
+inline bool ParseCollectorArgs(const std::vector<std::wstring>& args, CollectorOptions& options, std::string& error) {
+    for (size_t i = 0; i < args.size(); i++) {
+        const std::wstring& arg = args[i];
+        auto value = [&](std::wstring& out) {
+            if (i + 1 >= args.size()) {
+                error = "valeur manquante pour " + WideToUtf8(arg);
+                return false;
+            }
+            out = args[++i];
+            return true;
+        };
+        auto number = [&](unsigned long long& out) {
+            std::wstring text;
+            if (!value(text)) return false;
+            wchar_t* end = nullptr;
+            out = std::wcstoull(text.c_str(), &end, 10);
+            if (text.empty() || *end != L'\0') {
+                error = "nombre invalide pour " + WideToUtf8(arg) + ": " + WideToUtf8(text);
+                return false;
+            }
+            return true;
+        };
+
+        std::wstring text;
+        unsigned long long n = 0;
+        if (arg == L"--help" || arg == L"-h" || arg == L"/?") {
+            options.help = true;
+        } else if (arg == L"--format") {
+            if (!value(text)) return false;
+            if (text == L"json") {
+                options.format = ExportFormat::Json;
+            } else if (text == L"ndjson") {
+                options.format = ExportFormat::Ndjson;
+            } else {
+                error = "format inconnu: " + WideToUtf8(text);
+                return false;
+            }
+        } else if (arg == L"--output") {
+            if (!value(options.output)) return false;
+        } else if (arg == L"--ldif") {
+            if (!value(options.ldifPath)) return false;
+        } else if (arg == L"--events") {
+            if (!value(options.eventsDir)) return false;
+        } else if (arg == L"--no-events") {
+            options.collectEvents = false;
+        } else if (arg == L"--lookback") {
+            if (!number(n)) return false;
+            options.lookbackHours = (unsigned)n;
+        } else if (arg == L"--test-replication") {
+            options.testReplication = true;
+        } else if (arg == L"--analyze") {
+            if (!value(options.analyzePath)) return false;
+        } else if (arg == L"--import") {
+            if (!value(options.importPath)) return false;
+        } else if (arg == L"--history") {
+            if (!value(options.historyDir)) return false;
+        } else if (arg == L"--workers") {
+            if (!number(n)) return false;
+            options.probe.workers = (unsigned)n;
+        } else if (arg == L"--timeout") {
+            if (!number(n)) return false;
+            options.probe.dcTimeout = std::chrono::milliseconds(n);
+        } else if (arg == L"--deadline") {
+            if (!number(n)) return false;
+            options.probe.scanDeadline = std::chrono::milliseconds(n);
+        } else if (arg == L"--log") {
+            if (!value(options.logPath)) return false;
+        } else if (arg == L"--metrics") {
+            if (!value(options.metricsPath)) return false;
+        } else if (arg == L"--snapshot") {
+            if (!value(options.snapshotPath)) return false;
+        } else if (arg == L"--rules") {
+            if (!value(options.rulesPath)) return false;
+        } else if (arg == L"--root") {
+            if (!value(options.rootDc)) return false;
+        } else if (arg == L"--canary") {
+            if (!value(options.canaryContainer)) return false;
+        } else if (arg == L"--canary-from") {
+            if (!value(text)) return false;
+            options.canaryOrigins.clear();
+            for (size_t pos = 0; pos <= text.size();) {
+                size_t comma = text.find(L',', pos);
+                if (comma == std::wstring::npos) comma = text.size();
+                if (comma > pos) options.canaryOrigins.push_back(text.substr(pos, comma - pos));
+                pos = comma + 1;
+            }
+        } else if (arg == L"--canary-timeout") {
+            if (!number(n)) return false;
+            options.canaryTimeout = std::chrono::seconds(std::max<unsigned long long>(1, n));
+        } else if (arg == L"--pipeline") {
+            options.pipeline = true;
+        } else if (arg == L"--hops") {
+            if (!number(n)) return false;
+            options.maxHops = static_cast<unsigned>(n);
+        } else if (arg == L"--site") {
+            if (!value(text)) return false;
+            options.sites.clear();
+            for (size_t pos = 0; pos <= text.size();) {
+                size_t comma = text.find(L',', pos);
+                if (comma == std::wstring::npos) comma = text.size();
+                if (comma > pos) options.sites.push_back(text.substr(pos, comma - pos));
+                pos = comma + 1;
+            }
+        } else if (arg == L"--aggregator") {
+            if (!value(options.aggregator)) return false;
+        } else if (arg == L"--listen") {
+            if (!value(options.listen)) return false;
+        } else if (arg == L"--id") {
+            if (!value(options.collectorId)) return false;
+        } else if (arg == L"--expect") {
+            if (!number(n)) return false;
+            options.expect = static_cast<unsigned>(n);
+        } else if (arg == L"--wait") {
+            if (!number(n)) return false;
+            options.wait = std::chrono::milliseconds(n);
+        } else if (arg == L"--interval") {
+            if (!number(n)) return false;
+            options.interval = std::chrono::seconds(n);
+        } else if (arg == L"--timing") {
+            options.timing = true;
+        } else if (arg == L"--benchmark") {
+            options.benchmark = true;
+        } else if (arg == L"--graph") {
+            options.graphBenchmark = true;
+        } else if (arg == L"--schedule") {
+            options.scheduleBenchmark = true;
+        } else if (arg == L"--parse") {
+            options.parseBenchmark = true;
+        } else if (arg == L"--snapshots") {
+            options.snapshotBenchmark = true;
+        } else if (arg == L"--cancel") {
+            options.cancelBenchmark = true;
+        } else if (arg == L"--alerts") {
+            options.alertBenchmark = true;
+        } else if (arg == L"--usn") {
+            options.usnBenchmark = true;
+        } else if (arg == L"--propagation") {
+            options.canaryBenchmark = true;
+        } else if (arg == L"--repadmin") {
+            options.repadminBenchmark = true;
+        } else if (arg == L"--dn") {
+            options.dnBenchmark = true;
+        } else if (arg == L"--probe") {
+            options.probeBenchmark = true;
+        } else if (arg == L"--discovery") {
+            options.discoveryBenchmark = true;
+        } else if (arg == L"--bookmarks") {
+            options.bookmarkBenchmark = true;
+        } else if (arg == L"--model") {
+            options.modelBenchmark = true;
+        } else if (arg == L"--publisher") {
+            options.publisherBenchmark = true;
+        } else if (arg == L"--matrix") {
+            options.matrixBenchmark = true;
+        } else if (arg == L"--series") {
+            options.seriesBenchmark = true;
+        } else if (arg == L"--logger") {
+            options.loggerBenchmark = true;
+        } else if (arg == L"--export") {
+            options.exportBenchmark = true;
+        } else if (arg == L"--histograms") {
+            options.histogramBenchmark = true;
+        } else if (arg == L"--pool") {
+            options.poolBenchmark = true;
+        } else if (arg == L"--loopback") {
+            options.loopbackBenchmark = true;
+        } else if (arg == L"--poll") {
+            options.pollBenchmark = true;
+        } else if (arg == L"--hours") {
+            if (!number(n)) return false;
+            options.hours = static_cast<unsigned>(std::max<unsigned long long>(1, n));
+        } else if (arg == L"--sizes") {
+            if (!value(text)) return false;
+            options.benchmarkSizes.clear();
+            for (size_t pos = 0; pos < text.size();) {
+                wchar_t* end = nullptr;
+                unsigned long size = std::wcstoul(text.c_str() + pos, &end, 10);
+                size_t next = static_cast<size_t>(end - text.c_str());
+                if (next == pos || size == 0 || (next < text.size() && text[next] != L',')) {
+                    error = "liste de tailles invalide: " + WideToUtf8(text);
+                    return false;
+                }
+                options.benchmarkSizes.push_back(static_cast<unsigned>(size));
+                pos = next + 1;
+            }
+        } else if (arg == L"--seed") {
+            if (!number(n)) return false;
+            options.seed = n;
+        } else if (arg == L"--rtt") {
+            if (!number(n)) return false;
+            options.rtt = std::chrono::milliseconds(n);
+        } else if (arg == L"--scans") {
+            if (!number(n)) return false;
+            options.scans = static_cast<unsigned>(std::max<unsigned long long>(1, n));
+        } else if (arg == L"--no-pool") {
+            options.pool = false;
+        } else {
+            error = "option inconnue: " + WideToUtf8(arg);
+            return false;
+        }
+    }
+    if (!options.sites.empty() && options.aggregator.empty()) {
+        error = "--site requiert --aggregator";
+        return false;
+    }
+    if (options.pipeline && !options.benchmark &&
+        (!options.snapshotPath.empty() || !options.historyDir.empty() || !options.rulesPath.empty() ||
+         !options.metricsPath.empty() || !options.rootDc.empty() || !options.canaryContainer.empty() ||
+         !options.aggregator.empty() || !options.listen.empty())) {
+        error = "--pipeline ne conserve pas le scan : incompatible avec --snapshot, --history, --rules, --metrics, "
+                "--root, --canary, --aggregator et --listen";
+        return false;
+    }
+    // A dump has no USN (the anomaly detector would see every DC roll back)
+    // and no forest to write canaries to or to partition between collectors
+    if (!options.importPath.empty() && !options.benchmark &&
+        (!options.historyDir.empty() || !options.canaryContainer.empty() || !options.aggregator.empty() ||
+         !options.listen.empty() || options.pipeline || !options.ldifPath.empty())) {
+        error = "--import remplace le scan : incompatible avec --history, --canary, --aggregator, --listen, "
+                "--pipeline et --ldif";
+        return false;
+    }
+    return true;
+}
+
+// "topology":{"links","convergenceSec","unreachablePairs","stalestDcs":[...],
+//  "articulationPoints":[{"dc","site","isolatedSites":[...]}], "root":{...}}
+// from the replication graph of the scan
+inline std::string FormatTopologySummary(const ScanSnapshot& snapshot, const CollectorOptions& options) {
+    const ReplicationModel& model = snapshot.model;
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    auto name = [&](DcId id) { return ReportExporter::JsonString(WideToUtf8(model.DcName(id))); };
+
+    TopologyGraph graph = BuildTopologyGraph(snapshot);
+    graph.ComputeBounds(std::max(1u, std::thread::hardware_concurrency()));
+
+    std::string s = "\"topology\":{\"links\":" + num(graph.EdgeCount());
+    s += ",\"convergenceSec\":" + num(graph.ConvergenceSec());
+    s += ",\"unreachablePairs\":" + num(graph.UnreachablePairs());
+
+    std::vector<DcId> stalest(model.Size());
+    for (DcId id = 0; id < model.Size(); id++) stalest[id] = id;
+    size_t top = std::min<size_t>(10, stalest.size());
+    std::partial_sort(stalest.begin(), stalest.begin() + top, stalest.end(), [&](DcId a, DcId b) {
+        return graph.Bound(a).delaySec > graph.Bound(b).delaySec;
+    });
+    s += ",\"stalestDcs\":[";
+    for (size_t i = 0; i < top; i++) {
+        TopologyGraph::StalenessBound b = graph.Bound(stalest[i]);
+        if (b.sources == 0) break;
+        if (i) s += ',';
+        s += "{\"dc\":" + name(stalest[i]) + ",\"sec\":" + num(b.delaySec) + ",\"from\":" + name(b.worstSource) +
+             ",\"hops\":" + num(b.hops) + ",\"sources\":" + num(b.sources) + '}';
+    }
+    s += "],\"articulationPoints\":[";
+    bool first = true;
+    for (DcId dc : graph.ArticulationPoints()) {
+        if (!first) s += ',';
+        first = false;
+        s += "{\"dc\":" + name(dc) + ",\"site\":" + ReportExporter::JsonString(WideToUtf8(model.SiteName(dc))) +
+             ",\"isolatedSites\":[";
+        TopologyGraph::Partition partition = graph.IslandsWithout(dc);
+        for (size_t k = 0; k < partition.isolatedSites.size(); k++) {
+            if (k) s += ',';
+            s += ReportExporter::JsonString(WideToUtf8(model.sites.Name(partition.isolatedSites[k])));
+        }
+        s += "]}";
+    }
+    s += ']';
+
+    if (!options.rootDc.empty()) {
+        DcId root = kInvalidId;
+        for (DcId id = 0; id < model.Size() && root == kInvalidId; id++) {
+            if (DnEqual()(model.DcName(id), options.rootDc)) root = id;
+        }
+        s += ",\"root\":";
+        if (root == kInvalidId) {
+            s += "null";
+        } else {
+            std::vector<uint32_t> hops = graph.HopsFrom(root);
+            s += "{\"dc\":" + name(root) + ",\"maxHops\":" + num(options.maxHops) + ",\"beyond\":[";
+            first = true;
+            for (DcId id = 0; id < model.Size(); id++) {
+                if (hops[id] == TopologyGraph::kUnreachable || hops[id] <= options.maxHops) continue;
+                if (!first) s += ',';
+                first = false;
+                s += "{\"dc\":" + name(id) + ",\"hops\":" + num(hops[id]) + '}';
+            }
+            s += "],\"unreached\":[";
+            first = true;
+            for (DcId id = 0; id < model.Size(); id++) {
+                if (hops[id] != TopologyGraph::kUnreachable) continue;
+                if (!first) s += ',';
+                first = false;
+                s += name(id);
+            }
+            s += "]}";
+        }
+    }
+    s += '}';
+    return s;
+}
+
+// [{"source","dest","error","eventId","nc","count","first","last"}...], the
+// n most frequent (source, destination, error) triples
+inline std::string FormatReplicationErrors(const ReplicationErrorTable& table, size_t n) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    char stamp[24];
+    std::string s = "[";
+    for (const ReplicationErrorEntry& e : table.Top(n)) {
+        if (s.size() > 1) s += ',';
+        s += "{\"source\":" + ReportExporter::JsonString(table.Name(e.source)) +
+             ",\"dest\":" + ReportExporter::JsonString(table.Name(e.dest)) + ",\"error\":" + num(e.error) +
+             ",\"eventId\":" + num(e.lastEventId) + ",\"nc\":" + ReportExporter::JsonString(table.Name(e.namingContext)) +
+             ",\"count\":" + num(e.count) + ",\"first\":\"";
+        s.append(stamp, ReportExporter::FormatTimestamp(e.firstSeen, stamp));
+        s += "\",\"last\":\"";
+        s.append(stamp, ReportExporter::FormatTimestamp(e.lastSeen, stamp));
+        s += "\"}";
+    }
+    s += ']';
+    return s;
+}
+
+// "changes":{"since","added":[...],"removed":[...],"usnRegressions":[{"dc","before","after"}],
+//  "newFailures":[{"dc","before","after"}],"lagChanges":[{"dc","beforeSec","afterSec","lagBefore","lagAfter"}]}
+// against the previous snapshot file
+inline std::string FormatSnapshotDiff(const SnapshotDiff& diff, int64_t since) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    auto latency = [&](uint64_t sec) { return sec == kUnknownLatency ? std::string("null") : num(sec); };
+    auto names = [](const std::vector<std::string>& list) {
+        std::string s = "[";
+        for (const std::string& n : list) {
+            if (s.size() > 1) s += ',';
+            s += ReportExporter::JsonString(n);
+        }
+        return s + ']';
+    };
+    auto changes = [&](const std::vector<SnapshotDcChange>& list, bool lag) {
+        std::string s = "[";
+        for (const SnapshotDcChange& c : list) {
+            if (s.size() > 1) s += ',';
+            s += "{\"dc\":" + ReportExporter::JsonString(c.dc);
+            if (lag) {
+                s += ",\"beforeSec\":" + latency(c.before) + ",\"afterSec\":" + latency(c.after) + ",\"lagBefore\":\"";
+                s += LagClassName(c.lagBefore);
+                s += "\",\"lagAfter\":\"";
+                s += LagClassName(c.lagAfter);
+                s += "\"}";
+            } else {
+                s += ",\"before\":" + num(c.before) + ",\"after\":" + num(c.after) + '}';
+            }
+        }
+        return s + ']';
+    };
+    char stamp[24];
+    std::string s = "\"changes\":{\"since\":\"";
+    s.append(stamp, ReportExporter::FormatTimestamp(since, stamp));
+    s += "\",\"added\":" + names(diff.added) + ",\"removed\":" + names(diff.removed) +
+         ",\"usnRegressions\":" + changes(diff.usnRegressions, false) +
+         ",\"newFailures\":" + changes(diff.newFailures, false) + ",\"lagChanges\":" + changes(diff.lagChanges, true) + '}';
+    return s;
+}
+
+// {"generatedAt":..., "health":..., "exitCode":..., counts, "usn":{...}, timings,
+//  "replicationErrors":[...], "phases":{"bind":{"n","p50Ms","p99Ms","maxMs"},...}, "slowestDcs":[...],
+//  then the extra sections in order ("topology":{...}, "changes":{...}...); empty ones are skipped
+inline std::string FormatCollectorSummary(const HealthReport& h, const ScanSnapshot* snapshot, const std::wstring& configDn,
+                                          int64_t localErrors, int64_t startupMs, int64_t scanMs, const std::string& error,
+                                          const std::vector<std::string>& sections = {}) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    char stamp[24];
+    std::string s = "{\"generatedAt\":\"";
+    s.append(stamp, ReportExporter::FormatTimestamp(UnixNowMs(), stamp));
+    s += "\",\"health\":\"";
+    s += HealthStatusName(h.status);
+    s += "\",\"exitCode\":" + num(static_cast<uint64_t>(h.status));
+    if (!error.empty()) s += ",\"error\":" + ReportExporter::JsonString(error);
+    if (snapshot && snapshot->cancelled) s += ",\"cancelled\":true";
+    s += ",\"configurationNc\":" + ReportExporter::JsonString(WideToUtf8(configDn));
+    s += ",\"siteCount\":" + num(snapshot ? snapshot->siteCount : 0);
+    s += ",\"dcCount\":" + num(h.dcs);
+    s += ",\"reachable\":" + num(h.reachable);
+    s += ",\"unreachable\":" + num(h.unreachable);
+    s += ",\"timedOut\":" + num(h.timedOut);
+    s += ",\"failingLinks\":" + num(h.failingLinks);
+    s += ",\"eventErrors\":" + num(h.eventErrors);
+    s += ",\"eventsUnavailable\":" + num(h.eventsUnavailable);
+    s += ",\"lag\":{";
+    for (size_t k = 0; k < 5; k++) {
+        if (k) s += ',';
+        s += '"';
+        s += LagClassName(static_cast<LagClass>(k));
+        s += "\":" + num(h.lag[k]);
+    }
+    s += "},\"usn\":";
+    if (snapshot && h.spread.count > 0) {
+        s += "{\"min\":" + num(h.spread.minUsn) + ",\"max\":" + num(h.spread.maxUsn) + ",\"diff\":" + num(h.spread.Diff());
+        s += ",\"minDc\":" + ReportExporter::JsonString(WideToUtf8(snapshot->model.DcName(h.spread.minDc)));
+        s += ",\"maxDc\":" + ReportExporter::JsonString(WideToUtf8(snapshot->model.DcName(h.spread.maxDc)));
+        s += ",\"lag\":\"";
+        s += LagClassName(h.usnLag);
+        s += "\"}";
+    } else {
+        s += "null";
+    }
+    s += ",\"localReplicationErrors\":" + (localErrors >= 0 ? num(static_cast<uint64_t>(localErrors)) : std::string("null"));
+    if (snapshot && snapshot->replicationErrors) {
+        s += ",\"replicationErrors\":" + FormatReplicationErrors(*snapshot->replicationErrors, 20);
+    }
+    s += ",\"startupMs\":" + num(static_cast<uint64_t>(startupMs));
+    s += ",\"scanMs\":" + num(static_cast<uint64_t>(scanMs));
+    if (snapshot && snapshot->metrics) {
+        const ScanMetrics& metrics = *snapshot->metrics;
+        char ms[32];
+        auto millis = [&](uint64_t micros) {
+            std::snprintf(ms, sizeof(ms), "%.3f", micros / 1000.0);
+            return std::string(ms);
+        };
+        s += ",\"phases\":{";
+        bool first = true;
+        for (size_t p = 0; p < kMetricPhases; p++) {
+            PhaseSummary ps = metrics.Summarize(static_cast<MetricPhase>(p));
+            if (ps.count == 0) continue;
+            if (!first) s += ',';
+            first = false;
+            s += '"';
+            s += MetricPhaseName(ps.phase);
+            s += "\":{\"n\":" + num(ps.count) + ",\"p50Ms\":" + millis(ps.p50Us) + ",\"p99Ms\":" + millis(ps.p99Us) +
+                 ",\"maxMs\":" + millis(ps.maxUs) + '}';
+        }
+        s += "},\"slowestDcs\":[";
+        first = true;
+        for (const DcTiming& t : metrics.SlowestDcs(10)) {
+            if (t.totalUs == 0 || t.dc >= snapshot->model.Size()) break;
+            if (!first) s += ',';
+            first = false;
+            s += "{\"dc\":" + ReportExporter::JsonString(WideToUtf8(snapshot->model.DcName(t.dc))) +
+                 ",\"ms\":" + millis(t.totalUs) + '}';
+        }
+        s += ']';
+    }
+    for (const std::string& section : sections) {
+        if (!section.empty()) s += ',' + section;
+    }
+    s += '}';
+    return s;
+}
+
+// "alerts":{"rules","pending","firing":[{"rule","severity","dc","site","source","namingContext","since","value"}]},
+// most severe first; source and namingContext only for partner rules
+inline std::string FormatAlertSummary(const AlertEngine& alerts) {
+    char stamp[24];
+    char value[32];
+    std::string s = "\"alerts\":{\"rules\":" + std::to_string(alerts.Rules().size()) +
+                    ",\"pending\":" + std::to_string(alerts.Pending()) + ",\"firing\":[";
+    bool first = true;
+    for (const ActiveAlert& a : alerts.Active()) {
+        const AlertRule& rule = alerts.Rules()[a.rule];
+        if (!first) s += ',';
+        first = false;
+        s += "{\"rule\":" + ReportExporter::JsonString(rule.name) + ",\"severity\":\"" + AlertSeverityName(rule.severity) +
+             "\",\"dc\":" + ReportExporter::JsonString(WideToUtf8(a.dc)) +
+             ",\"site\":" + ReportExporter::JsonString(WideToUtf8(a.site));
+        if (rule.partner) {
+            s += ",\"source\":" + ReportExporter::JsonString(WideToUtf8(a.source)) +
+                 ",\"namingContext\":" + ReportExporter::JsonString(WideToUtf8(a.namingContext));
+        }
+        s += ",\"since\":\"";
+        s.append(stamp, ReportExporter::FormatTimestamp(a.since, stamp));
+        s += "\",\"value\":";
+        if (a.value == a.value) {
+            std::snprintf(value, sizeof(value), "%.15g", a.value);
+            s += value;
+        } else {
+            s += "null";
+        }
+        s += '}';
+    }
+    s += "]}";
+    return s;
+}
+
+// "usnAnomalies":[{kind, dc, time, since, usn, previousUsn, rate, threshold}]
+// for the anomalies this scan's samples raised
+inline std::string FormatUsnAnomalySummary(const std::vector<UsnAnomalyEntry>& anomalies) {
+    char stamp[24];
+    char number[32];
+    auto real = [&](double v) {
+        std::snprintf(number, sizeof(number), "%.6g", v);
+        return std::string(number);
+    };
+    std::string s = "\"usnAnomalies\":[";
+    for (size_t i = 0; i < anomalies.size(); i++) {
+        const UsnAnomaly& a = anomalies[i].anomaly;
+        if (i) s += ',';
+        s += "{\"kind\":\"" + std::string(UsnAnomalyKindName(a.kind)) + "\",\"dc\":" +
+             ReportExporter::JsonString(WideToUtf8(anomalies[i].dc)) + ",\"time\":\"";
+        s.append(stamp, ReportExporter::FormatTimestamp(a.time, stamp));
+        s += "\",\"since\":\"";
+        s.append(stamp, ReportExporter::FormatTimestamp(a.since, stamp));
+        s += "\",\"usn\":" + std::to_string(a.usn) + ",\"previousUsn\":" + std::to_string(a.previousUsn) +
+             ",\"rate\":" + real(a.rate) + ",\"threshold\":" + real(a.threshold) + '}';
+    }
+    s += ']';
+    return s;
+}
+
+// "canary":{"container","probes","pairs","converged","notConverged","unreachable","writeFailed",
+//  "sitePairs":[{"source","dest","converged","failed","p50Ms","p90Ms","maxMs"}],
+//  "slowest":[{"source","dest","status","latencyMs","lowerMs","upperMs"}]}: pairs that did not
+// converge first, then the longest propagation times
+inline std::string FormatCanarySummary(const std::wstring& container, size_t probes, const std::vector<CanaryResult>& results,
+                                       const std::vector<ProbeTarget>& targets, const CanaryLatencyTable& table,
+                                       const ReplicationModel& model) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    auto inum = [](int64_t v) { return std::to_string(v); };
+    size_t counts[5] = {};
+    for (const auto& r : results) counts[static_cast<size_t>(r.status)]++;
+    std::string s = "\"canary\":{\"container\":" + ReportExporter::JsonString(WideToUtf8(container)) +
+                    ",\"probes\":" + num(probes) + ",\"pairs\":" + num(results.size()) +
+                    ",\"converged\":" + num(counts[0]) + ",\"notConverged\":" + num(counts[1]) +
+                    ",\"unreachable\":" + num(counts[2]) + ",\"writeFailed\":" + num(counts[3]) + ",\"sitePairs\":[";
+    bool first = true;
+    for (const auto& row : table.Rows()) {
+        if (!first) s += ',';
+        first = false;
+        s += "{\"source\":" + ReportExporter::JsonString(WideToUtf8(model.sites.Name(row.source))) +
+             ",\"dest\":" + ReportExporter::JsonString(WideToUtf8(model.sites.Name(row.dest))) +
+             ",\"converged\":" + num(row.converged) + ",\"failed\":" + num(row.failed) +
+             ",\"p50Ms\":" + inum(row.p50Ms) + ",\"p90Ms\":" + inum(row.p90Ms) + ",\"maxMs\":" + inum(row.maxMs) + '}';
+    }
+    s += "],\"slowest\":[";
+
+    std::vector<const CanaryResult*> order;
+    for (const auto& r : results) {
+        if (r.status != CanaryStatus::WriteFailed && r.status != CanaryStatus::Cancelled) order.push_back(&r);
+    }
+    const size_t top = std::min<size_t>(10, order.size());
+    auto rank = [](const CanaryResult* r) { return r->status == CanaryStatus::Converged ? r->latencyMs : INT64_MAX; };
+    std::partial_sort(order.begin(), order.begin() + top, order.end(),
+                      [&](const CanaryResult* a, const CanaryResult* b) { return rank(a) > rank(b); });
+    for (size_t i = 0; i < top; i++) {
+        const CanaryResult& r = *order[i];
+        if (i) s += ',';
+        s += "{\"source\":" + ReportExporter::JsonString(WideToUtf8(targets[r.source].dc)) +
+             ",\"dest\":" + ReportExporter::JsonString(WideToUtf8(targets[r.dest].dc)) + ",\"status\":\"" +
+             CanaryStatusName(r.status) + "\",\"latencyMs\":" + inum(r.latencyMs) +
+             ",\"lowerMs\":" + inum(r.lowerMs) + ",\"upperMs\":" + inum(r.upperMs) + '}';
+    }
+    s += "]}";
+    return s;
+}
+
+// The directory and the event sources of a scan: the fixtures given on the
+// command line, the platform's otherwise
+struct CollectorSources {
+    std::shared_ptr<IDirectoryBackend> directory;
+    std::shared_ptr<IEventSource> events;
+    std::shared_ptr<EventCollector> eventCollector;     // null without events
+    EventCollectorOptions eventOptions;
+};
+
+// False, with the reason on stderr, when there is no directory to scan
+inline bool OpenCollectorSources(const CollectorOptions& options, const CollectorEnvironment& env, CollectorSources& sources) {
+    sources.directory = env.directory;
+    if (!options.ldifPath.empty()) {
+        auto ldif = std::make_shared<LdifDirectoryBackend>();
+        if (!ldif->LoadFile(options.ldifPath)) {
+            std::fprintf(stderr, "Impossible de lire %s\n", WideToUtf8(options.ldifPath).c_str());
+            return false;
+        }
+        sources.directory = ldif;
+    }
+    if (!sources.directory) {
+        std::fputs("Aucun backend d'annuaire sur cette plateforme: utilisez --ldif\n", stderr);
+        return false;
+    }
+
+    if (options.collectEvents) {
+        sources.events = options.eventsDir.empty() ? env.events : std::make_shared<XmlEventSource>(options.eventsDir);
+    }
+    sources.eventOptions.initialLookback = std::chrono::hours(options.lookbackHours);
+    if (sources.events) sources.eventCollector = std::make_shared<EventCollector>(sources.events, sources.eventOptions);
+    return true;
+}
+
+// JSON: {"summary":{...},"dcs":[...]}. NDJSON: one line per DC (the export
+// row format), then {"summary":{...}} last.
+inline bool WriteCollectorDocument(const CollectorOptions& options, const std::string& summary, const ScanSnapshot* snapshot) {
+    ReportExporter exporter(options.format);
+    if (!exporter.Open(options.output)) {
+        std::fprintf(stderr, "Impossible d'écrire %s\n", WideToUtf8(options.output).c_str());
+        return false;
+    }
+    BufferedWriter& out = exporter.Writer();
+    if (options.format == ExportFormat::Json) {
+        out.Write("{\"summary\":");
+        out.Write(summary);
+        out.Write(",\"dcs\":");
+        if (snapshot) {
+            exporter.WriteSnapshot(*snapshot);
+        } else {
+            out.Write("[]\n");
+        }
+        out.Write("}\n");
+    } else {
+        if (snapshot) exporter.WriteSnapshot(*snapshot);
+        out.Write("{\"summary\":");
+        out.Write(summary);
+        out.Write("}\n");
+    }
+    return exporter.Close();
+}
+
+// --pipeline: the scan through ScanPipeline, each DC written as soon as it
+// is analysed and then forgotten, so memory does not grow with the forest.
+// JSON: {"dcs":[...],"summary":{...}}; NDJSON: rows, then the summary.
+// Without a snapshot the summary's siteCount and usn are empty: the
+// "pipeline" section carries them, with the stage counters. --timing
+// prints the stages every second.
+inline int RunPipelinedCollector(const CollectorOptions& options, const CollectorEnvironment& env) {
+    using Clock = std::chrono::steady_clock;
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    const int64_t startedAt = env.startedAt ? env.startedAt : UnixNowMs();
+
+    AsyncLogger logger;
+    if (!options.logPath.empty()) {
+        LoggerOptions logOptions;
+        logOptions.path = options.logPath;
+        logger.Start(logOptions);
+    }
+
+    CollectorSources sources;
+    if (!OpenCollectorSources(options, env, sources)) return static_cast<int>(HealthStatus::Unknown);
+
+    ReportExporter exporter(options.format);
+    if (!exporter.Open(options.output)) {
+        std::fprintf(stderr, "Impossible d'écrire %s\n", WideToUtf8(options.output).c_str());
+        return static_cast<int>(HealthStatus::Unknown);
+    }
+    BufferedWriter& out = exporter.Writer();
+    if (options.format == ExportFormat::Json) out.Write("{\"dcs\":");
+    exporter.BeginStream(sources.eventCollector ? sources.eventCollector->Options().eventIds : std::vector<uint32_t>());
+
+    struct ExportSink : IPipelineSink {
+        explicit ExportSink(ReportExporter& e) : exporter(e) {}
+        void OnDc(const PipelineDc& dc) override { exporter.WriteRow(dc.site, dc.name, dc.record, dc.eventCounts.data()); }
+        ReportExporter& exporter;
+    } sink(exporter);
+
+    const int64_t startupMs = UnixNowMs() - startedAt;
+    const auto scanStart = Clock::now();
+    const std::wstring configDn = ResolveConfigurationDn(*sources.directory, options.probe.dcTimeout, env.domainDn);
+    ScanPipeline pipeline(sources.directory, sources.eventCollector, options.probe);
+    PipelineResult result = pipeline.Run(configDn, sink, env.cancel, [&](const PipelineStats& stats) {
+        if (!options.timing) return;
+        std::fprintf(stderr, "%6.1f s", stats.elapsedMs / 1000.0);
+        for (size_t i = 0; i < kPipelineStages; i++) {
+            std::fprintf(stderr, "  %s %llu", PipelineStageName(static_cast<PipelineStage>(i)),
+                         (unsigned long long)stats.stages[i].items);
+            if (i + 1 < kPipelineStages) {
+                std::fprintf(stderr, " [%zu/%zu]", stats.queues[i].depth, stats.queues[i].capacity);
+            }
+        }
+        std::fputc('\n', stderr);
+    });
+    exporter.End();
+    int64_t localErrors = (options.testReplication && sources.events)
+                              ? CountReplicationEvents(*sources.events, sources.eventOptions) : -1;
+    const int64_t scanMs = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - scanStart).count();
+
+    HealthReport& health = result.health;
+    if (localErrors > 0 && health.status == HealthStatus::Healthy) health.status = HealthStatus::Degraded;
+    if (result.cancelled) health.status = HealthStatus::Unknown;
+    std::string section = "\"pipeline\":{\"cancelled\":" + std::string(result.cancelled ? "true" : "false") +
+                          ",\"siteCount\":" + num(result.sites.size()) + ",\"entriesRead\":" + num(result.entriesRead) +
+                          ",\"connections\":" + num(result.connections) + ",\"withLatency\":" + num(result.withLatency);
+    if (health.spread.count > 0) {
+        section += ",\"usn\":{\"min\":" + num(health.spread.minUsn) + ",\"max\":" + num(health.spread.maxUsn) +
+                   ",\"diff\":" + num(health.spread.Diff()) +
+                   ",\"minDc\":" + ReportExporter::JsonString(WideToUtf8(result.minUsnDc)) +
+                   ",\"maxDc\":" + ReportExporter::JsonString(WideToUtf8(result.maxUsnDc)) + '}';
+    }
+    section += "," + FormatPipelineStatsJson(result.stats) + '}';
+    std::string summary = FormatCollectorSummary(health, nullptr, configDn, localErrors, startupMs, scanMs,
+                                                 result.discovered ? std::string() : std::string("Aucun site AD trouvé"),
+                                                 {section});
+    out.Write(options.format == ExportFormat::Json ? ",\"summary\":" : "{\"summary\":");
+    out.Write(summary);
+    out.Write("}\n");
+    const bool written = exporter.Close();
+
+    if (options.timing) {
+        std::fprintf(stderr, "démarrage %lld ms, scan %lld ms (%llu DCs)\n", (long long)startupMs, (long long)scanMs,
+                     (unsigned long long)exporter.RowsWritten());
+    }
+    logger.Log(LogLevel::Info, L"Collecte terminée",
+               {{"health", HealthStatusName(health.status)}, {"dcs", health.dcs}, {"ms", scanMs}});
+    logger.Stop();
+    return written ? static_cast<int>(health.status) : static_cast<int>(HealthStatus::Unknown);
+}
+
+// "import":{"path","format","bytes","records","rows","superseded","skipped",
+//  "chunks","dumpTime","ms","megabytesPerSecond"} when --import replaced the scan
+inline std::string FormatImportSummary(const std::wstring& path, const RepadminImportStats& stats) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    const double ms = stats.splitMs + stats.parseMs + stats.mergeMs;
+    char dumpTime[24], rate[32];
+    const size_t dumpTimeLength = ReportExporter::FormatTimestamp(stats.dumpTime, dumpTime);
+    std::snprintf(rate, sizeof(rate), "%.1f", ms > 0 ? stats.bytes / (1024.0 * 1024.0) / (ms / 1000) : 0.0);
+    return "\"import\":{\"path\":" + ReportExporter::JsonString(WideToUtf8(path)) +
+           ",\"format\":\"" + RepadminFormatName(stats.format) + "\",\"bytes\":" + num(stats.bytes) +
+           ",\"records\":" + num(stats.records) + ",\"rows\":" + num(stats.rows) +
+           ",\"superseded\":" + num(stats.superseded) + ",\"skipped\":" + num(stats.skipped) +
+           ",\"chunks\":" + num(stats.chunks) +
+           ",\"dumpTime\":" + ReportExporter::JsonString(std::string(dumpTime, dumpTimeLength)) +
+           ",\"ms\":" + num(static_cast<uint64_t>(ms)) + ",\"megabytesPerSecond\":" + rate + '}';
+}
+
+// One scan, one document (see WriteCollectorDocument). Returns the health
+// status as exit code; 3 when the scan could not run, stopped early
+// (Ctrl+C, --deadline) or the output could not be written. --import reads
+// a repadmin dump instead of scanning: no directory is opened, and since
+// the dump carries no USN the summary's usn section stays empty.
+inline int RunCollector(const CollectorOptions& options, const CollectorEnvironment& env) {
+    using Clock = std::chrono::steady_clock;
+    auto elapsedMs = [](Clock::time_point since) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - since).count();
+    };
+    if (options.pipeline) return RunPipelinedCollector(options, env);
+    const int64_t startedAt = env.startedAt ? env.startedAt : UnixNowMs();
+
+    AsyncLogger logger;
+    if (!options.logPath.empty()) {
+        LoggerOptions logOptions;
+        logOptions.path = options.logPath;
+        logger.Start(logOptions);
+    }
+
+    const bool imported = !options.importPath.empty();
+    CollectorSources sources;
+    if (!imported && !OpenCollectorSources(options, env, sources)) return static_cast<int>(HealthStatus::Unknown);
+
+    // Rules are checked before the scan: a typo should not cost a forest scan
+    std::unique_ptr<AlertEngine> alerts;
+    if (!options.rulesPath.empty()) {
+        std::vector<AlertRule> rules;
+        std::string error;
+        if (!LoadAlertRuleFile(options.rulesPath, rules, error)) {
+            std::fprintf(stderr, "%s: %s\n", WideToUtf8(options.rulesPath).c_str(), error.c_str());
+            return static_cast<int>(HealthStatus::Unknown);
+        }
+        alerts = std::make_unique<AlertEngine>(std::move(rules));
+    }
+
+    // The history also primes the USN anomaly detector: a single scan adds
+    // one sample per DC to what was recorded before it
+    SnapshotPublisher publisher;
+    auto history = std::make_shared<TimeSeriesStore>();
+    std::shared_ptr<UsnAnomalyMonitor> anomalies;
+    if (!options.historyDir.empty()) {
+        if (history->Open(options.historyDir)) {
+            publisher.Subscribe(std::make_shared<HistoryRecorder>(history));
+            anomalies = std::make_shared<UsnAnomalyMonitor>();
+            anomalies->SetHistory(history);
+            publisher.Subscribe(anomalies);
+        } else {
+            logger.Log(LogLevel::Warning, L"Historique indisponible", {{"path", options.historyDir}});
+        }
+    }
+
+    const int64_t startupMs = UnixNowMs() - startedAt;
+    const auto scanStart = Clock::now();
+    std::wstring configDn;
+    SnapshotPtr snapshot;
+    std::string importSummary, importError;
+    if (imported) {
+        RepadminImportStats stats;
+        if (ImportRepadminFile(options.importPath, RepadminImportOptions(), snapshot, stats, importError)) {
+            importSummary = FormatImportSummary(options.importPath, stats);
+            logger.Log(LogLevel::Info, L"Sortie repadmin importée",
+                       {{"path", options.importPath}, {"format", RepadminFormatName(stats.format)}, {"rows", stats.rows}});
+        } else {
+            std::fprintf(stderr, "%s: %s\n", WideToUtf8(options.importPath).c_str(), importError.c_str());
+        }
+    } else {
+        ScanEngine engine(sources.directory, sources.eventCollector, options.probe, &logger);
+        configDn = engine.ResolveConfigurationDn(env.domainDn);
+        snapshot = engine.Run(publisher, configDn, nullptr, env.cancel);
+    }
+    int64_t localErrors = (options.testReplication && sources.events)
+                              ? CountReplicationEvents(*sources.events, sources.eventOptions) : -1;
+    const int64_t scanMs = elapsedMs(scanStart);
+
+    // Changes since the previous snapshot file, which this scan then replaces.
+    // A partial scan would show every DC it did not reach as changed: kept out.
+    std::string changes;
+    bool snapshotWritten = true;
+    if (!options.snapshotPath.empty() && snapshot && snapshot->cancelled) {
+        logger.Log(LogLevel::Warning, L"Snapshot non remplacé (scan incomplet)", {{"path", options.snapshotPath}});
+    } else if (!options.snapshotPath.empty() && snapshot) {
+        const std::string encoded = EncodeSnapshot(*snapshot);
+        SnapshotView previous, current;
+        std::error_code ec;
+        if (std::filesystem::exists(options.snapshotPath, ec) && current.Attach(encoded.data(), encoded.size())) {
+            if (previous.Open(options.snapshotPath)) {
+                changes = FormatSnapshotDiff(DiffSnapshots(previous, current), previous.Header().completedAt);
+            } else {
+                logger.Log(LogLevel::Warning, L"Snapshot précédent ignoré",
+                           {{"path", options.snapshotPath}, {"error", previous.Error()}});
+            }
+        }
+        previous.Close();
+        snapshotWritten = WriteSnapshotFile(encoded, options.snapshotPath);
+        if (!snapshotWritten) std::fprintf(stderr, "Impossible d'écrire %s\n", WideToUtf8(options.snapshotPath).c_str());
+    }
+
+    HealthReport health = snapshot ? EvaluateHealth(*snapshot) : HealthReport();
+    if (imported) {
+        health.spread = UsnSpread();
+        health.usnLag = LagClass::Unknown;
+    }
+    if (localErrors > 0 && health.status == HealthStatus::Healthy) health.status = HealthStatus::Degraded;
+    std::string alertSummary;
+    if (alerts && snapshot) {
+        alerts->Evaluate(*snapshot, UnixNowMs());
+        for (const ActiveAlert& a : alerts->Active()) {
+            const AlertSeverity severity = alerts->Rules()[a.rule].severity;
+            if (severity == AlertSeverity::Critical) {
+                health.status = HealthStatus::Critical;
+            } else if (severity == AlertSeverity::Warning && health.status == HealthStatus::Healthy) {
+                health.status = HealthStatus::Degraded;
+            }
+        }
+        alertSummary = FormatAlertSummary(*alerts);
+    }
+    std::string anomalySummary;
+    if (anomalies && snapshot) {
+        const std::vector<UsnAnomalyEntry> raised = anomalies->Recent();
+        for (const UsnAnomalyEntry& e : raised) {
+            if (e.anomaly.kind == UsnAnomalyKind::Rollback) {
+                health.status = HealthStatus::Critical;
+            } else if (e.anomaly.kind != UsnAnomalyKind::Restore && health.status == HealthStatus::Healthy) {
+                health.status = HealthStatus::Degraded;
+            }
+            logger.Log(LogLevel::Warning, L"Anomalie USN",
+                       {{"kind", UsnAnomalyKindName(e.anomaly.kind)}, {"dc", e.dc}, {"usn", e.anomaly.usn},
+                        {"previous", e.anomaly.previousUsn}});
+        }
+        anomalySummary = FormatUsnAnomalySummary(raised);
+    }
+    // Canary markers written on the origins, then read back on every DC
+    // holding the container's NC until they arrive or --canary-timeout
+    std::string canarySummary;
+    if (!options.canaryContainer.empty() && snapshot && !snapshot->cancelled) {
+        std::vector<ProbeTarget> targets = CanaryTargets(*snapshot, options.canaryContainer);
+        std::vector<uint32_t> origins;
+        for (const auto& name : options.canaryOrigins) {
+            size_t t = 0;
+            while (t < targets.size() && DnKey(targets[t].dc) != DnKey(name)) t++;
+            if (t < targets.size()) {
+                origins.push_back(static_cast<uint32_t>(t));
+            } else {
+                logger.Log(LogLevel::Warning, L"Origine canari ignorée (DC absent du scan)", {{"dc", name}});
+            }
+        }
+        if (options.canaryOrigins.empty() && !targets.empty()) origins.push_back(0);
+
+        CanaryOptions canaryOptions;
+        canaryOptions.container = options.canaryContainer;
+        canaryOptions.maxInFlight = options.probe.workers;
+        canaryOptions.readTimeout = options.probe.dcTimeout;
+        canaryOptions.probeTimeout = options.canaryTimeout;
+        CanaryProbe probe(sources.directory, canaryOptions);
+        CanaryLatencyTable table;
+        std::vector<CanaryResult> results = probe.Run(targets, origins, [&](const CanaryResult& r) {
+            table.Record(r, targets[r.source].site, targets[r.dest].site);
+            if (r.status != CanaryStatus::Converged) {
+                logger.Log(LogLevel::Warning, L"Marqueur canari non reçu",
+                           {{"source", targets[r.source].dc}, {"dest", targets[r.dest].dc},
+                            {"status", CanaryStatusName(r.status)}});
+            }
+        }, env.cancel);
+        for (const auto& r : results) {
+            if (r.status != CanaryStatus::Converged && r.status != CanaryStatus::Cancelled &&
+                health.status == HealthStatus::Healthy) {
+                health.status = HealthStatus::Degraded;
+            }
+        }
+        canarySummary = FormatCanarySummary(options.canaryContainer, origins.size(), results, targets, table, snapshot->model);
+    }
+    if (snapshot && snapshot->cancelled) health.status = HealthStatus::Unknown;
+    std::string summary = FormatCollectorSummary(health, snapshot.get(), configDn, localErrors, startupMs, scanMs,
+                                                 snapshot ? std::string()
+                                                          : imported ? importError : std::string("Aucun site AD trouvé"),
+                                                 {importSummary,
+                                                  snapshot ? FormatTopologySummary(*snapshot, options) : std::string(),
+                                                  changes, alertSummary, anomalySummary, canarySummary});
+
+    const auto outputStart = Clock::now();
+    bool written = WriteCollectorDocument(options, summary, snapshot.get()) && snapshotWritten;
+    history->Close();
+    if (!options.metricsPath.empty() && snapshot &&
+        !PrometheusExporter::WriteFile(options.metricsPath, PrometheusExporter::Format(*snapshot, health))) {
+        std::fprintf(stderr, "Impossible d'écrire %s\n", WideToUtf8(options.metricsPath).c_str());
+        written = false;
+    }
+
+    if (options.timing) {
+        std::fprintf(stderr, "démarrage %lld ms, scan %lld ms, écriture %lld ms, hors réseau %lld ms\n",
+                     (long long)startupMs, (long long)scanMs, (long long)elapsedMs(outputStart),
+                     (long long)(UnixNowMs() - startedAt - scanMs));
+    }
+    logger.Log(LogLevel::Info, L"Collecte terminée",
+               {{"health", HealthStatusName(health.status)}, {"dcs", health.dcs}, {"ms", scanMs}});
+    logger.Stop();
+    return written ? static_cast<int>(health.status) : static_cast<int>(HealthStatus::Unknown);
+}
+
+// --aggregator: a site collector. Scans the sites of --site when the
+// aggregator asks (and every --interval seconds when given) and sends each
+// scan as one batch; exits when the aggregator says so. Returns 0, or 3
+// when the aggregator stayed unreachable for --wait.
+inline int RunSiteCollector(const CollectorOptions& options, const CollectorEnvironment& env) {
+    SiteCollectorOptions collectorOptions;
+    if (!SocketEndpoint::Parse(WideToUtf8(options.aggregator), collectorOptions.aggregator)) {
+        std::fprintf(stderr, "Adresse d'agrégateur invalide: %s\n", WideToUtf8(options.aggregator).c_str());
+        return static_cast<int>(HealthStatus::Unknown);
+    }
+    AsyncLogger logger;
+    if (!options.logPath.empty()) {
+        LoggerOptions logOptions;
+        logOptions.path = options.logPath;
+        logger.Start(logOptions);
+    }
+    CollectorSources sources;
+    if (!OpenCollectorSources(options, env, sources)) return static_cast<int>(HealthStatus::Unknown);
+
+    ScanEngine engine(sources.directory, sources.eventCollector, options.probe, &logger);
+    engine.SetSiteScope(options.sites);
+    for (const std::wstring& site : options.sites) collectorOptions.hello.sites.push_back(WideToUtf8(site));
+    std::wstring id = options.collectorId;
+    if (id.empty()) {
+        for (size_t i = 0; i < options.sites.size(); i++) id += (i ? L"," : L"") + options.sites[i];
+    }
+    collectorOptions.hello.id = id.empty() ? std::string("forest") : WideToUtf8(id);
+    collectorOptions.interval = options.interval;
+    collectorOptions.retryFor = options.wait;
+
+    SiteCollector collector(collectorOptions, [&](uint64_t requestId) {
+        SnapshotPublisher publisher;
+        SnapshotPtr snapshot = engine.Run(publisher, engine.ResolveConfigurationDn(env.domainDn));
+        if (!snapshot) {
+            logger.Log(LogLevel::Warning, L"Aucun site AD trouvé", {{"request", requestId}});
+            return std::string();
+        }
+        ScanSnapshot scoped = ScopeSnapshot(*snapshot, options.sites);
+        logger.Log(LogLevel::Info, L"Lot envoyé", {{"request", requestId}, {"dcs", scoped.model.Size()}});
+        return EncodeSnapshot(scoped);
+    });
+    const bool done = collector.Run();
+    if (!done) std::fprintf(stderr, "Agrégateur injoignable: %s\n", WideToUtf8(options.aggregator).c_str());
+    logger.Stop();
+    return done ? 0 : static_cast<int>(HealthStatus::Unknown);
+}
+
+// "collectors":{"expected","connected","answered","stale","list":[{"id","sites":[...],"dcs",
+//  "batches","duplicates","lastSequence","ageMs","connected","failed","stale"}]}
+inline std::string FormatCollectorStatuses(const std::vector<CollectorStatus>& statuses, size_t expected, size_t answered) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    auto flag = [](bool b) { return std::string(b ? "true" : "false"); };
+    const int64_t now = UnixNowMs();
+    size_t connected = 0, stale = 0;
+    std::string list;
+    for (const CollectorStatus& c : statuses) {
+        connected += c.connected;
+        stale += c.stale;
+        if (!list.empty()) list += ',';
+        list += "{\"id\":" + ReportExporter::JsonString(c.id) + ",\"sites\":[";
+        for (size_t i = 0; i < c.sites.size(); i++) list += (i ? "," : "") + ReportExporter::JsonString(c.sites[i]);
+        list += "],\"dcs\":" + num(c.dcs) + ",\"batches\":" + num(c.batches) + ",\"duplicates\":" + num(c.duplicates) +
+                ",\"lastSequence\":" + num(c.lastSequence) +
+                ",\"ageMs\":" + num(static_cast<uint64_t>(std::max<int64_t>(0, now - c.lastFrameAt))) +
+                ",\"connected\":" + flag(c.connected) + ",\"failed\":" + flag(c.failed) + ",\"stale\":" + flag(c.stale) + '}';
+    }
+    return "\"collectors\":{\"expected\":" + num(expected) + ",\"connected\":" + num(connected) +
+           ",\"answered\":" + num(answered) + ",\"stale\":" + num(stale) + ",\"list\":[" + list + "]}";
+}
+
+// --listen: the central aggregator, one collection. Waits up to --wait for
+// --expect collectors, asks all of them for a scan at once, merges what
+// came back within --wait into one forest and writes it like a scan, with
+// a "collectors" section; then tells the collectors to exit. A stale or
+// missing collector makes the result degraded at best; a previous batch
+// of a stale one still counts.
+inline int RunAggregator(const CollectorOptions& options) {
+    using Clock = std::chrono::steady_clock;
+    const auto start = Clock::now();
+    AggregatorOptions aggregatorOptions;
+    if (!SocketEndpoint::Parse(WideToUtf8(options.listen), aggregatorOptions.listen)) {
+        std::fprintf(stderr, "Adresse d'écoute invalide: %s\n", WideToUtf8(options.listen).c_str());
+        return static_cast<int>(HealthStatus::Unknown);
+    }
+    CollectorAggregator aggregator;
+    if (!aggregator.Start(aggregatorOptions)) {
+        std::fprintf(stderr, "Impossible d'écouter sur %s\n", WideToUtf8(options.listen).c_str());
+        return static_cast<int>(HealthStatus::Unknown);
+    }
+    const size_t connected = aggregator.WaitForCollectors(std::max(1u, options.expect), options.wait);
+    const auto scanStart = Clock::now();
+    const size_t answered = connected ? aggregator.WaitForBatches(aggregator.RequestScan(), options.wait) : 0;
+    const int64_t scanMs = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - scanStart).count();
+    std::shared_ptr<ScanSnapshot> merged = aggregator.Merge();
+    std::vector<CollectorStatus> statuses = aggregator.Statuses();
+    aggregator.SendBye();
+    aggregator.Stop();
+
+    HealthReport health = merged ? EvaluateHealth(*merged) : HealthReport();
+    bool incomplete = statuses.size() < options.expect;
+    for (const CollectorStatus& c : statuses) incomplete = incomplete || c.stale || c.failed;
+    if (incomplete && health.status == HealthStatus::Healthy) health.status = HealthStatus::Degraded;
+    const int64_t startupMs = std::chrono::duration_cast<std::chrono::milliseconds>(scanStart - start).count();
+    std::string summary = FormatCollectorSummary(health, merged.get(), L"", -1, startupMs, scanMs,
+                                                 merged ? std::string() : std::string("Aucun lot reçu"),
+                                                 {merged ? FormatTopologySummary(*merged, options) : std::string(),
+                                                  FormatCollectorStatuses(statuses, options.expect, answered)});
+    if (options.timing) {
+        std::fprintf(stderr, "%zu collecteurs, %zu réponses, attente %lld ms, scan %lld ms\n", statuses.size(), answered,
+                     (long long)startupMs, (long long)scanMs);
+    }
+    if (!WriteCollectorDocument(options, summary, merged.get())) return static_cast<int>(HealthStatus::Unknown);
+    return static_cast<int>(health.status);
+}
+
+// --analyze: the replication errors of recorded event exports, without a
+// scan. {"files","unreadable","bytes","events","replicationEvents","ms",
+// "eventsPerSecond","replicationErrors":[...]}; critical when a file could
+// not be read.
+inline int RunEventAnalysis(const CollectorOptions& options) {
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point start = Clock::now();
+    EventFileStats stats;
+    ReplicationErrorTable table = AnalyzeEventFiles({options.analyzePath}, options.probe.workers, stats);
+    const double ms = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count() / 1000.0;
+    if (stats.files == 0) {
+        std::fprintf(stderr, "Aucun fichier XML dans %s\n", WideToUtf8(options.analyzePath).c_str());
+        return static_cast<int>(HealthStatus::Unknown);
+    }
+
+    BufferedWriter out(64 * 1024);
+    if (!out.Open(options.output)) {
+        std::fprintf(stderr, "Impossible d'écrire %s\n", WideToUtf8(options.output).c_str());
+        return static_cast<int>(HealthStatus::Unknown);
+    }
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    char elapsed[32], rate[32];
+    std::snprintf(elapsed, sizeof(elapsed), "%.1f", ms);
+    std::snprintf(rate, sizeof(rate), "%.0f", ms > 0 ? stats.events / (ms / 1000) : 0.0);
+    out.Write("{\"files\":" + num(stats.files) + ",\"unreadable\":" + num(stats.unreadable) +
+              ",\"bytes\":" + num(stats.bytes) + ",\"events\":" + num(stats.events) +
+              ",\"replicationEvents\":" + num(stats.replicationEvents) +
+              ",\"ms\":" + elapsed + ",\"eventsPerSecond\":" + rate +
+              ",\"replicationErrors\":" + FormatReplicationErrors(table, 100) + "}\n");
+    if (options.timing) {
+        std::fprintf(stderr, "%zu fichiers, %llu événements, %.1f ms\n", stats.files,
+                     (unsigned long long)stats.events, ms);
+    }
+    if (!out.Close()) return static_cast<int>(HealthStatus::Unknown);
+    return stats.unreadable ? static_cast<int>(HealthStatus::Critical) : 0;
+}
+
+// --sizes in ascending order, or the mode's own sizes without it
+inline std::vector<unsigned> BenchmarkSizes(const CollectorOptions& options, std::vector<unsigned> defaults) {
+    std::vector<unsigned> sizes = options.benchmarkSizes.empty() ? std::move(defaults) : options.benchmarkSizes;
+    std::sort(sizes.begin(), sizes.end());
+    return sizes;
+}
+
+// What the --benchmark modes share: the table header to stderr, then one
+// row(out, size) per size, which writes its NDJSON and table lines and
+// returns false when the size fails the mode's checks. The output is
+// flushed after each size, so a long run can be followed. Critical when a
+// size failed, unknown when the output cannot be written.
+template <typename Header, typename Row>
+inline int RunBenchmarkTable(const CollectorOptions& options, const std::vector<unsigned>& sizes, Header header,
+                             Row row) {
+    BufferedWriter out(64 * 1024);
+    if (!out.Open(options.output)) {
+        std::fprintf(stderr, "Impossible d'écrire %s\n", WideToUtf8(options.output).c_str());
+        return static_cast<int>(HealthStatus::Unknown);
+    }
+    header();
+    bool failed = false;
+    for (unsigned size : sizes) {
+        failed = !row(out, size) || failed;
+        out.Flush();
+    }
+    if (!out.Close()) return static_cast<int>(HealthStatus::Unknown);
+    return failed ? static_cast<int>(HealthStatus::Critical) : 0;
+}
+
+// The event parser over options.eventsDir loaded in memory, or over
+// generated corpora of each size (in events). NDJSON to the output, a table
+// to stderr. Exits critical when a warm pass allocated: adding an event whose
+// triple is known must not.
+inline int RunParseBenchmarks(const CollectorOptions& options) {
+    BufferedWriter out(64 * 1024);
+    if (!out.Open(options.output)) {
+        std::fprintf(stderr, "Impossible d'écrire %s\n", WideToUtf8(options.output).c_str());
+        return static_cast<int>(HealthStatus::Unknown);
+    }
+    std::fprintf(stderr, "%10s %10s %10s %8s %10s %10s %12s %8s %10s\n",
+                 "événements", "réplic", "Mo", "triplets", "scan ms", "agrég ms", "évén/s", "Mo/s", "alloc/évén");
+    auto run = [&](const std::string& name, std::string_view corpus) {
+        ParseBenchmarkResult r = RunParseBenchmark(corpus, 5);
+        r.corpus = name;
+        out.Write(FormatParseBenchmarkJson(r));
+        std::fprintf(stderr, "%10llu %10llu %10.1f %8zu %10.2f %10.2f %12.0f %8.1f %10.4f\n",
+                     (unsigned long long)r.events, (unsigned long long)r.replicationEvents,
+                     r.bytes / (1024.0 * 1024.0), r.triples, r.scanMs, r.aggregateMs, r.eventsPerSecond,
+                     r.megabytesPerSecond, r.allocationsPerEvent);
+        out.Flush();
+        return r.allocations == 0;
+    };
+
+    bool allocationFree = true;
+    if (!options.eventsDir.empty()) {
+        std::string corpus;
+        for (const std::filesystem::path& path : ListEventFiles({options.eventsDir})) {
+            MappedFile file;
+            if (file.Open(path.wstring(), false)) corpus.append(reinterpret_cast<const char*>(file.Data()), file.Size());
+        }
+        if (corpus.empty()) {
+            std::fprintf(stderr, "Aucun événement dans %s\n", WideToUtf8(options.eventsDir).c_str());
+            return static_cast<int>(HealthStatus::Unknown);
+        }
+        allocationFree = run(WideToUtf8(options.eventsDir), corpus);
+    } else {
+        for (unsigned size : BenchmarkSizes(options, {100000, 1000000})) {
+            const std::string corpus = GenerateEventCorpus(size, std::max(2u, size / 1000), options.seed);
+            allocationFree = run("synthetic", corpus) && allocationFree;
+        }
+    }
+    if (!out.Close()) return static_cast<int>(HealthStatus::Unknown);
+    return allocationFree ? 0 : static_cast<int>(HealthStatus::Critical);
+}
+
+// Snapshot files of generated forests: encode, write, map and verify, load
+// and diff against a second scan with known changes. NDJSON to the output,
+// a table to stderr; critical when the diff misses or invents a change.
+inline int RunSnapshotBenchmarks(const CollectorOptions& options) {
+    auto header = [] {
+        std::fprintf(stderr, "%8s %10s %10s %10s %10s %10s %10s %22s %8s\n",
+                     "DCs", "Ko", "encod ms", "écrit ms", "ouvre ms", "charge ms", "écart ms", "+/-/usn/échec/lat",
+                     "erreurs");
+    };
+    auto row = [&](BufferedWriter& out, unsigned size) {
+        SnapshotBenchmarkResult r = RunSnapshotBenchmark(size, options.seed);
+        out.Write(FormatSnapshotBenchmarkJson(r));
+        char found[64];
+        std::snprintf(found, sizeof(found), "%zu/%zu/%zu/%zu/%zu", r.found[0], r.found[1], r.found[2], r.found[3], r.found[4]);
+        std::fprintf(stderr, "%8u %10llu %10.3f %10.3f %10.3f %10.3f %10.3f %22s %8zu\n",
+                     r.dcs, (unsigned long long)(r.bytes / 1024), r.encodeMs, r.writeMs, r.openMs, r.loadMs, r.diffMs,
+                     found, r.mismatches);
+        return r.mismatches == 0;
+    };
+    return RunBenchmarkTable(options, BenchmarkSizes(options, {1000, 10000}), header, row);
+}
+
+// Cancelled scans of slow generated forests (10 DCs per site, round trips
+// ten times --rtt, no pool). NDJSON to the output, a table to stderr.
+// Critical when a partial snapshot is inconsistent, the first row takes a
+// second or more, or the scan returns more than 100 ms after a cancel
+// while probing; cancels during replica metadata also wait for the reads
+// in flight, so they get the slowest read on top.
+inline int RunCancelBenchmarks(const CollectorOptions& options) {
+    auto header = [] {
+        std::fprintf(stderr, "%8s %8s %10s %10s %8s %12s %12s %10s %12s %10s %8s\n",
+                     "DCs", "sites", "scan ms", "1re ligne", "annulés", "sondage ms", "réplic ms", "lecture ms",
+                     "échéance +ms", "partiels", "écarts");
+    };
+    auto row = [&](BufferedWriter& out, unsigned size) {
+        ForestSpec spec;
+        spec.seed = options.seed;
+        spec.dcs = size;
+        spec.sites = std::max(1u, size / 10);
+        spec.localRtt = options.rtt * 10;
+        spec.remoteRtt = options.rtt * 20;
+        spec.pooled = false;
+
+        CancelBenchmarkResult r = RunCancelBenchmark(spec, options.probe);
+        out.Write(FormatCancelBenchmarkJson(r));
+        std::fprintf(stderr, "%8u %8u %10lld %10lld %8zu %12lld %12lld %10lld %12lld %10zu %8zu\n",
+                     r.dcs, r.sites, (long long)r.fullMs, (long long)r.firstRowMs, r.cancels, (long long)r.probeCancelMs,
+                     (long long)r.replicaCancelMs, (long long)r.readBoundMs, (long long)r.deadlineOverrunMs,
+                     r.partialRows, r.mismatches);
+        return r.mismatches == 0 && r.firstRowMs >= 0 && r.firstRowMs < 1000 && r.probeCancelMs <= 100 &&
+               r.replicaCancelMs <= 100 + r.readBoundMs && r.deadlineOverrunMs <= 100 + r.readBoundMs;
+    };
+    return RunBenchmarkTable(options, BenchmarkSizes(options, {1000}), header, row);
+}
+
+// Alert rules: parser cases, compiled code against the tree walk on random
+// columns, a hysteresis scenario, engine alerts on a scanned forest, then
+// 1000 generated rules over synthetic snapshots of --sizes DCs. NDJSON to
+// the output, a table to stderr. Critical when a check fails or the rules
+// evaluate fewer than 1e8 rule-samples per second (1000 rules x 100k DCs).
+inline int RunAlertBenchmarks(const CollectorOptions& options) {
+    auto header = [] {
+        std::fprintf(stderr, "%8s %8s %8s %10s %10s %12s %12s %14s %8s %8s\n",
+                     "règles", "DCs", "analyse", "comparés", "liens", "compil. ms", "évaluat. ms", "règle-DC/s",
+                     "actives", "écarts");
+    };
+    auto row = [&](BufferedWriter& out, unsigned size) {
+        AlertBenchmarkResult r = RunAlertBenchmark(size, 1000, options.seed);
+        out.Write(FormatAlertBenchmarkJson(r));
+        std::fprintf(stderr, "%8u %8zu %4zu/%-3zu %10zu %10zu %12.2f %12.2f %14.3g %8zu %8zu\n",
+                     r.rules, r.samples, r.parseCases - r.parseFailures, r.parseCases, r.checked, r.forestRows,
+                     r.compileMs, r.evaluateMs, r.ruleSamplesPerSecond, r.firing, r.mismatches);
+        return r.parseFailures == 0 && r.mismatches == 0 && r.ruleSamplesPerSecond >= 1e8;
+    };
+    return RunBenchmarkTable(options, BenchmarkSizes(options, {100000}), header, row);
+}
+
+// Synthetic USN traces, one hour at one sample per DC per second, replayed
+// through the anomaly detector. Fails on a missed or unexpected anomaly, a
+// failed digest or monitor check, or a detector slower than ten times real
+// time (a tenth of a core at most at that rate).
+inline int RunUsnBenchmarks(const CollectorOptions& options) {
+    auto header = [] {
+        std::fprintf(stderr, "%8s %12s %8s %8s %8s %8s %8s %10s %12s %14s %8s %8s\n",
+                     "DCs", "échantillons", "injectés", "détectés", "manqués", "imprévus", "écarts", "rang t-d.",
+                     "observ. ms", "échant./s", "ns/éch.", "octets/DC");
+    };
+    auto row = [&](BufferedWriter& out, unsigned size) {
+        UsnBenchmarkResult r = RunUsnBenchmark(size, 3600, options.seed);
+        out.Write(FormatUsnBenchmarkJson(r));
+        std::fprintf(stderr, "%8u %12llu %8zu %8zu %8zu %8zu %8zu %10.5f %12.1f %14.3g %8.1f %8zu\n",
+                     r.dcs, (unsigned long long)r.samples, r.injected, r.detected, r.missed, r.unexpected, r.mismatches,
+                     r.digestRankError, r.observeMs, r.samplesPerSecond, r.nsPerSample, r.bytesPerDc);
+        return r.missed == 0 && r.unexpected == 0 && r.mismatches == 0 && r.samplesPerSecond >= 10.0 * r.dcs;
+    };
+    return RunBenchmarkTable(options, BenchmarkSizes(options, {10000}), header, row);
+}
+
+// Canary probes against the simulated directory (RunCanaryBenchmark).
+// Fails on a pair with the wrong status, bounds that miss the simulated
+// delay, or a site table that lost results.
+inline int RunCanaryBenchmarks(const CollectorOptions& options) {
+    auto header = [] {
+        std::fprintf(stderr, "%8s %6s %7s %8s %8s %8s %8s %8s %8s %10s %10s %10s\n",
+                     "DCs", "sondes", "paires", "reçues", "absentes", "injoign.", "hors b.", "écarts", "lect/p.",
+                     "marge", "délai max", "durée ms");
+    };
+    auto row = [&](BufferedWriter& out, unsigned size) {
+        CanaryBenchmarkResult r = RunCanaryBenchmark(size, options.seed);
+        out.Write(FormatCanaryBenchmarkJson(r));
+        std::fprintf(stderr, "%8u %6u %7zu %8zu %8zu %8zu %8zu %8zu %8.2f %9.0f%% %10lld %10.0f\n",
+                     r.dcs, r.probes, r.pairs, r.converged, r.notConverged, r.unreachable, r.outOfBounds, r.mismatches,
+                     r.readsPerPair, r.boundShare * 100, (long long)r.maxDelayMs, r.wallMs);
+        return r.outOfBounds == 0 && r.mismatches == 0 && r.writeFailed == 0;
+    };
+    return RunBenchmarkTable(options, BenchmarkSizes(options, {100}), header, row);
+}
+
+// Pipelined scans of generated forests against ScanEngine::Run
+// (RunPipelineBenchmark). Fails on a DC lost or delivered twice, records
+// that differ from ScanEngine's, or a pipeline whose memory follows the
+// forest: its growth at the largest size may not exceed twice the
+// smallest size's plus 16 MiB.
+inline int RunPipelineBenchmarks(const CollectorOptions& options) {
+    const std::vector<unsigned> sizes = BenchmarkSizes(options, {5000, 20000, 50000});
+    auto header = [] {
+        std::fprintf(stderr, "%8s %6s %8s %6s %6s %9s %9s %10s %10s %10s %11s %11s %7s\n",
+                     "DCs", "sites", "livrés", "perdus", "écarts", "1er DC ms", "découv ms", "pipeline", "phases",
+                     "base Ko", "pipeline Ko", "phases Ko", "file");
+    };
+    uint64_t smallestKb = 0;
+    auto row = [&](BufferedWriter& out, unsigned size) {
+        PipelineBenchmarkResult r = RunPipelineBenchmark(size, options.probe, options.seed, options.rtt);
+        out.Write(FormatPipelineBenchmarkJson(r));
+        std::fprintf(stderr, "%8u %6u %8zu %6zu %6zu %9lld %9lld %10lld %10lld %10llu %11llu %11llu %7zu\n",
+                     r.dcs, r.sites, r.delivered, r.missing, r.mismatches, (long long)r.firstDcMs,
+                     (long long)r.discoveryMs, (long long)r.pipelineMs, (long long)r.phasedMs,
+                     (unsigned long long)r.baseRssKb, (unsigned long long)r.pipelineKb, (unsigned long long)r.phasedKb,
+                     r.maxQueueDepth);
+        if (size == sizes.front()) smallestKb = r.pipelineKb;
+        if (size == sizes.back() && sizes.size() > 1 && r.pipelineKb > 2 * smallestKb + 16 * 1024) {
+            std::fprintf(stderr, "mémoire du pipeline non bornée: %llu Ko à %u DCs, %llu Ko à %u DCs\n",
+                         (unsigned long long)smallestKb, sizes.front(), (unsigned long long)r.pipelineKb, r.dcs);
+            return false;
+        }
+        return r.missing == 0 && r.mismatches == 0;
+    };
+    return RunBenchmarkTable(options, sizes, header, row);
+}
+
+// Replication graph of generated forests (50 DCs per site, 10 inbound
+// connections per DC): build, bounds, articulation points and incremental
+// updates checked against a rebuild. NDJSON to the output, a table to stderr.
+inline int RunGraphBenchmarks(const CollectorOptions& options) {
+    auto header = [] {
+        std::fprintf(stderr, "%8s %8s %8s %10s %10s %10s %6s %10s %10s %10s %8s\n",
+                     "DCs", "sites", "liens", "build ms", "bornes ms", "artic ms", "AP", "maj moy", "maj max",
+                     "complètes", "écarts");
+    };
+    auto row = [&](BufferedWriter& out, unsigned size) {
+        ForestSpec spec;
+        spec.seed = options.seed;
+        spec.dcs = size;
+        spec.sites = std::max(1u, size / 50);
+        spec.intraSiteConnections = 10;
+
+        GraphBenchmarkResult r = RunGraphBenchmark(spec, options.probe.workers);
+        out.Write(FormatGraphBenchmarkJson(r));
+        std::fprintf(stderr, "%8u %8u %8llu %10lld %10lld %10lld %6llu %10.2f %10.2f %10llu %8llu\n",
+                     r.dcs, r.sites, (unsigned long long)r.edges, (long long)r.buildMs, (long long)r.boundsMs,
+                     (long long)r.articulationMs, (unsigned long long)r.articulationPoints, r.updateAvgMs, r.updateMaxMs,
+                     (unsigned long long)r.fullRecomputes, (unsigned long long)r.mismatches);
+        return r.mismatches == 0;
+    };
+    return RunBenchmarkTable(options, BenchmarkSizes(options, {1000, 5000}), header, row);
+}
+
+// options.hours of adaptive polling per size (10 DCs per site) with the
+// default policy. Runs are deterministic: the digest only changes with the
+// seed, the sizes or the scheduler. Exits critical when a budget was exceeded.
+inline int RunScheduleBenchmarks(const CollectorOptions& options) {
+    auto header = [] {
+        std::fprintf(stderr, "%8s %6s %8s %8s %8s %10s %8s %10s %10s %10s %10s\n",
+                     "DCs", "sites", "sain/h", "retard/h", "échec/h", "sondages", "lots", "site/min", "total/min",
+                     "ns/sond.", "empreinte");
+    };
+    auto row = [&](BufferedWriter& out, unsigned size) {
+        PollPolicy policy;
+        policy.seed = options.seed;
+        ScheduleBenchmarkResult r = RunScheduleBenchmark(size, std::max(1u, size / 10), options.hours, policy);
+        out.Write(FormatScheduleBenchmarkJson(r));
+        std::fprintf(stderr, "%8u %6u %8.2f %8.2f %8.2f %10llu %8llu %6zu/%-3zu %6zu/%-3zu %10.0f %10llx\n",
+                     r.dcs, r.sites, r.pollsPerHour[0], r.pollsPerHour[1], r.pollsPerHour[2],
+                     (unsigned long long)r.dispatched, (unsigned long long)r.batches, r.maxSitePerMinute, r.siteAllowance,
+                     r.maxGlobalPerMinute, r.globalAllowance, r.nsPerDispatch, (unsigned long long)(r.digest & 0xFFFFFFFFFF));
+        return r.maxSitePerMinute <= r.siteAllowance && r.maxGlobalPerMinute <= r.globalAllowance;
+    };
+    return RunBenchmarkTable(options, BenchmarkSizes(options, {1000, 10000}), header, row);
+}
+
+// The repadmin importer: its CSV scanner and small dumps checked against
+// what generated them, then dumps of the given sizes (MB) imported from a
+// temporary file with one worker and with every core. One stderr line per
+// import; any mismatch fails the run.
+inline int RunRepadminBenchmarks(const CollectorOptions& options) {
+    auto header = [] {
+        std::fprintf(stderr, "%6s %8s %10s %10s %7s %10s %7s %9s %9s %9s %9s %8s\n",
+                     "Mo", "passages", "lignes", "remplacées", "écarts", "génér. ms", "cœurs", "découpe", "lecture",
+                     "fusion", "total ms", "Mo/s");
+    };
+    auto row = [&](BufferedWriter& out, unsigned size) {
+        RepadminBenchmarkResult r = RunRepadminBenchmark(size, 5000, options.seed);
+        out.Write(FormatRepadminBenchmarkJson(r));
+        for (const RepadminBenchmarkPass& p : r.passes) {
+            std::fprintf(stderr, "%6u %8u %10llu %10llu %7zu %10.0f %7u %9.1f %9.1f %9.1f %9.1f %8.1f\n",
+                         r.megabytes, r.dumps, (unsigned long long)r.rows, (unsigned long long)r.superseded, r.mismatches,
+                         r.generateMs, p.workers, p.splitMs, p.parseMs, p.mergeMs, p.totalMs, p.megabytesPerSecond);
+        }
+        if (r.passes.empty()) std::fprintf(stderr, "%6u : import impossible (%zu écarts)\n", r.megabytes, r.mismatches);
+        return r.mismatches == 0 && !r.passes.empty();
+    };
+    return RunBenchmarkTable(options, BenchmarkSizes(options, {64, 1024}), header, row);
+}
+
+// Distinguished names: the parser fuzzed and corrupted, then one discovery
+// pass per size (DCs) resolved through lowered text keys and through a
+// DnTable. Fuzz failures or a wrong interned answer fail the run.
+inline int RunDnBenchmarks(const CollectorOptions& options) {
+    auto header = [] {
+        std::fprintf(stderr, "%8s %8s %10s %6s %10s %7s %9s %9s %10s %12s %12s %9s\n",
+                     "DCs", "DNs", "recherches", "fuzz", "corrompus", "écarts", "manqués", "texte ms", "internés ms",
+                     "alloc texte", "alloc intern.", "arène Ko");
+    };
+    auto row = [&](BufferedWriter& out, unsigned size) {
+        DnBenchmarkResult r = RunDnBenchmark(size, options.seed);
+        out.Write(FormatDnBenchmarkJson(r));
+        std::fprintf(stderr, "%8u %8zu %10zu %6zu %4zu/%-5zu %7zu %9zu %9.1f %10.1f %12llu %12llu %9zu\n",
+                     r.dcs, r.dns, r.lookups, r.fuzzCases, r.mutatedParsed, r.mutated, r.mismatches, r.legacyMissed,
+                     r.legacyMs, r.internedMs, (unsigned long long)r.legacyAllocations,
+                     (unsigned long long)r.internedAllocations, r.arenaBytes / 1024);
+        return r.mismatches == 0;
+    };
+    return RunBenchmarkTable(options, BenchmarkSizes(options, {10000, 100000}), header, row);
+}
+
+// ProbeEngine's per-DC timeout, scan deadline and per-site cap against the
+// simulated backend; --sizes sets the DCs of the cap run. Any outcome the
+// options do not allow fails the run.
+inline int RunProbeBenchmarks(const CollectorOptions& options) {
+    auto header = [] {
+        std::fprintf(stderr, "%8s %6s %10s %10s %10s %10s %6s %6s %6s %8s %8s %8s %8s %7s\n",
+                     "DCs", "sites", "délai ms", "bloqué ms", "total ms", "échéance", "ok", "expir.", "annul.",
+                     "max/site", "max", "bloqués", "plafond", "écarts");
+    };
+    auto row = [&](BufferedWriter& out, unsigned size) {
+        ProbeBenchmarkResult r = RunProbeBenchmark(size, options.seed);
+        out.Write(FormatProbeBenchmarkJson(r));
+        std::fprintf(stderr, "%8u %6u %10.0f %10.1f %10.1f %10.1f %6zu %6zu %6zu %8u %8u %8u %8u %7zu\n",
+                     r.dcs, r.sites, r.timeoutMs, r.hungElapsedMs, r.hungWallMs, r.deadlineWallMs, r.deadlineOk,
+                     r.deadlineTimedOut, r.deadlineCancelled, r.maxSiteInFlight, r.maxInFlight, r.hungSiteInFlight,
+                     r.siteLimit, r.mismatches);
+        return r.mismatches == 0;
+    };
+    return RunBenchmarkTable(options, BenchmarkSizes(options, {200}), header, row);
+}
+
+// The checked-in LDIF fixture through the LDIF backend and DiscoverTopology:
+// one line, failing on any count, name or filter result that differs from
+// the fixture. --ldif points at the fixture when not run from the sources.
+inline int RunDiscoveryBenchmarks(const CollectorOptions& options) {
+    const std::wstring path = options.ldifPath.empty() ? L"fixtures/topology.ldif" : options.ldifPath;
+    auto header = [] {
+        std::fprintf(stderr, "%8s %6s %8s %6s %10s %10s %6s %8s %7s %9s %9s\n",
+                     "entrées", "sites", "serveurs", "DCs", "connexions", "désactiv.", "liens", "filtres", "écarts",
+                     "lecture ms", "découv. ms");
+    };
+    auto row = [&](BufferedWriter& out, unsigned) {
+        DiscoveryBenchmarkResult r = RunDiscoveryBenchmark(path);
+        out.Write(FormatDiscoveryBenchmarkJson(r));
+        std::fprintf(stderr, "%8zu %6zu %8zu %6zu %10zu %10zu %6zu %8zu %7zu %9.2f %9.2f\n",
+                     r.entries, r.sites, r.servers, r.dcs, r.connections, r.disabled, r.siteLinks, r.filters,
+                     r.mismatches, r.loadMs, r.discoverMs);
+        if (r.entries == 0) std::fprintf(stderr, "Impossible de lire %s\n", WideToUtf8(path).c_str());
+        return r.mismatches == 0;
+    };
+    return RunBenchmarkTable(options, {0}, header, row);
+}
+
+// The bookmark replay over fixtures/events, or the directory --events names
+// (one subdirectory per stage, see RunEventBookmarkBenchmark)
+inline int RunEventBookmarkBenchmarks(const CollectorOptions& options) {
+    const std::wstring root = options.eventsDir.empty() ? L"fixtures/events" : options.eventsDir;
+    auto header = [] {
+        std::fprintf(stderr, "%11s %10s %11s %7s %10s\n", "collectes", "événements", "reprises", "écarts",
+                     "collecte ms");
+    };
+    auto row = [&](BufferedWriter& out, unsigned) {
+        EventBookmarkBenchmarkResult r = RunEventBookmarkBenchmark(root);
+        out.Write(FormatEventBookmarkBenchmarkJson(r));
+        std::fprintf(stderr, "%11zu %10llu %11zu %7zu %10.2f\n", r.collections, (unsigned long long)r.events,
+                     r.restarts, r.mismatches, r.collectMs);
+        return r.mismatches == 0;
+    };
+    return RunBenchmarkTable(options, {0}, header, row);
+}
+
+// ReplicationModel built and classified per size (10 DCs per site), checked
+// against threshold edges and a reference classification. NDJSON to the
+// output, a table to stderr; Critical on any mismatch.
+inline int RunModelBenchmarks(const CollectorOptions& options) {
+    auto header = [] {
+        std::fprintf(stderr, "%8s %6s %10s %10s %10s %26s %8s\n",
+                     "DCs", "sites", "constr ms", "class. ms", "suivi ms", "inc/sync/mineur/moyen/grave", "erreurs");
+    };
+    auto row = [&](BufferedWriter& out, unsigned size) {
+        ModelBenchmarkResult r = RunModelBenchmark(size, options.seed);
+        out.Write(FormatModelBenchmarkJson(r));
+        char classes[64];
+        std::snprintf(classes, sizeof(classes), "%zu/%zu/%zu/%zu/%zu",
+                      r.classes[0], r.classes[1], r.classes[2], r.classes[3], r.classes[4]);
+        std::fprintf(stderr, "%8u %6zu %10.3f %10.3f %10.3f %26s %8zu\n",
+                     r.dcs, r.sites, r.buildMs, r.classifyMs, r.trackMs, classes, r.mismatches);
+        return r.mismatches == 0;
+    };
+    return RunBenchmarkTable(options, BenchmarkSizes(options, {10000}), header, row);
+}
+
+// SnapshotPublisher under concurrent readers, three runs per reader count
+// (--sizes, default 1, 4 and 16 threads): with the default hazard slots,
+// with a single one, so readers that miss it take the locked path, and
+// with none, so every read does.
+// Critical when a reader sees the generation go back, a snapshot freed
+// under it, or one is never freed.
+inline int RunPublisherBenchmarks(const CollectorOptions& options) {
+    auto header = [] {
+        std::fprintf(stderr, "%8s %12s %12s %12s %12s %8s %9s %8s\n",
+                     "lecteurs", "emplacements", "publications", "lectures", "lect./ms", "recul", "invalides", "fuites");
+    };
+    auto row = [&](BufferedWriter& out, unsigned size) {
+        size_t mismatches = 0;
+        for (size_t slots : {SnapshotPublisher::kHazardSlots, size_t(1), size_t(0)}) {
+            PublisherBenchmarkResult r = RunPublisherBenchmark(size, slots);
+            out.Write(FormatPublisherBenchmarkJson(r));
+            std::fprintf(stderr, "%8u %12zu %12llu %12llu %12.1f %8llu %9llu %8llu\n", r.readers, r.hazardSlots,
+                         (unsigned long long)r.publishes, (unsigned long long)r.reads, r.readsPerMs,
+                         (unsigned long long)r.regressions, (unsigned long long)r.invalid, (unsigned long long)r.leaked);
+            mismatches += r.mismatches;
+        }
+        return mismatches == 0;
+    };
+    return RunBenchmarkTable(options, BenchmarkSizes(options, {1, 4, 16}), header, row);
+}
+
+// Latency matrix of generated forests (--sizes, default 2,000 DCs): rows
+// collected, built, summarized, looked up and copied, every cell checked
+// against the replica state it came from. Critical on any mismatch.
+inline int RunLatencyMatrixBenchmarks(const CollectorOptions& options) {
+    auto header = [] {
+        std::fprintf(stderr, "%8s %5s %10s %10s %10s %10s %10s %10s %10s %8s\n",
+                     "DCs", "NCs", "cellules", "gen ms", "collecte ms", "constr ms", "synth ms", "lookup ns",
+                     "copie µs", "erreurs");
+    };
+    auto row = [&](BufferedWriter& out, unsigned size) {
+        LatencyMatrixBenchmarkResult r = RunLatencyMatrixBenchmark(size, options.seed);
+        out.Write(FormatLatencyMatrixBenchmarkJson(r));
+        std::fprintf(stderr, "%8u %5zu %10zu %10.1f %10.1f %10.3f %10.3f %10.1f %10.1f %8zu\n",
+                     r.dcs, r.ncs, r.cells, r.generateMs, r.collectMs, r.buildMs, r.summarizeMs, r.lookupNs, r.copyUs,
+                     r.mismatches);
+        return r.mismatches == 0;
+    };
+    return RunBenchmarkTable(options, BenchmarkSizes(options, {2000}), header, row);
+}
+
+// A month of 5-minute samples per DC (--sizes, default 1000 DCs) ingested
+// into a TimeSeriesStore, then range-queried and checked against the
+// samples. NDJSON to the output, a table to stderr; Critical on a mismatch.
+inline int RunTimeSeriesBenchmarks(const CollectorOptions& options) {
+    auto header = [] {
+        std::fprintf(stderr, "%8s %10s %10s %9s %10s %12s %10s %10s %10s %8s\n",
+                     "DCs", "points", "Ko", "segments", "ingest ms", "points/s", "ouvre ms", "jour µs", "mois µs",
+                     "erreurs");
+    };
+    auto row = [&](BufferedWriter& out, unsigned size) {
+        TimeSeriesBenchmarkResult r = RunTimeSeriesBenchmark(size, options.seed);
+        out.Write(FormatTimeSeriesBenchmarkJson(r));
+        std::fprintf(stderr, "%8u %10llu %10llu %9zu %10.1f %12.0f %10.3f %10.1f %10.1f %8zu\n",
+                     r.dcs, (unsigned long long)r.records, (unsigned long long)(r.bytes / 1024), r.segments, r.ingestMs,
+                     r.recordsPerSec, r.reopenMs, r.dayQueryUs, r.monthQueryUs, r.mismatches);
+        return r.mismatches == 0;
+    };
+    return RunBenchmarkTable(options, BenchmarkSizes(options, {1000}), header, row);
+}
+
+// AsyncLogger with 1, 4 and 16 producers (--sizes), each count run with the
+// drop policy then the blocking one. Critical when a line is lost under
+// Block, or lines and counters disagree under Drop.
+inline int RunLoggerBenchmarks(const CollectorOptions& options) {
+    auto header = [] {
+        std::fprintf(stderr, "%11s %9s %10s %10s %12s %10s %10s %10s %8s\n",
+                     "producteurs", "politique", "entrées", "écrit ms", "entrées/s", "perdues", "écrites", "arrêt ms",
+                     "erreurs");
+    };
+    auto row = [&](BufferedWriter& out, unsigned size) {
+        size_t mismatches = 0;
+        for (LogOverflow overflow : {LogOverflow::Drop, LogOverflow::Block}) {
+            LoggerBenchmarkResult r = RunLoggerBenchmark(size, overflow);
+            out.Write(FormatLoggerBenchmarkJson(r));
+            std::fprintf(stderr, "%11u %9s %10llu %10.1f %12.0f %10llu %10llu %10.1f %8zu\n", r.producers,
+                         overflow == LogOverflow::Block ? "attente" : "perte", (unsigned long long)r.records, r.logMs,
+                         r.recordsPerSec, (unsigned long long)r.dropped, (unsigned long long)r.written, r.stopMs,
+                         r.mismatches);
+            mismatches += r.mismatches;
+        }
+        return mismatches == 0;
+    };
+    return RunBenchmarkTable(options, BenchmarkSizes(options, {1, 4, 16}), header, row);
+}
+
+// Exports of a generated model (--sizes, default 1,000,000 rows) read back
+// as RFC 4180 CSV and strict JSON. Critical on a malformed document or a
+// field that does not round-trip.
+inline int RunExportBenchmarks(const CollectorOptions& options) {
+    auto header = [] {
+        std::fprintf(stderr, "%9s %10s %10s %10s %10s %10s %9s %10s %9s %8s\n",
+                     "lignes", "CSV Ko", "CSV ms", "JSON ms", "NDJSON ms", "CSV Mo/s", "relu ms", "guillemets",
+                     "JSON Ko", "erreurs");
+    };
+    auto row = [&](BufferedWriter& out, unsigned size) {
+        ExportBenchmarkResult r = RunExportBenchmark(size, options.seed);
+        out.Write(FormatExportBenchmarkJson(r));
+        std::fprintf(stderr, "%9u %10llu %10.1f %10.1f %10.1f %10.1f %9.1f %10zu %9llu %8zu\n", r.rows,
+                     (unsigned long long)(r.csvBytes / 1024), r.csvMs, r.jsonMs, r.ndjsonMs, r.csvMBps, r.readBackMs,
+                     r.quoted, (unsigned long long)(r.jsonBytes / 1024), r.mismatches);
+        return r.mismatches == 0;
+    };
+    return RunBenchmarkTable(options, BenchmarkSizes(options, {1000000}), header, row);
+}
+
+// Histogram math and Prometheus text format; sizes are sample counts
+inline int RunHistogramBenchmarks(const CollectorOptions& options) {
+    auto header = [] {
+        std::fprintf(stderr, "%11s %8s %9s %8s %8s %10s %10s %10s %8s\n",
+                     "échantillons", "seaux", "quantiles", "familles", "lignes", "échappés", "ns/mesure", "format ms",
+                     "erreurs");
+    };
+    auto row = [&](BufferedWriter& out, unsigned size) {
+        HistogramBenchmarkResult r = RunHistogramBenchmark(size, options.seed);
+        out.Write(FormatHistogramBenchmarkJson(r));
+        std::fprintf(stderr, "%11u %8zu %9zu %8zu %8zu %10zu %10.1f %10.3f %8zu\n", r.samples, r.buckets, r.quantiles,
+                     r.families, r.lines, r.escapedLabels, r.recordNs, r.formatMs, r.mismatches);
+        return r.mismatches == 0;
+    };
+    return RunBenchmarkTable(options, BenchmarkSizes(options, {1000000}), header, row);
+}
+
+// Connection pool behaviour and contention; sizes are thread counts
+inline int RunPoolBenchmarks(const CollectorOptions& options) {
+    auto header = [] {
+        std::fprintf(stderr, "%8s %12s %10s %12s %10s %9s %10s %8s\n", "threads", "acquisitions", "liaisons",
+                     "réutilisées", "attentes", "pic/DC", "us/bail", "erreurs");
+    };
+    auto row = [&](BufferedWriter& out, unsigned size) {
+        PoolBenchmarkResult r = RunPoolBenchmark(std::max(1u, size), options.seed);
+        out.Write(FormatPoolBenchmarkJson(r));
+        std::fprintf(stderr, "%8u %12llu %10llu %12llu %10llu %9zu %10.2f %8zu\n", r.threads,
+                     (unsigned long long)r.acquisitions, (unsigned long long)r.binds, (unsigned long long)r.reuses,
+                     (unsigned long long)r.waits, r.peakPerDc, r.acquireUs, r.mismatches);
+        return r.mismatches == 0;
+    };
+    return RunBenchmarkTable(options, BenchmarkSizes(options, {1, 4, 16}), header, row);
+}
+
+// Collector protocol over a local socket; sizes are DCs per batch
+inline int RunLoopbackBenchmarks(const CollectorOptions& options) {
+    auto header = [] {
+        std::fprintf(stderr, "%8s %10s %12s %8s %9s %9s %8s\n",
+                     "DCs", "lot Ko", "aller-ret ms", "lots", "doublons", "coupés", "erreurs");
+    };
+    auto row = [&](BufferedWriter& out, unsigned size) {
+        LoopbackBenchmarkResult r = RunLoopbackBenchmark(std::max(1u, size), options.seed);
+        out.Write(FormatLoopbackBenchmarkJson(r));
+        std::fprintf(stderr, "%8u %10llu %12.2f %8llu %9llu %9zu %8zu\n", r.dcs, (unsigned long long)(r.batchBytes / 1024),
+                     r.roundTripMs, (unsigned long long)r.batches, (unsigned long long)r.duplicates, r.dropped,
+                     r.mismatches);
+        return r.mismatches == 0;
+    };
+    return RunBenchmarkTable(options, BenchmarkSizes(options, {1000, 50000}), header, row);
+}
+
+// ScanEngine's poll context: full scans read concurrently through
+// TopologyGeneration(), polls on the engine's snapshots, and a foreign
+// snapshot that must stop polling until the next scan (RunPollBenchmark).
+// --sizes sets the forest's DCs. Critical on any mismatch.
+inline int RunPollBenchmarks(const CollectorOptions& options) {
+    auto header = [] {
+        std::fprintf(stderr, "%8s %6s %10s %8s %7s %8s %10s %10s %8s\n",
+                     "DCs", "scans", "lectures", "fausses", "relevés", "refusés", "scans ms", "relevés ms", "erreurs");
+    };
+    auto row = [&](BufferedWriter& out, unsigned size) {
+        PollBenchmarkResult r = RunPollBenchmark(std::max(1u, size), options.seed);
+        out.Write(FormatPollBenchmarkJson(r));
+        std::fprintf(stderr, "%8u %6u %10llu %8zu %7zu %8zu %10.1f %10.1f %8zu\n", r.dcs, r.scans,
+                     (unsigned long long)r.reads, r.badReads, r.polls, r.refused, r.scanMs, r.pollMs, r.mismatches);
+        return r.mismatches == 0;
+    };
+    return RunBenchmarkTable(options, BenchmarkSizes(options, {200}), header, row);
+}
+
+// options.scans scans per size against generated forests (10 DCs per
+// site, 100 per domain). Results go to the output as NDJSON, a table to
+// stderr. Sizes run in ascending order since the peak RSS only grows.
+inline int RunBenchmark(const CollectorOptions& options) {
+    if (options.graphBenchmark) return RunGraphBenchmarks(options);
+    if (options.scheduleBenchmark) return RunScheduleBenchmarks(options);
+    if (options.parseBenchmark) return RunParseBenchmarks(options);
+    if (options.snapshotBenchmark) return RunSnapshotBenchmarks(options);
+    if (options.cancelBenchmark) return RunCancelBenchmarks(options);
+    if (options.alertBenchmark) return RunAlertBenchmarks(options);
+    if (options.usnBenchmark) return RunUsnBenchmarks(options);
+    if (options.canaryBenchmark) return RunCanaryBenchmarks(options);
+    if (options.repadminBenchmark) return RunRepadminBenchmarks(options);
+    if (options.dnBenchmark) return RunDnBenchmarks(options);
+    if (options.probeBenchmark) return RunProbeBenchmarks(options);
+    if (options.discoveryBenchmark) return RunDiscoveryBenchmarks(options);
+    if (options.bookmarkBenchmark) return RunEventBookmarkBenchmarks(options);
+    if (options.modelBenchmark) return RunModelBenchmarks(options);
+    if (options.publisherBenchmark) return RunPublisherBenchmarks(options);
+    if (options.matrixBenchmark) return RunLatencyMatrixBenchmarks(options);
+    if (options.seriesBenchmark) return RunTimeSeriesBenchmarks(options);
+    if (options.loggerBenchmark) return RunLoggerBenchmarks(options);
+    if (options.exportBenchmark) return RunExportBenchmarks(options);
+    if (options.histogramBenchmark) return RunHistogramBenchmarks(options);
+    if (options.poolBenchmark) return RunPoolBenchmarks(options);
+    if (options.loopbackBenchmark) return RunLoopbackBenchmarks(options);
+    if (options.pollBenchmark) return RunPollBenchmarks(options);
+    if (options.pipeline) return RunPipelineBenchmarks(options);
+    auto header = [] {
+        std::fprintf(stderr, "%8s %5s %8s %10s %10s %10s %10s %10s %12s %10s %8s\n",
+                     "DCs", "scan", "sites", "gen ms", "scan ms", "1re ligne", "sondage", "réplic", "pic RSS Ko",
+                     "alloc/DC", "liaisons");
+    };
+    auto row = [&](BufferedWriter& out, unsigned size) {
+        ForestSpec spec;
+        spec.seed = options.seed;
+        spec.dcs = size;
+        spec.sites = std::max(1u, size / 10);
+        spec.localRtt = options.rtt;
+        spec.remoteRtt = options.rtt * 5;
+        spec.pooled = options.pool;
+
+        for (const BenchmarkResult& r : RunScanBenchmark(spec, options.probe, options.scans)) {
+            out.Write(FormatBenchmarkJson(r));
+            std::fprintf(stderr, "%8u %5u %8u %10lld %10lld %10lld %10lld %10lld %12llu %10.1f %8llu\n",
+                         r.dcs, r.scan, r.sites, (long long)r.generateMs, (long long)r.wallMs, (long long)r.firstRowMs,
+                         (long long)r.probeMs, (long long)r.replicaMs, (unsigned long long)r.peakRssKb,
+                         r.allocationsPerDc, (unsigned long long)r.binds);
+        }
+        return true;
+    };
+    return RunBenchmarkTable(options, BenchmarkSizes(options, {10, 100, 1000, 10000}), header, row);
+}
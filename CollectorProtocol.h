@@ -0,0 +1,687 @@
+// CollectorProtocol.h
+// Collecteurs de site et agrégateur central : trames numérotées sur TCP ou socket Unix, fusion, dédoublonnage et collecteurs muets
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "ReplicationModel.h"
+#include "ScanEngine.h"
+#include "ScanSnapshot.h"
+#include "SnapshotFile.h"
+#include "SocketStream.h"
+#include "Utf8.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Wire format, little-endian. Every frame is a 16-byte header followed by
+// length payload bytes:
+//   Hello        collector -> aggregator: id, instance, site names
+//   ScanRequest  aggregator -> collectors; sequence is the request id
+//   Batch        collector -> aggregator; sequence numbers the collector's
+//                batches, payload = request id (0: periodic) + snapshot file
+//                (empty when the scan failed)
+//   Ack          aggregator -> collector; sequence of the batch received
+//   Heartbeat    collector -> aggregator, while connected
+//   Bye          aggregator -> collectors: collection over, exit
+enum class FrameType : uint8_t {
+    Hello = 1,
+    ScanRequest,
+    Batch,
+    Ack,
+    Heartbeat,
+    Bye
+};
+
+struct FrameHeader {
+    uint32_t length;                    // payload bytes
+    uint8_t type;                       // FrameType
+    uint8_t version;
+    uint16_t reserved;
+    uint64_t sequence;
+};
+
+static_assert(sizeof(FrameHeader) == 16, "FrameHeader must stay 16 bytes");
+
+const uint8_t kProtocolVersion = 1;
+const uint32_t kMaxFramePayload = 64u << 20;
+
+struct Frame {
+    FrameType type = FrameType::Heartbeat;
+    uint64_t sequence = 0;
+    std::string payload;
+};
+
+// Header and payload in one write. Threads sharing a socket still have to
+// serialize their calls.
+inline bool SendFrame(SocketStream& socket, FrameType type, uint64_t sequence, std::string_view payload = {}) {
+    FrameHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.length = static_cast<uint32_t>(payload.size());
+    header.type = static_cast<uint8_t>(type);
+    header.version = kProtocolVersion;
+    header.sequence = sequence;
+    std::string buffer;
+    buffer.reserve(sizeof(header) + payload.size());
+    buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    buffer.append(payload.data(), payload.size());
+    return socket.SendAll(buffer.data(), buffer.size());
+}
+
+// The next frame of a readable socket. False when the peer closed, a frame
+// stalled for longer than timeout, or the header is not one of ours.
+inline bool ReceiveFrame(SocketStream& socket, Frame& frame, std::chrono::milliseconds timeout) {
+    FrameHeader header;
+    if (!socket.ReceiveAll(&header, sizeof(header), timeout)) return false;
+    if (header.version != kProtocolVersion || header.length > kMaxFramePayload ||
+        header.type < static_cast<uint8_t>(FrameType::Hello) || header.type > static_cast<uint8_t>(FrameType::Bye)) {
+        return false;
+    }
+    frame.type = static_cast<FrameType>(header.type);
+    frame.sequence = header.sequence;
+    frame.payload.resize(header.length);
+    return header.length == 0 || socket.ReceiveAll(&frame.payload[0], header.length, timeout);
+}
+
+class PayloadWriter {
+public:
+    void U64(uint64_t v) { m_data.append(reinterpret_cast<const char*>(&v), 8); }
+    void U32(uint32_t v) { m_data.append(reinterpret_cast<const char*>(&v), 4); }
+    void String(std::string_view s) {
+        U32(static_cast<uint32_t>(s.size()));
+        m_data.append(s.data(), s.size());
+    }
+    void Bytes(std::string_view s) { m_data.append(s.data(), s.size()); }
+    std::string& Data() { return m_data; }
+
+private:
+    std::string m_data;
+};
+
+// Every read fails once the payload is exhausted
+class PayloadReader {
+public:
+    explicit PayloadReader(std::string_view data) : m_data(data) {}
+
+    bool U64(uint64_t& v) { return Fixed(&v, 8); }
+    bool U32(uint32_t& v) { return Fixed(&v, 4); }
+    bool String(std::string_view& s) {
+        uint32_t length = 0;
+        if (!U32(length) || length > m_data.size() - m_pos) return false;
+        s = m_data.substr(m_pos, length);
+        m_pos += length;
+        return true;
+    }
+    std::string_view Rest() const { return m_data.substr(m_pos); }
+
+private:
+    bool Fixed(void* out, size_t size) {
+        if (m_data.size() - m_pos < size) return false;
+        std::memcpy(out, m_data.data() + m_pos, size);
+        m_pos += size;
+        return true;
+    }
+
+    std::string_view m_data;
+    size_t m_pos = 0;
+};
+
+struct CollectorHello {
+    std::string id;                     // stable across restarts: the host name, typically
+    uint64_t instance = 0;              // new at every start, so the aggregator knows sequences restarted
+    std::vector<std::string> sites;
+};
+
+inline std::string EncodeHello(const CollectorHello& hello) {
+    PayloadWriter w;
+    w.String(hello.id);
+    w.U64(hello.instance);
+    w.U32(static_cast<uint32_t>(hello.sites.size()));
+    for (const std::string& site : hello.sites) w.String(site);
+    return std::move(w.Data());
+}
+
+inline bool DecodeHello(std::string_view payload, CollectorHello& hello) {
+    PayloadReader r(payload);
+    std::string_view id;
+    uint32_t count = 0;
+    if (!r.String(id) || id.empty() || !r.U64(hello.instance) || !r.U32(count)) return false;
+    hello.id.assign(id.data(), id.size());
+    hello.sites.clear();
+    for (uint32_t i = 0; i < count; i++) {
+        std::string_view site;
+        if (!r.String(site)) return false;
+        hello.sites.emplace_back(site);
+    }
+    return true;
+}
+
+// The part of a scan a site collector reports: the DCs of its sites, the
+// links they replicate in from, and the sources of those links as stub
+// rows (name and site only, never probed) so the aggregator can join links
+// across sites.
+inline ScanSnapshot ScopeSnapshot(const ScanSnapshot& snapshot, const std::vector<std::wstring>& sites) {
+    const ReplicationModel& model = snapshot.model;
+    std::vector<bool> inScope(model.Size()), keep(model.Size());
+    for (DcId id = 0; id < model.Size(); id++) {
+        inScope[id] = keep[id] = SiteInScope(sites, model.sites.Name(model.records[id].site));
+    }
+    for (const ReplicationLink& link : snapshot.links) {
+        if (link.dest < model.Size() && link.source < model.Size() && inScope[link.dest]) keep[link.source] = true;
+    }
+
+    ScanSnapshot scoped;
+    scoped.generation = snapshot.generation;
+    scoped.startedAt = snapshot.startedAt;
+    scoped.completedAt = snapshot.completedAt;
+    scoped.siteCount = snapshot.siteCount;
+    scoped.replicationErrors = snapshot.replicationErrors;
+    ReplicationModel& out = scoped.model;
+    out.SetEventIds(model.eventIds);
+    std::vector<DcId> newId(model.Size(), kInvalidId);
+    for (DcId id = 0; id < model.Size(); id++) {
+        if (!keep[id]) continue;
+        const DcId n = out.AddDc(model.sites.Name(model.records[id].site), model.DcName(id));
+        newId[id] = n;
+        if (!inScope[id]) continue;
+        const uint32_t site = out.records[n].site;
+        out.records[n] = model.records[id];
+        out.records[n].site = site;
+        std::copy(model.EventCountsOf(id), model.EventCountsOf(id) + model.eventIds.size(), out.EventCountsOf(n));
+    }
+    for (const ReplicationLink& link : snapshot.links) {
+        if (link.dest >= model.Size() || link.source >= model.Size() || !inScope[link.dest]) continue;
+        scoped.links.push_back({newId[link.source], newId[link.dest], link.scheduleSec});
+    }
+    scoped.latency.Resize(out.Size());
+    scoped.spread = ComputeUsnSpread(out);
+    return scoped;
+}
+
+// Rows a collector actually scanned, as opposed to stubs
+inline bool SnapshotRowProbed(const SnapshotDcEntry& e) {
+    return e.probedAt != 0 || e.status != static_cast<uint8_t>(ProbeStatus::Cancelled);
+}
+
+// One forest from the latest batch of each collector. A DC reported by
+// several collectors (overlapping scopes, stubs) keeps the row of one that
+// probed it: an answering one first, then the most recent. Links are
+// joined by DC name and deduplicated. Lag classes are recomputed, the USN
+// spread being forest-wide.
+inline std::shared_ptr<ScanSnapshot> MergeSnapshots(const std::vector<const SnapshotView*>& parts) {
+    auto merged = std::make_shared<ScanSnapshot>();
+    ReplicationModel& model = merged->model;
+
+    std::vector<uint32_t> ids;
+    for (const SnapshotView* part : parts) {
+        for (size_t k = 0; k < part->EventIdCount(); k++) {
+            if (std::find(ids.begin(), ids.end(), part->EventIds()[k]) == ids.end()) ids.push_back(part->EventIds()[k]);
+        }
+    }
+    model.SetEventIds(ids);
+
+    struct Source {
+        const SnapshotView* part = nullptr;
+        size_t index = 0;
+    };
+    auto better = [](const SnapshotDcEntry& a, const SnapshotDcEntry& b) {
+        const bool pa = SnapshotRowProbed(a), pb = SnapshotRowProbed(b);
+        if (pa != pb) return pa;
+        const uint8_t ok = static_cast<uint8_t>(ProbeStatus::Ok);
+        if ((a.status == ok) != (b.status == ok)) return a.status == ok;
+        return a.probedAt > b.probedAt;
+    };
+    std::vector<std::vector<DcId>> idOf(parts.size());
+    std::vector<Source> best;
+    for (size_t p = 0; p < parts.size(); p++) {
+        const SnapshotView& part = *parts[p];
+        const SnapshotFileHeader& header = part.Header();
+        merged->generation = std::max(merged->generation, header.generation);
+        merged->siteCount = std::max<size_t>(merged->siteCount, header.siteTotal);
+        if (header.startedAt && (!merged->startedAt || header.startedAt < merged->startedAt)) {
+            merged->startedAt = header.startedAt;
+        }
+        merged->completedAt = std::max(merged->completedAt, header.completedAt);
+
+        idOf[p].resize(part.DcCount());
+        for (size_t i = 0; i < part.DcCount(); i++) {
+            const std::string_view site = part.SiteName(part.Dc(i).site), name = part.DcName(i);
+            const DcId id = model.AddDc(Utf8ToWide(site.data(), site.size()), Utf8ToWide(name.data(), name.size()));
+            idOf[p][i] = id;
+            if (id >= best.size()) best.resize(id + 1);
+            if (!best[id].part || better(part.Dc(i), best[id].part->Dc(best[id].index))) best[id] = {&part, i};
+        }
+    }
+
+    for (DcId id = 0; id < model.Size(); id++) {
+        const SnapshotView& part = *best[id].part;
+        const SnapshotDcEntry& e = part.Dc(best[id].index);
+        DcRecord& r = model.records[id];
+        r.usn = e.usn;
+        r.probedAt = e.probedAt;
+        r.lastReplication = e.lastReplication;
+        r.probeMs = e.probeMs;
+        r.errorTotal = e.errorTotal;
+        r.latencySec = e.latencySec;
+        r.partners = e.partners;
+        r.failingPartners = e.failingPartners;
+        r.status = static_cast<ProbeStatus>(e.status);
+        r.events = static_cast<EventState>(e.events);
+        const uint32_t* counts = part.EventCountsOf(best[id].index);
+        uint32_t* out = model.EventCountsOf(id);
+        for (size_t k = 0; k < part.EventIdCount(); k++) {
+            out[std::find(ids.begin(), ids.end(), part.EventIds()[k]) - ids.begin()] = counts[k];
+        }
+    }
+
+    for (size_t p = 0; p < parts.size(); p++) {
+        const ReplicationLink* links = parts[p]->Links();
+        for (size_t l = 0; l < parts[p]->LinkCount(); l++) {
+            if (links[l].source >= idOf[p].size() || links[l].dest >= idOf[p].size()) continue;
+            merged->links.push_back({idOf[p][links[l].source], idOf[p][links[l].dest], links[l].scheduleSec});
+        }
+    }
+    auto key = [](const ReplicationLink& l) { return (static_cast<uint64_t>(l.dest) << 32) | l.source; };
+    std::sort(merged->links.begin(), merged->links.end(),
+              [&](const ReplicationLink& a, const ReplicationLink& b) { return key(a) < key(b); });
+    merged->links.erase(std::unique(merged->links.begin(), merged->links.end(),
+                                    [&](const ReplicationLink& a, const ReplicationLink& b) { return key(a) == key(b); }),
+                        merged->links.end());
+
+    merged->latency.Resize(model.Size());
+    merged->spread = ClassifyLag(model);
+    return merged;
+}
+
+struct SiteCollectorOptions {
+    SocketEndpoint aggregator;
+    CollectorHello hello;
+    std::chrono::milliseconds interval{0};          // unsolicited batches this often; 0: only on request
+    std::chrono::milliseconds heartbeat{5000};
+    std::chrono::milliseconds connectTimeout{5000};
+    std::chrono::milliseconds retryFor{10 * 60 * 1000};     // gives up after this long without a connection
+};
+
+// Client side of a site collector. Connects (exponential backoff), says
+// hello and answers each ScanRequest with one Batch: the whole site in a
+// single frame, so a scan costs one round trip over the WAN however many
+// DCs the site has. A batch stays pending until acknowledged and is sent
+// again after a reconnect; the aggregator drops copies it already has.
+// Heartbeats go out from a second thread, a long scan does not make the
+// collector look dead.
+class SiteCollector {
+public:
+    // Encoded snapshot of the request (0: periodic); empty when the scan failed
+    using ScanFunction = std::function<std::string(uint64_t requestId)>;
+
+    SiteCollector(SiteCollectorOptions options, ScanFunction scan)
+        : m_options(std::move(options)), m_scan(std::move(scan)) {
+        if (m_options.hello.instance == 0) {
+            std::random_device random;
+            m_options.hello.instance = (static_cast<uint64_t>(random()) << 32) ^ random() ^
+                                       static_cast<uint64_t>(UnixNowMs());
+        }
+    }
+
+    // True once the aggregator said Bye, false when it stayed unreachable
+    // for retryFor
+    bool Run() {
+        using Clock = std::chrono::steady_clock;
+        std::chrono::milliseconds backoff(250);
+        Clock::time_point lostAt = Clock::now();
+        for (;;) {
+            if (!m_socket.Connect(m_options.aggregator, m_options.connectTimeout)) {
+                if (Clock::now() - lostAt >= m_options.retryFor) return false;
+                std::this_thread::sleep_for(backoff);
+                backoff = std::min<std::chrono::milliseconds>(backoff * 2, std::chrono::seconds(30));
+                continue;
+            }
+            backoff = std::chrono::milliseconds(250);
+            const bool bye = Serve();
+            m_socket.Close();
+            if (bye) return true;
+            lostAt = Clock::now();
+        }
+    }
+
+    uint64_t BatchesSent() const { return m_sequence; }
+
+private:
+    bool Send(FrameType type, uint64_t sequence, std::string_view payload = {}) {
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+        return SendFrame(m_socket, type, sequence, payload);
+    }
+
+    bool ScanAndSend(uint64_t requestId) {
+        PayloadWriter w;
+        w.U64(requestId);
+        w.Bytes(m_scan(requestId));
+        m_pending = std::move(w.Data());
+        m_pendingSequence = ++m_sequence;
+        return Send(FrameType::Batch, m_pendingSequence, m_pending);
+    }
+
+    // One connection; true when it ended with Bye
+    bool Serve() {
+        using Clock = std::chrono::steady_clock;
+        if (!Send(FrameType::Hello, 0, EncodeHello(m_options.hello))) return false;
+        if (!m_pending.empty() && !Send(FrameType::Batch, m_pendingSequence, m_pending)) return false;
+
+        bool stop = false;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::thread heartbeat([&] {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!wake.wait_for(lock, m_options.heartbeat, [&] { return stop; })) {
+                if (!Send(FrameType::Heartbeat, 0)) {
+                    m_socket.Shutdown();        // wakes the reader below
+                    return;
+                }
+            }
+        });
+
+        bool bye = false;
+        Clock::time_point nextScan = Clock::now();
+        for (;;) {
+            if (m_options.interval.count() > 0 && Clock::now() >= nextScan) {
+                if (!ScanAndSend(0)) break;
+                nextScan = Clock::now() + m_options.interval;
+            }
+            if (!m_socket.Readable(std::chrono::milliseconds(250))) continue;
+            Frame frame;
+            if (!ReceiveFrame(m_socket, frame, std::chrono::seconds(30))) break;
+            if (frame.type == FrameType::ScanRequest) {
+                if (!ScanAndSend(frame.sequence)) break;
+            } else if (frame.type == FrameType::Ack) {
+                if (frame.sequence >= m_pendingSequence) m_pending.clear();
+            } else if (frame.type == FrameType::Bye) {
+                bye = true;
+                break;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake.notify_all();
+        heartbeat.join();
+        return bye;
+    }
+
+    SiteCollectorOptions m_options;
+    ScanFunction m_scan;
+    SocketStream m_socket;
+    std::mutex m_sendMutex;
+    uint64_t m_sequence = 0;
+    std::string m_pending;              // last batch until acknowledged
+    uint64_t m_pendingSequence = 0;
+};
+
+struct AggregatorOptions {
+    SocketEndpoint listen;
+    std::chrono::milliseconds staleAfter{30000};    // no frame for this long: stale
+};
+
+// What the aggregator knows of one collector
+struct CollectorStatus {
+    std::string id;
+    std::vector<std::string> sites;
+    uint64_t instance = 0;
+    uint64_t lastSequence = 0;          // last batch kept
+    uint64_t requestId = 0;             // request the last batch answered, 0 for a periodic one
+    uint64_t batches = 0;
+    uint64_t duplicates = 0;            // batches sent again after a reconnect, dropped
+    int64_t lastFrameAt = 0;            // Unix epoch, milliseconds
+    int64_t batchAt = 0;
+    size_t dcs = 0;                     // probed DCs of the last batch
+    bool connected = false;
+    bool failed = false;                // the last batch carried no scan
+    bool stale = false;                 // gone, silent for staleAfter, or no answer to the last request
+};
+
+// The central side: one accept thread and one reader thread per
+// connection. Collectors are known by id, so one that reconnects (or
+// restarts) takes its entry back; each keeps only its latest batch, and
+// batches numbered at or below the last one kept are acknowledged and
+// dropped. Merge() joins the latest batches into one forest.
+class CollectorAggregator {
+public:
+    CollectorAggregator() = default;
+    CollectorAggregator(const CollectorAggregator&) = delete;
+    CollectorAggregator& operator=(const CollectorAggregator&) = delete;
+    ~CollectorAggregator() { Stop(); }
+
+    bool Start(const AggregatorOptions& options) {
+        m_options = options;
+        if (!m_listener.Listen(options.listen)) return false;
+        m_stopping = false;
+        m_acceptor = std::thread([this] { AcceptLoop(); });
+        return true;
+    }
+
+    void Stop() {
+        m_stopping = true;
+        if (m_acceptor.joinable()) m_acceptor.join();
+        std::vector<std::shared_ptr<Connection>> connections;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            connections.swap(m_connections);
+        }
+        for (auto& c : connections) {
+            if (c->reader.joinable()) c->reader.join();
+        }
+        m_listener.Close();
+    }
+
+    // Until count collectors are connected and said hello; how many are
+    size_t WaitForCollectors(size_t count, std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait_for(lock, timeout, [&] { return Connected() >= count; });
+        return Connected();
+    }
+
+    // Asks every connected collector for a scan; the request id
+    uint64_t RequestScan() {
+        std::vector<std::shared_ptr<Connection>> targets;
+        uint64_t requestId;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            requestId = ++m_requestId;
+            for (auto& entry : m_peers) {
+                if (entry.second.status.connected) targets.push_back(entry.second.connection);
+            }
+        }
+        for (auto& c : targets) Send(*c, FrameType::ScanRequest, requestId);
+        return requestId;
+    }
+
+    // Until every connected collector answered requestId (or left); how
+    // many answered
+    size_t WaitForBatches(uint64_t requestId, std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto answered = [&] {
+            size_t n = 0;
+            for (auto& entry : m_peers) n += entry.second.status.requestId >= requestId;
+            return n;
+        };
+        m_changed.wait_for(lock, timeout, [&] {
+            for (auto& entry : m_peers) {
+                if (entry.second.status.connected && entry.second.status.requestId < requestId) return false;
+            }
+            return true;
+        });
+        return answered();
+    }
+
+    void SendBye() {
+        std::vector<std::shared_ptr<Connection>> targets;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto& entry : m_peers) {
+                if (entry.second.status.connected) targets.push_back(entry.second.connection);
+            }
+        }
+        for (auto& c : targets) Send(*c, FrameType::Bye, 0);
+    }
+
+    // By id
+    std::vector<CollectorStatus> Statuses() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const int64_t now = UnixNowMs();
+        std::vector<CollectorStatus> statuses;
+        for (auto& entry : m_peers) {
+            CollectorStatus s = entry.second.status;
+            s.stale = !s.connected || now - s.lastFrameAt > m_options.staleAfter.count() ||
+                      (m_requestId != 0 && s.requestId < m_requestId);
+            statuses.push_back(s);
+        }
+        return statuses;
+    }
+
+    // The latest batch of every collector, merged; null before any batch
+    std::shared_ptr<ScanSnapshot> Merge() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<std::unique_ptr<SnapshotView>> views;
+        std::vector<const SnapshotView*> parts;
+        for (auto& entry : m_peers) {
+            if (entry.second.batch.empty()) continue;
+            views.emplace_back(new SnapshotView());
+            if (views.back()->Attach(entry.second.batch.data(), entry.second.batch.size())) parts.push_back(views.back().get());
+        }
+        return parts.empty() ? nullptr : MergeSnapshots(parts);
+    }
+
+private:
+    struct Connection {
+        SocketStream socket;
+        std::mutex send;
+        std::thread reader;
+        std::string id;                 // set by Hello
+    };
+
+    struct Peer {
+        CollectorStatus status;
+        std::string batch;              // snapshot file of the last batch kept
+        std::shared_ptr<Connection> connection;
+    };
+
+    size_t Connected() const {
+        size_t n = 0;
+        for (auto& entry : m_peers) n += entry.second.status.connected;
+        return n;
+    }
+
+    static bool Send(Connection& c, FrameType type, uint64_t sequence) {
+        std::lock_guard<std::mutex> lock(c.send);
+        return SendFrame(c.socket, type, sequence);
+    }
+
+    void AcceptLoop() {
+        while (!m_stopping) {
+            SocketStream socket = m_listener.Accept(std::chrono::milliseconds(200));
+            if (!socket.Valid()) continue;
+            auto c = std::make_shared<Connection>();
+            c->socket = std::move(socket);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_connections.push_back(c);
+            c->reader = std::thread([this, c] { ReadLoop(c); });
+        }
+    }
+
+    void ReadLoop(const std::shared_ptr<Connection>& c) {
+        while (!m_stopping) {
+            if (!c->socket.Readable(std::chrono::milliseconds(200))) continue;
+            Frame frame;
+            if (!ReceiveFrame(c->socket, frame, std::chrono::seconds(30)) || !Handle(c, frame)) break;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_peers.find(c->id);
+        if (it != m_peers.end() && it->second.connection == c) {
+            it->second.status.connected = false;
+            it->second.connection.reset();
+        }
+        c->socket.Close();
+        m_changed.notify_all();
+    }
+
+    // False drops the connection: frames before Hello, malformed payloads
+    bool Handle(const std::shared_ptr<Connection>& c, Frame& frame) {
+        if (frame.type == FrameType::Hello) {
+            CollectorHello hello;
+            if (!DecodeHello(frame.payload, hello)) return false;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Peer& peer = m_peers[hello.id];
+            if (peer.status.instance != hello.instance) {
+                peer.status.instance = hello.instance;
+                peer.status.lastSequence = 0;
+            }
+            peer.status.id = hello.id;
+            peer.status.sites = hello.sites;
+            peer.status.connected = true;
+            peer.status.lastFrameAt = UnixNowMs();
+            peer.connection = c;
+            c->id = hello.id;
+            m_changed.notify_all();
+            return true;
+        }
+        if (c->id.empty()) return false;
+        if (frame.type == FrameType::Batch) {
+            PayloadReader r(frame.payload);
+            uint64_t requestId = 0;
+            if (!r.U64(requestId)) return false;
+            const std::string_view file = r.Rest();
+            size_t probed = 0;
+            if (!file.empty()) {
+                SnapshotView view;
+                if (!view.Attach(file.data(), file.size())) return false;
+                for (size_t i = 0; i < view.DcCount(); i++) probed += SnapshotRowProbed(view.Dc(i));
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                Peer& peer = m_peers[c->id];
+                peer.status.lastFrameAt = UnixNowMs();
+                if (frame.sequence <= peer.status.lastSequence) {
+                    peer.status.duplicates++;
+                } else {
+                    peer.status.lastSequence = frame.sequence;
+                    peer.status.requestId = std::max(peer.status.requestId, requestId);
+                    peer.status.batches++;
+                    peer.status.batchAt = peer.status.lastFrameAt;
+                    peer.status.failed = file.empty();
+                    if (!file.empty()) {
+                        peer.batch.assign(file.data(), file.size());
+                        peer.status.dcs = probed;
+                    }
+                }
+                m_changed.notify_all();
+            }
+            return Send(*c, FrameType::Ack, frame.sequence);
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_peers[c->id].status.lastFrameAt = UnixNowMs();
+        return true;
+    }
+
+    AggregatorOptions m_options;
+    SocketStream m_listener;
+    std::thread m_acceptor;
+    std::atomic<bool> m_stopping{false};
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::map<std::string, Peer> m_peers;
+    std::vector<std::shared_ptr<Connection>> m_connections;
+    uint64_t m_requestId = 0;
+};
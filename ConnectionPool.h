@@ -0,0 +1,317 @@
+// ConnectionPool.h
+// Pool de sessions d'annuaire liées par DC (réutilisation entre lectures et scans, expiration, contrôle, éviction)
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A bound session to one DC. What it holds (LDAP object, DRS handle, fake
+// socket) is the transport's business; the pool only owns its lifetime.
+class IDirectorySession {
+public:
+    virtual ~IDirectorySession() = default;
+};
+
+// Protocol behind the pool. Bind and Check are called without the pool
+// lock and must be callable concurrently for different sessions.
+class IDirectoryTransport {
+public:
+    virtual ~IDirectoryTransport() = default;
+
+    // Binds to dc; null with error set when the DC cannot be bound
+    virtual std::unique_ptr<IDirectorySession> Bind(const std::wstring& dc, std::chrono::milliseconds timeout,
+                                                    int32_t& error) = 0;
+
+    // Cheap round trip on a session that sat idle, before it is reused
+    virtual bool Check(IDirectorySession& session) {
+        (void)session;
+        return true;
+    }
+
+    // Errors meaning the connection itself is gone: the session is dropped
+    // together with every idle session to the same DC
+    virtual bool IsConnectionError(int32_t error) const {
+        (void)error;
+        return true;
+    }
+};
+
+struct ConnectionPoolOptions {
+    unsigned maxPerDc = 2;                          // bound sessions per DC, idle and leased
+    std::chrono::seconds idleTimeout{300};          // idle sessions older than this are closed
+    std::chrono::seconds checkAfter{60};            // idle sessions older than this are checked first
+};
+
+struct ConnectionPoolStats {
+    uint64_t binds = 0;
+    uint64_t bindFailures = 0;
+    uint64_t reuses = 0;
+    uint64_t checksFailed = 0;
+    uint64_t expired = 0;
+    uint64_t evicted = 0;
+    uint64_t waits = 0;                             // acquisitions that waited for a free slot
+    size_t idle = 0;
+    size_t leased = 0;
+};
+
+// Bound sessions keyed by DC name, reused across reads and scans. At most
+// maxPerDc sessions exist per DC; an acquisition beyond the cap waits for a
+// lease to come back, up to the caller's timeout. Idle sessions expire
+// lazily (on acquisition and on Trim), sessions idle for a while are checked
+// before reuse, and a connection error evicts the DC's idle sessions at once
+// so the next read rebinds instead of failing on another dead connection.
+// Sessions are closed outside the lock.
+class ConnectionPool {
+public:
+    class Lease;
+
+    ConnectionPool(std::shared_ptr<IDirectoryTransport> transport, ConnectionPoolOptions options = ConnectionPoolOptions())
+        : m_transport(std::move(transport)), m_options(options) {
+        if (m_options.maxPerDc == 0) m_options.maxPerDc = 1;
+    }
+
+    ~ConnectionPool() { Clear(); }
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    // An idle session to dc, a new bind when none is usable, or an empty
+    // lease with error set when the bind failed (transport error) or no slot
+    // freed up in time (-1). Leases must not outlive the pool.
+    Lease Acquire(const std::wstring& dc, std::chrono::milliseconds timeout, int32_t& error);
+
+    // Closes idle sessions past the idle timeout
+    void Trim() {
+        std::vector<std::unique_ptr<IDirectorySession>> closing;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            const Clock::time_point now = Clock::now();
+            for (auto& kv : m_dcs) Expire(kv.second, now, closing);
+            m_lastTrim = now;
+        }
+    }
+
+    // Closes every idle session to dc; leased ones are dropped on return
+    void Evict(const std::wstring& dc) {
+        std::vector<std::unique_ptr<IDirectorySession>> closing;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_dcs.find(dc);
+        if (it != m_dcs.end()) EvictLocked(it->second, closing);
+    }
+
+    // Closes every idle session and marks leased ones for closing on return.
+    // The Windows transports call this before COM is uninitialised.
+    void Clear() {
+        std::vector<std::unique_ptr<IDirectorySession>> closing;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& kv : m_dcs) EvictLocked(kv.second, closing);
+    }
+
+    ConnectionPoolStats Stats() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ConnectionPoolStats s = m_stats;
+        for (const auto& kv : m_dcs) {
+            s.idle += kv.second.idle.size();
+            s.leased += kv.second.leased;
+        }
+        return s;
+    }
+
+    const ConnectionPoolOptions& Options() const { return m_options; }
+    IDirectoryTransport& Transport() const { return *m_transport; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Idle {
+        std::unique_ptr<IDirectorySession> session;
+        Clock::time_point since;
+    };
+
+    struct DcSessions {
+        std::vector<Idle> idle;                     // most recently returned last
+        unsigned leased = 0;                        // includes binds in progress
+        uint64_t epoch = 0;                         // bumped by eviction: older leases are not taken back
+        std::condition_variable returned;
+    };
+
+    void Expire(DcSessions& sessions, Clock::time_point now, std::vector<std::unique_ptr<IDirectorySession>>& closing) {
+        auto stale = std::partition(sessions.idle.begin(), sessions.idle.end(),
+                                    [&](const Idle& i) { return now - i.since < m_options.idleTimeout; });
+        for (auto it = stale; it != sessions.idle.end(); ++it) closing.push_back(std::move(it->session));
+        m_stats.expired += static_cast<uint64_t>(sessions.idle.end() - stale);
+        if (stale != sessions.idle.end()) sessions.returned.notify_all();
+        sessions.idle.erase(stale, sessions.idle.end());
+    }
+
+    void EvictLocked(DcSessions& sessions, std::vector<std::unique_ptr<IDirectorySession>>& closing) {
+        for (auto& i : sessions.idle) closing.push_back(std::move(i.session));
+        m_stats.evicted += sessions.idle.size();
+        sessions.idle.clear();
+        sessions.epoch++;
+        sessions.returned.notify_all();
+    }
+
+    void Return(const std::wstring& dc, uint64_t epoch, std::unique_ptr<IDirectorySession> session, bool connectionLost) {
+        std::vector<std::unique_ptr<IDirectorySession>> closing;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        DcSessions& sessions = m_dcs[dc];
+        sessions.leased--;
+        if (connectionLost) {
+            closing.push_back(std::move(session));
+            m_stats.evicted++;
+            EvictLocked(sessions, closing);
+        } else if (epoch != sessions.epoch) {
+            closing.push_back(std::move(session));
+        } else {
+            sessions.idle.push_back(Idle{std::move(session), Clock::now()});
+        }
+        sessions.returned.notify_one();
+    }
+
+    std::shared_ptr<IDirectoryTransport> m_transport;
+    ConnectionPoolOptions m_options;
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::wstring, DcSessions> m_dcs;
+    ConnectionPoolStats m_stats;
+    Clock::time_point m_lastTrim = Clock::now();
+};
+
+// Exclusive use of one bound session. Returned to the pool when destroyed,
+// unless Fail() reported a connection error.
+class ConnectionPool::Lease {
+public:
+    Lease() = default;
+    Lease(Lease&& other) noexcept { *this = std::move(other); }
+
+    Lease& operator=(Lease&& other) noexcept {
+        if (this != &other) {
+            Release();
+            m_pool = other.m_pool;
+            m_dc = std::move(other.m_dc);
+            m_session = std::move(other.m_session);
+            m_epoch = other.m_epoch;
+            m_reused = other.m_reused;
+            m_lost = other.m_lost;
+            other.m_pool = nullptr;
+        }
+        return *this;
+    }
+
+    ~Lease() { Release(); }
+
+    explicit operator bool() const { return m_session != nullptr; }
+    IDirectorySession* Session() const { return m_session.get(); }
+    bool Reused() const { return m_reused; }
+
+    template <typename T>
+    T& As() const { return static_cast<T&>(*m_session); }
+
+    // Reports a failed call. Connection errors close the session and the
+    // DC's idle sessions; other errors keep the session.
+    void Fail(int32_t error) {
+        if (m_pool && m_pool->Transport().IsConnectionError(error)) m_lost = true;
+    }
+
+private:
+    friend class ConnectionPool;
+
+    void Release() {
+        if (m_pool && m_session) m_pool->Return(m_dc, m_epoch, std::move(m_session), m_lost);
+        m_pool = nullptr;
+    }
+
+    ConnectionPool* m_pool = nullptr;
+    std::wstring m_dc;
+    std::unique_ptr<IDirectorySession> m_session;
+    uint64_t m_epoch = 0;
+    bool m_reused = false;
+    bool m_lost = false;
+};
+
+inline ConnectionPool::Lease ConnectionPool::Acquire(const std::wstring& dc, std::chrono::milliseconds timeout, int32_t& error) {
+    const Clock::time_point deadline = Clock::now() + timeout;
+    std::vector<std::unique_ptr<IDirectorySession>> closing;
+    Lease lease;
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    // Periodic sweep of DCs nobody reads any more
+    Clock::time_point now = Clock::now();
+    if (now - m_lastTrim >= m_options.idleTimeout) {
+        for (auto& kv : m_dcs) Expire(kv.second, now, closing);
+        m_lastTrim = now;
+    }
+
+    DcSessions& sessions = m_dcs[dc];
+    bool waited = false;
+    for (;;) {
+        now = Clock::now();
+        Expire(sessions, now, closing);
+
+        // Most recently used first: it is the likeliest to still be alive
+        while (!sessions.idle.empty()) {
+            Idle idle = std::move(sessions.idle.back());
+            sessions.idle.pop_back();
+            sessions.leased++;
+            const uint64_t epoch = sessions.epoch;
+            bool alive = true;
+            if (now - idle.since >= m_options.checkAfter) {
+                lock.unlock();
+                alive = m_transport->Check(*idle.session);
+                lock.lock();
+            }
+            if (alive) {
+                m_stats.reuses++;
+                lease.m_pool = this;
+                lease.m_dc = dc;
+                lease.m_session = std::move(idle.session);
+                lease.m_epoch = epoch;
+                lease.m_reused = true;
+                return lease;
+            }
+            m_stats.checksFailed++;
+            sessions.leased--;
+            closing.push_back(std::move(idle.session));
+        }
+
+        if (sessions.idle.size() + sessions.leased < m_options.maxPerDc) break;
+        if (!waited) m_stats.waits++;
+        waited = true;
+        if (sessions.returned.wait_until(lock, deadline) == std::cv_status::timeout &&
+            sessions.idle.empty() && sessions.idle.size() + sessions.leased >= m_options.maxPerDc) {
+            error = -1;                                 // every session to this DC is busy
+            return lease;
+        }
+    }
+
+    // Bind outside the lock; the slot is reserved meanwhile
+    sessions.leased++;
+    const uint64_t epoch = sessions.epoch;
+    lock.unlock();
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now());
+    std::unique_ptr<IDirectorySession> session =
+        m_transport->Bind(dc, std::max(std::chrono::milliseconds(1), remaining), error);
+    lock.lock();
+
+    if (!session) {
+        m_stats.bindFailures++;
+        sessions.leased--;
+        sessions.returned.notify_one();
+        return lease;
+    }
+    m_stats.binds++;
+    lease.m_pool = this;
+    lease.m_dc = dc;
+    lease.m_epoch = epoch;
+    lease.m_session = std::move(session);
+    return lease;
+}
@@ -0,0 +1,161 @@
+// DirectoryBackend.h
+// Interface d'accès à l'annuaire AD, indépendante d'ADSI (backends réel et simulé)
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cwctype>
+#include <functional>
+#include <string>
+#include <vector>
+
+enum class ProbeStatus : uint8_t {
+    Ok,
+    Unreachable,
+    Timeout,
+    Cancelled
+};
+
+struct RootDseReply {
+    ProbeStatus status = ProbeStatus::Unreachable;
+    int32_t error = 0;                  // HRESULT / backend specific code
+    uint64_t highestCommittedUSN = 0;
+    std::wstring dnsHostName;
+    std::wstring dsServiceName;
+    std::wstring defaultNamingContext;
+    std::wstring configurationNamingContext;
+};
+
+// One attribute of one object as a given DC holds it
+struct AttributeReply {
+    ProbeStatus status = ProbeStatus::Unreachable;
+    int32_t error = 0;
+    bool found = false;                 // the object exists and the attribute has a value
+    std::wstring value;
+};
+
+struct DirectoryAttribute {
+    std::wstring name;
+    std::vector<std::wstring> values;   // binary values are rendered as hex
+};
+
+struct DirectoryEntry {
+    std::wstring dn;
+    std::vector<DirectoryAttribute> attributes;
+
+    const std::vector<std::wstring>* Find(const std::wstring& attr) const {
+        for (const auto& a : attributes) {
+            if (a.name.size() != attr.size()) continue;
+            bool same = true;
+            for (size_t i = 0; i < attr.size() && same; i++) {
+                same = towlower(a.name[i]) == towlower(attr[i]);
+            }
+            if (same) return &a.values;
+        }
+        return nullptr;
+    }
+
+    std::wstring First(const std::wstring& attr) const {
+        const auto* v = Find(attr);
+        return (v && !v->empty()) ? v->front() : std::wstring();
+    }
+};
+
+struct SearchRequest {
+    std::wstring server;                // empty: let the backend pick a DC
+    std::wstring baseDn;
+    std::wstring filter;
+    std::vector<std::wstring> attributes;
+    uint32_t pageSize = 1000;
+};
+
+// Inbound replication partner of a DC for one naming context, as reported
+// by the DC itself (DS_REPL_NEIGHBOR). Times are Unix ms, 0 if never.
+struct ReplicaNeighbor {
+    std::wstring namingContext;
+    std::wstring sourceDsaDn;           // NTDS Settings DN of the source DC
+    int64_t lastSuccess = 0;
+    int64_t lastAttempt = 0;
+    uint32_t consecutiveFailures = 0;
+    uint32_t lastResult = 0;            // Win32 status of the last attempt
+    uint64_t usnLastObjChangeSynced = 0;
+    uint64_t usnAttributeFilter = 0;
+};
+
+// One up-to-dateness vector entry (DS_REPL_CURSOR_3): the newest change
+// originated by sourceDsaDn that this DC has applied for a naming context.
+struct UpToDatenessCursor {
+    std::wstring namingContext;
+    std::wstring sourceDsaDn;           // empty for DCs that no longer exist
+    std::wstring invocationId;          // hex, same rendering as search values
+    uint64_t usnHighPropUpdate = 0;
+    int64_t lastSyncSuccess = 0;
+};
+
+struct ReplicaState {
+    int32_t error = 0;
+    std::vector<ReplicaNeighbor> neighbors;
+    std::vector<UpToDatenessCursor> cursors;
+};
+
+// A directory backend answers per-DC reads. Implementations must be callable
+// concurrently from several probe workers.
+class IDirectoryBackend {
+public:
+    virtual ~IDirectoryBackend() = default;
+
+    // Reads the rootDSE of dcName. The timeout is a hint: backends honour it
+    // when the underlying API allows it, the probe engine enforces it anyway.
+    // An empty dcName reads the rootDSE of whichever DC the locator picks.
+    virtual RootDseReply ReadRootDse(const std::wstring& dcName, std::chrono::milliseconds timeout) = 0;
+
+    // Paged subtree search; onEntry is called once per returned object.
+    // Returns false if the search could not be executed.
+    virtual bool SearchSubtree(const SearchRequest& request, const std::function<void(const DirectoryEntry&)>& onEntry) {
+        (void)request;
+        (void)onEntry;
+        return false;
+    }
+
+    // Inbound neighbors (all naming contexts) and the up-to-dateness vector
+    // of each listed naming context, read from dcName.
+    // Returns false if the DC could not be queried.
+    virtual bool ReadReplicaState(const std::wstring& dcName, const std::vector<std::wstring>& namingContexts,
+                                  ReplicaState& state) {
+        (void)dcName;
+        (void)namingContexts;
+        (void)state;
+        return false;
+    }
+
+    // Reads one single-valued attribute of dn from dcName's own replica
+    // (no referral). A missing object or value is an Ok reply with found
+    // false. The timeout is a hint, as for ReadRootDse.
+    virtual AttributeReply ReadAttribute(const std::wstring& dcName, const std::wstring& dn, const std::wstring& attribute,
+                                         std::chrono::milliseconds timeout) {
+        (void)dcName;
+        (void)dn;
+        (void)attribute;
+        (void)timeout;
+        return AttributeReply();
+    }
+
+    // Writes one single-valued attribute of dn on dcName, creating dn as a
+    // container if it does not exist yet. Returns false with error set if
+    // the write was not committed.
+    virtual bool WriteAttribute(const std::wstring& dcName, const std::wstring& dn, const std::wstring& attribute,
+                                const std::wstring& value, int32_t& error) {
+        (void)dcName;
+        (void)dn;
+        (void)attribute;
+        (void)value;
+        error = -1;
+        return false;
+    }
+
+    // Closes the bound sessions a backend keeps between reads and scans.
+    // Front ends call it before tearing COM down; later reads rebind.
+    virtual void CloseSessions() {}
+};
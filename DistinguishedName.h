@@ -0,0 +1,646 @@
+// DistinguishedName.h
+// Noms distinctifs LDAP (RFC 4514) : analyse dans une arène, internement en identifiants, comparaisons sans allocation
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cwctype>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Bump allocator for parsed DNs: blocks are never moved, so views into them
+// stay valid until the arena is destroyed or rewound past them. Only
+// trivially destructible types.
+class DnArena {
+public:
+    struct Mark {
+        size_t block = 0;
+        size_t used = 0;
+    };
+
+    explicit DnArena(size_t blockBytes = 64 * 1024) : m_blockBytes(blockBytes) {}
+    DnArena(const DnArena&) = delete;
+    DnArena& operator=(const DnArena&) = delete;
+
+    template <typename T>
+    T* Allocate(size_t count) {
+        const size_t bytes = count * sizeof(T);
+        if (m_blocks.empty()) AddBlock(bytes + alignof(T), 0);
+        for (;;) {
+            Block& b = m_blocks[m_current];
+            const size_t at = (b.used + alignof(T) - 1) & ~(alignof(T) - 1);
+            if (at + bytes <= b.size) {
+                b.used = at + bytes;
+                return reinterpret_cast<T*>(b.data.get() + at);
+            }
+            // Blocks left over by a rewind are reused when large enough
+            if (m_current + 1 < m_blocks.size() && m_blocks[m_current + 1].size >= bytes + alignof(T)) {
+                m_blocks[++m_current].used = 0;
+            } else {
+                AddBlock(bytes + alignof(T), m_current + 1);
+                m_current++;
+            }
+        }
+    }
+
+    Mark Position() const { return m_blocks.empty() ? Mark() : Mark{m_current, m_blocks[m_current].used}; }
+
+    // Frees everything allocated since mark (the memory is kept for reuse)
+    void Rewind(const Mark& mark) {
+        if (m_blocks.empty()) return;
+        m_current = mark.block;
+        m_blocks[m_current].used = mark.used;
+    }
+
+    size_t Bytes() const {
+        size_t n = 0;
+        for (const Block& b : m_blocks) n += b.size;
+        return n;
+    }
+
+private:
+    struct Block {
+        std::unique_ptr<unsigned char[]> data;
+        size_t size = 0;
+        size_t used = 0;
+    };
+
+    void AddBlock(size_t minBytes, size_t at) {
+        Block b;
+        b.size = std::max(m_blockBytes, minBytes);
+        b.data.reset(new unsigned char[b.size]);
+        m_blocks.insert(m_blocks.begin() + static_cast<std::ptrdiff_t>(at), std::move(b));
+    }
+
+    size_t m_blockBytes;
+    size_t m_current = 0;
+    std::vector<Block> m_blocks;
+};
+
+// One type=value pair. The value is unescaped; hexString values ("#04024869")
+// are kept as written, '#' included.
+struct DnAttribute {
+    const wchar_t* type = nullptr;
+    const wchar_t* value = nullptr;
+    uint32_t typeLength = 0;
+    uint32_t valueLength = 0;
+    bool hexString = false;
+
+    std::wstring_view Type() const { return std::wstring_view(type, typeLength); }
+    std::wstring_view Value() const { return std::wstring_view(value, valueLength); }
+};
+
+// One RDN: usually a single attribute, several for "CN=a+UID=b" (sorted by
+// type). hash covers this RDN, chain this RDN and every RDN after it, so a
+// DN and each of its ancestors hash in O(1).
+struct Rdn {
+    const DnAttribute* attributes = nullptr;
+    uint32_t count = 0;
+    uint64_t hash = 0;
+    uint64_t chain = 0;
+
+    std::wstring_view Type() const { return attributes[0].Type(); }
+    std::wstring_view Value() const { return attributes[0].Value(); }
+};
+
+// A parsed DN, leaf first as written ("CN=DC1,CN=Servers,..."). A view:
+// the RDNs live in the arena it was parsed into.
+struct DnView {
+    const Rdn* rdns = nullptr;
+    uint32_t count = 0;
+
+    bool Empty() const { return count == 0; }
+    uint64_t Hash() const { return count ? rdns[0].chain : 0; }
+    const Rdn& Leaf() const { return rdns[0]; }
+    DnView Parent() const { return count ? DnView{rdns + 1, count - 1} : DnView(); }
+    // The last n RDNs: the ancestor n levels below the root
+    DnView Suffix(uint32_t n) const { return n >= count ? *this : DnView{rdns + (count - n), n}; }
+};
+
+// Attribute types and the values AD compares (CN, OU, DC...) are case-insensitive
+inline wchar_t FoldDnChar(wchar_t c) {
+    if (c < 0x80) return c >= L'A' && c <= L'Z' ? static_cast<wchar_t>(c + 32) : c;
+    return static_cast<wchar_t>(towlower(c));
+}
+
+inline bool DnTextEquals(std::wstring_view a, std::wstring_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i] != b[i] && FoldDnChar(a[i]) != FoldDnChar(b[i])) return false;
+    }
+    return true;
+}
+
+inline bool RdnEquals(const Rdn& a, const Rdn& b) {
+    if (a.hash != b.hash || a.count != b.count) return false;
+    for (uint32_t i = 0; i < a.count; i++) {
+        if (!DnTextEquals(a.attributes[i].Type(), b.attributes[i].Type()) ||
+            !DnTextEquals(a.attributes[i].Value(), b.attributes[i].Value())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// dn ends with suffix (or is it): suffix is dn itself or one of its ancestors
+inline bool DnEndsWith(DnView dn, DnView suffix) {
+    if (suffix.count > dn.count) return false;
+    if (suffix.count == 0) return true;
+    const Rdn* tail = dn.rdns + (dn.count - suffix.count);
+    if (tail[0].chain != suffix.rdns[0].chain) return false;
+    for (uint32_t i = 0; i < suffix.count; i++) {
+        if (!RdnEquals(tail[i], suffix.rdns[i])) return false;
+    }
+    return true;
+}
+
+inline bool DnEquals(DnView a, DnView b) { return a.count == b.count && DnEndsWith(a, b); }
+inline bool DnIsUnder(DnView dn, DnView ancestor) { return dn.count > ancestor.count && DnEndsWith(dn, ancestor); }
+inline bool DnIsChildOf(DnView dn, DnView parent) { return dn.count == parent.count + 1 && DnEndsWith(dn, parent); }
+
+inline uint64_t HashDnText(uint64_t h, std::wstring_view text) {
+    for (wchar_t c : text) {
+        h ^= static_cast<uint64_t>(FoldDnChar(c));
+        h *= 0x100000001B3ull;
+    }
+    return h;
+}
+
+inline uint64_t ChainDnHash(uint64_t parent, uint64_t rdn) {
+    uint64_t h = (parent ^ (rdn + 0x9E3779B97F4A7C15ull + (parent << 6) + (parent >> 2))) * 0xFF51AFD7ED558CCDull;
+    return h ^ (h >> 33);
+}
+
+// Hex pairs of "\C3\A9" are UTF-8 bytes: decoded as they come, without a
+// byte buffer. Invalid sequences become U+FFFD.
+struct DnUtf8Decoder {
+    uint32_t cp = 0;
+    unsigned need = 0;
+
+    static wchar_t* Put(uint32_t value, wchar_t* out) {
+        if (sizeof(wchar_t) == 2 && value >= 0x10000) {
+            value -= 0x10000;
+            *out++ = static_cast<wchar_t>(0xD800 + (value >> 10));
+            *out++ = static_cast<wchar_t>(0xDC00 + (value & 0x3FF));
+        } else {
+            *out++ = static_cast<wchar_t>(value);
+        }
+        return out;
+    }
+
+    wchar_t* Feed(unsigned char byte, wchar_t* out) {
+        if (need > 0 && (byte & 0xC0) == 0x80) {
+            cp = (cp << 6) | (byte & 0x3F);
+            if (--need == 0) out = Put(cp, out);
+            return out;
+        }
+        out = Flush(out);
+        if (byte < 0x80) return Put(byte, out);
+        if ((byte >> 5) == 0x6) {
+            cp = byte & 0x1F;
+            need = 1;
+        } else if ((byte >> 4) == 0xE) {
+            cp = byte & 0x0F;
+            need = 2;
+        } else if ((byte >> 3) == 0x1E) {
+            cp = byte & 0x07;
+            need = 3;
+        } else {
+            out = Put(0xFFFD, out);
+        }
+        return out;
+    }
+
+    wchar_t* Flush(wchar_t* out) {
+        if (need == 0) return out;
+        need = 0;
+        return Put(0xFFFD, out);
+    }
+};
+
+inline int DnHexDigit(wchar_t c) {
+    if (c >= L'0' && c <= L'9') return c - L'0';
+    if (c >= L'a' && c <= L'f') return c - L'a' + 10;
+    if (c >= L'A' && c <= L'F') return c - L'A' + 10;
+    return -1;
+}
+
+inline bool IsDnSpecial(wchar_t c) {
+    return c == L',' || c == L'+' || c == L'"' || c == L'\\' || c == L'<' || c == L'>' || c == L';' || c == L'=' ||
+           c == L' ' || c == L'#';
+}
+
+// Reads one attribute value from text[pos] up to the next unescaped ',',
+// ';' or '+' (or the closing quote of an RFC 2253 quoted value) into out,
+// unescaped; returns the end of the written value, nullptr when the value
+// is malformed. Unescaped trailing spaces are dropped.
+inline wchar_t* ReadDnValue(std::wstring_view text, size_t& pos, wchar_t* out, bool& hexString) {
+    wchar_t* const start = out;
+    wchar_t* kept = out;                    // end of the value without unescaped trailing spaces
+    hexString = pos < text.size() && text[pos] == L'#';
+    if (hexString) {
+        *out++ = text[pos++];
+        while (pos < text.size() && DnHexDigit(text[pos]) >= 0) *out++ = text[pos++];
+        if (out - start < 3 || (out - start) % 2 == 0) return nullptr;     // '#' and pairs of hex digits
+        return out;
+    }
+    const bool quoted = pos < text.size() && text[pos] == L'"';
+    if (quoted) pos++;
+    DnUtf8Decoder utf8;
+    while (pos < text.size()) {
+        const wchar_t c = text[pos];
+        if (quoted ? c == L'"' : (c == L',' || c == L';' || c == L'+')) break;
+        if (c == L'\\') {
+            if (pos + 1 >= text.size()) return nullptr;
+            const int hi = DnHexDigit(text[pos + 1]);
+            const int lo = pos + 2 < text.size() ? DnHexDigit(text[pos + 2]) : -1;
+            if (hi >= 0 && lo >= 0) {
+                out = utf8.Feed(static_cast<unsigned char>(hi * 16 + lo), out);
+                pos += 3;
+            } else if (IsDnSpecial(text[pos + 1])) {
+                out = utf8.Flush(out);
+                *out++ = text[pos + 1];
+                pos += 2;
+            } else {
+                return nullptr;
+            }
+            kept = out;
+            continue;
+        }
+        out = utf8.Flush(out);
+        *out++ = c;
+        pos++;
+        if (c != L' ' || quoted) kept = out;
+    }
+    out = utf8.Flush(out);
+    if (quoted) {
+        if (pos >= text.size()) return nullptr;         // no closing quote
+        pos++;
+        return out;
+    }
+    return kept;
+}
+
+// Parses an RFC 4514 DN ("CN=a\,b+UID=c,DC=example,DC=com") into arena.
+// Spaces around separators and '=' are tolerated (AD writes "CN=a, DC=b"),
+// as are ';' separators and quoted values (RFC 2253). An empty string is
+// the root DSE's empty DN. Returns false on a malformed DN; what was
+// allocated for it is then wasted until the arena is rewound.
+inline bool ParseDn(std::wstring_view text, DnArena& arena, DnView& dn) {
+    dn = DnView();
+    auto skipSpaces = [&](size_t& pos) {
+        while (pos < text.size() && text[pos] == L' ') pos++;
+    };
+    size_t pos = 0;
+    skipSpaces(pos);
+    if (pos == text.size()) return true;
+
+    // Every attribute takes one '=': a bound for the RDN and attribute
+    // arrays. Types and values never grow when unescaped, so the text's
+    // length bounds their characters.
+    size_t separators = 1;
+    for (wchar_t c : text) separators += c == L'=' ? 1 : 0;
+    wchar_t* chars = arena.Allocate<wchar_t>(text.size());
+    DnAttribute* attributes = arena.Allocate<DnAttribute>(separators);
+    Rdn* rdns = arena.Allocate<Rdn>(separators);
+    size_t attributeCount = 0, rdnCount = 0;
+    wchar_t* out = chars;
+
+    for (;;) {
+        Rdn& rdn = rdns[rdnCount++];
+        rdn.attributes = attributes + attributeCount;
+        rdn.count = 0;
+        for (;;) {
+            skipSpaces(pos);
+            // attributeType: keystring or numeric OID
+            const size_t typeStart = pos;
+            auto alpha = [](wchar_t c) { return (c >= L'a' && c <= L'z') || (c >= L'A' && c <= L'Z'); };
+            auto digit = [](wchar_t c) { return c >= L'0' && c <= L'9'; };
+            if (pos < text.size() && alpha(text[pos])) {
+                while (pos < text.size() && (alpha(text[pos]) || digit(text[pos]) || text[pos] == L'-')) pos++;
+            } else {
+                while (pos < text.size() && (digit(text[pos]) || text[pos] == L'.')) pos++;
+            }
+            if (pos == typeStart || attributeCount == separators) return false;
+            DnAttribute& a = attributes[attributeCount++];
+            a.type = out;
+            a.typeLength = static_cast<uint32_t>(pos - typeStart);
+            out = std::copy(text.data() + typeStart, text.data() + pos, out);
+            skipSpaces(pos);
+            if (pos >= text.size() || text[pos] != L'=') return false;
+            pos++;
+            skipSpaces(pos);
+            a.value = out;
+            out = ReadDnValue(text, pos, out, a.hexString);
+            if (!out) return false;
+            a.valueLength = static_cast<uint32_t>(out - a.value);
+            rdn.count++;
+            skipSpaces(pos);
+            if (pos < text.size() && text[pos] == L'+') {
+                pos++;
+                continue;
+            }
+            break;
+        }
+        // Multi-valued RDNs compare as sets: sorted by type, then value
+        if (rdn.count > 1) {
+            DnAttribute* first = attributes + attributeCount - rdn.count;
+            std::sort(first, attributes + attributeCount, [](const DnAttribute& x, const DnAttribute& y) {
+                auto less = [](std::wstring_view p, std::wstring_view q) {
+                    for (size_t i = 0; i < p.size() && i < q.size(); i++) {
+                        const wchar_t a = FoldDnChar(p[i]), b = FoldDnChar(q[i]);
+                        if (a != b) return a < b;
+                    }
+                    return p.size() < q.size();
+                };
+                if (!DnTextEquals(x.Type(), y.Type())) return less(x.Type(), y.Type());
+                return less(x.Value(), y.Value());
+            });
+        }
+        uint64_t h = 0xCBF29CE484222325ull;
+        for (uint32_t i = 0; i < rdn.count; i++) {
+            if (i) h = HashDnText(h, L"+");
+            h = HashDnText(HashDnText(HashDnText(h, rdn.attributes[i].Type()), L"="), rdn.attributes[i].Value());
+        }
+        rdn.hash = h;
+        if (pos >= text.size()) break;
+        if (text[pos] != L',' && text[pos] != L';') return false;
+        pos++;
+        if (rdnCount == separators) return false;
+    }
+
+    uint64_t chain = 0;
+    for (size_t i = rdnCount; i-- > 0;) {
+        chain = ChainDnHash(chain, rdns[i].hash);
+        rdns[i].chain = chain;
+    }
+    dn.rdns = rdns;
+    dn.count = static_cast<uint32_t>(rdnCount);
+    return true;
+}
+
+// Appends value escaped for a DN (RFC 4514 section 2.4)
+inline void AppendDnValue(std::wstring& out, std::wstring_view value) {
+    for (size_t i = 0; i < value.size(); i++) {
+        const wchar_t c = value[i];
+        if (c == L',' || c == L'+' || c == L'"' || c == L'\\' || c == L'<' || c == L'>' || c == L';' ||
+            (i == 0 && (c == L'#' || c == L' ')) || (i + 1 == value.size() && c == L' ')) {
+            out += L'\\';
+            out += c;
+        } else if (c == 0) {
+            out += L"\\00";
+        } else {
+            out += c;
+        }
+    }
+}
+
+inline void AppendRdn(std::wstring& out, const Rdn& rdn) {
+    for (uint32_t k = 0; k < rdn.count; k++) {
+        const DnAttribute& a = rdn.attributes[k];
+        if (k) out += L'+';
+        out.append(a.type, a.typeLength);
+        out += L'=';
+        if (a.hexString) {
+            out.append(a.value, a.valueLength);
+        } else {
+            AppendDnValue(out, a.Value());
+        }
+    }
+}
+
+// The DN as text, types as written, values escaped, no spaces
+inline void AppendDn(std::wstring& out, DnView dn) {
+    for (uint32_t i = 0; i < dn.count; i++) {
+        if (i) out += L',';
+        AppendRdn(out, dn.rdns[i]);
+    }
+}
+
+inline std::wstring FormatDn(DnView dn) {
+    std::wstring out;
+    AppendDn(out, dn);
+    return out;
+}
+
+// type=value,parent with value escaped: "CN=Sites," + configuration, built
+// in one allocation
+inline std::wstring ChildDn(std::wstring_view type, std::wstring_view value, std::wstring_view parent) {
+    std::wstring dn;
+    dn.reserve(type.size() + value.size() + parent.size() + 8);
+    dn.append(type.data(), type.size());
+    dn += L'=';
+    AppendDnValue(dn, value);
+    if (!parent.empty()) {
+        dn += L',';
+        dn.append(parent.data(), parent.size());
+    }
+    return dn;
+}
+
+// "corp.example.com" -> "DC=corp,DC=example,DC=com"
+inline std::wstring DomainDnFromDns(std::wstring_view domain) {
+    while (!domain.empty() && domain.back() == L'.') domain.remove_suffix(1);
+    std::wstring dn;
+    if (domain.empty()) return dn;
+    dn.reserve(domain.size() + 4 * (std::count(domain.begin(), domain.end(), L'.') + 1));
+    for (size_t pos = 0; pos <= domain.size();) {
+        size_t dot = domain.find(L'.', pos);
+        if (dot == std::wstring_view::npos) dot = domain.size();
+        if (!dn.empty()) dn += L',';
+        dn += L"DC=";
+        AppendDnValue(dn, domain.substr(pos, dot - pos));
+        pos = dot + 1;
+    }
+    return dn;
+}
+
+// "LDAP://server/dn" for ADSI, which reads '/' as a path separator even
+// inside the DN: escaped there as "\/". No server: the DC locator picks one.
+inline std::wstring AdsPath(std::wstring_view server, std::wstring_view dn) {
+    std::wstring path;
+    path.reserve(8 + server.size() + dn.size() + 4);
+    path += L"LDAP://";
+    if (!server.empty()) {
+        path.append(server.data(), server.size());
+        path += L'/';
+    }
+    for (size_t i = 0; i < dn.size(); i++) {
+        if (dn[i] == L'\\' && i + 1 < dn.size()) {
+            path += dn[i];
+            path += dn[++i];
+            continue;
+        }
+        if (dn[i] == L'/') path += L'\\';
+        path += dn[i];
+    }
+    return path;
+}
+
+// The text after the first RDN ("CN=a\,b,CN=c" -> "CN=c"), without parsing
+// or copying; empty for a single RDN
+inline std::wstring_view ParentDnText(std::wstring_view dn) {
+    bool quoted = false;
+    for (size_t i = 0; i < dn.size(); i++) {
+        if (dn[i] == L'\\') {
+            i++;
+        } else if (dn[i] == L'"') {
+            quoted = !quoted;
+        } else if (!quoted && (dn[i] == L',' || dn[i] == L';')) {
+            size_t start = i + 1;
+            while (start < dn.size() && dn[start] == L' ') start++;
+            return dn.substr(start);
+        }
+    }
+    return std::wstring_view();
+}
+
+// The unescaped value of the first RDN ("CN=a\,b,..." -> "a,b"); dn itself
+// when it is not a DN
+inline std::wstring FirstRdnValue(std::wstring_view dn) {
+    const size_t eq = dn.find(L'=');
+    if (eq == std::wstring_view::npos) return std::wstring(dn);
+    size_t pos = eq + 1;
+    while (pos < dn.size() && dn[pos] == L' ') pos++;
+    std::wstring value(dn.size() - pos, L'\0');
+    bool hexString;
+    const wchar_t* end = ReadDnValue(dn, pos, &value[0], hexString);
+    value.resize(end ? static_cast<size_t>(end - value.data()) : 0);
+    return value;
+}
+
+// DNs interned to dense ids, as a tree: each id keeps its first RDN and
+// its parent's id, so interning a DN interns its ancestors and each RDN is
+// stored once. Equal DNs (case, spacing and escaping aside) get the same
+// id: maps keyed by DN become vectors, comparisons and ancestry walks
+// integer compares. Id 0 is the empty DN, the root of every other.
+// Intern is not thread-safe; the const members are, while nothing interns.
+typedef uint32_t DnId;
+const DnId kInvalidDn = 0xFFFFFFFFu;
+const DnId kRootDn = 0;
+
+class DnTable {
+public:
+    DnTable() : m_nodes(1), m_slots(64, kInvalidDn) {}
+    DnTable(const DnTable&) = delete;
+    DnTable& operator=(const DnTable&) = delete;
+
+    // kInvalidDn when text is not a DN. Parsed in a scratch arena that stays
+    // in cache; only new RDNs are copied into the table.
+    DnId Intern(std::wstring_view text) {
+        m_scratch.Rewind(DnArena::Mark());
+        DnView dn;
+        return ParseDn(text, m_scratch, dn) ? Intern(dn) : kInvalidDn;
+    }
+
+    // A DN parsed elsewhere, root first
+    DnId Intern(DnView dn) {
+        DnId id = kRootDn;
+        for (uint32_t i = dn.count; i-- > 0;) {
+            const DnId parent = id;
+            id = Child(parent, dn.rdns[i]);
+            if (id == kInvalidDn) id = Insert(parent, dn.rdns[i]);
+        }
+        return id;
+    }
+
+    DnId Find(std::wstring_view text) const {
+        DnArena scratch(text.size() * (sizeof(wchar_t) + sizeof(Rdn) + sizeof(DnAttribute)) + 64);
+        DnView dn;
+        return ParseDn(text, scratch, dn) ? Find(dn) : kInvalidDn;
+    }
+
+    DnId Find(DnView dn) const {
+        DnId id = kRootDn;
+        for (uint32_t i = dn.count; i-- > 0 && id != kInvalidDn;) id = Child(id, dn.rdns[i]);
+        return id;
+    }
+
+    // The DN without its first RDN; kInvalidDn for the empty DN
+    DnId Parent(DnId id) const { return id < m_nodes.size() ? m_nodes[id].parent : kInvalidDn; }
+    uint32_t Depth(DnId id) const { return id < m_nodes.size() ? m_nodes[id].depth : 0; }
+    // The first RDN; no attributes for the empty DN
+    const Rdn& Leaf(DnId id) const { return m_nodes[id < m_nodes.size() ? id : kRootDn].leaf; }
+
+    std::wstring Name(DnId id) const {
+        std::wstring out;
+        for (DnId at = id < m_nodes.size() ? id : kRootDn; at != kRootDn; at = m_nodes[at].parent) {
+            if (at != id) out += L',';
+            AppendRdn(out, m_nodes[at].leaf);
+        }
+        return out;
+    }
+
+    // dn is ancestor or below it
+    bool IsWithin(DnId dn, DnId ancestor) const {
+        if (dn >= m_nodes.size() || ancestor >= m_nodes.size()) return false;
+        while (m_nodes[dn].depth > m_nodes[ancestor].depth) dn = m_nodes[dn].parent;
+        return dn == ancestor;
+    }
+
+    size_t Size() const { return m_nodes.size(); }
+    size_t ArenaBytes() const { return m_arena.Bytes(); }
+
+private:
+    struct Node {
+        Rdn leaf;                       // chain: the hash of the whole DN
+        DnId parent = kInvalidDn;
+        uint32_t depth = 0;
+    };
+
+    DnId Child(DnId parent, const Rdn& rdn) const {
+        const size_t mask = m_slots.size() - 1;
+        for (size_t i = static_cast<size_t>(rdn.chain) & mask;; i = (i + 1) & mask) {
+            const DnId id = m_slots[i];
+            if (id == kInvalidDn) return kInvalidDn;
+            const Node& node = m_nodes[id];
+            if (node.leaf.chain == rdn.chain && node.parent == parent && RdnEquals(node.leaf, rdn)) return id;
+        }
+    }
+
+    DnId Insert(DnId parent, const Rdn& rdn) {
+        if ((m_nodes.size() + 1) * 2 > m_slots.size()) {
+            std::vector<DnId> slots(m_slots.size() * 2, kInvalidDn);
+            m_slots.swap(slots);
+            for (DnId id = 1; id < m_nodes.size(); id++) Place(id);
+        }
+        Node node;
+        node.leaf = rdn;
+        node.parent = parent;
+        node.depth = m_nodes[parent].depth + 1;
+        size_t chars = 0;
+        for (uint32_t k = 0; k < rdn.count; k++) chars += rdn.attributes[k].typeLength + rdn.attributes[k].valueLength;
+        DnAttribute* attributes = m_arena.Allocate<DnAttribute>(rdn.count);
+        wchar_t* out = m_arena.Allocate<wchar_t>(chars);
+        for (uint32_t k = 0; k < rdn.count; k++) {
+            DnAttribute a = rdn.attributes[k];
+            a.type = out;
+            out = std::copy(rdn.attributes[k].type, rdn.attributes[k].type + a.typeLength, out);
+            a.value = out;
+            out = std::copy(rdn.attributes[k].value, rdn.attributes[k].value + a.valueLength, out);
+            attributes[k] = a;
+        }
+        node.leaf.attributes = attributes;
+        const DnId id = static_cast<DnId>(m_nodes.size());
+        m_nodes.push_back(node);
+        Place(id);
+        return id;
+    }
+
+    void Place(DnId id) {
+        const size_t mask = m_slots.size() - 1;
+        size_t i = static_cast<size_t>(m_nodes[id].leaf.chain) & mask;
+        while (m_slots[i] != kInvalidDn) i = (i + 1) & mask;
+        m_slots[i] = id;
+    }
+
+    DnArena m_arena;
+    DnArena m_scratch{16 * 1024};
+    std::vector<Node> m_nodes;          // by id; m_nodes[0] is the empty DN
+    std::vector<DnId> m_slots;          // open addressing by (parent, RDN) hash, kInvalidDn when free
+};
@@ -0,0 +1,226 @@
+// EventAnalysis.h
+// Agrégation des événements de réplication par (DC source, DC destination, code d'erreur), fichiers XML en une passe
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "EventParser.h"
+#include "MappedFile.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+struct ReplicationErrorEntry {
+    uint32_t source = 0;                // name ids, see ReplicationErrorTable::Name()
+    uint32_t dest = 0;
+    uint32_t error = 0;                 // Win32 status, 0 for events without one (2042, 1388...)
+    uint32_t lastEventId = 0;
+    uint32_t namingContext = 0;         // last one seen, 0 when none
+    uint64_t count = 0;
+    int64_t firstSeen = 0;              // Unix epoch, milliseconds
+    int64_t lastSeen = 0;
+};
+
+// Counters per (source, destination, error). Names are interned once,
+// lower-cased and with XML entities decoded; after that, adding an event
+// whose triple was already seen allocates nothing. One writer; tables
+// built on separate threads are merged.
+class ReplicationErrorTable {
+public:
+    ReplicationErrorTable() { Intern(std::string_view()); }
+    ReplicationErrorTable(ReplicationErrorTable&&) = default;
+    ReplicationErrorTable& operator=(ReplicationErrorTable&&) = default;
+
+    // m_ids views into m_names: a member-wise copy would point at the original
+    ReplicationErrorTable(const ReplicationErrorTable&) = delete;
+    ReplicationErrorTable& operator=(const ReplicationErrorTable&) = delete;
+
+    // The event was logged by dest. Returns false when it carries no
+    // replication field at all (no source, no error).
+    bool Add(std::string_view dest, const EventView& event) {
+        ReplicationFields fields = ExtractReplicationFields(event);
+        if (fields.source.empty() && fields.error == 0) return false;
+        Add(Intern(fields.source), Intern(dest), fields.error, event.eventId, Intern(fields.namingContext),
+            1, event.timeCreated, event.timeCreated);
+        m_events++;
+        return true;
+    }
+
+    void Merge(const ReplicationErrorTable& other) {
+        for (const ReplicationErrorEntry& e : other.m_entries) {
+            Add(Intern(other.Name(e.source)), Intern(other.Name(e.dest)), e.error, e.lastEventId,
+                Intern(other.Name(e.namingContext)), e.count, e.firstSeen, e.lastSeen);
+        }
+        m_events += other.m_events;
+    }
+
+    const std::string& Name(uint32_t id) const { return m_names[id]; }
+    const std::vector<ReplicationErrorEntry>& Entries() const { return m_entries; }
+    uint64_t Events() const { return m_events; }
+    bool Empty() const { return m_entries.empty(); }
+
+    // Most frequent first, then by name and error so the order is stable
+    std::vector<ReplicationErrorEntry> Top(size_t n) const {
+        std::vector<ReplicationErrorEntry> sorted = m_entries;
+        n = std::min(n, sorted.size());
+        std::partial_sort(sorted.begin(), sorted.begin() + n, sorted.end(),
+                          [&](const ReplicationErrorEntry& a, const ReplicationErrorEntry& b) {
+            if (a.count != b.count) return a.count > b.count;
+            if (a.source != b.source) return Name(a.source) < Name(b.source);
+            if (a.dest != b.dest) return Name(a.dest) < Name(b.dest);
+            return a.error < b.error;
+        });
+        sorted.resize(n);
+        return sorted;
+    }
+
+private:
+    struct Key {
+        uint64_t names;                 // source << 32 | dest
+        uint32_t error;
+        bool operator==(const Key& other) const { return names == other.names && error == other.error; }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            uint64_t k = key.names ^ (static_cast<uint64_t>(key.error) * 0x9E3779B97F4A7C15ull);
+            k ^= k >> 33; k *= 0xFF51AFD7ED558CCDull; k ^= k >> 33;
+            return static_cast<size_t>(k);
+        }
+    };
+
+    void Add(uint32_t source, uint32_t dest, uint32_t error, uint32_t eventId, uint32_t nc, uint64_t count,
+             int64_t first, int64_t last) {
+        const Key key{(static_cast<uint64_t>(source) << 32) | dest, error};
+        auto it = m_index.find(key);
+        if (it == m_index.end()) {
+            it = m_index.emplace(key, static_cast<uint32_t>(m_entries.size())).first;
+            ReplicationErrorEntry e;
+            e.source = source;
+            e.dest = dest;
+            e.error = error;
+            e.firstSeen = first;
+            m_entries.push_back(e);
+        }
+        ReplicationErrorEntry& e = m_entries[it->second];
+        e.count += count;
+        if (first != 0 && (e.firstSeen == 0 || first < e.firstSeen)) e.firstSeen = first;
+        if (last >= e.lastSeen) {
+            e.lastSeen = last;
+            e.lastEventId = eventId;
+            if (nc != 0) e.namingContext = nc;
+        }
+    }
+
+    // Lower-cased, entities decoded, into m_scratch; reused across calls
+    uint32_t Intern(std::string_view raw) {
+        m_scratch.clear();
+        for (size_t i = 0; i < raw.size(); i++) {
+            char c = raw[i];
+            if (c == '&') {
+                static const struct { const char* entity; size_t length; char value; } kEntities[] = {
+                    {"&amp;", 5, '&'}, {"&lt;", 4, '<'}, {"&gt;", 4, '>'}, {"&quot;", 6, '"'}, {"&apos;", 6, '\''},
+                };
+                for (const auto& entity : kEntities) {
+                    if (raw.compare(i, entity.length, entity.entity) == 0) {
+                        c = entity.value;
+                        i += entity.length - 1;
+                        break;
+                    }
+                }
+            } else if (c >= 'A' && c <= 'Z') {
+                c = static_cast<char>(c - 'A' + 'a');
+            }
+            m_scratch += c;
+        }
+        // Trailing whitespace from pretty-printed exports
+        while (!m_scratch.empty() && (m_scratch.back() == ' ' || m_scratch.back() == '\r' || m_scratch.back() == '\n' ||
+                                      m_scratch.back() == '\t')) {
+            m_scratch.pop_back();
+        }
+        auto it = m_ids.find(std::string_view(m_scratch));
+        if (it != m_ids.end()) return it->second;
+        m_names.push_back(m_scratch);
+        const uint32_t id = static_cast<uint32_t>(m_names.size() - 1);
+        m_ids.emplace(std::string_view(m_names.back()), id);
+        return id;
+    }
+
+    std::deque<std::string> m_names;                            // stable addresses for the views in m_ids
+    std::unordered_map<std::string_view, uint32_t> m_ids;
+    std::unordered_map<Key, uint32_t, KeyHash> m_index;         // (source, dest, error) -> entry
+    std::vector<ReplicationErrorEntry> m_entries;
+    std::string m_scratch;
+    uint64_t m_events = 0;
+};
+
+struct EventFileStats {
+    size_t files = 0;
+    size_t unreadable = 0;
+    uint64_t bytes = 0;
+    uint64_t events = 0;                // <Event> elements scanned
+    uint64_t replicationEvents = 0;     // added to the table
+};
+
+// The given files, and every .xml file under the given directories
+// (recursively), sorted
+inline std::vector<std::filesystem::path> ListEventFiles(const std::vector<std::wstring>& paths) {
+    std::vector<std::filesystem::path> files;
+    for (const std::wstring& path : paths) {
+        std::error_code ec;
+        if (std::filesystem::is_directory(path, ec)) {
+            for (auto it = std::filesystem::recursive_directory_iterator(path, ec);
+                 !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+                if (it->is_regular_file(ec) && it->path().extension() == L".xml") files.push_back(it->path());
+            }
+        } else {
+            files.push_back(path);
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// Every event file of paths memory-mapped and scanned once, files spread
+// over workers, one table per file merged in input order. Events are
+// attributed to their <Computer>.
+inline ReplicationErrorTable AnalyzeEventFiles(const std::vector<std::wstring>& paths, unsigned workers,
+                                               EventFileStats& stats) {
+    const std::vector<std::filesystem::path> files = ListEventFiles(paths);
+    std::vector<ReplicationErrorTable> tables(files.size());
+    std::vector<EventFileStats> perFile(files.size());
+    ParallelFor(files.size(), workers, [&](size_t i) {
+        MappedFile file;
+        if (!file.Open(files[i].wstring(), false)) {
+            perFile[i].unreadable = 1;
+            return;
+        }
+        perFile[i].bytes = file.Size();
+        EventXmlScanner scanner(reinterpret_cast<const char*>(file.Data()), file.Size());
+        EventView event;
+        while (scanner.Next(event)) {
+            perFile[i].events++;
+            if (tables[i].Add(event.computer, event)) perFile[i].replicationEvents++;
+        }
+    });
+
+    ReplicationErrorTable merged;
+    stats = EventFileStats();
+    stats.files = files.size();
+    for (size_t i = 0; i < files.size(); i++) {
+        merged.Merge(tables[i]);
+        stats.unreadable += perFile[i].unreadable;
+        stats.bytes += perFile[i].bytes;
+        stats.events += perFile[i].events;
+        stats.replicationEvents += perFile[i].replicationEvents;
+    }
+    return merged;
+}
@@ -0,0 +1,265 @@
+// EventCollector.h
+// Collecte incrémentale et parallèle des événements de réplication par DC (signets par numéro d'enregistrement)
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "CancellationToken.h"
+#include "EventAnalysis.h"
+#include "EventParser.h"
+#include "ParallelFor.h"
+#include "ScanMetrics.h"
+#include "Utf8.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct EventRecord {
+    uint32_t eventId = 0;
+    uint64_t recordId = 0;
+    int64_t timeCreated = 0;            // Unix epoch, milliseconds
+    std::string_view xml;               // rendered <Event> (UTF-8) when asked for, valid during the callback
+};
+
+struct EventQuery {
+    std::wstring dc;                    // empty: local machine
+    std::wstring channel;
+    std::vector<uint32_t> eventIds;
+    uint64_t afterRecordId = 0;         // only records with a higher EventRecordID
+    int64_t lookbackMs = 0;             // 0: no time bound
+    bool renderXml = false;             // fill EventRecord::xml
+};
+
+struct EventQueryStatus {
+    int32_t error = 0;
+    uint64_t newestRecordId = 0;        // newest record in the channel, 0 if unknown
+};
+
+// Event sources return matching records oldest first. Implementations must
+// be callable concurrently for different DCs.
+class IEventSource {
+public:
+    virtual ~IEventSource() = default;
+    virtual bool Query(const EventQuery& query, const std::function<void(const EventRecord&)>& onRecord,
+                       EventQueryStatus& status) = 0;
+};
+
+struct EventCollectorOptions {
+    std::wstring channel = L"Directory Service";
+    std::vector<uint32_t> eventIds{1311, 1388, 1925, 1988, 2042, 2087, 2088};
+    unsigned workers = 16;
+    std::chrono::hours initialLookback{24};
+    bool analyzePayloads = true;        // render each event and count it per (source, destination, error)
+};
+
+struct DcEventCounts {
+    bool ok = false;
+    int32_t error = 0;
+    std::vector<uint64_t> totals;       // per configured event ID, since tracking started
+    std::vector<uint64_t> fresh;        // per configured event ID, read by this collection
+    ReplicationErrorTable errors;       // events read by this collection, this DC as destination
+
+    uint64_t Total() const {
+        uint64_t n = 0;
+        for (uint64_t v : totals) n += v;
+        return n;
+    }
+};
+
+// Keeps one bookmark per DC (last EventRecordID seen plus running totals) so
+// each collection only reads records newer than the previous one. A channel
+// that was cleared (record IDs going backwards) restarts from the lookback.
+class EventCollector {
+public:
+    EventCollector(std::shared_ptr<IEventSource> source, EventCollectorOptions options)
+        : m_source(std::move(source)), m_options(std::move(options)) {
+        if (m_options.workers == 0) m_options.workers = 1;
+    }
+
+    const EventCollectorOptions& Options() const { return m_options; }
+
+    // With metrics, queries are recorded under the DC's index in dcs.
+    // onResult runs under a lock, one DC at a time, as each one completes.
+    // Once cancel is set no further query starts; DCs not queried get no
+    // onResult and stay default (ok false) in the result.
+    std::vector<DcEventCounts> Collect(const std::vector<std::wstring>& dcs, ScanMetrics* metrics = nullptr,
+                                       const std::function<void(size_t, const DcEventCounts&)>& onResult = nullptr,
+                                       const CancellationToken* cancel = nullptr) {
+        std::vector<DcEventCounts> results(dcs.size());
+        std::mutex mutex;
+        ParallelFor(dcs.size(), m_options.workers, [&](size_t i) {
+            if (cancel && cancel->Cancelled()) return;
+            {
+                MetricsScope scope(metrics, static_cast<uint32_t>(i));
+                results[i] = CollectOne(dcs[i]);
+            }
+            if (onResult) {
+                std::lock_guard<std::mutex> lock(mutex);
+                onResult(i, results[i]);
+            }
+        });
+        return results;
+    }
+
+    DcEventCounts CollectOne(const std::wstring& dc) {
+        DcEventCounts counts;
+        const size_t ids = m_options.eventIds.size();
+        counts.fresh.assign(ids, 0);
+
+        Bookmark bookmark;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_bookmarks.find(dc);
+            if (it != m_bookmarks.end()) bookmark = it->second;
+        }
+        bookmark.totals.resize(ids, 0);
+
+        EventQuery query;
+        query.dc = dc;
+        query.channel = m_options.channel;
+        query.eventIds = m_options.eventIds;
+        query.renderXml = m_options.analyzePayloads;
+        const std::string dest = WideToUtf8(dc);
+
+        uint64_t lastRecordId = 0;
+        EventView view;
+        auto onRecord = [&](const EventRecord& rec) {
+            lastRecordId = std::max(lastRecordId, rec.recordId);
+            EventXmlScanner scanner(rec.xml);
+            if (!rec.xml.empty() && scanner.Next(view)) counts.errors.Add(dest.empty() ? view.computer : dest, view);
+            for (size_t k = 0; k < ids; k++) {
+                if (m_options.eventIds[k] == rec.eventId) {
+                    counts.fresh[k]++;
+                    break;
+                }
+            }
+        };
+
+        EventQueryStatus status;
+        for (int attempt = 0; attempt < 2; attempt++) {
+            query.afterRecordId = bookmark.lastRecordId;
+            query.lookbackMs = (bookmark.lastRecordId == 0)
+                ? std::chrono::duration_cast<std::chrono::milliseconds>(m_options.initialLookback).count() : 0;
+            lastRecordId = bookmark.lastRecordId;
+            std::fill(counts.fresh.begin(), counts.fresh.end(), 0);
+            counts.errors = ReplicationErrorTable();
+            status = EventQueryStatus();
+
+            counts.ok = m_source->Query(query, onRecord, status);
+            if (!counts.ok || status.newestRecordId == 0 || status.newestRecordId >= bookmark.lastRecordId) break;
+            bookmark.lastRecordId = 0;  // channel was cleared since the last collection
+        }
+
+        counts.error = status.error;
+        if (!counts.ok) {
+            counts.totals = bookmark.totals;
+            return counts;
+        }
+
+        for (size_t k = 0; k < ids; k++) bookmark.totals[k] += counts.fresh[k];
+        bookmark.lastRecordId = lastRecordId;
+        counts.totals = bookmark.totals;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bookmarks[dc] = std::move(bookmark);
+        return counts;
+    }
+
+    // Clears a DC's bookmark, e.g. after its channel was cleared or rebuilt
+    void ResetBookmark(const std::wstring& dc) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bookmarks.erase(dc);
+    }
+
+    // Text format, one DC per line: dc \t lastRecordId \t id=count ...
+    bool SaveBookmarks(const std::wstring& path) const {
+        std::ofstream out(std::filesystem::path(path), std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& kv : m_bookmarks) {
+            out << WideToUtf8(kv.first) << '\t' << kv.second.lastRecordId;
+            for (size_t k = 0; k < kv.second.totals.size() && k < m_options.eventIds.size(); k++) {
+                out << '\t' << m_options.eventIds[k] << '=' << kv.second.totals[k];
+            }
+            out << '\n';
+        }
+        return static_cast<bool>(out);
+    }
+
+    bool LoadBookmarks(const std::wstring& path) {
+        std::ifstream in(std::filesystem::path(path), std::ios::binary);
+        if (!in) return false;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bookmarks.clear();
+        std::string line;
+        while (std::getline(in, line)) {
+            size_t tab = line.find('\t');
+            if (tab == std::string::npos) continue;
+            Bookmark bookmark;
+            bookmark.totals.assign(m_options.eventIds.size(), 0);
+            size_t pos = tab + 1;
+            bookmark.lastRecordId = std::strtoull(line.c_str() + pos, nullptr, 10);
+            while ((pos = line.find('\t', pos)) != std::string::npos) {
+                pos++;
+                uint32_t id = static_cast<uint32_t>(std::strtoul(line.c_str() + pos, nullptr, 10));
+                size_t eq = line.find('=', pos);
+                if (eq == std::string::npos) break;
+                uint64_t total = std::strtoull(line.c_str() + eq + 1, nullptr, 10);
+                for (size_t k = 0; k < m_options.eventIds.size(); k++) {
+                    if (m_options.eventIds[k] == id) bookmark.totals[k] = total;
+                }
+            }
+            m_bookmarks[Utf8ToWide(line.substr(0, tab))] = std::move(bookmark);
+        }
+        return true;
+    }
+
+private:
+    struct Bookmark {
+        uint64_t lastRecordId = 0;
+        std::vector<uint64_t> totals;
+    };
+
+    std::shared_ptr<IEventSource> m_source;
+    EventCollectorOptions m_options;
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::wstring, Bookmark> m_bookmarks;
+};
+
+// Replication events in one channel (local machine when dc is empty) over
+// the lookback window, without bookmarks. With errors, each event is also
+// rendered and counted per (source, destination, error). Returns -1 if the
+// query failed.
+inline int64_t CountReplicationEvents(IEventSource& source, const EventCollectorOptions& options,
+                                      const std::wstring& dc = L"", ReplicationErrorTable* errors = nullptr) {
+    EventQuery query;
+    query.dc = dc;
+    query.channel = options.channel;
+    query.eventIds = options.eventIds;
+    query.lookbackMs = std::chrono::duration_cast<std::chrono::milliseconds>(options.initialLookback).count();
+    query.renderXml = errors != nullptr;
+    const std::string dest = WideToUtf8(dc);
+
+    int64_t count = 0;
+    EventView view;
+    EventQueryStatus status;
+    auto onRecord = [&](const EventRecord& rec) {
+        count++;
+        EventXmlScanner scanner(rec.xml);
+        if (errors && !rec.xml.empty() && scanner.Next(view)) errors->Add(dest.empty() ? view.computer : dest, view);
+    };
+    if (!source.Query(query, onRecord, status)) return -1;
+    return count;
+}
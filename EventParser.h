@@ -0,0 +1,277 @@
+// EventParser.h
+// Lecture sans copie ni allocation des événements XML (System et EventData) et champs propres à la réplication
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <string_view>
+
+// Parses "2024-05-01T12:34:56.1234567Z" into Unix milliseconds (UTC).
+inline int64_t ParseIsoTimestamp(const char* s, size_t len) {
+    auto num = [&](size_t pos, size_t n) -> int {
+        int v = 0;
+        for (size_t i = pos; i < pos + n && i < len; i++) {
+            if (s[i] < '0' || s[i] > '9') return -1;
+            v = v * 10 + (s[i] - '0');
+        }
+        return v;
+    };
+    if (len < 19) return 0;
+    int y = num(0, 4), mo = num(5, 2), d = num(8, 2), h = num(11, 2), mi = num(14, 2), sec = num(17, 2);
+    if (y < 1970 || mo < 1 || mo > 12 || d < 1 || h < 0 || mi < 0 || sec < 0) return 0;
+    int ms = 0;
+    if (len > 20 && s[19] == '.') {
+        int digits = 0;
+        for (size_t i = 20; i < len && s[i] >= '0' && s[i] <= '9'; i++, digits++) {
+            if (digits < 3) ms = ms * 10 + (s[i] - '0');
+        }
+        for (; digits < 3; digits++) ms *= 10;
+    }
+    // Days from civil (Howard Hinnant's algorithm)
+    y -= mo <= 2;
+    const int era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (mo + (mo > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    const int64_t days = static_cast<int64_t>(era) * 146097 + static_cast<int64_t>(doe) - 719468;
+    return ((days * 24 + h) * 60 + mi) * 60000 + sec * 1000 + ms;
+}
+
+// One <Event> element. Every view points into the scanned buffer and is
+// valid as long as the buffer is; text is raw, entities are not decoded.
+struct EventView {
+    static constexpr size_t kMaxData = 16;
+
+    uint32_t eventId = 0;
+    uint64_t recordId = 0;
+    int64_t timeCreated = 0;            // Unix epoch, milliseconds
+    std::string_view element;           // the whole <Event>...</Event>
+    std::string_view provider;
+    std::string_view channel;
+    std::string_view computer;
+    std::string_view data[kMaxData];    // <EventData><Data> in order; extra ones are dropped
+    std::string_view dataNames[kMaxData];   // Name attribute, empty for positional insertion strings
+    uint8_t dataCount = 0;
+
+    // Named <Data Name='...'> value, empty when absent
+    std::string_view Data(std::string_view name) const {
+        for (size_t i = 0; i < dataCount; i++) {
+            if (dataNames[i] == name) return data[i];
+        }
+        return std::string_view();
+    }
+};
+
+// Walks the <Event> elements of a buffer (an EvtRender XML string, a
+// wevtutil export, a concatenation of both) in one forward pass: each tag
+// is read once and only the elements EventView has a slot for are looked
+// at. Never allocates and never copies.
+class EventXmlScanner {
+public:
+    EventXmlScanner(const char* data, size_t size) : m_text(data, size) {}
+    explicit EventXmlScanner(std::string_view text) : m_text(text) {}
+
+    // Fills event with the next <Event>; false at the end of the buffer
+    bool Next(EventView& event) {
+        for (;;) {
+            size_t start = m_text.find("<Event", m_pos);
+            if (start == std::string_view::npos || start + 6 >= m_text.size()) {
+                m_pos = m_text.size();
+                return false;
+            }
+            const char after = m_text[start + 6];
+            if (after != '>' && after != ' ' && after != '\t' && after != '\r' && after != '\n') {
+                m_pos = start + 6;          // <Events>, <EventData>, <EventID>...
+                continue;
+            }
+            size_t end = m_text.find("</Event>", start);
+            if (end == std::string_view::npos) end = m_text.size();
+            m_pos = end + (end < m_text.size() ? 8 : 0);
+            event = EventView();
+            event.element = m_text.substr(start, m_pos - start);
+            ParseElement(m_text.substr(start, end - start), event);
+            return true;
+        }
+    }
+
+    // Bytes consumed so far
+    size_t Position() const { return m_pos; }
+
+private:
+    static bool Is(std::string_view name, const char* literal, size_t length) {
+        return name.size() == length && std::memcmp(name.data(), literal, length) == 0;
+    }
+
+    static uint64_t Number(std::string_view text) {
+        uint64_t v = 0;
+        for (char c : text) {
+            if (c < '0' || c > '9') break;
+            v = v * 10 + static_cast<uint64_t>(c - '0');
+        }
+        return v;
+    }
+
+    // Value of attr inside a start tag (between '<' and '>')
+    static std::string_view Attribute(std::string_view tag, const char* attr, size_t length) {
+        for (size_t p = tag.find(attr); p != std::string_view::npos; p = tag.find(attr, p + length)) {
+            if (p == 0 || (tag[p - 1] != ' ' && tag[p - 1] != '\t' && tag[p - 1] != '\n' && tag[p - 1] != '\r')) continue;
+            size_t q = p + length;
+            if (q + 1 >= tag.size() || tag[q] != '=') continue;
+            const char quote = tag[q + 1];
+            if (quote != '\'' && quote != '"') continue;
+            size_t close = tag.find(quote, q + 2);
+            if (close == std::string_view::npos) return std::string_view();
+            return tag.substr(q + 2, close - q - 2);
+        }
+        return std::string_view();
+    }
+
+    static void ParseElement(std::string_view xml, EventView& event) {
+        bool inEventData = false;
+        size_t pos = 0;
+        while ((pos = xml.find('<', pos)) != std::string_view::npos) {
+            size_t nameStart = pos + 1;
+            if (nameStart >= xml.size()) break;
+            if (xml[nameStart] == '/') {
+                if (xml.compare(nameStart + 1, 9, "EventData") == 0) inEventData = false;
+                pos = nameStart;
+                continue;
+            }
+            size_t gt = xml.find('>', nameStart);
+            if (gt == std::string_view::npos) break;
+            size_t nameEnd = nameStart;
+            while (nameEnd < gt && xml[nameEnd] != ' ' && xml[nameEnd] != '/' && xml[nameEnd] != '\t' &&
+                   xml[nameEnd] != '\r' && xml[nameEnd] != '\n') {
+                nameEnd++;
+            }
+            const std::string_view name = xml.substr(nameStart, nameEnd - nameStart);
+            const std::string_view tag = xml.substr(nameEnd, gt - nameEnd);
+            const bool empty = gt > nameStart && xml[gt - 1] == '/';
+
+            // Text up to the next tag, empty for <X/>
+            auto text = [&]() {
+                if (empty) return std::string_view();
+                size_t lt = xml.find('<', gt + 1);
+                if (lt == std::string_view::npos) lt = xml.size();
+                return xml.substr(gt + 1, lt - gt - 1);
+            };
+
+            switch (name.size()) {
+                case 4:
+                    if (inEventData && Is(name, "Data", 4) && event.dataCount < EventView::kMaxData) {
+                        event.dataNames[event.dataCount] = Attribute(tag, "Name", 4);
+                        event.data[event.dataCount++] = text();
+                    }
+                    break;
+                case 7:
+                    if (Is(name, "EventID", 7)) event.eventId = static_cast<uint32_t>(Number(text()));
+                    else if (Is(name, "Channel", 7)) event.channel = text();
+                    break;
+                case 8:
+                    if (Is(name, "Provider", 8)) event.provider = Attribute(tag, "Name", 4);
+                    else if (Is(name, "Computer", 8)) event.computer = text();
+                    break;
+                case 9:
+                    if (Is(name, "EventData", 9)) inEventData = !empty;
+                    break;
+                case 11:
+                    if (Is(name, "TimeCreated", 11)) {
+                        std::string_view time = Attribute(tag, "SystemTime", 10);
+                        event.timeCreated = ParseIsoTimestamp(time.data(), time.size());
+                    }
+                    break;
+                case 13:
+                    if (Is(name, "EventRecordID", 13)) event.recordId = Number(text());
+                    break;
+            }
+            pos = gt + 1;
+        }
+    }
+
+    std::string_view m_text;
+    size_t m_pos = 0;
+};
+
+// "8524", "0x2117" or "8524 The DSA operation is unable..." (the code
+// followed by its message); 0 when the text does not start with a number
+inline uint32_t ParseWin32Error(std::string_view text) {
+    size_t p = 0;
+    while (p < text.size() && (text[p] == ' ' || text[p] == '\t' || text[p] == '\r' || text[p] == '\n')) p++;
+    uint64_t v = 0;
+    if (p + 1 < text.size() && text[p] == '0' && (text[p + 1] == 'x' || text[p + 1] == 'X')) {
+        for (p += 2; p < text.size(); p++) {
+            const char c = text[p];
+            const int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                            : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+            if (digit < 0) break;
+            v = (v << 4) | static_cast<uint64_t>(digit);
+        }
+    } else {
+        for (; p < text.size() && text[p] >= '0' && text[p] <= '9'; p++) v = v * 10 + static_cast<uint64_t>(text[p] - '0');
+    }
+    return static_cast<uint32_t>(v);
+}
+
+// Where a replication event keeps its source DC, naming context and error
+// code: 1-based insertion string positions, 0 when the event has no such
+// field. Events logged with named <Data> elements are read by name instead.
+struct ReplicationEventLayout {
+    uint32_t eventId;
+    uint8_t source;
+    uint8_t namingContext;
+    uint8_t error;
+};
+
+inline const ReplicationEventLayout* FindReplicationLayout(uint32_t eventId) {
+    static const ReplicationEventLayout kLayouts[] = {
+        {1311, 0, 0, 0},                // KCC: no spanning tree for a partition
+        {1388, 1, 0, 0},                // lingering object replicated in (loose mode)
+        {1925, 2, 1, 6},                // replication link could not be established
+        {1988, 1, 0, 0},                // lingering object blocked (strict mode)
+        {2042, 3, 0, 0},                // too long since the last replication (tombstone lifetime)
+        {2087, 1, 0, 5},                // DNS lookup of the source DC failed
+        {2088, 1, 0, 5},                // DNS lookup failed, NetBIOS fallback worked
+    };
+    for (const auto& layout : kLayouts) {
+        if (layout.eventId == eventId) return &layout;
+    }
+    return nullptr;
+}
+
+struct ReplicationFields {
+    std::string_view source;            // source DC as logged: DNS name, DSA GUID address or NTDS Settings DN
+    std::string_view namingContext;
+    uint32_t error = 0;                 // Win32 status, 0 when the event carries none
+};
+
+// Replication fields of an event, from its named data when there is any,
+// from the layout table otherwise
+inline ReplicationFields ExtractReplicationFields(const EventView& event) {
+    ReplicationFields fields;
+    auto firstNamed = [&](std::initializer_list<const char*> names) {
+        for (const char* n : names) {
+            std::string_view v = event.Data(n);
+            if (!v.empty()) return v;
+        }
+        return std::string_view();
+    };
+    if (event.dataCount > 0 && !event.dataNames[0].empty()) {
+        fields.source = firstNamed({"SourceDC", "SourceDsa", "Source", "SourceServer"});
+        fields.namingContext = firstNamed({"NamingContext", "Partition", "DirectoryPartition"});
+        fields.error = ParseWin32Error(firstNamed({"ErrorCode", "Error", "Status", "StatusCode"}));
+        return fields;
+    }
+    const ReplicationEventLayout* layout = FindReplicationLayout(event.eventId);
+    if (!layout) return fields;
+    auto at = [&](uint8_t position) {
+        return position > 0 && position <= event.dataCount ? event.data[position - 1] : std::string_view();
+    };
+    fields.source = at(layout->source);
+    fields.namingContext = at(layout->namingContext);
+    fields.error = ParseWin32Error(at(layout->error));
+    return fields;
+}
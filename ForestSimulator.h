@@ -0,0 +1,225 @@
+// ForestSimulator.h
+// Générateur déterministe de forêts AD synthétiques (sites, DCs, connexions, NCs, RTT, pannes, croissance USN)
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "DirectoryBackend.h"
+#include "SimulatedDirectoryBackend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+struct ForestSpec {
+    uint64_t seed = 1;
+    unsigned sites = 10;
+    unsigned dcs = 100;                         // spread evenly over the sites
+    unsigned dcsPerDomain = 100;                // one domain NC per block of sites holding about this many DCs
+    unsigned intraSiteConnections = 2;          // inbound connections per DC from the next DCs of its site
+    unsigned interSiteConnections = 1;          // inbound connections per bridgehead from the next sites
+    std::chrono::minutes siteLinkInterval{180}; // replInterval of the site links behind them
+    std::chrono::milliseconds localRtt{1};      // rootDSE round trip to DCs in the first site
+    std::chrono::milliseconds remoteRtt{5};     // ... and to DCs in every other site
+    unsigned bindRoundTrips = 3;                // a bind (LDAP or DRS) costs this many round trips
+    bool pooled = true;                         // sessions kept in a ConnectionPool across reads and scans
+    double rttJitter = 0.25;                    // +/- fraction of the RTT, per DC
+    double failureRate = 0.0;                   // per read
+    double hangRate = 0.0;                      // share of DCs that never answer
+    double linkFailureRate = 0.0;               // share of inbound links that are failing
+    std::chrono::seconds replicationLag{300};   // intra-site staleness, multiplied by site distance
+    uint64_t baseUsn = 10000000;                // newest USN in the forest
+    uint64_t usnGrowthPerHour = 20000;          // forest-wide change rate, sets the USN spread
+};
+
+// Builds the directory objects DiscoverTopology reads (sites, servers, NTDS
+// Settings, connections, site links) plus per-DC behaviour, all from the spec and its
+// seed: the same spec always yields the same forest. Each DC hosts only
+// its domain NC, so up-to-dateness vectors grow with the domain size and
+// not with the forest size.
+class ForestSimulator {
+public:
+    explicit ForestSimulator(const ForestSpec& spec)
+        : m_spec(spec), m_backend(std::make_shared<SimulatedDirectoryBackend>(spec.seed)) {
+        Generate();
+        if (spec.pooled) m_backend->EnablePool();
+    }
+
+    std::shared_ptr<SimulatedDirectoryBackend> Backend() const { return m_backend; }
+    const ForestSpec& Spec() const { return m_spec; }
+    const std::wstring& ConfigurationDn() const { return m_configDn; }
+    size_t Connections() const { return m_connections; }
+    size_t Domains() const { return m_domains; }
+
+private:
+    struct Dc {
+        std::wstring name;
+        std::wstring host;
+        std::wstring serverDn;
+        std::wstring ntdsDn;
+        unsigned site = 0;
+        unsigned domain = 0;
+        std::vector<size_t> sources;            // inbound connection sources
+    };
+
+    void Generate() {
+        const ForestSpec& s = m_spec;
+        const unsigned siteCount = std::max(1u, s.sites);
+        const std::wstring forestDn = L"DC=sim,DC=example";
+        m_configDn = L"CN=Configuration," + forestDn;
+        const std::wstring sitesDn = L"CN=Sites," + m_configDn;
+        m_backend->SetRootDse(m_configDn, forestDn);
+
+        // Domains take contiguous blocks of sites, so neighbouring sites
+        // usually share a domain NC
+        m_domains = std::max<size_t>(1, (s.dcs + std::max(1u, s.dcsPerDomain) - 1) / std::max(1u, s.dcsPerDomain));
+        m_domains = std::min<size_t>(m_domains, siteCount);
+
+        std::vector<std::vector<size_t>> bySite(siteCount);
+        std::vector<std::wstring> siteDns(siteCount);
+        std::vector<Dc> dcs(s.dcs);
+        for (unsigned i = 0; i < s.dcs; i++) {
+            Dc& dc = dcs[i];
+            dc.site = static_cast<unsigned>(static_cast<uint64_t>(i) * siteCount / std::max(1u, s.dcs));
+            dc.domain = static_cast<unsigned>(static_cast<uint64_t>(dc.site) * m_domains / siteCount);
+            dc.name = L"DC" + Pad(i, 5);
+            dc.host = dc.name + L"." + DomainDns(dc.domain);
+            bySite[dc.site].push_back(i);
+        }
+
+        for (unsigned site = 0; site < siteCount; site++) {
+            std::wstring name = L"Site" + Pad(site, 4);
+            std::wstring siteDn = L"CN=" + name + L"," + sitesDn;
+            siteDns[site] = siteDn;
+            m_backend->AddEntry(Entry(siteDn, {{L"objectClass", {L"top", L"site"}}, {L"name", {name}}}));
+            for (size_t index : bySite[site]) {
+                Dc& dc = dcs[index];
+                dc.serverDn = L"CN=" + dc.name + L",CN=Servers," + siteDn;
+                dc.ntdsDn = L"CN=NTDS Settings," + dc.serverDn;
+            }
+        }
+
+        // Intra-site ring, then a ring of bridgeheads (first DC of each site)
+        for (unsigned site = 0; site < siteCount; site++) {
+            const std::vector<size_t>& members = bySite[site];
+            unsigned links = std::min<unsigned>(s.intraSiteConnections, static_cast<unsigned>(members.size() ? members.size() - 1 : 0));
+            for (size_t k = 0; k < members.size(); k++) {
+                for (unsigned l = 1; l <= links; l++) {
+                    dcs[members[k]].sources.push_back(members[(k + l) % members.size()]);
+                }
+            }
+        }
+        std::vector<size_t> bridgeheads;
+        for (const auto& members : bySite) {
+            if (!members.empty()) bridgeheads.push_back(members.front());
+        }
+        unsigned remoteLinks = std::min<unsigned>(s.interSiteConnections, static_cast<unsigned>(bridgeheads.size() ? bridgeheads.size() - 1 : 0));
+        const std::wstring ipDn = L"CN=IP,CN=Inter-Site Transports," + sitesDn;
+        const std::wstring interval = std::to_wstring(s.siteLinkInterval.count());
+        std::unordered_set<uint64_t> linkedSites;
+        for (size_t k = 0; k < bridgeheads.size(); k++) {
+            for (unsigned l = 1; l <= remoteLinks; l++) {
+                size_t source = bridgeheads[(k + l) % bridgeheads.size()];
+                dcs[bridgeheads[k]].sources.push_back(source);
+
+                // One site link per pair of sites with a connection between them
+                uint64_t a = std::min(dcs[bridgeheads[k]].site, dcs[source].site);
+                uint64_t b = std::max(dcs[bridgeheads[k]].site, dcs[source].site);
+                if (!linkedSites.insert((a << 32) | b).second) continue;
+                std::wstring name = L"Link" + Pad(a, 4) + L"-" + Pad(b, 4);
+                m_backend->AddEntry(Entry(L"CN=" + name + L"," + ipDn,
+                                          {{L"objectClass", {L"top", L"siteLink"}}, {L"name", {name}},
+                                           {L"siteList", {siteDns[a], siteDns[b]}},
+                                           {L"cost", {L"100"}}, {L"replInterval", {interval}}}));
+            }
+        }
+
+        for (size_t i = 0; i < dcs.size(); i++) {
+            const Dc& dc = dcs[i];
+            uint64_t h = Mix(s.seed ^ (i * 0x9E3779B97F4A7C15ull));
+            std::wstring domainNc = DomainDn(dc.domain);
+
+            m_backend->AddEntry(Entry(dc.serverDn, {{L"objectClass", {L"top", L"server"}}, {L"name", {dc.name}},
+                                                   {L"dNSHostName", {dc.host}}}));
+            m_backend->AddEntry(Entry(dc.ntdsDn, {{L"objectClass", {L"applicationSettings", L"nTDSDSA"}},
+                                                 {L"invocationId", {Hex(h) + Hex(Mix(h))}},
+                                                 {L"hasMasterNCs", {domainNc}}}));
+
+            SimulatedDc sim;
+            sim.name = dc.host;
+            sim.ntdsDsaDn = dc.ntdsDn;
+            sim.namingContexts = {domainNc};
+            for (size_t k = 0; k < dc.sources.size(); k++) {
+                const Dc& source = dcs[dc.sources[k]];
+                m_backend->AddEntry(Entry(L"CN=" + Hex(Mix(h + k + 1)) + L"," + dc.ntdsDn,
+                                          {{L"objectClass", {L"nTDSConnection"}}, {L"fromServer", {source.ntdsDn}},
+                                           {L"enabledConnection", {L"TRUE"}}, {L"options", {L"1"}}}));
+                sim.inboundPartners.push_back(source.host);
+                m_connections++;
+            }
+
+            std::chrono::milliseconds rtt = dc.site == 0 ? s.localRtt : s.remoteRtt;
+            double jitter = (Unit(Mix(h ^ 1)) * 2.0 - 1.0) * s.rttJitter;
+            sim.latency = std::chrono::milliseconds(static_cast<int64_t>(rtt.count() * (1.0 + jitter) + 0.5));
+            sim.bindLatency = sim.latency * s.bindRoundTrips;
+            sim.failureRate = s.failureRate;
+            sim.hang = Unit(Mix(h ^ 2)) < s.hangRate;
+            sim.partnerFailureRate = s.linkFailureRate;
+
+            // Sites further along the ring see changes later; the USN gap
+            // to the newest DC follows from the lag and the change rate
+            unsigned distance = std::min(dc.site, siteCount - dc.site);
+            int64_t lagSec = s.replicationLag.count() * (1 + distance % 8);
+            lagSec = static_cast<int64_t>(lagSec * (0.5 + Unit(Mix(h ^ 3))));
+            sim.replicationLag = std::chrono::seconds(lagSec);
+            uint64_t behind = s.usnGrowthPerHour * static_cast<uint64_t>(lagSec) / 3600;
+            sim.highestCommittedUSN = s.baseUsn - std::min(s.baseUsn, behind);
+            m_backend->AddDc(sim);
+        }
+    }
+
+    static DirectoryEntry Entry(const std::wstring& dn, std::vector<DirectoryAttribute> attributes) {
+        DirectoryEntry e;
+        e.dn = dn;
+        e.attributes = std::move(attributes);
+        return e;
+    }
+
+    static std::wstring DomainDns(size_t domain) {
+        return domain == 0 ? L"sim.example" : L"d" + std::to_wstring(domain) + L".sim.example";
+    }
+
+    static std::wstring DomainDn(size_t domain) {
+        return domain == 0 ? L"DC=sim,DC=example" : L"DC=d" + std::to_wstring(domain) + L",DC=sim,DC=example";
+    }
+
+    static std::wstring Pad(uint64_t n, size_t width) {
+        std::wstring s = std::to_wstring(n);
+        return s.size() < width ? std::wstring(width - s.size(), L'0') + s : s;
+    }
+
+    static std::wstring Hex(uint64_t v) {
+        static const wchar_t digits[] = L"0123456789abcdef";
+        std::wstring out(16, L'0');
+        for (int i = 15; i >= 0; i--, v >>= 4) out[i] = digits[v & 0xF];
+        return out;
+    }
+
+    static uint64_t Mix(uint64_t x) {
+        x ^= x >> 30; x *= 0xBF58476D1CE4E5B9ull;
+        x ^= x >> 27; x *= 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    static double Unit(uint64_t h) { return static_cast<double>(h >> 11) * (1.0 / 9007199254740992.0); }
+
+    ForestSpec m_spec;
+    std::shared_ptr<SimulatedDirectoryBackend> m_backend;
+    std::wstring m_configDn;
+    size_t m_connections = 0;
+    size_t m_domains = 1;
+};
@@ -0,0 +1,82 @@
+// HealthCheck.h
+// Évaluation de l'état de santé d'un scan (synthèse et code de sortie du collecteur sans interface)
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "ReplicationModel.h"
+#include "ScanSnapshot.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Values double as the headless collector's exit codes
+enum class HealthStatus : uint8_t {
+    Healthy = 0,
+    Degraded = 1,
+    Critical = 2,
+    Unknown = 3                         // no scan, nothing reachable, or the collector failed
+};
+
+inline const char* HealthStatusName(HealthStatus status) {
+    switch (status) {
+        case HealthStatus::Healthy:  return "healthy";
+        case HealthStatus::Degraded: return "degraded";
+        case HealthStatus::Critical: return "critical";
+        default:                     return "unknown";
+    }
+}
+
+struct HealthReport {
+    HealthStatus status = HealthStatus::Unknown;
+    size_t dcs = 0;
+    size_t reachable = 0;
+    size_t timedOut = 0;
+    size_t unreachable = 0;             // includes timed out DCs
+    size_t failingLinks = 0;            // inbound links with consecutive failures, all DCs
+    size_t eventErrors = 0;             // replication events over the collection window
+    size_t eventsUnavailable = 0;
+    size_t lag[5] = {};                 // DCs per LagClass
+    UsnSpread spread;
+    LagClass usnLag = LagClass::Unknown; // highest vs lowest USN of the scan
+};
+
+// Adds one DC to the report's counts (status is left to FinishHealth)
+inline void AddToHealth(HealthReport& h, const DcRecord& r) {
+    h.dcs++;
+    if (r.HasUsn()) {
+        h.reachable++;
+    } else {
+        h.unreachable++;
+        if (r.status == ProbeStatus::Timeout) h.timedOut++;
+    }
+    h.failingLinks += r.failingPartners;
+    h.eventErrors += r.errorTotal;
+    if (r.events == EventState::Unavailable) h.eventsUnavailable++;
+    h.lag[static_cast<size_t>(r.lag)]++;
+}
+
+// Critical: a DC did not answer or one lags severely. Degraded: moderate
+// lag, failing inbound links or replication errors in the event logs.
+// Unknown when no DC answered at all.
+inline void FinishHealth(HealthReport& h, const UsnThresholds& thresholds = UsnThresholds()) {
+    if (h.spread.count > 1) h.usnLag = ClassifyUsnDiff(h.spread.Diff(), thresholds);
+    if (h.reachable == 0) {
+        h.status = HealthStatus::Unknown;
+    } else if (h.unreachable > 0 || h.lag[static_cast<size_t>(LagClass::Severe)] > 0) {
+        h.status = HealthStatus::Critical;
+    } else if (h.lag[static_cast<size_t>(LagClass::Moderate)] > 0 || h.failingLinks > 0 || h.eventErrors > 0) {
+        h.status = HealthStatus::Degraded;
+    } else {
+        h.status = HealthStatus::Healthy;
+    }
+}
+
+inline HealthReport EvaluateHealth(const ScanSnapshot& snapshot, const UsnThresholds& thresholds = UsnThresholds()) {
+    HealthReport h;
+    const ReplicationModel& model = snapshot.model;
+    h.spread = snapshot.spread.count ? snapshot.spread : ComputeUsnSpread(model);
+    for (const DcRecord& r : model.records) AddToHealth(h, r);
+    FinishHealth(h, thresholds);
+    return h;
+}
@@ -0,0 +1,72 @@
+// HistoryRecorder.h
+// Enregistrement de chaque scan terminé dans l'historique (échantillons par DC et par lien entrant)
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "ScanSnapshot.h"
+#include "TimeSeriesStore.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+inline std::wstring DcSeriesName(const std::wstring& dc) {
+    return L"dc:" + dc;
+}
+
+inline std::wstring LinkSeriesName(const std::wstring& dest, const std::wstring& source, const std::wstring& nc) {
+    return L"link:" + dest + L"|" + source + L"|" + nc;
+}
+
+// Appends one sample per reachable DC (USN, worst latency, event errors)
+// and one per inbound link (USN watermark, age of the last success,
+// consecutive failures). Every sample of a scan carries the scan's
+// completion time, which keeps appends in time order. After a partial poll
+// only the re-polled DCs are recorded.
+class HistoryRecorder : public IScanSubscriber {
+public:
+    explicit HistoryRecorder(std::shared_ptr<TimeSeriesStore> store) : m_store(std::move(store)) {}
+
+    void OnScanCompleted(const SnapshotPtr& snapshot) override {
+        Record(*snapshot);
+        m_store->Flush();
+    }
+
+    size_t Record(const ScanSnapshot& snapshot) {
+        const ReplicationModel& model = snapshot.model;
+        const int64_t time = snapshot.completedAt ? snapshot.completedAt : UnixNowMs();
+        size_t samples = 0;
+
+        for (DcId id = 0; id < model.Size(); id++) {
+            const DcRecord& r = model.records[id];
+            if (!r.HasUsn()) continue;
+            if (!snapshot.polled.empty() && !std::binary_search(snapshot.polled.begin(), snapshot.polled.end(), id)) continue;
+
+            TimeSample sample;
+            sample.time = time;
+            sample.usn = r.usn;
+            sample.lagSec = r.HasLatency() ? r.latencySec : 0;
+            sample.errors = static_cast<uint16_t>(std::min<uint32_t>(r.errorTotal, 0x7FFF));
+            if (m_store->Append(m_store->SeriesId(DcSeriesName(model.DcName(id))), sample)) samples++;
+
+            const DestinationRow* row = snapshot.latency.Row(id);
+            if (!row) continue;
+            for (const auto& n : row->neighbors) {
+                TimeSample link;
+                link.time = time;
+                link.usn = n.usnSynced;
+                link.lagSec = n.lastSuccess > 0
+                    ? static_cast<uint32_t>(std::max<int64_t>(0, row->observedAt - n.lastSuccess) / 1000) : 0;
+                link.errors = n.consecutiveFailures;
+                std::wstring name = LinkSeriesName(model.DcName(id), model.DcName(n.source), snapshot.latency.NcName(n.nc));
+                if (m_store->Append(m_store->SeriesId(name), link)) samples++;
+            }
+        }
+        return samples;
+    }
+
+private:
+    std::shared_ptr<TimeSeriesStore> m_store;
+};
@@ -0,0 +1,306 @@
+// LatencyMatrix.h
+// Matrice de latence DC x DC x NC construite à partir des voisins entrants et des vecteurs de mise à jour
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "CancellationToken.h"
+#include "DirectoryBackend.h"
+#include "ParallelFor.h"
+#include "ReplicationModel.h"
+#include "ScanMetrics.h"
+#include "TopologyDiscovery.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cwctype>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef uint16_t NcId;
+
+const NcId kInvalidNc = 0xFFFF;
+
+// Inbound partner link of a destination DC for one NC (40 bytes)
+struct NeighborCell {
+    int64_t lastSuccess = 0;
+    int64_t lastAttempt = 0;
+    uint64_t usnSynced = 0;
+    DcId source = kInvalidId;
+    uint32_t lastResult = 0;
+    uint16_t consecutiveFailures = 0;   // saturates at 0xFFFF
+    NcId nc = kInvalidNc;
+
+    bool Failing() const { return consecutiveFailures > 0; }
+};
+
+// Up-to-dateness of a destination DC against one originating DC (24 bytes)
+struct CursorCell {
+    uint64_t usn = 0;
+    int64_t lastSyncSuccess = 0;
+    DcId source = kInvalidId;
+    NcId nc = kInvalidNc;
+};
+
+// Everything read from one destination DC in one poll. Both arrays are
+// sorted by (nc, source) and never modified once the row is built.
+struct DestinationRow {
+    int64_t observedAt = 0;
+    std::vector<NeighborCell> neighbors;
+    std::vector<CursorCell> cursors;
+    uint32_t unresolved = 0;            // entries whose DC or NC is not in the topology
+};
+
+struct ReplicationSummary {
+    uint16_t partners = 0;              // distinct inbound source DCs
+    uint16_t failingPartners = 0;       // sources failing for at least one NC
+    int64_t lastSuccess = 0;            // newest successful inbound sync
+    int64_t worstLatencyMs = -1;        // oldest UTD cursor, -1 if unknown
+    DcId worstSource = kInvalidId;
+    NcId worstNc = kInvalidNc;
+};
+
+// Case-insensitive hashing for DN keys, without building lowercase copies
+struct DnHash {
+    size_t operator()(const std::wstring& s) const {
+        uint64_t h = 1469598103934665603ull;
+        for (wchar_t c : s) { h ^= static_cast<uint64_t>(Fold(c)); h *= 1099511628211ull; }
+        return static_cast<size_t>(h);
+    }
+    static wchar_t Fold(wchar_t c) {
+        if (c < 0x80) return (c >= L'A' && c <= L'Z') ? static_cast<wchar_t>(c + 32) : c;
+        return static_cast<wchar_t>(towlower(c));
+    }
+};
+
+struct DnEqual {
+    bool operator()(const std::wstring& a, const std::wstring& b) const {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); i++) {
+            if (a[i] != b[i] && DnHash::Fold(a[i]) != DnHash::Fold(b[i])) return false;
+        }
+        return true;
+    }
+};
+
+// Resolves the DSA names found in replica metadata to the scan's DcIds.
+// Cursors of deleted DCs carry no DN, so invocation IDs are indexed too.
+class DsaIndex {
+public:
+    void Add(DcId id, const ServerInfo& server) {
+        if (!server.ntdsDsaDn.empty()) m_byDsa[server.ntdsDsaDn] = id;
+        if (!server.invocationId.empty()) m_byInvocation[server.invocationId] = id;
+    }
+
+    DcId Resolve(const std::wstring& dsaDn, const std::wstring& invocationId = std::wstring()) const {
+        if (!dsaDn.empty()) {
+            auto it = m_byDsa.find(dsaDn);
+            if (it != m_byDsa.end()) return it->second;
+        }
+        if (!invocationId.empty()) {
+            auto it = m_byInvocation.find(invocationId);
+            if (it != m_byInvocation.end()) return it->second;
+        }
+        return kInvalidId;
+    }
+
+private:
+    std::unordered_map<std::wstring, DcId, DnHash, DnEqual> m_byDsa;
+    std::unordered_map<std::wstring, DcId, DnHash, DnEqual> m_byInvocation;
+};
+
+// DC x DC x NC matrix stored as one immutable row per destination DC.
+// Re-polling a DC swaps its row only; copies (snapshots) share the rows,
+// so copying the matrix costs one pointer per DC, not one cell per pair.
+class LatencyMatrix {
+public:
+    typedef std::shared_ptr<const DestinationRow> RowPtr;
+
+    void Resize(size_t dcCount) { m_rows.resize(dcCount); }
+    size_t Size() const { return m_rows.size(); }
+
+    NcId InternNc(const std::wstring& nc) {
+        if (m_ncs.Find(DnKey(nc)) == kInvalidId && m_ncs.Size() >= kInvalidNc) return kInvalidNc;
+        return static_cast<NcId>(m_ncs.Intern(DnKey(nc)));
+    }
+
+    NcId FindNc(const std::wstring& nc) const {
+        uint32_t id = m_ncs.Find(DnKey(nc));
+        return id == kInvalidId ? kInvalidNc : static_cast<NcId>(id);
+    }
+
+    const std::wstring& NcName(NcId nc) const { return m_ncs.Name(nc); }
+    size_t NcCount() const { return m_ncs.Size(); }
+
+    void Update(DcId dest, RowPtr row) {
+        if (dest >= m_rows.size()) m_rows.resize(static_cast<size_t>(dest) + 1);
+        m_rows[dest] = std::move(row);
+    }
+
+    const DestinationRow* Row(DcId dest) const {
+        return dest < m_rows.size() ? m_rows[dest].get() : nullptr;
+    }
+
+    const NeighborCell* FindNeighbor(DcId dest, DcId source, NcId nc) const {
+        const DestinationRow* row = Row(dest);
+        return row ? FindCell(row->neighbors, source, nc) : nullptr;
+    }
+
+    const CursorCell* FindCursor(DcId dest, DcId source, NcId nc) const {
+        const DestinationRow* row = Row(dest);
+        return row ? FindCell(row->cursors, source, nc) : nullptr;
+    }
+
+    // How far dest lagged behind changes originated by source when dest was
+    // polled, in ms; -1 if dest does not track source for that NC
+    int64_t LatencyMs(DcId dest, DcId source, NcId nc) const {
+        const CursorCell* cell = FindCursor(dest, source, nc);
+        if (!cell || cell->lastSyncSuccess <= 0) return -1;
+        return std::max<int64_t>(0, Row(dest)->observedAt - cell->lastSyncSuccess);
+    }
+
+    ReplicationSummary Summarize(DcId dest) const {
+        ReplicationSummary summary;
+        const DestinationRow* row = Row(dest);
+        if (!row) return summary;
+
+        std::vector<DcId> sources, failing;
+        for (const auto& n : row->neighbors) {
+            sources.push_back(n.source);
+            if (n.Failing()) failing.push_back(n.source);
+            summary.lastSuccess = std::max(summary.lastSuccess, n.lastSuccess);
+        }
+        summary.partners = static_cast<uint16_t>(std::min<size_t>(0xFFFF, CountDistinct(sources)));
+        summary.failingPartners = static_cast<uint16_t>(std::min<size_t>(0xFFFF, CountDistinct(failing)));
+
+        for (const auto& c : row->cursors) {
+            if (c.source == dest || c.lastSyncSuccess <= 0) continue;
+            int64_t latency = std::max<int64_t>(0, row->observedAt - c.lastSyncSuccess);
+            if (latency > summary.worstLatencyMs) {
+                summary.worstLatencyMs = latency;
+                summary.worstSource = c.source;
+                summary.worstNc = c.nc;
+            }
+        }
+        return summary;
+    }
+
+    size_t CellCount() const {
+        size_t n = 0;
+        for (const auto& row : m_rows) {
+            if (row) n += row->neighbors.size() + row->cursors.size();
+        }
+        return n;
+    }
+
+private:
+    template <typename Cell>
+    static const Cell* FindCell(const std::vector<Cell>& cells, DcId source, NcId nc) {
+        auto it = std::lower_bound(cells.begin(), cells.end(), std::make_pair(nc, source),
+                                   [](const Cell& c, const std::pair<NcId, DcId>& key) {
+                                       return c.nc != key.first ? c.nc < key.first : c.source < key.second;
+                                   });
+        return (it != cells.end() && it->nc == nc && it->source == source) ? &*it : nullptr;
+    }
+
+    static size_t CountDistinct(std::vector<DcId>& ids) {
+        std::sort(ids.begin(), ids.end());
+        return static_cast<size_t>(std::unique(ids.begin(), ids.end()) - ids.begin());
+    }
+
+    std::vector<RowPtr> m_rows;
+    StringInterner m_ncs;               // keyed by lowercase DN
+};
+
+// Converts one DC's raw replica state into a matrix row. NCs must already
+// be interned in the matrix: this only reads it, so it is safe to call from
+// several collection workers at once.
+inline LatencyMatrix::RowPtr BuildDestinationRow(const ReplicaState& state, const DsaIndex& dsas,
+                                                 const LatencyMatrix& matrix, int64_t observedAt) {
+    auto row = std::make_shared<DestinationRow>();
+    row->observedAt = observedAt;
+
+    // Entries come grouped by NC, so remember the last lookup
+    const std::wstring* lastNc = nullptr;
+    NcId lastNcId = kInvalidNc;
+    auto findNc = [&](const std::wstring& nc) {
+        if (!lastNc || *lastNc != nc) {
+            lastNc = &nc;
+            lastNcId = matrix.FindNc(nc);
+        }
+        return lastNcId;
+    };
+
+    row->neighbors.reserve(state.neighbors.size());
+    for (const auto& n : state.neighbors) {
+        NeighborCell cell;
+        cell.source = dsas.Resolve(n.sourceDsaDn);
+        cell.nc = findNc(n.namingContext);
+        if (cell.source == kInvalidId || cell.nc == kInvalidNc) {
+            row->unresolved++;
+            continue;
+        }
+        cell.lastSuccess = n.lastSuccess;
+        cell.lastAttempt = n.lastAttempt;
+        cell.usnSynced = n.usnLastObjChangeSynced;
+        cell.lastResult = n.lastResult;
+        cell.consecutiveFailures = static_cast<uint16_t>(std::min<uint32_t>(0xFFFF, n.consecutiveFailures));
+        row->neighbors.push_back(cell);
+    }
+
+    row->cursors.reserve(state.cursors.size());
+    for (const auto& c : state.cursors) {
+        CursorCell cell;
+        cell.source = dsas.Resolve(c.sourceDsaDn, c.invocationId);
+        cell.nc = findNc(c.namingContext);
+        if (cell.source == kInvalidId || cell.nc == kInvalidNc) {
+            row->unresolved++;
+            continue;
+        }
+        cell.usn = c.usnHighPropUpdate;
+        cell.lastSyncSuccess = c.lastSyncSuccess;
+        row->cursors.push_back(cell);
+    }
+
+    auto byKey = [](const auto& a, const auto& b) { return a.nc != b.nc ? a.nc < b.nc : a.source < b.source; };
+    std::sort(row->neighbors.begin(), row->neighbors.end(), byKey);
+    std::sort(row->cursors.begin(), row->cursors.end(), byKey);
+    return row;
+}
+
+struct ReplicaTarget {
+    DcId id = kInvalidId;
+    std::wstring host;
+    std::vector<std::wstring> namingContexts;
+};
+
+// Polls each target's replica state in parallel and swaps its row into the
+// matrix. onRow runs under the collector lock, one destination at a time.
+// With metrics, each read is recorded under the target's DcId. Once cancel
+// is set no further read starts, reads in flight complete (one per worker)
+// and targets not read get no onRow.
+inline void CollectReplicaStates(IDirectoryBackend& backend, const std::vector<ReplicaTarget>& targets,
+                                 const DsaIndex& dsas, LatencyMatrix& matrix, unsigned workers,
+                                 const std::function<void(DcId, bool)>& onRow, ScanMetrics* metrics = nullptr,
+                                 const CancellationToken* cancel = nullptr) {
+    std::mutex mutex;
+    ParallelFor(targets.size(), workers, [&](size_t i) {
+        if (cancel && cancel->Cancelled()) return;
+        const ReplicaTarget& target = targets[i];
+        ReplicaState state;
+        bool ok;
+        {
+            MetricsScope scope(metrics, target.id);
+            ok = backend.ReadReplicaState(target.host, target.namingContexts, state);
+        }
+        LatencyMatrix::RowPtr row = ok ? BuildDestinationRow(state, dsas, matrix, UnixNowMs()) : nullptr;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (row) matrix.Update(target.id, std::move(row));
+        if (onRow) onRow(target.id, ok);
+    });
+}
@@ -0,0 +1,295 @@
+// LdifDirectoryBackend.h
+// Backend de test rejouant un export LDIF enregistré d'une forêt (découverte hors ligne)
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "DirectoryBackend.h"
+#include "DistinguishedName.h"
+#include "ScanMetrics.h"
+#include "TopologyDiscovery.h"
+#include "Utf8.h"
+
+#include <atomic>
+#include <cwctype>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Serves rootDSE reads and subtree searches from an in-memory LDIF image.
+// The entry with an empty DN ("dn:") acts as the rootDSE; a DC answers a
+// rootDSE read if a server object with that name or dNSHostName exists, and
+// reports the optional highestCommittedUSN attribute recorded on it.
+// Filters support &, |, !, equality, presence and trailing-* prefixes.
+class LdifDirectoryBackend : public IDirectoryBackend {
+public:
+    bool LoadFile(const std::wstring& path) {
+        std::ifstream in(std::filesystem::path(path), std::ios::binary);
+        if (!in) return false;
+        std::stringstream buffer;
+        buffer << in.rdbuf();
+        return LoadText(buffer.str());
+    }
+
+    bool LoadText(const std::string& text) {
+        m_entries.clear();
+        m_rootDse = DirectoryEntry();
+
+        std::vector<std::string> lines;
+        std::string current;
+        size_t pos = 0;
+        while (pos <= text.size()) {
+            size_t eol = text.find('\n', pos);
+            if (eol == std::string::npos) eol = text.size();
+            std::string line = text.substr(pos, eol - pos);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            pos = eol + 1;
+
+            // RFC 2849 folding: a leading space continues the previous line
+            if (!line.empty() && line[0] == ' ' && !lines.empty()) {
+                lines.back() += line.substr(1);
+            } else {
+                lines.push_back(line);
+            }
+        }
+
+        DirectoryEntry entry;
+        bool inEntry = false;
+        auto flush = [&]() {
+            if (!inEntry) return;
+            if (entry.dn.empty()) {
+                m_rootDse = entry;
+            } else {
+                m_entries.push_back(entry);
+            }
+            entry = DirectoryEntry();
+            inEntry = false;
+        };
+
+        for (const auto& line : lines) {
+            if (line.empty()) {
+                flush();
+                continue;
+            }
+            if (line[0] == '#') continue;
+
+            size_t colon = line.find(':');
+            if (colon == std::string::npos) return false;
+            std::wstring name = Utf8ToWide(line.substr(0, colon));
+            std::wstring value;
+            size_t v = colon + 1;
+            if (v < line.size() && line[v] == ':') {
+                std::string raw = Base64Decode(line.substr(v + 1));
+                value = IsBinaryAttribute(name) ? ToHex(raw) : Utf8ToWide(raw);
+            } else {
+                while (v < line.size() && line[v] == ' ') v++;
+                value = Utf8ToWide(line.substr(v));
+            }
+
+            if (DnKey(name) == L"dn") {
+                flush();
+                entry.dn = value;
+                inEntry = true;
+                continue;
+            }
+            if (!inEntry || DnKey(name) == L"version") continue;
+
+            auto* values = const_cast<std::vector<std::wstring>*>(entry.Find(name));
+            if (values) {
+                values->push_back(value);
+            } else {
+                entry.attributes.push_back({name, {value}});
+            }
+        }
+        flush();
+
+        // Entry DNs interned once: a search walks parent ids, no lowered copies
+        m_dns = std::make_unique<DnTable>();
+        m_entryDns.clear();
+        for (const auto& e : m_entries) m_entryDns.push_back(m_dns->Intern(e.dn));
+
+        m_hostIndex.clear();
+        for (size_t i = 0; i < m_entries.size(); i++) {
+            if (!HasObjectClass(m_entries[i], L"server")) continue;
+            m_hostIndex[DnKey(m_entries[i].First(L"name"))] = i;
+            std::wstring dns = m_entries[i].First(L"dNSHostName");
+            if (!dns.empty()) m_hostIndex[DnKey(dns)] = i;
+        }
+        return true;
+    }
+
+    size_t EntryCount() const { return m_entries.size(); }
+    uint64_t Searches() const { return m_searches.load(std::memory_order_relaxed); }
+    uint64_t Pages() const { return m_pages.load(std::memory_order_relaxed); }
+
+    RootDseReply ReadRootDse(const std::wstring& dcName, std::chrono::milliseconds) override {
+        PhaseTimer timer(dcName.empty() ? MetricPhase::DcLocate : MetricPhase::RootDseRead);
+        RootDseReply reply;
+        const DirectoryEntry* source = &m_rootDse;
+        if (!dcName.empty()) {
+            auto it = m_hostIndex.find(DnKey(dcName));
+            if (it == m_hostIndex.end()) return reply;
+            source = &m_entries[it->second];
+        }
+        reply.status = ProbeStatus::Ok;
+        reply.highestCommittedUSN = std::wcstoull(source->First(L"highestCommittedUSN").c_str(), nullptr, 10);
+        reply.dnsHostName = source->First(L"dNSHostName");
+        reply.dsServiceName = source->First(L"dsServiceName");
+        reply.defaultNamingContext = m_rootDse.First(L"defaultNamingContext");
+        reply.configurationNamingContext = m_rootDse.First(L"configurationNamingContext");
+        return reply;
+    }
+
+    bool SearchSubtree(const SearchRequest& request, const std::function<void(const DirectoryEntry&)>& onEntry) override {
+        size_t p = 0;
+        std::unique_ptr<Filter> filter = ParseFilter(request.filter, p);
+        if (!filter) return false;
+        PhaseTimer timer(MetricPhase::Search);
+        m_searches.fetch_add(1, std::memory_order_relaxed);
+
+        DnArena scratch(1024);
+        DnView baseDn;
+        if (!ParseDn(request.baseDn, scratch, baseDn)) return false;
+        const DnId base = m_dns->Find(baseDn);         // not interned: no entry below it
+        uint32_t pageSize = request.pageSize ? request.pageSize : 1000;
+        uint32_t inPage = 0;
+        m_pages.fetch_add(1, std::memory_order_relaxed);
+
+        for (size_t i = 0; i < m_entries.size(); i++) {
+            const DirectoryEntry& entry = m_entries[i];
+            if (!m_dns->IsWithin(m_entryDns[i], base) || !filter->Match(entry)) continue;
+
+            if (inPage == pageSize) {
+                m_pages.fetch_add(1, std::memory_order_relaxed);
+                inPage = 0;
+            }
+            inPage++;
+
+            if (request.attributes.empty()) {
+                onEntry(entry);
+                continue;
+            }
+            DirectoryEntry projected;
+            projected.dn = entry.dn;
+            for (const auto& attr : request.attributes) {
+                const auto* values = entry.Find(attr);
+                if (values) projected.attributes.push_back({attr, *values});
+            }
+            onEntry(projected);
+        }
+        return true;
+    }
+
+private:
+    struct Filter {
+        enum class Kind { And, Or, Not, Equal, Present, Prefix } kind = Kind::Equal;
+        std::wstring attr;
+        std::wstring value;
+        std::vector<std::unique_ptr<Filter>> children;
+
+        bool Match(const DirectoryEntry& e) const {
+            switch (kind) {
+                case Kind::And:
+                    for (const auto& c : children) if (!c->Match(e)) return false;
+                    return true;
+                case Kind::Or:
+                    for (const auto& c : children) if (c->Match(e)) return true;
+                    return false;
+                case Kind::Not:
+                    return !children.front()->Match(e);
+                default:
+                    break;
+            }
+            const auto* values = e.Find(attr);
+            if (!values || values->empty()) return false;
+            if (kind == Kind::Present) return true;
+            for (const auto& v : *values) {
+                std::wstring key = DnKey(v);
+                if (kind == Kind::Equal && key == value) return true;
+                if (kind == Kind::Prefix && key.compare(0, value.size(), value) == 0) return true;
+            }
+            return false;
+        }
+    };
+
+    static std::unique_ptr<Filter> ParseFilter(const std::wstring& s, size_t& p) {
+        if (p >= s.size() || s[p] != L'(') return nullptr;
+        p++;
+        auto f = std::make_unique<Filter>();
+        if (p < s.size() && (s[p] == L'&' || s[p] == L'|' || s[p] == L'!')) {
+            f->kind = s[p] == L'&' ? Filter::Kind::And : (s[p] == L'|' ? Filter::Kind::Or : Filter::Kind::Not);
+            p++;
+            while (p < s.size() && s[p] == L'(') {
+                auto child = ParseFilter(s, p);
+                if (!child) return nullptr;
+                f->children.push_back(std::move(child));
+            }
+            if (f->children.empty() || (f->kind == Filter::Kind::Not && f->children.size() != 1)) return nullptr;
+        } else {
+            size_t eq = s.find(L'=', p);
+            size_t close = s.find(L')', p);
+            if (eq == std::wstring::npos || close == std::wstring::npos || eq > close) return nullptr;
+            f->attr = s.substr(p, eq - p);
+            f->value = DnKey(s.substr(eq + 1, close - eq - 1));
+            if (f->value == L"*") {
+                f->kind = Filter::Kind::Present;
+            } else if (!f->value.empty() && f->value.back() == L'*') {
+                f->kind = Filter::Kind::Prefix;
+                f->value.pop_back();
+            }
+            p = close;
+        }
+        if (p >= s.size() || s[p] != L')') return nullptr;
+        p++;
+        return f;
+    }
+
+    static bool IsBinaryAttribute(const std::wstring& name) {
+        std::wstring key = DnKey(name);
+        return key == L"objectguid" || key == L"invocationid" || key == L"objectsid";
+    }
+
+    static std::string Base64Decode(const std::string& in) {
+        std::string out;
+        uint32_t acc = 0;
+        int bits = 0;
+        for (char ch : in) {
+            int v;
+            if (ch >= 'A' && ch <= 'Z') v = ch - 'A';
+            else if (ch >= 'a' && ch <= 'z') v = ch - 'a' + 26;
+            else if (ch >= '0' && ch <= '9') v = ch - '0' + 52;
+            else if (ch == '+') v = 62;
+            else if (ch == '/') v = 63;
+            else continue;
+            acc = (acc << 6) | static_cast<uint32_t>(v);
+            bits += 6;
+            if (bits >= 8) {
+                bits -= 8;
+                out.push_back(static_cast<char>((acc >> bits) & 0xFF));
+            }
+        }
+        return out;
+    }
+
+    static std::wstring ToHex(const std::string& raw) {
+        static const wchar_t digits[] = L"0123456789abcdef";
+        std::wstring out;
+        for (unsigned char c : raw) {
+            out += digits[c >> 4];
+            out += digits[c & 0xF];
+        }
+        return out;
+    }
+
+    DirectoryEntry m_rootDse;
+    std::vector<DirectoryEntry> m_entries;
+    std::unique_ptr<DnTable> m_dns = std::make_unique<DnTable>();
+    std::vector<DnId> m_entryDns;           // by entry, kInvalidDn when not a DN
+    std::unordered_map<std::wstring, size_t> m_hostIndex;
+    std::atomic<uint64_t> m_searches{0};
+    std::atomic<uint64_t> m_pages{0};
+};
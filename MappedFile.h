@@ -0,0 +1,164 @@
+// MappedFile.h
+// Fichier projeté en mémoire (Win32 / POSIX), redimensionnable, pour les stockages binaires
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Utf8.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Maps a whole file read-only or read-write. Resize() grows or shrinks the
+// file and remaps it, so pointers from Data() are invalidated by Resize()
+// and Close(); callers keep offsets, not pointers, across those calls.
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            Close();
+            m_data = other.m_data;
+            m_size = other.m_size;
+            m_writable = other.m_writable;
+            m_file = other.m_file;
+            other.m_data = nullptr;
+            other.m_size = 0;
+            other.m_file = kNoFile;
+        }
+        return *this;
+    }
+
+    ~MappedFile() { Close(); }
+
+    // Opens (creating it if writable) and maps path. minSize grows the file
+    // to at least that many bytes; 0 keeps the current size.
+    bool Open(const std::wstring& path, bool writable, size_t minSize = 0) {
+        Close();
+        m_writable = writable;
+#ifdef _WIN32
+        m_file = CreateFileW(path.c_str(), GENERIC_READ | (writable ? GENERIC_WRITE : 0),
+                             FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                             writable ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE) {
+            m_file = kNoFile;
+            return false;
+        }
+        LARGE_INTEGER size = {};
+        GetFileSizeEx(m_file, &size);
+        m_size = (size_t)size.QuadPart;
+#else
+        m_file = ::open(WideToUtf8(path).c_str(), writable ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+        if (m_file < 0) {
+            m_file = kNoFile;
+            return false;
+        }
+        struct stat st;
+        if (fstat(m_file, &st) != 0) {
+            Close();
+            return false;
+        }
+        m_size = static_cast<size_t>(st.st_size);
+#endif
+        if (writable && minSize > m_size) return Resize(minSize);
+        return Map();
+    }
+
+    bool Resize(size_t newSize) {
+        if (!m_writable || m_file == kNoFile) return false;
+        Unmap();
+#ifdef _WIN32
+        LARGE_INTEGER pos;
+        pos.QuadPart = (LONGLONG)newSize;
+        if (!SetFilePointerEx(m_file, pos, nullptr, FILE_BEGIN) || !SetEndOfFile(m_file)) return false;
+#else
+        if (ftruncate(m_file, static_cast<off_t>(newSize)) != 0) return false;
+#endif
+        m_size = newSize;
+        return Map();
+    }
+
+    // Writes dirty pages back; the OS would do it eventually anyway
+    void Flush() {
+        if (!m_data || !m_writable) return;
+#ifdef _WIN32
+        FlushViewOfFile(m_data, 0);
+#else
+        msync(m_data, m_size, MS_ASYNC);
+#endif
+    }
+
+    void Close() {
+        Unmap();
+        if (m_file == kNoFile) return;
+#ifdef _WIN32
+        CloseHandle(m_file);
+#else
+        ::close(m_file);
+#endif
+        m_file = kNoFile;
+        m_size = 0;
+    }
+
+    bool IsOpen() const { return m_file != kNoFile; }
+    uint8_t* Data() { return m_data; }
+    const uint8_t* Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+
+private:
+#ifdef _WIN32
+    typedef HANDLE FileHandle;
+    static constexpr FileHandle kNoFile = nullptr;
+#else
+    typedef int FileHandle;
+    static constexpr FileHandle kNoFile = -1;
+#endif
+
+    bool Map() {
+        if (m_size == 0) return true;           // empty files stay unmapped
+#ifdef _WIN32
+        HANDLE mapping = CreateFileMappingW(m_file, nullptr, m_writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) return false;
+        m_data = (uint8_t*)MapViewOfFile(mapping, m_writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, m_size);
+        CloseHandle(mapping);                   // the view keeps the mapping alive
+        return m_data != nullptr;
+#else
+        void* p = mmap(nullptr, m_size, PROT_READ | (m_writable ? PROT_WRITE : 0), MAP_SHARED, m_file, 0);
+        if (p == MAP_FAILED) return false;
+        m_data = static_cast<uint8_t*>(p);
+        return true;
+#endif
+    }
+
+    void Unmap() {
+        if (!m_data) return;
+#ifdef _WIN32
+        UnmapViewOfFile(m_data);
+#else
+        munmap(m_data, m_size);
+#endif
+        m_data = nullptr;
+    }
+
+    uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    bool m_writable = false;
+    FileHandle m_file = kNoFile;
+};
@@ -0,0 +1,30 @@
+// ParallelFor.h
+// Boucle parallèle bornée (pool de threads éphémère) pour les lectures par DC
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Runs fn(i) for i in [0, count) on up to `workers` threads, the calling
+// thread included. Indices are handed out dynamically so slow items do not
+// hold up a whole static partition.
+template <typename Fn>
+void ParallelFor(size_t count, unsigned workers, Fn&& fn) {
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+            fn(i);
+        }
+    };
+
+    size_t threads = std::min<size_t>(std::max(1u, workers), count);
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < threads; t++) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+}
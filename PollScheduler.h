@@ -0,0 +1,349 @@
+// PollScheduler.h
+// Planification adaptative des sondages : DCs en retard ou en erreur sondés plus souvent, budgets par site et global, lots par site
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "ReplicationModel.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <set>
+#include <utility>
+#include <vector>
+
+enum class PollHealth : uint8_t {
+    Unknown,                            // never polled: due at once
+    Healthy,
+    Lagging,                            // moderate or severe lag
+    Failing                             // no answer, or failing inbound partners
+};
+
+inline const char* PollHealthName(PollHealth health) {
+    switch (health) {
+        case PollHealth::Healthy: return "healthy";
+        case PollHealth::Lagging: return "lagging";
+        case PollHealth::Failing: return "failing";
+        default:                  return "unknown";
+    }
+}
+
+// Event counts are left out: they only change on full scans
+inline PollHealth ClassifyPoll(const DcRecord& r) {
+    if (r.status == ProbeStatus::Cancelled) return PollHealth::Unknown;
+    if (!r.HasUsn() || r.failingPartners > 0) return PollHealth::Failing;
+    if (r.lag == LagClass::Moderate || r.lag == LagClass::Severe) return PollHealth::Lagging;
+    return PollHealth::Healthy;
+}
+
+struct PollPolicy {
+    int64_t healthyMs = 15 * 60000;
+    int64_t laggingMs = 2 * 60000;
+    int64_t failingMs = 30000;          // doubled per consecutive failure, up to laggingMs
+    unsigned jitterPercent = 10;        // +/- spread of each interval, so DCs polled together drift apart
+    unsigned globalPerMinute = 600;     // probes per minute, forest-wide
+    unsigned globalBurst = 64;
+    unsigned sitePerMinute = 12;        // per site, unless SetSiteBudget() says otherwise
+    unsigned siteBurst = 8;
+    unsigned maxBatch = 8;              // DCs per site batch
+    int64_t coalesceMs = 60000;         // DCs due this soon join a batch of their site
+    uint64_t seed = 1;                  // jitter
+};
+
+// Probes per minute with a burst allowance. Tokens are counted in
+// 1/60000ths so a refill over any whole number of milliseconds is exact.
+class TokenBucket {
+public:
+    static constexpr int64_t kUnit = 60000;
+
+    void Configure(unsigned perMinute, unsigned burst, int64_t now) {
+        m_perMinute = perMinute;
+        m_capacity = static_cast<int64_t>(std::max(1u, burst)) * kUnit;
+        m_units = m_capacity;
+        m_last = now;
+    }
+
+    void Refill(int64_t now) {
+        m_units = Available(now);
+        m_last = std::max(m_last, now);
+    }
+
+    bool Take() {
+        if (m_units < kUnit) return false;
+        m_units -= kUnit;
+        return true;
+    }
+
+    bool HasToken() const { return m_units >= kUnit; }
+    int64_t Tokens() const { return m_units / kUnit; }
+
+    // When the next token is available, no earlier than now
+    int64_t ReadyAt(int64_t now) const {
+        int64_t units = Available(now);
+        if (units >= kUnit) return now;
+        if (m_perMinute == 0) return std::numeric_limits<int64_t>::max();
+        return std::max(now, m_last) + (kUnit - units + m_perMinute - 1) / m_perMinute;
+    }
+
+private:
+    int64_t Available(int64_t now) const {
+        if (now <= m_last) return m_units;
+        return std::min(m_capacity, m_units + (now - m_last) * static_cast<int64_t>(m_perMinute));
+    }
+
+    int64_t m_units = 0;
+    int64_t m_capacity = kUnit;
+    int64_t m_last = 0;
+    unsigned m_perMinute = 0;
+};
+
+// DCs of one site to poll together
+struct PollBatch {
+    SiteId site = kInvalidId;
+    std::vector<DcId> dcs;
+};
+
+struct PollSchedulerStats {
+    uint64_t dispatched = 0;
+    uint64_t batches = 0;
+    uint64_t coalesced = 0;             // dispatched before their due time to join a batch
+    uint64_t siteThrottled = 0;         // due sites skipped for lack of a site token
+    uint64_t globalThrottled = 0;       // Due() calls that ran out of global tokens
+};
+
+// Next-due time per DC, derived from the health of its last poll. Each
+// site keeps DCs not yet due by due time and due ones by deadline (due time
+// plus interval, i.e. when the poll after would be due), and two indexes
+// order the sites by earliest due and earliest deadline. Due() serves sites
+// earliest deadline first, at most one batch each, every DC costing a token
+// from its site's bucket and from the global one: when the budgets cannot
+// keep up, healthy DCs slip before lagging and failing ones do. Time is
+// whatever the caller passes in milliseconds, never read from a clock, so a
+// run is reproducible under a virtual clock. Not thread-safe.
+class PollScheduler {
+public:
+    static constexpr int64_t kNever = std::numeric_limits<int64_t>::max();
+
+    explicit PollScheduler(PollPolicy policy = PollPolicy()) : m_policy(policy) {
+        if (m_policy.maxBatch == 0) m_policy.maxBatch = 1;
+    }
+
+    // Starts over with these DCs (siteOfDc indexed by DcId), all due at now
+    void SetDcs(const std::vector<SiteId>& siteOfDc, int64_t now) {
+        size_t siteCount = 0;
+        for (SiteId s : siteOfDc) siteCount = std::max<size_t>(siteCount, s + 1);
+        m_dcs.assign(siteOfDc.size(), DcState());
+        m_sites.clear();
+        m_sites.resize(siteCount);
+        m_waitingOrder.clear();
+        m_readyOrder.clear();
+        m_stats = PollSchedulerStats();
+        m_global.Configure(m_policy.globalPerMinute, m_policy.globalBurst, now);
+        for (Site& site : m_sites) site.bucket.Configure(m_policy.sitePerMinute, m_policy.siteBurst, now);
+        for (DcId id = 0; id < m_dcs.size(); id++) {
+            m_dcs[id].site = siteOfDc[id];
+            Enqueue(id, now, 0);
+        }
+    }
+
+    // Tighter (or looser) budget for one site, e.g. a branch office on a thin link
+    void SetSiteBudget(SiteId site, unsigned perMinute, unsigned burst, int64_t now) {
+        if (site < m_sites.size()) m_sites[site].bucket.Configure(perMinute, burst, now);
+    }
+
+    // Health of a DC's poll, or of a full scan: schedules its next poll.
+    // A DC that was still queued is moved.
+    void Report(DcId id, PollHealth health, int64_t now) {
+        if (id >= m_dcs.size()) return;
+        DcState& dc = m_dcs[id];
+        Dequeue(id);
+        dc.health = health;
+        dc.failures = health == PollHealth::Failing ? static_cast<uint16_t>(std::min(dc.failures + 1, 0xFFFF)) : 0;
+        dc.polls++;
+        const int64_t interval = Interval(id);
+        Enqueue(id, now + interval, interval);
+    }
+
+    // Batches to poll now, one per site at most, earliest deadline first.
+    // Dispatched DCs stay out of the queue until reported.
+    std::vector<PollBatch> Due(int64_t now) {
+        Promote(now);
+        std::vector<PollBatch> batches;
+        m_global.Refill(now);
+        std::vector<SiteId> readySites;
+        for (const auto& entry : m_readyOrder) {
+            if (!m_global.HasToken()) {
+                m_stats.globalThrottled++;
+                break;
+            }
+            Site& site = m_sites[entry.second];
+            site.bucket.Refill(now);
+            if (site.bucket.HasToken()) {
+                readySites.push_back(entry.second);
+                if (readySites.size() >= static_cast<size_t>(m_global.Tokens())) break;
+            } else {
+                m_stats.siteThrottled++;
+            }
+        }
+
+        for (SiteId siteId : readySites) {
+            if (!m_global.HasToken()) break;
+            Site& site = m_sites[siteId];
+            Unindex(siteId);
+            PollBatch batch;
+            batch.site = siteId;
+            auto room = [&] {
+                return batch.dcs.size() < m_policy.maxBatch && site.bucket.HasToken() && m_global.HasToken();
+            };
+            while (!site.ready.empty() && room()) {
+                Dispatch(batch, site.ready.begin()->second);
+                site.ready.erase(site.ready.begin());
+            }
+            // Coalescing: DCs of the site due shortly ride along
+            while (!site.waiting.empty() && room() && site.waiting.begin()->first <= now + m_policy.coalesceMs) {
+                Dispatch(batch, site.waiting.begin()->second);
+                site.waiting.erase(site.waiting.begin());
+                m_stats.coalesced++;
+            }
+            Index(siteId);
+            m_stats.batches++;
+            batches.push_back(std::move(batch));
+        }
+        return batches;
+    }
+
+    // Earliest time Due() can return a batch: a due time, pushed back by
+    // the site's and the global budgets. kNever when nothing is queued.
+    int64_t NextWake(int64_t now) const {
+        int64_t wake = kNever;
+        const int64_t global = m_global.ReadyAt(now);
+        for (const auto& entry : m_readyOrder) {
+            wake = std::min(wake, m_sites[entry.second].bucket.ReadyAt(now));
+            if (wake <= global) break;
+        }
+        for (const auto& entry : m_waitingOrder) {
+            if (entry.first >= wake) break;
+            wake = std::min(wake, std::max(entry.first, m_sites[entry.second].bucket.ReadyAt(now)));
+        }
+        if (wake == kNever) return wake;
+        return std::max(wake, global);
+    }
+
+    size_t DcCount() const { return m_dcs.size(); }
+    PollHealth Health(DcId id) const { return m_dcs[id].health; }
+    int64_t DueAt(DcId id) const { return m_dcs[id].queued ? m_dcs[id].due : kNever; }
+    const PollSchedulerStats& Stats() const { return m_stats; }
+    const PollPolicy& Policy() const { return m_policy; }
+
+private:
+    typedef std::pair<int64_t, DcId> Entry;
+
+    struct DcState {
+        int64_t due = 0;
+        int64_t deadline = 0;
+        SiteId site = 0;
+        PollHealth health = PollHealth::Unknown;
+        uint16_t failures = 0;
+        uint32_t polls = 0;
+        bool queued = false;
+        bool ready = false;                         // in the site's ready set (by deadline)
+    };
+
+    struct Site {
+        std::set<Entry> waiting;                    // (due, dc), not due yet
+        std::set<Entry> ready;                      // (deadline, dc), due
+        TokenBucket bucket;
+    };
+
+    int64_t Interval(DcId id) const {
+        const DcState& dc = m_dcs[id];
+        int64_t base;
+        switch (dc.health) {
+            case PollHealth::Healthy: base = m_policy.healthyMs; break;
+            case PollHealth::Lagging: base = m_policy.laggingMs; break;
+            case PollHealth::Failing:
+                base = std::min(m_policy.laggingMs, m_policy.failingMs << std::min<unsigned>(dc.failures - 1, 16));
+                break;
+            default: return 0;
+        }
+        if (m_policy.jitterPercent == 0 || base <= 0) return base;
+
+        // Deterministic per (seed, DC, poll): same inputs, same schedule
+        uint64_t x = m_policy.seed ^ (static_cast<uint64_t>(id) << 32) ^ dc.polls;
+        x ^= x >> 30; x *= 0xBF58476D1CE4E5B9ull;
+        x ^= x >> 27; x *= 0x94D049BB133111EBull;
+        x ^= x >> 31;
+        const int64_t spread = base * std::min(m_policy.jitterPercent, 100u) / 100;
+        return base - spread + static_cast<int64_t>(x % static_cast<uint64_t>(2 * spread + 1));
+    }
+
+    void Dispatch(PollBatch& batch, DcId id) {
+        m_sites[m_dcs[id].site].bucket.Take();
+        m_global.Take();
+        m_dcs[id].queued = false;
+        batch.dcs.push_back(id);
+        m_stats.dispatched++;
+    }
+
+    // Moves DCs that came due into their site's ready set
+    void Promote(int64_t now) {
+        while (!m_waitingOrder.empty() && m_waitingOrder.begin()->first <= now) {
+            const SiteId siteId = m_waitingOrder.begin()->second;
+            Site& site = m_sites[siteId];
+            Unindex(siteId);
+            while (!site.waiting.empty() && site.waiting.begin()->first <= now) {
+                DcState& dc = m_dcs[site.waiting.begin()->second];
+                dc.ready = true;
+                site.ready.insert({dc.deadline, site.waiting.begin()->second});
+                site.waiting.erase(site.waiting.begin());
+            }
+            Index(siteId);
+        }
+    }
+
+    void Unindex(SiteId siteId) {
+        const Site& site = m_sites[siteId];
+        if (!site.waiting.empty()) m_waitingOrder.erase({site.waiting.begin()->first, siteId});
+        if (!site.ready.empty()) m_readyOrder.erase({site.ready.begin()->first, siteId});
+    }
+
+    void Index(SiteId siteId) {
+        const Site& site = m_sites[siteId];
+        if (!site.waiting.empty()) m_waitingOrder.insert({site.waiting.begin()->first, siteId});
+        if (!site.ready.empty()) m_readyOrder.insert({site.ready.begin()->first, siteId});
+    }
+
+    void Enqueue(DcId id, int64_t due, int64_t interval) {
+        DcState& dc = m_dcs[id];
+        Unindex(dc.site);
+        dc.due = due;
+        dc.deadline = due + interval;
+        dc.queued = true;
+        dc.ready = false;
+        m_sites[dc.site].waiting.insert({due, id});
+        Index(dc.site);
+    }
+
+    void Dequeue(DcId id) {
+        DcState& dc = m_dcs[id];
+        if (!dc.queued) return;
+        Site& site = m_sites[dc.site];
+        Unindex(dc.site);
+        if (dc.ready) {
+            site.ready.erase({dc.deadline, id});
+        } else {
+            site.waiting.erase({dc.due, id});
+        }
+        dc.queued = false;
+        Index(dc.site);
+    }
+
+    PollPolicy m_policy;
+    std::vector<DcState> m_dcs;
+    std::vector<Site> m_sites;
+    std::set<std::pair<int64_t, SiteId>> m_waitingOrder;   // (earliest due, site)
+    std::set<std::pair<int64_t, SiteId>> m_readyOrder;     // (earliest deadline, site)
+    TokenBucket m_global;
+    PollSchedulerStats m_stats;
+};
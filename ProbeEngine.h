@@ -0,0 +1,260 @@
+// ProbeEngine.h
+// Sondage concurrent des DCs (rootDSE/USN) avec délais par DC, échéance globale et plafond par site
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "CancellationToken.h"
+#include "DirectoryBackend.h"
+#include "ScanMetrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct ProbeTarget {
+    std::wstring dc;
+    uint32_t site = 0;
+};
+
+struct ProbeOptions {
+    unsigned workers = 32;
+    unsigned perSiteLimit = 8;
+    std::chrono::milliseconds dcTimeout{15000};
+    std::chrono::milliseconds scanDeadline{300000};
+};
+
+struct ProbeOutcome {
+    RootDseReply reply;
+    std::chrono::milliseconds elapsed{0};
+};
+
+// Fans rootDSE reads out over a bounded pool of workers. A DC that does not
+// answer within dcTimeout is reported as Timeout and its worker is replaced,
+// so one hung bind never stalls the rest of the scan; the hung call still
+// counts against its site's cap until it returns. Workers are detached and
+// only share reference-counted state: a call stuck inside the backend may
+// outlive Run() without touching the caller's data. With metrics, each
+// worker records its backend calls under the target's index. A cancelled
+// token ends Run() within kCancelPoll: probes in flight are abandoned like
+// timed out ones, and every DC not reached is reported Cancelled.
+class ProbeEngine {
+public:
+    using Callback = std::function<void(size_t index, const ProbeOutcome& outcome)>;
+
+    ProbeEngine(std::shared_ptr<IDirectoryBackend> backend, ProbeOptions options,
+                std::shared_ptr<ScanMetrics> metrics = nullptr)
+        : m_backend(std::move(backend)), m_options(options), m_metrics(std::move(metrics)) {
+        if (m_options.workers == 0) m_options.workers = 1;
+        if (m_options.perSiteLimit == 0) m_options.perSiteLimit = 1;
+    }
+
+    static constexpr std::chrono::milliseconds kCancelPoll{20};
+
+    // Probes every target and returns one outcome per target, in input order.
+    // onResult is invoked on the calling thread as outcomes arrive.
+    std::vector<ProbeOutcome> Run(const std::vector<ProbeTarget>& targets, const Callback& onResult = nullptr,
+                                  const CancellationToken* cancel = nullptr) {
+        using Clock = std::chrono::steady_clock;
+
+        auto state = std::make_shared<State>();
+        state->backend = m_backend;
+        state->metrics = m_metrics;
+        state->options = m_options;
+        state->targets = targets;
+        state->slots.assign(targets.size(), Slot{});
+        state->outcomes.assign(targets.size(), ProbeOutcome{});
+
+        uint32_t siteCount = 0;
+        for (const auto& t : targets) siteCount = std::max(siteCount, t.site + 1);
+        state->sitePending.resize(siteCount);
+        state->siteInFlight.assign(siteCount, 0);
+        for (size_t i = 0; i < targets.size(); i++) {
+            state->sitePending[targets[i].site].push_back(i);
+        }
+        state->pending = targets.size();
+
+        Clock::time_point deadline = Clock::now() + m_options.scanDeadline;
+        if (cancel) deadline = std::min(deadline, cancel->Deadline());
+        state->deadline = deadline;
+
+        size_t workers = std::min<size_t>(m_options.workers, targets.size());
+        for (size_t i = 0; i < workers; i++) {
+            std::thread(Worker, state).detach();
+        }
+
+        size_t done = 0;
+        std::vector<size_t> ready;
+        std::unique_lock<std::mutex> lock(state->mutex);
+
+        while (done < targets.size()) {
+            Clock::time_point wakeAt = deadline;
+            for (size_t idx : state->running) {
+                wakeAt = std::min(wakeAt, state->slots[idx].startedAt + m_options.dcTimeout);
+            }
+            if (cancel) wakeAt = std::min(wakeAt, Clock::now() + kCancelPoll);
+            state->doneCv.wait_until(lock, wakeAt, [&] { return !state->completed.empty(); });
+
+            Clock::time_point now = Clock::now();
+
+            // Per-DC timeouts: finalize overdue probes and replace their worker
+            for (size_t k = 0; k < state->running.size();) {
+                size_t idx = state->running[k];
+                Slot& slot = state->slots[idx];
+                if (now - slot.startedAt >= m_options.dcTimeout) {
+                    slot.phase = Phase::Done;
+                    slot.abandoned = true;
+                    state->outcomes[idx].reply.status = ProbeStatus::Timeout;
+                    state->outcomes[idx].elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - slot.startedAt);
+                    state->completed.push_back(idx);
+                    state->running[k] = state->running.back();
+                    state->running.pop_back();
+                    if (state->pending > 0 && now < deadline) {
+                        std::thread(Worker, state).detach();
+                    }
+                    state->workCv.notify_all();
+                } else {
+                    k++;
+                }
+            }
+
+            // Whole-scan deadline: whatever is left is timed out or cancelled.
+            // On a cancel request, probes in flight are cancelled too.
+            const bool cancelled = cancel && cancel->CancelRequested();
+            if (now >= deadline || cancelled) {
+                for (size_t idx = 0; idx < state->slots.size(); idx++) {
+                    Slot& slot = state->slots[idx];
+                    if (slot.phase == Phase::Done) continue;
+                    state->outcomes[idx].reply.status =
+                        (slot.phase == Phase::Running && !cancelled) ? ProbeStatus::Timeout : ProbeStatus::Cancelled;
+                    slot.abandoned = (slot.phase == Phase::Running);
+                    slot.phase = Phase::Done;
+                    state->completed.push_back(idx);
+                }
+                state->running.clear();
+                state->pending = 0;
+                state->stop = true;
+                state->workCv.notify_all();
+            }
+
+            ready.swap(state->completed);
+            state->completed.clear();
+            lock.unlock();
+            for (size_t idx : ready) {
+                done++;
+                if (onResult) onResult(idx, state->outcomes[idx]);
+            }
+            ready.clear();
+            lock.lock();
+        }
+
+        state->stop = true;
+        state->workCv.notify_all();
+        return state->outcomes;
+    }
+
+private:
+    enum class Phase : uint8_t { Pending, Running, Done };
+
+    struct Slot {
+        Phase phase = Phase::Pending;
+        bool abandoned = false;
+        std::chrono::steady_clock::time_point startedAt;
+    };
+
+    struct State {
+        std::mutex mutex;
+        std::condition_variable workCv;
+        std::condition_variable doneCv;
+
+        std::shared_ptr<IDirectoryBackend> backend;
+        std::shared_ptr<ScanMetrics> metrics;
+        ProbeOptions options;
+        std::vector<ProbeTarget> targets;
+        std::vector<Slot> slots;
+        std::vector<ProbeOutcome> outcomes;
+
+        std::vector<std::deque<size_t>> sitePending;
+        std::vector<unsigned> siteInFlight;
+        size_t siteCursor = 0;
+        size_t pending = 0;
+
+        std::vector<size_t> running;
+        std::vector<size_t> completed;
+        std::chrono::steady_clock::time_point deadline;
+        bool stop = false;
+    };
+
+    // Round-robin over sites so one large site cannot monopolise the pool
+    static bool PickNext(State& s, size_t& index) {
+        size_t sites = s.sitePending.size();
+        for (size_t n = 0; n < sites; n++) {
+            size_t site = (s.siteCursor + n) % sites;
+            if (s.sitePending[site].empty() || s.siteInFlight[site] >= s.options.perSiteLimit) continue;
+            index = s.sitePending[site].front();
+            s.sitePending[site].pop_front();
+            s.siteCursor = site + 1;
+            return true;
+        }
+        return false;
+    }
+
+    static void Worker(std::shared_ptr<State> state) {
+        using Clock = std::chrono::steady_clock;
+        State& s = *state;
+        std::unique_lock<std::mutex> lock(s.mutex);
+
+        for (;;) {
+            size_t idx = 0;
+            bool picked = false;
+            s.workCv.wait(lock, [&] { return s.stop || s.pending == 0 || (picked = PickNext(s, idx)); });
+            if (!picked) return;
+
+            Slot& slot = s.slots[idx];
+            slot.phase = Phase::Running;
+            slot.startedAt = Clock::now();
+            s.pending--;
+            s.siteInFlight[s.targets[idx].site]++;
+            s.running.push_back(idx);
+
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(s.deadline - slot.startedAt);
+            auto timeout = std::max(std::chrono::milliseconds(1), std::min(s.options.dcTimeout, remaining));
+            const std::wstring dc = s.targets[idx].dc;
+
+            lock.unlock();
+            RootDseReply reply;
+            {
+                MetricsScope scope(s.metrics.get(), static_cast<uint32_t>(idx));
+                reply = s.backend->ReadRootDse(dc, timeout);
+            }
+            lock.lock();
+
+            if (s.slots[idx].abandoned) {
+                // The coordinator already reported this DC and started a
+                // replacement; only now is the DC's site free again
+                s.siteInFlight[s.targets[idx].site]--;
+                s.workCv.notify_all();
+                return;
+            }
+
+            s.slots[idx].phase = Phase::Done;
+            s.outcomes[idx].reply = std::move(reply);
+            s.outcomes[idx].elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - s.slots[idx].startedAt);
+            s.siteInFlight[s.targets[idx].site]--;
+            s.running.erase(std::find(s.running.begin(), s.running.end(), idx));
+            s.completed.push_back(idx);
+            s.doneCv.notify_one();
+            s.workCv.notify_all();
+        }
+    }
+
+    std::shared_ptr<IDirectoryBackend> m_backend;
+    ProbeOptions m_options;
+    std::shared_ptr<ScanMetrics> m_metrics;
+};
@@ -0,0 +1,204 @@
+// PrometheusExporter.h
+// Exposition au format texte Prometheus de l'état et des durées par phase du dernier scan
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "HealthCheck.h"
+#include "ScanMetrics.h"
+#include "ScanSnapshot.h"
+#include "Utf8.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+
+// Text exposition format 0.0.4. Phase latencies are summaries (p50, p99,
+// sum, count) plus a max gauge, and a histogram on fixed bounds that can be
+// aggregated across collectors; sites only carry sum/count/max, and the
+// ten slowest DCs a total. Everything describes the last completed scan.
+class PrometheusExporter {
+public:
+    // Histogram bounds, 1 ms to 1 min
+    static constexpr uint64_t kBucketBoundsUs[] = {1000, 5000, 10000, 25000, 50000, 100000, 250000,
+                                                   500000, 1000000, 2500000, 5000000, 10000000, 60000000};
+
+    static std::string Format(const ScanSnapshot& snapshot, const HealthReport& health) {
+        PrometheusExporter e;
+        const ReplicationModel& model = snapshot.model;
+
+        e.Header("adrepl_health_status", "gauge", "État du dernier scan : 0 sain, 1 dégradé, 2 critique, 3 inconnu");
+        e.Sample("adrepl_health_status", "", static_cast<uint64_t>(health.status));
+        e.Header("adrepl_scan_timestamp_seconds", "gauge", "Fin du dernier scan (epoch Unix)");
+        e.Sample("adrepl_scan_timestamp_seconds", "", snapshot.completedAt / 1000);
+        e.Header("adrepl_scan_duration_seconds", "gauge", "Durée du dernier scan");
+        e.Seconds("adrepl_scan_duration_seconds", "", static_cast<uint64_t>(snapshot.completedAt - snapshot.startedAt) * 1000);
+        e.Header("adrepl_scan_generation", "gauge", "Numéro du scan depuis le démarrage");
+        e.Sample("adrepl_scan_generation", "", snapshot.generation);
+        e.Header("adrepl_dcs", "gauge", "DCs du dernier scan par état");
+        e.Sample("adrepl_dcs", "state=\"reachable\"", health.reachable);
+        e.Sample("adrepl_dcs", "state=\"unreachable\"", health.unreachable);
+        e.Sample("adrepl_dcs", "state=\"timed_out\"", health.timedOut);
+        e.Header("adrepl_failing_links", "gauge", "Liens entrants en échec");
+        e.Sample("adrepl_failing_links", "", health.failingLinks);
+        e.Header("adrepl_replication_events", "gauge", "Événements de réplication (1311, 1388, 2042...) sur la fenêtre de collecte");
+        e.Sample("adrepl_replication_events", "", health.eventErrors);
+        e.Header("adrepl_usn_spread", "gauge", "Écart entre le plus haut et le plus bas USN");
+        e.Sample("adrepl_usn_spread", "", health.spread.count > 1 ? health.spread.Diff() : 0);
+
+        const ScanMetrics* metrics = snapshot.metrics.get();
+        if (!metrics) return e.m_out;
+
+        e.Header("adrepl_phase_duration_seconds", "summary", "Durée des appels bloquants par phase");
+        for (size_t p = 0; p < kMetricPhases; p++) {
+            PhaseSummary s = metrics->Summarize(static_cast<MetricPhase>(p));
+            std::string phase = "phase=\"" + std::string(MetricPhaseName(s.phase)) + "\"";
+            e.Seconds("adrepl_phase_duration_seconds", phase + ",quantile=\"0.5\"", s.p50Us);
+            e.Seconds("adrepl_phase_duration_seconds", phase + ",quantile=\"0.99\"", s.p99Us);
+            e.Seconds("adrepl_phase_duration_seconds_sum", phase, s.sumUs);
+            e.Sample("adrepl_phase_duration_seconds_count", phase, s.count);
+        }
+        e.Header("adrepl_phase_duration_max_seconds", "gauge", "Appel le plus long par phase");
+        for (size_t p = 0; p < kMetricPhases; p++) {
+            MetricPhase phase = static_cast<MetricPhase>(p);
+            e.Seconds("adrepl_phase_duration_max_seconds", "phase=\"" + std::string(MetricPhaseName(phase)) + "\"",
+                      metrics->Histogram(phase).MaxMicros());
+        }
+
+        e.Header("adrepl_phase_latency_seconds", "histogram", "Répartition des appels bloquants par phase");
+        for (size_t p = 0; p < kMetricPhases; p++) {
+            MetricPhase phase = static_cast<MetricPhase>(p);
+            const LatencyHistogram& h = metrics->Histogram(phase);
+            std::string label = "phase=\"" + std::string(MetricPhaseName(phase)) + "\"";
+            for (uint64_t bound : kBucketBoundsUs) {
+                e.Sample("adrepl_phase_latency_seconds_bucket", label + ",le=\"" + SecondsText(bound) + "\"",
+                         h.CountAtOrBelow(bound));
+            }
+            uint64_t count = h.Count();
+            e.Sample("adrepl_phase_latency_seconds_bucket", label + ",le=\"+Inf\"", count);
+            e.Seconds("adrepl_phase_latency_seconds_sum", label, h.SumMicros());
+            e.Sample("adrepl_phase_latency_seconds_count", label, count);
+        }
+
+        e.Header("adrepl_site_phase_duration_seconds", "summary", "Durée des appels par site et par phase");
+        for (uint32_t site = 0; site < metrics->SiteCount() && site < model.sites.Size(); site++) {
+            for (size_t p = 0; p < kMetricPhases; p++) {
+                SitePhaseStats s = metrics->SiteStats(site, static_cast<MetricPhase>(p));
+                if (s.count == 0) continue;
+                std::string labels = "site=\"" + Escape(model.sites.Name(site)) + "\",phase=\"" +
+                                     MetricPhaseName(static_cast<MetricPhase>(p)) + "\"";
+                e.Seconds("adrepl_site_phase_duration_seconds_sum", labels, s.sumUs);
+                e.Sample("adrepl_site_phase_duration_seconds_count", labels, s.count);
+            }
+        }
+        e.Header("adrepl_site_phase_duration_max_seconds", "gauge", "Appel le plus long par site et par phase");
+        for (uint32_t site = 0; site < metrics->SiteCount() && site < model.sites.Size(); site++) {
+            for (size_t p = 0; p < kMetricPhases; p++) {
+                SitePhaseStats s = metrics->SiteStats(site, static_cast<MetricPhase>(p));
+                if (s.count == 0) continue;
+                e.Seconds("adrepl_site_phase_duration_max_seconds", "site=\"" + Escape(model.sites.Name(site)) +
+                          "\",phase=\"" + MetricPhaseName(static_cast<MetricPhase>(p)) + "\"", s.maxUs);
+            }
+        }
+
+        e.Header("adrepl_slowest_dc_seconds", "gauge", "Temps cumulé des appels des DCs les plus lents");
+        unsigned rank = 1;
+        for (const DcTiming& t : metrics->SlowestDcs(10)) {
+            if (t.totalUs == 0 || t.dc >= model.Size()) break;
+            SiteId site = model.records[t.dc].site;
+            e.Seconds("adrepl_slowest_dc_seconds", "rank=\"" + std::to_string(rank++) + "\",dc=\"" +
+                      Escape(model.DcName(t.dc)) + "\",site=\"" +
+                      (site < model.sites.Size() ? Escape(model.sites.Name(site)) : std::string()) + "\"", t.totalUs);
+        }
+        return e.m_out;
+    }
+
+    // Replaces path through a temporary file, so a scraper or the node
+    // exporter textfile collector never reads a half-written file
+    static bool WriteFile(const std::wstring& path, const std::string& text) {
+        std::filesystem::path target(path);
+        std::filesystem::path temp = target;
+        temp += L".tmp";
+        {
+            std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+            if (!out) return false;
+            out.write(text.data(), static_cast<std::streamsize>(text.size()));
+            if (!out) return false;
+        }
+        std::error_code ec;
+        std::filesystem::rename(temp, target, ec);
+        return !ec;
+    }
+
+    // Label values: backslash, double quote and line feed are escaped
+    static std::string Escape(const std::wstring& value) {
+        std::string utf8 = WideToUtf8(value);
+        std::string out;
+        out.reserve(utf8.size());
+        for (char c : utf8) {
+            if (c == '\\' || c == '"') {
+                out += '\\';
+                out += c;
+            } else if (c == '\n') {
+                out += "\\n";
+            } else {
+                out += c;
+            }
+        }
+        return out;
+    }
+
+private:
+    void Header(const char* name, const char* type, const char* help) {
+        m_out += "# HELP ";
+        m_out += name;
+        m_out += ' ';
+        m_out += help;
+        m_out += "\n# TYPE ";
+        m_out += name;
+        m_out += ' ';
+        m_out += type;
+        m_out += '\n';
+    }
+
+    void Sample(const char* name, const std::string& labels, uint64_t value) {
+        Name(name, labels);
+        m_out += std::to_string(value);
+        m_out += '\n';
+    }
+
+    void Sample(const char* name, const std::string& labels, int64_t value) {
+        Name(name, labels);
+        m_out += std::to_string(value);
+        m_out += '\n';
+    }
+
+    // Microseconds rendered as seconds, exact to the microsecond
+    void Seconds(const char* name, const std::string& labels, uint64_t micros) {
+        Name(name, labels);
+        m_out += SecondsText(micros);
+        m_out += '\n';
+    }
+
+    static std::string SecondsText(uint64_t micros) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%llu.%06llu", (unsigned long long)(micros / 1000000),
+                      (unsigned long long)(micros % 1000000));
+        return text;
+    }
+
+    void Name(const char* name, const std::string& labels) {
+        m_out += name;
+        if (!labels.empty()) {
+            m_out += '{';
+            m_out += labels;
+            m_out += '}';
+        }
+        m_out += ' ';
+    }
+
+    std::string m_out;
+};
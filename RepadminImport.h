@@ -0,0 +1,883 @@
+// RepadminImport.h
+// Import hors ligne des exports repadmin (/showrepl * /csv, /replsummary) : fichier projeté, découpage et lecture CSV parallèles
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define REPADMIN_CSV_SSE2 1
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "EventParser.h"
+#include "LatencyMatrix.h"
+#include "MappedFile.h"
+#include "ParallelFor.h"
+#include "ReplicationModel.h"
+#include "ScanSnapshot.h"
+#include "TopologyGraph.h"
+#include "Utf8.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Index of the lowest set bit; x must not be 0
+inline unsigned LowestBit(uint64_t x) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctzll(x));
+#endif
+}
+
+// Bit i set when an odd number of bits 0..i are. Applied to the quote
+// positions of a block, it marks the bytes inside quoted text (the opening
+// quote included, the closing one not); bit 63 is the block's parity.
+inline uint64_t PrefixXor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+struct CsvBlockMasks {
+    uint64_t quote = 0;
+    uint64_t comma = 0;
+    uint64_t newline = 0;
+};
+
+// Classifies the 64 bytes at p, or the size left when fewer (the missing
+// bytes classify as nothing)
+inline CsvBlockMasks ClassifyCsvBlock(const char* p, size_t size) {
+    CsvBlockMasks m;
+#ifdef REPADMIN_CSV_SSE2
+    if (size >= 64) {
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i comma = _mm_set1_epi8(',');
+        const __m128i newline = _mm_set1_epi8('\n');
+        for (unsigned i = 0; i < 4; i++) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i));
+            auto bits = [&](__m128i c) {
+                return static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, c)))) << (16 * i);
+            };
+            m.quote |= bits(quote);
+            m.comma |= bits(comma);
+            m.newline |= bits(newline);
+        }
+        return m;
+    }
+#endif
+    const size_t n = std::min<size_t>(size, 64);
+    for (size_t i = 0; i < n; i++) {
+        const uint64_t bit = 1ull << i;
+        if (p[i] == '"') {
+            m.quote |= bit;
+        } else if (p[i] == ',') {
+            m.comma |= bit;
+        } else if (p[i] == '\n') {
+            m.newline |= bit;
+        }
+    }
+    return m;
+}
+
+// One CSV record, fields unquoted. Views point into the scanned input, or
+// into the scanner's scratch for fields with doubled quotes; either way
+// they are valid until the callback returns. Fields past kMaxFields are
+// counted, not kept.
+struct CsvRecord {
+    static constexpr size_t kMaxFields = 16;
+
+    std::string_view fields[kMaxFields];
+    size_t count = 0;
+    size_t offset = 0;                  // of the record's first byte in the input
+
+    std::string_view Field(size_t i) const { return i < count && i < kMaxFields ? fields[i] : std::string_view(); }
+};
+
+// RFC 4180 reader: commas between fields, LF or CRLF between records,
+// quoted fields holding commas, newlines and doubled quotes. Input is
+// classified 64 bytes at a time (SSE2 where the target has it) and the
+// quote mask becomes an "inside quotes" mask by prefix XOR, so separators
+// in quoted text drop out without a per-byte state machine.
+class CsvScanner {
+public:
+    // onRecord(const CsvRecord&) returns false to stop early
+    template <typename OnRecord>
+    void Scan(const char* data, size_t size, OnRecord&& onRecord) {
+        CsvRecord record;
+        size_t fieldStart = 0;
+        uint64_t carry = 0;                 // all ones when the block starts inside quotes
+        for (size_t block = 0; block < size; block += 64) {
+            const CsvBlockMasks m = ClassifyCsvBlock(data + block, size - block);
+            const uint64_t quoted = PrefixXor(m.quote) ^ carry;
+            carry = static_cast<uint64_t>(static_cast<int64_t>(quoted) >> 63);
+            uint64_t separators = (m.comma | m.newline) & ~quoted;
+            while (separators) {
+                const size_t pos = block + LowestBit(separators);
+                separators &= separators - 1;
+                const bool last = data[pos] == '\n';
+                AddField(record, data, fieldStart, pos, last);
+                fieldStart = pos + 1;
+                if (last) {
+                    if (!onRecord(static_cast<const CsvRecord&>(record))) return;
+                    record.count = 0;
+                    record.offset = fieldStart;
+                }
+            }
+        }
+        if (fieldStart < size || record.count > 0) {
+            AddField(record, data, fieldStart, size, true);
+            onRecord(static_cast<const CsvRecord&>(record));
+        }
+    }
+
+private:
+    void AddField(CsvRecord& record, const char* data, size_t begin, size_t end, bool last) {
+        if (last && end > begin && data[end - 1] == '\r') end--;
+        const size_t i = record.count++;
+        if (i >= CsvRecord::kMaxFields) return;
+        if (end > begin && data[begin] == '"') {
+            begin++;
+            if (end > begin && data[end - 1] == '"') end--;
+            std::string_view text(data + begin, end - begin);
+            if (text.find('"') != std::string_view::npos) {
+                std::string& scratch = m_scratch[i];
+                scratch.clear();
+                for (size_t k = 0; k < text.size(); k++) {
+                    scratch += text[k];
+                    if (text[k] == '"' && k + 1 < text.size() && text[k + 1] == '"') k++;
+                }
+                text = scratch;
+            }
+            record.fields[i] = text;
+        } else {
+            record.fields[i] = std::string_view(data + begin, end - begin);
+        }
+    }
+
+    std::string m_scratch[CsvRecord::kMaxFields];
+};
+
+// Cuts data into ranges of about chunkBytes that each start on a record:
+// the quote parity of every nominal cut comes from a parallel pass over
+// the blocks, then the cut moves past the next newline outside quotes.
+// Returns the range starts followed by size.
+inline std::vector<size_t> SplitCsvChunks(const char* data, size_t size, size_t chunkBytes, unsigned workers) {
+    chunkBytes = std::max<size_t>(64, (chunkBytes + 63) / 64 * 64);
+    const size_t nominal = (size + chunkBytes - 1) / chunkBytes;
+    std::vector<uint8_t> odd(nominal, 0);
+    ParallelFor(nominal, workers, [&](size_t i) {
+        const size_t begin = i * chunkBytes, end = std::min(size, begin + chunkBytes);
+        uint64_t parity = 0;
+        for (size_t b = begin; b < end; b += 64) parity ^= PrefixXor(ClassifyCsvBlock(data + b, end - b).quote) >> 63;
+        odd[i] = static_cast<uint8_t>(parity);
+    });
+
+    std::vector<size_t> starts;
+    if (size > 0) starts.push_back(0);
+    bool inside = false;
+    for (size_t i = 1; i < nominal; i++) {
+        inside = inside != (odd[i - 1] != 0);
+        size_t pos = i * chunkBytes;
+        bool quoted = inside;
+        while (pos < size) {
+            const char c = data[pos++];
+            if (c == '"') {
+                quoted = !quoted;
+            } else if (c == '\n' && !quoted) {
+                break;
+            }
+        }
+        if (pos < size && pos > starts.back()) starts.push_back(pos);
+    }
+    starts.push_back(size);
+    return starts;
+}
+
+// PowerShell's ">" writes UTF-16LE: dumps saved that way are converted
+// once, the parsers only read UTF-8. Lone surrogates become U+FFFD.
+inline std::string Utf16LeToUtf8(const char* data, size_t size) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    const size_t units = size / 2;
+    std::string out;
+    out.reserve(units);
+    for (size_t i = 0; i < units; i++) {
+        uint32_t cp = p[2 * i] | (static_cast<uint32_t>(p[2 * i + 1]) << 8);
+        if (cp < 0x80) {
+            out.push_back(static_cast<char>(cp));
+            continue;
+        }
+        if (cp >= 0xD800 && cp <= 0xDFFF) {
+            const uint32_t lo = i + 1 < units ? (p[2 * i + 2] | (static_cast<uint32_t>(p[2 * i + 3]) << 8)) : 0;
+            if (cp <= 0xDBFF && lo >= 0xDC00 && lo <= 0xDFFF) {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                i++;
+            } else {
+                cp = 0xFFFD;
+            }
+        }
+        if (cp < 0x800) {
+            out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+        } else if (cp < 0x10000) {
+            out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        } else {
+            out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        }
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+    return out;
+}
+
+enum class RepadminFormat : uint8_t {
+    Unknown,
+    ShowreplCsv,                        // repadmin /showrepl * /csv
+    ReplSummary                         // repadmin /replsummary
+};
+
+inline const char* RepadminFormatName(RepadminFormat format) {
+    switch (format) {
+        case RepadminFormat::ShowreplCsv: return "showrepl";
+        case RepadminFormat::ReplSummary: return "replsummary";
+        default:                          return "unknown";
+    }
+}
+
+struct RepadminImportOptions {
+    unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunkBytes = 4 << 20;        // unit of parallel parsing; small values only serve the checks
+    LinkScheduleOptions schedule;       // link delays: same site or not, as a scan without site links
+    LatencyThresholds latency;
+};
+
+struct RepadminImportStats {
+    RepadminFormat format = RepadminFormat::Unknown;
+    uint64_t bytes = 0;                 // as read, before any UTF-16 conversion
+    uint64_t records = 0;               // non-empty CSV records, or text lines
+    uint64_t rows = 0;                  // replication rows: showrepl_INFO records, summary table lines
+    uint64_t superseded = 0;            // rows replaced by a newer one for the same (destination, NC, source)
+    uint64_t skipped = 0;               // headers, other repadmin records, malformed rows
+    size_t chunks = 0;
+    int64_t dumpTime = 0;               // newest time found in the dump: latencies are measured against it
+    double splitMs = 0;
+    double parseMs = 0;
+    double mergeMs = 0;
+};
+
+// Where the fields of a showrepl row are, from the dump's header. repadmin
+// tags its own lines (showrepl_COLUMNS, then showrepl_INFO rows); a dump
+// round-tripped through Import-Csv/Export-Csv loses the tag column.
+struct ShowreplLayout {
+    bool tagged = true;
+    std::string header;                 // untagged: the header's first field, repeated headers are skipped
+    size_t destSite = 1, dest = 2, nc = 3, sourceSite = 4, source = 5;
+    size_t failures = 7, lastFailure = 8, lastSuccess = 9, status = 10;
+
+    size_t FieldsNeeded() const {
+        return std::max({destSite, dest, nc, sourceSite, source, failures, lastFailure, lastSuccess, status}) + 1;
+    }
+};
+
+inline bool EqualsAsciiNoCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        char x = a[i], y = b[i];
+        if (x >= 'A' && x <= 'Z') x = static_cast<char>(x + 32);
+        if (y >= 'A' && y <= 'Z') y = static_cast<char>(y + 32);
+        if (x != y) return false;
+    }
+    return true;
+}
+
+// Columns are found by their English names; a localised header keeps
+// repadmin's default positions
+inline bool ParseShowreplLayout(const CsvRecord& header, ShowreplLayout& layout, std::string& error) {
+    layout = ShowreplLayout();
+    const std::string_view first = header.Field(0);
+    if (first == "showrepl_COLUMNS") {
+        layout.tagged = true;
+    } else if (EqualsAsciiNoCase(first, "Destination DSA Site")) {
+        layout.tagged = false;
+        layout.header = std::string(first);
+        layout.destSite = 0, layout.dest = 1, layout.nc = 2, layout.sourceSite = 3, layout.source = 4;
+        layout.failures = 6, layout.lastFailure = 7, layout.lastSuccess = 8, layout.status = 9;
+    } else {
+        error = "en-tête repadmin /showrepl /csv introuvable";
+        return false;
+    }
+    const struct { const char* name; size_t ShowreplLayout::*column; } kColumns[] = {
+        {"Destination DSA Site", &ShowreplLayout::destSite}, {"Destination DSA", &ShowreplLayout::dest},
+        {"Naming Context", &ShowreplLayout::nc}, {"Source DSA Site", &ShowreplLayout::sourceSite},
+        {"Source DSA", &ShowreplLayout::source}, {"Number of Failures", &ShowreplLayout::failures},
+        {"Last Failure Time", &ShowreplLayout::lastFailure}, {"Last Success Time", &ShowreplLayout::lastSuccess},
+        {"Last Failure Status", &ShowreplLayout::status}};
+    for (size_t i = 0; i < header.count && i < CsvRecord::kMaxFields; i++) {
+        for (const auto& c : kColumns) {
+            if (EqualsAsciiNoCase(header.fields[i], c.name)) layout.*c.column = i;
+        }
+    }
+    return true;
+}
+
+// Failure counts and Win32 status codes: decimal, or 0x hexadecimal
+inline uint32_t ParseRepadminNumber(std::string_view s) {
+    size_t i = 0;
+    while (i < s.size() && s[i] == ' ') i++;
+    uint64_t v = 0;
+    if (i + 1 < s.size() && s[i] == '0' && (s[i + 1] == 'x' || s[i + 1] == 'X')) {
+        for (i += 2; i < s.size(); i++) {
+            const char c = s[i];
+            const int d = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                        : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+            if (d < 0) break;
+            v = std::min<uint64_t>(0xFFFFFFFFull, v * 16 + static_cast<uint64_t>(d));
+        }
+    } else {
+        for (; i < s.size() && s[i] >= '0' && s[i] <= '9'; i++) {
+            v = std::min<uint64_t>(0xFFFFFFFFull, v * 10 + static_cast<uint64_t>(s[i] - '0'));
+        }
+    }
+    return static_cast<uint32_t>(v);
+}
+
+// One inbound link state as a showrepl row gives it. IDs are local to the
+// chunk that read the row until the merge maps them to the snapshot's.
+struct ShowreplRow {
+    int64_t lastSuccess = 0;
+    int64_t lastFailure = 0;
+    uint64_t offset = 0;                // in the input: the later row wins a tie
+    uint32_t dest = 0;
+    uint32_t source = 0;
+    uint32_t nc = 0;
+    uint32_t failures = 0;
+    uint32_t status = 0;
+
+    int64_t ObservedAt() const { return std::max(lastSuccess, lastFailure); }
+};
+
+// What one chunk read. Names point into the input, or into owned when the
+// CSV field had to be unquoted.
+struct ShowreplChunk {
+    std::vector<std::string_view> dcNames;
+    std::vector<std::string_view> dcSites;
+    std::vector<std::string_view> ncNames;
+    std::vector<ShowreplRow> rows;
+    std::deque<std::string> owned;
+    uint64_t records = 0;
+    uint64_t skipped = 0;
+    int64_t newest = 0;
+};
+
+// Reads the showrepl rows of data[begin, end), which starts on a record.
+// Rows come grouped by destination and NC, so the last lookup of each is
+// remembered.
+inline void ParseShowreplChunk(const char* data, size_t begin, size_t end, const ShowreplLayout& layout,
+                               ShowreplChunk& chunk) {
+    const char* const lo = data + begin;
+    const char* const hi = data + end;
+    std::unordered_map<std::string_view, uint32_t> dcIds, ncIds;
+    auto keep = [&](std::string_view v) {
+        if (v.empty() || (v.data() >= lo && v.data() + v.size() <= hi)) return v;
+        chunk.owned.emplace_back(v);
+        return std::string_view(chunk.owned.back());
+    };
+    auto dcId = [&](std::string_view name, std::string_view site) {
+        auto it = dcIds.find(name);
+        if (it != dcIds.end()) {
+            if (chunk.dcSites[it->second].empty()) chunk.dcSites[it->second] = keep(site);
+            return it->second;
+        }
+        const uint32_t id = static_cast<uint32_t>(chunk.dcNames.size());
+        chunk.dcNames.push_back(keep(name));
+        chunk.dcSites.push_back(keep(site));
+        dcIds.emplace(chunk.dcNames.back(), id);
+        return id;
+    };
+    auto ncId = [&](std::string_view name) {
+        auto it = ncIds.find(name);
+        if (it != ncIds.end()) return it->second;
+        const uint32_t id = static_cast<uint32_t>(chunk.ncNames.size());
+        chunk.ncNames.push_back(keep(name));
+        ncIds.emplace(chunk.ncNames.back(), id);
+        return id;
+    };
+
+    const size_t needed = layout.FieldsNeeded();
+    std::string_view lastDest, lastNc;
+    uint32_t lastDestId = 0, lastNcId = 0;
+    bool haveNc = false;
+    CsvScanner scanner;
+    scanner.Scan(lo, end - begin, [&](const CsvRecord& r) {
+        if (r.count == 1 && r.fields[0].empty()) return true;      // blank line
+        chunk.records++;
+        const std::string_view tag = r.Field(0);
+        const bool row = layout.tagged ? tag == "showrepl_INFO" : tag != layout.header;
+        const std::string_view dest = r.Field(layout.dest), source = r.Field(layout.source);
+        if (!row || r.count < needed || dest.empty() || source.empty()) {
+            chunk.skipped++;
+            return true;
+        }
+        ShowreplRow out;
+        if (lastDest.empty() || dest != lastDest) {
+            lastDestId = dcId(dest, r.Field(layout.destSite));
+            lastDest = chunk.dcNames[lastDestId];
+        }
+        out.dest = lastDestId;
+        const std::string_view nc = r.Field(layout.nc);
+        if (!haveNc || nc != lastNc) {
+            lastNcId = ncId(nc);
+            lastNc = chunk.ncNames[lastNcId];
+            haveNc = true;
+        }
+        out.nc = lastNcId;
+        out.source = dcId(source, r.Field(layout.sourceSite));
+        out.failures = ParseRepadminNumber(r.Field(layout.failures));
+        out.status = ParseRepadminNumber(r.Field(layout.status));
+        const std::string_view failure = r.Field(layout.lastFailure), success = r.Field(layout.lastSuccess);
+        out.lastFailure = ParseIsoTimestamp(failure.data(), failure.size());
+        out.lastSuccess = ParseIsoTimestamp(success.data(), success.size());
+        out.offset = begin + r.offset;
+        chunk.newest = std::max(chunk.newest, out.ObservedAt());
+        chunk.rows.push_back(out);
+        return true;
+    });
+}
+
+// The snapshot fields every import sets the same way
+inline void FinishImportedSnapshot(ScanSnapshot& snapshot, int64_t dumpTime) {
+    snapshot.generation = 1;
+    snapshot.startedAt = dumpTime;
+    snapshot.completedAt = dumpTime;
+    snapshot.siteCount = snapshot.model.sites.Size();
+    snapshot.latency.Resize(snapshot.model.Size());
+}
+
+// A showrepl dump in memory. Chunks are parsed in parallel, their names
+// merged into the model in input order, then rows are redistributed by
+// destination (counting sort) so each destination's row is built by one
+// worker: the newest observation of each (destination, NC, source) wins,
+// which makes a concatenation of dumps import as its latest state.
+//
+// Destinations get ProbeStatus::Ok, no USN, and the latency of their
+// oldest successful inbound link against the dump's newest timestamp;
+// DCs only seen as a source were not read by repadmin: Unreachable.
+// repadmin writes local times; they are read as UTC, which shifts the
+// absolute times but not the latencies.
+inline bool ImportShowreplCsv(const char* data, size_t size, const RepadminImportOptions& options, SnapshotPtr& snapshot,
+                              RepadminImportStats& stats, std::string& error) {
+    using Clock = std::chrono::steady_clock;
+    auto millis = [](Clock::time_point since) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - since).count() / 1000.0;
+    };
+    const unsigned workers = std::max(1u, options.workers);
+
+    // The header: the first record that is not a comment (Export-Csv writes "#TYPE ...")
+    CsvRecord header;
+    bool found = false;
+    CsvScanner headerScanner;
+    headerScanner.Scan(data, std::min<size_t>(size, 64 * 1024), [&](const CsvRecord& r) {
+        const std::string_view first = r.Field(0);
+        if (first.empty() || first[0] == '#') return true;
+        header = r;
+        found = true;
+        return false;
+    });
+    ShowreplLayout layout;
+    if (!found) {
+        error = "en-tête repadmin /showrepl /csv introuvable";
+        return false;
+    }
+    if (!ParseShowreplLayout(header, layout, error)) return false;
+
+    Clock::time_point t0 = Clock::now();
+    const std::vector<size_t> starts = SplitCsvChunks(data, size, options.chunkBytes, workers);
+    const size_t chunkCount = starts.size() - 1;
+    stats.chunks = chunkCount;
+    stats.splitMs = millis(t0);
+
+    t0 = Clock::now();
+    std::vector<ShowreplChunk> chunks(chunkCount);
+    ParallelFor(chunkCount, workers, [&](size_t i) { ParseShowreplChunk(data, starts[i], starts[i + 1], layout, chunks[i]); });
+    stats.parseMs = millis(t0);
+
+    // Names in input order, so DcIds follow the dump
+    t0 = Clock::now();
+    auto working = std::make_shared<ScanSnapshot>();
+    ReplicationModel& model = working->model;
+    LatencyMatrix& matrix = working->latency;
+    std::unordered_map<std::string_view, DcId> dcIds;
+    std::unordered_map<std::string_view, NcId> ncIds;
+    std::vector<std::vector<uint32_t>> dcMaps(chunkCount), ncMaps(chunkCount);
+    for (size_t c = 0; c < chunkCount; c++) {
+        const ShowreplChunk& chunk = chunks[c];
+        stats.records += chunk.records;
+        stats.skipped += chunk.skipped;
+        stats.rows += chunk.rows.size();
+        stats.dumpTime = std::max(stats.dumpTime, chunk.newest);
+        for (size_t k = 0; k < chunk.dcNames.size(); k++) {
+            auto it = dcIds.find(chunk.dcNames[k]);
+            if (it == dcIds.end()) {
+                const std::string_view site = chunk.dcSites[k];
+                const DcId id = model.AddDc(Utf8ToWide(site.data(), site.size()),
+                                            Utf8ToWide(chunk.dcNames[k].data(), chunk.dcNames[k].size()));
+                it = dcIds.emplace(chunk.dcNames[k], id).first;
+            }
+            dcMaps[c].push_back(it->second);
+        }
+        for (std::string_view nc : chunk.ncNames) {
+            auto it = ncIds.find(nc);
+            if (it == ncIds.end()) it = ncIds.emplace(nc, matrix.InternNc(Utf8ToWide(nc.data(), nc.size()))).first;
+            ncMaps[c].push_back(it->second);
+        }
+    }
+    if (stats.rows == 0) {
+        error = "aucune ligne de réplication (showrepl_INFO) dans le fichier";
+        return false;
+    }
+    if (stats.dumpTime == 0) stats.dumpTime = UnixNowMs();
+    matrix.Resize(model.Size());
+    std::vector<SiteId> siteOf(model.Size());
+    for (DcId id = 0; id < model.Size(); id++) siteOf[id] = model.records[id].site;
+
+    // Counting sort of the rows into destination partitions
+    const size_t partitions = std::min<size_t>(std::max<size_t>(1, model.Size()), static_cast<size_t>(workers) * 4);
+    std::vector<size_t> counts(chunkCount * partitions, 0);
+    ParallelFor(chunkCount, workers, [&](size_t c) {
+        size_t* count = counts.data() + c * partitions;
+        for (ShowreplRow& row : chunks[c].rows) {
+            row.dest = dcMaps[c][row.dest];
+            row.source = dcMaps[c][row.source];
+            row.nc = ncMaps[c][row.nc];
+            count[row.dest % partitions]++;
+        }
+    });
+    std::vector<size_t> partitionStart(partitions + 1, 0);
+    std::vector<size_t> cursor(chunkCount * partitions);
+    size_t total = 0;
+    for (size_t p = 0; p < partitions; p++) {
+        partitionStart[p] = total;
+        for (size_t c = 0; c < chunkCount; c++) {
+            cursor[c * partitions + p] = total;
+            total += counts[c * partitions + p];
+        }
+    }
+    partitionStart[partitions] = total;
+    std::vector<ShowreplRow> rows(total);
+    ParallelFor(chunkCount, workers, [&](size_t c) {
+        size_t* next = cursor.data() + c * partitions;
+        for (const ShowreplRow& row : chunks[c].rows) rows[next[row.dest % partitions]++] = row;
+        std::vector<ShowreplRow>().swap(chunks[c].rows);
+    });
+
+    // One destination row per DC, built where its partition is
+    const int64_t dumpTime = stats.dumpTime;
+    std::vector<uint8_t> isDestination(model.Size(), 0);
+    std::vector<std::vector<ReplicationLink>> partitionLinks(partitions);
+    std::vector<uint64_t> superseded(partitions, 0);
+    ParallelFor(partitions, workers, [&](size_t p) {
+        // Counting sort by destination (p, p + partitions, ...), then each
+        // destination's few thousand rows sorted on their own
+        const size_t dests = (model.Size() - p + partitions - 1) / partitions;
+        std::vector<size_t> destStart(dests + 1, 0);
+        for (size_t i = partitionStart[p]; i < partitionStart[p + 1]; i++) destStart[rows[i].dest / partitions + 1]++;
+        for (size_t d = 0; d < dests; d++) destStart[d + 1] += destStart[d];
+        std::vector<ShowreplRow> sorted(partitionStart[p + 1] - partitionStart[p]);
+        std::vector<size_t> next(destStart.begin(), destStart.end() - 1);
+        for (size_t i = partitionStart[p]; i < partitionStart[p + 1]; i++) sorted[next[rows[i].dest / partitions]++] = rows[i];
+        for (size_t d = 0; d < dests; d++) {
+            std::sort(sorted.begin() + static_cast<std::ptrdiff_t>(destStart[d]),
+                      sorted.begin() + static_cast<std::ptrdiff_t>(destStart[d + 1]),
+                      [](const ShowreplRow& a, const ShowreplRow& b) {
+                if (a.nc != b.nc) return a.nc < b.nc;
+                if (a.source != b.source) return a.source < b.source;
+                if (a.ObservedAt() != b.ObservedAt()) return a.ObservedAt() < b.ObservedAt();
+                return a.offset < b.offset;
+            });
+        }
+        const auto first = sorted.begin();
+        const auto last = sorted.end();
+        std::vector<DcId> sources;
+        for (auto it = first; it != last;) {
+            const DcId dest = it->dest;
+            auto row = std::make_shared<DestinationRow>();
+            row->observedAt = dumpTime;
+            int64_t oldest = 0;
+            sources.clear();
+            for (; it != last && it->dest == dest; ++it) {
+                auto next = it + 1;
+                if (next != last && next->dest == dest && next->nc == it->nc && next->source == it->source) {
+                    superseded[p]++;
+                    continue;
+                }
+                if (it->nc == kInvalidNc) {
+                    row->unresolved++;
+                    continue;
+                }
+                NeighborCell cell;
+                cell.lastSuccess = it->lastSuccess;
+                cell.lastAttempt = it->ObservedAt();
+                cell.source = it->source;
+                cell.lastResult = it->status;
+                cell.consecutiveFailures = static_cast<uint16_t>(std::min<uint32_t>(0xFFFF, it->failures));
+                cell.nc = static_cast<NcId>(it->nc);
+                row->neighbors.push_back(cell);
+                if (it->lastSuccess > 0 && (oldest == 0 || it->lastSuccess < oldest)) oldest = it->lastSuccess;
+                if (it->source != dest) sources.push_back(it->source);
+            }
+            matrix.Update(dest, row);
+            isDestination[dest] = 1;
+
+            const ReplicationSummary summary = matrix.Summarize(dest);
+            DcRecord& r = model.records[dest];
+            r.status = ProbeStatus::Ok;
+            r.probedAt = dumpTime;
+            r.partners = summary.partners;
+            r.failingPartners = summary.failingPartners;
+            r.lastReplication = summary.lastSuccess;
+            if (oldest > 0) {
+                r.latencySec = static_cast<uint32_t>(
+                    std::min<int64_t>(std::max<int64_t>(0, dumpTime - oldest) / 1000, kUnknownLatency - 1));
+            }
+            r.lag = r.HasLatency() ? ClassifyLatency(r.latencySec, r.failingPartners, options.latency) : LagClass::Unknown;
+
+            std::sort(sources.begin(), sources.end());
+            sources.erase(std::unique(sources.begin(), sources.end()), sources.end());
+            for (DcId source : sources) {
+                ReplicationLink link;
+                link.source = source;
+                link.dest = dest;
+                link.scheduleSec = siteOf[source] == siteOf[dest] ? options.schedule.intraSiteSec : options.schedule.interSiteSec;
+                partitionLinks[p].push_back(link);
+            }
+        }
+    });
+    for (DcId id = 0; id < model.Size(); id++) {
+        if (!isDestination[id]) model.records[id].status = ProbeStatus::Unreachable;
+    }
+    for (size_t p = 0; p < partitions; p++) {
+        stats.superseded += superseded[p];
+        working->links.insert(working->links.end(), partitionLinks[p].begin(), partitionLinks[p].end());
+    }
+    std::sort(working->links.begin(), working->links.end(), [](const ReplicationLink& a, const ReplicationLink& b) {
+        return a.dest != b.dest ? a.dest < b.dest : a.source < b.source;
+    });
+    FinishImportedSnapshot(*working, dumpTime);
+    stats.mergeMs = millis(t0);
+    snapshot = working;
+    return true;
+}
+
+// "1d.02h:03m:04s", "45m:12s", ":04s" or ">60 days" in seconds; -1 when
+// there is no duration
+inline int64_t ParseReplSummaryDelta(std::string_view text) {
+    int64_t total = 0, value = 0;
+    bool digits = false, any = false;
+    for (char c : text) {
+        if (c >= '0' && c <= '9') {
+            value = value * 10 + (c - '0');
+            digits = true;
+            continue;
+        }
+        if (c == ' ') continue;             // ">60 days"
+        if (digits) {
+            const int64_t unit = c == 'd' ? 86400 : c == 'h' ? 3600 : c == 'm' ? 60 : c == 's' ? 1 : 0;
+            if (unit) {
+                total += value * unit;
+                any = true;
+            }
+        }
+        value = 0;
+        digits = false;
+    }
+    return any ? total : -1;
+}
+
+// repadmin /replsummary text: two tables, source DSAs then destination
+// DSAs ("largest delta", "fails/total", error), then the DCs that could
+// not be queried. Headers are recognised by their "%%" column, not their
+// words, so localised output reads too. Destinations get Ok, their largest
+// delta as latency and fails/total as failing and total links; DCs in the
+// error list, and sources never listed as destinations, are Unreachable.
+// There are neither sites nor links. Small files: one sequential pass.
+inline bool ImportReplSummary(const char* data, size_t size, const RepadminImportOptions& options, SnapshotPtr& snapshot,
+                              RepadminImportStats& stats, std::string& error) {
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point t0 = Clock::now();
+    auto working = std::make_shared<ScanSnapshot>();
+    ReplicationModel& model = working->model;
+    std::vector<uint8_t> listed;            // 1 source, 2 destination, 3 unreachable
+    auto mark = [&](std::string_view name, uint8_t what) {
+        const DcId id = model.AddDc(L"", Utf8ToWide(name.data(), name.size()));
+        if (id >= listed.size()) listed.resize(id + 1, 0);
+        listed[id] = std::max(listed[id], what);
+        return id;
+    };
+    auto trim = [](std::string_view s) {
+        while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+        while (!s.empty() && (s.back() == ' ' || s.back() == '\t' || s.back() == '\r')) s.remove_suffix(1);
+        return s;
+    };
+
+    struct Destination {
+        DcId id;
+        int64_t deltaSec;
+        uint32_t fails;
+        uint32_t total;
+    };
+    std::vector<Destination> destinations;
+    int tables = 0;
+    bool inTable = false;
+    for (size_t pos = 0; pos < size;) {
+        const char* nl = static_cast<const char*>(std::memchr(data + pos, '\n', size - pos));
+        const size_t end = nl ? static_cast<size_t>(nl - data) : size;
+        const std::string_view raw(data + pos, end - pos);
+        pos = end + 1;
+        const std::string_view line = trim(raw);
+        stats.records++;
+        if (line.empty()) {
+            inTable = false;
+            continue;
+        }
+        if (tables == 0 && stats.dumpTime == 0) {
+            for (size_t k = 0; k + 19 <= line.size(); k++) {
+                if (line[k + 4] == '-' && line[k + 7] == '-' && line[k + 13] == ':' && line[k + 16] == ':') {
+                    stats.dumpTime = ParseIsoTimestamp(line.data() + k, 19);
+                    if (stats.dumpTime) break;
+                }
+            }
+        }
+        if (line.find("%%") != std::string_view::npos) {
+            tables++;
+            inTable = true;
+            continue;
+        }
+        const size_t slash = line.find('/');
+        if (inTable && tables <= 2 && raw[0] == ' ' && slash != std::string_view::npos) {
+            // " DC01      01h:02m:03s    2 /  10   20  (1722) ..."
+            const size_t nameEnd = line.find_first_of(" \t");
+            size_t failsStart = line.find_last_not_of(' ', slash - 1);
+            while (failsStart != std::string_view::npos && failsStart > 0 && line[failsStart - 1] >= '0' && line[failsStart - 1] <= '9') {
+                failsStart--;
+            }
+            if (nameEnd == std::string_view::npos || failsStart == std::string_view::npos || failsStart <= nameEnd) {
+                stats.skipped++;
+                continue;
+            }
+            stats.rows++;
+            const std::string_view name = line.substr(0, nameEnd);
+            if (tables == 1) {
+                mark(name, 1);
+                continue;
+            }
+            Destination d;
+            d.id = mark(name, 2);
+            d.deltaSec = ParseReplSummaryDelta(line.substr(nameEnd, failsStart - nameEnd));
+            d.fails = ParseRepadminNumber(line.substr(failsStart, slash - failsStart));
+            d.total = ParseRepadminNumber(trim(line.substr(slash + 1)));
+            destinations.push_back(d);
+            continue;
+        }
+        inTable = false;
+        if (tables >= 2) {
+            // "58 - DC03.contoso.com": the DC could not be queried
+            const size_t dash = line.find(" - ");
+            if (dash != std::string_view::npos && line[0] >= '0' && line[0] <= '9') {
+                std::string_view name = trim(line.substr(dash + 3));
+                name = name.substr(0, name.find('.'));
+                if (!name.empty()) {
+                    mark(name, 3);
+                    stats.rows++;
+                    continue;
+                }
+            }
+        }
+        stats.skipped++;
+    }
+    if (destinations.empty()) {
+        error = "aucun tableau de destination dans le résumé repadmin /replsummary";
+        return false;
+    }
+    if (stats.dumpTime == 0) stats.dumpTime = UnixNowMs();
+
+    for (const Destination& d : destinations) {
+        DcRecord& r = model.records[d.id];
+        r.probedAt = stats.dumpTime;
+        r.partners = static_cast<uint16_t>(std::min<uint32_t>(0xFFFF, d.total));
+        r.failingPartners = static_cast<uint16_t>(std::min<uint32_t>(0xFFFF, d.fails));
+        if (d.deltaSec >= 0) {
+            r.latencySec = static_cast<uint32_t>(std::min<int64_t>(d.deltaSec, kUnknownLatency - 1));
+            r.lastReplication = stats.dumpTime - d.deltaSec * 1000;
+        }
+        r.lag = r.HasLatency() ? ClassifyLatency(r.latencySec, r.failingPartners, options.latency) : LagClass::Unknown;
+    }
+    for (DcId id = 0; id < model.Size(); id++) {
+        model.records[id].status = listed[id] == 2 ? ProbeStatus::Ok : ProbeStatus::Unreachable;
+    }
+    FinishImportedSnapshot(*working, stats.dumpTime);
+    stats.chunks = 1;
+    stats.parseMs = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t0).count() / 1000.0;
+    snapshot = working;
+    return true;
+}
+
+// A repadmin dump in memory, format told by its content: showrepl_ tags or
+// a "Destination DSA Site" header make a showrepl CSV, a "%%" column a
+// replsummary. UTF-16LE (PowerShell redirection) is converted first.
+inline bool ImportRepadminBuffer(const char* data, size_t size, const RepadminImportOptions& options, SnapshotPtr& snapshot,
+                                 RepadminImportStats& stats, std::string& error) {
+    stats = RepadminImportStats();
+    stats.bytes = size;
+    if (size >= 2 && static_cast<unsigned char>(data[0]) == 0xFF && static_cast<unsigned char>(data[1]) == 0xFE) {
+        const std::string utf8 = Utf16LeToUtf8(data + 2, size - 2);
+        const bool ok = ImportRepadminBuffer(utf8.data(), utf8.size(), options, snapshot, stats, error);
+        stats.bytes = size;
+        return ok;
+    }
+    if (size >= 3 && std::memcmp(data, "\xEF\xBB\xBF", 3) == 0) {
+        data += 3;
+        size -= 3;
+    }
+    const std::string_view head(data, std::min<size_t>(size, 64 * 1024));
+    if (head.find("showrepl_") != std::string_view::npos || head.find("Destination DSA Site") != std::string_view::npos) {
+        stats.format = RepadminFormat::ShowreplCsv;
+        return ImportShowreplCsv(data, size, options, snapshot, stats, error);
+    }
+    if (head.find("%%") != std::string_view::npos) {
+        stats.format = RepadminFormat::ReplSummary;
+        return ImportReplSummary(data, size, options, snapshot, stats, error);
+    }
+    error = "format non reconnu (attendu : repadmin /showrepl * /csv ou repadmin /replsummary)";
+    return false;
+}
+
+// The file is mapped, not read: the parse workers share the page cache
+inline bool ImportRepadminFile(const std::wstring& path, const RepadminImportOptions& options, SnapshotPtr& snapshot,
+                               RepadminImportStats& stats, std::string& error) {
+    MappedFile file;
+    if (!file.Open(path, false)) {
+        error = "lecture impossible";
+        return false;
+    }
+    return ImportRepadminBuffer(reinterpret_cast<const char*>(file.Data()), file.Size(), options, snapshot, stats, error);
+}
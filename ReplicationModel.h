@@ -0,0 +1,319 @@
+// ReplicationModel.h
+// Modèle de réplication typé et compact (identifiants internés, USN 64 bits, statuts énumérés)
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "DirectoryBackend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+typedef uint32_t SiteId;
+typedef uint32_t DcId;
+
+const uint32_t kInvalidId = std::numeric_limits<uint32_t>::max();
+const uint32_t kUnknownLatency = std::numeric_limits<uint32_t>::max();
+
+// Maps names to dense, stable integer IDs.
+class StringInterner {
+public:
+    uint32_t Intern(const std::wstring& name) {
+        auto it = m_ids.find(name);
+        if (it != m_ids.end()) return it->second;
+        uint32_t id = static_cast<uint32_t>(m_names.size());
+        m_names.push_back(name);
+        m_ids.emplace(name, id);
+        return id;
+    }
+
+    uint32_t Find(const std::wstring& name) const {
+        auto it = m_ids.find(name);
+        return it == m_ids.end() ? kInvalidId : it->second;
+    }
+
+    const std::wstring& Name(uint32_t id) const { return m_names[id]; }
+    size_t Size() const { return m_names.size(); }
+
+    void Clear() {
+        m_names.clear();
+        m_ids.clear();
+    }
+
+private:
+    std::vector<std::wstring> m_names;
+    std::unordered_map<std::wstring, uint32_t> m_ids;
+};
+
+enum class LagClass : uint8_t {
+    Unknown,
+    InSync,
+    Minor,
+    Moderate,
+    Severe
+};
+
+enum class EventState : uint8_t {
+    Unknown,
+    Ok,
+    Unavailable
+};
+
+// One fixed-size record per DC, indexed by DcId. Timestamps are Unix ms.
+struct DcRecord {
+    uint64_t usn = 0;
+    int64_t probedAt = 0;
+    int64_t lastReplication = 0;
+    uint64_t invocation = 0;            // InvocationKey of the DC's invocationId, 0 unknown
+    uint32_t probeMs = 0;
+    uint32_t errorTotal = 0;
+    uint32_t latencySec = kUnknownLatency;  // oldest inbound UTD cursor when polled
+    SiteId site = kInvalidId;
+    uint16_t partners = 0;
+    uint16_t failingPartners = 0;
+    ProbeStatus status = ProbeStatus::Cancelled;
+    LagClass lag = LagClass::Unknown;
+    EventState events = EventState::Unknown;
+
+    bool HasUsn() const { return status == ProbeStatus::Ok; }
+    bool HasLatency() const { return latencySec != kUnknownLatency; }
+};
+
+// 64-bit FNV-1a of an invocationId as discovery reads it (hex, case
+// folded): records compare invocation IDs without holding strings. 0 is
+// kept for "unknown".
+inline uint64_t InvocationKey(const std::wstring& invocationId) {
+    if (invocationId.empty()) return 0;
+    uint64_t h = 1469598103934665603ull;
+    for (wchar_t c : invocationId) {
+        h ^= static_cast<uint64_t>((c >= L'A' && c <= L'Z') ? c + 32 : c);
+        h *= 1099511628211ull;
+    }
+    return h ? h : 1;
+}
+
+// Inbound replication link: dest pulls from source (an enabled
+// nTDSConnection). scheduleSec is how long a change can wait on the link by
+// configuration alone.
+struct ReplicationLink {
+    DcId source = kInvalidId;
+    DcId dest = kInvalidId;
+    uint32_t scheduleSec = 0;
+};
+
+// Flat store for one scan. Per-DC event counts are kept in a separate dense
+// array (dc * eventIds.size() + k) so DcRecord stays fixed-size.
+class ReplicationModel {
+public:
+    StringInterner sites;
+    StringInterner dcs;
+    std::vector<DcRecord> records;
+    std::vector<uint32_t> eventIds;
+    std::vector<uint32_t> eventCounts;
+
+    void Clear() {
+        sites.Clear();
+        dcs.Clear();
+        records.clear();
+        eventCounts.clear();
+    }
+
+    void Reserve(size_t dcCount) {
+        records.reserve(dcCount);
+        eventCounts.reserve(dcCount * eventIds.size());
+    }
+
+    void SetEventIds(const std::vector<uint32_t>& ids) {
+        eventIds = ids;
+        eventCounts.assign(records.size() * eventIds.size(), 0);
+    }
+
+    DcId AddDc(const std::wstring& site, const std::wstring& dc) {
+        DcId id = dcs.Intern(dc);
+        if (id == records.size()) {
+            records.emplace_back();
+            eventCounts.resize(eventCounts.size() + eventIds.size(), 0);
+        }
+        records[id].site = sites.Intern(site);
+        return id;
+    }
+
+    size_t Size() const { return records.size(); }
+    const std::wstring& SiteName(DcId id) const { return sites.Name(records[id].site); }
+    const std::wstring& DcName(DcId id) const { return dcs.Name(id); }
+
+    uint32_t* EventCountsOf(DcId id) { return eventCounts.data() + static_cast<size_t>(id) * eventIds.size(); }
+    const uint32_t* EventCountsOf(DcId id) const { return eventCounts.data() + static_cast<size_t>(id) * eventIds.size(); }
+};
+
+struct UsnThresholds {
+    uint64_t minor = 1000;
+    uint64_t moderate = 10000;
+};
+
+// Measured latency buckets. The defaults follow AD's own schedules: intra-
+// site changes arrive within minutes, inter-site links replicate every 3 h.
+struct LatencyThresholds {
+    uint32_t inSyncSec = 15 * 60;
+    uint32_t minorSec = 3 * 3600;
+    uint32_t moderateSec = 24 * 3600;
+};
+
+struct UsnSpread {
+    size_t count = 0;
+    uint64_t minUsn = 0;
+    uint64_t maxUsn = 0;
+    DcId minDc = kInvalidId;
+    DcId maxDc = kInvalidId;
+
+    uint64_t Diff() const { return maxUsn - minUsn; }
+};
+
+inline UsnSpread ComputeUsnSpread(const ReplicationModel& model) {
+    UsnSpread spread;
+    for (DcId id = 0; id < model.records.size(); id++) {
+        const DcRecord& r = model.records[id];
+        if (!r.HasUsn()) continue;
+        if (spread.count == 0 || r.usn > spread.maxUsn) {
+            spread.maxUsn = r.usn;
+            spread.maxDc = id;
+        }
+        if (spread.count == 0 || r.usn < spread.minUsn) {
+            spread.minUsn = r.usn;
+            spread.minDc = id;
+        }
+        spread.count++;
+    }
+    return spread;
+}
+
+inline LagClass ClassifyUsnDiff(uint64_t diff, const UsnThresholds& thresholds) {
+    if (diff == 0) return LagClass::InSync;
+    if (diff < thresholds.minor) return LagClass::Minor;
+    if (diff < thresholds.moderate) return LagClass::Moderate;
+    return LagClass::Severe;
+}
+
+inline LagClass ClassifyLatency(uint32_t latencySec, uint16_t failingPartners, const LatencyThresholds& thresholds) {
+    if (latencySec <= thresholds.inSyncSec) return failingPartners ? LagClass::Minor : LagClass::InSync;
+    if (latencySec <= thresholds.minorSec) return LagClass::Minor;
+    if (latencySec <= thresholds.moderateSec) return LagClass::Moderate;
+    return LagClass::Severe;
+}
+
+// Classifies every DC from its measured latency. DCs without replica
+// metadata fall back to the distance to the highest USN of the scan, which
+// needs at least two DCs with a USN; otherwise their lag stays Unknown.
+inline UsnSpread ClassifyLag(ReplicationModel& model, const UsnThresholds& thresholds = UsnThresholds(),
+                             const LatencyThresholds& latency = LatencyThresholds()) {
+    UsnSpread spread = ComputeUsnSpread(model);
+    for (auto& r : model.records) {
+        if (r.HasLatency()) {
+            r.lag = ClassifyLatency(r.latencySec, r.failingPartners, latency);
+        } else {
+            r.lag = (spread.count > 1 && r.HasUsn()) ? ClassifyUsnDiff(spread.maxUsn - r.usn, thresholds) : LagClass::Unknown;
+        }
+    }
+    return spread;
+}
+
+// ClassifyLag kept up to date one row at a time, for rows streamed while a
+// scan runs. DCs with a USN sit in a set ordered by USN, so the running min
+// and max are its ends; when the max moves, only DCs whose distance to it
+// crosses a threshold change class, and range lookups find them without a
+// pass over the forest. After the last Update() the classes and Spread()
+// are those ClassifyLag gives.
+class LagTracker {
+public:
+    explicit LagTracker(const UsnThresholds& thresholds = UsnThresholds(),
+                        const LatencyThresholds& latency = LatencyThresholds())
+        : m_thresholds(thresholds), m_latency(latency) {}
+
+    // Row id changed (probe result, replica metadata): classifies it, and
+    // appends every other DC whose class the change moved to reclassified
+    void Update(ReplicationModel& model, DcId id, std::vector<DcId>& reclassified) {
+        if (model.Size() > m_usnOf.size()) {
+            m_usnOf.resize(model.Size(), 0);
+            m_tracked.resize(model.Size(), false);
+        }
+        const size_t countBefore = m_spread.count;
+        const uint64_t maxBefore = m_spread.maxUsn;
+
+        if (m_tracked[id]) {
+            m_all.erase({m_usnOf[id], id});
+            m_byUsn.erase({m_usnOf[id], id});
+            m_tracked[id] = false;
+        }
+        const DcRecord& r = model.records[id];
+        if (r.HasUsn()) {
+            m_all.insert({r.usn, id});
+            if (!r.HasLatency()) m_byUsn.insert({r.usn, id});
+            m_usnOf[id] = r.usn;
+            m_tracked[id] = true;
+        }
+
+        m_spread = UsnSpread();
+        if (!m_all.empty()) {
+            m_spread.count = m_all.size();
+            m_spread.minUsn = m_all.begin()->first;
+            m_spread.minDc = m_all.begin()->second;
+            m_spread.maxUsn = m_all.rbegin()->first;
+            m_spread.maxDc = m_all.lower_bound({m_spread.maxUsn, 0})->second;     // lowest id, as ComputeUsnSpread
+        }
+
+        if ((countBefore > 1) != (m_spread.count > 1)) {
+            for (const auto& entry : m_byUsn) Reclassify(model, entry.second, id, reclassified);
+        } else if (m_spread.count > 1 && maxBefore != m_spread.maxUsn) {
+            // Distance max - u crosses threshold t for u in (lo - t, hi - t]
+            const int64_t lo = static_cast<int64_t>(std::min(maxBefore, m_spread.maxUsn));
+            const int64_t hi = static_cast<int64_t>(std::max(maxBefore, m_spread.maxUsn));
+            for (uint64_t t : {uint64_t(1), m_thresholds.minor, m_thresholds.moderate}) {
+                const int64_t last = hi - static_cast<int64_t>(t);
+                if (last < 0) continue;
+                const int64_t first = std::max<int64_t>(0, lo - static_cast<int64_t>(t) + 1);
+                for (auto it = m_byUsn.lower_bound({static_cast<uint64_t>(first), 0});
+                     it != m_byUsn.end() && it->first <= static_cast<uint64_t>(last); ++it) {
+                    Reclassify(model, it->second, id, reclassified);
+                }
+            }
+        }
+        model.records[id].lag = Classify(model.records[id]);
+    }
+
+    const UsnSpread& Spread() const { return m_spread; }
+
+private:
+    LagClass Classify(const DcRecord& r) const {
+        if (r.HasLatency()) return ClassifyLatency(r.latencySec, r.failingPartners, m_latency);
+        return (m_spread.count > 1 && r.HasUsn()) ? ClassifyUsnDiff(m_spread.maxUsn - r.usn, m_thresholds) : LagClass::Unknown;
+    }
+
+    void Reclassify(ReplicationModel& model, DcId dc, DcId updated, std::vector<DcId>& reclassified) const {
+        if (dc == updated) return;
+        const LagClass lag = Classify(model.records[dc]);
+        if (lag == model.records[dc].lag) return;
+        model.records[dc].lag = lag;
+        reclassified.push_back(dc);
+    }
+
+    UsnThresholds m_thresholds;
+    LatencyThresholds m_latency;
+    std::set<std::pair<uint64_t, DcId>> m_all;      // every DC with a USN
+    std::set<std::pair<uint64_t, DcId>> m_byUsn;    // ... of which those classified by USN distance
+    std::vector<uint64_t> m_usnOf;                  // USN each tracked DC was inserted with
+    std::vector<bool> m_tracked;
+    UsnSpread m_spread;
+};
+
+inline int64_t UnixNowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,470 @@
+// ReportExporter.h
+// Export en flux du modèle de scan (CSV RFC 4180 UTF-8, NDJSON, binaire compact) via un tampon d'écriture
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "ScanSnapshot.h"
+#include "Utf8.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class ExportFormat : uint8_t {
+    Csv,
+    Ndjson,
+    Binary,
+    Json                                // one array of the NDJSON objects
+};
+
+// Large write-behind buffer over a FILE*. Numbers are formatted in place,
+// so appending a cell never allocates.
+class BufferedWriter {
+public:
+    explicit BufferedWriter(size_t capacity = 1 << 20) : m_buffer(capacity) {}
+    ~BufferedWriter() { Close(); }
+
+    BufferedWriter(const BufferedWriter&) = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+    // "-" writes to standard output, which is flushed but left open
+    bool Open(const std::wstring& path) {
+        Close();
+        if (path == L"-") {
+#ifdef _WIN32
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+            m_file = stdout;
+            m_failed = false;
+            return true;
+        }
+#ifdef _WIN32
+        m_file = _wfopen(path.c_str(), L"wb");
+#else
+        m_file = std::fopen(WideToUtf8(path).c_str(), "wb");
+#endif
+        m_failed = m_file == nullptr;
+        return m_file != nullptr;
+    }
+
+    // Returns false if any write failed since Open
+    bool Close() {
+        if (!m_file) return !m_failed;
+        Flush();
+        if (m_file == stdout ? std::fflush(m_file) != 0 : std::fclose(m_file) != 0) m_failed = true;
+        m_file = nullptr;
+        return !m_failed;
+    }
+
+    void Write(const void* data, size_t size) {
+        if (m_used + size > m_buffer.size()) {
+            Flush();
+            if (size > m_buffer.size()) {
+                WriteThrough(data, size);
+                return;
+            }
+        }
+        std::memcpy(m_buffer.data() + m_used, data, size);
+        m_used += size;
+    }
+
+    void Write(const std::string& s) { Write(s.data(), s.size()); }
+
+    void Put(char c) {
+        if (m_used == m_buffer.size()) Flush();
+        m_buffer[m_used++] = c;
+    }
+
+    void PutUnsigned(uint64_t v) {
+        char tmp[20];
+        size_t n = 0;
+        do {
+            tmp[n++] = static_cast<char>('0' + v % 10);
+            v /= 10;
+        } while (v);
+        if (m_used + n > m_buffer.size()) Flush();
+        while (n) m_buffer[m_used++] = tmp[--n];
+    }
+
+    void PutSigned(int64_t v) {
+        if (v < 0) {
+            Put('-');
+            PutUnsigned(0 - static_cast<uint64_t>(v));
+        } else {
+            PutUnsigned(static_cast<uint64_t>(v));
+        }
+    }
+
+    // Little-endian fixed-width integers for the binary format
+    template <typename T>
+    void PutLe(T v) {
+        unsigned char bytes[sizeof(T)];
+        for (size_t i = 0; i < sizeof(T); i++) bytes[i] = static_cast<unsigned char>(static_cast<uint64_t>(v) >> (8 * i));
+        Write(bytes, sizeof(T));
+    }
+
+    void Flush() {
+        if (m_used == 0) return;
+        WriteThrough(m_buffer.data(), m_used);
+        m_used = 0;
+    }
+
+    uint64_t BytesWritten() const { return m_written + m_used; }
+
+private:
+    void WriteThrough(const void* data, size_t size) {
+        if (!m_file || std::fwrite(data, 1, size, m_file) != size) m_failed = true;
+        m_written += size;
+    }
+
+    std::vector<char> m_buffer;
+    size_t m_used = 0;
+    uint64_t m_written = 0;
+    std::FILE* m_file = nullptr;
+    bool m_failed = false;
+};
+
+inline const char* ProbeStatusName(ProbeStatus status) {
+    switch (status) {
+        case ProbeStatus::Ok:          return "ok";
+        case ProbeStatus::Unreachable: return "unreachable";
+        case ProbeStatus::Timeout:     return "timeout";
+        default:                       return "cancelled";
+    }
+}
+
+inline const char* LagClassName(LagClass lag) {
+    switch (lag) {
+        case LagClass::InSync:   return "in_sync";
+        case LagClass::Minor:    return "minor";
+        case LagClass::Moderate: return "moderate";
+        case LagClass::Severe:   return "severe";
+        default:                 return "unknown";
+    }
+}
+
+// Writes rows of a scan to one file. Begin() takes the scan's topology
+// snapshot and encodes every site and DC name once (already escaped for
+// the format), so a row costs a few memcpy and integer conversions.
+// The binary format is little-endian:
+//   "ADRX" u16 version u16 eventIdCount u32 eventIds[]
+//   u32 siteCount { u16 len, utf8 }  u32 dcCount { u16 len, utf8 }
+//   rows: u32 dc u32 site u8 status u8 lag u8 events u8 0 u64 usn
+//         i64 probedAt i64 lastReplication u32 probeMs u32 latencySec
+//         u32 errorTotal u16 partners u16 failingPartners u32 counts[]
+class ReportExporter {
+public:
+    explicit ReportExporter(ExportFormat format, size_t bufferSize = 1 << 20)
+        : m_format(format), m_out(bufferSize) {}
+
+    bool Open(const std::wstring& path) { return m_out.Open(path); }
+    bool Close() { return m_out.Close(); }
+    uint64_t RowsWritten() const { return m_rows; }
+    uint64_t BytesWritten() const { return m_out.BytesWritten(); }
+
+    // For callers that wrap the rows in a larger document
+    BufferedWriter& Writer() { return m_out; }
+
+    void Begin(const ReplicationModel& topology) {
+        m_rows = 0;
+        m_eventIds = topology.eventIds;
+        m_siteNames = EncodeNames(topology.sites);
+        m_dcNames = EncodeNames(topology.dcs);
+        WriteHeader();
+    }
+
+    // Rows whose names come with each row (a pipelined scan has no
+    // topology to encode up front). Csv, Ndjson and Json only: the binary
+    // format needs the name tables before the rows.
+    void BeginStream(const std::vector<uint32_t>& eventIds) {
+        m_rows = 0;
+        m_eventIds = eventIds;
+        m_siteNames.clear();
+        m_dcNames.clear();
+        WriteHeader();
+    }
+
+    void WriteRow(DcId id, const DcRecord& r, const uint32_t* counts) {
+        if (id >= m_dcNames.size()) return;
+        const std::string& site = r.site < m_siteNames.size() ? m_siteNames[r.site] : m_empty;
+        switch (m_format) {
+            case ExportFormat::Csv:    WriteCsv(site, m_dcNames[id], r, counts); break;
+            case ExportFormat::Ndjson:
+            case ExportFormat::Json:   WriteJson(site, m_dcNames[id], r, counts); break;
+            case ExportFormat::Binary: WriteBinary(id, r, counts); break;
+        }
+        m_rows++;
+    }
+
+    void WriteRow(const std::wstring& site, const std::wstring& dc, const DcRecord& r, const uint32_t* counts) {
+        switch (m_format) {
+            case ExportFormat::Csv:    WriteCsv(EncodeName(site), EncodeName(dc), r, counts); break;
+            case ExportFormat::Ndjson:
+            case ExportFormat::Json:   WriteJson(EncodeName(site), EncodeName(dc), r, counts); break;
+            case ExportFormat::Binary: return;
+        }
+        m_rows++;
+    }
+
+    // One row per DC of a finished (or partial) scan
+    void WriteSnapshot(const ScanSnapshot& snapshot) {
+        const ReplicationModel& model = snapshot.model;
+        Begin(model);
+        for (DcId id = 0; id < model.Size(); id++) WriteRow(id, model.records[id], model.EventCountsOf(id));
+        End();
+    }
+
+    // Closes the JSON array; nothing to do for the other formats
+    void End() {
+        if (m_format == ExportFormat::Json) Text("]\n");
+    }
+
+    void WriteBatch(const RowBatch& batch) {
+        size_t ids = m_eventIds.size();
+        for (size_t i = 0; i < batch.rows.size(); i++) {
+            WriteRow(batch.rows[i].id, batch.rows[i].record, batch.eventCounts.data() + i * ids);
+        }
+    }
+
+    void Flush() { m_out.Flush(); }
+
+    static std::string JsonString(const std::string& s) {
+        static const char hex[] = "0123456789abcdef";
+        std::string out = "\"";
+        for (unsigned char c : s) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += static_cast<char>(c);
+            } else if (c < 0x20) {
+                out += "\\u00";
+                out += hex[c >> 4];
+                out += hex[c & 0xF];
+            } else {
+                out += static_cast<char>(c);
+            }
+        }
+        return out + "\"";
+    }
+
+    // ISO 8601 UTC, second precision
+    static size_t FormatTimestamp(int64_t unixMs, char (&text)[24]) {
+        std::time_t t = static_cast<std::time_t>(unixMs / 1000);
+        std::tm utc;
+#ifdef _WIN32
+        gmtime_s(&utc, &t);
+#else
+        gmtime_r(&t, &utc);
+#endif
+        return std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%SZ", &utc);
+    }
+
+private:
+    void WriteHeader() {
+        if (m_format == ExportFormat::Csv) {
+            m_out.Write("\xEF\xBB\xBF", 3);     // BOM, so Excel detects UTF-8
+            Text("Site,DC,Statut,USN,Partenaires,PartenairesEnEchec,DerniereReplic,LatenceSec,Latence,Erreurs");
+            for (uint32_t id : m_eventIds) {
+                Text(",Evt");
+                m_out.PutUnsigned(id);
+            }
+            m_out.Write("\r\n", 2);
+        } else if (m_format == ExportFormat::Json) {
+            m_out.Put('[');
+        } else if (m_format == ExportFormat::Binary) {
+            m_out.Write("ADRX", 4);
+            m_out.PutLe<uint16_t>(1);
+            m_out.PutLe<uint16_t>(static_cast<uint16_t>(m_eventIds.size()));
+            for (uint32_t id : m_eventIds) m_out.PutLe<uint32_t>(id);
+            for (const auto* names : {&m_siteNames, &m_dcNames}) {
+                m_out.PutLe<uint32_t>(static_cast<uint32_t>(names->size()));
+                for (const auto& n : *names) {
+                    m_out.PutLe<uint16_t>(static_cast<uint16_t>(n.size()));
+                    m_out.Write(n);
+                }
+            }
+        }
+    }
+
+    std::string EncodeName(const std::wstring& name) const {
+        std::string utf8 = WideToUtf8(name);
+        return m_format == ExportFormat::Csv ? CsvField(utf8) : m_format == ExportFormat::Binary ? utf8 : JsonString(utf8);
+    }
+
+    std::vector<std::string> EncodeNames(const StringInterner& names) const {
+        std::vector<std::string> out(names.Size());
+        for (uint32_t i = 0; i < names.Size(); i++) out[i] = EncodeName(names.Name(i));
+        return out;
+    }
+
+    // RFC 4180: quote fields holding a comma, quote or line break and
+    // double the embedded quotes
+    static std::string CsvField(const std::string& s) {
+        if (s.find_first_of(",\"\r\n") == std::string::npos) return s;
+        std::string out = "\"";
+        for (char c : s) {
+            if (c == '"') out += '"';
+            out += c;
+        }
+        return out + "\"";
+    }
+
+    void PutTimestamp(int64_t unixMs) {
+        char text[24];
+        m_out.Write(text, FormatTimestamp(unixMs, text));
+    }
+
+    void WriteCsv(const std::string& site, const std::string& dc, const DcRecord& r, const uint32_t* counts) {
+        m_out.Write(site);
+        m_out.Put(',');
+        m_out.Write(dc);
+        m_out.Put(',');
+        Text(ProbeStatusName(r.status));
+        m_out.Put(',');
+        if (r.HasUsn()) m_out.PutUnsigned(r.usn);
+        m_out.Put(',');
+        m_out.PutUnsigned(r.partners);
+        m_out.Put(',');
+        m_out.PutUnsigned(r.failingPartners);
+        m_out.Put(',');
+        if (r.lastReplication > 0) PutTimestamp(r.lastReplication);
+        m_out.Put(',');
+        if (r.HasLatency()) m_out.PutUnsigned(r.latencySec);
+        m_out.Put(',');
+        Text(LagClassName(r.lag));
+        m_out.Put(',');
+        m_out.PutUnsigned(r.errorTotal);
+        for (size_t k = 0; k < m_eventIds.size(); k++) {
+            m_out.Put(',');
+            m_out.PutUnsigned(counts[k]);
+        }
+        m_out.Write("\r\n", 2);
+    }
+
+    void Text(const char* text) {
+        m_out.Write(text, std::strlen(text));
+    }
+
+    void WriteJson(const std::string& site, const std::string& dc, const DcRecord& r, const uint32_t* counts) {
+        if (m_format == ExportFormat::Json && m_rows > 0) m_out.Put(',');
+        Text("{\"site\":");
+        m_out.Write(site);
+        Text(",\"dc\":");
+        m_out.Write(dc);
+        Text(",\"status\":\"");
+        Text(ProbeStatusName(r.status));
+        Text("\",\"usn\":");
+        if (r.HasUsn()) m_out.PutUnsigned(r.usn); else Text("null");
+        Text(",\"partners\":");
+        m_out.PutUnsigned(r.partners);
+        Text(",\"failingPartners\":");
+        m_out.PutUnsigned(r.failingPartners);
+        Text(",\"lastReplication\":");
+        if (r.lastReplication > 0) {
+            m_out.Put('"');
+            PutTimestamp(r.lastReplication);
+            m_out.Put('"');
+        } else {
+            Text("null");
+        }
+        Text(",\"latencySec\":");
+        if (r.HasLatency()) m_out.PutUnsigned(r.latencySec); else Text("null");
+        Text(",\"lag\":\"");
+        Text(LagClassName(r.lag));
+        Text("\",\"probeMs\":");
+        m_out.PutUnsigned(r.probeMs);
+        Text(",\"errors\":");
+        m_out.PutUnsigned(r.errorTotal);
+        Text(",\"events\":{");
+        for (size_t k = 0; k < m_eventIds.size(); k++) {
+            if (k) m_out.Put(',');
+            m_out.Put('"');
+            m_out.PutUnsigned(m_eventIds[k]);
+            Text("\":");
+            m_out.PutUnsigned(counts[k]);
+        }
+        Text(m_format == ExportFormat::Json ? "}}" : "}}\n");
+    }
+
+    void WriteBinary(DcId id, const DcRecord& r, const uint32_t* counts) {
+        m_out.PutLe<uint32_t>(id);
+        m_out.PutLe<uint32_t>(r.site);
+        m_out.PutLe<uint8_t>(static_cast<uint8_t>(r.status));
+        m_out.PutLe<uint8_t>(static_cast<uint8_t>(r.lag));
+        m_out.PutLe<uint8_t>(static_cast<uint8_t>(r.events));
+        m_out.PutLe<uint8_t>(0);
+        m_out.PutLe<uint64_t>(r.usn);
+        m_out.PutLe<int64_t>(r.probedAt);
+        m_out.PutLe<int64_t>(r.lastReplication);
+        m_out.PutLe<uint32_t>(r.probeMs);
+        m_out.PutLe<uint32_t>(r.latencySec);
+        m_out.PutLe<uint32_t>(r.errorTotal);
+        m_out.PutLe<uint16_t>(r.partners);
+        m_out.PutLe<uint16_t>(r.failingPartners);
+        for (size_t k = 0; k < m_eventIds.size(); k++) m_out.PutLe<uint32_t>(counts[k]);
+    }
+
+    ExportFormat m_format;
+    BufferedWriter m_out;
+    std::vector<uint32_t> m_eventIds;
+    std::vector<std::string> m_siteNames;
+    std::vector<std::string> m_dcNames;
+    std::string m_empty;
+    uint64_t m_rows = 0;
+};
+
+inline bool ExportSnapshot(const ScanSnapshot& snapshot, ExportFormat format, const std::wstring& path) {
+    ReportExporter exporter(format);
+    if (!exporter.Open(path)) return false;
+    exporter.WriteSnapshot(snapshot);
+    return exporter.Close();
+}
+
+// Streams a scan to a file while it runs. Rows are written each time the
+// scanner reports them, so a DC can appear several times as its record
+// fills in; the last occurrence is the final one.
+class StreamingExportSubscriber : public IScanSubscriber {
+public:
+    StreamingExportSubscriber(ExportFormat format, std::wstring path)
+        : m_exporter(format), m_path(std::move(path)) {}
+
+    void OnScanStarted(const SnapshotPtr& topology) override {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_ok = m_exporter.Open(m_path);
+        if (m_ok) m_exporter.Begin(topology->model);
+    }
+
+    void OnRows(const RowBatch& batch) override {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_ok) m_exporter.WriteBatch(batch);
+    }
+
+    void OnScanCompleted(const SnapshotPtr& snapshot) override {
+        (void)snapshot;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_ok) return;
+        m_exporter.End();
+        m_ok = m_exporter.Close();
+    }
+
+    bool Ok() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_ok;
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    ReportExporter m_exporter;
+    std::wstring m_path;
+    bool m_ok = false;
+};
@@ -0,0 +1,5403 @@
+// ScanBenchmark.h
+// Mesure du scan sur forêts synthétiques : durée, premier résultat, phases, pic mémoire, allocations par DC, lecture d'événements, snapshots binaires, annulation, règles d'alerte, anomalies USN, sonde canari, pipeline à mémoire bornée, import repadmin, noms distinctifs, limites du moteur de sondage, découverte sur LDIF de référence, rejeu d'événements et signets, modèle de réplication, publication concurrente de snapshots, matrice de latence, historique des séries temporelles, journalisation asynchrone, exports CSV et JSON relus, histogrammes de latence et exposition Prometheus, pool de connexions, protocole collecteurs-agrégateur en boucle locale
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <malloc.h>
+#endif
+#endif
+
+#include "AlertRules.h"
+#include "CanaryProbe.h"
+#include "CollectorProtocol.h"
+#include "ConnectionPool.h"
+#include "DistinguishedName.h"
+#include "EventAnalysis.h"
+#include "EventParser.h"
+#include "ForestSimulator.h"
+#include "HealthCheck.h"
+#include "LdifDirectoryBackend.h"
+#include "PollScheduler.h"
+#include "PrometheusExporter.h"
+#include "RepadminImport.h"
+#include "ReportExporter.h"
+#include "ScanPipeline.h"
+#include "ScanEngine.h"
+#include "ScanSnapshot.h"
+#include "SnapshotFile.h"
+#include "TimeSeriesStore.h"
+#include "TopologyDiscovery.h"
+#include "TopologyGraph.h"
+#include "UsnAnomaly.h"
+#include "XmlEventSource.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Incremented by the entry point's replacement operator new; stays 0 when
+// the executable does not count allocations
+inline std::atomic<uint64_t>& AllocationCounter() {
+    static std::atomic<uint64_t> count{0};
+    return count;
+}
+
+// Peak resident set of the process so far, in KiB. Never decreases, so
+// run benchmark sizes in ascending order.
+inline uint64_t PeakRssKb() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = {};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return static_cast<uint64_t>(counters.PeakWorkingSetSize / 1024);
+#else
+    struct rusage usage = {};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return static_cast<uint64_t>(usage.ru_maxrss) / 1024;
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss);
+#endif
+#endif
+}
+
+// Resident set right now, in KiB: unlike the peak, it goes down when
+// memory is returned, so it can be sampled during a run
+inline uint64_t CurrentRssKb() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = {};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return static_cast<uint64_t>(counters.WorkingSetSize / 1024);
+#elif defined(__linux__)
+    std::FILE* f = std::fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    unsigned long long size = 0, resident = 0;
+    const int n = std::fscanf(f, "%llu %llu", &size, &resident);
+    std::fclose(f);
+    return n == 2 ? resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) / 1024 : 0;
+#else
+    return PeakRssKb();
+#endif
+}
+
+// Hands freed heap pages back to the system where the allocator keeps
+// them, so a baseline taken afterwards does not hide a later run's growth
+inline void ReleaseFreeMemory() {
+#if defined(__GLIBC__)
+    malloc_trim(0);
+#endif
+}
+
+// Highest CurrentRssKb() between Start() and Stop(), sampled every few ms
+class RssSampler {
+public:
+    void Start() {
+        m_peak = CurrentRssKb();
+        m_running = true;
+        m_thread = std::thread([this] {
+            while (m_running.load(std::memory_order_relaxed)) {
+                m_peak = std::max<uint64_t>(m_peak, CurrentRssKb());
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+        });
+    }
+
+    uint64_t Stop() {
+        m_running = false;
+        if (m_thread.joinable()) m_thread.join();
+        return m_peak = std::max<uint64_t>(m_peak, CurrentRssKb());
+    }
+
+private:
+    std::thread m_thread;
+    std::atomic<bool> m_running{false};
+    uint64_t m_peak = 0;
+};
+
+struct BenchmarkResult {
+    unsigned scan = 1;                  // 1 for the first scan of a forest, cold sessions
+    unsigned dcs = 0;
+    unsigned sites = 0;
+    size_t domains = 0;
+    size_t connections = 0;
+    size_t reachable = 0;
+    HealthStatus health = HealthStatus::Unknown;
+    int64_t generateMs = 0;             // forest generation, not part of the scan
+    int64_t wallMs = 0;                 // ScanEngine::Run, discovery to publication
+    int64_t firstRowMs = -1;            // first row batch delivered to subscribers
+    int64_t discoveryMs = 0;
+    int64_t probeMs = 0;
+    int64_t replicaMs = 0;
+    int64_t analysisMs = 0;             // health and USN spread of the finished snapshot
+    uint64_t peakRssKb = 0;
+    uint64_t allocations = 0;           // during the scan
+    double allocationsPerDc = 0;
+    uint64_t binds = 0;                 // binds the simulated DCs served during the scan
+};
+
+// Runs scans of the forest described by spec against the in-process
+// simulated backend, without event collection, one result per scan. Later
+// scans reuse the engine and the backend, so with spec.pooled they show
+// what the warm connection pool saves.
+inline std::vector<BenchmarkResult> RunScanBenchmark(const ForestSpec& spec, const ProbeOptions& probe, unsigned scans = 1) {
+    using Clock = std::chrono::steady_clock;
+    auto ms = [](Clock::duration d) { return std::chrono::duration_cast<std::chrono::milliseconds>(d).count(); };
+
+    Clock::time_point t0 = Clock::now();
+    ForestSimulator forest(spec);
+    const int64_t generateMs = ms(Clock::now() - t0);
+
+    // First-row timing from the subscriber side, as a front end sees it
+    struct FirstRow : IScanSubscriber {
+        std::mutex mutex;
+        Clock::time_point at;
+        bool seen = false;
+        void OnRows(const RowBatch&) override {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!seen) at = Clock::now();
+            seen = true;
+        }
+    };
+    auto firstRow = std::make_shared<FirstRow>();
+    SnapshotPublisher publisher;
+    publisher.Subscribe(firstRow);
+    ScanEngine engine(forest.Backend(), nullptr, probe);
+
+    std::vector<BenchmarkResult> results;
+    for (unsigned scan = 1; scan <= std::max(1u, scans); scan++) {
+        BenchmarkResult result;
+        result.scan = scan;
+        result.dcs = spec.dcs;
+        result.sites = spec.sites;
+        result.domains = forest.Domains();
+        result.connections = forest.Connections();
+        if (scan == 1) result.generateMs = generateMs;
+        {
+            std::lock_guard<std::mutex> lock(firstRow->mutex);
+            firstRow->seen = false;
+        }
+
+        Clock::time_point phaseStart[4] = {};
+        const uint64_t allocationsBefore = AllocationCounter().load(std::memory_order_relaxed);
+        const uint64_t bindsBefore = forest.Backend()->Binds();
+        const Clock::time_point start = Clock::now();
+        SnapshotPtr snapshot = engine.Run(publisher, forest.ConfigurationDn(), [&](ScanPhase phase) {
+            phaseStart[static_cast<size_t>(phase)] = Clock::now();
+        });
+        const Clock::time_point end = Clock::now();
+        result.allocations = AllocationCounter().load(std::memory_order_relaxed) - allocationsBefore;
+        result.binds = forest.Backend()->Binds() - bindsBefore;
+
+        result.wallMs = ms(end - start);
+        {
+            std::lock_guard<std::mutex> lock(firstRow->mutex);
+            if (firstRow->seen) result.firstRowMs = ms(firstRow->at - start);
+        }
+        result.discoveryMs = ms(phaseStart[1] - phaseStart[0]);
+        result.probeMs = ms(phaseStart[2] - phaseStart[1]);
+        result.replicaMs = ms(end - phaseStart[2]);
+        result.allocationsPerDc = spec.dcs ? static_cast<double>(result.allocations) / spec.dcs : 0;
+
+        if (snapshot) {
+            Clock::time_point analysis = Clock::now();
+            HealthReport health = EvaluateHealth(*snapshot);
+            result.analysisMs = ms(Clock::now() - analysis);
+            result.health = health.status;
+            result.reachable = health.reachable;
+        }
+        result.peakRssKb = PeakRssKb();
+        results.push_back(result);
+    }
+    return results;
+}
+
+struct GraphBenchmarkResult {
+    unsigned dcs = 0;
+    unsigned sites = 0;
+    size_t edges = 0;
+    int64_t buildMs = 0;                // discovery of the generated forest, links and CSR
+    int64_t boundsMs = 0;               // full staleness bounds, every DC
+    int64_t articulationMs = 0;
+    size_t articulationPoints = 0;
+    int64_t islandsMs = 0;              // IslandsWithout() for every articulation point
+    size_t isolatedSites = 0;           // summed over the articulation points
+    uint32_t convergenceSec = 0;
+    size_t updates = 0;
+    double updateAvgMs = 0;
+    double updateMaxMs = 0;
+    size_t fullRecomputes = 0;          // updates that fell back to a full pass
+    size_t mismatches = 0;              // DCs whose incremental bound differs from a rebuild
+};
+
+// Builds the replication graph of a generated forest and times the full
+// bound computation, articulation points, islands and `updates` single-link
+// changes (new delays, links going down and coming back), then checks the
+// incrementally maintained bounds against a rebuild. Link delays are the
+// schedule plus a seeded stand-in for the observed sync age.
+inline GraphBenchmarkResult RunGraphBenchmark(const ForestSpec& spec, unsigned workers, unsigned updates = 100) {
+    using Clock = std::chrono::steady_clock;
+    auto ms = [](Clock::duration d) { return std::chrono::duration_cast<std::chrono::milliseconds>(d).count(); };
+    auto mix = [](uint64_t x) {
+        x ^= x >> 30; x *= 0xBF58476D1CE4E5B9ull;
+        x ^= x >> 27; x *= 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    };
+
+    GraphBenchmarkResult result;
+    result.dcs = spec.dcs;
+    result.sites = spec.sites;
+    ForestSimulator forest(spec);
+
+    Clock::time_point t0 = Clock::now();
+    ForestTopology topology;
+    DiscoverTopology(*forest.Backend(), forest.ConfigurationDn(), topology);
+    std::vector<DcId> dcOfServer(topology.servers.size(), kInvalidId);
+    std::vector<SiteId> siteOfDc;
+    for (size_t i = 0; i < topology.servers.size(); i++) {
+        if (!topology.servers[i].IsDc()) continue;
+        dcOfServer[i] = static_cast<DcId>(siteOfDc.size());
+        siteOfDc.push_back(topology.servers[i].site);
+    }
+    std::vector<TopologyGraph::Edge> edges;
+    for (const ReplicationLink& link : BuildReplicationLinks(topology, dcOfServer)) {
+        uint64_t h = mix(spec.seed ^ (static_cast<uint64_t>(link.source) << 32) ^ link.dest);
+        edges.push_back({link.source, link.dest, link.scheduleSec + static_cast<uint32_t>(h % (link.scheduleSec + 1))});
+    }
+    const size_t dcCount = siteOfDc.size();
+    TopologyGraph graph(dcCount, edges, siteOfDc);
+    result.buildMs = ms(Clock::now() - t0);
+    result.edges = graph.EdgeCount();
+
+    t0 = Clock::now();
+    graph.ComputeBounds(workers);
+    result.boundsMs = ms(Clock::now() - t0);
+    result.convergenceSec = graph.ConvergenceSec();
+
+    t0 = Clock::now();
+    std::vector<DcId> points = graph.ArticulationPoints();
+    result.articulationMs = ms(Clock::now() - t0);
+    result.articulationPoints = points.size();
+    t0 = Clock::now();
+    for (DcId dc : points) result.isolatedSites += graph.IslandsWithout(dc).isolatedSites.size();
+    result.islandsMs = ms(Clock::now() - t0);
+
+    // Changes: new delays mostly, some links going down, downed links coming back
+    std::vector<uint32_t> down;
+    double totalMs = 0;
+    for (unsigned i = 0; i < updates && graph.EdgeCount(); i++) {
+        uint64_t h = mix(spec.seed + 0x9E3779B97F4A7C15ull * (i + 1));
+        uint32_t edge;
+        uint32_t delay;
+        if (!down.empty() && h % 10 == 0) {
+            edge = down.back();
+            down.pop_back();
+            delay = static_cast<uint32_t>((h >> 8) % 3600);
+        } else {
+            edge = static_cast<uint32_t>((h >> 16) % graph.EdgeCount());
+            delay = h % 10 == 1 ? TopologyGraph::kUnreachable : static_cast<uint32_t>((h >> 8) % (4 * 3600));
+            if (delay == TopologyGraph::kUnreachable) down.push_back(edge);
+        }
+        Clock::time_point start = Clock::now();
+        TopologyGraph::UpdateStats stats = graph.UpdateEdge(edge, delay, workers);
+        double elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        totalMs += elapsed;
+        result.updateMaxMs = std::max(result.updateMaxMs, elapsed);
+        if (stats.full) result.fullRecomputes++;
+        result.updates++;
+    }
+    if (result.updates) result.updateAvgMs = totalMs / result.updates;
+
+    std::vector<TopologyGraph::Edge> current;
+    for (uint32_t e = 0; e < graph.EdgeCount(); e++) current.push_back({graph.EdgeSource(e), graph.EdgeDest(e), graph.EdgeDelay(e)});
+    TopologyGraph rebuilt(dcCount, current, siteOfDc);
+    rebuilt.ComputeBounds(workers);
+    for (DcId v = 0; v < dcCount; v++) {
+        TopologyGraph::StalenessBound a = graph.Bound(v), b = rebuilt.Bound(v);
+        if (a.delaySec != b.delaySec || a.worstSource != b.worstSource || a.hops != b.hops || a.sources != b.sources) {
+            result.mismatches++;
+        }
+    }
+    return result;
+}
+
+inline std::string FormatGraphBenchmarkJson(const GraphBenchmarkResult& r) {
+    auto num = [](int64_t v) { return std::to_string(v); };
+    char avg[32], max[32];
+    std::snprintf(avg, sizeof(avg), "%.2f", r.updateAvgMs);
+    std::snprintf(max, sizeof(max), "%.2f", r.updateMaxMs);
+    return "{\"dcs\":" + num(r.dcs) + ",\"sites\":" + num(r.sites) + ",\"edges\":" + num((int64_t)r.edges) +
+           ",\"buildMs\":" + num(r.buildMs) + ",\"boundsMs\":" + num(r.boundsMs) +
+           ",\"articulationMs\":" + num(r.articulationMs) + ",\"articulationPoints\":" + num((int64_t)r.articulationPoints) +
+           ",\"islandsMs\":" + num(r.islandsMs) + ",\"isolatedSites\":" + num((int64_t)r.isolatedSites) +
+           ",\"convergenceSec\":" + num(r.convergenceSec) + ",\"updates\":" + num((int64_t)r.updates) +
+           ",\"updateAvgMs\":" + avg + ",\"updateMaxMs\":" + max +
+           ",\"fullRecomputes\":" + num((int64_t)r.fullRecomputes) + ",\"mismatches\":" + num((int64_t)r.mismatches) + "}\n";
+}
+
+struct ScheduleBenchmarkResult {
+    unsigned dcs = 0;
+    unsigned sites = 0;
+    unsigned hours = 0;
+    unsigned dcsPerClass[3] = {};       // healthy, lagging, failing
+    double pollsPerHour[3] = {};        // per DC of the class
+    uint64_t dispatched = 0;
+    uint64_t batches = 0;
+    uint64_t coalesced = 0;
+    uint64_t wakeups = 0;
+    size_t maxSitePerMinute = 0;        // most probes to one site in any 60 s window
+    size_t siteAllowance = 0;           // burst + rate: the most the budget lets through
+    size_t maxGlobalPerMinute = 0;
+    size_t globalAllowance = 0;
+    double nsPerDispatch = 0;           // scheduler time (Due, Report, NextWake) per probe
+    uint64_t digest = 0;                // FNV-1a of the dispatch sequence: equal across runs
+};
+
+// Drives the scheduler for `hours` of virtual time over dcs DCs spread on
+// sites: 5% of DCs lag and 2% fail on every poll, the rest are healthy.
+// Polls complete instantly, so the run measures the scheduler alone and
+// the budgets it enforces, not probe latency.
+inline ScheduleBenchmarkResult RunScheduleBenchmark(unsigned dcs, unsigned sites, unsigned hours,
+                                                    const PollPolicy& policy = PollPolicy()) {
+    using Clock = std::chrono::steady_clock;
+    const int64_t kWindowMs = 60000;
+
+    ScheduleBenchmarkResult result;
+    result.dcs = dcs;
+    result.sites = sites = std::max(1u, sites);
+    result.hours = hours;
+    result.siteAllowance = policy.siteBurst + policy.sitePerMinute;
+    result.globalAllowance = policy.globalBurst + policy.globalPerMinute;
+
+    std::vector<SiteId> siteOfDc(dcs);
+    std::vector<PollHealth> healthOf(dcs);
+    for (DcId id = 0; id < dcs; id++) {
+        siteOfDc[id] = id % sites;
+        uint64_t h = (policy.seed + id) * 0x9E3779B97F4A7C15ull;
+        h ^= h >> 29;
+        unsigned bucket = static_cast<unsigned>(h % 100);
+        healthOf[id] = bucket < 5 ? PollHealth::Lagging : bucket < 7 ? PollHealth::Failing : PollHealth::Healthy;
+        result.dcsPerClass[static_cast<size_t>(healthOf[id]) - 1]++;
+    }
+
+    PollScheduler scheduler(policy);
+    Clock::duration busy{0};
+    Clock::time_point t0 = Clock::now();
+    scheduler.SetDcs(siteOfDc, 0);
+    busy += Clock::now() - t0;
+
+    const int64_t end = static_cast<int64_t>(hours) * 3600000;
+    uint64_t polls[3] = {};
+    std::vector<std::deque<int64_t>> siteWindow(sites);
+    std::deque<int64_t> globalWindow;
+    uint64_t digest = 14695981039346656037ull;
+    int64_t now = 0;
+    while (now < end) {
+        t0 = Clock::now();
+        std::vector<PollBatch> batches = scheduler.Due(now);
+        for (const PollBatch& batch : batches) {
+            for (DcId id : batch.dcs) scheduler.Report(id, healthOf[id], now);
+        }
+        int64_t next = scheduler.NextWake(now);
+        busy += Clock::now() - t0;
+        result.wakeups++;
+
+        for (const PollBatch& batch : batches) {
+            std::deque<int64_t>& window = siteWindow[batch.site];
+            for (DcId id : batch.dcs) {
+                polls[static_cast<size_t>(healthOf[id]) - 1]++;
+                window.push_back(now);
+                globalWindow.push_back(now);
+                for (uint64_t v : {static_cast<uint64_t>(now), static_cast<uint64_t>(id)}) {
+                    digest = (digest ^ v) * 1099511628211ull;
+                }
+            }
+            while (window.front() <= now - kWindowMs) window.pop_front();
+            result.maxSitePerMinute = std::max(result.maxSitePerMinute, window.size());
+        }
+        while (!globalWindow.empty() && globalWindow.front() <= now - kWindowMs) globalWindow.pop_front();
+        result.maxGlobalPerMinute = std::max(result.maxGlobalPerMinute, globalWindow.size());
+        if (next == PollScheduler::kNever) break;
+        now = std::max(now + 1, next);
+    }
+
+    const PollSchedulerStats& stats = scheduler.Stats();
+    result.dispatched = stats.dispatched;
+    result.batches = stats.batches;
+    result.coalesced = stats.coalesced;
+    result.digest = digest;
+    for (size_t c = 0; c < 3; c++) {
+        if (result.dcsPerClass[c] && hours) result.pollsPerHour[c] = double(polls[c]) / result.dcsPerClass[c] / hours;
+    }
+    if (stats.dispatched) {
+        result.nsPerDispatch = double(std::chrono::duration_cast<std::chrono::nanoseconds>(busy).count()) / stats.dispatched;
+    }
+    return result;
+}
+
+inline std::string FormatScheduleBenchmarkJson(const ScheduleBenchmarkResult& r) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    auto real = [](double v) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.2f", v);
+        return std::string(text);
+    };
+    return "{\"dcs\":" + num(r.dcs) + ",\"sites\":" + num(r.sites) + ",\"hours\":" + num(r.hours) +
+           ",\"healthy\":" + num(r.dcsPerClass[0]) + ",\"lagging\":" + num(r.dcsPerClass[1]) +
+           ",\"failing\":" + num(r.dcsPerClass[2]) + ",\"healthyPollsPerHour\":" + real(r.pollsPerHour[0]) +
+           ",\"laggingPollsPerHour\":" + real(r.pollsPerHour[1]) + ",\"failingPollsPerHour\":" + real(r.pollsPerHour[2]) +
+           ",\"dispatched\":" + num(r.dispatched) + ",\"batches\":" + num(r.batches) + ",\"coalesced\":" + num(r.coalesced) +
+           ",\"wakeups\":" + num(r.wakeups) + ",\"maxSitePerMinute\":" + num(r.maxSitePerMinute) +
+           ",\"siteAllowance\":" + num(r.siteAllowance) + ",\"maxGlobalPerMinute\":" + num(r.maxGlobalPerMinute) +
+           ",\"globalAllowance\":" + num(r.globalAllowance) + ",\"nsPerDispatch\":" + real(r.nsPerDispatch) +
+           ",\"digest\":\"" + num(r.digest) + "\"}\n";
+}
+
+struct ParseBenchmarkResult {
+    std::string corpus;                 // directory, or "synthetic"
+    uint64_t bytes = 0;
+    uint64_t events = 0;
+    uint64_t replicationEvents = 0;
+    uint64_t dataFields = 0;            // <Data> elements read
+    size_t triples = 0;                 // distinct (source, destination, error)
+    double scanMs = 0;                  // best pass, scanner alone
+    double aggregateMs = 0;             // best pass, scanner and table
+    double eventsPerSecond = 0;         // scanner and table
+    double megabytesPerSecond = 0;
+    uint64_t allocations = 0;           // one warm pass: the table already holds every triple
+    double allocationsPerEvent = 0;
+};
+
+// events events in wevtutil export form logged by dcs DCs, each failing
+// against four partners: the IDs the layout table knows, with one event in
+// four unrelated to replication. Deterministic for a seed.
+inline std::string GenerateEventCorpus(unsigned events, unsigned dcs, uint64_t seed) {
+    static const uint32_t kIds[] = {1925, 2042, 2087, 1388, 1311, 1988, 1925, 2088};
+    static const char* const kErrors[] = {"8524", "1722", "8453", "1256", "0x2117"};
+    std::string xml = "<Events>";
+    xml.reserve(static_cast<size_t>(events) * 900);
+    uint64_t h = seed * 0x9E3779B97F4A7C15ull + 1;
+    char line[1024];
+    dcs = std::max(2u, dcs);
+    for (unsigned i = 0; i < events; i++) {
+        h ^= h << 13; h ^= h >> 7; h ^= h << 17;
+        const unsigned dest = static_cast<unsigned>(h % dcs);
+        const unsigned source = (dest + 1 + static_cast<unsigned>((h >> 20) % 4)) % dcs;   // four partners per DC
+        const uint32_t id = (h >> 40) % 4 == 0 ? 1394 : kIds[(h >> 44) % 8];
+        const char* error = kErrors[(h >> 50) % 5];
+        const unsigned minute = i % 1440;
+        int n = std::snprintf(line, sizeof(line),
+            "<Event xmlns='http://schemas.microsoft.com/win/2004/08/events/event'><System>"
+            "<Provider Name='Microsoft-Windows-ActiveDirectory_DomainService' Guid='{0e8478c5-3605-4e8c-8497-1e730c959516}' "
+            "EventSourceName='NTDS Replication'/><EventID Qualifiers='49152'>%u</EventID><Version>0</Version>"
+            "<Level>2</Level><Task>5</Task><Opcode>0</Opcode><Keywords>0x8080000000000000</Keywords>"
+            "<TimeCreated SystemTime='2024-05-01T%02u:%02u:00.%07uZ'/><EventRecordID>%u</EventRecordID><Correlation/>"
+            "<Execution ProcessID='712' ThreadID='%u'/><Channel>Directory Service</Channel>"
+            "<Computer>DC%04u.corp.example.com</Computer><Security UserID='S-1-5-7'/></System><EventData>",
+            id, minute / 60, minute % 60, i % 10000000, i + 1, 1000 + (i % 500), dest);
+        xml.append(line, static_cast<size_t>(n));
+        if (id == 1925) {
+            n = std::snprintf(line, sizeof(line),
+                "<Data>DC=corp,DC=example,DC=com</Data><Data>CN=NTDS Settings,CN=DC%04u,CN=Servers,CN=Site%u,CN=Sites,"
+                "CN=Configuration,DC=corp,DC=example,DC=com</Data><Data>%u._msdcs.corp.example.com</Data><Data>IP</Data>"
+                "<Data>0</Data><Data>%s</Data><Data>The RPC server is unavailable.</Data>", source, source / 10, i, error);
+        } else if (id == 2087 || id == 2088) {
+            n = std::snprintf(line, sizeof(line),
+                "<Data>DC%04u</Data><Data>%08x-0000-4000-8000-000000000000._msdcs.corp.example.com</Data>"
+                "<Data>DC%04u.corp.example.com</Data><Data>DNS name does not exist.</Data><Data>%s</Data>",
+                source, source, source, error);
+        } else if (id == 2042) {
+            n = std::snprintf(line, sizeof(line),
+                "<Data>64</Data><Data>180</Data><Data>CN=NTDS Settings,CN=DC%04u,CN=Servers,CN=Site%u,CN=Sites,"
+                "CN=Configuration,DC=corp,DC=example,DC=com</Data><Data>DC=corp,DC=example,DC=com</Data>",
+                source, source / 10);
+        } else if (id == 1311) {
+            n = std::snprintf(line, sizeof(line), "<Data>DC=corp,DC=example,DC=com</Data><Data>Site%u</Data>", dest / 10);
+        } else if (id == 1394) {
+            n = std::snprintf(line, sizeof(line), "<Data>%u</Data>", i);
+        } else {
+            n = std::snprintf(line, sizeof(line),
+                "<Data>DC%04u.corp.example.com</Data><Data>CN={%08x-1111-2222-3333-444455556666}</Data>"
+                "<Data>DC=corp,DC=example,DC=com</Data>", source, i);
+        }
+        xml.append(line, static_cast<size_t>(n));
+        xml += "</EventData></Event>";
+    }
+    xml += "</Events>";
+    return xml;
+}
+
+// passes passes of the scanner alone, then of the scanner feeding a table,
+// over an in-memory corpus; the best pass of each is kept. Allocations are
+// counted on one more pass into the warmed table: the scanner itself never
+// allocates, so they come from the table only.
+inline ParseBenchmarkResult RunParseBenchmark(std::string_view corpus, unsigned passes) {
+    using Clock = std::chrono::steady_clock;
+    auto millis = [](Clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count() / 1e6;
+    };
+    ParseBenchmarkResult result;
+    result.bytes = corpus.size();
+    passes = std::max(1u, passes);
+
+    for (unsigned pass = 0; pass < passes; pass++) {
+        const Clock::time_point t0 = Clock::now();
+        EventXmlScanner scanner(corpus);
+        EventView event;
+        uint64_t events = 0, fields = 0;
+        while (scanner.Next(event)) {
+            events++;
+            fields += event.dataCount;
+        }
+        const double ms = millis(Clock::now() - t0);
+        if (pass == 0 || ms < result.scanMs) result.scanMs = ms;
+        result.events = events;
+        result.dataFields = fields;
+    }
+
+    ReplicationErrorTable table;
+    auto aggregate = [&]() {
+        EventXmlScanner scanner(corpus);
+        EventView event;
+        uint64_t added = 0;
+        while (scanner.Next(event)) added += table.Add(event.computer, event);
+        return added;
+    };
+    for (unsigned pass = 0; pass < passes; pass++) {
+        table = ReplicationErrorTable();
+        const Clock::time_point t0 = Clock::now();
+        result.replicationEvents = aggregate();
+        const double ms = millis(Clock::now() - t0);
+        if (pass == 0 || ms < result.aggregateMs) result.aggregateMs = ms;
+    }
+    result.triples = table.Entries().size();
+
+    const uint64_t allocationsBefore = AllocationCounter().load(std::memory_order_relaxed);
+    aggregate();
+    result.allocations = AllocationCounter().load(std::memory_order_relaxed) - allocationsBefore;
+    if (result.events) result.allocationsPerEvent = double(result.allocations) / result.events;
+    if (result.aggregateMs > 0) {
+        result.eventsPerSecond = result.events / (result.aggregateMs / 1000);
+        result.megabytesPerSecond = result.bytes / (1024.0 * 1024.0) / (result.aggregateMs / 1000);
+    }
+    return result;
+}
+
+inline std::string FormatParseBenchmarkJson(const ParseBenchmarkResult& r) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    auto real = [](double v) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.2f", v);
+        return std::string(text);
+    };
+    std::string s = "{\"corpus\":";
+    s += '"';
+    for (char c : r.corpus) {
+        if (c == '"' || c == '\\') s += '\\';
+        s += c;
+    }
+    s += '"';
+    return s + ",\"bytes\":" + num(r.bytes) + ",\"events\":" + num(r.events) +
+           ",\"replicationEvents\":" + num(r.replicationEvents) +
+           ",\"dataFields\":" + num(r.dataFields) + ",\"triples\":" + num(r.triples) +
+           ",\"scanMs\":" + real(r.scanMs) + ",\"aggregateMs\":" + real(r.aggregateMs) +
+           ",\"eventsPerSecond\":" + real(r.eventsPerSecond) + ",\"megabytesPerSecond\":" + real(r.megabytesPerSecond) +
+           ",\"allocations\":" + num(r.allocations) + ",\"allocationsPerEvent\":" + real(r.allocationsPerEvent) + "}\n";
+}
+
+struct SnapshotBenchmarkResult {
+    unsigned dcs = 0;
+    uint64_t bytes = 0;                 // file size of the first snapshot
+    double encodeMs = 0;
+    double writeMs = 0;
+    double openMs = 0;                  // map and verify (layout, CRC)
+    double loadMs = 0;                  // mapped file to a publishable ScanSnapshot
+    double diffMs = 0;
+    size_t expected[5] = {};            // added, removed, USN regressions, new failures, lag changes
+    size_t found[5] = {};
+    size_t mismatches = 0;              // sum of |expected - found|
+};
+
+// Two scans of a generated forest (10 DCs per site, 4 inbound links per
+// DC) written to the temporary directory, then mapped, loaded and diffed.
+// The second scan drops 1% of the DCs, adds as many and changes USNs,
+// failing partners and latencies of known DCs; the diff must find exactly
+// those. Dropping DCs shifts the indexes, so matching goes through the hash.
+// The loaded snapshot must hold the file's rows, event counts and links; a
+// hand-patched file repeating a DC name must load with counts and links
+// remapped to the surviving DcIds, and one with an out-of-range status,
+// lag or event state byte must be rejected.
+inline SnapshotBenchmarkResult RunSnapshotBenchmark(unsigned dcs, uint64_t seed, unsigned passes = 5) {
+    using Clock = std::chrono::steady_clock;
+    auto millis = [](Clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count() / 1e6;
+    };
+    SnapshotBenchmarkResult result;
+    result.dcs = dcs;
+    const unsigned sites = std::max(1u, dcs / 10);
+    const std::vector<uint32_t> eventIds = EventCollectorOptions().eventIds;
+
+    uint64_t h = seed * 0x9E3779B97F4A7C15ull + 1;
+    auto next = [&]() {
+        h ^= h << 13; h ^= h >> 7; h ^= h << 17;
+        return h;
+    };
+    auto addDc = [&](ScanSnapshot& s, unsigned i, const DcRecord& r, const uint32_t* counts) {
+        const DcId id = s.model.AddDc(L"Site" + std::to_wstring(i / 10), L"DC" + std::to_wstring(i) + L".corp.example.com");
+        const SiteId site = s.model.records[id].site;
+        s.model.records[id] = r;
+        s.model.records[id].site = site;
+        std::copy(counts, counts + eventIds.size(), s.model.EventCountsOf(id));
+    };
+
+    auto before = std::make_shared<ScanSnapshot>();
+    before->generation = 1;
+    before->startedAt = 1714564800000;
+    before->completedAt = before->startedAt + 60000;
+    before->siteCount = sites;
+    before->model.SetEventIds(eventIds);
+    before->model.Reserve(dcs);
+    std::vector<uint32_t> counts(eventIds.size());
+    for (unsigned i = 0; i < dcs; i++) {
+        DcRecord r;
+        r.status = next() % 50 == 0 ? ProbeStatus::Unreachable : ProbeStatus::Ok;
+        r.usn = 1000000 + next() % 100000;
+        r.probedAt = before->startedAt + static_cast<int64_t>(i);
+        r.lastReplication = r.probedAt - static_cast<int64_t>(next() % 3600000);
+        r.probeMs = static_cast<uint32_t>(next() % 200);
+        r.latencySec = static_cast<uint32_t>(next() % 1800);
+        r.partners = 4;
+        r.failingPartners = next() % 20 == 0 ? 1 : 0;
+        r.lag = ClassifyLatency(r.latencySec, r.failingPartners, LatencyThresholds());
+        r.events = EventState::Ok;
+        for (uint32_t& c : counts) c = static_cast<uint32_t>(next() % 3);
+        addDc(*before, i, r, counts.data());
+        for (unsigned k = 1; k <= 4; k++) {
+            before->links.push_back({static_cast<DcId>((i + k) % dcs), static_cast<DcId>(i), 900});
+        }
+    }
+
+    auto after = std::make_shared<ScanSnapshot>();
+    after->generation = 2;
+    after->startedAt = before->startedAt + 3600000;
+    after->completedAt = after->startedAt + 60000;
+    after->siteCount = sites;
+    after->model.SetEventIds(eventIds);
+    after->model.Reserve(dcs);
+    for (unsigned i = 0; i < dcs; i++) {
+        if (i % 100 == 50) {
+            result.expected[1]++;
+            continue;
+        }
+        DcRecord r = before->model.records[i];
+        if (i % 200 == 7 && r.status == ProbeStatus::Ok) {
+            r.usn -= 10;
+            result.expected[2]++;
+        }
+        if (i % 97 == 3) {
+            r.failingPartners++;
+            result.expected[3]++;
+        }
+        if (i % 50 == 11) {
+            r.latencySec += 3600;
+            result.expected[4]++;
+        }
+        r.usn += r.status == ProbeStatus::Ok && i % 200 != 7 ? 500 : 0;
+        addDc(*after, i, r, before->model.EventCountsOf(i));
+    }
+    for (unsigned i = dcs; i < dcs + dcs / 100; i++) {
+        DcRecord r;
+        r.status = ProbeStatus::Ok;
+        r.usn = 5000;
+        addDc(*after, i, r, counts.data());
+        result.expected[0]++;
+    }
+    after->links = before->links;
+
+    const std::filesystem::path dir = std::filesystem::temp_directory_path();
+    const std::wstring beforePath = (dir / ("adrs_bench_" + std::to_string(dcs) + "_a.adrs")).wstring();
+    const std::wstring afterPath = (dir / ("adrs_bench_" + std::to_string(dcs) + "_b.adrs")).wstring();
+
+    Clock::time_point t0 = Clock::now();
+    const std::string encoded = EncodeSnapshot(*before);
+    result.encodeMs = millis(Clock::now() - t0);
+    result.bytes = encoded.size();
+    t0 = Clock::now();
+    bool written = WriteSnapshotFile(encoded, beforePath);
+    result.writeMs = millis(Clock::now() - t0);
+    written = WriteSnapshotFile(EncodeSnapshot(*after), afterPath) && written;
+
+    // Best of passes for the read side, cold only on the first
+    for (unsigned pass = 0; written && pass < std::max(1u, passes); pass++) {
+        SnapshotView a, b;
+        t0 = Clock::now();
+        const bool opened = a.Open(beforePath);
+        const double openMs = millis(Clock::now() - t0);
+        if (!opened || !b.Open(afterPath)) {
+            written = false;
+            break;
+        }
+        t0 = Clock::now();
+        SnapshotPtr loaded = a.ToSnapshot();
+        const double loadMs = millis(Clock::now() - t0);
+        t0 = Clock::now();
+        SnapshotDiff diff = DiffSnapshots(a, b);
+        const double diffMs = millis(Clock::now() - t0);
+        if (pass == 0 || openMs < result.openMs) result.openMs = openMs;
+        if (pass == 0 || loadMs < result.loadMs) result.loadMs = loadMs;
+        if (pass == 0 || diffMs < result.diffMs) result.diffMs = diffMs;
+        result.found[0] = diff.added.size();
+        result.found[1] = diff.removed.size();
+        result.found[2] = diff.usnRegressions.size();
+        result.found[3] = diff.newFailures.size();
+        result.found[4] = diff.lagChanges.size();
+        if (loaded->model.Size() != dcs) result.mismatches++;
+    }
+    for (size_t k = 0; k < 5; k++) {
+        result.mismatches += result.expected[k] > result.found[k] ? result.expected[k] - result.found[k]
+                                                                  : result.found[k] - result.expected[k];
+    }
+    if (!written) result.mismatches++;
+
+    SnapshotView reread;
+    if (written && reread.Open(beforePath)) {
+        SnapshotPtr loaded = reread.ToSnapshot();
+        const ReplicationModel& m = loaded->model;
+        for (DcId id = 0; id < m.Size() && id < before->model.Size(); id++) {
+            const DcRecord& x = m.records[id];
+            const DcRecord& y = before->model.records[id];
+            const uint32_t* cx = m.EventCountsOf(id);
+            const uint32_t* cy = before->model.EventCountsOf(id);
+            if (m.DcName(id) != before->model.DcName(id) || m.SiteName(id) != before->model.SiteName(id) ||
+                x.usn != y.usn || x.status != y.status || x.lag != y.lag || x.events != y.events ||
+                x.latencySec != y.latencySec || x.failingPartners != y.failingPartners ||
+                !std::equal(cx, cx + eventIds.size(), cy)) result.mismatches++;
+        }
+        if (!std::equal(loaded->links.begin(), loaded->links.end(), before->links.begin(), before->links.end(),
+                        [](const ReplicationLink& x, const ReplicationLink& y) {
+                            return x.source == y.source && x.dest == y.dest && x.scheduleSec == y.scheduleSec;
+                        })) result.mismatches++;
+    }
+    reread.Close();
+    std::error_code ec;
+    std::filesystem::remove(beforePath, ec);
+    std::filesystem::remove(afterPath, ec);
+
+    // DC-A, DC-B, DC-A again, DC-C: file indexes 0..3 intern to DcIds 0, 1, 0, 2
+    ScanSnapshot small;
+    small.model.SetEventIds({1311, 2042});
+    const wchar_t* const names[4] = {L"DC-A", L"DC-B", L"DC-X", L"DC-C"};
+    for (unsigned i = 0; i < 4; i++) {
+        const DcId id = small.model.AddDc(i % 2 ? L"Site2" : L"Site1", names[i]);
+        small.model.records[id].usn = 10 * (i + 1);
+        small.model.EventCountsOf(id)[0] = 2 * i + 1;
+        small.model.EventCountsOf(id)[1] = 2 * i + 2;
+    }
+    small.links = {{1, 0, 900}, {2, 0, 900}, {0, 1, 900}, {2, 1, 900}, {3, 2, 900}, {0, 3, 900}};
+    std::string file = EncodeSnapshot(small);
+    auto entries = [](std::string& f) { return reinterpret_cast<SnapshotDcEntry*>(&f[sizeof(SnapshotFileHeader)]); };
+    auto reseal = [](std::string& f) {
+        const size_t crcAt = offsetof(SnapshotFileHeader, crc);
+        const uint32_t crc = Crc32(f.data() + crcAt + 4, f.size() - crcAt - 4, Crc32(f.data(), crcAt));
+        std::memcpy(&f[crcAt], &crc, 4);
+    };
+    entries(file)[2].name = entries(file)[0].name;
+    reseal(file);
+    {
+        SnapshotView view;
+        if (!view.Attach(file.data(), file.size())) {
+            result.mismatches++;
+        } else {
+            SnapshotPtr loaded = view.ToSnapshot();
+            const ReplicationModel& m = loaded->model;
+            const uint32_t usn[3] = {10, 20, 40}, first[3] = {1, 3, 7};
+            if (m.Size() != 3) {
+                result.mismatches++;
+            } else {
+                for (DcId id = 0; id < 3; id++) {
+                    if (m.records[id].usn != usn[id] || m.EventCountsOf(id)[0] != first[id] ||
+                        m.EventCountsOf(id)[1] != first[id] + 1) result.mismatches++;
+                }
+                if (m.DcName(2) != L"DC-C" || m.SiteName(2) != L"Site2") result.mismatches++;
+            }
+            // (source, dest) after remapping, self-links dropped, sorted by (dest, source)
+            const std::pair<DcId, DcId> links[4] = {{1, 0}, {2, 0}, {0, 1}, {0, 2}};
+            if (loaded->links.size() != 4) {
+                result.mismatches++;
+            } else {
+                for (size_t l = 0; l < 4; l++) {
+                    if (loaded->links[l].source != links[l].first || loaded->links[l].dest != links[l].second) {
+                        result.mismatches++;
+                    }
+                }
+            }
+        }
+    }
+
+    // Enum bytes: the highest valid values load, one past them is rejected
+    file = EncodeSnapshot(small);
+    for (int k = 0; k < 4; k++) {
+        std::string patched = file;
+        SnapshotDcEntry& e = entries(patched)[1];
+        e.status = static_cast<uint8_t>(ProbeStatus::Cancelled) + (k == 1);
+        e.lag = static_cast<uint8_t>(LagClass::Severe) + (k == 2);
+        e.events = static_cast<uint8_t>(EventState::Unavailable) + (k == 3);
+        reseal(patched);
+        SnapshotView view;
+        if (view.Attach(patched.data(), patched.size()) != (k == 0)) result.mismatches++;
+    }
+    return result;
+}
+
+inline std::string FormatSnapshotBenchmarkJson(const SnapshotBenchmarkResult& r) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    auto real = [](double v) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.3f", v);
+        return std::string(text);
+    };
+    static const char* const kNames[5] = {"added", "removed", "usnRegressions", "newFailures", "lagChanges"};
+    std::string s = "{\"dcs\":" + num(r.dcs) + ",\"bytes\":" + num(r.bytes) + ",\"encodeMs\":" + real(r.encodeMs) +
+                    ",\"writeMs\":" + real(r.writeMs) + ",\"openMs\":" + real(r.openMs) + ",\"loadMs\":" + real(r.loadMs) +
+                    ",\"diffMs\":" + real(r.diffMs);
+    for (size_t k = 0; k < 5; k++) s += ",\"" + std::string(kNames[k]) + "\":" + num(r.found[k]);
+    return s + ",\"mismatches\":" + num(r.mismatches) + "}\n";
+}
+
+struct CancelBenchmarkResult {
+    unsigned dcs = 0;
+    unsigned sites = 0;
+    int64_t fullMs = 0;                 // scan run to completion
+    int64_t firstRowMs = -1;
+    size_t cancels = 0;                 // scans cancelled while running
+    int64_t probeCancelMs = -1;         // worst cancel-to-return, cancel requested while probing
+    int64_t replicaCancelMs = -1;       // ... while reading replica metadata
+    int64_t readBoundMs = 0;            // slowest single replica read the forest can serve
+    int64_t deadlineOverrunMs = -1;     // scan deadline at half the full scan: return minus deadline
+    size_t partialRows = 0;             // DCs with a USN, summed over the cancelled scans
+    size_t mismatches = 0;              // inconsistent partial snapshots (see CheckPartialSnapshot)
+};
+
+// Problems in a snapshot the scan may have stopped early: lag classes or
+// USN spread that differ from ClassifyLag over the same rows, rows probed
+// but without a probe time or the reverse, replica metadata without a USN,
+// cancelled flag wrong, and lag classes the subscriber ended up with that
+// differ from the snapshot's.
+inline size_t CheckPartialSnapshot(const ScanSnapshot& snapshot, const ReplicationModel& streamed, bool expectCancelled) {
+    size_t bad = snapshot.cancelled == expectCancelled ? 0 : 1;
+    ReplicationModel model = snapshot.model;
+    const UsnSpread spread = ClassifyLag(model);
+    if (spread.count != snapshot.spread.count || spread.minUsn != snapshot.spread.minUsn ||
+        spread.maxUsn != snapshot.spread.maxUsn || (spread.count && (spread.minDc != snapshot.spread.minDc ||
+                                                                     spread.maxDc != snapshot.spread.maxDc))) {
+        bad++;
+    }
+    for (DcId id = 0; id < model.Size(); id++) {
+        const DcRecord& r = snapshot.model.records[id];
+        if (r.lag != model.records[id].lag) bad++;
+        if ((r.status == ProbeStatus::Cancelled) != (r.probedAt == 0) || (r.HasLatency() && !r.HasUsn())) bad++;
+        if (id >= streamed.Size() || streamed.records[id].lag != r.lag) bad++;
+    }
+    return bad;
+}
+
+// Scans of a slow, unpooled generated forest (every read pays its binds)
+// without event collection: one to completion for the reference and the
+// time to the first row, then one cancelled at each tenth of that time
+// from 1 to 9, then one with a scan deadline at half of it. Every partial
+// snapshot goes through CheckPartialSnapshot.
+inline CancelBenchmarkResult RunCancelBenchmark(const ForestSpec& spec, const ProbeOptions& probe) {
+    using Clock = std::chrono::steady_clock;
+    auto ms = [](Clock::duration d) { return std::chrono::duration_cast<std::chrono::milliseconds>(d).count(); };
+
+    CancelBenchmarkResult result;
+    result.dcs = spec.dcs;
+    result.sites = spec.sites;
+    const auto slowestRtt = std::max(spec.localRtt, spec.remoteRtt) * (1 + spec.rttJitter);
+    result.readBoundMs = static_cast<int64_t>(
+        std::chrono::duration<double, std::milli>(slowestRtt * static_cast<double>(spec.bindRoundTrips + 1)).count());
+    ForestSimulator forest(spec);
+
+    struct FirstRow : IScanSubscriber {
+        std::mutex mutex;
+        Clock::time_point at;
+        bool seen = false;
+        void OnRows(const RowBatch&) override {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!seen) at = Clock::now();
+            seen = true;
+        }
+    };
+
+    // One scan; cancelAfter < 0 runs it to the end. Returns the phase the
+    // cancel landed in and how long Run took to return after it.
+    struct Outcome {
+        SnapshotPtr snapshot;
+        ReplicationModel streamed;
+        int64_t wallMs = 0;
+        int64_t firstRowMs = -1;
+        int64_t cancelMs = -1;
+        ScanPhase cancelPhase = ScanPhase::Discovery;
+    };
+    auto scan = [&](const ProbeOptions& options, int64_t cancelAfter) {
+        Outcome outcome;
+        auto firstRow = std::make_shared<FirstRow>();
+        auto builder = std::make_shared<ModelBuilderSubscriber>();
+        SnapshotPublisher publisher;
+        publisher.Subscribe(firstRow);
+        publisher.Subscribe(builder);
+        ScanEngine engine(forest.Backend(), nullptr, options);
+        CancellationToken token;
+        std::atomic<uint8_t> phase{static_cast<uint8_t>(ScanPhase::Discovery)};
+        Clock::time_point cancelledAt;
+
+        const Clock::time_point start = Clock::now();
+        std::thread canceller;
+        std::mutex mutex;
+        std::condition_variable finished;
+        bool done = false;
+        if (cancelAfter >= 0) {
+            canceller = std::thread([&] {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (finished.wait_until(lock, start + std::chrono::milliseconds(cancelAfter), [&] { return done; })) return;
+                outcome.cancelPhase = static_cast<ScanPhase>(phase.load());
+                cancelledAt = Clock::now();
+                token.Cancel();
+            });
+        }
+        outcome.snapshot = engine.Run(publisher, forest.ConfigurationDn(), [&](ScanPhase p) {
+            phase.store(static_cast<uint8_t>(p));
+        }, &token);
+        const Clock::time_point end = Clock::now();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+        }
+        finished.notify_all();
+        if (canceller.joinable()) canceller.join();
+
+        outcome.wallMs = ms(end - start);
+        if (token.CancelRequested()) outcome.cancelMs = ms(end - cancelledAt);
+        if (firstRow->seen) outcome.firstRowMs = ms(firstRow->at - start);
+        outcome.streamed = builder->Model();
+        return outcome;
+    };
+    auto check = [&](const Outcome& outcome, bool expectCancelled) {
+        if (!outcome.snapshot) {
+            result.mismatches++;
+            return;
+        }
+        result.mismatches += CheckPartialSnapshot(*outcome.snapshot, outcome.streamed, expectCancelled);
+        if (expectCancelled) {
+            for (const DcRecord& r : outcome.snapshot->model.records) result.partialRows += r.HasUsn() ? 1 : 0;
+        }
+    };
+
+    Outcome full = scan(probe, -1);
+    result.fullMs = full.wallMs;
+    result.firstRowMs = full.firstRowMs;
+    check(full, false);
+
+    for (int tenth = 1; tenth <= 9; tenth++) {
+        Outcome outcome = scan(probe, result.fullMs * tenth / 10);
+        if (outcome.cancelMs < 0) continue;
+        result.cancels++;
+        check(outcome, true);
+        int64_t& worst = outcome.cancelPhase == ScanPhase::ReplicaMetadata ? result.replicaCancelMs : result.probeCancelMs;
+        worst = std::max(worst, outcome.cancelMs);
+    }
+
+    ProbeOptions bounded = probe;
+    bounded.scanDeadline = std::chrono::milliseconds(result.fullMs / 2);
+    Outcome deadline = scan(bounded, -1);
+    result.deadlineOverrunMs = deadline.wallMs - result.fullMs / 2;
+    check(deadline, true);
+    return result;
+}
+
+inline std::string FormatCancelBenchmarkJson(const CancelBenchmarkResult& r) {
+    auto num = [](int64_t v) { return std::to_string(v); };
+    return "{\"dcs\":" + num(r.dcs) + ",\"sites\":" + num(r.sites) + ",\"fullMs\":" + num(r.fullMs) +
+           ",\"firstRowMs\":" + num(r.firstRowMs) + ",\"cancels\":" + num((int64_t)r.cancels) +
+           ",\"probeCancelMs\":" + num(r.probeCancelMs) + ",\"replicaCancelMs\":" + num(r.replicaCancelMs) +
+           ",\"readBoundMs\":" + num(r.readBoundMs) + ",\"deadlineOverrunMs\":" + num(r.deadlineOverrunMs) +
+           ",\"partialRows\":" + num((int64_t)r.partialRows) + ",\"mismatches\":" + num((int64_t)r.mismatches) + "}\n";
+}
+
+struct AlertBenchmarkResult {
+    unsigned rules = 0;
+    size_t samples = 0;                 // DCs of the synthetic snapshot
+    size_t parseCases = 0;
+    size_t parseFailures = 0;           // good rules rejected, bad ones accepted, wrong line in the error
+    size_t checked = 0;                 // rows compared between compiled code and tree walk
+    size_t forestRows = 0;              // partner rows of the scanned forest
+    size_t mismatches = 0;              // compiled code, engine or hysteresis steps disagreeing with the reference
+    double compileMs = 0;               // parsing and compiling the rule set
+    double evaluateMs = 0;              // AlertEngine::Evaluate, every rule over every DC, best pass
+    double ruleSamplesPerSecond = 0;
+    size_t firing = 0;
+};
+
+// Rules that must parse (true) or be rejected
+inline size_t CheckAlertRuleParser(size_t& cases) {
+    static const struct { const char* text; bool ok; } kCases[] = {
+        {"alert a when usn_behind > 1000", true},
+        {"alert b-2.x severity=critical for=10m keep=5m site=Hub*,Core? dc=DC0* when usn_behind >= 10k and not "
+         "reachable = 0 clear usn_behind < 500", true},
+        {"alert c source=DC* when partner_failures > 3 or partner_age > 1h  # commentaire", true},
+        {"   # commentaire seul", true},
+        {"alert d when -(latency) < -1.5 * 2 + (3 - 1) / 4", true},
+        {"alert e severity=info when lag >= moderate && !timeout || events_unavailable != 0", true},
+        {"alert f when usn_behind-5>0", true},
+        {"alert when usn > 1", false},
+        {"alert x usn > 1", false},
+        {"alert x", false},
+        {"alert x when usn >", false},
+        {"alert x when foo > 1", false},
+        {"alert x severity=huge when usn > 1", false},
+        {"alert x for=abc when usn > 1", false},
+        {"alert x site= when usn > 1", false},
+        {"alert x when (usn > 1", false},
+        {"alert x when usn > 1 extra", false},
+        {"alert x when usn > 1 clear", false},
+        {"alarm x when usn > 1", false},
+        {"alert x when usn > 1\nalert x when usn > 2", false},
+        {"alert x when 1 + (2 + (3 + (4 + (5 + (6 + (7 + (8 + (9 + (10 + (11 + (12 + (13 + (14 + (15 + (16 + (17 + usn"
+         "))))))))))))))))", false},
+    };
+    size_t failures = 0;
+    for (const auto& c : kCases) {
+        std::vector<AlertRule> rules;
+        std::string error;
+        const bool ok = ParseAlertRules(c.text, rules, error);
+        if (ok != c.ok) failures++;
+        if (!ok && error.compare(0, 6, "ligne ") != 0) failures++;
+    }
+    // The error names the line of the bad rule
+    std::vector<AlertRule> rules;
+    std::string error;
+    if (ParseAlertRules("# ok\nalert a when usn > 1\n\nalert b when usn >> 1\n", rules, error) ||
+        error.compare(0, 8, "ligne 4:") != 0) {
+        failures++;
+    }
+    // Partner scope comes from the metrics and source=
+    if (!ParseAlertRules("alert a when partner_age > 1h\nalert b source=X when usn > 0\nalert c when usn > 0", rules, error) ||
+        !rules[0].partner || !rules[1].partner || rules[2].partner) {
+        failures++;
+    }
+    cases = sizeof(kCases) / sizeof(kCases[0]) + 2;
+    return failures;
+}
+
+// Random conditions over random columns (small integers, one value in ten
+// unknown), compiled code against EvaluateAlertExpr row by row
+inline size_t CheckAlertPrograms(uint64_t seed, size_t& checked) {
+    uint64_t h = seed * 0x9E3779B97F4A7C15ull + 7;
+    auto next = [&]() {
+        h ^= h << 13; h ^= h >> 7; h ^= h << 17;
+        return h;
+    };
+    const char* const kOps[] = {" + ", " - ", " * ", " / ", " < ", " <= ", " > ", " >= ", " == ", " != ",
+                                       " and ", " or "};
+    auto leaf = [&]() -> std::string {
+        if (next() % 3 == 0) return std::to_string(next() % 6);
+        return AlertMetricName(static_cast<AlertMetric>(next() % kAlertMetricCount));
+    };
+    auto expr = [&](auto& self, int depth) -> std::string {
+        if (depth == 0 || next() % 4 == 0) return leaf();
+        switch (next() % 5) {
+            case 0:  return "(not (" + self(self, depth - 1) + "))";
+            case 1:  return "-(" + self(self, depth - 1) + ")";
+            default: return "(" + self(self, depth - 1) + kOps[next() % 12] + self(self, depth - 1) + ")";
+        }
+    };
+
+    AlertSamples samples;
+    samples.Reset(2048);
+    for (double& v : samples.values) v = next() % 10 == 0 ? std::numeric_limits<double>::quiet_NaN() : next() % 6;
+
+    AlertVm vm;
+    std::vector<uint32_t> hits;
+    double values[kAlertMetricCount];
+    size_t mismatches = 0;
+    checked = 0;
+    for (int round = 0; round < 300; round++) {
+        std::vector<AlertRule> rules;
+        std::string error;
+        if (!ParseAlertRules("alert r when " + expr(expr, 4), rules, error)) {
+            mismatches++;
+            continue;
+        }
+        const AlertRule& rule = rules[0];
+        vm.Run(rule.whenCode, samples, hits);
+        size_t hit = 0;
+        for (size_t i = 0; i < samples.count; i++) {
+            for (size_t m = 0; m < kAlertMetricCount; m++) values[m] = samples.Column(static_cast<AlertMetric>(m))[i];
+            const double expected = EvaluateAlertExpr(rule.when, values);
+            const double row = vm.RunRow(rule.whenCode, samples, i);
+            const bool same = (expected != expected && row != row) || expected == row;
+            const bool listed = hit < hits.size() && hits[hit] == i;
+            if (listed) hit++;
+            if (!same || listed != AlertLogic::True(expected)) mismatches++;
+            checked++;
+        }
+    }
+    return mismatches;
+}
+
+// One DC drifting behind another, minute by minute, against a rule with
+// for=10m, keep=5m and a clear threshold below the firing one. Returns the
+// steps whose fired/resolved outcome is not the expected one.
+inline size_t CheckAlertHysteresis() {
+    std::vector<AlertRule> rules;
+    std::string error;
+    ParseAlertRules("alert retard for=10m keep=5m when usn_behind >= 1000 clear usn_behind < 500", rules, error);
+    AlertEngine engine(std::move(rules));
+
+    // minute, USN behind, expected: 1 fired, -1 resolved, 0 nothing
+    static const int kSteps[][3] = {
+        {0, 1200, 0}, {5, 1500, 0}, {10, 1500, 1}, {12, 800, 0}, {13, 1100, 0}, {14, 400, 0}, {16, 1200, 0},
+        {17, 300, 0}, {21, 300, 0}, {22, 300, -1}, {23, 2000, 0}, {24, 0, 0}, {30, 2000, 0}, {39, 2000, 0},
+        {40, 2000, 1}, {41, 999, 0}, {42, 1001, 0}, {43, 999, 0}, {44, 1001, 0}, {50, 100, 0}, {55, 100, -1},
+    };
+    size_t mismatches = 0;
+    for (const auto& step : kSteps) {
+        ScanSnapshot snapshot;
+        snapshot.model.AddDc(L"Hub", L"DC1");
+        snapshot.model.AddDc(L"Branch", L"DC2");
+        for (DcRecord& r : snapshot.model.records) r.status = ProbeStatus::Ok;
+        snapshot.model.records[0].usn = 100000;
+        snapshot.model.records[1].usn = 100000 - step[1];
+        snapshot.spread = ClassifyLag(snapshot.model);
+        const std::vector<AlertTransition> transitions = engine.Evaluate(snapshot, int64_t(step[0]) * 60000);
+        const int outcome = transitions.empty() ? 0 : (transitions[0].fired ? 1 : -1);
+        if (outcome != step[2] || transitions.size() > 1 || (outcome && transitions[0].alert.dc != L"DC2")) mismatches++;
+    }
+    return mismatches;
+}
+
+// A scanned generated forest: every partner and DC alert the engine fires
+// must match a row where the condition holds and the selectors match, and
+// a second evaluation of the same snapshot must change nothing
+inline size_t CheckAlertEngine(uint64_t seed, size_t& partnerRows) {
+    ForestSpec spec;
+    spec.seed = seed;
+    spec.dcs = 400;
+    spec.sites = 40;
+    spec.localRtt = std::chrono::milliseconds(0);
+    spec.remoteRtt = std::chrono::milliseconds(0);
+    spec.linkFailureRate = 0.05;
+    ForestSimulator forest(spec);
+    ScanEngine scanner(forest.Backend(), nullptr, ProbeOptions());
+    SnapshotPublisher publisher;
+    SnapshotPtr snapshot = scanner.Run(publisher, forest.ConfigurationDn());
+    if (!snapshot) return 1;
+
+    std::vector<AlertRule> rules;
+    std::string error;
+    if (!ParseAlertRules("alert lien_en_echec when partner_failures > 0\n"
+                         "alert lien_ancien site=Site001* when partner_age > 10m or partner_usn_behind > 0\n"
+                         "alert dc_retard dc=DC001*,dc002?? when usn_behind > 0 and latency >= 0\n",
+                         rules, error)) {
+        return 1;
+    }
+    const std::vector<AlertRule> reference = rules;
+    AlertEngine engine(std::move(rules));
+    const int64_t now = snapshot->completedAt;
+    engine.Evaluate(*snapshot, now);
+
+    size_t mismatches = engine.Evaluate(*snapshot, now + 60000).size();
+    AlertSamples dcSamples, partnerSamples;
+    BuildDcAlertSamples(*snapshot, 0xFFFFFFFF, now, dcSamples);
+    BuildPartnerAlertSamples(*snapshot, 0xFFFFFFFF, now, partnerSamples);
+    partnerRows = partnerSamples.count;
+    const ReplicationModel& model = snapshot->model;
+    double values[kAlertMetricCount];
+    std::vector<size_t> expected(reference.size(), 0), fired(reference.size(), 0);
+    for (size_t r = 0; r < reference.size(); r++) {
+        const AlertRule& rule = reference[r];
+        const AlertSamples& samples = rule.partner ? partnerSamples : dcSamples;
+        for (size_t i = 0; i < samples.count; i++) {
+            for (size_t m = 0; m < kAlertMetricCount; m++) values[m] = samples.Column(static_cast<AlertMetric>(m))[i];
+            const DcId dc = samples.dc[i];
+            const bool selected = AlertSelectorMatch(rule.sites, model.SiteName(dc)) &&
+                                  AlertSelectorMatch(rule.dcs, model.DcName(dc));
+            if (selected && AlertLogic::True(EvaluateAlertExpr(rule.when, values))) expected[r]++;
+        }
+    }
+    for (const ActiveAlert& a : engine.Active()) fired[a.rule]++;
+    for (size_t r = 0; r < reference.size(); r++) mismatches += expected[r] != fired[r] || expected[r] == 0 ? 1 : 0;
+    return mismatches;
+}
+
+// Throughput: 1000 generated rules over a synthetic snapshot of dcs DCs,
+// evaluated through AlertEngine as a monitor would, best of passes
+inline AlertBenchmarkResult RunAlertBenchmark(unsigned dcs, unsigned ruleCount, uint64_t seed, unsigned passes = 3) {
+    using Clock = std::chrono::steady_clock;
+    auto millis = [](Clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count() / 1e6;
+    };
+    AlertBenchmarkResult result;
+    result.rules = ruleCount;
+    result.samples = dcs;
+    result.parseFailures = CheckAlertRuleParser(result.parseCases);
+    result.mismatches = CheckAlertPrograms(seed, result.checked) + CheckAlertHysteresis() +
+                        CheckAlertEngine(seed, result.forestRows);
+
+    uint64_t h = seed * 0x9E3779B97F4A7C15ull + 3;
+    auto next = [&]() {
+        h ^= h << 13; h ^= h >> 7; h ^= h << 17;
+        return h;
+    };
+    ScanSnapshot snapshot;
+    snapshot.completedAt = 1714564800000;
+    snapshot.model.Reserve(dcs);
+    for (unsigned i = 0; i < dcs; i++) {
+        const DcId id = snapshot.model.AddDc(L"Site" + std::to_wstring(i / 10), L"DC" + std::to_wstring(i));
+        DcRecord& r = snapshot.model.records[id];
+        r.status = next() % 100 == 0 ? ProbeStatus::Timeout : ProbeStatus::Ok;
+        r.usn = 10000000 - next() % 20000;
+        r.probedAt = snapshot.completedAt;
+        r.probeMs = static_cast<uint32_t>(next() % 500);
+        r.latencySec = static_cast<uint32_t>(next() % 7200);
+        r.lastReplication = snapshot.completedAt - static_cast<int64_t>(next() % 7200000);
+        r.partners = 4;
+        r.failingPartners = next() % 50 == 0 ? 1 : 0;
+        r.errorTotal = next() % 100 == 0 ? static_cast<uint32_t>(next() % 50) : 0;
+        r.events = EventState::Ok;
+    }
+    snapshot.spread = ClassifyLag(snapshot.model);
+
+    // Thresholds past the tail of each distribution: a few hits per rule
+    static const char* const kTemplates[] = {
+        "usn_behind > %u",
+        "latency > %u and failing_partners >= 1",
+        "errors > %u or (timeout = 1 and probe_ms > 490)",
+        "replication_age > %u and lag >= moderate",
+        "probe_ms * 10 > %u and reachable",
+        "not (usn_behind < %u) and latency > 7000",
+    };
+    static const unsigned kBase[] = {19995, 7000, 48, 7195, 4995, 19950};
+    std::string text;
+    char line[256];
+    for (unsigned i = 0; i < ruleCount; i++) {
+        const size_t t = i % 6;
+        std::string condition(256, '\0');
+        condition.resize(std::snprintf(&condition[0], condition.size(), kTemplates[t], kBase[t] + static_cast<unsigned>(next() % 50)));
+        std::snprintf(line, sizeof(line), "alert r%u severity=%s site=%s when %s\n", i, i % 3 ? "warning" : "critical",
+                      i % 10 == 0 ? "Site1*" : "*", condition.c_str());
+        text += line;
+    }
+
+    std::vector<AlertRule> rules;
+    std::string error;
+    const auto compileStart = Clock::now();
+    if (!ParseAlertRules(text, rules, error)) {
+        result.parseFailures++;
+        return result;
+    }
+    result.compileMs = millis(Clock::now() - compileStart);
+
+    AlertEngine engine(std::move(rules));
+    result.evaluateMs = -1;
+    for (unsigned pass = 0; pass < passes; pass++) {
+        const auto start = Clock::now();
+        engine.Evaluate(snapshot, snapshot.completedAt + int64_t(pass) * 60000);
+        const double ms = millis(Clock::now() - start);
+        if (result.evaluateMs < 0 || ms < result.evaluateMs) result.evaluateMs = ms;
+    }
+    result.firing = engine.Active().size();
+    result.ruleSamplesPerSecond = result.evaluateMs > 0 ? double(ruleCount) * dcs / (result.evaluateMs / 1000) : 0;
+    return result;
+}
+
+inline std::string FormatAlertBenchmarkJson(const AlertBenchmarkResult& r) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    auto real = [](double v) {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.3f", v);
+        return std::string(buf);
+    };
+    return "{\"rules\":" + num(r.rules) + ",\"samples\":" + num(r.samples) + ",\"parseCases\":" + num(r.parseCases) +
+           ",\"parseFailures\":" + num(r.parseFailures) + ",\"checked\":" + num(r.checked) +
+           ",\"forestRows\":" + num(r.forestRows) + ",\"mismatches\":" + num(r.mismatches) +
+           ",\"compileMs\":" + real(r.compileMs) + ",\"evaluateMs\":" + real(r.evaluateMs) +
+           ",\"ruleSamplesPerSecond\":" + real(r.ruleSamplesPerSecond) + ",\"firing\":" + num(r.firing) + "}\n";
+}
+
+struct UsnBenchmarkResult {
+    unsigned dcs = 0;
+    unsigned seconds = 0;               // trace length, one sample per DC per second
+    uint64_t samples = 0;
+    size_t injected = 0;                // stalls, rollbacks, restores and bursts put into the traces
+    size_t detected = 0;                // ... raised with the right kind, DC and time
+    size_t missed = 0;
+    size_t unexpected = 0;              // anomalies on clean traces, duplicates, wrong kind or time
+    size_t mismatches = 0;              // t-digest and monitor checks
+    double digestRankError = 0;         // worst |rank(estimate) - q| over the checked quantiles
+    double observeMs = 0;               // UsnAnomalyDetector::Observe over every sample
+    double samplesPerSecond = 0;
+    double nsPerSample = 0;
+    size_t bytesPerDc = 0;
+};
+
+// Quantiles of a digest without decay against the exact ones, then a
+// decaying digest that must follow a shifted distribution. Returns the
+// worst rank error of the first part; failures count into mismatches.
+inline double CheckTDigest(uint64_t seed, size_t& mismatches) {
+    uint64_t h = seed * 0x9E3779B97F4A7C15ull + 11;
+    auto uniform = [&]() {
+        h ^= h << 13; h ^= h >> 7; h ^= h << 17;
+        return static_cast<double>(h >> 11) / 9007199254740992.0;
+    };
+    // Heavy right tail: exp of a sum of uniforms
+    std::vector<float> values(100000);
+    TDigest digest;
+    for (float& v : values) {
+        v = static_cast<float>(std::exp(3 * (uniform() + uniform() + uniform() - 1.5)));
+        digest.Add(v);
+    }
+    std::sort(values.begin(), values.end());
+    double worst = 0;
+    for (double q : {0.001, 0.01, 0.1, 0.5, 0.9, 0.99, 0.999}) {
+        const float estimate = static_cast<float>(digest.Quantile(q));
+        const double rank = double(std::upper_bound(values.begin(), values.end(), estimate) - values.begin()) / values.size();
+        worst = std::max(worst, std::fabs(rank - q));
+    }
+    if (worst > 0.01 || digest.Centroids() > TDigest::kCentroids) mismatches++;
+
+    TDigest recent;
+    recent.SetHalfLife(3600);
+    for (int i = 0; i < 20000; i++) recent.Add(static_cast<float>(uniform()));
+    for (int i = 0; i < 20000; i++) recent.Add(static_cast<float>(100 + uniform()));
+    const double median = recent.Quantile(0.5);
+    if (!(median >= 100 && median <= 101) || recent.Weight() > 2 * 3600) mismatches++;
+    return worst;
+}
+
+// The monitor over hand-built snapshots: rows streamed then completed count
+// once, DCs keep their detector state when the topology order changes, and
+// a USN going back under the same invocation ID is a rollback of that DC
+inline size_t CheckUsnMonitor() {
+    UsnAnomalyOptions options;
+    options.warmup = 0;
+    UsnAnomalyMonitor monitor(options);
+    auto scan = [&](int64_t time, const std::vector<const wchar_t*>& names, const std::vector<uint64_t>& usns, bool stream) {
+        auto snapshot = std::make_shared<ScanSnapshot>();
+        snapshot->startedAt = time;
+        for (size_t i = 0; i < names.size(); i++) {
+            const DcId id = snapshot->model.AddDc(L"Site", names[i]);
+            DcRecord& r = snapshot->model.records[id];
+            r.status = ProbeStatus::Ok;
+            r.usn = usns[i];
+            r.probedAt = time;
+            r.invocation = 7;
+        }
+        monitor.OnScanStarted(snapshot);
+        if (stream) {
+            RowBatch batch;
+            batch.topology = snapshot;
+            for (DcId id = 0; id < snapshot->model.Size(); id++) batch.rows.push_back({id, snapshot->model.records[id]});
+            monitor.OnRows(batch);
+        }
+        snapshot->completedAt = time + 1;
+        monitor.OnScanCompleted(snapshot);
+    };
+    scan(1000, {L"DC1", L"DC2"}, {5000, 9000}, true);
+    scan(2000, {L"DC2", L"DC1"}, {9100, 5100}, true);
+    scan(3000, {L"DC1", L"DC2"}, {5200, 8000}, false);
+    const std::vector<UsnAnomalyEntry> recent = monitor.Recent();
+    size_t mismatches = 0;
+    if (recent.size() != 1 || recent[0].anomaly.kind != UsnAnomalyKind::Rollback || recent[0].dc != L"DC2" ||
+        recent[0].anomaly.previousUsn != 9100 || recent[0].anomaly.time != 3000) {
+        mismatches++;
+    }
+    return mismatches;
+}
+
+// Synthetic traces replayed at one sample per DC per second: each DC
+// changes at its own rate (0.5 to 200 USN/s, +/-50% per second), and one
+// trace in 25 gets an anomaly after ten minutes of warm-up: a 20 minute
+// stall, a rollback or a restore (USN 5000 back, same or new invocation
+// ID), or a one minute burst at 20x its rate. Every injected anomaly must
+// be raised once, at the sample that shows it (stalls 10 minutes in), and
+// nothing else may be. Samples are generated a minute at a time, untimed.
+inline UsnBenchmarkResult RunUsnBenchmark(unsigned dcs, unsigned seconds, uint64_t seed) {
+    using Clock = std::chrono::steady_clock;
+    UsnBenchmarkResult result;
+    result.dcs = dcs;
+    result.seconds = seconds = std::max(seconds, 1800u);
+    result.bytesPerDc = UsnAnomalyDetector::BytesPerDc();
+    result.digestRankError = CheckTDigest(seed, result.mismatches);
+    result.mismatches += CheckUsnMonitor();
+
+    uint64_t h = seed * 0x9E3779B97F4A7C15ull + 5;
+    auto next = [&]() {
+        h ^= h << 13; h ^= h >> 7; h ^= h << 17;
+        return h;
+    };
+    auto uniform = [&]() { return static_cast<double>(next() >> 11) / 9007199254740992.0; };
+
+    struct Trace {
+        double rate = 0;
+        uint64_t usn = 0;
+        uint64_t invocation = 0;
+        int kind = -1;                  // UsnAnomalyKind injected, -1 none
+        unsigned at = 0;                // second it starts
+        unsigned changed = 0;           // second of the last USN change
+        unsigned expected = 0;          // second it must be raised at: stalls, 600 s after the last change
+        size_t raised = 0;
+        bool onTime = false;
+    };
+    std::vector<Trace> traces(dcs);
+    for (unsigned i = 0; i < dcs; i++) {
+        Trace& t = traces[i];
+        t.rate = std::exp(std::log(0.5) + uniform() * std::log(400.0));
+        t.usn = 1000000 + next() % 1000000;
+        t.invocation = next() | 1;
+        if (next() % 25 == 0) {
+            t.kind = static_cast<int>(next() % 4);
+            t.at = 600 + static_cast<unsigned>(next() % (seconds - 1800));
+            t.expected = t.at;
+            result.injected++;
+        }
+    }
+
+    const int64_t base = 1714564800000;
+    const unsigned kChunk = 60;
+    UsnAnomalyDetector detector;
+    detector.Resize(dcs);
+    std::vector<UsnSample> chunk(static_cast<size_t>(kChunk) * dcs);
+    std::vector<UsnAnomaly> raised;
+    Clock::duration observed{0};
+    for (unsigned start = 0; start < seconds; start += kChunk) {
+        const unsigned count = std::min(kChunk, seconds - start);
+        for (unsigned s = 0; s < count; s++) {
+            const unsigned second = start + s;
+            for (unsigned i = 0; i < dcs; i++) {
+                Trace& t = traces[i];
+                double rate = t.rate;
+                if (second >= t.at && t.kind == int(UsnAnomalyKind::Stall) && second < t.at + 1200) rate = 0;
+                if (second >= t.at && t.kind == int(UsnAnomalyKind::Burst) && second < t.at + 60) rate = t.rate * 20 + 100;
+                if (second == t.at && (t.kind == int(UsnAnomalyKind::Rollback) || t.kind == int(UsnAnomalyKind::Restore))) {
+                    t.usn -= 5000;
+                    if (t.kind == int(UsnAnomalyKind::Restore)) t.invocation = next() | 1;
+                } else if (second > 0 && rate > 0) {
+                    const uint64_t delta = static_cast<uint64_t>(rate * (0.5 + uniform()) + uniform());
+                    t.usn += delta;
+                    if (delta) t.changed = second;
+                }
+                if (second == t.at && t.kind == int(UsnAnomalyKind::Stall)) t.expected = t.changed + 600;
+                UsnSample& sample = chunk[static_cast<size_t>(s) * dcs + i];
+                sample.time = base + int64_t(second) * 1000;
+                sample.usn = t.usn;
+                sample.invocation = t.invocation;
+            }
+        }
+
+        raised.clear();
+        const auto observeStart = Clock::now();
+        for (unsigned s = 0; s < count; s++) {
+            const UsnSample* row = chunk.data() + static_cast<size_t>(s) * dcs;
+            for (unsigned i = 0; i < dcs; i++) detector.Observe(i, row[i], raised);
+        }
+        observed += Clock::now() - observeStart;
+        result.samples += uint64_t(count) * dcs;
+
+        for (const UsnAnomaly& a : raised) {
+            Trace& t = traces[a.dc];
+            t.raised++;
+            if (int(a.kind) != t.kind || a.time != base + int64_t(t.expected) * 1000) {
+                result.unexpected++;
+            } else if (t.raised == 1) {
+                t.onTime = true;
+            }
+        }
+    }
+
+    for (const Trace& t : traces) {
+        if (t.kind < 0) continue;
+        if (t.onTime) result.detected++;
+        else result.missed++;
+        if (t.raised > 1) result.unexpected += t.raised - 1;
+    }
+    result.observeMs = std::chrono::duration_cast<std::chrono::nanoseconds>(observed).count() / 1e6;
+    result.samplesPerSecond = result.observeMs > 0 ? result.samples / (result.observeMs / 1000) : 0;
+    result.nsPerSample = result.samples ? result.observeMs * 1e6 / result.samples : 0;
+    return result;
+}
+
+inline std::string FormatUsnBenchmarkJson(const UsnBenchmarkResult& r) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    auto real = [](double v) {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.3f", v);
+        return std::string(buf);
+    };
+    char rankError[32];
+    std::snprintf(rankError, sizeof(rankError), "%.5f", r.digestRankError);
+    return "{\"dcs\":" + num(r.dcs) + ",\"seconds\":" + num(r.seconds) + ",\"samples\":" + num(r.samples) +
+           ",\"injected\":" + num(r.injected) + ",\"detected\":" + num(r.detected) + ",\"missed\":" + num(r.missed) +
+           ",\"unexpected\":" + num(r.unexpected) + ",\"mismatches\":" + num(r.mismatches) +
+           ",\"digestRankError\":" + rankError + ",\"observeMs\":" + real(r.observeMs) +
+           ",\"samplesPerSecond\":" + real(r.samplesPerSecond) + ",\"nsPerSample\":" + real(r.nsPerSample) +
+           ",\"bytesPerDc\":" + num(r.bytesPerDc) + "}\n";
+}
+
+struct CanaryBenchmarkResult {
+    unsigned dcs = 0;
+    unsigned sites = 0;
+    unsigned probes = 0;
+    size_t pairs = 0;
+    size_t converged = 0;
+    size_t notConverged = 0;
+    size_t unreachable = 0;
+    size_t writeFailed = 0;
+    size_t outOfBounds = 0;             // converged pairs whose [lower, upper] misses the simulated delay
+    size_t mismatches = 0;              // wrong status, site table totals
+    size_t sitePairs = 0;
+    uint64_t reads = 0;
+    double readsPerPair = 0;
+    double boundShare = 0;              // mean (upper - lower) / delay over converged pairs
+    int64_t maxDelayMs = 0;
+    double wallMs = 0;
+};
+
+// Canary probes against the simulated directory: sites of ten DCs, a
+// replication delay of 40 to 320 ms growing with the destination's site,
+// 1 to 3 ms per read. One probe per site writes at once from the site's
+// first DC, so every probe is in flight together. The last DC never
+// answers and the one before it never receives changes: their pairs must
+// end Unreachable and NotConverged at the two second probe timeout, every
+// other pair Converged with bounds around the simulated delay.
+inline CanaryBenchmarkResult RunCanaryBenchmark(unsigned dcs, uint64_t seed) {
+    using Clock = std::chrono::steady_clock;
+    CanaryBenchmarkResult result;
+    result.dcs = dcs = std::max(dcs, 12u);
+    result.sites = (dcs + 9) / 10;
+
+    auto backend = std::make_shared<SimulatedDirectoryBackend>(seed);
+    backend->EnablePool();
+    std::vector<ProbeTarget> targets;
+    for (unsigned i = 0; i < dcs; i++) {
+        SimulatedDc dc;
+        dc.name = L"dc" + std::to_wstring(i) + L".canary.test";
+        dc.latency = std::chrono::milliseconds(1 + (i * 7 + seed) % 3);
+        dc.replicationDelay = std::chrono::milliseconds(40 + 40 * ((i / 10) % 8));
+        if (i == dcs - 2) dc.replicationDelay = std::chrono::hours(1);
+        if (i == dcs - 1) dc.failureRate = 1.0;
+        backend->AddDc(dc);
+        targets.push_back(ProbeTarget{dc.name, i / 10});
+    }
+    std::vector<uint32_t> origins;
+    for (unsigned site = 0; site < result.sites; site++) {
+        if (site * 10 < dcs - 2) origins.push_back(site * 10);
+    }
+    result.probes = static_cast<unsigned>(origins.size());
+
+    CanaryOptions options;
+    options.container = L"CN=Canaries,DC=canary,DC=test";
+    options.maxInFlight = 64;
+    options.firstPoll = std::chrono::milliseconds(10);
+    options.maxInterval = std::chrono::milliseconds(250);
+    options.backoff = 1.25;
+    options.readTimeout = std::chrono::milliseconds(1000);
+    options.probeTimeout = std::chrono::milliseconds(2000);
+    CanaryProbe probe(backend, options);
+    CanaryLatencyTable table;
+
+    const uint64_t callsBefore = backend->Calls();
+    const Clock::time_point start = Clock::now();
+    std::vector<CanaryResult> results = probe.Run(targets, origins, [&](const CanaryResult& r) {
+        table.Record(r, targets[r.source].site, targets[r.dest].site);
+    });
+    result.wallMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    result.reads = backend->Calls() - callsBefore - result.probes;
+    result.pairs = results.size();
+
+    for (const auto& r : results) {
+        CanaryStatus expected = r.dest == dcs - 1 ? CanaryStatus::Unreachable
+                              : r.dest == dcs - 2 ? CanaryStatus::NotConverged
+                                                  : CanaryStatus::Converged;
+        if (r.status != expected) result.mismatches++;
+        switch (r.status) {
+            case CanaryStatus::Converged:    result.converged++; break;
+            case CanaryStatus::NotConverged: result.notConverged++; break;
+            case CanaryStatus::Unreachable:  result.unreachable++; break;
+            case CanaryStatus::WriteFailed:  result.writeFailed++; break;
+            default: break;
+        }
+        if (r.status != CanaryStatus::Converged) continue;
+        const int64_t delay = backend->ReplicationDelay(targets[r.source].dc, targets[r.dest].dc).count();
+        result.maxDelayMs = std::max(result.maxDelayMs, delay);
+        if (delay < r.lowerMs || delay > r.upperMs) result.outOfBounds++;
+        result.boundShare += static_cast<double>(r.upperMs - r.lowerMs) / static_cast<double>(std::max<int64_t>(1, delay));
+    }
+    if (result.converged) result.boundShare /= static_cast<double>(result.converged);
+    result.readsPerPair = result.pairs ? static_cast<double>(result.reads) / static_cast<double>(result.pairs) : 0;
+
+    uint64_t tabled = 0;
+    for (const auto& row : table.Rows()) tabled += row.converged + row.failed;
+    if (tabled != result.converged + result.notConverged + result.unreachable) result.mismatches++;
+    result.sitePairs = table.Size();
+    return result;
+}
+
+struct PipelineBenchmarkResult {
+    unsigned dcs = 0;
+    unsigned sites = 0;
+    int64_t generateMs = 0;
+    size_t delivered = 0;               // DCs the sink received
+    size_t reachable = 0;
+    size_t missing = 0;                 // DCs never delivered, or delivered twice
+    size_t mismatches = 0;              // records differing from ScanEngine's
+    bool overlapped = false;            // the first DC reached the sink before discovery ended
+    int64_t firstDcMs = -1;
+    int64_t discoveryMs = 0;
+    int64_t pipelineMs = 0;
+    int64_t phasedMs = 0;               // ScanEngine::Run on the same forest
+    uint64_t baseRssKb = 0;             // after generation, before either scan
+    uint64_t pipelineKb = 0;            // peak resident growth over the base during the pipelined scan
+    uint64_t phasedKb = 0;              // ... during ScanEngine::Run, snapshot included
+    size_t maxQueueDepth = 0;
+    uint64_t fullWaits = 0;
+    PipelineStats stats;
+};
+
+// Order-independent digest of the fields both scans must agree on
+inline uint64_t PipelineRecordDigest(const std::wstring& dc, const DcRecord& r) {
+    uint64_t h = InvocationKey(dc);
+    for (uint64_t v : {static_cast<uint64_t>(r.status), r.usn, static_cast<uint64_t>(r.partners),
+                       static_cast<uint64_t>(r.failingPartners), static_cast<uint64_t>(r.HasLatency())}) {
+        h = (h ^ v) * 0x100000001B3ull;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+// A generated forest (sites of 10 DCs, 100 per domain, unpooled reads so
+// the simulator keeps no per-DC session) scanned through ScanPipeline
+// into a sink that keeps nothing but counters, then by ScanEngine::Run.
+// The resident set is sampled during each scan, against a base taken
+// after generation with free pages handed back: the pipeline's growth
+// should not depend on the forest size, ScanEngine's grows with it. The
+// digests of the records (status, USN, partners) must match.
+inline PipelineBenchmarkResult RunPipelineBenchmark(unsigned dcs, const ProbeOptions& probe, uint64_t seed,
+                                                    std::chrono::milliseconds rtt) {
+    using Clock = std::chrono::steady_clock;
+    auto ms = [](Clock::duration d) { return std::chrono::duration_cast<std::chrono::milliseconds>(d).count(); };
+    PipelineBenchmarkResult result;
+    result.dcs = dcs;
+
+    ForestSpec spec;
+    spec.seed = seed;
+    spec.dcs = dcs;
+    spec.sites = std::max(1u, dcs / 10);
+    spec.localRtt = spec.remoteRtt = rtt;
+    spec.pooled = false;
+    result.sites = spec.sites;
+    Clock::time_point t0 = Clock::now();
+    ForestSimulator forest(spec);
+    result.generateMs = ms(Clock::now() - t0);
+
+    struct CountingSink : IPipelineSink {
+        Clock::time_point start;
+        Clock::time_point first;
+        std::vector<uint8_t> seen;
+        uint64_t digest = 0;
+        size_t count = 0;
+        size_t reachable = 0;
+        size_t duplicates = 0;
+        void OnDc(const PipelineDc& dc) override {
+            if (count++ == 0) first = Clock::now();
+            if (dc.record.HasUsn()) reachable++;
+            if (dc.seq < seen.size() && seen[dc.seq]++) duplicates++;
+            digest += PipelineRecordDigest(dc.name, dc.record);
+        }
+    } sink;
+    sink.seen.assign(dcs, 0);
+
+    ReleaseFreeMemory();
+    result.baseRssKb = CurrentRssKb();
+    RssSampler sampler;
+    sampler.Start();
+    ScanPipeline pipeline(forest.Backend(), nullptr, probe);
+    sink.start = Clock::now();
+    PipelineResult run = pipeline.Run(forest.ConfigurationDn(), sink);
+    const uint64_t pipelinePeak = sampler.Stop();
+    result.pipelineMs = ms(Clock::now() - sink.start);
+    result.pipelineKb = pipelinePeak > result.baseRssKb ? pipelinePeak - result.baseRssKb : 0;
+    result.stats = run.stats;
+    result.delivered = sink.count;
+    result.reachable = sink.reachable;
+    result.missing = sink.duplicates + (dcs > sink.count ? dcs - sink.count : sink.count - dcs);
+    if (sink.count) result.firstDcMs = ms(sink.first - sink.start);
+    const PipelineStageStats& discover = run.stats.stages[static_cast<size_t>(PipelineStage::Discover)];
+    result.discoveryMs = static_cast<int64_t>((discover.busyUs + discover.blockedUs) / 1000);
+    result.overlapped = sink.count > 0 && result.firstDcMs < result.discoveryMs;
+    for (const auto& q : run.stats.queues) {
+        result.maxQueueDepth = std::max(result.maxQueueDepth, q.maxDepth);
+        result.fullWaits += q.fullWaits;
+    }
+
+    // The same forest the phased way; the snapshot stays alive until the
+    // peak is read, as a front end would hold it
+    ReleaseFreeMemory();
+    const uint64_t phasedBase = CurrentRssKb();
+    sampler.Start();
+    SnapshotPublisher publisher;
+    ScanEngine engine(forest.Backend(), nullptr, probe);
+    t0 = Clock::now();
+    SnapshotPtr snapshot = engine.Run(publisher, forest.ConfigurationDn());
+    result.phasedMs = ms(Clock::now() - t0);
+    const uint64_t phasedPeak = sampler.Stop();
+    result.phasedKb = phasedPeak > phasedBase ? phasedPeak - phasedBase : 0;
+
+    uint64_t digest = 0;
+    if (snapshot) {
+        const ReplicationModel& model = snapshot->model;
+        for (DcId id = 0; id < model.Size(); id++) digest += PipelineRecordDigest(model.DcName(id), model.records[id]);
+        if (model.Size() != sink.count) result.mismatches++;
+    }
+    if (digest != sink.digest) result.mismatches++;
+    return result;
+}
+
+inline std::string FormatPipelineBenchmarkJson(const PipelineBenchmarkResult& r) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    return "{\"dcs\":" + num(r.dcs) + ",\"sites\":" + num(r.sites) + ",\"generateMs\":" + num(r.generateMs) +
+           ",\"delivered\":" + num(r.delivered) + ",\"reachable\":" + num(r.reachable) +
+           ",\"missing\":" + num(r.missing) + ",\"mismatches\":" + num(r.mismatches) +
+           ",\"overlapped\":" + (r.overlapped ? "true" : "false") + ",\"firstDcMs\":" + std::to_string(r.firstDcMs) +
+           ",\"discoveryMs\":" + num(r.discoveryMs) + ",\"pipelineMs\":" + num(r.pipelineMs) +
+           ",\"phasedMs\":" + num(r.phasedMs) + ",\"baseRssKb\":" + num(r.baseRssKb) +
+           ",\"pipelineKb\":" + num(r.pipelineKb) + ",\"phasedKb\":" + num(r.phasedKb) +
+           "," + FormatPipelineStatsJson(r.stats) + "}\n";
+}
+
+struct RepadminBenchmarkPass {
+    unsigned workers = 0;
+    size_t chunks = 0;
+    double splitMs = 0;
+    double parseMs = 0;
+    double mergeMs = 0;
+    double totalMs = 0;                 // mapping included
+    double megabytesPerSecond = 0;
+};
+
+struct RepadminBenchmarkResult {
+    unsigned megabytes = 0;             // requested dump size
+    unsigned dcs = 0;
+    unsigned dumps = 0;                 // repadmin runs concatenated in the file
+    uint64_t bytes = 0;
+    uint64_t rows = 0;
+    uint64_t superseded = 0;
+    size_t csvRecords = 0;              // scanner check: records compared against the reference reader
+    size_t imports = 0;                 // small dumps imported by the checks
+    size_t mismatches = 0;              // scanner, imports or the large dump disagreeing with what was generated
+    double generateMs = 0;
+    std::vector<RepadminBenchmarkPass> passes;  // one worker, then every core
+};
+
+// What a generated showrepl dump must import as: its last run, measured
+// against the newest time in the file
+struct ShowreplTruth {
+    int64_t dumpTime = 0;
+    uint64_t rows = 0;
+    uint64_t unique = 0;                // distinct (destination, NC, source)
+    size_t links = 0;
+    unsigned dcs = 0;
+    unsigned dumps = 0;
+    std::vector<DcRecord> records;      // by generated DC index
+};
+
+// "YYYY-MM-DD HH:MM:SS" as repadmin prints it, without going through the
+// C library for every row
+inline void FormatRepadminTime(int64_t unixMs, char (&text)[20]) {
+    const int64_t secs = unixMs / 1000;
+    int64_t days = secs / 86400;
+    const unsigned sod = static_cast<unsigned>(secs % 86400);
+    // Civil from days (Howard Hinnant's algorithm)
+    days += 719468;
+    const int64_t era = days / 146097;
+    const unsigned doe = static_cast<unsigned>(days - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    const unsigned d = doy - (153 * mp + 2) / 5 + 1;
+    const unsigned m = mp < 10 ? mp + 3 : mp - 9;
+    const unsigned y = static_cast<unsigned>(yoe + era * 400 + (m <= 2));
+    auto put = [&](size_t at, unsigned value, size_t digits) {
+        for (size_t i = digits; i-- > 0; value /= 10) text[at + i] = static_cast<char>('0' + value % 10);
+    };
+    put(0, y, 4);
+    text[4] = '-';
+    put(5, m, 2);
+    text[7] = '-';
+    put(8, d, 2);
+    text[10] = ' ';
+    put(11, sod / 3600, 2);
+    text[13] = ':';
+    put(14, sod / 60 % 60, 2);
+    text[16] = ':';
+    put(17, sod % 60, 2);
+    text[19] = '\0';
+}
+
+// repadmin /showrepl * /csv of a forest of dcs DCs (10 per site, every
+// 7th site name quoted for its comma), four NCs, two same-site partners
+// per DC and one from the next site for each site's first DC. Runs are an
+// hour apart and written until minBytes is reached: 5% of the links fail
+// in each run. exported writes what Import-Csv | Export-Csv makes of it:
+// a #TYPE line, no tag column, every field quoted.
+inline ShowreplTruth GenerateShowreplDump(unsigned dcs, uint64_t minBytes, uint64_t seed, bool exported,
+                                          const std::function<void(const std::string&)>& write) {
+    static const char* const kNcs[] = {
+        "DC=corp,DC=example,DC=com", "CN=Configuration,DC=corp,DC=example,DC=com",
+        "CN=Schema,CN=Configuration,DC=corp,DC=example,DC=com", "DC=DomainDnsZones,DC=corp,DC=example,DC=com"};
+    ShowreplTruth truth;
+    dcs = std::max(2u, dcs);
+    truth.dcs = dcs;
+    auto siteName = [](unsigned dc) {
+        const unsigned site = dc / 10;
+        return site % 7 == 3 ? "\"Site" + std::to_string(site) + ", annexe\"" : "Site" + std::to_string(site);
+    };
+    std::vector<std::vector<unsigned>> sources(dcs);
+    for (unsigned i = 0; i < dcs; i++) {
+        const unsigned base = i / 10 * 10, size = std::min(10u, dcs - base);
+        if (size > 1) sources[i].push_back(base + (i - base + 1) % size);
+        if (size > 2) sources[i].push_back(base + (i - base + size - 1) % size);
+        if (i == base && dcs > 10) sources[i].push_back((base + 10) % (dcs / 10 * 10));
+        std::sort(sources[i].begin(), sources[i].end());
+        sources[i].erase(std::unique(sources[i].begin(), sources[i].end()), sources[i].end());
+        sources[i].erase(std::remove(sources[i].begin(), sources[i].end(), i), sources[i].end());
+    }
+
+    uint64_t h = seed * 0x9E3779B97F4A7C15ull + 11;
+    auto next = [&]() {
+        h ^= h << 13; h ^= h >> 7; h ^= h << 17;
+        return h;
+    };
+    const int64_t start = 1714564800000;    // 2024-05-01 12:00:00
+    const char* const columns = "Destination DSA Site,Destination DSA,Naming Context,Source DSA Site,Source DSA,Transport Type,"
+                                "Number of Failures,Last Failure Time,Last Success Time,Last Failure Status";
+    std::string out;
+    std::vector<DcRecord> last(dcs);
+    std::vector<int64_t> oldest(dcs);
+    uint64_t written = 0;
+    char line[512], success[20], failure[20];
+    if (exported) {
+        out = "#TYPE System.Management.Automation.PSCustomObject\r\n";
+        for (const char* c = columns; *c; c++) {
+            if (c == columns || c[-1] == ',') out += '"';
+            out += *c;
+            if (c[1] == ',' || c[1] == '\0') out += '"';
+        }
+        out += "\r\n";
+    }
+    for (unsigned run = 0; run == 0 || written + out.size() < minBytes; run++) {
+        const int64_t at = start + static_cast<int64_t>(run) * 3600000;
+        if (!exported) out += std::string("showrepl_COLUMNS,") + columns + "\r\n";
+        for (unsigned dest = 0; dest < dcs; dest++) {
+            DcRecord& r = last[dest];
+            r = DcRecord();
+            oldest[dest] = 0;
+            std::vector<bool> failing(sources[dest].size(), false);
+            for (const char* nc : kNcs) {
+                for (size_t k = 0; k < sources[dest].size(); k++) {
+                    const unsigned source = sources[dest][k];
+                    const bool fails = next() % 20 == 0;
+                    const uint32_t failures = fails ? 1 + static_cast<uint32_t>(next() % 5) : 0;
+                    const int64_t lastSuccess = fails ? at - static_cast<int64_t>(1 + next() % 48) * 3600000
+                                                      : at - static_cast<int64_t>(next() % 3540) * 1000;
+                    const bool oldFailure = !fails && next() % 10 == 0;
+                    FormatRepadminTime(lastSuccess, success);
+                    FormatRepadminTime(fails ? at : at - 2 * 86400000, failure);
+                    const std::string destSite = siteName(dest), sourceSite = siteName(source);
+                    int n;
+                    if (exported) {
+                        auto q = [](const std::string& s) { return s[0] == '"' ? s : '"' + s + '"'; };
+                        n = std::snprintf(line, sizeof(line), "%s,\"DC%05u\",\"%s\",%s,\"DC%05u\",\"RPC\",\"%u\",\"%s\",\"%s\",\"%u\"\r\n",
+                                          q(destSite).c_str(), dest, nc, q(sourceSite).c_str(), source, failures,
+                                          fails || oldFailure ? failure : "0", success, fails ? (next() % 2 ? 1722u : 8524u) : 0u);
+                    } else {
+                        n = std::snprintf(line, sizeof(line), "showrepl_INFO,%s,DC%05u,\"%s\",%s,DC%05u,RPC,%u,%s,%s,%u\r\n",
+                                          destSite.c_str(), dest, nc, sourceSite.c_str(), source, failures,
+                                          fails || oldFailure ? failure : "0", success, fails ? (next() % 2 ? 1722u : 8524u) : 0u);
+                    }
+                    out.append(line, static_cast<size_t>(n));
+                    truth.rows++;
+                    truth.dumpTime = std::max(truth.dumpTime, std::max(lastSuccess, fails ? at : int64_t(0)));
+                    if (fails) failing[k] = true;
+                    r.lastReplication = std::max(r.lastReplication, lastSuccess);
+                    if (oldest[dest] == 0 || lastSuccess < oldest[dest]) oldest[dest] = lastSuccess;
+                }
+            }
+            r.status = ProbeStatus::Ok;
+            r.partners = static_cast<uint16_t>(sources[dest].size());
+            r.failingPartners = static_cast<uint16_t>(std::count(failing.begin(), failing.end(), true));
+        }
+        written += out.size();
+        write(out);
+        out.clear();
+        truth.dumps = run + 1;
+    }
+    for (unsigned dest = 0; dest < dcs; dest++) {
+        last[dest].latencySec = static_cast<uint32_t>((truth.dumpTime - oldest[dest]) / 1000);
+        truth.unique += sources[dest].size() * 4;
+        truth.links += sources[dest].size();
+    }
+    truth.records = std::move(last);
+    return truth;
+}
+
+// Fields of the import that differ from the generated dump's last run
+inline size_t CountShowreplMismatches(const ScanSnapshot& snapshot, const RepadminImportStats& stats, const ShowreplTruth& truth) {
+    const ReplicationModel& model = snapshot.model;
+    size_t bad = 0;
+    if (model.Size() != truth.dcs) bad++;
+    if (stats.rows != truth.rows) bad++;
+    if (stats.rows - stats.superseded != truth.unique) bad++;
+    if (stats.dumpTime != truth.dumpTime) bad++;
+    if (snapshot.links.size() != truth.links) bad++;
+    if (snapshot.latency.CellCount() != truth.unique) bad++;
+    wchar_t name[16];
+    for (unsigned i = 0; i < truth.dcs; i++) {
+        std::swprintf(name, 16, L"DC%05u", i);
+        const DcId id = model.dcs.Find(name);
+        if (id == kInvalidId) {
+            bad++;
+            continue;
+        }
+        const DcRecord& a = model.records[id];
+        const DcRecord& b = truth.records[i];
+        if (a.status != b.status || a.partners != b.partners || a.failingPartners != b.failingPartners ||
+            a.lastReplication != b.lastReplication || a.latencySec != b.latencySec) {
+            bad++;
+        }
+    }
+    return bad;
+}
+
+// Random CSV (quoted fields holding commas, quotes, CR and LF, CRLF or LF
+// endings, records wider than CsvRecord keeps, no final newline at times)
+// read by CsvScanner in one piece and in chunks from SplitCsvChunks,
+// against a byte-at-a-time RFC 4180 reader. Returns the records that differ.
+inline size_t CheckCsvScanner(uint64_t seed, size_t& records) {
+    uint64_t h = seed * 0x9E3779B97F4A7C15ull + 5;
+    auto next = [&]() {
+        h ^= h << 13; h ^= h >> 7; h ^= h << 17;
+        return h;
+    };
+    typedef std::vector<std::vector<std::string>> Table;
+    size_t bad = 0;
+    records = 0;
+    for (unsigned round = 0; round < 20; round++) {
+        static const char kAlphabet[] = {'a', 'b', 'z', ' ', ',', '"', '\n', '\r', '\xC3', '\xA9', '0', '9'};
+        std::string text;
+        const unsigned count = 50 + static_cast<unsigned>(next() % 200);
+        for (unsigned r = 0; r < count; r++) {
+            const unsigned fields = 1 + static_cast<unsigned>(next() % (next() % 10 == 0 ? 24 : 12));
+            for (unsigned f = 0; f < fields; f++) {
+                if (f) text += ',';
+                std::string value;
+                const unsigned length = static_cast<unsigned>(next() % (next() % 8 == 0 ? 150 : 12));
+                for (unsigned k = 0; k < length; k++) value += kAlphabet[next() % sizeof(kAlphabet)];
+                const bool special = value.find_first_of(",\"\r\n") != std::string::npos;
+                if (special || next() % 4 == 0) {
+                    text += '"';
+                    for (char c : value) text += c == '"' ? std::string("\"\"") : std::string(1, c);
+                    text += '"';
+                } else {
+                    text += value;
+                }
+            }
+            if (r + 1 < count || next() % 2) text += next() % 2 ? "\r\n" : "\n";
+        }
+
+        // Reference: one state machine, byte by byte
+        Table expected(1, std::vector<std::string>(1));
+        bool quoted = false, wasQuoted = false;
+        for (size_t i = 0; i < text.size(); i++) {
+            const char c = text[i];
+            std::string& field = expected.back().back();
+            if (quoted) {
+                if (c == '"' && i + 1 < text.size() && text[i + 1] == '"') {
+                    field += '"';
+                    i++;
+                } else if (c == '"') {
+                    quoted = false;
+                } else {
+                    field += c;
+                }
+            } else if (c == '"' && field.empty() && !wasQuoted) {
+                quoted = wasQuoted = true;
+            } else if (c == ',') {
+                expected.back().emplace_back();
+                wasQuoted = false;
+            } else if (c == '\n') {
+                expected.emplace_back(1);
+                wasQuoted = false;
+            } else if (c == '\r' && i + 1 < text.size() && text[i + 1] == '\n') {
+                continue;
+            } else {
+                field += c;
+            }
+        }
+        if (expected.back().size() == 1 && expected.back()[0].empty() && !text.empty() && text.back() == '\n') {
+            expected.pop_back();
+        }
+
+        auto compare = [&](const Table& got) {
+            size_t diff = got.size() > expected.size() ? got.size() - expected.size() : expected.size() - got.size();
+            for (size_t i = 0; i < std::min(got.size(), expected.size()); i++) {
+                if (got[i] != expected[i]) diff++;
+            }
+            return diff;
+        };
+        auto read = [](CsvScanner& scanner, const char* data, size_t size, Table& out) {
+            scanner.Scan(data, size, [&](const CsvRecord& r) {
+                out.emplace_back();
+                for (size_t f = 0; f < r.count; f++) {
+                    out.back().emplace_back(f < CsvRecord::kMaxFields ? std::string(r.fields[f]) : std::string());
+                }
+                return true;
+            });
+        };
+        for (auto& row : expected) {
+            for (size_t f = CsvRecord::kMaxFields; f < row.size(); f++) row[f].clear();
+        }
+        records += expected.size();
+
+        CsvScanner scanner;
+        Table whole;
+        read(scanner, text.data(), text.size(), whole);
+        bad += compare(whole);
+        for (size_t chunkBytes : {64, 128, 320, 4096}) {
+            const std::vector<size_t> starts = SplitCsvChunks(text.data(), text.size(), chunkBytes, 4);
+            Table pieces;
+            for (size_t i = 0; i + 1 < starts.size(); i++) read(scanner, text.data() + starts[i], starts[i + 1] - starts[i], pieces);
+            bad += compare(pieces);
+        }
+    }
+    return bad;
+}
+
+// A replsummary as repadmin prints it, with a localised header and the
+// delta forms it uses
+inline size_t CheckReplSummaryImport() {
+    const std::string text =
+        "Heure de début du résumé de réplication : 2024-05-01 12:00:00\r\n\r\n"
+        "Début de la collecte de données pour le résumé de réplication :\r\n  .....\r\n\r\n\r\n"
+        "DSA source          delta le plus grand   échecs/total %%   erreur\r\n"
+        " DC01                      12m:34s    0 /  10    0\r\n"
+        " DC02                   03h:01m:02s    2 /  10   20  (1722) Le serveur RPC n'est pas disponible.\r\n"
+        " DC04                          :05s    0 /   2    0\r\n\r\n\r\n"
+        "DSA de destination  delta le plus grand   échecs/total %%   erreur\r\n"
+        " DC01                      15m:02s    0 /   5    0\r\n"
+        " DC02                 1d.02h:00m:00s   1 /   5   20  (1722) Le serveur RPC n'est pas disponible.\r\n"
+        " DC05                     >60 days    5 /   5  100  (8524) Échec de la recherche DNS.\r\n\r\n"
+        "Erreurs opérationnelles lors de la récupération des informations de réplication :\r\n"
+        "          58 - DC03.corp.example.com\r\n";
+    SnapshotPtr snapshot;
+    RepadminImportStats stats;
+    std::string error;
+    if (!ImportRepadminBuffer(text.data(), text.size(), RepadminImportOptions(), snapshot, stats, error)) return 1;
+    const ReplicationModel& model = snapshot->model;
+    struct Expected { const wchar_t* dc; ProbeStatus status; uint32_t latencySec; uint16_t failing; uint16_t total; };
+    const Expected expected[] = {
+        {L"DC01", ProbeStatus::Ok, 902, 0, 5}, {L"DC02", ProbeStatus::Ok, 93600, 1, 5},
+        {L"DC04", ProbeStatus::Unreachable, kUnknownLatency, 0, 0}, {L"DC05", ProbeStatus::Ok, 60 * 86400, 5, 5},
+        {L"DC03", ProbeStatus::Unreachable, kUnknownLatency, 0, 0}};
+    size_t bad = stats.format != RepadminFormat::ReplSummary || stats.dumpTime != 1714564800000 || model.Size() != 5 ? 1 : 0;
+    for (const Expected& e : expected) {
+        const DcId id = model.dcs.Find(e.dc);
+        if (id == kInvalidId) {
+            bad++;
+            continue;
+        }
+        const DcRecord& r = model.records[id];
+        if (r.status != e.status || r.latencySec != e.latencySec || r.failingPartners != e.failing || r.partners != e.total) bad++;
+    }
+    return bad;
+}
+
+// Checks first: the CSV scanner against its reference, then small
+// generated dumps (repadmin's own output, an Export-Csv round trip, the
+// same dump in UTF-16 with a BOM, each in small chunks) and a replsummary.
+// Then a dump of about megabytes MB written to the temporary directory and
+// imported through the mapped file with one worker and with every core;
+// both imports must match the generator.
+inline RepadminBenchmarkResult RunRepadminBenchmark(unsigned megabytes, unsigned dcs, uint64_t seed) {
+    using Clock = std::chrono::steady_clock;
+    auto millis = [](Clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(d).count() / 1000.0;
+    };
+    RepadminBenchmarkResult result;
+    result.megabytes = megabytes;
+    result.dcs = dcs;
+    result.mismatches = CheckCsvScanner(seed, result.csvRecords) + CheckReplSummaryImport();
+    result.imports = 1;
+
+    for (int variant = 0; variant < 3; variant++) {
+        std::string dump;
+        const ShowreplTruth truth = GenerateShowreplDump(50, 200 * 1024, seed, variant == 1,
+                                                         [&](const std::string& s) { dump += s; });
+        if (variant == 2) {
+            std::string wide("\xFF\xFE", 2);
+            for (char c : dump) {
+                wide += c;
+                wide += '\0';
+            }
+            dump.swap(wide);
+        }
+        for (size_t chunkBytes : {size_t(256), size_t(64 * 1024)}) {
+            RepadminImportOptions options;
+            options.chunkBytes = chunkBytes;
+            SnapshotPtr snapshot;
+            RepadminImportStats stats;
+            std::string error;
+            result.imports++;
+            if (!ImportRepadminBuffer(dump.data(), dump.size(), options, snapshot, stats, error)) {
+                result.mismatches++;
+                continue;
+            }
+            result.mismatches += CountShowreplMismatches(*snapshot, stats, truth);
+        }
+    }
+
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / ("adri_showrepl_" + std::to_string(megabytes) + ".csv");
+    Clock::time_point t0 = Clock::now();
+    std::FILE* file = std::fopen(path.string().c_str(), "wb");
+    if (!file) {
+        result.mismatches++;
+        return result;
+    }
+    bool written = true;
+    const ShowreplTruth truth = GenerateShowreplDump(dcs, static_cast<uint64_t>(megabytes) << 20, seed, false,
+                                                     [&](const std::string& s) {
+        written = std::fwrite(s.data(), 1, s.size(), file) == s.size() && written;
+    });
+    written = std::fclose(file) == 0 && written;
+    result.generateMs = millis(Clock::now() - t0);
+    result.dumps = truth.dumps;
+    if (!written) {
+        result.mismatches++;
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+        return result;
+    }
+
+    std::vector<unsigned> workerCounts = {1};
+    const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    if (cores > 1) workerCounts.push_back(cores);
+    for (unsigned workers : workerCounts) {
+        RepadminImportOptions options;
+        options.workers = workers;
+        SnapshotPtr snapshot;
+        RepadminImportStats stats;
+        std::string error;
+        t0 = Clock::now();
+        const bool ok = ImportRepadminFile(path.wstring(), options, snapshot, stats, error);
+        RepadminBenchmarkPass pass;
+        pass.totalMs = millis(Clock::now() - t0);
+        pass.workers = workers;
+        pass.chunks = stats.chunks;
+        pass.splitMs = stats.splitMs;
+        pass.parseMs = stats.parseMs;
+        pass.mergeMs = stats.mergeMs;
+        if (pass.totalMs > 0) pass.megabytesPerSecond = stats.bytes / (1024.0 * 1024.0) / (pass.totalMs / 1000);
+        result.passes.push_back(pass);
+        result.bytes = stats.bytes;
+        result.rows = stats.rows;
+        result.superseded = stats.superseded;
+        result.mismatches += ok ? CountShowreplMismatches(*snapshot, stats, truth) : 1;
+    }
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    return result;
+}
+
+inline std::string FormatRepadminBenchmarkJson(const RepadminBenchmarkResult& r) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    auto real = [](double v) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.2f", v);
+        return std::string(text);
+    };
+    std::string s = "{\"megabytes\":" + num(r.megabytes) + ",\"dcs\":" + num(r.dcs) + ",\"dumps\":" + num(r.dumps) +
+                    ",\"bytes\":" + num(r.bytes) + ",\"rows\":" + num(r.rows) + ",\"superseded\":" + num(r.superseded) +
+                    ",\"csvRecords\":" + num(r.csvRecords) + ",\"imports\":" + num(r.imports) +
+                    ",\"mismatches\":" + num(r.mismatches) + ",\"generateMs\":" + real(r.generateMs) + ",\"passes\":[";
+    for (size_t i = 0; i < r.passes.size(); i++) {
+        const RepadminBenchmarkPass& p = r.passes[i];
+        if (i) s += ',';
+        s += "{\"workers\":" + num(p.workers) + ",\"chunks\":" + num(p.chunks) + ",\"splitMs\":" + real(p.splitMs) +
+             ",\"parseMs\":" + real(p.parseMs) + ",\"mergeMs\":" + real(p.mergeMs) + ",\"totalMs\":" + real(p.totalMs) +
+             ",\"megabytesPerSecond\":" + real(p.megabytesPerSecond) + '}';
+    }
+    return s + "]}\n";
+}
+
+struct DnBenchmarkResult {
+    unsigned dcs = 0;
+    size_t dns = 0;                     // distinct DNs of the simulated forest
+    size_t lookups = 0;                 // DN and ancestor lookups of one discovery pass
+    size_t fuzzCases = 0;               // generated DNs, each written several ways
+    size_t mutated = 0;                 // corrupted DNs fed to the parser
+    size_t mutatedParsed = 0;           // still DNs after corruption
+    size_t mismatches = 0;              // fuzz failures, or interned lookups disagreeing with the forest
+    size_t legacyMissed = 0;            // lookups the lowered text keys could not resolve
+    double legacyMs = 0;                // lowered copies in string-keyed maps, textual parents
+    double internedMs = 0;              // DnTable ids, parents from the table, vector indexes
+    uint64_t legacyAllocations = 0;
+    uint64_t internedAllocations = 0;
+    size_t arenaBytes = 0;
+};
+
+// RFC 4514 text of a DN given as (type, value) pairs, leaf first. style
+// bits: 1 hex-escapes specials and non-ASCII (as UTF-8), 2 flips the case
+// of ASCII letters, 4 adds spaces around separators and '='.
+inline std::wstring WriteFuzzDn(const std::vector<std::pair<std::wstring, std::wstring>>& rdns, unsigned style,
+                                uint64_t& h) {
+    auto next = [&]() {
+        h ^= h << 13; h ^= h >> 7; h ^= h << 17;
+        return h;
+    };
+    auto flip = [&](wchar_t c) {
+        if ((style & 2) && next() % 2 && ((c >= L'a' && c <= L'z') || (c >= L'A' && c <= L'Z'))) return static_cast<wchar_t>(c ^ 32);
+        return c;
+    };
+    auto hex = [](std::wstring& out, unsigned char b) {
+        static const wchar_t kDigits[] = L"0123456789ABCDEF";
+        out += L'\\';
+        out += kDigits[b >> 4];
+        out += kDigits[b & 15];
+    };
+    std::wstring text;
+    for (size_t i = 0; i < rdns.size(); i++) {
+        if (i) text += (style & 4) && next() % 2 ? L", " : L",";
+        for (wchar_t c : rdns[i].first) text += flip(c);
+        text += (style & 4) && next() % 2 ? L" = " : L"=";
+        const std::wstring& value = rdns[i].second;
+        for (size_t k = 0; k < value.size(); k++) {
+            const wchar_t c = value[k];
+            const bool special = c == L',' || c == L'+' || c == L'"' || c == L'\\' || c == L'<' || c == L'>' ||
+                                 c == L';' || (k == 0 && (c == L'#' || c == L' ')) || (k + 1 == value.size() && c == L' ');
+            if ((style & 1) && (special || c >= 0x80 || next() % 8 == 0)) {
+                std::string utf8;
+                AppendUtf8(utf8, &value[k], 1);
+                for (char b : utf8) hex(text, static_cast<unsigned char>(b));
+            } else if (special) {
+                text += L'\\';
+                text += c;
+            } else {
+                text += flip(c);
+            }
+        }
+    }
+    return text;
+}
+
+// The string handling discovery used before DnTable: lowered copies as map
+// keys, parents cut from the text (escapes honoured, nothing else)
+inline std::wstring LegacyParentDn(const std::wstring& dn) {
+    for (size_t i = 0; i < dn.size(); i++) {
+        if (dn[i] == L'\\') {
+            i++;
+        } else if (dn[i] == L',') {
+            size_t start = i + 1;
+            while (start < dn.size() && dn[start] == L' ') start++;
+            return dn.substr(start);
+        }
+    }
+    return std::wstring();
+}
+
+// Fuzz: random DNs (multi-valued RDNs, specials, non-ASCII, spaces at the
+// ends of values) written canonically, hex-escaped, re-cased and spaced
+// must parse to the same values, intern to one id, format back to an equal
+// DN and agree with ParentDnText, FirstRdnValue and the table's ancestry;
+// corrupted ones must fail cleanly or format back to themselves. Then one
+// discovery-shaped pass over a forest of dcs DCs (site, server, NTDS
+// Settings, connection and fromServer DNs, each resolved to its server or
+// site) through string-keyed maps, then through DnTable; both must agree.
+inline DnBenchmarkResult RunDnBenchmark(unsigned dcs, uint64_t seed) {
+    using Clock = std::chrono::steady_clock;
+    auto millis = [](Clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(d).count() / 1000.0;
+    };
+    DnBenchmarkResult result;
+    result.dcs = dcs;
+    uint64_t h = seed * 0x9E3779B97F4A7C15ull + 3;
+    auto next = [&]() {
+        h ^= h << 13; h ^= h >> 7; h ^= h << 17;
+        return h;
+    };
+
+    static const wchar_t* const kTypes[] = {L"CN", L"OU", L"DC", L"O", L"UID", L"2.5.4.3"};
+    static const wchar_t kAlphabet[] = {L'a', L'Z', L'0', L' ', L',', L'+', L'"', L'\\', L'<', L'>', L';', L'=',
+                                        L'#', L'-', L'.', L'/', 0xE9, 0x20AC, 0x4E2D};
+    DnTable table;
+    for (unsigned round = 0; round < 2000; round++) {
+        std::vector<std::pair<std::wstring, std::wstring>> rdns(1 + next() % 6);
+        for (auto& rdn : rdns) {
+            rdn.first = kTypes[next() % 6];
+            const size_t length = next() % 12;
+            for (size_t k = 0; k < length; k++) rdn.second += kAlphabet[next() % (sizeof(kAlphabet) / sizeof(kAlphabet[0]))];
+        }
+        result.fuzzCases++;
+        const std::wstring canonical = WriteFuzzDn(rdns, 0, h);
+        const DnId id = table.Intern(canonical);
+        bool ok = id != kInvalidDn && table.Depth(id) == rdns.size();
+        DnId at = id;
+        for (size_t i = 0; ok && i < rdns.size(); i++, at = table.Parent(at)) {
+            const Rdn& rdn = table.Leaf(at);
+            ok = rdn.count == 1 && rdn.Type() == rdns[i].first && rdn.Value() == rdns[i].second;
+        }
+        for (unsigned style = 1; ok && style < 8; style++) ok = table.Intern(WriteFuzzDn(rdns, style, h)) == id;
+        ok = ok && table.Intern(table.Name(id)) == id;
+        ok = ok && FirstRdnValue(canonical) == rdns[0].second;
+        ok = ok && (rdns.size() == 1 ? ParentDnText(canonical).empty() : table.Intern(ParentDnText(canonical)) == table.Parent(id));
+        // Every ancestor contains the DN; a changed leaf is a sibling, not a child
+        for (DnId up = table.Parent(id); ok && up != kInvalidDn; up = table.Parent(up)) ok = table.IsWithin(id, up) && !table.IsWithin(up, id);
+        if (ok && rdns.size() > 1) {
+            std::vector<std::pair<std::wstring, std::wstring>> sibling = rdns;
+            sibling[0].second += L'x';
+            const DnId other = table.Intern(WriteFuzzDn(sibling, 0, h));
+            ok = other != id && table.Parent(other) == table.Parent(id) && !table.IsWithin(other, id);
+        }
+        // A multi-valued RDN matches in either order
+        if (ok) {
+            std::vector<std::pair<std::wstring, std::wstring>> pair(rdns.begin() + (rdns.size() > 1 ? 1 : 0), rdns.end());
+            const std::wstring a = WriteFuzzDn({{L"CN", L"a"}}, 0, h) + L"+" + WriteFuzzDn({{L"UID", L"b"}}, 0, h) + L"," + WriteFuzzDn(pair, 0, h);
+            const std::wstring b = WriteFuzzDn({{L"uid", L"B"}}, 0, h) + L"+" + WriteFuzzDn({{L"cn", L"A"}}, 0, h) + L"," + WriteFuzzDn(pair, 0, h);
+            ok = table.Intern(a) != kInvalidDn && table.Intern(a) == table.Intern(b);
+        }
+        if (!ok) result.mismatches++;
+
+        // Corrupted: inserted, deleted or replaced characters, specials favoured
+        std::wstring text = canonical;
+        for (unsigned m = 1 + next() % 3; m > 0; m--) {
+            const size_t at = text.empty() ? 0 : next() % text.size();
+            static const wchar_t kNoise[] = {L'\\', L',', L'=', L'+', L'"', L'#', L' ', L';', L'A', L'2'};
+            const wchar_t c = kNoise[next() % (sizeof(kNoise) / sizeof(kNoise[0]))];
+            switch (next() % 3) {
+                case 0: text.insert(text.begin() + static_cast<std::ptrdiff_t>(at), c); break;
+                case 1: if (!text.empty()) text.erase(at, 1); break;
+                default: if (!text.empty()) text[at] = c; break;
+            }
+        }
+        result.mutated++;
+        const DnId bad = table.Intern(text);
+        if (bad != kInvalidDn) {
+            result.mutatedParsed++;
+            if (table.Intern(table.Name(bad)) != bad) result.mismatches++;
+        }
+    }
+    result.mismatches += DomainDnFromDns(L"corp.example.com.") == L"DC=corp,DC=example,DC=com" ? 0 : 1;
+    result.mismatches += AdsPath(L"dc1", L"CN=a/b\\,c,DC=x") == L"LDAP://dc1/CN=a\\/b\\,c,DC=x" ? 0 : 1;
+    result.mismatches += ChildDn(L"CN", L" Site #1, annexe ", L"CN=Sites") == L"CN=\\ Site #1\\, annexe\\ ,CN=Sites" ? 0 : 1;
+
+    // The forest: what discovery reads, in directory order
+    const std::wstring sitesDn = L"CN=Sites,CN=Configuration,DC=corp,DC=example,DC=com";
+    std::vector<std::wstring> siteDns, serverDns, ntdsDns, connectionDns, fromServers;
+    for (unsigned site = 0; site * 10 < dcs; site++) {
+        siteDns.push_back(ChildDn(L"CN", site % 7 == 3 ? L"Site " + std::to_wstring(site) + L", annexe" : L"Site" + std::to_wstring(site), sitesDn));
+    }
+    for (unsigned dc = 0; dc < dcs; dc++) {
+        serverDns.push_back(ChildDn(L"CN", L"DC" + std::to_wstring(dc), ChildDn(L"CN", L"Servers", siteDns[dc / 10])));
+        ntdsDns.push_back(ChildDn(L"CN", L"NTDS Settings", serverDns.back()));
+    }
+    for (unsigned dc = 0; dc < dcs; dc++) {
+        for (unsigned k = 1; k <= 2 && k < dcs; k++) {
+            const unsigned from = (dc + k) % dcs;
+            connectionDns.push_back(ChildDn(L"CN", L"{" + std::to_wstring(next()) + L"}", ntdsDns[dc]));
+            // fromServer as AD may write it: other case, a space after each comma
+            std::wstring ref = ntdsDns[from];
+            for (size_t i = 0; i < ref.size(); i++) {
+                if (ref[i] == L',' && (i == 0 || ref[i - 1] != L'\\')) ref.insert(++i, 1, L' ');
+            }
+            fromServers.push_back(DnKey(ref));
+        }
+    }
+    result.dns = siteDns.size() + serverDns.size() + ntdsDns.size() + connectionDns.size();
+    result.lookups = serverDns.size() + ntdsDns.size() + 2 * connectionDns.size();
+
+    // Both answer, per connection, (destination server, source server) and,
+    // per server, its site; the answers are summed and compared with the
+    // forest as generated. Text keys miss the spaced fromServer values.
+    uint64_t expectedSum = 0, internedSum = 0;
+    for (unsigned dc = 0; dc < dcs; dc++) {
+        expectedSum += dc / 10;
+        for (unsigned k = 1; k <= 2 && k < dcs; k++) expectedSum += dc * 31ull + (dc + k) % dcs;
+    }
+    const uint64_t allocationsBefore = AllocationCounter().load(std::memory_order_relaxed);
+    Clock::time_point t0 = Clock::now();
+    {
+        std::unordered_map<std::wstring, uint32_t> siteByDn, serverByDn, serverByDsa;
+        for (uint32_t i = 0; i < siteDns.size(); i++) siteByDn[DnKey(siteDns[i])] = i;
+        for (uint32_t i = 0; i < serverDns.size(); i++) {
+            auto site = siteByDn.find(DnKey(LegacyParentDn(LegacyParentDn(serverDns[i]))));
+            if (site == siteByDn.end()) result.legacyMissed++;
+            serverByDn[DnKey(serverDns[i])] = i;
+        }
+        for (const auto& dn : ntdsDns) {
+            auto server = serverByDn.find(DnKey(LegacyParentDn(dn)));
+            if (server != serverByDn.end()) serverByDsa[DnKey(dn)] = server->second;
+            else result.legacyMissed++;
+        }
+        for (size_t i = 0; i < connectionDns.size(); i++) {
+            auto to = serverByDsa.find(DnKey(LegacyParentDn(connectionDns[i])));
+            auto from = serverByDsa.find(DnKey(fromServers[i]));
+            result.legacyMissed += (to == serverByDsa.end()) + (from == serverByDsa.end());
+        }
+    }
+    result.legacyMs = millis(Clock::now() - t0);
+    const uint64_t allocationsBetween = AllocationCounter().load(std::memory_order_relaxed);
+    result.legacyAllocations = allocationsBetween - allocationsBefore;
+
+    t0 = Clock::now();
+    {
+        DnTable dns;
+        const uint32_t kNone = 0xFFFFFFFFu;
+        std::vector<uint32_t> siteByDn, serverByDn, serverByDsa;
+        auto set = [&](std::vector<uint32_t>& index, DnId dn, uint32_t value) {
+            if (dn == kInvalidDn) return;
+            if (dn >= index.size()) index.resize(std::max<size_t>(dn + 1, index.size() * 2), kNone);
+            index[dn] = value;
+        };
+        auto get = [&](const std::vector<uint32_t>& index, DnId dn) { return dn < index.size() ? index[dn] : kNone; };
+        for (uint32_t i = 0; i < siteDns.size(); i++) set(siteByDn, dns.Intern(siteDns[i]), i);
+        for (uint32_t i = 0; i < serverDns.size(); i++) {
+            const DnId dn = dns.Intern(serverDns[i]);
+            const uint32_t site = get(siteByDn, dns.Parent(dns.Parent(dn)));
+            if (site != kNone) internedSum += site;
+            set(serverByDn, dn, i);
+        }
+        for (const auto& text : ntdsDns) {
+            const DnId dn = dns.Intern(text);
+            const uint32_t server = get(serverByDn, dns.Parent(dn));
+            if (server != kNone) set(serverByDsa, dn, server);
+        }
+        for (size_t i = 0; i < connectionDns.size(); i++) {
+            const uint32_t to = get(serverByDsa, dns.Parent(dns.Intern(connectionDns[i])));
+            const uint32_t from = get(serverByDsa, dns.Intern(fromServers[i]));
+            if (to != kNone && from != kNone) internedSum += to * 31ull + from;
+        }
+        result.arenaBytes = dns.ArenaBytes();
+    }
+    result.internedMs = millis(Clock::now() - t0);
+    result.internedAllocations = AllocationCounter().load(std::memory_order_relaxed) - allocationsBetween;
+    if (expectedSum != internedSum) result.mismatches++;
+    return result;
+}
+
+inline std::string FormatDnBenchmarkJson(const DnBenchmarkResult& r) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    auto real = [](double v) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.2f", v);
+        return std::string(text);
+    };
+    return "{\"dcs\":" + num(r.dcs) + ",\"dns\":" + num(r.dns) + ",\"lookups\":" + num(r.lookups) +
+           ",\"fuzzCases\":" + num(r.fuzzCases) + ",\"mutated\":" + num(r.mutated) +
+           ",\"mutatedParsed\":" + num(r.mutatedParsed) + ",\"mismatches\":" + num(r.mismatches) +
+           ",\"legacyMissed\":" + num(r.legacyMissed) +
+           ",\"legacyMs\":" + real(r.legacyMs) + ",\"internedMs\":" + real(r.internedMs) +
+           ",\"legacyAllocations\":" + num(r.legacyAllocations) + ",\"internedAllocations\":" + num(r.internedAllocations) +
+           ",\"arenaBytes\":" + num(r.arenaBytes) + "}\n";
+}
+
+inline std::string FormatCanaryBenchmarkJson(const CanaryBenchmarkResult& r) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    auto real = [](double v) {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.3f", v);
+        return std::string(buf);
+    };
+    return "{\"dcs\":" + num(r.dcs) + ",\"sites\":" + num(r.sites) + ",\"probes\":" + num(r.probes) +
+           ",\"pairs\":" + num(r.pairs) + ",\"converged\":" + num(r.converged) +
+           ",\"notConverged\":" + num(r.notConverged) + ",\"unreachable\":" + num(r.unreachable) +
+           ",\"writeFailed\":" + num(r.writeFailed) + ",\"outOfBounds\":" + num(r.outOfBounds) +
+           ",\"mismatches\":" + num(r.mismatches) + ",\"sitePairs\":" + num(r.sitePairs) +
+           ",\"reads\":" + num(r.reads) + ",\"readsPerPair\":" + real(r.readsPerPair) +
+           ",\"boundShare\":" + real(r.boundShare) + ",\"maxDelayMs\":" + num(static_cast<uint64_t>(r.maxDelayMs)) +
+           ",\"wallMs\":" + real(r.wallMs) + "}\n";
+}
+
+struct ProbeBenchmarkResult {
+    unsigned dcs = 0;                   // DCs of the per-site cap run
+    unsigned sites = 0;
+    double timeoutMs = 0;               // dcTimeout of the hung DC run
+    double hungElapsedMs = 0;           // what the engine reported for the hung DC
+    double hungWallMs = 0;              // the whole run, which must not wait for the hang
+    double deadlineMs = 0;              // scanDeadline of the slow forest run
+    double deadlineWallMs = 0;
+    size_t deadlineOk = 0;
+    size_t deadlineTimedOut = 0;        // in flight at the deadline, or given its remainder as timeout
+    size_t deadlineCancelled = 0;       // never started
+    unsigned siteLimit = 0;
+    unsigned maxSiteInFlight = 0;       // reads seen at once in one site by the backend
+    unsigned maxInFlight = 0;           // ... and overall
+    unsigned hungSiteInFlight = 0;      // reads seen at once in a site whose DCs hang past their timeout
+    double capWallMs = 0;
+    size_t mismatches = 0;              // outcomes or limits the options do not allow
+};
+
+// Counts the reads in flight per site around the simulated backend: what
+// the per-site cap of ProbeEngine must bound
+class ConcurrencyCountingBackend : public IDirectoryBackend {
+public:
+    ConcurrencyCountingBackend(std::shared_ptr<IDirectoryBackend> inner, const std::vector<ProbeTarget>& targets)
+        : m_inner(std::move(inner)) {
+        uint32_t sites = 0;
+        for (const ProbeTarget& t : targets) {
+            m_siteOf[t.dc] = t.site;
+            sites = std::max(sites, t.site + 1);
+        }
+        m_siteInFlight.assign(sites, 0);
+    }
+
+    RootDseReply ReadRootDse(const std::wstring& dcName, std::chrono::milliseconds timeout) override {
+        const uint32_t site = m_siteOf.at(dcName);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_maxSite = std::max(m_maxSite, ++m_siteInFlight[site]);
+            m_max = std::max(m_max, ++m_inFlight);
+        }
+        RootDseReply reply = m_inner->ReadRootDse(dcName, timeout);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_siteInFlight[site]--;
+        m_inFlight--;
+        return reply;
+    }
+
+    unsigned MaxSiteInFlight() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_maxSite;
+    }
+
+    unsigned MaxInFlight() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_max;
+    }
+
+private:
+    std::shared_ptr<IDirectoryBackend> m_inner;
+    std::unordered_map<std::wstring, uint32_t> m_siteOf;
+    mutable std::mutex m_mutex;
+    std::vector<unsigned> m_siteInFlight;
+    unsigned m_inFlight = 0;
+    unsigned m_maxSite = 0;
+    unsigned m_max = 0;
+};
+
+// The three limits of ProbeEngine against the simulated backend, unpooled:
+// a hung DC among fast ones must come back Timeout after dcTimeout without
+// holding the run; a forest slower than the scan deadline must end at the
+// deadline with reads in flight Timeout and the rest Cancelled; dcs DCs
+// over sites of fifty, read with many more workers than sites times the
+// per-site cap, must never have more than the cap in flight in a site, nor
+// may a site whose hung reads were timed out and replaced.
+inline ProbeBenchmarkResult RunProbeBenchmark(unsigned dcs, uint64_t seed) {
+    using Clock = std::chrono::steady_clock;
+    auto millis = [](Clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(d).count() / 1000.0;
+    };
+    auto forest = [&](unsigned count, std::chrono::milliseconds latency, unsigned perSite, std::vector<ProbeTarget>& targets) {
+        auto backend = std::make_shared<SimulatedDirectoryBackend>(seed);
+        targets.clear();
+        for (unsigned i = 0; i < count; i++) {
+            SimulatedDc dc;
+            dc.name = L"DC" + std::to_wstring(i);
+            dc.latency = latency;
+            backend->AddDc(dc);
+            targets.push_back(ProbeTarget{dc.name, i / perSite});
+        }
+        return backend;
+    };
+    ProbeBenchmarkResult result;
+    std::vector<ProbeTarget> targets;
+
+    // One hung DC among fast ones
+    {
+        auto backend = forest(12, std::chrono::milliseconds(5), 12, targets);
+        SimulatedDc hung;
+        hung.name = L"DC-hung";
+        hung.hang = true;
+        backend->AddDc(hung);
+        targets.push_back(ProbeTarget{hung.name, 0});
+        ProbeOptions options;
+        options.workers = 4;
+        options.dcTimeout = std::chrono::milliseconds(100);
+        options.scanDeadline = std::chrono::milliseconds(10000);
+        result.timeoutMs = static_cast<double>(options.dcTimeout.count());
+        const Clock::time_point t0 = Clock::now();
+        std::vector<ProbeOutcome> outcomes = ProbeEngine(backend, options).Run(targets);
+        result.hungWallMs = millis(Clock::now() - t0);
+        const ProbeOutcome& h = outcomes.back();
+        result.hungElapsedMs = static_cast<double>(h.elapsed.count());
+        if (h.reply.status != ProbeStatus::Timeout || result.hungElapsedMs < result.timeoutMs ||
+            result.hungElapsedMs > result.timeoutMs + 150) {
+            result.mismatches++;
+        }
+        // The hang lasts 4 timeouts: the run must be over long before
+        if (result.hungWallMs > 3 * result.timeoutMs) result.mismatches++;
+        for (size_t i = 0; i + 1 < outcomes.size(); i++) result.mismatches += outcomes[i].reply.status == ProbeStatus::Ok ? 0 : 1;
+    }
+
+    // A forest slower than the deadline: 2 workers, 24 DCs of 40 ms
+    {
+        auto backend = forest(24, std::chrono::milliseconds(40), 24, targets);
+        ProbeOptions options;
+        options.workers = 2;
+        options.dcTimeout = std::chrono::milliseconds(1000);
+        options.scanDeadline = std::chrono::milliseconds(200);
+        result.deadlineMs = static_cast<double>(options.scanDeadline.count());
+        const Clock::time_point t0 = Clock::now();
+        std::vector<ProbeOutcome> outcomes = ProbeEngine(backend, options).Run(targets);
+        result.deadlineWallMs = millis(Clock::now() - t0);
+        for (const ProbeOutcome& o : outcomes) {
+            switch (o.reply.status) {
+                case ProbeStatus::Ok: result.deadlineOk++; break;
+                case ProbeStatus::Timeout: result.deadlineTimedOut++; break;
+                case ProbeStatus::Cancelled: result.deadlineCancelled++; break;
+                default: result.mismatches++; break;
+            }
+        }
+        if (result.deadlineWallMs < result.deadlineMs || result.deadlineWallMs > result.deadlineMs + 150) result.mismatches++;
+        // Reads started near the deadline get what is left of it as their
+        // timeout, so more than one per worker may end Timeout; no more
+        // reads can succeed than the workers had time for
+        const size_t possible = options.workers * static_cast<size_t>(options.scanDeadline / std::chrono::milliseconds(40));
+        if (result.deadlineOk == 0 || result.deadlineOk > possible || result.deadlineTimedOut == 0 ||
+            result.deadlineCancelled == 0) {
+            result.mismatches++;
+        }
+    }
+
+    // The per-site cap: 32 workers, sites of 50 DCs, at most 3 per site
+    {
+        auto simulated = forest(dcs, std::chrono::milliseconds(5), 50, targets);
+        auto counting = std::make_shared<ConcurrencyCountingBackend>(simulated, targets);
+        ProbeOptions options;
+        options.workers = 32;
+        options.perSiteLimit = 3;
+        result.dcs = dcs;
+        result.sites = (dcs + 49) / 50;
+        result.siteLimit = options.perSiteLimit;
+        const Clock::time_point t0 = Clock::now();
+        std::vector<ProbeOutcome> outcomes = ProbeEngine(counting, options).Run(targets);
+        result.capWallMs = millis(Clock::now() - t0);
+        result.maxSiteInFlight = counting->MaxSiteInFlight();
+        result.maxInFlight = counting->MaxInFlight();
+        for (const ProbeOutcome& o : outcomes) result.mismatches += o.reply.status == ProbeStatus::Ok ? 0 : 1;
+        if (result.maxSiteInFlight > options.perSiteLimit || result.maxInFlight > options.workers) result.mismatches++;
+        // A site must reach the cap and several be read at once, or the cap proves nothing
+        if (result.maxSiteInFlight < options.perSiteLimit ||
+            (result.sites > 1 && result.maxInFlight <= options.perSiteLimit)) {
+            result.mismatches++;
+        }
+    }
+
+    // The cap with hung reads: two DCs that hang for 4 timeouts fill a site
+    // capped at 2; the fast DCs behind them wait until the hangs return
+    {
+        auto simulated = forest(6, std::chrono::milliseconds(5), 6, targets);
+        for (int i = 1; i >= 0; i--) {
+            SimulatedDc hung;
+            hung.name = L"DC-hung" + std::to_wstring(i);
+            hung.hang = true;
+            simulated->AddDc(hung);
+            targets.insert(targets.begin(), ProbeTarget{hung.name, 0});
+        }
+        auto counting = std::make_shared<ConcurrencyCountingBackend>(simulated, targets);
+        ProbeOptions options;
+        options.workers = 8;
+        options.perSiteLimit = 2;
+        options.dcTimeout = std::chrono::milliseconds(50);
+        options.scanDeadline = std::chrono::milliseconds(10000);
+        std::vector<ProbeOutcome> outcomes = ProbeEngine(counting, options).Run(targets);
+        result.hungSiteInFlight = counting->MaxSiteInFlight();
+        for (size_t i = 0; i < outcomes.size(); i++) {
+            const ProbeStatus expected = i < 2 ? ProbeStatus::Timeout : ProbeStatus::Ok;
+            result.mismatches += outcomes[i].reply.status == expected ? 0 : 1;
+        }
+        if (result.hungSiteInFlight > options.perSiteLimit) result.mismatches++;
+    }
+    return result;
+}
+
+inline std::string FormatProbeBenchmarkJson(const ProbeBenchmarkResult& r) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    auto real = [](double v) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.2f", v);
+        return std::string(text);
+    };
+    return "{\"dcs\":" + num(r.dcs) + ",\"sites\":" + num(r.sites) + ",\"timeoutMs\":" + real(r.timeoutMs) +
+           ",\"hungElapsedMs\":" + real(r.hungElapsedMs) + ",\"hungWallMs\":" + real(r.hungWallMs) +
+           ",\"deadlineMs\":" + real(r.deadlineMs) + ",\"deadlineWallMs\":" + real(r.deadlineWallMs) +
+           ",\"deadlineOk\":" + num(r.deadlineOk) + ",\"deadlineTimedOut\":" + num(r.deadlineTimedOut) +
+           ",\"deadlineCancelled\":" + num(r.deadlineCancelled) + ",\"siteLimit\":" + num(r.siteLimit) +
+           ",\"maxSiteInFlight\":" + num(r.maxSiteInFlight) + ",\"maxInFlight\":" + num(r.maxInFlight) +
+           ",\"hungSiteInFlight\":" + num(r.hungSiteInFlight) + ",\"capWallMs\":" + real(r.capWallMs) +
+           ",\"mismatches\":" + num(r.mismatches) + "}\n";
+}
+
+struct DiscoveryBenchmarkResult {
+    size_t entries = 0;                 // objects loaded from the LDIF file
+    size_t sites = 0;
+    size_t servers = 0;
+    size_t dcs = 0;
+    size_t connections = 0;
+    size_t disabled = 0;                // connections with enabledConnection FALSE
+    size_t siteLinks = 0;
+    size_t filters = 0;                 // searches checked against their expected count
+    size_t mismatches = 0;              // counts, names, attributes or filter results not as the fixture has them
+    double loadMs = 0;
+    double discoverMs = 0;
+};
+
+// fixtures/topology.ldif (or what --ldif names) loaded by the LDIF backend
+// and discovered: every count, the escaped and base64 site names, binary
+// and multi-valued attributes, connections from a DN written in another
+// case and spacing, then searches that exercise each filter form.
+inline DiscoveryBenchmarkResult RunDiscoveryBenchmark(const std::wstring& path) {
+    using Clock = std::chrono::steady_clock;
+    auto millis = [](Clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(d).count() / 1000.0;
+    };
+    DiscoveryBenchmarkResult result;
+    LdifDirectoryBackend backend;
+    Clock::time_point t0 = Clock::now();
+    if (!backend.LoadFile(path)) {
+        result.mismatches++;
+        return result;
+    }
+    result.loadMs = millis(Clock::now() - t0);
+    result.entries = backend.EntryCount();
+    auto expect = [&](bool ok) { result.mismatches += ok ? 0 : 1; };
+
+    const RootDseReply locator = backend.ReadRootDse(std::wstring(), std::chrono::milliseconds(1000));
+    expect(locator.configurationNamingContext == L"CN=Configuration,DC=corp,DC=example,DC=com");
+    ForestTopology topology;
+    t0 = Clock::now();
+    expect(DiscoverTopology(backend, locator.configurationNamingContext, topology));
+    result.discoverMs = millis(Clock::now() - t0);
+
+    result.sites = topology.sites.size();
+    result.servers = topology.servers.size();
+    result.connections = topology.connections.size();
+    result.siteLinks = topology.siteLinks.size();
+    for (const ServerInfo& s : topology.servers) result.dcs += s.IsDc() ? 1 : 0;
+    for (const ConnectionInfo& c : topology.connections) result.disabled += c.enabled ? 0 : 1;
+    expect(result.sites == 4 && result.servers == 6 && result.dcs == 5 && result.connections == 6 &&
+           result.disabled == 1 && result.siteLinks == 2);
+
+    // Sites sorted by name; servers by site, then name
+    static const wchar_t* const kSites[] = {L"Genève", L"Lyon", L"Paris", L"Site, annexe"};
+    for (size_t i = 0; i < 4 && i < topology.sites.size(); i++) expect(topology.sites[i].name == kSites[i]);
+    auto server = [&](const wchar_t* name) -> const ServerInfo* {
+        for (const ServerInfo& s : topology.servers) {
+            if (s.name == name) return &s;
+        }
+        return nullptr;
+    };
+    auto siteOf = [&](const wchar_t* name) {
+        const ServerInfo* s = server(name);
+        return s && s->site < topology.sites.size() ? topology.sites[s->site].name : std::wstring();
+    };
+    expect(siteOf(L"DC4") == L"Site, annexe" && siteOf(L"DC5") == L"Genève" && siteOf(L"FS1") == L"Paris");
+    const ServerInfo* dc1 = server(L"DC1");
+    const ServerInfo* dc2 = server(L"DC2");
+    const ServerInfo* fs1 = server(L"FS1");
+    expect(dc1 && dc1->invocationId == L"101112131415161718191a1b1c1d1e1f" && dc1->masterNCs.size() == 3 &&
+           dc1->HostName() == L"dc1.corp.example.com");
+    expect(dc2 && dc2->masterNCs.size() == 1);             // hasMasterNCs when msDS-hasMasterNCs is missing
+    expect(fs1 && !fs1->IsDc() && fs1->HostName() == L"FS1");
+
+    // The DC5 <- DC4 connection is only found if fromServer's DN matches
+    // the NTDS Settings DN despite case, spaces and the escaped comma
+    auto connection = [&](const wchar_t* from, const wchar_t* to) -> const ConnectionInfo* {
+        for (const ConnectionInfo& c : topology.connections) {
+            if (topology.servers[c.fromServer].name == from && topology.servers[c.toServer].name == to) return &c;
+        }
+        return nullptr;
+    };
+    const ConnectionInfo* dc2ToDc1 = connection(L"DC2", L"DC1");
+    const ConnectionInfo* dc3ToDc4 = connection(L"DC3", L"DC4");
+    expect(dc2ToDc1 && dc2ToDc1->options == 1 && dc2ToDc1->enabled);
+    expect(dc3ToDc4 && !dc3ToDc4->enabled);
+    expect(connection(L"DC4", L"DC5") != nullptr);
+    for (const SiteLinkInfo& link : topology.siteLinks) {
+        if (link.name == L"Lyon-Regions") expect(link.sites.size() == 3 && link.cost == 200 && link.replIntervalMin == 60);
+        if (link.name == L"Paris-Lyon") expect(link.sites.size() == 2 && link.cost == 100 && link.replIntervalMin == 180);
+    }
+
+    // rootDSE reads by host name or server name, USN as recorded
+    const RootDseReply byHost = backend.ReadRootDse(L"DC1.corp.example.com", std::chrono::milliseconds(1000));
+    const RootDseReply byName = backend.ReadRootDse(L"dc2", std::chrono::milliseconds(1000));
+    expect(byHost.status == ProbeStatus::Ok && byHost.highestCommittedUSN == 120500);
+    expect(byName.status == ProbeStatus::Ok && byName.highestCommittedUSN == 118000);
+    expect(backend.ReadRootDse(L"dc9.corp.example.com", std::chrono::milliseconds(1000)).status != ProbeStatus::Ok);
+
+    // Each filter form, with the number of objects it must return (-1: rejected)
+    const std::wstring sitesDn = ChildDn(L"CN", L"Sites", locator.configurationNamingContext);
+    const struct {
+        std::wstring base;
+        const wchar_t* filter;
+        int expected;
+    } searches[] = {
+        {sitesDn, L"(&(objectClass=server)(!(dNSHostName=*)))", 1},
+        {sitesDn, L"(name=DC*)", 5},
+        {sitesDn, L"(|(objectClass=site)(objectClass=siteLink))", 7},
+        {sitesDn, L"(&(objectClass=nTDSConnection)(enabledConnection=false))", 1},
+        {L"CN=NTDS Settings,CN=DC3,CN=Servers,CN=Lyon," + sitesDn, L"(objectClass=nTDSConnection)", 2},
+        {L"cn=site\\, ANNEXE, " + DnKey(sitesDn), L"(objectClass=*)", 4},
+        {L"CN=Nowhere," + sitesDn, L"(objectClass=*)", 0},
+        {sitesDn, L"(&(objectClass=site)", -1},
+        {sitesDn, L"(!(objectClass=site)(name=x))", -1},
+        {L"CN=a,,DC=b", L"(objectClass=*)", -1},
+    };
+    for (const auto& s : searches) {
+        SearchRequest request;
+        request.baseDn = s.base;
+        request.filter = s.filter;
+        int found = 0;
+        const bool ok = backend.SearchSubtree(request, [&](const DirectoryEntry&) { found++; });
+        result.filters++;
+        expect(s.expected < 0 ? !ok : ok && found == s.expected);
+    }
+    return result;
+}
+
+inline std::string FormatDiscoveryBenchmarkJson(const DiscoveryBenchmarkResult& r) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    auto real = [](double v) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.3f", v);
+        return std::string(text);
+    };
+    return "{\"entries\":" + num(r.entries) + ",\"sites\":" + num(r.sites) + ",\"servers\":" + num(r.servers) +
+           ",\"dcs\":" + num(r.dcs) + ",\"connections\":" + num(r.connections) + ",\"disabled\":" + num(r.disabled) +
+           ",\"siteLinks\":" + num(r.siteLinks) + ",\"filters\":" + num(r.filters) +
+           ",\"mismatches\":" + num(r.mismatches) + ",\"loadMs\":" + real(r.loadMs) +
+           ",\"discoverMs\":" + real(r.discoverMs) + "}\n";
+}
+
+struct EventBookmarkBenchmarkResult {
+    size_t collections = 0;             // CollectOne calls across the three stages
+    uint64_t events = 0;                // records delivered to the collector
+    size_t restarts = 0;                // collections that found the channel cleared
+    size_t mismatches = 0;              // counts, bookmarks or parsed fields not as the fixtures have them
+    double collectMs = 0;
+};
+
+// Serves <root>/<stage>/<dc>.xml, so one collector can see a channel grow
+// and then get cleared between two collections
+class StagedEventSource : public IEventSource {
+public:
+    explicit StagedEventSource(std::wstring root) : m_root(std::move(root)) {}
+
+    void SetStage(unsigned stage) { m_stage = stage; }
+    uint64_t Delivered() const { return m_delivered; }
+
+    bool Query(const EventQuery& query, const std::function<void(const EventRecord&)>& onRecord,
+               EventQueryStatus& status) override {
+        XmlEventSource source((std::filesystem::path(m_root) / std::to_wstring(m_stage)).wstring());
+        return source.Query(query, [&](const EventRecord& rec) {
+            m_delivered++;
+            onRecord(rec);
+        }, status);
+    }
+
+private:
+    std::wstring m_root;
+    unsigned m_stage = 1;
+    uint64_t m_delivered = 0;
+};
+
+// fixtures/events (or what --events names) replayed through one collector:
+// stage 1 has an event outside the lookback, one with an unconfigured ID,
+// one from another channel and records out of order; stage 2 appends two
+// records; stage 3 is the channel after a clear, record IDs restarting at 1.
+// DC2 exports no event and DC3 has no file at all.
+inline EventBookmarkBenchmarkResult RunEventBookmarkBenchmark(const std::wstring& root) {
+    using Clock = std::chrono::steady_clock;
+    EventBookmarkBenchmarkResult result;
+    auto expect = [&](bool ok) {
+        if (!ok) result.mismatches++;
+    };
+
+    auto source = std::make_shared<StagedEventSource>(root);
+    EventCollectorOptions options;
+    options.workers = 1;
+    EventCollector collector(source, options);
+    const std::vector<uint32_t>& ids = options.eventIds;
+
+    // Counts per event ID, in the order of options.eventIds
+    auto counts = [&](std::initializer_list<std::pair<uint32_t, uint64_t>> expected) {
+        std::vector<uint64_t> v(ids.size(), 0);
+        for (const auto& e : expected) {
+            for (size_t k = 0; k < ids.size(); k++) {
+                if (ids[k] == e.first) v[k] = e.second;
+            }
+        }
+        return v;
+    };
+    auto collect = [&](const std::wstring& dc) {
+        result.collections++;
+        return collector.CollectOne(dc);
+    };
+
+    // The parser alone: every record of the channel, oldest first, whatever the file order
+    {
+        XmlEventSource xml((std::filesystem::path(root) / L"1").wstring());
+        EventQuery query;
+        query.dc = L"DC1";
+        query.channel = options.channel;
+        query.eventIds = {1394, 1925, 2042, 2087};
+        std::vector<uint64_t> records;
+        int64_t time104 = 0;
+        EventQueryStatus status;
+        expect(xml.Query(query, [&](const EventRecord& rec) {
+            records.push_back(rec.recordId);
+            if (rec.recordId == 104) time104 = rec.timeCreated;
+        }, status));
+        expect(records == std::vector<uint64_t>{101, 102, 103, 104, 106});
+        expect(time104 == 1714561200123);
+        expect(status.newestRecordId == 106);
+    }
+
+    Clock::time_point t0 = Clock::now();
+    source->SetStage(1);
+    DcEventCounts dc1 = collect(L"DC1");
+    expect(dc1.ok && dc1.error == 0);
+    expect(dc1.fresh == counts({{1925, 1}, {2087, 1}, {2042, 1}}));
+    expect(dc1.totals == dc1.fresh);
+    std::vector<std::pair<std::string, uint32_t>> errors;
+    for (const ReplicationErrorEntry& e : dc1.errors.Entries()) {
+        expect(dc1.errors.Name(e.dest) == "dc1" && e.count == 1);
+        errors.emplace_back(dc1.errors.Name(e.source), e.error);
+    }
+    std::sort(errors.begin(), errors.end());
+    expect(errors == std::vector<std::pair<std::string, uint32_t>>{
+        {"cn=ntds settings,cn=dc2,cn=servers,cn=paris,cn=sites,cn=configuration,dc=corp,dc=example,dc=com", 1722},
+        {"cn=ntds settings,cn=dc4,cn=servers,cn=lyon,cn=sites,cn=configuration,dc=corp,dc=example,dc=com", 0},
+        {"dc3.corp.example.com", 8532}});
+
+    DcEventCounts dc2 = collect(L"DC2");
+    expect(dc2.ok && dc2.Total() == 0 && dc2.errors.Empty());
+    DcEventCounts dc3 = collect(L"DC3");
+    expect(!dc3.ok && dc3.error == 2);
+
+    source->SetStage(2);
+    dc1 = collect(L"DC1");
+    expect(dc1.ok && dc1.fresh == counts({{1925, 1}, {1388, 1}}));
+    expect(dc1.totals == counts({{1925, 2}, {2087, 1}, {2042, 1}, {1388, 1}}));
+    expect(dc1.errors.Events() == 2);
+
+    // Cleared channel: the newest record is now below the bookmark
+    source->SetStage(3);
+    dc1 = collect(L"DC1");
+    result.restarts += dc1.fresh == counts({{2042, 1}, {1925, 1}}) ? 1 : 0;
+    expect(dc1.ok && result.restarts == 1);
+    expect(dc1.totals == counts({{1925, 3}, {2087, 1}, {2042, 2}, {1388, 1}}));
+    dc1 = collect(L"DC1");
+    expect(dc1.ok && dc1.Total() == 7 && dc1.fresh == counts({}));
+
+    // Bookmarks survive a restart of the collector
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "adrc_bookmarks.txt";
+    expect(collector.SaveBookmarks(path.wstring()));
+    EventCollector reloaded(source, options);
+    expect(reloaded.LoadBookmarks(path.wstring()));
+    result.collections++;
+    dc1 = reloaded.CollectOne(L"DC1");
+    expect(dc1.ok && dc1.fresh == counts({}) && dc1.totals == counts({{1925, 3}, {2087, 1}, {2042, 2}, {1388, 1}}));
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+
+    result.collectMs = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t0).count() / 1000.0;
+    result.events = source->Delivered();
+    return result;
+}
+
+inline std::string FormatEventBookmarkBenchmarkJson(const EventBookmarkBenchmarkResult& r) {
+    char ms[32];
+    std::snprintf(ms, sizeof(ms), "%.3f", r.collectMs);
+    return "{\"collections\":" + std::to_string(r.collections) + ",\"events\":" + std::to_string(r.events) +
+           ",\"restarts\":" + std::to_string(r.restarts) + ",\"mismatches\":" + std::to_string(r.mismatches) +
+           ",\"collectMs\":" + ms + "}\n";
+}
+
+struct ModelBenchmarkResult {
+    unsigned dcs = 0;
+    size_t sites = 0;
+    double buildMs = 0;                 // best pass: intern, AddDc and fill every row
+    double classifyMs = 0;              // best pass of ClassifyLag
+    double trackMs = 0;                 // LagTracker fed every row once
+    size_t classes[5] = {};             // rows per LagClass after ClassifyLag
+    size_t mismatches = 0;              // ids, names, counts, classes or spread not as expected
+};
+
+// Lag class of a row from the thresholds' definitions, without the model's
+// helpers; spread as ComputeUsnSpread gives it
+inline LagClass ReferenceLag(const DcRecord& r, const UsnSpread& spread) {
+    const LatencyThresholds latency;
+    const UsnThresholds usn;
+    if (r.latencySec != kUnknownLatency) {
+        if (r.latencySec > latency.moderateSec) return LagClass::Severe;
+        if (r.latencySec > latency.minorSec) return LagClass::Moderate;
+        if (r.latencySec > latency.inSyncSec || r.failingPartners > 0) return LagClass::Minor;
+        return LagClass::InSync;
+    }
+    if (r.status != ProbeStatus::Ok || spread.count < 2) return LagClass::Unknown;
+    const uint64_t diff = spread.maxUsn - r.usn;
+    if (diff >= usn.moderate) return LagClass::Severe;
+    if (diff >= usn.minor) return LagClass::Moderate;
+    return diff ? LagClass::Minor : LagClass::InSync;
+}
+
+// Threshold edges with their expected class, then a one-USN model whose
+// lag cannot be measured
+inline size_t CheckLagEdges() {
+    struct Row {
+        uint64_t usn;
+        uint32_t latencySec;
+        uint16_t failing;
+        ProbeStatus status;
+        LagClass expected;
+    };
+    const Row rows[] = {
+        {20000, kUnknownLatency, 0, ProbeStatus::Ok, LagClass::InSync},
+        {19001, kUnknownLatency, 0, ProbeStatus::Ok, LagClass::Minor},
+        {19000, kUnknownLatency, 0, ProbeStatus::Ok, LagClass::Moderate},
+        {10001, kUnknownLatency, 0, ProbeStatus::Ok, LagClass::Moderate},
+        {10000, kUnknownLatency, 0, ProbeStatus::Ok, LagClass::Severe},
+        {0, kUnknownLatency, 0, ProbeStatus::Unreachable, LagClass::Unknown},
+        {500, 900, 0, ProbeStatus::Ok, LagClass::InSync},
+        {500, 900, 1, ProbeStatus::Ok, LagClass::Minor},
+        {500, 901, 0, ProbeStatus::Ok, LagClass::Minor},
+        {500, 10800, 0, ProbeStatus::Ok, LagClass::Minor},
+        {500, 10801, 0, ProbeStatus::Ok, LagClass::Moderate},
+        {500, 86400, 0, ProbeStatus::Ok, LagClass::Moderate},
+        {500, 86401, 0, ProbeStatus::Ok, LagClass::Severe},
+        {20000, kUnknownLatency, 0, ProbeStatus::Ok, LagClass::InSync},
+    };
+    size_t bad = 0;
+    ReplicationModel model;
+    for (size_t i = 0; i < sizeof(rows) / sizeof(rows[0]); i++) {
+        const DcId id = model.AddDc(L"Paris", L"DC" + std::to_wstring(i));
+        DcRecord& r = model.records[id];
+        r.usn = rows[i].usn;
+        r.latencySec = rows[i].latencySec;
+        r.failingPartners = rows[i].failing;
+        r.status = rows[i].status;
+    }
+    const UsnSpread spread = ClassifyLag(model);
+    for (size_t i = 0; i < model.Size(); i++) bad += model.records[i].lag != rows[i].expected;
+    // Rows with a latency still count in the spread; ties keep the lowest id
+    if (spread.count != 13 || spread.maxUsn != 20000 || spread.maxDc != 0 || spread.minUsn != 500 || spread.minDc != 6) bad++;
+
+    ReplicationModel single;
+    const DcId only = single.AddDc(L"Paris", L"DC1");
+    single.records[only].status = ProbeStatus::Ok;
+    single.records[only].usn = 42;
+    if (ClassifyLag(single).count != 1 || single.records[only].lag != LagClass::Unknown) bad++;
+    return bad;
+}
+
+// dcs rows (10 per site, every name interned twice) built passes times,
+// then classified: by ClassifyLag, by the reference above, and by a
+// LagTracker fed the rows in a shuffled order.
+inline ModelBenchmarkResult RunModelBenchmark(unsigned dcs, uint64_t seed, unsigned passes = 5) {
+    using Clock = std::chrono::steady_clock;
+    auto millis = [](Clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count() / 1e6;
+    };
+    ModelBenchmarkResult result;
+    result.dcs = dcs;
+    result.mismatches = CheckLagEdges();
+    const std::vector<uint32_t> eventIds = EventCollectorOptions().eventIds;
+
+    std::vector<std::wstring> siteNames(std::max(1u, (dcs + 9) / 10));
+    for (size_t s = 0; s < siteNames.size(); s++) siteNames[s] = L"Site" + std::to_wstring(s);
+    std::vector<std::wstring> dcNames(dcs);
+    for (unsigned i = 0; i < dcs; i++) dcNames[i] = L"DC" + std::to_wstring(i) + L".corp.example.com";
+
+    uint64_t h = seed * 0x9E3779B97F4A7C15ull + 13;
+    auto next = [&]() {
+        h ^= h << 13; h ^= h >> 7; h ^= h << 17;
+        return h;
+    };
+    std::vector<DcRecord> rows(dcs);
+    for (DcRecord& r : rows) {
+        const uint64_t roll = next() % 100;
+        r.status = roll < 5 ? ProbeStatus::Unreachable : roll < 7 ? ProbeStatus::Timeout : ProbeStatus::Ok;
+        if (r.status == ProbeStatus::Ok) {
+            r.usn = 5000000 + next() % 20000;
+            if (next() % 2) r.latencySec = static_cast<uint32_t>(next() % (2 * 86400));
+            r.failingPartners = next() % 10 == 0 ? 1 : 0;
+        }
+    }
+
+    ReplicationModel model;
+    result.buildMs = 1e300;
+    for (unsigned pass = 0; pass < passes; pass++) {
+        Clock::time_point t0 = Clock::now();
+        model = ReplicationModel();
+        model.SetEventIds(eventIds);
+        model.Reserve(dcs);
+        for (unsigned i = 0; i < dcs; i++) {
+            const DcId id = model.AddDc(siteNames[i / 10], dcNames[i]);
+            const SiteId site = model.records[id].site;
+            model.records[id] = rows[i];
+            model.records[id].site = site;
+            uint32_t* counts = model.EventCountsOf(id);
+            for (size_t k = 0; k < eventIds.size(); k++) counts[k] = i + static_cast<uint32_t>(k);
+        }
+        result.buildMs = std::min(result.buildMs, millis(Clock::now() - t0));
+    }
+
+    // Interning again finds the same ids and adds no row
+    for (unsigned i = 0; i < dcs; i++) {
+        if (model.AddDc(siteNames[i / 10], dcNames[i]) != i) result.mismatches++;
+    }
+    result.sites = model.sites.Size();
+    if (model.Size() != dcs || model.dcs.Size() != dcs || result.sites != siteNames.size() ||
+        model.eventCounts.size() != static_cast<size_t>(dcs) * eventIds.size() ||
+        model.dcs.Find(L"DC-absent") != kInvalidId) {
+        result.mismatches++;
+    }
+    for (unsigned i = 0; i < dcs; i++) {
+        if (model.dcs.Find(dcNames[i]) != i || model.DcName(i) != dcNames[i] || model.SiteName(i) != siteNames[i / 10]) {
+            result.mismatches++;
+        }
+        const uint32_t* counts = model.EventCountsOf(i);
+        for (size_t k = 0; k < eventIds.size(); k++) result.mismatches += counts[k] != i + k;
+    }
+
+    UsnSpread spread;
+    result.classifyMs = 1e300;
+    for (unsigned pass = 0; pass < passes; pass++) {
+        for (DcRecord& r : model.records) r.lag = LagClass::Unknown;
+        Clock::time_point t0 = Clock::now();
+        spread = ClassifyLag(model);
+        result.classifyMs = std::min(result.classifyMs, millis(Clock::now() - t0));
+    }
+
+    UsnSpread expected;
+    for (DcId id = 0; id < dcs; id++) {
+        const DcRecord& r = model.records[id];
+        if (r.status != ProbeStatus::Ok) continue;
+        if (expected.count == 0 || r.usn > expected.maxUsn) expected.maxUsn = r.usn, expected.maxDc = id;
+        if (expected.count == 0 || r.usn < expected.minUsn) expected.minUsn = r.usn, expected.minDc = id;
+        expected.count++;
+    }
+    if (spread.count != expected.count || spread.minUsn != expected.minUsn || spread.maxUsn != expected.maxUsn ||
+        spread.minDc != expected.minDc || spread.maxDc != expected.maxDc) {
+        result.mismatches++;
+    }
+    for (const DcRecord& r : model.records) {
+        if (r.lag != ReferenceLag(r, expected)) result.mismatches++;
+        result.classes[static_cast<size_t>(r.lag)]++;
+    }
+
+    ReplicationModel tracked = model;
+    for (DcRecord& r : tracked.records) r.lag = LagClass::Unknown;
+    std::vector<DcId> order(dcs);
+    for (DcId id = 0; id < dcs; id++) order[id] = id;
+    for (size_t i = order.size(); i > 1; i--) std::swap(order[i - 1], order[next() % i]);
+    LagTracker tracker;
+    std::vector<DcId> reclassified;
+    Clock::time_point t0 = Clock::now();
+    for (DcId id : order) tracker.Update(tracked, id, reclassified);
+    result.trackMs = millis(Clock::now() - t0);
+    if (tracker.Spread().count != spread.count || tracker.Spread().maxDc != spread.maxDc ||
+        tracker.Spread().minUsn != spread.minUsn) {
+        result.mismatches++;
+    }
+    for (DcId id = 0; id < dcs; id++) result.mismatches += tracked.records[id].lag != model.records[id].lag;
+    return result;
+}
+
+inline std::string FormatModelBenchmarkJson(const ModelBenchmarkResult& r) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    auto real = [](double v) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.3f", v);
+        return std::string(text);
+    };
+    static const char* const kNames[5] = {"unknown", "inSync", "minor", "moderate", "severe"};
+    std::string s = "{\"dcs\":" + num(r.dcs) + ",\"sites\":" + num(r.sites) + ",\"buildMs\":" + real(r.buildMs) +
+                    ",\"classifyMs\":" + real(r.classifyMs) + ",\"trackMs\":" + real(r.trackMs);
+    for (size_t k = 0; k < 5; k++) s += ",\"" + std::string(kNames[k]) + "\":" + num(r.classes[k]);
+    return s + ",\"mismatches\":" + num(r.mismatches) + "}\n";
+}
+
+struct PublisherBenchmarkResult {
+    unsigned readers = 0;
+    size_t hazardSlots = 0;             // fewer than readers: the others read under the writer lock
+    uint64_t publishes = 0;
+    uint64_t reads = 0;                 // Current() calls that returned a snapshot
+    double readsPerMs = 0;
+    uint64_t regressions = 0;           // a reader saw a generation older than one it had already seen
+    uint64_t invalid = 0;               // a snapshot freed, or its fields overwritten, while a reader held it
+    uint64_t leaked = 0;                // snapshots not freed once the publisher was destroyed
+    size_t mismatches = 0;
+};
+
+// readers threads call Current() for duration while one thread publishes
+// new generations as fast as it can (at most maxPublishes). Each snapshot
+// carries a pattern derived from its generation and is freed through a
+// deleter that records and poisons it, so a reader holding a freed or
+// recycled snapshot sees it. Readers keep the last few snapshots alive to
+// overlap with the writer's reclamation.
+inline PublisherBenchmarkResult RunPublisherBenchmark(unsigned readers,
+                                                      size_t hazardSlots = SnapshotPublisher::kHazardSlots,
+                                                      std::chrono::milliseconds duration = std::chrono::milliseconds(500),
+                                                      uint64_t maxPublishes = 1u << 20) {
+    using Clock = std::chrono::steady_clock;
+    PublisherBenchmarkResult result;
+    result.readers = readers;
+    result.hazardSlots = hazardSlots;
+
+    // 0 never published, 1 published, 2 freed
+    std::unique_ptr<std::atomic<uint8_t>[]> state(new std::atomic<uint8_t>[maxPublishes + 1]);
+    for (uint64_t g = 0; g <= maxPublishes; g++) state[g].store(0, std::memory_order_relaxed);
+    std::atomic<uint64_t> freed{0};
+    auto make = [&](uint64_t generation) {
+        ScanSnapshot* s = new ScanSnapshot;
+        s->generation = generation;
+        s->startedAt = static_cast<int64_t>(generation * 3);
+        s->completedAt = static_cast<int64_t>(generation * 3 + 1);
+        s->siteCount = static_cast<size_t>(generation ^ 0x5A5A5A5Au);
+        state[generation].store(1, std::memory_order_release);
+        return SnapshotPtr(s, [&](ScanSnapshot* p) {
+            state[p->generation].store(2, std::memory_order_release);
+            p->completedAt = -1;
+            p->siteCount = 0;
+            delete p;
+            freed.fetch_add(1, std::memory_order_relaxed);
+        });
+    };
+    auto intact = [&](const ScanSnapshot& s) {
+        return s.generation <= maxPublishes && state[s.generation].load(std::memory_order_acquire) == 1 &&
+               s.startedAt == static_cast<int64_t>(s.generation * 3) &&
+               s.completedAt == static_cast<int64_t>(s.generation * 3 + 1) &&
+               s.siteCount == static_cast<size_t>(s.generation ^ 0x5A5A5A5Au);
+    };
+
+    std::atomic<uint64_t> reads{0}, regressions{0}, invalid{0};
+    uint64_t lastPublished = 0;
+    Clock::duration readTime{};
+    {
+        SnapshotPublisher publisher(hazardSlots);
+        std::atomic<bool> stop{false};
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < readers; t++) {
+            threads.emplace_back([&] {
+                SnapshotPtr held[4];
+                uint64_t seen = 0, n = 0, bad = 0, back = 0;
+                while (!stop.load(std::memory_order_relaxed)) {
+                    SnapshotPtr s = publisher.Current();
+                    if (!s) continue;
+                    n++;
+                    if (s->generation < seen) back++;
+                    seen = std::max(seen, s->generation);
+                    if (!intact(*s)) bad++;
+                    held[n % 4] = std::move(s);
+                    for (const SnapshotPtr& h : held) {
+                        if (h && !intact(*h)) bad++;
+                    }
+                }
+                reads += n;
+                regressions += back;
+                invalid += bad;
+            });
+        }
+
+        const Clock::time_point start = Clock::now();
+        while (Clock::now() - start < duration && lastPublished < maxPublishes) {
+            publisher.Publish(make(++lastPublished));
+        }
+        stop = true;
+        for (auto& t : threads) t.join();
+        readTime = Clock::now() - start;
+
+        SnapshotPtr last = publisher.Current();
+        if (!last || last->generation != lastPublished) result.mismatches++;
+    }
+
+    result.publishes = lastPublished;
+    result.reads = reads;
+    result.readsPerMs = result.reads / std::max(1e-3, std::chrono::duration<double, std::milli>(readTime).count());
+    result.regressions = regressions;
+    result.invalid = invalid;
+    result.leaked = lastPublished - freed.load();
+    if (readers > 0 && result.reads == 0) result.mismatches++;
+    result.mismatches += result.regressions + result.invalid + result.leaked;
+    return result;
+}
+
+inline std::string FormatPublisherBenchmarkJson(const PublisherBenchmarkResult& r) {
+    char perMs[32];
+    std::snprintf(perMs, sizeof(perMs), "%.1f", r.readsPerMs);
+    return "{\"readers\":" + std::to_string(r.readers) + ",\"hazardSlots\":" + std::to_string(r.hazardSlots) +
+           ",\"publishes\":" + std::to_string(r.publishes) +
+           ",\"reads\":" + std::to_string(r.reads) + ",\"readsPerMs\":" + perMs +
+           ",\"regressions\":" + std::to_string(r.regressions) + ",\"invalid\":" + std::to_string(r.invalid) +
+           ",\"leaked\":" + std::to_string(r.leaked) + ",\"mismatches\":" + std::to_string(r.mismatches) + "}\n";
+}
+
+struct LatencyMatrixBenchmarkResult {
+    unsigned dcs = 0;
+    unsigned sites = 0;
+    size_t ncs = 0;
+    size_t cells = 0;                   // neighbor and cursor cells in the matrix
+    double generateMs = 0;
+    double collectMs = 0;               // CollectReplicaStates over every DC, simulated reads included
+    double buildMs = 0;                 // BuildDestinationRow alone, from states read beforehand
+    double summarizeMs = 0;             // Summarize for every DC
+    double lookupNs = 0;                // per LatencyMs lookup, random (dest, source, NC)
+    size_t lookupHits = 0;              // lookups for a pair the destination tracks
+    double copyUs = 0;                  // copying the whole matrix, as a snapshot does
+    size_t mismatches = 0;              // cells, summaries or shared rows not as the raw states have them
+};
+
+// A generated forest (10 DCs per site, 100 per domain, no RTT) discovered,
+// then every DC's replica state read once and turned into matrix rows.
+// Each cell is checked against the state it came from, each summary
+// against one recomputed by brute force, and a copy of the matrix must
+// keep its rows when the original swaps one.
+inline LatencyMatrixBenchmarkResult RunLatencyMatrixBenchmark(unsigned dcs, uint64_t seed) {
+    using Clock = std::chrono::steady_clock;
+    auto millis = [](Clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count() / 1e6;
+    };
+    LatencyMatrixBenchmarkResult result;
+    result.dcs = dcs;
+
+    ForestSpec spec;
+    spec.seed = seed;
+    spec.dcs = dcs;
+    spec.sites = std::max(1u, dcs / 10);
+    spec.localRtt = spec.remoteRtt = std::chrono::milliseconds(0);
+    spec.linkFailureRate = 0.05;
+    result.sites = spec.sites;
+    Clock::time_point t0 = Clock::now();
+    ForestSimulator forest(spec);
+    result.generateMs = millis(Clock::now() - t0);
+
+    ForestTopology topology;
+    if (!DiscoverTopology(*forest.Backend(), forest.ConfigurationDn(), topology)) {
+        result.mismatches++;
+        return result;
+    }
+    std::vector<const ServerInfo*> servers;
+    DsaIndex dsas;
+    std::unordered_map<std::wstring, DcId> byDsa;
+    LatencyMatrix matrix;
+    for (const ServerInfo& server : topology.servers) {
+        if (!server.IsDc()) continue;
+        const DcId id = static_cast<DcId>(servers.size());
+        servers.push_back(&server);
+        dsas.Add(id, server);
+        byDsa[server.ntdsDsaDn] = id;
+        for (const auto& nc : server.masterNCs) matrix.InternNc(nc);
+    }
+    if (servers.size() != dcs) result.mismatches++;
+    result.ncs = matrix.NcCount();
+    matrix.Resize(servers.size());
+
+    std::vector<ReplicaTarget> targets;
+    for (DcId id = 0; id < servers.size(); id++) targets.push_back({id, servers[id]->HostName(), servers[id]->masterNCs});
+    LatencyMatrix collected = matrix;
+    size_t rows = 0;
+    t0 = Clock::now();
+    CollectReplicaStates(*forest.Backend(), targets, dsas, collected, 8, [&](DcId, bool ok) { rows += ok; });
+    result.collectMs = millis(Clock::now() - t0);
+    if (rows != servers.size()) result.mismatches++;
+
+    std::vector<ReplicaState> states(servers.size());
+    for (DcId id = 0; id < servers.size(); id++) {
+        if (!forest.Backend()->ReadReplicaState(targets[id].host, targets[id].namingContexts, states[id])) result.mismatches++;
+    }
+    const int64_t observedAt = UnixNowMs();
+    t0 = Clock::now();
+    for (DcId id = 0; id < servers.size(); id++) matrix.Update(id, BuildDestinationRow(states[id], dsas, matrix, observedAt));
+    result.buildMs = millis(Clock::now() - t0);
+    result.cells = matrix.CellCount();
+    if (result.cells != collected.CellCount()) result.mismatches++;
+
+    // Every raw entry is in its cell; summaries recomputed from the raw state
+    size_t rawCells = 0;
+    int64_t worstSum = 0;
+    for (DcId dest = 0; dest < servers.size(); dest++) {
+        const ReplicaState& state = states[dest];
+        rawCells += state.neighbors.size() + state.cursors.size();
+        std::set<DcId> partners, failing;
+        int64_t lastSuccess = 0;
+        for (const auto& n : state.neighbors) {
+            const DcId source = byDsa.at(n.sourceDsaDn);
+            const NeighborCell* cell = matrix.FindNeighbor(dest, source, matrix.FindNc(n.namingContext));
+            if (!cell || cell->lastSuccess != n.lastSuccess || cell->lastAttempt != n.lastAttempt ||
+                cell->usnSynced != n.usnLastObjChangeSynced || cell->lastResult != n.lastResult ||
+                cell->consecutiveFailures != n.consecutiveFailures) {
+                result.mismatches++;
+            }
+            partners.insert(source);
+            if (n.consecutiveFailures) failing.insert(source);
+            lastSuccess = std::max(lastSuccess, n.lastSuccess);
+        }
+        int64_t worst = -1;
+        for (const auto& c : state.cursors) {
+            const DcId source = byDsa.at(c.sourceDsaDn);
+            const NcId nc = matrix.FindNc(c.namingContext);
+            const CursorCell* cell = matrix.FindCursor(dest, source, nc);
+            if (!cell || cell->usn != c.usnHighPropUpdate || cell->lastSyncSuccess != c.lastSyncSuccess ||
+                matrix.LatencyMs(dest, source, nc) != std::max<int64_t>(0, observedAt - c.lastSyncSuccess)) {
+                result.mismatches++;
+            }
+            if (source != dest) worst = std::max(worst, std::max<int64_t>(0, observedAt - c.lastSyncSuccess));
+        }
+        worstSum += worst;
+        const ReplicationSummary summary = matrix.Summarize(dest);
+        if (summary.partners != partners.size() || summary.failingPartners != failing.size() ||
+            summary.lastSuccess != lastSuccess || summary.worstLatencyMs != worst ||
+            (worst >= 0 && matrix.LatencyMs(dest, summary.worstSource, summary.worstNc) != worst)) {
+            result.mismatches++;
+        }
+        if (matrix.Row(dest)->unresolved != 0) result.mismatches++;
+    }
+    if (rawCells != result.cells) result.mismatches++;
+
+    // The forest gives each DC one NC and a fresh cursor for itself: a
+    // hand-made row covers two NCs out of order, an old self cursor (not a
+    // latency), a cursor known only by invocationId and two unresolvable ones
+    if (servers.size() >= 8 && result.ncs >= 2) {
+        const std::wstring& ncA = matrix.NcName(0);
+        const std::wstring& ncB = matrix.NcName(1);
+        ReplicaState state;
+        auto neighbor = [&](DcId source, const std::wstring& nc, uint32_t failures) {
+            ReplicaNeighbor n;
+            n.namingContext = nc;
+            n.sourceDsaDn = servers[source]->ntdsDsaDn;
+            n.lastSuccess = observedAt - 60000 * (source + 1);
+            n.consecutiveFailures = failures;
+            state.neighbors.push_back(n);
+        };
+        auto cursor = [&](const std::wstring& dsa, const std::wstring& invocation, const std::wstring& nc, int64_t ageMs) {
+            UpToDatenessCursor c;
+            c.namingContext = nc;
+            c.sourceDsaDn = dsa;
+            c.invocationId = invocation;
+            c.lastSyncSuccess = observedAt - ageMs;
+            state.cursors.push_back(c);
+        };
+        neighbor(5, ncB, 0);
+        neighbor(3, ncA, 2);
+        neighbor(3, ncB, 0);
+        cursor(servers[2]->ntdsDsaDn, L"", ncA, 36000000);
+        cursor(servers[5]->ntdsDsaDn, L"", ncB, 3600000);
+        cursor(servers[3]->ntdsDsaDn, L"", ncB, 7200000);
+        cursor(L"", servers[7]->invocationId, ncA, 600000);
+        cursor(servers[5]->ntdsDsaDn, L"", ncA, 1800000);
+        cursor(L"CN=NTDS Settings,CN=Gone,CN=Servers,CN=Nowhere,CN=Sites," + forest.ConfigurationDn(), L"", ncA, 1);
+        cursor(servers[5]->ntdsDsaDn, L"", L"DC=absent,DC=example,DC=com", 1);
+        LatencyMatrix hand = matrix;
+        hand.Update(2, BuildDestinationRow(state, dsas, hand, observedAt));
+        const ReplicationSummary summary = hand.Summarize(2);
+        const NcId a = 0, b = 1;
+        if (hand.Row(2)->unresolved != 2 || hand.Row(2)->cursors.size() != 5 || summary.partners != 2 ||
+            summary.failingPartners != 1 || summary.lastSuccess != observedAt - 4 * 60000 ||
+            summary.worstLatencyMs != 7200000 || summary.worstSource != 3 || summary.worstNc != b ||
+            hand.LatencyMs(2, 7, a) != 600000 || hand.LatencyMs(2, 5, a) != 1800000 ||
+            hand.LatencyMs(2, 5, b) != 3600000 || hand.LatencyMs(2, 3, a) != -1 ||
+            !hand.FindNeighbor(2, 3, a) || hand.FindNeighbor(2, 3, a)->consecutiveFailures != 2 ||
+            !hand.FindNeighbor(2, 5, b) || hand.FindNeighbor(2, 5, a)) {
+            result.mismatches++;
+        }
+    }
+
+    t0 = Clock::now();
+    int64_t summarized = 0;
+    for (DcId dest = 0; dest < servers.size(); dest++) summarized += matrix.Summarize(dest).worstLatencyMs;
+    result.summarizeMs = millis(Clock::now() - t0);
+    if (summarized != worstSum) result.mismatches++;
+
+    // Random lookups, about one in two for a pair the destination tracks
+    uint64_t h = seed * 0x9E3779B97F4A7C15ull + 17;
+    auto next = [&]() {
+        h ^= h << 13; h ^= h >> 7; h ^= h << 17;
+        return h;
+    };
+    const size_t lookups = 1000000;
+    t0 = Clock::now();
+    for (size_t i = 0; i < lookups; i++) {
+        const DcId dest = static_cast<DcId>(next() % servers.size());
+        const std::vector<CursorCell>& cursors = matrix.Row(dest)->cursors;
+        const bool tracked = !cursors.empty() && next() % 2;
+        const DcId source = tracked ? cursors[next() % cursors.size()].source : static_cast<DcId>(next() % servers.size());
+        const NcId nc = tracked ? cursors.front().nc : static_cast<NcId>(next() % std::max<size_t>(1, result.ncs));
+        result.lookupHits += matrix.LatencyMs(dest, source, nc) >= 0;
+    }
+    result.lookupNs = millis(Clock::now() - t0) * 1e6 / lookups;
+    if (matrix.FindCursor(0, kInvalidId, 0) || matrix.LatencyMs(static_cast<DcId>(servers.size()), 0, 0) != -1) result.mismatches++;
+
+    // A copy shares every row; swapping one in the original leaves the copy as it was
+    t0 = Clock::now();
+    LatencyMatrix copy = matrix;
+    result.copyUs = millis(Clock::now() - t0) * 1000;
+    const DestinationRow* before = copy.Row(0);
+    matrix.Update(0, std::make_shared<DestinationRow>());
+    if (copy.Row(0) != before || matrix.Row(0) == before || copy.CellCount() != result.cells) result.mismatches++;
+    for (DcId id = 1; id < servers.size(); id++) {
+        if (copy.Row(id) != matrix.Row(id)) result.mismatches++;
+    }
+    return result;
+}
+
+inline std::string FormatLatencyMatrixBenchmarkJson(const LatencyMatrixBenchmarkResult& r) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    auto real = [](double v) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.3f", v);
+        return std::string(text);
+    };
+    return "{\"dcs\":" + num(r.dcs) + ",\"sites\":" + num(r.sites) + ",\"ncs\":" + num(r.ncs) +
+           ",\"cells\":" + num(r.cells) + ",\"generateMs\":" + real(r.generateMs) + ",\"collectMs\":" + real(r.collectMs) +
+           ",\"buildMs\":" + real(r.buildMs) + ",\"summarizeMs\":" + real(r.summarizeMs) +
+           ",\"lookupNs\":" + real(r.lookupNs) + ",\"lookupHits\":" + num(r.lookupHits) + ",\"copyUs\":" + real(r.copyUs) +
+           ",\"mismatches\":" + num(r.mismatches) + "}\n";
+}
+
+struct TimeSeriesBenchmarkResult {
+    unsigned dcs = 0;
+    unsigned days = 0;
+    uint64_t records = 0;
+    uint64_t bytes = 0;                 // segment files on disk after the last append
+    size_t segments = 0;
+    double ingestMs = 0;
+    double recordsPerSec = 0;
+    double reopenMs = 0;                // Close then Open: maps every segment and rebuilds its index
+    size_t queries = 0;
+    double dayQueryUs = 0;              // mean, one series over one day
+    double monthQueryUs = 0;            // mean, one series over the whole history
+    size_t mismatches = 0;              // rejected appends, or query results that differ from a scan of the samples
+};
+
+// days of samples for dcs series, one every 5 minutes (the scan interval),
+// appended in time order to a store under the temporary directory. USNs
+// mostly grow, with the odd restore (a regression) and jump past 32 bits,
+// both of which force keyframes. Random range queries, including ranges
+// outside the history, across segment boundaries and reduced to one
+// sample, are compared with a linear scan of the samples kept in memory,
+// before and after the store is reopened from its files.
+inline TimeSeriesBenchmarkResult RunTimeSeriesBenchmark(unsigned dcs, uint64_t seed, unsigned days = 30) {
+    using Clock = std::chrono::steady_clock;
+    auto millis = [](Clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count() / 1e6;
+    };
+    TimeSeriesBenchmarkResult result;
+    result.dcs = dcs;
+    result.days = days;
+    if (dcs == 0) return result;
+
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / ("adts_bench_" + std::to_string(dcs));
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+
+    uint64_t h = seed * 0x9E3779B97F4A7C15ull + 19;
+    auto next = [&]() {
+        h ^= h << 13; h ^= h >> 7; h ^= h << 17;
+        return h;
+    };
+
+    const int64_t start = 1714521600000;    // 2024-05-01T00:00:00Z
+    const int64_t step = 300000;
+    const int64_t steps = static_cast<int64_t>(days) * 86400000 / step;
+    std::vector<std::vector<TimeSample>> samples(dcs);
+    std::vector<uint64_t> usn(dcs);
+    for (unsigned i = 0; i < dcs; i++) {
+        usn[i] = 1000000 + static_cast<uint64_t>(i) * 1000;
+        samples[i].reserve(static_cast<size_t>(steps));
+    }
+
+    {
+        TimeSeriesStore store;
+        if (!store.Open(dir.wstring())) {
+            result.mismatches++;
+            return result;
+        }
+        std::vector<uint32_t> series(dcs);
+        for (unsigned i = 0; i < dcs; i++) series[i] = store.SeriesId(L"dc:DC" + std::to_wstring(i));
+
+        Clock::time_point t0 = Clock::now();
+        for (int64_t s = 0; s < steps; s++) {
+            for (unsigned i = 0; i < dcs; i++) {
+                const uint64_t roll = next();
+                if (roll % 5000 == 0) usn[i] -= std::min<uint64_t>(usn[i], 10000);
+                else if (roll % 20000 == 1) usn[i] += 1ull << 33;
+                else usn[i] += roll % 500;
+                TimeSample sample;
+                sample.time = start + s * step + static_cast<int64_t>(i) * step / dcs;
+                sample.usn = usn[i];
+                sample.lagSec = static_cast<uint32_t>((roll >> 20) % 7200);
+                sample.errors = (roll >> 40) % 1000 == 0 ? 40000 : static_cast<uint16_t>((roll >> 40) % 3);
+                if (!store.Append(series[i], sample)) result.mismatches++;
+                sample.errors = std::min<uint16_t>(sample.errors, SampleRecord::kKeyframe - 1);
+                samples[i].push_back(sample);
+            }
+        }
+        store.Flush();
+        result.ingestMs = millis(Clock::now() - t0);
+        result.records = store.RecordCount();
+        result.segments = store.SegmentCount();
+        TimeSample late;
+        late.time = start;
+        if (store.Append(series[0], late)) result.mismatches++;   // out of time order
+    }
+    result.recordsPerSec = result.records / std::max(1e-9, result.ingestMs / 1000);
+    if (result.records != static_cast<uint64_t>(steps) * dcs) result.mismatches++;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        if (entry.path().extension() == ".tss") result.bytes += entry.file_size(ec);
+    }
+
+    const int64_t end = start + steps * step;
+    auto check = [&](const TimeSeriesStore& store, size_t count) {
+        double dayUs = 0, monthUs = 0;
+        size_t dayCount = 0, monthCount = 0;
+        std::vector<TimeSample> got;
+        for (size_t q = 0; q < count; q++) {
+            const unsigned i = static_cast<unsigned>(next() % dcs);
+            const uint64_t kind = next() % 10;
+            int64_t from, to;
+            if (kind == 0) {
+                from = start - 86400000;
+                to = end + 86400000;
+            } else if (kind == 1) {
+                from = to = samples[i][next() % samples[i].size()].time;
+            } else if (kind == 2) {
+                from = start + static_cast<int64_t>(next() % (static_cast<uint64_t>(days) + 1)) * 86400000 - 3600000;
+                to = from + 2 * 3600000;
+            } else {
+                from = start - 86400000 + static_cast<int64_t>(next() % static_cast<uint64_t>(end - start + 2 * 86400000));
+                to = from + static_cast<int64_t>(next() % (kind == 3 ? 3 * 86400000ull : 86400000ull));
+            }
+            got.clear();
+            Clock::time_point t0 = Clock::now();
+            store.Query(store.FindSeries(L"dc:DC" + std::to_wstring(i)), from, to, got);
+            const double us = millis(Clock::now() - t0) * 1000;
+            if (kind == 0) monthUs += us, monthCount++;
+            if (kind >= 4) dayUs += us, dayCount++;
+
+            const auto& all = samples[i];
+            auto first = std::lower_bound(all.begin(), all.end(), from,
+                                          [](const TimeSample& s, int64_t t) { return s.time < t; });
+            size_t k = 0;
+            bool same = true;
+            for (auto it = first; it != all.end() && it->time <= to; ++it, k++) {
+                if (k >= got.size() || got[k].time != it->time || got[k].usn != it->usn || got[k].lagSec != it->lagSec ||
+                    got[k].errors != it->errors) {
+                    same = false;
+                    break;
+                }
+            }
+            if (!same || k != got.size()) result.mismatches++;
+            result.queries++;
+        }
+        result.dayQueryUs = dayCount ? dayUs / dayCount : 0;
+        result.monthQueryUs = monthCount ? monthUs / monthCount : 0;
+    };
+
+    TimeSeriesStore store;
+    Clock::time_point t0 = Clock::now();
+    if (!store.Open(dir.wstring())) result.mismatches++;
+    result.reopenMs = millis(Clock::now() - t0);
+    if (store.RecordCount() != result.records || store.SeriesCount() != dcs) result.mismatches++;
+    check(store, 2000);
+
+    // Appends after a reopen continue the chains of the last segment
+    TimeSample more;
+    more.time = end - 1;
+    more.usn = samples[0].back().usn + 7;
+    if (!store.Append(store.FindSeries(L"dc:DC0"), more)) result.mismatches++;
+    samples[0].push_back(more);
+    std::vector<TimeSample> tail;
+    store.Query(store.FindSeries(L"dc:DC0"), end - 3600000, end, tail);
+    if (tail.size() != 13 || tail.back().usn != more.usn || tail[11].usn != samples[0][samples[0].size() - 2].usn) {
+        result.mismatches++;
+    }
+    store.Close();
+    std::filesystem::remove_all(dir, ec);
+    return result;
+}
+
+inline std::string FormatTimeSeriesBenchmarkJson(const TimeSeriesBenchmarkResult& r) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    auto real = [](double v) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.3f", v);
+        return std::string(text);
+    };
+    return "{\"dcs\":" + num(r.dcs) + ",\"days\":" + num(r.days) + ",\"records\":" + num(r.records) +
+           ",\"bytes\":" + num(r.bytes) + ",\"segments\":" + num(r.segments) + ",\"ingestMs\":" + real(r.ingestMs) +
+           ",\"recordsPerSec\":" + real(r.recordsPerSec) + ",\"reopenMs\":" + real(r.reopenMs) +
+           ",\"queries\":" + num(r.queries) + ",\"dayQueryUs\":" + real(r.dayQueryUs) +
+           ",\"monthQueryUs\":" + real(r.monthQueryUs) + ",\"mismatches\":" + num(r.mismatches) + "}\n";
+}
+
+struct LoggerBenchmarkResult {
+    unsigned producers = 0;
+    LogOverflow overflow = LogOverflow::Drop;
+    uint64_t records = 0;               // Log() calls, all producers
+    double logMs = 0;                   // first call to the last producer returning
+    double stopMs = 0;                  // Stop(): drain and final write
+    double recordsPerSec = 0;           // producer side
+    uint64_t accepted = 0;
+    uint64_t dropped = 0;
+    uint64_t written = 0;
+    uint64_t lines = 0;                 // producer lines found in the file
+    uint64_t stopAccepted = 0;          // entries accepted by a logger stopped while the producers log
+    uint64_t stopLines = 0;             // ... and its lines in the file
+    size_t mismatches = 0;              // lost, duplicated or reordered lines, or counters that disagree
+};
+
+// producers threads each log perProducer entries ("p=<thread> seq=<n>")
+// into a small ring, so the writer falls behind. The file is then read
+// back: every line must appear at most once and in each producer's order,
+// and the lines plus the dropped count (the writer's own notes included)
+// must add up to what was logged. With LogOverflow::Block nothing may be
+// dropped. A second logger is stopped while the producers are still
+// logging: every entry it accepted must be in its file.
+inline LoggerBenchmarkResult RunLoggerBenchmark(unsigned producers, LogOverflow overflow, uint64_t perProducer = 200000) {
+    using Clock = std::chrono::steady_clock;
+    auto millis = [](Clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(d).count() / 1000.0;
+    };
+    LoggerBenchmarkResult result;
+    result.producers = producers;
+    result.overflow = overflow;
+    result.records = perProducer * producers;
+
+    const std::filesystem::path path = std::filesystem::temp_directory_path() /
+        ("adlog_bench_" + std::to_string(producers) + (overflow == LogOverflow::Block ? "_block.log" : "_drop.log"));
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+
+    LoggerOptions options;
+    options.path = path.wstring();
+    options.queueCapacity = 1024;
+    options.maxFileBytes = UINT64_MAX;
+    options.overflow = overflow;
+    AsyncLogger logger;
+    if (!logger.Start(options)) {
+        result.mismatches++;
+        return result;
+    }
+
+    Clock::time_point t0 = Clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned p = 0; p < producers; p++) {
+        threads.emplace_back([&, p] {
+            for (uint64_t i = 0; i < perProducer; i++) logger.Log(LogLevel::Info, L"bench", {{"p", p}, {"seq", i}});
+        });
+    }
+    for (auto& t : threads) t.join();
+    result.logMs = millis(Clock::now() - t0);
+    t0 = Clock::now();
+    logger.Stop();
+    result.stopMs = millis(Clock::now() - t0);
+    result.recordsPerSec = result.records / std::max(1e-9, result.logMs / 1000);
+    result.accepted = logger.Accepted();
+    result.dropped = logger.Dropped();
+    result.written = logger.Written();
+
+    // Reads back "... INFO - bench p=<p> seq=<n>" and the writer's
+    // "log entries dropped count=<n>" notes
+    std::vector<int64_t> last(producers, -1);
+    uint64_t noted = 0;
+    std::FILE* file = std::fopen(path.string().c_str(), "rb");
+    if (!file) {
+        result.mismatches++;
+        return result;
+    }
+    char line[256];
+    while (std::fgets(line, sizeof(line), file)) {
+        const char* text = std::strstr(line, " - ");
+        if (!text) {
+            result.mismatches++;
+            continue;
+        }
+        unsigned long long p = 0, seq = 0, count = 0;
+        if (std::sscanf(text, " - bench p=%llu seq=%llu", &p, &seq) == 2 && p < producers) {
+            if (static_cast<int64_t>(seq) <= last[p]) result.mismatches++;
+            last[p] = static_cast<int64_t>(seq);
+            result.lines++;
+        } else if (std::sscanf(text, " - log entries dropped count=%llu", &count) == 1) {
+            noted += count;
+        } else {
+            result.mismatches++;
+        }
+    }
+    std::fclose(file);
+    std::filesystem::remove(path, ec);
+
+    if (result.accepted + result.dropped != result.records || result.written != result.accepted ||
+        result.lines != result.accepted || noted != result.dropped) {
+        result.mismatches++;
+    }
+    if (overflow == LogOverflow::Block && (result.dropped != 0 || result.lines != result.records)) result.mismatches++;
+
+    // Stop() racing the producers
+    std::filesystem::path stopPath = path;
+    stopPath.replace_extension(".stop.log");
+    std::filesystem::remove(stopPath, ec);
+    options.path = stopPath.wstring();
+    AsyncLogger stopped;
+    if (!stopped.Start(options)) {
+        result.mismatches++;
+        return result;
+    }
+    threads.clear();
+    for (unsigned p = 0; p < producers; p++) {
+        threads.emplace_back([&, p] {
+            for (uint64_t i = 0; i < perProducer / 10; i++) stopped.Log(LogLevel::Info, L"bench", {{"p", p}, {"seq", i}});
+        });
+    }
+    while (stopped.Accepted() == 0) std::this_thread::yield();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    stopped.Stop();
+    for (auto& t : threads) t.join();
+    result.stopAccepted = stopped.Accepted();
+    file = std::fopen(stopPath.string().c_str(), "rb");
+    if (!file) {
+        result.mismatches++;
+        return result;
+    }
+    while (std::fgets(line, sizeof(line), file)) {
+        if (std::strstr(line, " - bench p=")) result.stopLines++;
+    }
+    std::fclose(file);
+    std::filesystem::remove(stopPath, ec);
+    if (result.stopLines != result.stopAccepted || stopped.Written() != result.stopAccepted) result.mismatches++;
+    return result;
+}
+
+inline std::string FormatLoggerBenchmarkJson(const LoggerBenchmarkResult& r) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    auto real = [](double v) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.3f", v);
+        return std::string(text);
+    };
+    return "{\"producers\":" + num(r.producers) + ",\"overflow\":\"" +
+           (r.overflow == LogOverflow::Block ? "block" : "drop") + "\",\"records\":" + num(r.records) +
+           ",\"logMs\":" + real(r.logMs) + ",\"stopMs\":" + real(r.stopMs) +
+           ",\"recordsPerSec\":" + real(r.recordsPerSec) + ",\"accepted\":" + num(r.accepted) +
+           ",\"dropped\":" + num(r.dropped) + ",\"written\":" + num(r.written) + ",\"lines\":" + num(r.lines) +
+           ",\"stopAccepted\":" + num(r.stopAccepted) + ",\"stopLines\":" + num(r.stopLines) +
+           ",\"mismatches\":" + num(r.mismatches) + "}\n";
+}
+
+struct ExportBenchmarkResult {
+    unsigned rows = 0;
+    uint64_t csvBytes = 0;
+    uint64_t jsonBytes = 0;
+    uint64_t ndjsonBytes = 0;
+    double csvMs = 0;                   // ExportSnapshot, file closed
+    double jsonMs = 0;
+    double ndjsonMs = 0;
+    double csvMBps = 0;
+    double readBackMs = 0;              // parsing the three files back, all checks included
+    size_t quoted = 0;                  // CSV fields that needed quotes
+    size_t mismatches = 0;              // invalid documents, or fields that differ from the model
+};
+
+// Strict RFC 8259 reader: rejects raw control characters, unknown
+// escapes, lone surrogates, leading zeros and trailing commas. Values are
+// read into a small tree, one row at a time.
+class JsonReader {
+public:
+    struct Value {
+        char kind = 0;                  // s string, n number, t true, f false, z null, o object, a array
+        std::string text;               // decoded string, or the number as written
+        std::vector<std::pair<std::string, Value>> members;
+        std::vector<Value> items;
+
+        const Value* Member(const char* key) const {
+            for (const auto& m : members) {
+                if (m.first == key) return &m.second;
+            }
+            return nullptr;
+        }
+    };
+
+    JsonReader(const char* data, size_t size) : m_p(data), m_end(data + size) {}
+
+    bool Ok() const { return m_ok; }
+    bool AtEnd() {
+        Ws();
+        return m_p == m_end;
+    }
+    bool Consume(char c) {
+        Ws();
+        if (m_p == m_end || *m_p != c) return false;
+        m_p++;
+        return true;
+    }
+    bool Peek(char c) {
+        Ws();
+        return m_p != m_end && *m_p == c;
+    }
+    void SkipLine() {
+        while (m_p != m_end && *m_p != '\n') m_p++;
+        if (m_p != m_end) m_p++;
+    }
+    bool LineEnd() {
+        while (m_p != m_end && (*m_p == ' ' || *m_p == '\t' || *m_p == '\r')) m_p++;
+        if (m_p == m_end) return true;
+        if (*m_p != '\n') return false;
+        m_p++;
+        return true;
+    }
+
+    bool Read(Value& v, int depth = 0) {
+        Ws();
+        if (m_p == m_end || depth > 64) return Fail();
+        v = Value();
+        const char c = *m_p;
+        if (c == '"') {
+            v.kind = 's';
+            return String(v.text);
+        }
+        if (c == '{') {
+            v.kind = 'o';
+            m_p++;
+            if (Consume('}')) return true;
+            do {
+                std::pair<std::string, Value> member;
+                Ws();
+                if (m_p == m_end || *m_p != '"' || !String(member.first) || !Consume(':') || !Read(member.second, depth + 1)) {
+                    return Fail();
+                }
+                v.members.push_back(std::move(member));
+            } while (Consume(','));
+            return Consume('}') || Fail();
+        }
+        if (c == '[') {
+            v.kind = 'a';
+            m_p++;
+            if (Consume(']')) return true;
+            do {
+                v.items.emplace_back();
+                if (!Read(v.items.back(), depth + 1)) return Fail();
+            } while (Consume(','));
+            return Consume(']') || Fail();
+        }
+        for (const char* literal : {"true", "false", "null"}) {
+            const size_t n = std::strlen(literal);
+            if (static_cast<size_t>(m_end - m_p) >= n && std::memcmp(m_p, literal, n) == 0) {
+                v.kind = literal[0] == 'n' ? 'z' : literal[0];
+                m_p += n;
+                return true;
+            }
+        }
+        v.kind = 'n';
+        return Number(v.text);
+    }
+
+private:
+    bool Fail() {
+        m_ok = false;
+        return false;
+    }
+
+    void Ws() {
+        while (m_p != m_end && (*m_p == ' ' || *m_p == '\t' || *m_p == '\r' || *m_p == '\n')) m_p++;
+    }
+
+    bool Number(std::string& out) {
+        const char* start = m_p;
+        auto digits = [&]() {
+            const char* from = m_p;
+            while (m_p != m_end && *m_p >= '0' && *m_p <= '9') m_p++;
+            return m_p != from;
+        };
+        if (m_p != m_end && *m_p == '-') m_p++;
+        if (m_p != m_end && *m_p == '0') {
+            m_p++;
+        } else if (!digits()) {
+            return Fail();
+        }
+        if (m_p != m_end && *m_p == '.') {
+            m_p++;
+            if (!digits()) return Fail();
+        }
+        if (m_p != m_end && (*m_p == 'e' || *m_p == 'E')) {
+            m_p++;
+            if (m_p != m_end && (*m_p == '+' || *m_p == '-')) m_p++;
+            if (!digits()) return Fail();
+        }
+        out.assign(start, m_p);
+        return true;
+    }
+
+    bool Hex4(uint32_t& v) {
+        if (m_end - m_p < 4) return false;
+        v = 0;
+        for (int i = 0; i < 4; i++, m_p++) {
+            const char c = *m_p;
+            v <<= 4;
+            if (c >= '0' && c <= '9') v |= static_cast<uint32_t>(c - '0');
+            else if (c >= 'a' && c <= 'f') v |= static_cast<uint32_t>(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') v |= static_cast<uint32_t>(c - 'A' + 10);
+            else return false;
+        }
+        return true;
+    }
+
+    static void PutCodePoint(std::string& out, uint32_t cp) {
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+
+    bool String(std::string& out) {
+        m_p++;                          // opening quote
+        out.clear();
+        while (m_p != m_end) {
+            const unsigned char c = static_cast<unsigned char>(*m_p++);
+            if (c == '"') return true;
+            if (c < 0x20) return Fail();
+            if (c != '\\') {
+                out += static_cast<char>(c);
+                continue;
+            }
+            if (m_p == m_end) return Fail();
+            switch (*m_p++) {
+                case '"':  out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/':  out += '/'; break;
+                case 'b':  out += '\b'; break;
+                case 'f':  out += '\f'; break;
+                case 'n':  out += '\n'; break;
+                case 'r':  out += '\r'; break;
+                case 't':  out += '\t'; break;
+                case 'u': {
+                    uint32_t cp;
+                    if (!Hex4(cp) || (cp >= 0xDC00 && cp < 0xE000)) return Fail();
+                    if (cp >= 0xD800 && cp < 0xDC00) {
+                        uint32_t low;
+                        if (m_end - m_p < 2 || m_p[0] != '\\' || m_p[1] != 'u') return Fail();
+                        m_p += 2;
+                        if (!Hex4(low) || low < 0xDC00 || low >= 0xE000) return Fail();
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    PutCodePoint(out, cp);
+                    break;
+                }
+                default:   return Fail();
+            }
+        }
+        return Fail();
+    }
+
+    const char* m_p;
+    const char* m_end;
+    bool m_ok = true;
+};
+
+// RFC 4180 records: fields split on commas, quoted fields with doubled
+// quotes and embedded line breaks, records ending in CRLF. Returns false at
+// the end of the input or on a malformed record.
+inline bool ReadCsvRecord(const char*& p, const char* end, std::vector<std::string>& fields, size_t& quoted) {
+    fields.clear();
+    if (p == end) return false;
+    for (;;) {
+        std::string field;
+        if (p != end && *p == '"') {
+            quoted++;
+            p++;
+            for (;;) {
+                if (p == end) return false;
+                if (*p == '"') {
+                    if (p + 1 != end && p[1] == '"') {
+                        field += '"';
+                        p += 2;
+                        continue;
+                    }
+                    p++;
+                    break;
+                }
+                field += *p++;
+            }
+        } else {
+            while (p != end && *p != ',' && *p != '\r' && *p != '\n' && *p != '"') field += *p++;
+            if (p != end && *p == '"') return false;
+        }
+        fields.push_back(std::move(field));
+        if (p == end) return false;
+        if (*p == ',') {
+            p++;
+            continue;
+        }
+        if (end - p >= 2 && p[0] == '\r' && p[1] == '\n') {
+            p += 2;
+            return true;
+        }
+        return false;
+    }
+}
+
+// Site and DC names for row i: plain, or holding what each format must
+// escape (commas, quotes, CR/LF, tabs, control characters, backslashes,
+// accents, CJK and a character outside the BMP)
+inline std::wstring ExportTestName(const wchar_t* prefix, unsigned i) {
+    std::wstring n = prefix + std::to_wstring(i);
+    switch (i % 16) {
+        case 1:  return n + L", annexe";
+        case 3:  return L"\"" + n + L"\" nord";
+        case 5:  return n + L"\r\nB";
+        case 7:  return L"Gen\u00E8ve " + n;
+        case 9:  return n + L"\t\x01\x1F";
+        case 11: return n + L"\\share\\";
+        case 13: return L"\u6771\u4EAC-" + n + L"-\U0001F600";
+        case 15: return L",\"" + n + L"\n\"";
+        default: return n;
+    }
+}
+
+// rows generated DC records (names from ExportTestName, 10 DCs per site)
+// exported as CSV, JSON and NDJSON to the temporary directory, then read
+// back with the parsers above and compared field by field with the model.
+inline ExportBenchmarkResult RunExportBenchmark(unsigned rows, uint64_t seed) {
+    using Clock = std::chrono::steady_clock;
+    auto millis = [](Clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(d).count() / 1000.0;
+    };
+    ExportBenchmarkResult result;
+    result.rows = rows;
+
+    ScanSnapshot snapshot;
+    ReplicationModel& model = snapshot.model;
+    model.SetEventIds(EventCollectorOptions().eventIds);
+    model.Reserve(rows);
+    uint64_t h = seed * 0x9E3779B97F4A7C15ull + 23;
+    auto next = [&]() {
+        h ^= h << 13; h ^= h >> 7; h ^= h << 17;
+        return h;
+    };
+    for (unsigned i = 0; i < rows; i++) {
+        const DcId id = model.AddDc(ExportTestName(L"Site", i / 10), ExportTestName(L"DC", i) + L".corp.example.com");
+        DcRecord& r = model.records[id];
+        const uint64_t roll = next();
+        r.status = roll % 20 == 0 ? ProbeStatus::Unreachable : roll % 20 == 1 ? ProbeStatus::Timeout : ProbeStatus::Ok;
+        r.usn = r.status == ProbeStatus::Ok ? (roll >> 8) % 10000000000ull : 0;
+        r.partners = static_cast<uint16_t>((roll >> 40) % 9);
+        r.failingPartners = static_cast<uint16_t>(std::min<uint64_t>(r.partners, (roll >> 44) % 3));
+        r.lastReplication = roll % 7 == 0 ? 0 : 1714521600000 + static_cast<int64_t>((roll >> 16) % 2592000000ull);
+        r.latencySec = roll % 5 == 0 ? kUnknownLatency : static_cast<uint32_t>((roll >> 24) % 200000);
+        r.lag = static_cast<LagClass>((roll >> 50) % 5);
+        r.probeMs = static_cast<uint32_t>((roll >> 54) % 30000);
+        uint32_t* counts = model.EventCountsOf(id);
+        for (size_t k = 0; k < model.eventIds.size(); k++) {
+            counts[k] = static_cast<uint32_t>(next() % 50);
+            r.errorTotal += counts[k];
+        }
+    }
+
+    const std::filesystem::path dir = std::filesystem::temp_directory_path();
+    const std::filesystem::path paths[3] = {dir / "adrx_bench.csv", dir / "adrx_bench.json", dir / "adrx_bench.ndjson"};
+    const ExportFormat formats[3] = {ExportFormat::Csv, ExportFormat::Json, ExportFormat::Ndjson};
+    double* times[3] = {&result.csvMs, &result.jsonMs, &result.ndjsonMs};
+    uint64_t* sizes[3] = {&result.csvBytes, &result.jsonBytes, &result.ndjsonBytes};
+    std::string files[3];
+    for (int f = 0; f < 3; f++) {
+        Clock::time_point t0 = Clock::now();
+        if (!ExportSnapshot(snapshot, formats[f], paths[f].wstring())) result.mismatches++;
+        *times[f] = millis(Clock::now() - t0);
+        std::error_code ec;
+        *sizes[f] = std::filesystem::file_size(paths[f], ec);
+        std::FILE* file = std::fopen(paths[f].string().c_str(), "rb");
+        if (file) {
+            files[f].resize(static_cast<size_t>(*sizes[f]));
+            if (std::fread(&files[f][0], 1, files[f].size(), file) != files[f].size()) result.mismatches++;
+            std::fclose(file);
+        }
+        std::filesystem::remove(paths[f], ec);
+    }
+    result.csvMBps = result.csvBytes / 1048576.0 / std::max(1e-9, result.csvMs / 1000);
+
+    // Expected text of each field, as the exporters render it
+    std::vector<std::string> siteNames(model.sites.Size()), dcNames(rows);
+    for (uint32_t i = 0; i < siteNames.size(); i++) siteNames[i] = WideToUtf8(model.sites.Name(i));
+    for (DcId id = 0; id < rows; id++) dcNames[id] = WideToUtf8(model.DcName(id));
+    auto text = [](uint64_t v) { return std::to_string(v); };
+    auto timestamp = [](int64_t unixMs) {
+        char t[24];
+        return std::string(t, ReportExporter::FormatTimestamp(unixMs, t));
+    };
+    const std::string header = "\xEF\xBB\xBFSite,DC,Statut,USN,Partenaires,PartenairesEnEchec,DerniereReplic,LatenceSec,Latence,Erreurs";
+
+    Clock::time_point t0 = Clock::now();
+    {
+        const char* p = files[0].data();
+        const char* end = p + files[0].size();
+        std::vector<std::string> fields;
+        size_t quotedHeader = 0;
+        if (!ReadCsvRecord(p, end, fields, quotedHeader) || fields.size() != 10 + model.eventIds.size()) result.mismatches++;
+        std::string joined;
+        for (size_t k = 0; k < fields.size() && k < 10; k++) joined += (k ? "," : "") + fields[k];
+        if (joined != header) result.mismatches++;
+        DcId id = 0;
+        for (; ReadCsvRecord(p, end, fields, result.quoted); id++) {
+            if (id >= rows || fields.size() != 10 + model.eventIds.size()) {
+                result.mismatches++;
+                continue;
+            }
+            const DcRecord& r = model.records[id];
+            const uint32_t* counts = model.EventCountsOf(id);
+            bool same = fields[0] == siteNames[r.site] && fields[1] == dcNames[id] &&
+                        fields[2] == ProbeStatusName(r.status) && fields[3] == (r.HasUsn() ? text(r.usn) : "") &&
+                        fields[4] == text(r.partners) && fields[5] == text(r.failingPartners) &&
+                        fields[6] == (r.lastReplication > 0 ? timestamp(r.lastReplication) : "") &&
+                        fields[7] == (r.HasLatency() ? text(r.latencySec) : "") && fields[8] == LagClassName(r.lag) &&
+                        fields[9] == text(r.errorTotal);
+            for (size_t k = 0; k < model.eventIds.size(); k++) same = same && fields[10 + k] == text(counts[k]);
+            if (!same) result.mismatches++;
+        }
+        if (id != rows || p != end) result.mismatches++;
+    }
+
+    // One JSON object per row, checked member by member
+    auto checkRow = [&](const JsonReader::Value& v, DcId id) {
+        const DcRecord& r = model.records[id];
+        const uint32_t* counts = model.EventCountsOf(id);
+        auto is = [&](const char* key, char kind, const std::string& value) {
+            const JsonReader::Value* m = v.Member(key);
+            return m && m->kind == kind && (kind == 'z' || m->text == value);
+        };
+        bool same = v.kind == 'o' && v.members.size() == 12 && is("site", 's', siteNames[r.site]) &&
+                    is("dc", 's', dcNames[id]) && is("status", 's', ProbeStatusName(r.status)) &&
+                    (r.HasUsn() ? is("usn", 'n', text(r.usn)) : is("usn", 'z', "")) &&
+                    is("partners", 'n', text(r.partners)) && is("failingPartners", 'n', text(r.failingPartners)) &&
+                    (r.lastReplication > 0 ? is("lastReplication", 's', timestamp(r.lastReplication))
+                                           : is("lastReplication", 'z', "")) &&
+                    (r.HasLatency() ? is("latencySec", 'n', text(r.latencySec)) : is("latencySec", 'z', "")) &&
+                    is("lag", 's', LagClassName(r.lag)) && is("probeMs", 'n', text(r.probeMs)) &&
+                    is("errors", 'n', text(r.errorTotal));
+        const JsonReader::Value* events = v.Member("events");
+        same = same && events && events->kind == 'o' && events->members.size() == model.eventIds.size();
+        for (size_t k = 0; same && k < model.eventIds.size(); k++) {
+            same = events->members[k].first == text(model.eventIds[k]) && events->members[k].second.kind == 'n' &&
+                   events->members[k].second.text == text(counts[k]);
+        }
+        if (!same) result.mismatches++;
+    };
+    {
+        JsonReader reader(files[1].data(), files[1].size());
+        JsonReader::Value row;
+        DcId id = 0;
+        if (!reader.Consume('[')) result.mismatches++;
+        if (!reader.Peek(']')) {
+            do {
+                if (!reader.Read(row)) break;
+                if (id < rows) checkRow(row, id);
+                id++;
+            } while (reader.Consume(','));
+        }
+        if (!reader.Consume(']') || !reader.AtEnd() || !reader.Ok() || id != rows) result.mismatches++;
+    }
+    {
+        JsonReader reader(files[2].data(), files[2].size());
+        JsonReader::Value row;
+        DcId id = 0;
+        while (!reader.AtEnd()) {
+            if (!reader.Read(row) || !reader.LineEnd()) {
+                result.mismatches++;
+                break;
+            }
+            if (id < rows) checkRow(row, id);
+            id++;
+        }
+        if (!reader.Ok() || id != rows) result.mismatches++;
+    }
+    result.readBackMs = millis(Clock::now() - t0);
+
+    // The reader itself must refuse what the exporters must never emit
+    for (const char* bad : {"{\"a\":1,}", "[01]", "\"\x01\"", "\"\\x\"", "\"\\ud800\"", "[1 2]", "{\"a\" 1}", "tru"}) {
+        JsonReader reader(bad, std::strlen(bad));
+        JsonReader::Value v;
+        if (reader.Read(v) && reader.AtEnd()) result.mismatches++;
+    }
+    return result;
+}
+
+inline std::string FormatExportBenchmarkJson(const ExportBenchmarkResult& r) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    auto real = [](double v) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.3f", v);
+        return std::string(text);
+    };
+    return "{\"rows\":" + num(r.rows) + ",\"csvBytes\":" + num(r.csvBytes) + ",\"jsonBytes\":" + num(r.jsonBytes) +
+           ",\"ndjsonBytes\":" + num(r.ndjsonBytes) + ",\"csvMs\":" + real(r.csvMs) + ",\"jsonMs\":" + real(r.jsonMs) +
+           ",\"ndjsonMs\":" + real(r.ndjsonMs) + ",\"csvMBps\":" + real(r.csvMBps) +
+           ",\"readBackMs\":" + real(r.readBackMs) + ",\"quoted\":" + num(r.quoted) +
+           ",\"mismatches\":" + num(r.mismatches) + "}\n";
+}
+
+struct HistogramBenchmarkResult {
+    unsigned samples = 0;
+    size_t buckets = 0;                 // histogram buckets checked
+    size_t quantiles = 0;
+    size_t families = 0;                // metric families in the exposition
+    size_t lines = 0;                   // samples in the exposition
+    size_t escapedLabels = 0;           // label values holding \, " or a line feed
+    double recordNs = 0;                // per Record, 4 threads
+    double formatMs = 0;
+    size_t mismatches = 0;
+};
+
+// Histogram math and Prometheus exposition against brute force. Every
+// bucket must be contiguous with its neighbours, contain its own bounds and
+// stay under 1/32 relative width; quantiles must match the sorted samples'
+// bucket at rank ceil(q * n). The exposition of a scan whose site and DC
+// names need escaping is parsed back: every sample belongs to a declared
+// family, label values unescape to the names, and the histogram's
+// cumulative buckets, +Inf, _sum and _count match the recorded samples.
+inline HistogramBenchmarkResult RunHistogramBenchmark(unsigned samples, uint64_t seed) {
+    using Clock = std::chrono::steady_clock;
+    HistogramBenchmarkResult result;
+    result.samples = samples;
+    typedef LatencyHistogram H;
+
+    for (size_t i = 0; i < H::kBuckets; i++) {
+        const uint64_t lower = H::BucketLower(i), upper = H::BucketUpper(i);
+        bool ok = lower <= upper && H::BucketIndex(lower) == i && H::BucketIndex(upper) == i;
+        if (i == 0) ok = ok && lower == 0;
+        else ok = ok && lower == H::BucketUpper(i - 1) + 1;
+        if (i >= H::kLinear) ok = ok && (upper - lower + 1) * H::kHalf <= lower;
+        else ok = ok && lower == upper;
+        if (!ok) result.mismatches++;
+        result.buckets++;
+    }
+    if (H::BucketUpper(H::kBuckets - 1) != H::kMaxValue || H::BucketIndex(H::kMaxValue + 1) != H::kBuckets - 1 ||
+        H::BucketIndex(~0ull) != H::kBuckets - 1) result.mismatches++;
+    {
+        H empty;
+        if (empty.Count() != 0 || empty.ValueAtQuantile(0.5) != 0 || empty.ValueAtQuantile(1.0) != 0) result.mismatches++;
+    }
+
+    {
+        // 0..49 land in exact buckets: each quantile is the sample at its rank
+        H exact;
+        for (uint64_t v = 0; v < 50; v++) exact.Record(v);
+        for (unsigned k = 0; k <= 1000; k++) {
+            const uint64_t rank = std::max<uint64_t>(1, (k * 50 + 999) / 1000);
+            if (exact.ValueAtQuantile(k / 1000.0) != rank - 1) result.mismatches++;
+            result.quantiles++;
+        }
+    }
+
+    // Log-uniform values from 0 to about 2^35 us, a few past the last bucket
+    uint64_t h = seed * 0x9E3779B97F4A7C15ull + 29;
+    auto next = [&]() {
+        h ^= h << 13; h ^= h >> 7; h ^= h << 17;
+        return h;
+    };
+    std::vector<uint64_t> values(samples);
+    for (uint64_t& v : values) {
+        const uint64_t roll = next();
+        v = roll % 1000 == 0 ? H::kMaxValue + (roll >> 40) : (roll >> 29) >> (roll % 36);
+        const size_t b = H::BucketIndex(v);
+        if (v <= H::kMaxValue && (v < H::BucketLower(b) || v > H::BucketUpper(b))) result.mismatches++;
+    }
+
+    H hist;
+    const unsigned threads = 4;
+    auto start = Clock::now();
+    {
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                for (size_t i = t; i < values.size(); i += threads) hist.Record(values[i]);
+            });
+        }
+        for (std::thread& w : workers) w.join();
+    }
+    result.recordNs = samples ? std::chrono::duration<double, std::nano>(Clock::now() - start).count() / samples : 0;
+
+    std::vector<uint64_t> sorted = values;
+    std::sort(sorted.begin(), sorted.end());
+    uint64_t sum = 0;
+    for (uint64_t v : values) sum += v;
+    const uint64_t max = sorted.empty() ? 0 : sorted.back();
+    if (hist.Count() != samples || hist.SumMicros() != sum || hist.MaxMicros() != max) result.mismatches++;
+    if (!sorted.empty()) {
+        // Round quantiles and ones whose rank falls between two samples
+        for (double q : {0.0, 0.001, 0.01, 0.25, 0.5, 0.75, 0.9, 0.99, 0.999, 0.9999, 1.0, 0.0000123, 0.1234123,
+                         0.3333333, 0.7777771, 0.9876541}) {
+            // ceil, minus the float noise the histogram also tolerates
+            uint64_t rank = static_cast<uint64_t>(std::ceil(q * static_cast<double>(samples) - 1e-6));
+            rank = std::min<uint64_t>(samples, std::max<uint64_t>(1, rank));
+            const uint64_t exact = sorted[rank - 1];
+            const uint64_t expected = std::min(H::BucketUpper(H::BucketIndex(exact)), max);
+            const uint64_t got = hist.ValueAtQuantile(q);
+            if (got != expected || got < std::min(exact, H::kMaxValue)) result.mismatches++;  // saturates past the last bucket
+            result.quantiles++;
+        }
+    }
+
+    // A scan whose names need escaping, samples spread over phases and DCs
+    const std::wstring siteNames[] = {L"Paris", L"Site \"Nord\"", L"C:\\Sites\\Lyon", L"Ligne\nSuivante", L"Épinal",
+                                      L"\\\"\n"};
+    const size_t siteCount = sizeof(siteNames) / sizeof(siteNames[0]);
+    auto snapshot = std::make_shared<ScanSnapshot>();
+    ReplicationModel& model = snapshot->model;
+    std::vector<uint32_t> siteOfDc;
+    for (size_t s = 0; s < siteCount; s++) {
+        for (unsigned k = 0; k < 3; k++) {
+            std::wstring dc = L"DC" + std::to_wstring(s) + L"-" + std::to_wstring(k) + (k == 1 ? L"\"q\"\\" : L"");
+            const DcId id = model.AddDc(siteNames[s], dc);
+            siteOfDc.push_back(model.records[id].site);
+        }
+    }
+    auto metrics = std::make_shared<ScanMetrics>();
+    metrics->SetDcs(siteOfDc);
+    std::vector<uint64_t> phaseValues[kMetricPhases];
+    std::map<std::pair<uint32_t, size_t>, std::pair<uint64_t, uint64_t>> siteCells;  // (site, phase) -> count, sum
+    for (size_t i = 0; i < values.size() && i < 200000; i++) {
+        const size_t p = i % kMetricPhases;
+        const uint64_t v = std::min(values[i], H::kMaxValue) % 120000000;
+        const uint32_t dc = static_cast<uint32_t>(next() % (siteOfDc.size() + 1));  // one in n without a DC
+        metrics->Record(static_cast<MetricPhase>(p), dc == siteOfDc.size() ? ScanMetrics::kNoDc : dc, v);
+        phaseValues[p].push_back(v);
+        if (dc < siteOfDc.size()) {
+            auto& cell = siteCells[{siteOfDc[dc], p}];
+            cell.first++;
+            cell.second += v;
+        }
+    }
+    snapshot->metrics = metrics;
+    snapshot->generation = 7;
+    snapshot->startedAt = 1714521600000;
+    snapshot->completedAt = 1714521612345;
+    HealthReport health;
+    start = Clock::now();
+    const std::string text = PrometheusExporter::Format(*snapshot, health);
+    result.formatMs = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count() / 1000.0;
+
+    auto seconds = [](uint64_t micros) {
+        char out[32];
+        std::snprintf(out, sizeof(out), "%llu.%06llu", (unsigned long long)(micros / 1000000),
+                      (unsigned long long)(micros % 1000000));
+        return std::string(out);
+    };
+    struct Line {
+        std::string name;
+        std::vector<std::pair<std::string, std::string>> labels;
+        std::string value;
+        std::string Label(const char* key) const {
+            for (const auto& l : labels) if (l.first == key) return l.second;
+            return std::string();
+        }
+    };
+    auto nameChar = [](char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == ':';
+    };
+    // Parses one sample line; false on anything the text format does not allow
+    auto parse = [&](const std::string& s, Line& line) {
+        size_t i = 0;
+        while (i < s.size() && nameChar(s[i])) i++;
+        if (i == 0 || (s[0] >= '0' && s[0] <= '9')) return false;
+        line.name = s.substr(0, i);
+        if (i < s.size() && s[i] == '{') {
+            i++;
+            while (i < s.size() && s[i] != '}') {
+                size_t k = i;
+                while (i < s.size() && nameChar(s[i])) i++;
+                if (i == k || i + 1 >= s.size() || s[i] != '=' || s[i + 1] != '"') return false;
+                std::string key = s.substr(k, i - k), value;
+                for (i += 2; i < s.size() && s[i] != '"'; i++) {
+                    if (s[i] != '\\') { value += s[i]; continue; }
+                    if (++i >= s.size()) return false;
+                    if (s[i] == 'n') value += '\n';
+                    else if (s[i] == '\\' || s[i] == '"') value += s[i];
+                    else return false;
+                }
+                if (i >= s.size()) return false;
+                i++;
+                line.labels.emplace_back(key, value);
+                if (i < s.size() && s[i] == ',') i++;
+                else if (i < s.size() && s[i] != '}') return false;
+            }
+            if (i >= s.size()) return false;
+            i++;
+        }
+        if (i >= s.size() || s[i] != ' ') return false;
+        line.value = s.substr(i + 1);
+        if (line.value.empty()) return false;
+        for (char c : line.value) if (!(c >= '0' && c <= '9') && c != '.') return false;
+        return true;
+    };
+
+    std::map<std::string, std::string> types;
+    std::set<std::string> helped;
+    std::vector<Line> lines;
+    if (text.empty() || text.back() != '\n') result.mismatches++;
+    for (size_t pos = 0; pos < text.size();) {
+        size_t end = text.find('\n', pos);
+        if (end == std::string::npos) end = text.size();
+        const std::string s = text.substr(pos, end - pos);
+        pos = end + 1;
+        if (s.compare(0, 7, "# HELP ") == 0) {
+            helped.insert(s.substr(7, s.find(' ', 7) - 7));
+        } else if (s.compare(0, 7, "# TYPE ") == 0) {
+            const size_t space = s.find(' ', 7);
+            const std::string name = s.substr(7, space - 7), type = space == std::string::npos ? "" : s.substr(space + 1);
+            if (!helped.count(name) || types.count(name) ||
+                (type != "gauge" && type != "counter" && type != "summary" && type != "histogram")) result.mismatches++;
+            types[name] = type;
+        } else {
+            Line line;
+            if (!parse(s, line)) {
+                result.mismatches++;
+                continue;
+            }
+            // The family must be declared; suffixes only on summaries and histograms
+            std::string family = line.name;
+            for (const char* suffix : {"_bucket", "_sum", "_count"}) {
+                const size_t n = std::strlen(suffix);
+                if (types.count(line.name) || line.name.size() <= n ||
+                    line.name.compare(line.name.size() - n, n, suffix) != 0) continue;
+                const std::string base = line.name.substr(0, line.name.size() - n);
+                const std::string type = types.count(base) ? types[base] : std::string();
+                if (type == "histogram" || (type == "summary" && std::strcmp(suffix, "_bucket") != 0)) family = base;
+            }
+            if (!types.count(family)) result.mismatches++;
+            for (const auto& l : line.labels) {
+                if (l.second.find_first_of("\\\"\n") != std::string::npos) result.escapedLabels++;
+            }
+            lines.push_back(std::move(line));
+        }
+    }
+    result.families = types.size();
+    result.lines = lines.size();
+    if (types["adrepl_phase_latency_seconds"] != "histogram" || types["adrepl_phase_duration_seconds"] != "summary") {
+        result.mismatches++;
+    }
+
+    std::set<std::string> siteUtf8, dcUtf8;
+    for (uint32_t s = 0; s < model.sites.Size(); s++) siteUtf8.insert(WideToUtf8(model.sites.Name(s)));
+    for (DcId id = 0; id < model.Size(); id++) dcUtf8.insert(WideToUtf8(model.DcName(id)));
+    for (size_t p = 0; p < kMetricPhases; p++) {
+        const std::string phase = MetricPhaseName(static_cast<MetricPhase>(p));
+        const std::vector<uint64_t>& pv = phaseValues[p];
+        uint64_t phaseSum = 0;
+        for (uint64_t v : pv) phaseSum += v;
+        const LatencyHistogram& ph = metrics->Histogram(static_cast<MetricPhase>(p));
+
+        // Buckets in order of bound, cumulative, never counting a value above le
+        std::vector<std::string> bounds;
+        for (uint64_t b : PrometheusExporter::kBucketBoundsUs) bounds.push_back(seconds(b));
+        bounds.push_back("+Inf");
+        size_t bucket = 0;
+        std::string sumText, countText;
+        for (const Line& line : lines) {
+            if (line.Label("phase") != phase) continue;
+            if (line.name == "adrepl_phase_latency_seconds_bucket") {
+                if (bucket >= bounds.size() || line.Label("le") != bounds[bucket]) {
+                    result.mismatches++;
+                    continue;
+                }
+                uint64_t expected = 0, atOrBelow = 0;
+                const uint64_t le = bucket < bounds.size() - 1 ? PrometheusExporter::kBucketBoundsUs[bucket] : ~0ull;
+                for (uint64_t v : pv) {
+                    if (H::BucketUpper(H::BucketIndex(v)) <= le) expected++;
+                    if (v <= le) atOrBelow++;
+                }
+                if (line.value != std::to_string(expected) || expected > atOrBelow) result.mismatches++;
+                bucket++;
+            } else if (line.name == "adrepl_phase_latency_seconds_sum") {
+                sumText = line.value;
+            } else if (line.name == "adrepl_phase_latency_seconds_count") {
+                countText = line.value;
+            } else if (line.name == "adrepl_phase_duration_seconds_count") {
+                if (line.value != std::to_string(pv.size())) result.mismatches++;
+            } else if (line.name == "adrepl_phase_duration_seconds_sum") {
+                if (line.value != seconds(phaseSum)) result.mismatches++;
+            } else if (line.name == "adrepl_phase_duration_seconds") {
+                const std::string q = line.Label("quantile");
+                if (q != "0.5" && q != "0.99") result.mismatches++;
+                else if (line.value != seconds(ph.ValueAtQuantile(q == "0.5" ? 0.5 : 0.99))) result.mismatches++;
+            }
+        }
+        if (bucket != bounds.size() || sumText != seconds(phaseSum) || countText != std::to_string(pv.size())) {
+            result.mismatches++;
+        }
+    }
+
+    // Site and DC labels unescape to the model's names
+    size_t siteLines = 0;
+    for (const Line& line : lines) {
+        if (line.name == "adrepl_site_phase_duration_seconds_count") {
+            siteLines++;
+            bool found = false;
+            for (const auto& cell : siteCells) {
+                if (WideToUtf8(model.sites.Name(cell.first.first)) != line.Label("site") ||
+                    MetricPhaseName(static_cast<MetricPhase>(cell.first.second)) != line.Label("phase")) continue;
+                found = line.value == std::to_string(cell.second.first);
+                break;
+            }
+            if (!found) result.mismatches++;
+        } else if (line.name == "adrepl_slowest_dc_seconds") {
+            if (!dcUtf8.count(line.Label("dc")) || !siteUtf8.count(line.Label("site"))) result.mismatches++;
+        }
+    }
+    if (siteLines != siteCells.size()) result.mismatches++;
+    return result;
+}
+
+inline std::string FormatHistogramBenchmarkJson(const HistogramBenchmarkResult& r) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    auto real = [](double v) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.3f", v);
+        return std::string(text);
+    };
+    return "{\"samples\":" + num(r.samples) + ",\"buckets\":" + num(r.buckets) + ",\"quantiles\":" + num(r.quantiles) +
+           ",\"families\":" + num(r.families) + ",\"lines\":" + num(r.lines) +
+           ",\"escapedLabels\":" + num(r.escapedLabels) + ",\"recordNs\":" + real(r.recordNs) +
+           ",\"formatMs\":" + real(r.formatMs) + ",\"mismatches\":" + num(r.mismatches) + "}\n";
+}
+
+struct PoolBenchmarkResult {
+    unsigned threads = 0;
+    uint64_t acquisitions = 0;          // stress phase
+    uint64_t binds = 0;
+    uint64_t reuses = 0;
+    uint64_t waits = 0;
+    size_t peakPerDc = 0;               // most leases to one DC at once
+    double acquireUs = 0;               // per acquisition and return, stress phase
+    size_t mismatches = 0;
+};
+
+// Counts live sessions per DC and fails binds and checks on demand
+class CountingTransport : public IDirectoryTransport {
+public:
+    struct Session : IDirectorySession {
+        Session(CountingTransport& t, size_t dc) : transport(t), dc(dc) { ++transport.m_live[dc]; }
+        ~Session() override { --transport.m_live[dc]; }
+        CountingTransport& transport;
+        size_t dc;
+        bool dead = false;
+    };
+
+    static constexpr int32_t kLost = 51;            // LDAP_UNAVAILABLE
+    static constexpr int32_t kNoSuchObject = 32;
+
+    std::unique_ptr<IDirectorySession> Bind(const std::wstring& dc, std::chrono::milliseconds timeout,
+                                            int32_t& error) override {
+        (void)timeout;
+        m_bindCalls++;
+        if (dc == L"down") {
+            error = kLost;
+            return nullptr;
+        }
+        return std::make_unique<Session>(*this, Index(dc));
+    }
+
+    bool Check(IDirectorySession& session) override {
+        m_checks++;
+        return !static_cast<Session&>(session).dead;
+    }
+
+    bool IsConnectionError(int32_t error) const override { return error == kLost; }
+
+    static size_t Index(const std::wstring& dc) { return dc.empty() ? 0 : static_cast<size_t>(dc.back() - L'0') % kDcs; }
+    size_t Live(size_t dc) const { return m_live[dc].load(); }
+    size_t Live() const {
+        size_t n = 0;
+        for (const auto& l : m_live) n += l.load();
+        return n;
+    }
+
+    static constexpr size_t kDcs = 4;
+    std::atomic<size_t> m_live[kDcs] = {};
+    std::atomic<uint64_t> m_bindCalls{0};
+    std::atomic<uint64_t> m_checks{0};
+};
+
+// The pool against a counting transport: cap-and-wait (a timed-out wait,
+// then a wait served by a returned lease), idle expiry on Acquire and on
+// Trim, a failed health check rebinding, a lost connection evicting the
+// DC's idle sessions and leases taken before the eviction, a failed bind
+// releasing its slot. Then threads hammer four DCs with a cap of 2 while
+// some leases report lost connections: no DC may ever have more than 2
+// leases out, and no session may survive the pool. (Live sessions can
+// briefly exceed the cap: the pool closes them outside its lock.)
+inline PoolBenchmarkResult RunPoolBenchmark(unsigned threads, uint64_t seed,
+                                            std::chrono::milliseconds duration = std::chrono::milliseconds(500)) {
+    using Clock = std::chrono::steady_clock;
+    using std::chrono::milliseconds;
+    PoolBenchmarkResult result;
+    result.threads = threads;
+    auto check = [&](bool ok) {
+        if (!ok) result.mismatches++;
+    };
+    auto transport = std::make_shared<CountingTransport>();
+
+    {
+        // Cap and wait
+        ConnectionPoolOptions options;
+        options.maxPerDc = 2;
+        ConnectionPool pool(transport, options);
+        int32_t error = 0;
+        ConnectionPool::Lease a = pool.Acquire(L"dc0", milliseconds(100), error);
+        ConnectionPool::Lease b = pool.Acquire(L"dc0", milliseconds(100), error);
+        check(a && b && !a.Reused() && transport->Live(0) == 2);
+        error = 0;
+        Clock::time_point start = Clock::now();
+        ConnectionPool::Lease c = pool.Acquire(L"dc0", milliseconds(50), error);
+        check(!c && error == -1 && Clock::now() - start >= milliseconds(50));
+        // Another DC is not held up by dc0's cap
+        ConnectionPool::Lease other = pool.Acquire(L"dc1", milliseconds(50), error);
+        check(static_cast<bool>(other));
+
+        std::thread giver([&]() {
+            std::this_thread::sleep_for(milliseconds(30));
+            a = ConnectionPool::Lease();
+        });
+        error = 0;
+        ConnectionPool::Lease d = pool.Acquire(L"dc0", milliseconds(5000), error);
+        giver.join();
+        ConnectionPoolStats s = pool.Stats();
+        check(d && d.Reused() && error == 0 && s.waits == 2 && s.binds == 3 && s.leased == 3 && s.idle == 0);
+        check(transport->Live(0) == 2);
+
+        // A failed bind gives its slot back
+        ConnectionPool::Lease down = pool.Acquire(L"down", milliseconds(50), error);
+        check(!down && error == CountingTransport::kLost);
+        for (int i = 0; i < 3; i++) {
+            error = 0;
+            ConnectionPool::Lease again = pool.Acquire(L"down", milliseconds(50), error);
+            check(!again && error == CountingTransport::kLost);
+        }
+        check(pool.Stats().bindFailures == 4 && pool.Stats().waits == 2);
+    }
+    check(transport->Live() == 0);
+
+    {
+        // Idle expiry: a zero timeout closes every returned session on the next Acquire
+        ConnectionPoolOptions options;
+        options.idleTimeout = std::chrono::seconds(0);
+        ConnectionPool pool(transport, options);
+        int32_t error = 0;
+        { ConnectionPool::Lease a = pool.Acquire(L"dc0", milliseconds(100), error); }
+        check(transport->Live(0) == 1 && pool.Stats().idle == 1);
+        ConnectionPool::Lease b = pool.Acquire(L"dc0", milliseconds(100), error);
+        ConnectionPoolStats s = pool.Stats();
+        check(b && !b.Reused() && s.expired == 1 && s.binds == 2 && transport->Live(0) == 1);
+    }
+    {
+        // ... and Trim closes sessions past a one-second timeout, not younger ones
+        ConnectionPoolOptions options;
+        options.idleTimeout = std::chrono::seconds(1);
+        ConnectionPool pool(transport, options);
+        int32_t error = 0;
+        { ConnectionPool::Lease a = pool.Acquire(L"dc0", milliseconds(100), error); }
+        { ConnectionPool::Lease a = pool.Acquire(L"dc0", milliseconds(100), error); check(a.Reused()); }
+        pool.Trim();
+        check(pool.Stats().idle == 1 && pool.Stats().expired == 0);
+        std::this_thread::sleep_for(milliseconds(1100));
+        pool.Trim();
+        check(pool.Stats().idle == 0 && pool.Stats().expired == 1 && transport->Live(0) == 0);
+    }
+
+    {
+        // Failed health check: a dead idle session is closed and replaced
+        ConnectionPoolOptions options;
+        options.checkAfter = std::chrono::seconds(0);
+        ConnectionPool pool(transport, options);
+        int32_t error = 0;
+        {
+            ConnectionPool::Lease a = pool.Acquire(L"dc2", milliseconds(100), error);
+            a.As<CountingTransport::Session>().dead = true;
+        }
+        const uint64_t checks = transport->m_checks.load();
+        ConnectionPool::Lease b = pool.Acquire(L"dc2", milliseconds(100), error);
+        ConnectionPoolStats s = pool.Stats();
+        check(b && !b.Reused() && !b.As<CountingTransport::Session>().dead && transport->m_checks.load() == checks + 1 &&
+              s.checksFailed == 1 && s.binds == 2 && transport->Live(2) == 1);
+        b = ConnectionPool::Lease();
+        ConnectionPool::Lease c = pool.Acquire(L"dc2", milliseconds(100), error);
+        check(c.Reused() && pool.Stats().checksFailed == 1);
+    }
+
+    {
+        // Lost connection: the failing session, the idle ones and older leases go
+        ConnectionPoolOptions options;
+        options.maxPerDc = 4;
+        ConnectionPool pool(transport, options);
+        int32_t error = 0;
+        ConnectionPool::Lease a = pool.Acquire(L"dc3", milliseconds(100), error);
+        ConnectionPool::Lease b = pool.Acquire(L"dc3", milliseconds(100), error);
+        ConnectionPool::Lease c = pool.Acquire(L"dc3", milliseconds(100), error);
+        ConnectionPool::Lease d = pool.Acquire(L"dc3", milliseconds(100), error);
+        c = ConnectionPool::Lease();
+        d = ConnectionPool::Lease();
+        check(pool.Stats().idle == 2 && transport->Live(3) == 4);
+        b.Fail(CountingTransport::kNoSuchObject);       // not a connection error: kept
+        b = ConnectionPool::Lease();
+        check(pool.Stats().idle == 3 && pool.Stats().evicted == 0);
+        a.Fail(CountingTransport::kLost);
+        a = ConnectionPool::Lease();
+        ConnectionPoolStats s = pool.Stats();
+        check(s.idle == 0 && s.leased == 0 && s.evicted == 4 && transport->Live(3) == 0);
+
+        ConnectionPool::Lease e = pool.Acquire(L"dc3", milliseconds(100), error);
+        ConnectionPool::Lease f = pool.Acquire(L"dc3", milliseconds(100), error);
+        check(e && !e.Reused() && f && !f.Reused());
+        pool.Evict(L"dc3");                         // leased ones are closed when they come back
+        e = ConnectionPool::Lease();
+        check(pool.Stats().idle == 0 && transport->Live(3) == 1);
+        f = ConnectionPool::Lease();
+        check(transport->Live(3) == 0);
+    }
+    check(transport->Live() == 0);
+
+    // Stress: every thread loops over random DCs, one lease in 50 reports a
+    // lost connection, one in 200 Evict()s
+    std::atomic<size_t> inUse[CountingTransport::kDcs] = {};
+    std::atomic<size_t> peak{0};
+    {
+        ConnectionPoolOptions options;
+        options.maxPerDc = 2;
+        ConnectionPool pool(transport, options);
+        std::atomic<uint64_t> acquisitions{0}, timeouts{0};
+        std::atomic<bool> stop{false};
+        std::vector<std::thread> workers;
+        const Clock::time_point start = Clock::now();
+        for (unsigned t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                uint64_t h = seed * 0x9E3779B97F4A7C15ull + 31 + t;
+                auto next = [&]() {
+                    h ^= h << 13; h ^= h >> 7; h ^= h << 17;
+                    return h;
+                };
+                while (!stop.load(std::memory_order_relaxed)) {
+                    const uint64_t roll = next();
+                    const size_t index = roll % CountingTransport::kDcs;
+                    const std::wstring dc = L"dc" + std::to_wstring(index);
+                    int32_t error = 0;
+                    ConnectionPool::Lease lease = pool.Acquire(dc, milliseconds(2000), error);
+                    acquisitions.fetch_add(1, std::memory_order_relaxed);
+                    if (!lease) {
+                        timeouts.fetch_add(1, std::memory_order_relaxed);
+                        continue;
+                    }
+                    const size_t leased = ++inUse[index];
+                    size_t seen = peak.load();
+                    while (leased > seen && !peak.compare_exchange_weak(seen, leased)) {}
+                    if (roll % 7 == 0) std::this_thread::yield();
+                    if ((roll >> 8) % 50 == 0) lease.Fail(CountingTransport::kLost);
+                    if ((roll >> 16) % 200 == 0) pool.Evict(dc);
+                    --inUse[index];
+                }
+            });
+        }
+        std::this_thread::sleep_for(duration);
+        stop = true;
+        for (std::thread& w : workers) w.join();
+        const double elapsed = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+        ConnectionPoolStats s = pool.Stats();
+        result.acquisitions = acquisitions.load();
+        result.binds = s.binds;
+        result.reuses = s.reuses;
+        result.waits = s.waits;
+        result.acquireUs = result.acquisitions ? elapsed * threads / result.acquisitions : 0;
+        check(timeouts.load() == 0 && s.leased == 0 && s.binds + s.reuses == result.acquisitions);
+        check(s.idle <= options.maxPerDc * CountingTransport::kDcs);
+    }
+    result.peakPerDc = peak.load();
+    check(result.peakPerDc <= 2 && transport->Live() == 0);
+    return result;
+}
+
+inline std::string FormatPoolBenchmarkJson(const PoolBenchmarkResult& r) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    auto real = [](double v) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.3f", v);
+        return std::string(text);
+    };
+    return "{\"threads\":" + num(r.threads) + ",\"acquisitions\":" + num(r.acquisitions) + ",\"binds\":" + num(r.binds) +
+           ",\"reuses\":" + num(r.reuses) + ",\"waits\":" + num(r.waits) + ",\"peakPerDc\":" + num(r.peakPerDc) +
+           ",\"acquireUs\":" + real(r.acquireUs) + ",\"mismatches\":" + num(r.mismatches) + "}\n";
+}
+
+struct LoopbackBenchmarkResult {
+    unsigned dcs = 0;                   // DCs in the real collector's batch
+    uint64_t batchBytes = 0;
+    double roundTripMs = 0;             // scan request to the batch kept, best of the requests
+    uint64_t batches = 0;               // kept by the aggregator, all collectors
+    uint64_t duplicates = 0;            // resent batches it dropped
+    size_t dropped = 0;                 // connections it closed on a bad or cut frame
+    size_t mismatches = 0;
+};
+
+// A scan of dcs DCs in 10-DC sites named prefix + index; USNs start at usn
+inline ScanSnapshot LoopbackSnapshot(const std::wstring& prefix, unsigned dcs, uint64_t usn) {
+    ScanSnapshot s;
+    s.generation = 1;
+    s.startedAt = 1714564800000;
+    s.completedAt = s.startedAt + 1000;
+    s.siteCount = (dcs + 9) / 10;
+    s.model.SetEventIds(EventCollectorOptions().eventIds);
+    for (unsigned i = 0; i < dcs; i++) {
+        const DcId id = s.model.AddDc(prefix + L"Site" + std::to_wstring(i / 10), prefix + std::to_wstring(i));
+        DcRecord& r = s.model.records[id];
+        r.status = ProbeStatus::Ok;
+        r.usn = usn + i;
+        r.probedAt = s.startedAt + i;
+        if (i > 0) s.links.push_back({id - 1, id, 900});
+    }
+    s.latency.Resize(s.model.Size());
+    return s;
+}
+
+// Aggregator and collectors over a local socket (a Unix socket on POSIX,
+// TCP loopback on Windows). A real SiteCollector answers scan requests
+// while raw clients drive the aggregator frame by frame:
+//   - a batch sent again with its sequence is acknowledged and dropped, in
+//     the same connection and after a reconnect; a new instance restarts
+//     the numbering;
+//   - a silent collector turns stale after staleAfter and fresh again on a
+//     heartbeat, one that ignores a scan request stays stale until it
+//     answers, one that leaves is stale;
+//   - a peer cut in the middle of a batch, one sending a bad header and one
+//     sending a batch before its hello are dropped without touching the
+//     kept batches, and the other collectors keep being served.
+// The merged forest must hold both collectors' DCs with the kept USNs.
+inline LoopbackBenchmarkResult RunLoopbackBenchmark(unsigned dcs, uint64_t seed) {
+    using Clock = std::chrono::steady_clock;
+    using std::chrono::milliseconds;
+    LoopbackBenchmarkResult result;
+    result.dcs = dcs;
+    auto check = [&](bool ok) {
+        if (!ok) result.mismatches++;
+    };
+
+    SocketEndpoint endpoint;
+#ifdef _WIN32
+    SocketEndpoint::Parse("127.0.0.1:" + std::to_string(49152 + seed % 10000), endpoint);
+#else
+    (void)seed;
+    const std::filesystem::path socketPath =
+        std::filesystem::temp_directory_path() / ("adrc_loopback_" + std::to_string(::getpid()) + ".sock");
+    SocketEndpoint::Parse("unix:" + socketPath.string(), endpoint);
+#endif
+    AggregatorOptions aggregatorOptions;
+    aggregatorOptions.listen = endpoint;
+    aggregatorOptions.staleAfter = milliseconds(300);
+    CollectorAggregator aggregator;
+    if (!aggregator.Start(aggregatorOptions)) {
+        result.mismatches++;
+        return result;
+    }
+
+    // Status of one collector, or an empty one
+    auto status = [&](const std::string& id) {
+        for (const CollectorStatus& s : aggregator.Statuses()) {
+            if (s.id == id) return s;
+        }
+        return CollectorStatus();
+    };
+    auto waitFor = [&](const std::function<bool()>& done) {
+        const Clock::time_point deadline = Clock::now() + milliseconds(5000);
+        while (!done()) {
+            if (Clock::now() >= deadline) return false;
+            std::this_thread::sleep_for(milliseconds(5));
+        }
+        return true;
+    };
+
+    // The real collector
+    const std::string siteFile = EncodeSnapshot(LoopbackSnapshot(L"SITE-", dcs, 1000));
+    result.batchBytes = siteFile.size();
+    SiteCollectorOptions collectorOptions;
+    collectorOptions.aggregator = endpoint;
+    collectorOptions.hello.id = "site";
+    collectorOptions.hello.sites = {"SITE-Site0"};
+    collectorOptions.heartbeat = milliseconds(100);
+    collectorOptions.retryFor = milliseconds(5000);
+    SiteCollector collector(collectorOptions, [&](uint64_t) { return siteFile; });
+    bool collectorBye = false;
+    std::thread collectorThread([&] { collectorBye = collector.Run(); });
+    check(aggregator.WaitForCollectors(1, milliseconds(5000)) == 1);
+
+    // Collectors that answered a new request; waits for the connected
+    // ones, so a raw client that never answers costs the whole timeout
+    auto request = [&](milliseconds timeout) {
+        return aggregator.WaitForBatches(aggregator.RequestScan(), timeout);
+    };
+    for (int i = 0; i < 5; i++) {
+        const Clock::time_point start = Clock::now();
+        check(request(milliseconds(5000)) == 1);
+        const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        if (i == 0 || ms < result.roundTripMs) result.roundTripMs = ms;
+    }
+    check(status("site").batches == 5 && status("site").dcs == dcs);
+
+    // A client speaking the protocol by hand
+    struct RawClient {
+        SocketStream socket;
+        bool Open(const SocketEndpoint& at, const std::string& id, uint64_t instance) {
+            if (!socket.Connect(at, std::chrono::milliseconds(2000))) return false;
+            CollectorHello hello;
+            hello.id = id;
+            hello.instance = instance;
+            hello.sites = {id};
+            return SendFrame(socket, FrameType::Hello, 0, EncodeHello(hello));
+        }
+        bool Batch(uint64_t sequence, uint64_t request, const std::string& file) {
+            PayloadWriter w;
+            w.U64(request);
+            w.Bytes(file);
+            return SendFrame(socket, FrameType::Batch, sequence, w.Data());
+        }
+        // The next Ack, skipping scan requests; 0 when none came
+        uint64_t Ack() {
+            Frame frame;
+            while (ReceiveFrame(socket, frame, std::chrono::milliseconds(2000))) {
+                if (frame.type == FrameType::Ack) return frame.sequence;
+            }
+            return 0;
+        }
+        // True once the peer closed the connection
+        bool Dropped() {
+            Frame frame;
+            for (int i = 0; i < 100; i++) {
+                if (!socket.Readable(std::chrono::milliseconds(50))) continue;
+                if (!ReceiveFrame(socket, frame, std::chrono::milliseconds(50))) return socket.Closed();
+            }
+            return false;
+        }
+    };
+    auto rawFile = [&](uint64_t usn) { return EncodeSnapshot(LoopbackSnapshot(L"RAW-", 3, usn)); };
+    const uint64_t answer = status("site").requestId;      // raw joins late, its batches answer this
+
+    // Duplicates: same connection, reconnect, new instance
+    {
+        RawClient raw;
+        check(raw.Open(endpoint, "raw", 7));
+        check(raw.Batch(1, answer, rawFile(100)) && raw.Ack() == 1);
+        check(raw.Batch(1, answer, rawFile(200)) && raw.Ack() == 1);
+        CollectorStatus s = status("raw");
+        check(s.batches == 1 && s.duplicates == 1 && s.lastSequence == 1);
+        check(raw.Batch(2, answer, rawFile(300)) && raw.Ack() == 2);
+    }
+    check(waitFor([&] { return !status("raw").connected; }));
+    {
+        RawClient raw;
+        check(raw.Open(endpoint, "raw", 7));
+        check(raw.Batch(2, answer, rawFile(400)) && raw.Ack() == 2);
+        CollectorStatus s = status("raw");
+        check(s.connected && s.batches == 2 && s.duplicates == 2 && s.lastSequence == 2);
+    }
+    check(waitFor([&] { return !status("raw").connected; }));
+    RawClient raw;
+    check(raw.Open(endpoint, "raw", 8));                // restarted: numbering starts over
+    check(raw.Batch(1, answer, rawFile(500)) && raw.Ack() == 1);
+    {
+        CollectorStatus s = status("raw");
+        check(s.instance == 8 && s.batches == 3 && s.duplicates == 2 && s.lastSequence == 1);
+    }
+    std::shared_ptr<ScanSnapshot> merged = aggregator.Merge();
+    {
+        const DcId site0 = merged ? merged->model.dcs.Find(L"SITE-0") : kInvalidId;
+        const DcId raw0 = merged ? merged->model.dcs.Find(L"RAW-0") : kInvalidId;
+        check(merged && merged->model.Size() == dcs + 3 && site0 != kInvalidId && raw0 != kInvalidId &&
+              merged->model.records[site0].usn == 1000 && merged->model.records[raw0].usn == 500);
+    }
+
+    // Stale: silence, a heartbeat, an unanswered request, a departure
+    check(waitFor([&] { CollectorStatus s = status("raw"); return s.connected && s.stale; }));
+    check(!status("site").stale);                   // heartbeats every 100 ms
+    check(SendFrame(raw.socket, FrameType::Heartbeat, 0));
+    check(waitFor([&] { return !status("raw").stale; }));
+    check(request(milliseconds(300)) == 1);         // site answers, raw does not
+    check(status("raw").stale && !status("site").stale);
+    check(raw.Batch(2, status("site").requestId, rawFile(600)) && raw.Ack() == 2);
+    check(!status("raw").stale);
+    raw.socket.Close();
+    check(waitFor([&] { CollectorStatus s = status("raw"); return !s.connected && s.stale; }));
+    check(raw.Open(endpoint, "raw", 8));
+
+    // Dropped connections: cut mid-batch, bad header, batch before hello
+    const uint64_t kept = status("raw").batches;
+    {
+        RawClient cut;
+        check(cut.Open(endpoint, "cut", 9));
+        check(waitFor([&] { return status("cut").connected; }));
+        PayloadWriter w;
+        w.U64(0);
+        w.Bytes(rawFile(700));
+        FrameHeader header;
+        std::memset(&header, 0, sizeof(header));
+        header.length = static_cast<uint32_t>(w.Data().size());
+        header.type = static_cast<uint8_t>(FrameType::Batch);
+        header.version = kProtocolVersion;
+        header.sequence = 1;
+        check(cut.socket.SendAll(&header, sizeof(header)) && cut.socket.SendAll(w.Data().data(), w.Data().size() / 2));
+        cut.socket.Close();
+        check(waitFor([&] { return !status("cut").connected; }));
+        CollectorStatus s = status("cut");
+        check(s.batches == 0 && s.lastSequence == 0);
+        result.dropped++;
+    }
+    {
+        RawClient bad;
+        check(bad.Open(endpoint, "bad", 10));
+        check(waitFor([&] { return status("bad").connected; }));
+        FrameHeader header;
+        std::memset(&header, 0, sizeof(header));
+        header.type = static_cast<uint8_t>(FrameType::Heartbeat);
+        header.version = kProtocolVersion + 1;
+        check(bad.socket.SendAll(&header, sizeof(header)) && bad.Dropped());
+        check(waitFor([&] { return !status("bad").connected; }));
+        result.dropped++;
+    }
+    {
+        RawClient early;
+        check(early.socket.Connect(endpoint, milliseconds(2000)));
+        check(early.Batch(1, 0, rawFile(800)) && early.Dropped());
+        result.dropped++;
+    }
+    check(waitFor([&] { CollectorStatus s = status("raw"); return s.connected && s.batches == kept; }));
+    check(request(milliseconds(300)) == 1 && status("site").batches == 7);
+    merged = aggregator.Merge();
+    {
+        const DcId raw0 = merged ? merged->model.dcs.Find(L"RAW-0") : kInvalidId;
+        check(merged && merged->model.Size() == dcs + 3 && raw0 != kInvalidId && merged->model.records[raw0].usn == 600);
+    }
+
+    aggregator.SendBye();
+    collectorThread.join();
+    check(collectorBye && collector.BatchesSent() == 7);
+    raw.socket.Close();
+    for (const CollectorStatus& s : aggregator.Statuses()) {
+        result.batches += s.batches;
+        result.duplicates += s.duplicates;
+    }
+    aggregator.Stop();
+    return result;
+}
+
+inline std::string FormatLoopbackBenchmarkJson(const LoopbackBenchmarkResult& r) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    auto real = [](double v) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.3f", v);
+        return std::string(text);
+    };
+    return "{\"dcs\":" + num(r.dcs) + ",\"batchBytes\":" + num(r.batchBytes) + ",\"roundTripMs\":" + real(r.roundTripMs) +
+           ",\"batches\":" + num(r.batches) + ",\"duplicates\":" + num(r.duplicates) + ",\"dropped\":" + num(r.dropped) +
+           ",\"mismatches\":" + num(r.mismatches) + "}\n";
+}
+
+struct PollBenchmarkResult {
+    unsigned dcs = 0;
+    unsigned scans = 0;                 // full scans run while another thread reads TopologyGeneration()
+    uint64_t reads = 0;                 // TopologyGeneration() calls during them
+    size_t badReads = 0;                // 0 after the first scan, going back, or no scan's generation
+    size_t polls = 0;                   // Poll() calls that published
+    size_t refused = 0;                 // Poll() calls refused on a foreign snapshot
+    double scanMs = 0;
+    double pollMs = 0;
+    size_t mismatches = 0;
+};
+
+// The poll context ScanEngine keeps between Run() and Poll(). Full scans
+// of a generated forest run while another thread reads
+// TopologyGeneration(), as the GUI's monitor does after a scan: every read
+// after the first scan must be the generation of a scan that has already
+// started publishing, never 0, never older than the previous read. Then
+// polls on the engine's own snapshots must publish; a copy published by
+// someone else (a reloaded file) must make Poll() refuse and drop the
+// context, until the next full scan brings polling back.
+inline PollBenchmarkResult RunPollBenchmark(unsigned dcs, uint64_t seed) {
+    using Clock = std::chrono::steady_clock;
+    auto millis = [](Clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(d).count() / 1000.0;
+    };
+    PollBenchmarkResult result;
+    result.dcs = dcs;
+    result.scans = 4;
+
+    ForestSpec spec;
+    spec.seed = seed;
+    spec.dcs = dcs;
+    spec.sites = std::max(1u, dcs / 10);
+    spec.localRtt = std::chrono::milliseconds(0);
+    spec.remoteRtt = std::chrono::milliseconds(0);
+    ForestSimulator forest(spec);
+    ScanEngine engine(forest.Backend(), nullptr, ProbeOptions());
+    SnapshotPublisher publisher;
+
+    // Generations Run() is about to publish, so a read can be checked
+    // against them: a read may see a scan before Run() returns
+    std::mutex scansMutex;
+    std::vector<uint64_t> started;
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> reads{0};
+    std::atomic<size_t> badReads{0};
+    std::thread reader([&] {
+        uint64_t last = 0, n = 0;
+        size_t bad = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+            const uint64_t g = engine.TopologyGeneration();
+            n++;
+            if (g < last) bad++;
+            if (g != last) {
+                std::lock_guard<std::mutex> lock(scansMutex);
+                // Run() numbers its snapshot before publishing it, so the
+                // next generation is allowed too
+                const uint64_t next = started.empty() ? 1 : started.back() + 1;
+                if (g != next && std::find(started.begin(), started.end(), g) == started.end()) bad++;
+            }
+            last = g;
+        }
+        reads = n;
+        badReads = bad;
+    });
+
+    Clock::time_point t0 = Clock::now();
+    uint64_t generation = 0;
+    for (unsigned k = 0; k < result.scans; k++) {
+        SnapshotPtr snapshot = engine.Run(publisher, forest.ConfigurationDn());
+        if (!snapshot || snapshot->model.Size() != dcs) {
+            result.mismatches++;
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(scansMutex);
+            started.push_back(snapshot->generation);
+        }
+        if (snapshot->generation <= generation || engine.TopologyGeneration() != snapshot->generation) result.mismatches++;
+        generation = snapshot->generation;
+    }
+    stop = true;
+    reader.join();
+    result.scanMs = millis(Clock::now() - t0);
+    result.reads = reads;
+    result.badReads = badReads;
+    result.mismatches += result.badReads;
+
+    // Polls build on the engine's own snapshots, full scan or poll
+    std::vector<DcId> due;
+    for (DcId id = 0; id < dcs; id += 7) due.push_back(id);
+    t0 = Clock::now();
+    for (int k = 0; k < 2; k++) {
+        SnapshotPtr polled = engine.Poll(publisher, due);
+        if (!polled || polled->polled != due || publisher.Current() != polled || engine.TopologyGeneration() != generation) {
+            result.mismatches++;
+        } else {
+            result.polls++;
+        }
+    }
+    result.pollMs = millis(Clock::now() - t0);
+
+    // A foreign snapshot with the same DCs: refused, and the context stays
+    // dropped until a full scan
+    publisher.Publish(std::make_shared<ScanSnapshot>(*publisher.Current()));
+    for (int k = 0; k < 2; k++) {
+        if (engine.Poll(publisher, due)) {
+            result.mismatches++;
+        } else {
+            result.refused++;
+        }
+        if (engine.TopologyGeneration() != 0) result.mismatches++;
+    }
+    SnapshotPtr rescan = engine.Run(publisher, forest.ConfigurationDn());
+    if (!rescan || engine.TopologyGeneration() != rescan->generation) result.mismatches++;
+    SnapshotPtr polled = engine.Poll(publisher, due);
+    if (!polled || polled->polled != due) {
+        result.mismatches++;
+    } else {
+        result.polls++;
+    }
+    return result;
+}
+
+inline std::string FormatPollBenchmarkJson(const PollBenchmarkResult& r) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    auto real = [](double v) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.2f", v);
+        return std::string(text);
+    };
+    return "{\"dcs\":" + num(r.dcs) + ",\"scans\":" + num(r.scans) + ",\"reads\":" + num(r.reads) +
+           ",\"badReads\":" + num(r.badReads) + ",\"polls\":" + num(r.polls) + ",\"refused\":" + num(r.refused) +
+           ",\"scanMs\":" + real(r.scanMs) + ",\"pollMs\":" + real(r.pollMs) +
+           ",\"mismatches\":" + num(r.mismatches) + "}\n";
+}
+
+// One NDJSON line per benchmark scan
+inline std::string FormatBenchmarkJson(const BenchmarkResult& r) {
+    auto num = [](int64_t v) { return std::to_string(v); };
+    char perDc[32];
+    std::snprintf(perDc, sizeof(perDc), "%.1f", r.allocationsPerDc);
+    return "{\"scan\":" + num(r.scan) + ",\"dcs\":" + num(r.dcs) + ",\"sites\":" + num(r.sites) + ",\"domains\":" + num((int64_t)r.domains) +
+           ",\"connections\":" + num((int64_t)r.connections) + ",\"reachable\":" + num((int64_t)r.reachable) +
+           ",\"health\":\"" + HealthStatusName(r.health) + "\",\"generateMs\":" + num(r.generateMs) +
+           ",\"wallMs\":" + num(r.wallMs) + ",\"firstRowMs\":" + num(r.firstRowMs) +
+           ",\"discoveryMs\":" + num(r.discoveryMs) + ",\"probeMs\":" + num(r.probeMs) +
+           ",\"replicaMs\":" + num(r.replicaMs) + ",\"analysisMs\":" + num(r.analysisMs) +
+           ",\"peakRssKb\":" + num((int64_t)r.peakRssKb) + ",\"allocations\":" + num((int64_t)r.allocations) +
+           ",\"allocationsPerDc\":" + perDc + ",\"binds\":" + num((int64_t)r.binds) + "}\n";
+}
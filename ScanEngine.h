@@ -0,0 +1,391 @@
+// ScanEngine.h
+// Déroulement d'un scan complet sans interface : découverte, sondage USN, métadonnées de réplication, événements
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "AsyncLogger.h"
+#include "CancellationToken.h"
+#include "DirectoryBackend.h"
+#include "DistinguishedName.h"
+#include "EventCollector.h"
+#include "LatencyMatrix.h"
+#include "ProbeEngine.h"
+#include "ReplicationModel.h"
+#include "ScanMetrics.h"
+#include "ScanSnapshot.h"
+#include "TopologyDiscovery.h"
+#include "TopologyGraph.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class ScanPhase : uint8_t {
+    Discovery,
+    Probing,
+    ReplicaMetadata,
+    Events
+};
+
+// The configuration NC from the default DC's rootDSE. When the rootDSE
+// cannot be read, domainDn (if given) supplies the domain DN to derive it.
+inline std::wstring ResolveConfigurationDn(IDirectoryBackend& backend, std::chrono::milliseconds timeout,
+                                           const std::function<std::wstring()>& domainDn = nullptr) {
+    RootDseReply rootDse = backend.ReadRootDse(L"", timeout);
+    if (rootDse.status == ProbeStatus::Ok && !rootDse.configurationNamingContext.empty()) {
+        return rootDse.configurationNamingContext;
+    }
+    std::wstring domain = domainDn ? domainDn() : std::wstring();
+    return domain.empty() ? L"" : ChildDn(L"CN", L"Configuration", domain);
+}
+
+// Site names compare case-insensitively (ASCII); an empty scope holds every site
+inline bool SiteInScope(const std::vector<std::wstring>& scope, const std::wstring& site) {
+    if (scope.empty()) return true;
+    auto lower = [](wchar_t c) { return c >= L'A' && c <= L'Z' ? static_cast<wchar_t>(c - L'A' + L'a') : c; };
+    for (const std::wstring& s : scope) {
+        if (s.size() == site.size() &&
+            std::equal(s.begin(), s.end(), site.begin(), [&](wchar_t x, wchar_t y) { return lower(x) == lower(y); })) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Runs one scan end to end on the calling thread: topology discovery,
+// concurrent rootDSE probes, replica metadata of every DC that answered,
+// then event collection. The scan is built in a private snapshot, rows are
+// streamed to the publisher's subscribers as they fill in (lag classes
+// included, kept current by a LagTracker), and the finished snapshot is
+// published atomically. A cancelled token or the scan deadline ends the
+// scan early: what was read is published, marked cancelled. No UI: front
+// ends observe the phases and subscribe to the publisher.
+class ScanEngine {
+public:
+    using PhaseCallback = std::function<void(ScanPhase)>;
+
+    // events may be null: the event phase is then skipped and every DC
+    // keeps EventState::Unknown
+    ScanEngine(std::shared_ptr<IDirectoryBackend> backend, std::shared_ptr<EventCollector> events,
+               ProbeOptions options, AsyncLogger* logger = nullptr)
+        : m_backend(std::move(backend)), m_events(std::move(events)), m_options(options), m_logger(logger) {}
+
+    const ProbeOptions& Options() const { return m_options; }
+
+    // Site-local collectors: only the DCs of these sites (case-insensitive
+    // names) are probed and read; the others stay in the model as never
+    // probed (ProbeStatus::Cancelled), links included. Empty: every site.
+    void SetSiteScope(std::vector<std::wstring> sites) { m_siteScope = std::move(sites); }
+    const std::vector<std::wstring>& SiteScope() const { return m_siteScope; }
+
+    // ResolveConfigurationDn on the engine's backend, timed as part of the
+    // next Run(): DC location and the locator rootDSE read
+    std::wstring ResolveConfigurationDn(const std::function<std::wstring()>& domainDn = nullptr) {
+        if (!m_nextMetrics) m_nextMetrics = std::make_shared<ScanMetrics>();
+        MetricsScope scope(m_nextMetrics.get());
+        return ::ResolveConfigurationDn(*m_backend, m_options.dcTimeout, domainDn);
+    }
+
+    // Returns the published snapshot, or null when discovery found no site.
+    // cancel, polled by every phase, is honoured within ProbeEngine::kCancelPoll
+    // while probing and after the reads in flight otherwise.
+    SnapshotPtr Run(SnapshotPublisher& publisher, const std::wstring& configDn, const PhaseCallback& onPhase = nullptr,
+                    const CancellationToken* cancel = nullptr) {
+        const CancellationToken token(cancel, CancellationToken::Clock::now() + m_options.scanDeadline);
+        auto phase = [&](ScanPhase p) { if (onPhase) onPhase(p); };
+        std::shared_ptr<ScanMetrics> metrics = std::move(m_nextMetrics);
+        if (!metrics) metrics = std::make_shared<ScanMetrics>();
+        MetricsScope scope(metrics.get());
+
+        // One paged subtree search returns sites, servers, NTDS Settings and connections
+        phase(ScanPhase::Discovery);
+        ForestTopology topology;
+        if (!configDn.empty()) DiscoverTopology(*m_backend, configDn, topology);
+        const std::vector<SiteInfo>& sites = topology.sites;
+        if (sites.empty()) {
+            Log(LogLevel::Warning, L"Aucun site AD détecté", {{"config", configDn}});
+            return nullptr;
+        }
+
+        auto working = std::make_shared<ScanSnapshot>();
+        working->generation = ++m_generation;
+        working->metrics = metrics;
+        working->startedAt = UnixNowMs();
+        working->siteCount = sites.size();
+        ReplicationModel& model = working->model;
+        model.SetEventIds(m_events ? m_events->Options().eventIds : std::vector<uint32_t>());
+
+        // Probe targets are DCs in model order, so target index == DcId
+        std::vector<ProbeTarget> targets;
+        std::vector<const ServerInfo*> dcServers;
+        std::vector<DcId> dcOfServer(topology.servers.size(), kInvalidId);
+        DsaIndex dsas;
+        for (size_t i = 0; i < topology.servers.size(); i++) {
+            const ServerInfo& server = topology.servers[i];
+            if (!server.IsDc()) continue;
+            DcId id = model.AddDc(sites[server.site].name, server.name);
+            model.records[id].invocation = InvocationKey(server.invocationId);
+            dcOfServer[i] = id;
+            if (id == targets.size()) {
+                targets.push_back({server.HostName(), server.site});
+                dcServers.push_back(&server);
+                dsas.Add(id, server);
+            }
+        }
+        working->links = BuildReplicationLinks(topology, dcOfServer);
+        std::vector<uint32_t> siteOfDc(model.Size());
+        for (DcId id = 0; id < model.Size(); id++) siteOfDc[id] = model.records[id].site;
+        metrics->SetDcs(siteOfDc);
+        working->latency.Resize(model.Size());
+        for (const ServerInfo* server : dcServers) {
+            for (const auto& nc : server->masterNCs) working->latency.InternNc(nc);
+        }
+
+        auto pollContext = std::make_shared<PollContext>();
+        pollContext->targets = targets;
+        for (const ServerInfo* server : dcServers) pollContext->namingContexts.push_back(server->masterNCs);
+        pollContext->dsas = dsas;
+
+        // DCs probed by this scan, all of them unless scoped to some sites
+        std::vector<DcId> scoped;
+        std::vector<ProbeTarget> scopedTargets;
+        for (DcId id = 0; id < targets.size(); id++) {
+            if (!SiteInScope(m_siteScope, sites[targets[id].site].name)) continue;
+            scoped.push_back(id);
+            scopedTargets.push_back(targets[id]);
+        }
+
+        SnapshotPtr topologySnapshot = std::make_shared<const ScanSnapshot>(*working);
+        publisher.NotifyStarted(topologySnapshot);
+        RowBatcher batcher(publisher, topologySnapshot);
+
+        // A row goes out with every row whose lag class it changed
+        LagTracker lag;
+        std::vector<DcId> reclassified;
+        auto emit = [&](DcId id) {
+            reclassified.clear();
+            lag.Update(model, id, reclassified);
+            batcher.Add(model, id);
+            for (DcId other : reclassified) batcher.Add(model, other);
+        };
+
+        phase(ScanPhase::Probing);
+        ProbeEngine engine(m_backend, m_options, metrics);
+        engine.Run(scopedTargets, [&](size_t index, const ProbeOutcome& outcome) {
+            DcId id = scoped[index];
+            DcRecord& r = model.records[id];
+            r.status = outcome.reply.status;
+            r.usn = outcome.reply.highestCommittedUSN;
+            r.probeMs = (uint32_t)outcome.elapsed.count();
+            if (r.status != ProbeStatus::Cancelled) r.probedAt = UnixNowMs();
+            if (r.status == ProbeStatus::Timeout) {
+                Log(LogLevel::Warning, L"Délai dépassé", {{"dc", model.DcName(id)}, {"ms", r.probeMs}});
+            }
+            emit(id);
+        }, &token);
+        batcher.Flush();
+
+        // Inbound partners and up-to-dateness vectors of every DC that answered
+        if (!token.Cancelled()) {
+            phase(ScanPhase::ReplicaMetadata);
+            std::vector<ReplicaTarget> replicaTargets;
+            for (DcId id = 0; id < model.Size(); id++) {
+                if (model.records[id].HasUsn()) replicaTargets.push_back({id, targets[id].dc, dcServers[id]->masterNCs});
+            }
+            CollectReplicaStates(*m_backend, replicaTargets, dsas, working->latency, m_options.workers,
+                                 [&](DcId id, bool ok) {
+            DcRecord& r = model.records[id];
+            if (ok) {
+                ReplicationSummary summary = working->latency.Summarize(id);
+                r.partners = summary.partners;
+                r.failingPartners = summary.failingPartners;
+                r.lastReplication = summary.lastSuccess;
+                if (summary.worstLatencyMs >= 0) r.latencySec = (uint32_t)std::min<int64_t>(summary.worstLatencyMs / 1000, kUnknownLatency - 1);
+            } else {
+                Log(LogLevel::Warning, L"Métadonnées de réplication indisponibles", {{"dc", model.DcName(id)}});
+            }
+            emit(id);
+            }, metrics.get(), &token);
+            batcher.Flush();
+        }
+
+        // Replication events, once per DC and in parallel
+        if (m_events && !token.Cancelled()) {
+            phase(ScanPhase::Events);
+            std::vector<std::wstring> hosts;
+            for (const auto& target : scopedTargets) hosts.push_back(target.dc);
+            auto replicationErrors = std::make_shared<ReplicationErrorTable>();
+            m_events->Collect(hosts, metrics.get(), [&](size_t i, const DcEventCounts& events) {
+                const DcId id = scoped[i];
+                DcRecord& r = model.records[id];
+                r.events = events.ok ? EventState::Ok : EventState::Unavailable;
+                uint32_t* counts = model.EventCountsOf(id);
+                for (size_t k = 0; k < events.totals.size() && k < model.eventIds.size(); k++) {
+                    counts[k] = (uint32_t)events.totals[k];
+                    r.errorTotal += counts[k];
+                }
+                replicationErrors->Merge(events.errors);
+                batcher.Add(model, id);
+            }, &token);
+            working->replicationErrors = replicationErrors;
+            batcher.Flush();
+        }
+
+        // Lag classes were kept current row by row: latency when measured, USN spread otherwise
+        working->spread = lag.Spread();
+        working->cancelled = token.Cancelled();
+        if (working->cancelled) {
+            Log(LogLevel::Warning, token.CancelRequested() ? L"Scan annulé" : L"Échéance du scan atteinte");
+        }
+        working->completedAt = UnixNowMs();
+        pollContext->scan = working->generation;
+        {
+            std::lock_guard<std::mutex> lock(m_pollMutex);
+            m_pollContext = pollContext;
+            m_pollBase = working;
+        }
+        publisher.Complete(working);
+
+        Log(LogLevel::Info, L"Scan terminé",
+            {{"sites", sites.size()}, {"dcs", model.Size()}, {"ms", working->completedAt - working->startedAt}});
+        LogMetrics(*metrics, model);
+        return working;
+    }
+
+    // Generation of the last full scan, the one Poll() builds on; 0 before,
+    // or once Poll() found a foreign snapshot. Any thread, even during Run().
+    uint64_t TopologyGeneration() const {
+        std::lock_guard<std::mutex> lock(m_pollMutex);
+        return m_pollContext ? m_pollContext->scan : 0;
+    }
+
+    // Re-polls some DCs of the last full scan: rootDSE, then the replica
+    // metadata of those that answered. The result is published as a new
+    // snapshot sharing the other DCs' rows with the current one; event
+    // counts are left as they were. Returns null when nothing was scanned
+    // yet, or when the current snapshot is not one this engine published
+    // (a reloaded snapshot, an imported dump): its DcIds need not match the
+    // discovery, so the poll context is dropped and TopologyGeneration()
+    // asks for a full scan. Same thread as Run().
+    SnapshotPtr Poll(SnapshotPublisher& publisher, std::vector<DcId> dcs) {
+        SnapshotPtr base = publisher.Current();
+        std::shared_ptr<const PollContext> context;
+        {
+            std::lock_guard<std::mutex> lock(m_pollMutex);
+            context = m_pollContext;
+            if (!base || !context) return nullptr;
+            if (base != m_pollBase.lock() || base->model.Size() != context->targets.size()) {
+                m_pollContext.reset();
+                context.reset();
+            }
+        }
+        if (!context) {
+            Log(LogLevel::Warning, L"Snapshot courant étranger au scan, nouveau scan requis", {{"generation", base->generation}});
+            return nullptr;
+        }
+
+        auto metrics = std::make_shared<ScanMetrics>();
+        MetricsScope scope(metrics.get());
+        auto working = std::make_shared<ScanSnapshot>(*base);
+        working->generation = ++m_generation;
+        working->metrics = metrics;
+        working->startedAt = UnixNowMs();
+        ReplicationModel& model = working->model;
+        std::vector<uint32_t> siteOfDc(model.Size());
+        for (DcId id = 0; id < model.Size(); id++) siteOfDc[id] = model.records[id].site;
+        metrics->SetDcs(siteOfDc);
+
+        std::sort(dcs.begin(), dcs.end());
+        dcs.erase(std::unique(dcs.begin(), dcs.end()), dcs.end());
+        dcs.erase(std::lower_bound(dcs.begin(), dcs.end(), static_cast<DcId>(model.Size())), dcs.end());
+        working->polled = dcs;
+
+        // Probe timings would be recorded under the target index, not the
+        // DcId, so probes go untimed here
+        std::vector<ProbeTarget> targets;
+        for (DcId id : dcs) targets.push_back(context->targets[id]);
+        ProbeEngine engine(m_backend, m_options);
+        engine.Run(targets, [&](size_t index, const ProbeOutcome& outcome) {
+            DcRecord& r = model.records[dcs[index]];
+            r.status = outcome.reply.status;
+            r.usn = outcome.reply.highestCommittedUSN;
+            r.probeMs = (uint32_t)outcome.elapsed.count();
+            r.probedAt = UnixNowMs();
+            if (!r.HasUsn()) {
+                r.partners = r.failingPartners = 0;
+                r.latencySec = kUnknownLatency;
+            }
+        });
+
+        std::vector<ReplicaTarget> replicaTargets;
+        for (DcId id : dcs) {
+            if (model.records[id].HasUsn()) replicaTargets.push_back({id, context->targets[id].dc, context->namingContexts[id]});
+        }
+        CollectReplicaStates(*m_backend, replicaTargets, context->dsas, working->latency, m_options.workers,
+                             [&](DcId id, bool ok) {
+            if (!ok) return;
+            DcRecord& r = model.records[id];
+            ReplicationSummary summary = working->latency.Summarize(id);
+            r.partners = summary.partners;
+            r.failingPartners = summary.failingPartners;
+            r.lastReplication = summary.lastSuccess;
+            r.latencySec = summary.worstLatencyMs >= 0
+                ? (uint32_t)std::min<int64_t>(summary.worstLatencyMs / 1000, kUnknownLatency - 1) : kUnknownLatency;
+        }, metrics.get());
+
+        working->spread = ClassifyLag(model);
+        working->completedAt = UnixNowMs();
+        {
+            std::lock_guard<std::mutex> lock(m_pollMutex);
+            m_pollBase = working;
+        }
+        publisher.Complete(working);
+        return working;
+    }
+
+private:
+    // What Poll() needs from the last full scan's discovery, indexed by DcId
+    struct PollContext {
+        uint64_t scan = 0;
+        std::vector<ProbeTarget> targets;
+        std::vector<std::vector<std::wstring>> namingContexts;
+        DsaIndex dsas;
+    };
+
+    // p50/p99/max per phase, then the slowest DCs
+    void LogMetrics(const ScanMetrics& metrics, const ReplicationModel& model) {
+        if (!m_logger) return;
+        for (size_t p = 0; p < kMetricPhases; p++) {
+            PhaseSummary s = metrics.Summarize(static_cast<MetricPhase>(p));
+            if (s.count == 0) continue;
+            Log(LogLevel::Info, L"Phase", {{"phase", MetricPhaseName(s.phase)}, {"n", s.count},
+                {"p50us", s.p50Us}, {"p99us", s.p99Us}, {"maxus", s.maxUs}});
+        }
+        for (const DcTiming& t : metrics.SlowestDcs(10)) {
+            if (t.totalUs == 0) break;
+            Log(LogLevel::Info, L"DC lent", {{"dc", model.DcName(t.dc)}, {"us", t.totalUs}});
+        }
+    }
+
+    void Log(LogLevel level, const std::wstring& message, std::initializer_list<LogField> fields = {}) {
+        if (m_logger) m_logger->Log(level, message, fields);
+    }
+
+    std::shared_ptr<IDirectoryBackend> m_backend;
+    std::shared_ptr<EventCollector> m_events;
+    ProbeOptions m_options;
+    AsyncLogger* m_logger;
+    std::atomic<uint64_t> m_generation{0};
+    std::shared_ptr<ScanMetrics> m_nextMetrics;     // opened by ResolveConfigurationDn, taken by Run
+    mutable std::mutex m_pollMutex;                 // m_pollContext and m_pollBase: TopologyGeneration() may race Run()
+    std::shared_ptr<const PollContext> m_pollContext;
+    std::weak_ptr<const ScanSnapshot> m_pollBase;   // last snapshot Run() or Poll() published
+    std::vector<std::wstring> m_siteScope;
+};
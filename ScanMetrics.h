@@ -0,0 +1,294 @@
+// ScanMetrics.h
+// Instrumentation des phases du scan : minuteurs par portée, histogrammes de latence sans verrou par DC et par site
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+// Where the time of a scan goes, one entry per blocking call type
+enum class MetricPhase : uint8_t {
+    DcLocate,                           // DC locator: DsGetDcNameW, serverless rootDSE bind
+    Bind,                               // ADsOpenObject / DsBindW / EvtOpenSession to a named DC
+    RootDseRead,                        // rootDSE attribute reads once bound
+    Search,                             // container enumeration (paged subtree search)
+    ReplicaMetadata,                    // DsReplicaGetInfo neighbors and cursors
+    EventQuery                          // EvtQuery and the record loop
+};
+
+const size_t kMetricPhases = 6;
+
+inline const char* MetricPhaseName(MetricPhase phase) {
+    switch (phase) {
+        case MetricPhase::DcLocate:        return "dc_locate";
+        case MetricPhase::Bind:            return "bind";
+        case MetricPhase::RootDseRead:     return "rootdse_read";
+        case MetricPhase::Search:          return "search";
+        case MetricPhase::ReplicaMetadata: return "replica_metadata";
+        default:                           return "event_query";
+    }
+}
+
+// HDR-style log-linear histogram of microsecond values: exact below 64 us,
+// then 32 sub-buckets per power of two (relative error under 3.2%), up to
+// about 19 hours. Recording is a handful of relaxed atomic operations, so
+// any number of threads can record while another reads.
+class LatencyHistogram {
+public:
+    static constexpr unsigned kSubBits = 6;
+    static constexpr uint64_t kLinear = 1ull << kSubBits;           // exact values below this
+    static constexpr uint64_t kHalf = kLinear / 2;                  // sub-buckets per octave above
+    static constexpr unsigned kOctaves = 30;
+    static constexpr size_t kBuckets = kLinear + kOctaves * kHalf;
+    static constexpr uint64_t kMaxValue = (kLinear << kOctaves) - 1;
+
+    void Record(uint64_t micros) {
+        m_counts[BucketIndex(micros)].fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(micros, std::memory_order_relaxed);
+        uint64_t max = m_max.load(std::memory_order_relaxed);
+        while (micros > max && !m_max.compare_exchange_weak(max, micros, std::memory_order_relaxed)) {}
+    }
+
+    uint64_t Count() const {
+        uint64_t n = 0;
+        for (const auto& c : m_counts) n += c.load(std::memory_order_relaxed);
+        return n;
+    }
+
+    uint64_t SumMicros() const { return m_sum.load(std::memory_order_relaxed); }
+    uint64_t MaxMicros() const { return m_max.load(std::memory_order_relaxed); }
+
+    // Highest value equivalent to the sample at rank ceil(q * count), capped
+    // by the recorded maximum; 0 when empty
+    uint64_t ValueAtQuantile(double q) const {
+        uint64_t counts[kBuckets];
+        uint64_t total = 0;
+        for (size_t i = 0; i < kBuckets; i++) total += (counts[i] = m_counts[i].load(std::memory_order_relaxed));
+        if (total == 0) return 0;
+
+        q = std::min(1.0, std::max(0.0, q));
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * static_cast<double>(total) + 0.999999));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; i++) {
+            seen += counts[i];
+            if (seen >= rank) return std::min(BucketUpper(i), MaxMicros());
+        }
+        return MaxMicros();
+    }
+
+    // Samples whose whole bucket lies at or below micros: a cumulative
+    // Prometheus bucket never counts a value above its bound
+    uint64_t CountAtOrBelow(uint64_t micros) const {
+        uint64_t n = 0;
+        for (size_t i = 0; i < kBuckets && BucketUpper(i) <= micros; i++) n += m_counts[i].load(std::memory_order_relaxed);
+        return n;
+    }
+
+    static size_t BucketIndex(uint64_t v) {
+        if (v < kLinear) return static_cast<size_t>(v);
+        v = std::min(v, kMaxValue);
+        unsigned shift = BitLength(v) - kSubBits;               // >= 1
+        return static_cast<size_t>(kLinear + (shift - 1) * kHalf + ((v >> shift) - kHalf));
+    }
+
+    static uint64_t BucketLower(size_t index) {
+        if (index < kLinear) return index;
+        unsigned shift = static_cast<unsigned>((index - kLinear) / kHalf) + 1;
+        return (kHalf + (index - kLinear) % kHalf) << shift;
+    }
+
+    static uint64_t BucketUpper(size_t index) {
+        if (index < kLinear) return index;
+        unsigned shift = static_cast<unsigned>((index - kLinear) / kHalf) + 1;
+        return ((kHalf + (index - kLinear) % kHalf + 1) << shift) - 1;
+    }
+
+private:
+    static unsigned BitLength(uint64_t v) {
+        unsigned n = 0;
+        if (v >> 32) { v >>= 32; n += 32; }
+        if (v >> 16) { v >>= 16; n += 16; }
+        if (v >> 8)  { v >>= 8;  n += 8; }
+        if (v >> 4)  { v >>= 4;  n += 4; }
+        if (v >> 2)  { v >>= 2;  n += 2; }
+        if (v >> 1)  { v >>= 1;  n += 1; }
+        return n + static_cast<unsigned>(v);
+    }
+
+    std::atomic<uint64_t> m_counts[kBuckets] = {};
+    std::atomic<uint64_t> m_sum{0};
+    std::atomic<uint64_t> m_max{0};
+};
+
+struct PhaseSummary {
+    MetricPhase phase = MetricPhase::DcLocate;
+    uint64_t count = 0;
+    uint64_t sumUs = 0;
+    uint64_t p50Us = 0;
+    uint64_t p99Us = 0;
+    uint64_t maxUs = 0;
+};
+
+struct SitePhaseStats {
+    uint64_t count = 0;
+    uint64_t sumUs = 0;
+    uint64_t maxUs = 0;
+};
+
+struct DcTiming {
+    uint32_t dc = 0;
+    uint64_t totalUs = 0;
+    uint64_t phaseUs[kMetricPhases] = {};
+};
+
+// Timings of one scan. Forest-wide quantiles come from one histogram per
+// phase; each DC keeps its time per phase and each site a count/sum/max per
+// phase, enough to rank DCs and compare sites without a histogram apiece.
+// A fresh object per scan: a probe abandoned by an earlier scan can still
+// record into that scan's metrics, never into the next one.
+class ScanMetrics {
+public:
+    static constexpr uint32_t kNoDc = std::numeric_limits<uint32_t>::max();
+
+    // Sizes the per-DC and per-site tables; call before any worker records
+    // with a DC index. siteOfDc is indexed by DC.
+    void SetDcs(const std::vector<uint32_t>& siteOfDc) {
+        m_dcCount = siteOfDc.size();
+        m_siteOfDc = siteOfDc;
+        m_siteCount = 0;
+        for (uint32_t site : siteOfDc) m_siteCount = std::max<size_t>(m_siteCount, site + 1);
+        m_dcMicros.reset(new std::atomic<uint64_t>[m_dcCount * kMetricPhases]());
+        m_sites.reset(new SiteCell[m_siteCount * kMetricPhases]());
+    }
+
+    void Record(MetricPhase phase, uint32_t dc, uint64_t micros) {
+        const size_t p = static_cast<size_t>(phase);
+        m_phases[p].Record(micros);
+        if (dc >= m_dcCount) return;
+        m_dcMicros[dc * kMetricPhases + p].fetch_add(micros, std::memory_order_relaxed);
+        SiteCell& cell = m_sites[m_siteOfDc[dc] * kMetricPhases + p];
+        cell.count.fetch_add(1, std::memory_order_relaxed);
+        cell.sum.fetch_add(micros, std::memory_order_relaxed);
+        uint64_t max = cell.max.load(std::memory_order_relaxed);
+        while (micros > max && !cell.max.compare_exchange_weak(max, micros, std::memory_order_relaxed)) {}
+    }
+
+    const LatencyHistogram& Histogram(MetricPhase phase) const { return m_phases[static_cast<size_t>(phase)]; }
+    size_t DcCount() const { return m_dcCount; }
+    size_t SiteCount() const { return m_siteCount; }
+
+    PhaseSummary Summarize(MetricPhase phase) const {
+        const LatencyHistogram& h = Histogram(phase);
+        PhaseSummary s;
+        s.phase = phase;
+        s.count = h.Count();
+        s.sumUs = h.SumMicros();
+        s.p50Us = h.ValueAtQuantile(0.50);
+        s.p99Us = h.ValueAtQuantile(0.99);
+        s.maxUs = h.MaxMicros();
+        return s;
+    }
+
+    SitePhaseStats SiteStats(uint32_t site, MetricPhase phase) const {
+        SitePhaseStats s;
+        if (site >= m_siteCount) return s;
+        const SiteCell& cell = m_sites[site * kMetricPhases + static_cast<size_t>(phase)];
+        s.count = cell.count.load(std::memory_order_relaxed);
+        s.sumUs = cell.sum.load(std::memory_order_relaxed);
+        s.maxUs = cell.max.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    // DCs with the most time spent across all phases, slowest first
+    std::vector<DcTiming> SlowestDcs(size_t n) const {
+        std::vector<DcTiming> all(m_dcCount);
+        for (size_t dc = 0; dc < m_dcCount; dc++) {
+            DcTiming& t = all[dc];
+            t.dc = static_cast<uint32_t>(dc);
+            for (size_t p = 0; p < kMetricPhases; p++) {
+                t.phaseUs[p] = m_dcMicros[dc * kMetricPhases + p].load(std::memory_order_relaxed);
+                t.totalUs += t.phaseUs[p];
+            }
+        }
+        n = std::min(n, all.size());
+        std::partial_sort(all.begin(), all.begin() + n, all.end(),
+                          [](const DcTiming& a, const DcTiming& b) { return a.totalUs > b.totalUs; });
+        all.resize(n);
+        return all;
+    }
+
+private:
+    struct SiteCell {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> max{0};
+    };
+
+    LatencyHistogram m_phases[kMetricPhases];
+    size_t m_dcCount = 0;
+    size_t m_siteCount = 0;
+    std::vector<uint32_t> m_siteOfDc;
+    std::unique_ptr<std::atomic<uint64_t>[]> m_dcMicros;
+    std::unique_ptr<SiteCell[]> m_sites;
+};
+
+// The scan and DC the current thread works for. Workers set it with a
+// MetricsScope; backends only open PhaseTimers and never see the metrics.
+struct MetricsContext {
+    ScanMetrics* metrics = nullptr;
+    uint32_t dc = ScanMetrics::kNoDc;
+};
+
+inline MetricsContext& CurrentMetricsContext() {
+    thread_local MetricsContext context;
+    return context;
+}
+
+class MetricsScope {
+public:
+    explicit MetricsScope(ScanMetrics* metrics, uint32_t dc = ScanMetrics::kNoDc) : m_saved(CurrentMetricsContext()) {
+        CurrentMetricsContext() = MetricsContext{metrics, dc};
+    }
+    ~MetricsScope() { CurrentMetricsContext() = m_saved; }
+
+    MetricsScope(const MetricsScope&) = delete;
+    MetricsScope& operator=(const MetricsScope&) = delete;
+
+private:
+    MetricsContext m_saved;
+};
+
+// Records the lifetime of the timer into the current thread's scan, if any.
+// Without a scope the timer costs one thread-local read.
+class PhaseTimer {
+public:
+    explicit PhaseTimer(MetricPhase phase) : m_phase(phase), m_context(CurrentMetricsContext()) {
+        if (m_context.metrics) m_start = std::chrono::steady_clock::now();
+    }
+
+    ~PhaseTimer() { Stop(); }
+
+    // Ends the measurement early, e.g. between a bind and the reads it enables
+    void Stop() {
+        if (!m_context.metrics) return;
+        auto elapsed = std::chrono::steady_clock::now() - m_start;
+        m_context.metrics->Record(m_phase, m_context.dc,
+                                  static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+        m_context.metrics = nullptr;
+    }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+    MetricPhase m_phase;
+    MetricsContext m_context;
+    std::chrono::steady_clock::time_point m_start;
+};
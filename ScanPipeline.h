@@ -0,0 +1,649 @@
+// ScanPipeline.h
+// Scan en pipeline à mémoire bornée : découverte, sondage, enrichissement, analyse et sortie reliés par des files bornées
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "BoundedQueue.h"
+#include "CancellationToken.h"
+#include "DirectoryBackend.h"
+#include "EventCollector.h"
+#include "HealthCheck.h"
+#include "LatencyMatrix.h"
+#include "ProbeEngine.h"
+#include "ReplicationModel.h"
+#include "ScanEngine.h"
+#include "TopologyDiscovery.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// One DC on its way through the pipeline. Discovery fills the names, each
+// stage fills in its part of the record; what only one stage needs
+// (DSA, naming contexts) is dropped once that stage is done with it.
+struct PipelineDc {
+    uint64_t seq = 0;                   // discovery order
+    std::wstring site;
+    std::wstring name;
+    std::wstring host;
+    std::wstring ntdsDsaDn;
+    std::wstring invocationId;
+    std::vector<std::wstring> namingContexts;
+    DcRecord record;                    // record.site indexes sites in discovery order
+    std::vector<uint32_t> eventCounts;  // per configured event ID
+};
+
+enum class PipelineStage : uint8_t {
+    Discover,
+    Probe,
+    Enrich,
+    Analyze,
+    Sink
+};
+
+const size_t kPipelineStages = 5;
+
+inline const char* PipelineStageName(PipelineStage stage) {
+    switch (stage) {
+        case PipelineStage::Discover: return "discover";
+        case PipelineStage::Probe:    return "probe";
+        case PipelineStage::Enrich:   return "enrich";
+        case PipelineStage::Analyze:  return "analyze";
+        default:                      return "sink";
+    }
+}
+
+// Written by the stage's workers, read by Stats() from any thread
+struct PipelineStageCounters {
+    std::atomic<uint64_t> items{0};
+    std::atomic<uint64_t> busyUs{0};
+    std::atomic<uint64_t> starvedUs{0};     // waiting for input
+    std::atomic<uint64_t> blockedUs{0};     // waiting for room downstream
+};
+
+struct PipelineStageStats {
+    PipelineStage stage = PipelineStage::Discover;
+    unsigned workers = 0;
+    uint64_t items = 0;
+    uint64_t busyUs = 0;
+    uint64_t starvedUs = 0;
+    uint64_t blockedUs = 0;
+};
+
+// Queue feeding stage q + 1 (queues[0] feeds Probe)
+struct PipelineQueueStats {
+    size_t capacity = 0;
+    size_t depth = 0;
+    size_t maxDepth = 0;
+    uint64_t fullWaits = 0;             // pushes that found the queue full
+};
+
+struct PipelineStats {
+    int64_t elapsedMs = 0;
+    size_t pending = 0;                 // discovery objects still waiting for their other half
+    PipelineStageStats stages[kPipelineStages];
+    PipelineQueueStats queues[kPipelineStages - 1];
+};
+
+// "stages":[{"stage","workers","items","busyMs","starvedMs","blockedMs"}],
+// "queues":[{"to","capacity","depth","maxDepth","fullWaits"}]
+inline std::string FormatPipelineStatsJson(const PipelineStats& stats) {
+    auto num = [](uint64_t v) { return std::to_string(v); };
+    std::string s = "\"stages\":[";
+    for (size_t i = 0; i < kPipelineStages; i++) {
+        const PipelineStageStats& st = stats.stages[i];
+        if (i) s += ',';
+        s += "{\"stage\":\"" + std::string(PipelineStageName(st.stage)) + "\",\"workers\":" + num(st.workers) +
+             ",\"items\":" + num(st.items) + ",\"busyMs\":" + num(st.busyUs / 1000) +
+             ",\"starvedMs\":" + num(st.starvedUs / 1000) + ",\"blockedMs\":" + num(st.blockedUs / 1000) + '}';
+    }
+    s += "],\"queues\":[";
+    for (size_t q = 0; q < kPipelineStages - 1; q++) {
+        const PipelineQueueStats& qs = stats.queues[q];
+        if (q) s += ',';
+        s += "{\"to\":\"" + std::string(PipelineStageName(static_cast<PipelineStage>(q + 1))) +
+             "\",\"capacity\":" + num(qs.capacity) + ",\"depth\":" + num(qs.depth) +
+             ",\"maxDepth\":" + num(qs.maxDepth) + ",\"fullWaits\":" + num(qs.fullWaits) + '}';
+    }
+    return s + ']';
+}
+
+// Spins briefly, then yields, then sleeps up to 1 ms: waiting on a
+// lock-free queue without a condition variable on the hot path
+class PipelineBackoff {
+public:
+    void Wait() {
+        if (m_round < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(std::min<unsigned>(1000, 50 * (1 + (m_round - 64) / 8))));
+        }
+        m_round++;
+    }
+
+private:
+    unsigned m_round = 0;
+};
+
+// BoundedQueue with backpressure: Push() waits while the ring is full, so
+// a fast stage is held back by the slower one after it instead of
+// buffering without bound. Pop() waits while the ring is empty and
+// returns false once every producer is done and the ring is drained.
+// Waits are charged to the calling stage's counters.
+template <typename T>
+class PipelineQueue {
+public:
+    explicit PipelineQueue(size_t capacity) : m_ring(capacity) {}
+
+    void AddProducers(unsigned n) { m_producers.fetch_add(n, std::memory_order_relaxed); }
+
+    void ProducerDone() {
+        if (m_producers.fetch_sub(1, std::memory_order_acq_rel) == 1) m_closed.store(true, std::memory_order_release);
+    }
+
+    void Push(T&& value, PipelineStageCounters& counters) {
+        if (!m_ring.TryPush(std::move(value))) {
+            m_fullWaits.fetch_add(1, std::memory_order_relaxed);
+            const auto start = std::chrono::steady_clock::now();
+            PipelineBackoff backoff;
+            while (!m_ring.TryPush(std::move(value))) backoff.Wait();      // a failed TryPush leaves value intact
+            counters.blockedUs.fetch_add(MicrosecondsSince(start), std::memory_order_relaxed);
+        }
+        const size_t depth = m_ring.SizeApprox();
+        size_t max = m_maxDepth.load(std::memory_order_relaxed);
+        while (depth > max && !m_maxDepth.compare_exchange_weak(max, depth, std::memory_order_relaxed)) {}
+    }
+
+    bool Pop(T& out, PipelineStageCounters& counters) {
+        if (m_ring.TryPop(out)) return true;
+        const auto start = std::chrono::steady_clock::now();
+        PipelineBackoff backoff;
+        bool popped;
+        for (;;) {
+            if (m_ring.TryPop(out)) {
+                popped = true;
+                break;
+            }
+            // Closed: every push happened before, so one more try drains it
+            if (m_closed.load(std::memory_order_acquire)) {
+                popped = m_ring.TryPop(out);
+                break;
+            }
+            backoff.Wait();
+        }
+        counters.starvedUs.fetch_add(MicrosecondsSince(start), std::memory_order_relaxed);
+        return popped;
+    }
+
+    PipelineQueueStats Stats() const {
+        PipelineQueueStats s;
+        s.capacity = m_ring.Capacity();
+        s.depth = m_ring.SizeApprox();
+        s.maxDepth = m_maxDepth.load(std::memory_order_relaxed);
+        s.fullWaits = m_fullWaits.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    static uint64_t MicrosecondsSince(std::chrono::steady_clock::time_point start) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+
+    BoundedQueue<T> m_ring;
+    std::atomic<unsigned> m_producers{0};
+    std::atomic<bool> m_closed{false};
+    std::atomic<size_t> m_maxDepth{0};
+    std::atomic<uint64_t> m_fullWaits{0};
+};
+
+// DiscoverTopology one entry at a time: a DC is emitted as soon as its
+// server object, its NTDS Settings and its site have all been read, so
+// probing starts while the search is still paging. Only objects still
+// missing their other half are held; directory order (parents first)
+// keeps that to a handful. Connections and site links are counted, not
+// kept: the pipeline does not build the replication graph.
+class TopologyStream {
+public:
+    template <typename Emit>
+    void Add(const DirectoryEntry& entry, Emit&& emit) {
+        m_entries++;
+        if (HasObjectClass(entry, L"nTDSConnection")) {
+            m_connections++;
+        } else if (HasObjectClass(entry, L"siteLink")) {
+            m_siteLinks++;
+        } else if (HasObjectClass(entry, L"nTDSDSA")) {
+            const uint64_t serverKey = Key(entry.dn, 1);
+            if (serverKey == 0) return;
+            PendingDsa dsa;
+            dsa.dn = entry.dn;
+            dsa.invocationId = entry.First(L"invocationId");
+            const auto* ncs = entry.Find(L"msDS-hasMasterNCs");
+            if (!ncs || ncs->empty()) ncs = entry.Find(L"hasMasterNCs");
+            if (ncs) dsa.namingContexts = *ncs;
+            auto server = m_servers.find(serverKey);
+            if (server == m_servers.end()) {
+                m_dsas[serverKey] = std::move(dsa);
+            } else {
+                Complete(std::move(server->second), std::move(dsa), emit);
+                m_servers.erase(server);
+            }
+        } else if (HasObjectClass(entry, L"server")) {
+            const uint64_t key = Key(entry.dn, 0);
+            PendingServer server;
+            server.name = entry.First(L"name");
+            if (server.name.empty()) server.name = FirstRdnValue(entry.dn);
+            server.host = entry.First(L"dNSHostName");
+            server.siteKey = Key(entry.dn, 2);
+            if (key == 0 || server.siteKey == 0) return;
+            auto dsa = m_dsas.find(key);
+            if (dsa == m_dsas.end()) {
+                m_servers[key] = std::move(server);
+            } else {
+                Complete(std::move(server), std::move(dsa->second), emit);
+                m_dsas.erase(dsa);
+            }
+        } else if (HasObjectClass(entry, L"site")) {
+            const uint64_t key = Key(entry.dn, 0);
+            if (key == 0 || m_siteByDn.count(key)) return;
+            std::wstring name = entry.First(L"name");
+            m_siteByDn[key] = static_cast<SiteId>(m_siteNames.size());
+            m_siteNames.push_back(name.empty() ? FirstRdnValue(entry.dn) : name);
+            auto waiting = m_awaitingSite.find(key);
+            if (waiting != m_awaitingSite.end()) {
+                std::vector<PipelineDc> dcs = std::move(waiting->second);
+                m_awaitingSite.erase(waiting);
+                for (PipelineDc& dc : dcs) Release(std::move(dc), key, emit);
+            }
+        }
+    }
+
+    // Servers without NTDS Settings (not DCs), DSAs without a server and
+    // DCs of a site not read (yet)
+    size_t Pending() const {
+        size_t n = m_servers.size() + m_dsas.size();
+        for (const auto& site : m_awaitingSite) n += site.second.size();
+        return n;
+    }
+
+    const std::vector<std::wstring>& Sites() const { return m_siteNames; }
+    uint64_t Emitted() const { return m_emitted; }
+    size_t EntriesRead() const { return m_entries; }
+    size_t Connections() const { return m_connections; }
+    size_t SiteLinks() const { return m_siteLinks; }
+
+private:
+    // DNs are keyed by their hash (DistinguishedName.h), levels RDNs up:
+    // case, spacing and escaping aside, and no key string per object. Only
+    // a handful of objects wait at a time, so 64 bits do not collide. 0
+    // when the DN does not parse or has no such ancestor.
+    uint64_t Key(const std::wstring& text, uint32_t levels) {
+        const DnArena::Mark mark = m_scratch.Position();
+        DnView dn;
+        uint64_t key = 0;
+        if (ParseDn(text, m_scratch, dn) && dn.count > levels) key = DnView{dn.rdns + levels, dn.count - levels}.Hash();
+        m_scratch.Rewind(mark);
+        return key;
+    }
+
+    struct PendingServer {
+        std::wstring name;
+        std::wstring host;
+        uint64_t siteKey = 0;
+    };
+
+    struct PendingDsa {
+        std::wstring dn;
+        std::wstring invocationId;
+        std::vector<std::wstring> namingContexts;
+    };
+
+    template <typename Emit>
+    void Complete(PendingServer&& server, PendingDsa&& dsa, Emit& emit) {
+        PipelineDc dc;
+        dc.name = std::move(server.name);
+        dc.host = server.host.empty() ? dc.name : std::move(server.host);
+        dc.ntdsDsaDn = std::move(dsa.dn);
+        dc.invocationId = std::move(dsa.invocationId);
+        dc.namingContexts = std::move(dsa.namingContexts);
+        dc.record.invocation = InvocationKey(dc.invocationId);
+        if (m_siteByDn.count(server.siteKey)) {
+            Release(std::move(dc), server.siteKey, emit);
+        } else {
+            m_awaitingSite[server.siteKey].push_back(std::move(dc));
+        }
+    }
+
+    template <typename Emit>
+    void Release(PipelineDc&& dc, uint64_t siteKey, Emit& emit) {
+        dc.record.site = m_siteByDn[siteKey];
+        dc.site = m_siteNames[dc.record.site];
+        dc.seq = m_emitted++;
+        emit(std::move(dc));
+    }
+
+    DnArena m_scratch{4096};
+    std::unordered_map<uint64_t, SiteId> m_siteByDn;
+    std::vector<std::wstring> m_siteNames;
+    std::unordered_map<uint64_t, PendingServer> m_servers;         // by server DN key, waiting for NTDS Settings
+    std::unordered_map<uint64_t, PendingDsa> m_dsas;               // by server DN key, waiting for the server
+    std::unordered_map<uint64_t, std::vector<PipelineDc>> m_awaitingSite;
+    uint64_t m_emitted = 0;
+    size_t m_entries = 0;
+    size_t m_connections = 0;
+    size_t m_siteLinks = 0;
+};
+
+// LatencyMatrix::Summarize straight from the raw replica state, sources
+// told apart by DSA DN: no DsaIndex, so no forest-wide state. The DC's own
+// cursor (its DSA or invocation ID) is left out of the worst latency.
+inline ReplicationSummary SummarizeReplicaState(const ReplicaState& state, const std::wstring& ownDsaDn,
+                                                const std::wstring& ownInvocationId, int64_t observedAt) {
+    ReplicationSummary summary;
+    DnEqual same;
+    std::vector<const std::wstring*> sources, failing;
+    for (const auto& n : state.neighbors) {
+        sources.push_back(&n.sourceDsaDn);
+        if (n.consecutiveFailures > 0) failing.push_back(&n.sourceDsaDn);
+        summary.lastSuccess = std::max(summary.lastSuccess, n.lastSuccess);
+    }
+    auto countDistinct = [&](std::vector<const std::wstring*>& dns) {
+        size_t n = 0;
+        for (size_t i = 0; i < dns.size(); i++) {
+            bool seen = false;
+            for (size_t j = 0; j < i && !seen; j++) seen = same(*dns[i], *dns[j]);
+            if (!seen) n++;
+        }
+        return static_cast<uint16_t>(std::min<size_t>(0xFFFF, n));
+    };
+    summary.partners = countDistinct(sources);
+    summary.failingPartners = countDistinct(failing);
+
+    for (const auto& c : state.cursors) {
+        if (c.lastSyncSuccess <= 0) continue;
+        if (!c.sourceDsaDn.empty() ? same(c.sourceDsaDn, ownDsaDn)
+                                   : (!ownInvocationId.empty() && same(c.invocationId, ownInvocationId))) {
+            continue;
+        }
+        summary.worstLatencyMs = std::max(summary.worstLatencyMs, std::max<int64_t>(0, observedAt - c.lastSyncSuccess));
+    }
+    return summary;
+}
+
+// Receives every discovered DC once, on the sink stage's thread, in the
+// order the analysis stage finished them (not discovery order)
+class IPipelineSink {
+public:
+    virtual ~IPipelineSink() = default;
+    virtual void OnDc(const PipelineDc& dc) = 0;
+};
+
+struct PipelineResult {
+    bool discovered = false;            // the discovery search ran and found a site
+    bool cancelled = false;
+    std::vector<std::wstring> sites;
+    size_t entriesRead = 0;
+    size_t connections = 0;
+    HealthReport health;                // spread DcIds are discovery order (PipelineDc::seq)
+    std::wstring minUsnDc;              // names behind health.spread
+    std::wstring maxUsnDc;
+    size_t withLatency = 0;             // DCs whose replica metadata was read
+    PipelineStats stats;
+};
+
+struct PipelineOptions {
+    size_t queueCapacity = 256;                     // per queue, rounded up to a power of two
+    unsigned enrichWorkers = 0;                     // 0: as many as probe workers
+    std::chrono::milliseconds progressInterval{1000};
+    std::vector<std::wstring> siteScope;            // as ScanEngine::SetSiteScope
+};
+
+// The scan as a pipeline, for forests too large to hold: discover -> probe
+// -> enrich (replica metadata, events) -> analyze -> sink, each stage on
+// its own threads, joined by bounded lock-free queues. Discovery overlaps
+// probing, and what a scan holds at any time is bounded by the queue
+// capacities and the worker counts, not by the forest: every DC is handed
+// to the sink and forgotten. Raw replies are reduced to the fixed-size
+// record as soon as they are read.
+//
+// Compared with ScanEngine: no snapshot, latency matrix, links or poll
+// context (all O(DCs)), no per-DC metrics, and the probe stage relies on
+// the backend honouring its timeout where ProbeEngine would abandon a hung
+// call. The per-site probe cap does not apply either: DCs arrive site by
+// site and holding one back would stall the stage. Lag comes from the
+// measured latency only: the USN distance fallback needs the forest's
+// highest USN, which a row streamed out cannot wait for, so DCs without
+// replica metadata stay Unknown (the summary still has the USN spread).
+class ScanPipeline {
+public:
+    using ProgressCallback = std::function<void(const PipelineStats&)>;
+
+    // events may be null: DCs then keep EventState::Unknown
+    ScanPipeline(std::shared_ptr<IDirectoryBackend> backend, std::shared_ptr<EventCollector> events,
+                 ProbeOptions probe, PipelineOptions options = PipelineOptions())
+        : m_backend(std::move(backend)), m_events(std::move(events)), m_probe(probe), m_options(std::move(options)) {
+        if (m_probe.workers == 0) m_probe.workers = 1;
+        if (m_options.enrichWorkers == 0) m_options.enrichWorkers = m_probe.workers;
+        if (m_options.queueCapacity < 2) m_options.queueCapacity = 2;
+    }
+
+    // Runs one scan on the calling thread, which reports progress every
+    // progressInterval while the stages run. A cancelled token (or the scan
+    // deadline) stops discovery and probing; DCs already discovered still
+    // reach the sink, marked Cancelled.
+    PipelineResult Run(const std::wstring& configDn, IPipelineSink& sink, const CancellationToken* cancel = nullptr,
+                       const ProgressCallback& onProgress = nullptr) {
+        using Clock = std::chrono::steady_clock;
+        const CancellationToken token(cancel, Clock::now() + m_probe.scanDeadline);
+        const std::vector<uint32_t> eventIds = m_events ? m_events->Options().eventIds : std::vector<uint32_t>();
+
+        RunState state(m_options.queueCapacity);
+        state.start = Clock::now();
+        state.workers[0] = 1;
+        state.workers[1] = m_probe.workers;
+        state.workers[2] = m_options.enrichWorkers;
+        state.workers[3] = 1;
+        state.workers[4] = 1;
+        for (size_t q = 0; q < kPipelineStages - 1; q++) state.queues[q]->AddProducers(state.workers[q]);
+        m_run = &state;
+
+        PipelineResult result;
+        TopologyStream topology;
+        std::vector<std::thread> threads;
+
+        threads.emplace_back([&] {
+            PipelineStageCounters& counters = state.counters[0];
+            auto emit = [&](PipelineDc&& dc) {
+                dc.eventCounts.assign(eventIds.size(), 0);
+                counters.items.fetch_add(1, std::memory_order_relaxed);
+                state.queues[0]->Push(std::move(dc), counters);
+            };
+            if (!configDn.empty()) {
+                SearchRequest request = TopologySearchRequest(configDn);
+                auto t0 = Clock::now();
+                result.discovered = m_backend->SearchSubtree(request, [&](const DirectoryEntry& entry) {
+                    if (token.Cancelled()) return;
+                    topology.Add(entry, emit);
+                    state.pending.store(topology.Pending(), std::memory_order_relaxed);
+                });
+                // Time spent pushing is counted as blocked, not busy
+                const uint64_t total = Micros(Clock::now() - t0);
+                const uint64_t blocked = counters.blockedUs.load(std::memory_order_relaxed);
+                counters.busyUs.store(total > blocked ? total - blocked : 0, std::memory_order_relaxed);
+            }
+            state.queues[0]->ProducerDone();
+        });
+
+        for (unsigned w = 0; w < state.workers[1]; w++) {
+            threads.emplace_back([&] {
+                StageLoop(state, 1, [&](PipelineDc& dc) {
+                    DcRecord& r = dc.record;
+                    if (token.Cancelled() || !SiteInScope(m_options.siteScope, dc.site)) {
+                        r.status = ProbeStatus::Cancelled;
+                        return;
+                    }
+                    const auto t0 = Clock::now();
+                    RootDseReply reply = m_backend->ReadRootDse(dc.host, m_probe.dcTimeout);
+                    r.status = reply.status;
+                    r.usn = reply.highestCommittedUSN;
+                    r.probeMs = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - t0).count());
+                    r.probedAt = UnixNowMs();
+                });
+            });
+        }
+
+        for (unsigned w = 0; w < state.workers[2]; w++) {
+            threads.emplace_back([&] {
+                StageLoop(state, 2, [&](PipelineDc& dc) {
+                    DcRecord& r = dc.record;
+                    if (r.HasUsn() && !token.Cancelled()) {
+                        ReplicaState replica;
+                        if (m_backend->ReadReplicaState(dc.host, dc.namingContexts, replica)) {
+                            ReplicationSummary summary = SummarizeReplicaState(replica, dc.ntdsDsaDn, dc.invocationId, UnixNowMs());
+                            r.partners = summary.partners;
+                            r.failingPartners = summary.failingPartners;
+                            r.lastReplication = summary.lastSuccess;
+                            if (summary.worstLatencyMs >= 0) r.latencySec = (uint32_t)std::min<int64_t>(summary.worstLatencyMs / 1000, kUnknownLatency - 1);
+                        }
+                    }
+                    if (m_events && r.status != ProbeStatus::Cancelled && !token.Cancelled()) {
+                        DcEventCounts events = m_events->CollectOne(dc.host);
+                        r.events = events.ok ? EventState::Ok : EventState::Unavailable;
+                        for (size_t k = 0; k < events.totals.size() && k < dc.eventCounts.size(); k++) {
+                            dc.eventCounts[k] = (uint32_t)events.totals[k];
+                            r.errorTotal += dc.eventCounts[k];
+                        }
+                    }
+                    dc.ntdsDsaDn = std::wstring();
+                    dc.invocationId = std::wstring();
+                    dc.namingContexts = std::vector<std::wstring>();
+                });
+            });
+        }
+
+        threads.emplace_back([&] {
+            HealthReport& health = result.health;
+            LatencyThresholds latency;
+            StageLoop(state, 3, [&](PipelineDc& dc) {
+                DcRecord& r = dc.record;
+                if (r.HasUsn()) {
+                    UsnSpread& s = health.spread;
+                    const DcId id = static_cast<DcId>(dc.seq);
+                    if (s.count == 0 || r.usn > s.maxUsn) { s.maxUsn = r.usn; s.maxDc = id; result.maxUsnDc = dc.name; }
+                    if (s.count == 0 || r.usn < s.minUsn) { s.minUsn = r.usn; s.minDc = id; result.minUsnDc = dc.name; }
+                    s.count++;
+                }
+                if (r.HasLatency()) {
+                    r.lag = ClassifyLatency(r.latencySec, r.failingPartners, latency);
+                    result.withLatency++;
+                }
+                AddToHealth(health, r);
+            });
+            FinishHealth(health);
+        });
+
+        threads.emplace_back([&] {
+            StageLoop(state, 4, [&](PipelineDc& dc) { sink.OnDc(dc); });
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.done = true;
+            state.doneCv.notify_all();
+        });
+
+        {
+            std::unique_lock<std::mutex> lock(state.mutex);
+            while (!state.done) {
+                state.doneCv.wait_for(lock, m_options.progressInterval, [&] { return state.done; });
+                if (!state.done && onProgress) {
+                    lock.unlock();
+                    onProgress(Stats());
+                    lock.lock();
+                }
+            }
+        }
+        for (auto& t : threads) t.join();
+
+        result.stats = Stats();
+        m_run = nullptr;
+        result.sites = topology.Sites();
+        result.discovered = result.discovered && !result.sites.empty();
+        result.entriesRead = topology.EntriesRead();
+        result.connections = topology.Connections();
+        result.cancelled = token.Cancelled();
+        return result;
+    }
+
+    // Live figures of the running scan; safe from any thread during Run()
+    // (the progress callback calls it), empty otherwise
+    PipelineStats Stats() const {
+        PipelineStats s;
+        const RunState* run = m_run.load();
+        if (!run) return s;
+        s.elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - run->start).count();
+        s.pending = run->pending.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < kPipelineStages; i++) {
+            PipelineStageStats& stage = s.stages[i];
+            stage.stage = static_cast<PipelineStage>(i);
+            stage.workers = run->workers[i];
+            stage.items = run->counters[i].items.load(std::memory_order_relaxed);
+            stage.busyUs = run->counters[i].busyUs.load(std::memory_order_relaxed);
+            stage.starvedUs = run->counters[i].starvedUs.load(std::memory_order_relaxed);
+            stage.blockedUs = run->counters[i].blockedUs.load(std::memory_order_relaxed);
+        }
+        for (size_t q = 0; q < kPipelineStages - 1; q++) s.queues[q] = run->queues[q]->Stats();
+        return s;
+    }
+
+private:
+    struct RunState {
+        explicit RunState(size_t capacity) {
+            for (auto& q : queues) q = std::make_unique<PipelineQueue<PipelineDc>>(capacity);
+        }
+        std::chrono::steady_clock::time_point start;
+        unsigned workers[kPipelineStages] = {};
+        PipelineStageCounters counters[kPipelineStages];
+        std::unique_ptr<PipelineQueue<PipelineDc>> queues[kPipelineStages - 1];
+        std::atomic<size_t> pending{0};
+        std::mutex mutex;
+        std::condition_variable doneCv;
+        bool done = false;
+    };
+
+    static uint64_t Micros(std::chrono::steady_clock::duration d) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+    }
+
+    // One worker of stage: pops from the queue before it, works, pushes to
+    // the queue after it (none after the sink)
+    template <typename Work>
+    static void StageLoop(RunState& run, size_t stage, Work&& work) {
+        PipelineStageCounters& counters = run.counters[stage];
+        PipelineQueue<PipelineDc>& in = *run.queues[stage - 1];
+        PipelineQueue<PipelineDc>* out = stage < kPipelineStages - 1 ? run.queues[stage].get() : nullptr;
+        PipelineDc dc;
+        while (in.Pop(dc, counters)) {
+            const auto t0 = std::chrono::steady_clock::now();
+            work(dc);
+            counters.busyUs.fetch_add(Micros(std::chrono::steady_clock::now() - t0), std::memory_order_relaxed);
+            counters.items.fetch_add(1, std::memory_order_relaxed);
+            if (out) out->Push(std::move(dc), counters);
+        }
+        if (out) out->ProducerDone();
+    }
+
+    std::shared_ptr<IDirectoryBackend> m_backend;
+    std::shared_ptr<EventCollector> m_events;
+    ProbeOptions m_probe;
+    PipelineOptions m_options;
+    std::atomic<RunState*> m_run{nullptr};
+};
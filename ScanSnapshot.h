@@ -0,0 +1,292 @@
+// ScanSnapshot.h
+// Publication atomique de snapshots de scan immuables (lecteurs sans verrou) et diffusion des lignes par lots
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "EventAnalysis.h"
+#include "LatencyMatrix.h"
+#include "ReplicationModel.h"
+#include "ScanMetrics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A scan as seen by readers. Never modified once published.
+struct ScanSnapshot {
+    uint64_t generation = 0;
+    int64_t startedAt = 0;
+    int64_t completedAt = 0;            // 0 while the scan is still running
+    bool cancelled = false;             // stopped early (cancel, deadline): DCs not reached keep ProbeStatus::Cancelled
+    size_t siteCount = 0;
+    ReplicationModel model;
+    LatencyMatrix latency;              // rows indexed by DcId, shared between snapshots
+    std::vector<ReplicationLink> links; // enabled connections, sorted by (dest, source)
+    std::vector<DcId> polled;           // DCs re-polled on top of the previous snapshot, sorted; empty after a full scan
+    UsnSpread spread;
+    std::shared_ptr<ScanMetrics> metrics;  // phase timings; abandoned probes may still add to them
+    std::shared_ptr<const ReplicationErrorTable> replicationErrors;  // events read by the scan, null without events
+
+    bool Complete() const { return completedAt != 0; }
+};
+
+typedef std::shared_ptr<const ScanSnapshot> SnapshotPtr;
+
+struct RowUpdate {
+    DcId id = kInvalidId;
+    DcRecord record;
+};
+
+// Rows produced since the previous batch. Names are resolved through
+// topology, the immutable snapshot announced when the scan started.
+struct RowBatch {
+    SnapshotPtr topology;
+    std::vector<RowUpdate> rows;
+    std::vector<uint32_t> eventCounts;  // rows.size() * eventIds.size()
+};
+
+// Called on the scanner thread, in order: started, rows..., completed.
+// Subscribers that need another thread (the UI) hand the data over.
+class IScanSubscriber {
+public:
+    virtual ~IScanSubscriber() = default;
+    virtual void OnScanStarted(const SnapshotPtr& topology) { (void)topology; }
+    virtual void OnRows(const RowBatch& batch) { (void)batch; }
+    virtual void OnScanCompleted(const SnapshotPtr& snapshot) { (void)snapshot; }
+};
+
+// Holds the current snapshot behind an atomic pointer. Readers take a
+// reference without locking: a hazard slot protects the node between the
+// pointer load and the shared_ptr copy, and the writer only frees retired
+// nodes no hazard points to. Writers (the scanner) are serialised. A reader
+// that finds every hazard slot taken copies the pointer under the writer
+// lock instead of waiting for a slot; with no slots at all, every read does.
+class SnapshotPublisher {
+public:
+    static const size_t kHazardSlots = 64;
+
+    explicit SnapshotPublisher(size_t hazardSlots = kHazardSlots)
+        : m_hazardCount(hazardSlots), m_hazards(new Hazard[hazardSlots]) {}
+    SnapshotPublisher(const SnapshotPublisher&) = delete;
+    SnapshotPublisher& operator=(const SnapshotPublisher&) = delete;
+
+    ~SnapshotPublisher() {
+        delete m_current.load();
+        for (Node* n : m_retired) delete n;
+    }
+
+    SnapshotPtr Current() const {
+        Hazard* hazard = AcquireHazard();
+        if (!hazard) {
+            // Retired nodes are only freed under this lock
+            std::lock_guard<std::mutex> lock(m_writerMutex);
+            Node* node = m_current.load(std::memory_order_acquire);
+            return node ? node->snapshot : SnapshotPtr();
+        }
+        Hazard& h = *hazard;
+        Node* node = m_current.load(std::memory_order_acquire);
+        for (;;) {
+            h.node.store(node, std::memory_order_seq_cst);
+            Node* again = m_current.load(std::memory_order_seq_cst);
+            if (again == node) break;
+            node = again;
+        }
+        SnapshotPtr result = node ? node->snapshot : SnapshotPtr();
+        h.node.store(nullptr, std::memory_order_release);
+        h.used.store(false, std::memory_order_release);
+        return result;
+    }
+
+    void Publish(SnapshotPtr snapshot) {
+        Node* node = new Node{std::move(snapshot)};
+        std::lock_guard<std::mutex> lock(m_writerMutex);
+        Node* old = m_current.exchange(node, std::memory_order_acq_rel);
+        if (old) m_retired.push_back(old);
+        Reclaim();
+    }
+
+    void Subscribe(const std::shared_ptr<IScanSubscriber>& subscriber) {
+        std::lock_guard<std::mutex> lock(m_subscriberMutex);
+        m_subscribers.push_back(subscriber);
+    }
+
+    void Unsubscribe(const std::shared_ptr<IScanSubscriber>& subscriber) {
+        std::lock_guard<std::mutex> lock(m_subscriberMutex);
+        m_subscribers.erase(std::remove(m_subscribers.begin(), m_subscribers.end(), subscriber), m_subscribers.end());
+    }
+
+    // Scanner side
+    void NotifyStarted(const SnapshotPtr& topology) {
+        for (const auto& s : Subscribers()) s->OnScanStarted(topology);
+    }
+
+    void NotifyRows(const RowBatch& batch) {
+        if (batch.rows.empty()) return;
+        for (const auto& s : Subscribers()) s->OnRows(batch);
+    }
+
+    // Publishes the finished scan, then tells subscribers
+    void Complete(const SnapshotPtr& snapshot) {
+        Publish(snapshot);
+        for (const auto& s : Subscribers()) s->OnScanCompleted(snapshot);
+    }
+
+private:
+    struct Node {
+        SnapshotPtr snapshot;
+    };
+
+    struct alignas(64) Hazard {
+        std::atomic<Node*> node{nullptr};
+        std::atomic<bool> used{false};
+    };
+
+    // One pass over the slots from a per-thread start; null when all are taken
+    Hazard* AcquireHazard() const {
+        if (m_hazardCount == 0) return nullptr;
+        size_t start = std::hash<std::thread::id>()(std::this_thread::get_id()) % m_hazardCount;
+        for (size_t n = 0; n < m_hazardCount; n++) {
+            size_t i = (start + n) % m_hazardCount;
+            bool expected = false;
+            if (!m_hazards[i].used.load(std::memory_order_relaxed) &&
+                m_hazards[i].used.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                return &m_hazards[i];
+            }
+        }
+        return nullptr;
+    }
+
+    void Reclaim() {
+        std::vector<Node*> protectedNodes;
+        for (size_t i = 0; i < m_hazardCount; i++) {
+            Node* n = m_hazards[i].node.load(std::memory_order_seq_cst);
+            if (n) protectedNodes.push_back(n);
+        }
+        auto keep = std::partition(m_retired.begin(), m_retired.end(), [&](Node* n) {
+            return std::find(protectedNodes.begin(), protectedNodes.end(), n) != protectedNodes.end();
+        });
+        for (auto it = keep; it != m_retired.end(); ++it) delete *it;
+        m_retired.erase(keep, m_retired.end());
+    }
+
+    std::vector<std::shared_ptr<IScanSubscriber>> Subscribers() {
+        std::lock_guard<std::mutex> lock(m_subscriberMutex);
+        return m_subscribers;
+    }
+
+    std::atomic<Node*> m_current{nullptr};
+    const size_t m_hazardCount;
+    std::unique_ptr<Hazard[]> m_hazards;
+    mutable std::mutex m_writerMutex;
+    std::vector<Node*> m_retired;
+
+    std::mutex m_subscriberMutex;
+    std::vector<std::shared_ptr<IScanSubscriber>> m_subscribers;
+};
+
+// Accumulates row batches on the scanner thread until a full-size batch or
+// the flush interval is reached, so subscribers see a few large batches
+// rather than one call per DC. The first row goes out alone, so a front end
+// shows something as soon as the first DC answers.
+class RowBatcher {
+public:
+    RowBatcher(SnapshotPublisher& publisher, SnapshotPtr topology, size_t batchSize = 64,
+               std::chrono::milliseconds interval = std::chrono::milliseconds(100))
+        : m_publisher(publisher), m_batchSize(batchSize), m_interval(interval),
+          m_lastFlush(std::chrono::steady_clock::now()) {
+        m_batch.topology = std::move(topology);
+    }
+
+    ~RowBatcher() { Flush(); }
+
+    void Add(const ReplicationModel& model, DcId id) {
+        m_batch.rows.push_back({id, model.records[id]});
+        const uint32_t* counts = model.EventCountsOf(id);
+        m_batch.eventCounts.insert(m_batch.eventCounts.end(), counts, counts + model.eventIds.size());
+        if (!m_started || m_batch.rows.size() >= m_batchSize || std::chrono::steady_clock::now() - m_lastFlush >= m_interval) {
+            Flush();
+        }
+    }
+
+    void Flush() {
+        m_lastFlush = std::chrono::steady_clock::now();
+        if (m_batch.rows.empty()) return;
+        m_started = true;
+        m_publisher.NotifyRows(m_batch);
+        m_batch.rows.clear();
+        m_batch.eventCounts.clear();
+    }
+
+private:
+    SnapshotPublisher& m_publisher;
+    RowBatch m_batch;
+    size_t m_batchSize;
+    std::chrono::milliseconds m_interval;
+    std::chrono::steady_clock::time_point m_lastFlush;
+    bool m_started = false;
+};
+
+// Headless consumer: rebuilds the scan's model from the batches it receives
+// and keeps the last completed snapshot. Safe to query from any thread.
+class ModelBuilderSubscriber : public IScanSubscriber {
+public:
+    void OnScanStarted(const SnapshotPtr& topology) override {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_model = topology->model;
+        m_rowsReceived = 0;
+        m_batchesReceived = 0;
+    }
+
+    void OnRows(const RowBatch& batch) override {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t ids = m_model.eventIds.size();
+        for (size_t i = 0; i < batch.rows.size(); i++) {
+            const RowUpdate& row = batch.rows[i];
+            if (row.id >= m_model.records.size()) continue;
+            m_model.records[row.id] = row.record;
+            std::copy(batch.eventCounts.begin() + i * ids, batch.eventCounts.begin() + (i + 1) * ids,
+                      m_model.EventCountsOf(row.id));
+        }
+        m_rowsReceived += batch.rows.size();
+        m_batchesReceived++;
+    }
+
+    void OnScanCompleted(const SnapshotPtr& snapshot) override {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_last = snapshot;
+    }
+
+    ReplicationModel Model() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_model;
+    }
+
+    SnapshotPtr LastCompleted() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_last;
+    }
+
+    size_t RowsReceived() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_rowsReceived;
+    }
+
+    size_t BatchesReceived() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_batchesReceived;
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    ReplicationModel m_model;
+    SnapshotPtr m_last;
+    size_t m_rowsReceived = 0;
+    size_t m_batchesReceived = 0;
+};
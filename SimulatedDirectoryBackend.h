@@ -0,0 +1,453 @@
+// SimulatedDirectoryBackend.h
+// Backend d'annuaire simulé (latence et pannes injectées) pour mesurer le moteur de sondage hors domaine
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "ConnectionPool.h"
+#include "DirectoryBackend.h"
+#include "ScanMetrics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cwctype>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct SimulatedDc {
+    std::wstring name;
+    std::chrono::milliseconds latency{20};
+    std::chrono::milliseconds bindLatency{0};       // paid once per session (LDAP or DRS)
+    double failureRate = 0.0;           // probability in [0,1] that a read fails
+    bool hang = false;                  // never answers within any sane timeout
+    uint64_t highestCommittedUSN = 0;
+
+    // Replica metadata. Cursors are generated on the fly against every DC
+    // hosting the same NC, so large forests need no per-pair storage.
+    std::wstring ntdsDsaDn;
+    std::vector<std::wstring> namingContexts;
+    std::vector<std::wstring> inboundPartners;      // DC names
+    std::chrono::seconds replicationLag{60};        // typical inbound staleness
+    double partnerFailureRate = 0.0;                // probability a partner link is failing
+    std::chrono::milliseconds replicationDelay{0};  // typical time before a write made elsewhere is readable here (0: replicationLag)
+};
+
+// Deterministic for a given seed: failures are derived from (seed, dc, call#).
+// Populate with AddDc() before handing the backend to the probe engine.
+// Directory objects added with AddEntry() are served by SearchSubtree():
+// every entry under the base DN is returned, the filter is not evaluated,
+// so only add the objects the caller's search is meant to find.
+// Every read needs a bound session: without a pool each call binds (and
+// pays bindLatency) like a fresh ADsOpenObject; with EnablePool() sessions
+// come from a ConnectionPool over a fake transport, and Binds() tells how
+// many binds the DCs actually served.
+// WriteAttribute() stores the value with its origin DC and time; another DC
+// reads it once ReplicationDelay(origin, dc) has passed, the newest visible
+// write winning, so an active probe sees real propagation times.
+class SimulatedDirectoryBackend : public IDirectoryBackend {
+public:
+    explicit SimulatedDirectoryBackend(uint64_t seed = 1) : m_seed(seed) {}
+
+    void EnablePool(const ConnectionPoolOptions& options = ConnectionPoolOptions()) {
+        m_pool = std::make_unique<ConnectionPool>(std::make_shared<Transport>(*this), options);
+    }
+
+    ConnectionPool* Pool() const { return m_pool.get(); }
+    uint64_t Binds() const { return m_binds.load(std::memory_order_relaxed); }
+
+    void CloseSessions() override {
+        if (m_pool) m_pool->Clear();
+    }
+
+    // Naming contexts reported by the locator's rootDSE (empty dcName)
+    void SetRootDse(const std::wstring& configurationNc, const std::wstring& defaultNc) {
+        m_configurationNc = configurationNc;
+        m_defaultNc = defaultNc;
+    }
+
+    void AddEntry(DirectoryEntry entry) {
+        m_entries.push_back(std::move(entry));
+    }
+
+    void AddDc(const SimulatedDc& dc) {
+        auto entry = std::make_unique<Entry>();
+        entry->dc = dc;
+        for (const auto& nc : dc.namingContexts) m_ncHosts[nc].push_back(entry.get());
+        m_dcs[dc.name] = std::move(entry);
+    }
+
+    uint64_t Calls() const { return m_calls.load(std::memory_order_relaxed); }
+    size_t DcCount() const { return m_dcs.size(); }
+    size_t EntryCount() const { return m_entries.size(); }
+
+    RootDseReply ReadRootDse(const std::wstring& dcName, std::chrono::milliseconds timeout) override {
+        m_calls.fetch_add(1, std::memory_order_relaxed);
+
+        PhaseTimer timer(dcName.empty() ? MetricPhase::DcLocate : MetricPhase::RootDseRead);
+        RootDseReply reply;
+        if (dcName.empty() && !m_configurationNc.empty()) {
+            reply.status = ProbeStatus::Ok;
+            reply.configurationNamingContext = m_configurationNc;
+            reply.defaultNamingContext = m_defaultNc;
+            return reply;
+        }
+        auto it = m_dcs.find(dcName);
+        if (it == m_dcs.end()) {
+            reply.error = -1;
+            return reply;
+        }
+
+        Entry& e = *it->second;
+        Connection connection(*this, e, timeout, Protocol::Ldap);
+        if (!connection) {
+            reply.status = connection.status;
+            reply.error = connection.error;
+            return reply;
+        }
+        PhaseTimer read(MetricPhase::RootDseRead);
+        reply.status = Answer(e, timeout);
+        if (reply.status != ProbeStatus::Ok) {
+            if (reply.status == ProbeStatus::Unreachable) reply.error = -2;
+            connection.Fail(reply.error);
+            return reply;
+        }
+        reply.highestCommittedUSN = e.dc.highestCommittedUSN;
+        reply.dnsHostName = dcName;
+        reply.dsServiceName = e.dc.ntdsDsaDn;
+        reply.configurationNamingContext = m_configurationNc;
+        reply.defaultNamingContext = m_defaultNc;
+        return reply;
+    }
+
+    bool SearchSubtree(const SearchRequest& request, const std::function<void(const DirectoryEntry&)>& onEntry) override {
+        m_calls.fetch_add(1, std::memory_order_relaxed);
+        if (m_entries.empty()) return false;
+        PhaseTimer timer(MetricPhase::Search);
+        for (const auto& entry : m_entries) {
+            if (EndsWithNoCase(entry.dn, request.baseDn)) onEntry(entry);
+        }
+        return true;
+    }
+
+    bool ReadReplicaState(const std::wstring& dcName, const std::vector<std::wstring>& namingContexts,
+                          ReplicaState& state) override {
+        m_calls.fetch_add(1, std::memory_order_relaxed);
+
+        auto it = m_dcs.find(dcName);
+        if (it == m_dcs.end()) {
+            state.error = -1;
+            return false;
+        }
+        Entry& e = *it->second;
+        Connection connection(*this, e, std::chrono::milliseconds(30000), Protocol::Drs);
+        if (!connection) {
+            state.error = connection.error;
+            return false;
+        }
+        PhaseTimer read(MetricPhase::ReplicaMetadata);
+        if (Answer(e, std::chrono::milliseconds(30000)) != ProbeStatus::Ok) {
+            state.error = -2;
+            connection.Fail(state.error);
+            return false;
+        }
+
+        const int64_t now = UnixMs();
+        const int64_t lagMs = std::chrono::duration_cast<std::chrono::milliseconds>(e.dc.replicationLag).count();
+        const uint64_t destHash = Hash(dcName);
+
+        for (const auto& partnerName : e.dc.inboundPartners) {
+            auto p = m_dcs.find(partnerName);
+            if (p == m_dcs.end()) continue;
+            const SimulatedDc& partner = p->second->dc;
+            uint64_t h = Mix(m_seed ^ destHash ^ (Hash(partnerName) * 3));
+            bool failing = Unit(h) < e.dc.partnerFailureRate;
+
+            for (const auto& nc : e.dc.namingContexts) {
+                if (std::find(partner.namingContexts.begin(), partner.namingContexts.end(), nc) == partner.namingContexts.end()) continue;
+                ReplicaNeighbor n;
+                n.namingContext = nc;
+                n.sourceDsaDn = partner.ntdsDsaDn;
+                n.lastAttempt = now - static_cast<int64_t>(h % 60000);
+                n.lastSuccess = failing ? n.lastAttempt - lagMs * 8 : n.lastAttempt;
+                n.consecutiveFailures = failing ? static_cast<uint32_t>(1 + (h >> 32) % 12) : 0;
+                n.lastResult = failing ? 1722 : 0;          // RPC server unavailable
+                n.usnLastObjChangeSynced = partner.highestCommittedUSN;
+                state.neighbors.push_back(n);
+            }
+        }
+
+        for (const auto& nc : namingContexts) {
+            auto hosts = m_ncHosts.find(nc);
+            if (hosts == m_ncHosts.end()) continue;
+            for (const Entry* source : hosts->second) {
+                UpToDatenessCursor c;
+                c.namingContext = nc;
+                c.sourceDsaDn = source->dc.ntdsDsaDn;
+                if (source == &e) {
+                    c.usnHighPropUpdate = e.dc.highestCommittedUSN;
+                    c.lastSyncSuccess = now;
+                } else {
+                    uint64_t h = Mix(m_seed ^ destHash ^ Hash(source->dc.name));
+                    c.usnHighPropUpdate = source->dc.highestCommittedUSN - std::min<uint64_t>(source->dc.highestCommittedUSN, h % 1000);
+                    c.lastSyncSuccess = now - lagMs / 2 - static_cast<int64_t>(h % static_cast<uint64_t>(lagMs + 1));
+                }
+                state.cursors.push_back(c);
+            }
+        }
+        return true;
+    }
+
+    AttributeReply ReadAttribute(const std::wstring& dcName, const std::wstring& dn, const std::wstring& attribute,
+                                 std::chrono::milliseconds timeout) override {
+        m_calls.fetch_add(1, std::memory_order_relaxed);
+        AttributeReply reply;
+        auto it = m_dcs.find(dcName);
+        if (it == m_dcs.end()) {
+            reply.error = -1;
+            return reply;
+        }
+        Entry& e = *it->second;
+        Connection connection(*this, e, timeout, Protocol::Ldap);
+        if (!connection) {
+            reply.status = connection.status;
+            reply.error = connection.error;
+            return reply;
+        }
+        reply.status = Answer(e, timeout);
+        if (reply.status != ProbeStatus::Ok) {
+            if (reply.status == ProbeStatus::Unreachable) reply.error = -2;
+            connection.Fail(reply.error);
+            return reply;
+        }
+
+        const int64_t now = UnixMs();
+        std::lock_guard<std::mutex> lock(m_writesMutex);
+        auto w = m_writes.find(WriteKey(dn, attribute));
+        if (w == m_writes.end()) return reply;
+        const Write* newest = nullptr;
+        for (const auto& write : w->second) {
+            if (newest && write.at < newest->at) continue;
+            if (write.origin != &e && write.at + DelayMs(*write.origin, e) > now) continue;
+            newest = &write;
+        }
+        if (newest) {
+            reply.found = true;
+            reply.value = newest->value;
+        }
+        return reply;
+    }
+
+    bool WriteAttribute(const std::wstring& dcName, const std::wstring& dn, const std::wstring& attribute,
+                        const std::wstring& value, int32_t& error) override {
+        m_calls.fetch_add(1, std::memory_order_relaxed);
+        auto it = m_dcs.find(dcName);
+        if (it == m_dcs.end()) {
+            error = -1;
+            return false;
+        }
+        Entry& e = *it->second;
+        Connection connection(*this, e, std::chrono::milliseconds(30000), Protocol::Ldap);
+        if (!connection) {
+            error = connection.error;
+            return false;
+        }
+        if (Answer(e, std::chrono::milliseconds(30000)) != ProbeStatus::Ok) {
+            error = -2;
+            connection.Fail(error);
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(m_writesMutex);
+        auto& writes = m_writes[WriteKey(dn, attribute)];
+        if (writes.size() >= kWritesKept) writes.erase(writes.begin());
+        writes.push_back(Write{&e, UnixMs(), value});
+        return true;
+    }
+
+    // How long a write made on source takes to become readable on dest: the
+    // destination's delay, scaled by a fixed factor in [0.5, 1.5) per pair
+    std::chrono::milliseconds ReplicationDelay(const std::wstring& source, const std::wstring& dest) const {
+        auto s = m_dcs.find(source);
+        auto d = m_dcs.find(dest);
+        if (s == m_dcs.end() || d == m_dcs.end() || s == d) return std::chrono::milliseconds(0);
+        return std::chrono::milliseconds(DelayMs(*s->second, *d->second));
+    }
+
+private:
+    struct Entry {
+        SimulatedDc dc;
+        std::atomic<uint64_t> calls{0};
+    };
+
+    enum class Protocol : uint8_t { Ldap, Drs };
+
+    // One simulated bind: the DC's bind latency, or its hang
+    ProbeStatus BindDc(Entry& e, std::chrono::milliseconds timeout) {
+        PhaseTimer timer(MetricPhase::Bind);
+        if (e.dc.hang) {
+            std::this_thread::sleep_for(timeout * 4);
+            return ProbeStatus::Timeout;
+        }
+        if (e.dc.bindLatency > timeout) {
+            std::this_thread::sleep_for(timeout);
+            return ProbeStatus::Timeout;
+        }
+        std::this_thread::sleep_for(e.dc.bindLatency);
+        m_binds.fetch_add(1, std::memory_order_relaxed);
+        return ProbeStatus::Ok;
+    }
+
+    // An LDAP session, with the DRS handle bound the first time it is needed
+    struct Session : IDirectorySession {
+        Entry* dc = nullptr;
+        bool drsBound = false;
+    };
+
+    // The fake server end of the pool
+    class Transport : public IDirectoryTransport {
+    public:
+        explicit Transport(SimulatedDirectoryBackend& backend) : m_backend(backend) {}
+
+        std::unique_ptr<IDirectorySession> Bind(const std::wstring& dc, std::chrono::milliseconds timeout,
+                                                int32_t& error) override {
+            auto it = m_backend.m_dcs.find(dc);
+            if (it == m_backend.m_dcs.end()) {
+                error = -1;
+                return nullptr;
+            }
+            if (m_backend.BindDc(*it->second, timeout) != ProbeStatus::Ok) {
+                error = -3;
+                return nullptr;
+            }
+            auto session = std::make_unique<Session>();
+            session->dc = it->second.get();
+            return session;
+        }
+
+        // -2: the DC stopped answering; anything else leaves the session usable
+        bool IsConnectionError(int32_t error) const override { return error == -2; }
+
+    private:
+        SimulatedDirectoryBackend& m_backend;
+    };
+
+    // A pooled lease, or a one-off bind when no pool is enabled
+    struct Connection {
+        ConnectionPool::Lease lease;
+        ProbeStatus status = ProbeStatus::Ok;
+        int32_t error = 0;
+
+        Connection(SimulatedDirectoryBackend& backend, Entry& e, std::chrono::milliseconds timeout, Protocol protocol) {
+            if (!backend.m_pool) {
+                status = backend.BindDc(e, timeout);
+                if (status != ProbeStatus::Ok) error = -3;
+                return;
+            }
+            lease = backend.m_pool->Acquire(e.dc.name, timeout, error);
+            if (!lease) {
+                status = ProbeStatus::Unreachable;
+                return;
+            }
+            Session& session = lease.As<Session>();
+            if (protocol == Protocol::Drs && !session.drsBound) {
+                status = backend.BindDc(e, timeout);
+                if (status != ProbeStatus::Ok) {
+                    error = -3;
+                    lease.Fail(-2);
+                    return;
+                }
+                session.drsBound = true;
+            }
+        }
+
+        explicit operator bool() const { return status == ProbeStatus::Ok; }
+        void Fail(int32_t code) { if (lease) lease.Fail(code); }
+    };
+
+    // Applies the DC's latency, hang and failure settings to one call
+    ProbeStatus Answer(Entry& e, std::chrono::milliseconds timeout) {
+        uint64_t call = e.calls.fetch_add(1, std::memory_order_relaxed);
+
+        if (e.dc.hang) {
+            std::this_thread::sleep_for(timeout * 4);
+            return ProbeStatus::Timeout;
+        }
+        if (e.dc.latency > timeout) {
+            std::this_thread::sleep_for(timeout);
+            return ProbeStatus::Timeout;
+        }
+        std::this_thread::sleep_for(e.dc.latency);
+
+        uint64_t h = Mix(m_seed ^ Hash(e.dc.name) ^ (call * 0x9E3779B97F4A7C15ull));
+        return Unit(h) < e.dc.failureRate ? ProbeStatus::Unreachable : ProbeStatus::Ok;
+    }
+
+    struct Write {
+        const Entry* origin;
+        int64_t at;                     // Unix ms
+        std::wstring value;
+    };
+
+    static constexpr size_t kWritesKept = 256;      // per attribute; the oldest write is dropped first
+
+    int64_t DelayMs(const Entry& source, const Entry& dest) const {
+        const auto base = dest.dc.replicationDelay.count() > 0
+            ? dest.dc.replicationDelay
+            : std::chrono::duration_cast<std::chrono::milliseconds>(dest.dc.replicationLag);
+        const double scale = 0.5 + Unit(Mix(m_seed ^ Hash(dest.dc.name) ^ (Hash(source.dc.name) * 7)));
+        return static_cast<int64_t>(static_cast<double>(base.count()) * scale);
+    }
+
+    static std::wstring WriteKey(const std::wstring& dn, const std::wstring& attribute) {
+        std::wstring key = dn + L'|' + attribute;
+        for (auto& c : key) c = towlower(c);
+        return key;
+    }
+
+    static double Unit(uint64_t h) { return static_cast<double>(h >> 11) * (1.0 / 9007199254740992.0); }
+
+    static int64_t UnixMs() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    static uint64_t Mix(uint64_t x) {
+        x ^= x >> 30; x *= 0xBF58476D1CE4E5B9ull;
+        x ^= x >> 27; x *= 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    static bool EndsWithNoCase(const std::wstring& dn, const std::wstring& suffix) {
+        if (suffix.size() > dn.size()) return false;
+        size_t offset = dn.size() - suffix.size();
+        for (size_t i = 0; i < suffix.size(); i++) {
+            if (towlower(dn[offset + i]) != towlower(suffix[i])) return false;
+        }
+        return true;
+    }
+
+    static uint64_t Hash(const std::wstring& s) {
+        uint64_t h = 1469598103934665603ull;
+        for (wchar_t c : s) { h ^= static_cast<uint64_t>(c); h *= 1099511628211ull; }
+        return h;
+    }
+
+    uint64_t m_seed;
+    std::atomic<uint64_t> m_calls{0};
+    std::atomic<uint64_t> m_binds{0};
+    std::wstring m_configurationNc;
+    std::wstring m_defaultNc;
+    std::vector<DirectoryEntry> m_entries;
+    std::unordered_map<std::wstring, std::unique_ptr<Entry>> m_dcs;
+    std::unordered_map<std::wstring, std::vector<const Entry*>> m_ncHosts;
+    std::mutex m_writesMutex;
+    std::unordered_map<std::wstring, std::vector<Write>> m_writes;     // keyed by WriteKey
+    std::unique_ptr<ConnectionPool> m_pool;         // declared last: its sessions point into m_dcs
+};
@@ -0,0 +1,479 @@
+// SnapshotFile.h
+// Snapshots de scan binaires (table de chaînes, enregistrements fixes, CRC-32) projetés en mémoire, et écarts entre deux scans
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "MappedFile.h"
+#include "ReplicationModel.h"
+#include "ScanSnapshot.h"
+#include "Utf8.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// CRC-32 (IEEE, reflected), eight bytes per step; crc chains calls
+inline uint32_t Crc32(const void* data, size_t size, uint32_t crc = 0) {
+    struct Tables {
+        uint32_t t[8][256];
+        Tables() {
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++) c = (c >> 1) ^ (0xEDB88320u & (0u - (c & 1)));
+                t[0][i] = c;
+            }
+            for (uint32_t i = 0; i < 256; i++) {
+                for (int s = 1; s < 8; s++) t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xFF];
+            }
+        }
+    };
+    static const Tables tables;
+    const uint32_t (&t)[8][256] = tables.t;
+
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for (; size >= 8; size -= 8, p += 8) {
+        uint32_t lo, hi;
+        std::memcpy(&lo, p, 4);
+        std::memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+    }
+    while (size--) crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xFF];
+    return ~crc;
+}
+
+// On-disk layout, little-endian, every section 4-byte aligned and the
+// records 8-byte aligned so a mapped file is read in place:
+//   header (64 bytes)
+//   SnapshotDcEntry dcs[dcCount]
+//   SnapshotName sites[siteCount]
+//   u32 eventIds[eventIdCount]
+//   u32 eventCounts[dcCount * eventIdCount]
+//   ReplicationLink links[linkCount]
+//   UTF-8 string table (stringBytes), padded to 8
+// The CRC covers the whole file except its own field.
+struct SnapshotFileHeader {
+    char magic[4];                      // "ADRS"
+    uint16_t version;
+    uint16_t eventIdCount;
+    uint32_t dcCount;
+    uint32_t siteCount;                 // named sites (those with a DC)
+    uint32_t siteTotal;                 // ScanSnapshot::siteCount, sites without a DC included
+    uint32_t linkCount;
+    uint32_t stringBytes;
+    uint32_t crc;
+    uint64_t generation;
+    int64_t startedAt;
+    int64_t completedAt;
+    uint64_t fileSize;
+};
+
+struct SnapshotName {
+    uint32_t offset;                    // into the string table
+    uint32_t length;
+};
+
+struct SnapshotDcEntry {
+    uint64_t usn;
+    int64_t probedAt;
+    int64_t lastReplication;
+    SnapshotName name;
+    uint32_t site;                      // index into the site names
+    uint32_t probeMs;
+    uint32_t errorTotal;
+    uint32_t latencySec;
+    uint16_t partners;
+    uint16_t failingPartners;
+    uint8_t status;                     // ProbeStatus
+    uint8_t lag;                        // LagClass
+    uint8_t events;                     // EventState
+    uint8_t reserved;
+};
+
+static_assert(sizeof(SnapshotFileHeader) == 64, "SnapshotFileHeader must stay 64 bytes");
+static_assert(sizeof(SnapshotDcEntry) == 56, "SnapshotDcEntry must stay 56 bytes");
+static_assert(sizeof(ReplicationLink) == 12, "ReplicationLink is stored as is");
+
+const uint16_t kSnapshotFileVersion = 1;
+
+// One buffer holding the file for a snapshot; the latency matrix is not
+// kept, only what the list, the health check and the diff need
+inline std::string EncodeSnapshot(const ScanSnapshot& snapshot) {
+    const ReplicationModel& model = snapshot.model;
+    const size_t ids = model.eventIds.size();
+
+    std::string strings;
+    auto addName = [&](const std::wstring& name) {
+        SnapshotName n;
+        n.offset = static_cast<uint32_t>(strings.size());
+        strings += WideToUtf8(name);
+        n.length = static_cast<uint32_t>(strings.size() - n.offset);
+        return n;
+    };
+    std::vector<SnapshotDcEntry> dcs(model.Size());
+    for (DcId id = 0; id < model.Size(); id++) {
+        const DcRecord& r = model.records[id];
+        SnapshotDcEntry& e = dcs[id];
+        std::memset(&e, 0, sizeof(e));
+        e.usn = r.usn;
+        e.probedAt = r.probedAt;
+        e.lastReplication = r.lastReplication;
+        e.name = addName(model.DcName(id));
+        e.site = r.site;
+        e.probeMs = r.probeMs;
+        e.errorTotal = r.errorTotal;
+        e.latencySec = r.latencySec;
+        e.partners = r.partners;
+        e.failingPartners = r.failingPartners;
+        e.status = static_cast<uint8_t>(r.status);
+        e.lag = static_cast<uint8_t>(r.lag);
+        e.events = static_cast<uint8_t>(r.events);
+    }
+    std::vector<SnapshotName> sites(model.sites.Size());
+    for (size_t s = 0; s < sites.size(); s++) sites[s] = addName(model.sites.Name(static_cast<uint32_t>(s)));
+    strings.resize((strings.size() + 7) & ~size_t(7), '\0');
+
+    SnapshotFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "ADRS", 4);
+    header.version = kSnapshotFileVersion;
+    header.eventIdCount = static_cast<uint16_t>(ids);
+    header.dcCount = static_cast<uint32_t>(dcs.size());
+    header.siteCount = static_cast<uint32_t>(sites.size());
+    header.siteTotal = static_cast<uint32_t>(snapshot.siteCount);
+    header.linkCount = static_cast<uint32_t>(snapshot.links.size());
+    header.stringBytes = static_cast<uint32_t>(strings.size());
+    header.generation = snapshot.generation;
+    header.startedAt = snapshot.startedAt;
+    header.completedAt = snapshot.completedAt;
+
+    const size_t links = snapshot.links.size() * sizeof(ReplicationLink);
+    header.fileSize = sizeof(header) + dcs.size() * sizeof(SnapshotDcEntry) + sites.size() * sizeof(SnapshotName) +
+                      ids * 4 + model.eventCounts.size() * 4 + links + strings.size();
+    header.fileSize = (header.fileSize + 7) & ~uint64_t(7);
+
+    std::string file;
+    file.reserve(static_cast<size_t>(header.fileSize));
+    auto append = [&](const void* data, size_t size) { file.append(static_cast<const char*>(data), size); };
+    append(&header, sizeof(header));
+    append(dcs.data(), dcs.size() * sizeof(SnapshotDcEntry));
+    append(sites.data(), sites.size() * sizeof(SnapshotName));
+    append(model.eventIds.data(), ids * 4);
+    append(model.eventCounts.data(), model.eventCounts.size() * 4);
+    append(snapshot.links.data(), links);
+    append(strings.data(), strings.size());
+    file.resize(static_cast<size_t>(header.fileSize), '\0');
+
+    const size_t crcAt = offsetof(SnapshotFileHeader, crc);
+    const uint32_t crc = Crc32(file.data() + crcAt + 4, file.size() - crcAt - 4, Crc32(file.data(), crcAt));
+    std::memcpy(&file[crcAt], &crc, 4);
+    return file;
+}
+
+// Replaces path with an encoded snapshot through a temporary file, so a
+// reader mapping the previous one never sees a half-written file
+inline bool WriteSnapshotFile(const std::string& file, const std::wstring& path) {
+    std::filesystem::path target(path);
+    std::filesystem::path temp = target;
+    temp += L".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        out.write(file.data(), static_cast<std::streamsize>(file.size()));
+        if (!out) return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp, target, ec);
+    return !ec;
+}
+
+// A snapshot file read in place: Open() maps it, Attach() takes a buffer
+// (EncodeSnapshot's output, say). Both check the layout and the CRC once;
+// after that every accessor is a bounds-free lookup into the mapping.
+class SnapshotView {
+public:
+    SnapshotView() = default;
+    SnapshotView(const SnapshotView&) = delete;
+    SnapshotView& operator=(const SnapshotView&) = delete;
+
+    bool Open(const std::wstring& path) {
+        m_header = nullptr;
+        if (!m_file.Open(path, false)) {
+            m_error = "fichier illisible";
+            return false;
+        }
+        return Attach(m_file.Data(), m_file.Size());
+    }
+
+    // data must stay valid, and unchanged, while the view is used
+    bool Attach(const void* data, size_t size) {
+        m_header = nullptr;
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        if (size < sizeof(SnapshotFileHeader) || std::memcmp(bytes, "ADRS", 4) != 0) {
+            m_error = "pas un snapshot de scan";
+            return false;
+        }
+        const SnapshotFileHeader* header = reinterpret_cast<const SnapshotFileHeader*>(bytes);
+        if (header->version != kSnapshotFileVersion) {
+            m_error = "version de snapshot inconnue";
+            return false;
+        }
+        const uint64_t dcs = header->dcCount, ids = header->eventIdCount;
+        const uint64_t expected = sizeof(SnapshotFileHeader) + dcs * sizeof(SnapshotDcEntry) +
+                                  uint64_t(header->siteCount) * sizeof(SnapshotName) + ids * 4 + dcs * ids * 4 +
+                                  uint64_t(header->linkCount) * sizeof(ReplicationLink) + header->stringBytes;
+        if (header->fileSize != size || ((expected + 7) & ~uint64_t(7)) != size) {
+            m_error = "snapshot tronqué";
+            return false;
+        }
+        const size_t crcAt = offsetof(SnapshotFileHeader, crc);
+        if (Crc32(bytes + crcAt + 4, size - crcAt - 4, Crc32(bytes, crcAt)) != header->crc) {
+            m_error = "somme de contrôle incorrecte";
+            return false;
+        }
+
+        m_dcs = reinterpret_cast<const SnapshotDcEntry*>(bytes + sizeof(SnapshotFileHeader));
+        m_sites = reinterpret_cast<const SnapshotName*>(m_dcs + dcs);
+        m_eventIds = reinterpret_cast<const uint32_t*>(m_sites + header->siteCount);
+        m_eventCounts = m_eventIds + ids;
+        m_links = reinterpret_cast<const ReplicationLink*>(m_eventCounts + dcs * ids);
+        m_strings = reinterpret_cast<const char*>(m_links + header->linkCount);
+
+        // Names, site indexes and enums are checked once so lookups need not be
+        for (size_t i = 0; i < dcs; i++) {
+            if (!NameFits(m_dcs[i].name, header->stringBytes) || m_dcs[i].site >= header->siteCount) {
+                m_error = "table de chaînes incohérente";
+                return false;
+            }
+            if (m_dcs[i].status > static_cast<uint8_t>(ProbeStatus::Cancelled) ||
+                m_dcs[i].lag > static_cast<uint8_t>(LagClass::Severe) ||
+                m_dcs[i].events > static_cast<uint8_t>(EventState::Unavailable)) {
+                m_error = "état de DC inconnu";
+                return false;
+            }
+        }
+        for (size_t s = 0; s < header->siteCount; s++) {
+            if (!NameFits(m_sites[s], header->stringBytes)) {
+                m_error = "table de chaînes incohérente";
+                return false;
+            }
+        }
+        m_header = header;
+        m_error.clear();
+        return true;
+    }
+
+    // Unmaps the file; needed before replacing it on Windows
+    void Close() {
+        m_header = nullptr;
+        m_file.Close();
+    }
+
+    bool Valid() const { return m_header != nullptr; }
+    const std::string& Error() const { return m_error; }
+    const SnapshotFileHeader& Header() const { return *m_header; }
+
+    size_t DcCount() const { return m_header->dcCount; }
+    const SnapshotDcEntry& Dc(size_t i) const { return m_dcs[i]; }
+    std::string_view DcName(size_t i) const { return Name(m_dcs[i].name); }
+    std::string_view SiteName(size_t site) const { return Name(m_sites[site]); }
+    size_t EventIdCount() const { return m_header->eventIdCount; }
+    const uint32_t* EventIds() const { return m_eventIds; }
+    const uint32_t* EventCountsOf(size_t i) const { return m_eventCounts + i * m_header->eventIdCount; }
+    size_t LinkCount() const { return m_header->linkCount; }
+    const ReplicationLink* Links() const { return m_links; }
+
+    // A snapshot to publish at start-up: the rows, links and event counts of
+    // the file, an empty latency matrix (Row() is null for every DC). A DC
+    // name repeated in the file keeps its first row; event counts and link
+    // ends are remapped from file indexes to the DcIds they interned to.
+    SnapshotPtr ToSnapshot() const {
+        auto snapshot = std::make_shared<ScanSnapshot>();
+        snapshot->generation = m_header->generation;
+        snapshot->startedAt = m_header->startedAt;
+        snapshot->completedAt = m_header->completedAt;
+        snapshot->siteCount = m_header->siteTotal;
+
+        ReplicationModel& model = snapshot->model;
+        model.eventIds.assign(m_eventIds, m_eventIds + m_header->eventIdCount);
+        for (size_t s = 0; s < m_header->siteCount; s++) {
+            const std::string_view name = SiteName(s);
+            model.sites.Intern(Utf8ToWide(name.data(), name.size()));
+        }
+        model.Reserve(DcCount());
+        std::vector<DcId> idOf(DcCount());
+        bool duplicates = false;
+        for (size_t i = 0; i < DcCount(); i++) {
+            const SnapshotDcEntry& e = m_dcs[i];
+            const std::string_view name = DcName(i);
+            std::wstring dc = Utf8ToWide(name.data(), name.size());
+            const DcId existing = model.dcs.Find(dc);
+            if (existing != kInvalidId) {           // duplicate name: first one wins
+                idOf[i] = existing;
+                duplicates = true;
+                continue;
+            }
+            const DcId id = model.AddDc(model.sites.Name(e.site), dc);
+            idOf[i] = id;
+            const uint32_t* counts = EventCountsOf(i);
+            std::copy(counts, counts + model.eventIds.size(), model.EventCountsOf(id));
+            DcRecord& r = model.records[id];
+            r.usn = e.usn;
+            r.probedAt = e.probedAt;
+            r.lastReplication = e.lastReplication;
+            r.probeMs = e.probeMs;
+            r.errorTotal = e.errorTotal;
+            r.latencySec = e.latencySec;
+            r.partners = e.partners;
+            r.failingPartners = e.failingPartners;
+            r.status = static_cast<ProbeStatus>(e.status);
+            r.lag = static_cast<LagClass>(e.lag);
+            r.events = static_cast<EventState>(e.events);
+        }
+        snapshot->latency.Resize(model.Size());
+        for (size_t l = 0; l < LinkCount(); l++) {
+            ReplicationLink link = m_links[l];
+            if (link.source >= DcCount() || link.dest >= DcCount()) continue;
+            link.source = idOf[link.source];
+            link.dest = idOf[link.dest];
+            if (link.source == link.dest) continue;     // between two rows of one name
+            snapshot->links.push_back(link);
+        }
+        if (duplicates) {
+            // Remapped ends may repeat a link or break the (dest, source) order
+            auto key = [](const ReplicationLink& a) { return std::make_pair(a.dest, a.source); };
+            std::sort(snapshot->links.begin(), snapshot->links.end(),
+                      [&](const ReplicationLink& a, const ReplicationLink& b) { return key(a) < key(b); });
+            snapshot->links.erase(std::unique(snapshot->links.begin(), snapshot->links.end(),
+                                              [&](const ReplicationLink& a, const ReplicationLink& b) {
+                                                  return key(a) == key(b);
+                                              }), snapshot->links.end());
+        }
+        snapshot->spread = ComputeUsnSpread(model);
+        return snapshot;
+    }
+
+private:
+    static bool NameFits(const SnapshotName& n, uint32_t stringBytes) {
+        return n.offset <= stringBytes && n.length <= stringBytes - n.offset;
+    }
+
+    std::string_view Name(const SnapshotName& n) const { return std::string_view(m_strings + n.offset, n.length); }
+
+    MappedFile m_file;
+    const SnapshotFileHeader* m_header = nullptr;
+    const SnapshotDcEntry* m_dcs = nullptr;
+    const SnapshotName* m_sites = nullptr;
+    const uint32_t* m_eventIds = nullptr;
+    const uint32_t* m_eventCounts = nullptr;
+    const ReplicationLink* m_links = nullptr;
+    const char* m_strings = nullptr;
+    std::string m_error;
+};
+
+struct SnapshotDiffOptions {
+    uint32_t lagThresholdSec = 15 * 60;     // smaller latency moves are not reported
+};
+
+struct SnapshotDcChange {
+    std::string dc;
+    uint64_t before = 0;                // USN, failing partners or latency (kUnknownLatency when unknown)
+    uint64_t after = 0;
+    LagClass lagBefore = LagClass::Unknown;
+    LagClass lagAfter = LagClass::Unknown;
+};
+
+struct SnapshotDiff {
+    std::vector<std::string> added;
+    std::vector<std::string> removed;
+    std::vector<SnapshotDcChange> usnRegressions;   // USN went down: restored or rolled back DC
+    std::vector<SnapshotDcChange> newFailures;      // more failing inbound partners than before
+    std::vector<SnapshotDcChange> lagChanges;       // latency moved by the threshold or more, or the lag class changed
+
+    bool Empty() const {
+        return added.empty() && removed.empty() && usnRegressions.empty() && newFailures.empty() && lagChanges.empty();
+    }
+};
+
+// Compares two snapshots in one pass over each. DCs are matched by name:
+// scans of the same forest intern them in the same order, so the index is
+// tried first and a hash of the remaining names is only built when that
+// fails. Results follow the order of after (removed DCs: of before).
+inline SnapshotDiff DiffSnapshots(const SnapshotView& before, const SnapshotView& after,
+                                  const SnapshotDiffOptions& options = SnapshotDiffOptions()) {
+    SnapshotDiff diff;
+    const size_t nb = before.DcCount(), na = after.DcCount();
+    std::vector<uint32_t> match(na, kInvalidId);
+    std::vector<bool> matched(nb, false);
+    bool complete = true;
+    for (size_t i = 0; i < na; i++) {
+        if (i < nb && after.DcName(i) == before.DcName(i)) {
+            match[i] = static_cast<uint32_t>(i);
+            matched[i] = true;
+        } else {
+            complete = false;
+        }
+    }
+    if (!complete || na != nb) {
+        std::unordered_map<std::string_view, uint32_t> index;
+        for (size_t j = 0; j < nb; j++) {
+            if (!matched[j]) index.emplace(before.DcName(j), static_cast<uint32_t>(j));
+        }
+        for (size_t i = 0; i < na; i++) {
+            if (match[i] != kInvalidId) continue;
+            auto it = index.find(after.DcName(i));
+            if (it == index.end() || matched[it->second]) continue;
+            match[i] = it->second;
+            matched[it->second] = true;
+        }
+    }
+
+    auto change = [&](size_t i, uint64_t b, uint64_t a, const SnapshotDcEntry& eb, const SnapshotDcEntry& ea) {
+        SnapshotDcChange c;
+        c.dc = std::string(after.DcName(i));
+        c.before = b;
+        c.after = a;
+        c.lagBefore = static_cast<LagClass>(eb.lag);
+        c.lagAfter = static_cast<LagClass>(ea.lag);
+        return c;
+    };
+    const uint8_t ok = static_cast<uint8_t>(ProbeStatus::Ok);
+    for (size_t i = 0; i < na; i++) {
+        if (match[i] == kInvalidId) {
+            diff.added.emplace_back(after.DcName(i));
+            continue;
+        }
+        const SnapshotDcEntry& b = before.Dc(match[i]);
+        const SnapshotDcEntry& a = after.Dc(i);
+        if (b.status == ok && a.status == ok && a.usn < b.usn) diff.usnRegressions.push_back(change(i, b.usn, a.usn, b, a));
+        if (a.failingPartners > b.failingPartners) {
+            diff.newFailures.push_back(change(i, b.failingPartners, a.failingPartners, b, a));
+        }
+        bool lagMoved;
+        if (b.latencySec != kUnknownLatency && a.latencySec != kUnknownLatency) {
+            const uint32_t delta = a.latencySec > b.latencySec ? a.latencySec - b.latencySec : b.latencySec - a.latencySec;
+            lagMoved = delta >= options.lagThresholdSec;
+        } else {
+            const uint8_t unknown = static_cast<uint8_t>(LagClass::Unknown);
+            lagMoved = a.lag != b.lag && a.lag != unknown && b.lag != unknown;
+        }
+        if (lagMoved) diff.lagChanges.push_back(change(i, b.latencySec, a.latencySec, b, a));
+    }
+    for (size_t j = 0; j < nb; j++) {
+        if (!matched[j]) diff.removed.emplace_back(before.DcName(j));
+    }
+    return diff;
+}
@@ -0,0 +1,311 @@
+// SocketStream.h
+// Flux TCP ou socket Unix bloquants avec délais (Winsock / POSIX), pour le protocole collecteur-agrégateur
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+
+// "unix:/path" (POSIX only), "host:port" or ":port" / "port" (any address
+// when listening, loopback when connecting)
+struct SocketEndpoint {
+    bool local = false;                 // Unix domain socket
+    std::string host;
+    std::string port;
+    std::string path;
+
+    static bool Parse(const std::string& text, SocketEndpoint& out) {
+        out = SocketEndpoint();
+        if (text.compare(0, 5, "unix:") == 0) {
+            out.local = true;
+            out.path = text.substr(5);
+            return !out.path.empty();
+        }
+        size_t colon = text.rfind(':');
+        out.host = colon == std::string::npos ? std::string() : text.substr(0, colon);
+        out.port = colon == std::string::npos ? text : text.substr(colon + 1);
+        if (out.host.size() >= 2 && out.host.front() == '[' && out.host.back() == ']') {
+            out.host = out.host.substr(1, out.host.size() - 2);
+        }
+        return !out.port.empty() && out.port.find_first_not_of("0123456789") == std::string::npos;
+    }
+};
+
+// One connected or listening socket, closed on destruction. Reads and
+// writes block up to the timeout given; a timeout or a peer that closed
+// both read as false, Closed() tells which.
+class SocketStream {
+public:
+#ifdef _WIN32
+    typedef SOCKET Handle;
+    static constexpr Handle kInvalid = INVALID_SOCKET;
+#else
+    typedef int Handle;
+    static constexpr Handle kInvalid = -1;
+#endif
+
+    SocketStream() { Startup(); }
+    explicit SocketStream(Handle handle) : m_handle(handle) { Startup(); }
+    ~SocketStream() { Close(); }
+
+    SocketStream(const SocketStream&) = delete;
+    SocketStream& operator=(const SocketStream&) = delete;
+
+    SocketStream(SocketStream&& other) noexcept { *this = std::move(other); }
+    SocketStream& operator=(SocketStream&& other) noexcept {
+        if (this != &other) {
+            Close();
+            m_handle = other.m_handle;
+            m_closed = other.m_closed;
+            m_unlinkPath = std::move(other.m_unlinkPath);
+            other.m_handle = kInvalid;
+            other.m_unlinkPath.clear();
+        }
+        return *this;
+    }
+
+    bool Valid() const { return m_handle != kInvalid; }
+    bool Closed() const { return m_closed; }
+
+    bool Connect(const SocketEndpoint& endpoint, std::chrono::milliseconds timeout) {
+        Close();
+        if (endpoint.local) {
+#ifdef _WIN32
+            return false;
+#else
+            sockaddr_un addr = {};
+            if (!LocalAddress(endpoint.path, addr)) return false;
+            m_handle = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (m_handle == kInvalid) return false;
+            if (::connect(m_handle, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+                Close();
+                return false;
+            }
+            return true;
+#endif
+        }
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* list = nullptr;
+        const std::string host = endpoint.host.empty() ? std::string("127.0.0.1") : endpoint.host;
+        if (getaddrinfo(host.c_str(), endpoint.port.c_str(), &hints, &list) != 0) return false;
+        for (addrinfo* a = list; a; a = a->ai_next) {
+            m_handle = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (m_handle == kInvalid) continue;
+            if (ConnectWithin(a->ai_addr, static_cast<int>(a->ai_addrlen), timeout)) break;
+            Close();
+        }
+        freeaddrinfo(list);
+        if (!Valid()) return false;
+        int one = 1;
+        setsockopt(m_handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof(one));
+        return true;
+    }
+
+    // A Unix socket path left by a previous run is replaced
+    bool Listen(const SocketEndpoint& endpoint, int backlog = 64) {
+        Close();
+        if (endpoint.local) {
+#ifdef _WIN32
+            return false;
+#else
+            sockaddr_un addr = {};
+            if (!LocalAddress(endpoint.path, addr)) return false;
+            ::unlink(endpoint.path.c_str());
+            m_handle = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (m_handle == kInvalid) return false;
+            if (::bind(m_handle, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(m_handle, backlog) != 0) {
+                Close();
+                return false;
+            }
+            m_unlinkPath = endpoint.path;
+            return true;
+#endif
+        }
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo* list = nullptr;
+        if (getaddrinfo(endpoint.host.empty() ? nullptr : endpoint.host.c_str(), endpoint.port.c_str(), &hints, &list) != 0) {
+            return false;
+        }
+        for (addrinfo* a = list; a; a = a->ai_next) {
+            m_handle = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (m_handle == kInvalid) continue;
+            int one = 1;
+            setsockopt(m_handle, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&one), sizeof(one));
+            if (::bind(m_handle, a->ai_addr, static_cast<int>(a->ai_addrlen)) == 0 && ::listen(m_handle, backlog) == 0) break;
+            Close();
+        }
+        freeaddrinfo(list);
+        return Valid();
+    }
+
+    // Invalid stream when nothing arrived within timeout
+    SocketStream Accept(std::chrono::milliseconds timeout) {
+        if (!Wait(POLLIN, timeout)) return SocketStream();
+        SocketStream s(::accept(m_handle, nullptr, nullptr));
+        if (s.Valid() && m_unlinkPath.empty()) {
+            int one = 1;
+            setsockopt(s.m_handle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof(one));
+        }
+        return s;
+    }
+
+    bool SendAll(const void* data, size_t size) {
+        const char* p = static_cast<const char*>(data);
+        while (size > 0) {
+#ifdef _WIN32
+            int n = ::send(m_handle, p, static_cast<int>(size > (1u << 30) ? (1u << 30) : size), 0);
+#else
+            ssize_t n = ::send(m_handle, p, size, MSG_NOSIGNAL);
+#endif
+            if (n <= 0) {
+                m_closed = true;
+                return false;
+            }
+            p += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    // All size bytes, each chunk within timeout of the previous one
+    bool ReceiveAll(void* data, size_t size, std::chrono::milliseconds timeout) {
+        char* p = static_cast<char*>(data);
+        while (size > 0) {
+            if (!Wait(POLLIN, timeout)) return false;
+#ifdef _WIN32
+            int n = ::recv(m_handle, p, static_cast<int>(size > (1u << 30) ? (1u << 30) : size), 0);
+#else
+            ssize_t n = ::recv(m_handle, p, size, 0);
+#endif
+            if (n <= 0) {
+                m_closed = true;
+                return false;
+            }
+            p += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    // True when data (or the peer's close) is ready within timeout
+    bool Readable(std::chrono::milliseconds timeout) { return Wait(POLLIN, timeout); }
+
+    // Wakes a thread blocked on this socket; Close() still has to follow
+    void Shutdown() {
+#ifdef _WIN32
+        if (Valid()) ::shutdown(m_handle, SD_BOTH);
+#else
+        if (Valid()) ::shutdown(m_handle, SHUT_RDWR);
+#endif
+    }
+
+    void Close() {
+        if (m_handle != kInvalid) {
+#ifdef _WIN32
+            ::closesocket(m_handle);
+#else
+            ::close(m_handle);
+#endif
+            m_handle = kInvalid;
+        }
+#ifndef _WIN32
+        if (!m_unlinkPath.empty()) ::unlink(m_unlinkPath.c_str());
+#endif
+        m_unlinkPath.clear();
+    }
+
+private:
+    static void Startup() {
+#ifdef _WIN32
+        static const bool started = [] {
+            WSADATA data;
+            return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+        }();
+        (void)started;
+#endif
+    }
+
+#ifndef _WIN32
+    static bool LocalAddress(const std::string& path, sockaddr_un& addr) {
+        if (path.size() >= sizeof(addr.sun_path)) return false;
+        addr.sun_family = AF_UNIX;
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        return true;
+    }
+#endif
+
+    bool Wait(short events, std::chrono::milliseconds timeout) {
+        if (!Valid()) return false;
+#ifdef _WIN32
+        WSAPOLLFD fd = {};
+        fd.fd = m_handle;
+        fd.events = events;
+        int n = WSAPoll(&fd, 1, static_cast<INT>(timeout.count()));
+#else
+        pollfd fd = {};
+        fd.fd = m_handle;
+        fd.events = events;
+        int n = ::poll(&fd, 1, static_cast<int>(timeout.count()));
+#endif
+        return n > 0;
+    }
+
+    bool ConnectWithin(const sockaddr* addr, int length, std::chrono::milliseconds timeout) {
+#ifdef _WIN32
+        u_long nonBlocking = 1;
+        ioctlsocket(m_handle, FIONBIO, &nonBlocking);
+        int rc = ::connect(m_handle, addr, length);
+        bool ok = rc == 0 || (WSAGetLastError() == WSAEWOULDBLOCK && Wait(POLLOUT, timeout));
+        nonBlocking = 0;
+        ioctlsocket(m_handle, FIONBIO, &nonBlocking);
+#else
+        const int flags = fcntl(m_handle, F_GETFL, 0);
+        fcntl(m_handle, F_SETFL, flags | O_NONBLOCK);
+        int rc = ::connect(m_handle, addr, static_cast<socklen_t>(length));
+        bool ok = rc == 0 || (errno == EINPROGRESS && Wait(POLLOUT, timeout));
+        fcntl(m_handle, F_SETFL, flags);
+#endif
+        if (!ok) return false;
+        int error = 0;
+#ifdef _WIN32
+        int size = sizeof(error);
+#else
+        socklen_t size = sizeof(error);
+#endif
+        getsockopt(m_handle, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error), &size);
+        return error == 0;
+    }
+
+    Handle m_handle = kInvalid;
+    bool m_closed = false;
+    std::string m_unlinkPath;           // listening Unix socket, removed on close
+};
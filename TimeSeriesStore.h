@@ -0,0 +1,397 @@
+// TimeSeriesStore.h
+// Historique USN / latence / erreurs : segments projetés en mémoire, enregistrements fixes, USN en delta
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "MappedFile.h"
+#include "Utf8.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct TimeSample {
+    int64_t time = 0;                   // Unix ms
+    uint64_t usn = 0;
+    uint32_t lagSec = 0;
+    uint16_t errors = 0;
+};
+
+struct TimeSeriesOptions {
+    std::chrono::hours segmentSpan{24};             // at most 49 days (32-bit ms offsets)
+    std::chrono::hours retention{24 * 35};
+    uint32_t keyframeInterval = 256;                // samples between full USNs in a series
+};
+
+// On-disk record, 24 bytes. Keyframes hold the full USN (48 bits, far above
+// any real DC); the others hold the delta from the previous sample of the
+// same series. Records of one series are linked forward through `next`.
+struct SampleRecord {
+    uint32_t series;
+    uint32_t timeOffsetMs;              // from the segment's base time
+    uint32_t next;                      // next record of the series in this segment
+    uint32_t lagSec;
+    uint32_t usnLow;                    // keyframe: bits 0..31, otherwise the delta
+    uint16_t usnHigh;                   // keyframe: bits 32..47
+    uint16_t errors;                    // top bit: keyframe
+
+    static const uint16_t kKeyframe = 0x8000;
+    bool IsKeyframe() const { return (errors & kKeyframe) != 0; }
+};
+
+static_assert(sizeof(SampleRecord) == 24, "SampleRecord must stay 24 bytes");
+
+// Append-only store of per-DC and per-link samples. Time is cut into
+// segments (one file each, named after their base time); the newest segment
+// is mapped read-write and grown by doubling, older ones are read-only.
+// Each segment keeps a small in-memory index of keyframes per series, so a
+// range query seeks to the keyframe before `from` and then follows the
+// series chain, touching only that series' records.
+// Appends must be in time order. One writer, any number of readers.
+class TimeSeriesStore {
+public:
+    static const uint32_t kNoRecord = 0xFFFFFFFF;
+
+    ~TimeSeriesStore() { Close(); }
+
+    bool Open(const std::wstring& directory, const TimeSeriesOptions& options = TimeSeriesOptions()) {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        CloseLocked();
+        m_options = options;
+        m_spanMs = std::chrono::duration_cast<std::chrono::milliseconds>(options.segmentSpan).count();
+        m_spanMs = std::min<int64_t>(std::max<int64_t>(m_spanMs, 60000), 0xFFFFFFFFll);
+        if (m_options.keyframeInterval == 0) m_options.keyframeInterval = 1;
+        m_directory = std::filesystem::path(directory);
+
+        std::error_code ec;
+        std::filesystem::create_directories(m_directory, ec);
+        if (!std::filesystem::is_directory(m_directory, ec)) return false;
+
+        LoadCatalog();
+
+        std::vector<std::filesystem::path> files;
+        for (const auto& entry : std::filesystem::directory_iterator(m_directory, ec)) {
+            std::string stem = entry.path().stem().string();
+            if (entry.path().extension() != ".tss" || stem.empty() ||
+                stem.find_first_not_of("-0123456789") != std::string::npos) continue;
+            files.push_back(entry.path());
+        }
+        std::sort(files.begin(), files.end(), [](const std::filesystem::path& a, const std::filesystem::path& b) {
+            return std::strtoll(a.stem().string().c_str(), nullptr, 10) < std::strtoll(b.stem().string().c_str(), nullptr, 10);
+        });
+        for (size_t i = 0; i < files.size(); i++) {
+            auto segment = std::make_unique<Segment>();
+            if (!segment->Load(files[i].wstring(), i + 1 == files.size())) continue;
+            m_segments.push_back(std::move(segment));
+        }
+        if (!m_segments.empty()) {
+            const Segment& last = *m_segments.back();
+            m_lastTime = last.count ? last.TimeOf(static_cast<uint32_t>(last.count - 1)) : last.baseTime;
+        }
+        return true;
+    }
+
+    void Close() {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        CloseLocked();
+    }
+
+    // Returns the ID of a series, creating it on first use. Names are free
+    // form; the scan uses "dc:<name>" and "link:<dest>|<source>|<nc>".
+    uint32_t SeriesId(const std::wstring& name) {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        auto it = m_seriesIds.find(name);
+        if (it != m_seriesIds.end()) return it->second;
+
+        uint32_t id = static_cast<uint32_t>(m_seriesNames.size());
+        m_seriesNames.push_back(name);
+        m_seriesIds.emplace(name, id);
+        std::ofstream out(m_directory / "series.txt", std::ios::binary | std::ios::app);
+        out << WideToUtf8(name) << '\n';
+        return id;
+    }
+
+    uint32_t FindSeries(const std::wstring& name) const {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        auto it = m_seriesIds.find(name);
+        return it == m_seriesIds.end() ? kNoRecord : it->second;
+    }
+
+    bool Append(uint32_t series, const TimeSample& sample) {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        if (series >= m_seriesNames.size() || sample.time < m_lastTime) return false;
+
+        if (m_segments.empty() || sample.time >= m_segments.back()->baseTime + m_segments.back()->span) {
+            if (!Rollover(sample.time)) return false;
+        }
+        Segment& seg = *m_segments.back();
+        if (!seg.Reserve(seg.count + 1)) return false;
+
+        SeriesIndex& idx = seg.Series(series);
+        SampleRecord rec;
+        rec.series = series;
+        rec.timeOffsetMs = static_cast<uint32_t>(sample.time - seg.baseTime);
+        rec.next = kNoRecord;
+        rec.lagSec = sample.lagSec;
+        rec.errors = std::min<uint16_t>(sample.errors, SampleRecord::kKeyframe - 1);
+
+        bool keyframe = idx.last == kNoRecord || idx.sinceKeyframe + 1 >= m_options.keyframeInterval ||
+                        sample.usn < idx.lastUsn || sample.usn - idx.lastUsn > 0xFFFFFFFFull;
+        if (keyframe) {
+            rec.usnLow = static_cast<uint32_t>(sample.usn);
+            rec.usnHigh = static_cast<uint16_t>(sample.usn >> 32);
+            rec.errors |= SampleRecord::kKeyframe;
+        } else {
+            rec.usnLow = static_cast<uint32_t>(sample.usn - idx.lastUsn);
+            rec.usnHigh = 0;
+        }
+
+        uint32_t index = static_cast<uint32_t>(seg.count);
+        seg.Records()[index] = rec;
+        if (idx.last != kNoRecord) seg.Records()[idx.last].next = index;
+        seg.SetCount(seg.count + 1);            // published after the record is in place
+
+        idx.last = index;
+        idx.lastUsn = keyframe ? (sample.usn & 0xFFFFFFFFFFFFull) : idx.lastUsn + rec.usnLow;
+        idx.sinceKeyframe = keyframe ? 0 : idx.sinceKeyframe + 1;
+        if (keyframe) idx.keyframes.push_back({rec.timeOffsetMs, index});
+        m_lastTime = sample.time;
+        return true;
+    }
+
+    // Appends the samples of [from, to] to out, oldest first
+    size_t Query(uint32_t series, int64_t from, int64_t to, std::vector<TimeSample>& out) const {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        size_t before = out.size();
+        for (const auto& segPtr : m_segments) {
+            const Segment& seg = *segPtr;
+            if (seg.baseTime + seg.span <= from || seg.baseTime > to) continue;
+            if (series >= seg.series.size() || seg.series[series].keyframes.empty()) continue;
+
+            // Start at the last keyframe at or before `from`
+            const auto& kf = seg.series[series].keyframes;
+            int64_t rel = std::max<int64_t>(0, from - seg.baseTime);
+            auto it = std::upper_bound(kf.begin(), kf.end(), rel, [](int64_t t, const std::pair<uint32_t, uint32_t>& k) {
+                return t < static_cast<int64_t>(k.first);
+            });
+            if (it != kf.begin()) --it;
+
+            const SampleRecord* records = seg.Records();
+            uint64_t usn = 0;
+            for (uint32_t i = it->second; i != kNoRecord && i < seg.count; i = records[i].next) {
+                const SampleRecord& r = records[i];
+                usn = r.IsKeyframe() ? (static_cast<uint64_t>(r.usnHigh) << 32 | r.usnLow) : usn + r.usnLow;
+                int64_t t = seg.baseTime + r.timeOffsetMs;
+                if (t > to) break;
+                if (t < from) continue;
+                out.push_back({t, usn, r.lagSec, static_cast<uint16_t>(r.errors & ~SampleRecord::kKeyframe)});
+            }
+        }
+        return out.size() - before;
+    }
+
+    // Deletes segments that ended before now - retention
+    size_t EnforceRetention(int64_t now) {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        return EnforceRetentionLocked(now);
+    }
+
+    void Flush() {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        if (!m_segments.empty()) m_segments.back()->file.Flush();
+    }
+
+    size_t SegmentCount() const {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        return m_segments.size();
+    }
+
+    size_t SeriesCount() const {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        return m_seriesNames.size();
+    }
+
+    uint64_t RecordCount() const {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        uint64_t n = 0;
+        for (const auto& s : m_segments) n += s->count;
+        return n;
+    }
+
+private:
+    struct SegmentHeader {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t recordSize;
+        int64_t baseTime;
+        int64_t span;
+        uint64_t count;
+    };
+
+    static const uint32_t kMagic = 0x53544441;     // "ADTS"
+
+    struct SeriesIndex {
+        uint32_t last = kNoRecord;
+        uint32_t sinceKeyframe = 0;
+        uint64_t lastUsn = 0;
+        std::vector<std::pair<uint32_t, uint32_t>> keyframes;  // (time offset, record)
+    };
+
+    struct Segment {
+        MappedFile file;
+        std::wstring path;
+        int64_t baseTime = 0;
+        int64_t span = 0;
+        uint64_t count = 0;
+        std::vector<SeriesIndex> series;
+
+        SampleRecord* Records() { return reinterpret_cast<SampleRecord*>(file.Data() + sizeof(SegmentHeader)); }
+        const SampleRecord* Records() const { return reinterpret_cast<const SampleRecord*>(file.Data() + sizeof(SegmentHeader)); }
+        uint64_t Capacity() const { return (file.Size() - sizeof(SegmentHeader)) / sizeof(SampleRecord); }
+        int64_t TimeOf(uint32_t i) const { return baseTime + Records()[i].timeOffsetMs; }
+
+        SeriesIndex& Series(uint32_t id) {
+            if (id >= series.size()) series.resize(static_cast<size_t>(id) + 1);
+            return series[id];
+        }
+
+        void SetCount(uint64_t n) {
+            count = n;
+            reinterpret_cast<SegmentHeader*>(file.Data())->count = n;
+        }
+
+        bool Create(const std::wstring& filePath, int64_t base, int64_t spanMs) {
+            path = filePath;
+            if (!file.Open(filePath, true, sizeof(SegmentHeader) + 4096 * sizeof(SampleRecord))) return false;
+            SegmentHeader header = {kMagic, 1, static_cast<uint16_t>(sizeof(SampleRecord)), base, spanMs, 0};
+            std::memcpy(file.Data(), &header, sizeof(header));
+            baseTime = base;
+            span = spanMs;
+            count = 0;
+            return true;
+        }
+
+        bool Load(const std::wstring& filePath, bool writable) {
+            path = filePath;
+            if (!file.Open(filePath, writable) || file.Size() < sizeof(SegmentHeader)) return false;
+            SegmentHeader header;
+            std::memcpy(&header, file.Data(), sizeof(header));
+            if (header.magic != kMagic || header.recordSize != sizeof(SampleRecord)) return false;
+            baseTime = header.baseTime;
+            span = header.span;
+            count = std::min<uint64_t>(header.count, Capacity());   // a torn write loses the tail only
+
+            // Rebuild the per-series index; records are in time order
+            const SampleRecord* records = Records();
+            for (uint32_t i = 0; i < count; i++) {
+                const SampleRecord& r = records[i];
+                SeriesIndex& idx = Series(r.series);
+                if (r.IsKeyframe()) {
+                    idx.lastUsn = static_cast<uint64_t>(r.usnHigh) << 32 | r.usnLow;
+                    idx.sinceKeyframe = 0;
+                    idx.keyframes.push_back({r.timeOffsetMs, i});
+                } else {
+                    idx.lastUsn += r.usnLow;
+                    idx.sinceKeyframe++;
+                }
+                idx.last = i;
+            }
+            return true;
+        }
+
+        bool Reserve(uint64_t records) {
+            if (records <= Capacity()) return true;
+            if (records >= kNoRecord) return false;
+            uint64_t capacity = std::max<uint64_t>(Capacity() * 2, records);
+            return file.Resize(sizeof(SegmentHeader) + static_cast<size_t>(capacity) * sizeof(SampleRecord));
+        }
+
+        // Trims the unused tail once the segment stops receiving samples
+        void Seal() {
+            if (file.Size() > sizeof(SegmentHeader) + count * sizeof(SampleRecord)) {
+                file.Resize(sizeof(SegmentHeader) + static_cast<size_t>(count) * sizeof(SampleRecord));
+            }
+            file.Flush();
+        }
+    };
+
+    bool Rollover(int64_t time) {
+        if (!m_segments.empty()) {
+            Segment& previous = *m_segments.back();
+            previous.Seal();
+            // Reopen read-only so a stray write cannot corrupt sealed history
+            std::wstring path = previous.path;
+            auto sealed = std::make_unique<Segment>();
+            if (sealed->Load(path, false)) m_segments.back() = std::move(sealed);
+        }
+        EnforceRetentionLocked(time);
+
+        int64_t base = time - ((time % m_spanMs) + m_spanMs) % m_spanMs;
+        auto segment = std::make_unique<Segment>();
+        std::wstring path = (m_directory / (std::to_string(base) + ".tss")).wstring();
+        if (!segment->Create(path, base, m_spanMs)) return false;
+        m_segments.push_back(std::move(segment));
+        return true;
+    }
+
+    size_t EnforceRetentionLocked(int64_t now) {
+        int64_t cutoff = now - std::chrono::duration_cast<std::chrono::milliseconds>(m_options.retention).count();
+        size_t removed = 0;
+        while (m_segments.size() > 1 && m_segments.front()->baseTime + m_segments.front()->span <= cutoff) {
+            std::wstring path = m_segments.front()->path;
+            m_segments.erase(m_segments.begin());
+            std::error_code ec;
+            std::filesystem::remove(std::filesystem::path(path), ec);
+            removed++;
+        }
+        return removed;
+    }
+
+    void LoadCatalog() {
+        m_seriesNames.clear();
+        m_seriesIds.clear();
+        std::ifstream in(m_directory / "series.txt", std::ios::binary);
+        std::string line;
+        while (std::getline(in, line)) {
+            std::wstring name = Utf8ToWide(line);
+            m_seriesIds.emplace(name, static_cast<uint32_t>(m_seriesNames.size()));
+            m_seriesNames.push_back(std::move(name));
+        }
+    }
+
+    void CloseLocked() {
+        if (!m_segments.empty() && m_segments.back()->file.IsOpen()) m_segments.back()->Seal();
+        m_segments.clear();
+        m_seriesNames.clear();
+        m_seriesIds.clear();
+        m_lastTime = 0;
+    }
+
+    mutable std::shared_mutex m_mutex;
+    TimeSeriesOptions m_options;
+    int64_t m_spanMs = 0;
+    std::filesystem::path m_directory;
+    std::vector<std::unique_ptr<Segment>> m_segments;
+    std::vector<std::wstring> m_seriesNames;
+    std::unordered_map<std::wstring, uint32_t> m_seriesIds;
+    int64_t m_lastTime = 0;
+};
+
+// USN changes per hour between the first and last sample, 0 if undefined
+inline double UsnRatePerHour(const std::vector<TimeSample>& samples) {
+    if (samples.size() < 2 || samples.back().time <= samples.front().time) return 0.0;
+    if (samples.back().usn < samples.front().usn) return 0.0;
+    double hours = static_cast<double>(samples.back().time - samples.front().time) / 3600000.0;
+    return static_cast<double>(samples.back().usn - samples.front().usn) / hours;
+}
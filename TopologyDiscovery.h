@@ -0,0 +1,212 @@
+// TopologyDiscovery.h
+// Découverte de la topologie (sites, serveurs, nTDSDSA, nTDSConnection) en une seule recherche paginée
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "DirectoryBackend.h"
+#include "DistinguishedName.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cwchar>
+#include <cwctype>
+#include <string>
+#include <vector>
+
+struct SiteInfo {
+    std::wstring name;
+    std::wstring dn;
+};
+
+struct ServerInfo {
+    std::wstring name;
+    std::wstring dnsHostName;
+    std::wstring dn;
+    std::wstring ntdsDsaDn;             // empty if the server is not a DC
+    std::wstring invocationId;
+    std::vector<std::wstring> masterNCs;
+    uint32_t site = 0;
+
+    bool IsDc() const { return !ntdsDsaDn.empty(); }
+    // Name used to reach the DC over LDAP
+    const std::wstring& HostName() const { return dnsHostName.empty() ? name : dnsHostName; }
+};
+
+struct ConnectionInfo {
+    uint32_t fromServer = 0;
+    uint32_t toServer = 0;
+    uint32_t options = 0;
+    bool enabled = true;
+};
+
+// Site link of the IP or SMTP transport (CN=Inter-Site Transports)
+struct SiteLinkInfo {
+    std::wstring name;
+    std::vector<uint32_t> sites;        // indices into ForestTopology::sites
+    uint32_t cost = 100;
+    uint32_t replIntervalMin = 180;
+};
+
+struct ForestTopology {
+    std::wstring configurationDn;
+    std::vector<SiteInfo> sites;
+    std::vector<ServerInfo> servers;    // sorted by site, then name
+    std::vector<ConnectionInfo> connections;
+    std::vector<SiteLinkInfo> siteLinks;
+    size_t entriesRead = 0;
+};
+
+inline std::wstring DnKey(const std::wstring& dn) {
+    std::wstring key(dn);
+    for (auto& c : key) c = static_cast<wchar_t>(towlower(c));
+    return key;
+}
+
+inline bool HasObjectClass(const DirectoryEntry& entry, const wchar_t* cls) {
+    const auto* values = entry.Find(L"objectClass");
+    if (!values) return false;
+    for (const auto& v : *values) {
+        if (DnTextEquals(v, cls)) return true;
+    }
+    return false;
+}
+
+// The paged subtree search under CN=Sites that returns every object the
+// scan needs, site links included (they live under CN=Inter-Site Transports)
+inline SearchRequest TopologySearchRequest(const std::wstring& configurationDn, const std::wstring& server = std::wstring()) {
+    SearchRequest request;
+    request.server = server;
+    request.baseDn = ChildDn(L"CN", L"Sites", configurationDn);
+    request.filter = L"(|(objectClass=site)(objectClass=server)(objectClass=nTDSDSA)(objectClass=nTDSConnection)"
+                     L"(objectClass=siteLink))";
+    request.attributes = {L"objectClass", L"name", L"dNSHostName", L"invocationId",
+                          L"msDS-hasMasterNCs", L"hasMasterNCs", L"fromServer",
+                          L"enabledConnection", L"options", L"siteList", L"cost", L"replInterval"};
+    request.pageSize = 1000;
+    return request;
+}
+
+// One paged subtree search (TopologySearchRequest) returns every object the
+// scan needs; relationships are rebuilt from the DN hierarchy afterwards, so the
+// order in which the server returns entries does not matter. DNs are interned
+// once: parents are table lookups and the indexes below vectors by DnId.
+inline bool DiscoverTopology(IDirectoryBackend& backend, const std::wstring& configurationDn,
+                             ForestTopology& topology, const std::wstring& server = std::wstring()) {
+    topology = ForestTopology();
+    topology.configurationDn = configurationDn;
+    const SearchRequest request = TopologySearchRequest(configurationDn, server);
+
+    std::vector<DirectoryEntry> servers, dsas, connections, siteLinks;
+    std::vector<SiteInfo> sites;
+
+    bool ok = backend.SearchSubtree(request, [&](const DirectoryEntry& entry) {
+        topology.entriesRead++;
+        if (HasObjectClass(entry, L"nTDSConnection")) {
+            connections.push_back(entry);
+        } else if (HasObjectClass(entry, L"siteLink")) {
+            siteLinks.push_back(entry);
+        } else if (HasObjectClass(entry, L"nTDSDSA")) {
+            dsas.push_back(entry);
+        } else if (HasObjectClass(entry, L"server")) {
+            servers.push_back(entry);
+        } else if (HasObjectClass(entry, L"site")) {
+            std::wstring name = entry.First(L"name");
+            sites.push_back({name.empty() ? FirstRdnValue(entry.dn) : name, entry.dn});
+        }
+    });
+    if (!ok) return false;
+
+    const uint32_t kNone = 0xFFFFFFFFu;
+    DnTable dns;
+    auto set = [&](std::vector<uint32_t>& index, DnId dn, uint32_t value) {
+        if (dn == kInvalidDn) return;
+        if (dn >= index.size()) index.resize(dn + 1, kNone);
+        index[dn] = value;
+    };
+    auto get = [&](const std::vector<uint32_t>& index, DnId dn) { return dn < index.size() ? index[dn] : kNone; };
+
+    std::sort(sites.begin(), sites.end(), [](const SiteInfo& a, const SiteInfo& b) { return a.name < b.name; });
+    std::vector<uint32_t> siteByDn;
+    for (uint32_t i = 0; i < sites.size(); i++) set(siteByDn, dns.Intern(sites[i].dn), i);
+    topology.sites = std::move(sites);
+
+    // Servers live under CN=Servers,<site>
+    std::vector<uint32_t> serverByDn, serverByDsa;
+    std::vector<DnId> serverDns;
+    for (const auto& entry : servers) {
+        const DnId dn = dns.Intern(entry.dn);
+        const uint32_t site = get(siteByDn, dns.Parent(dns.Parent(dn)));
+        if (site == kNone) continue;
+
+        ServerInfo info;
+        info.name = entry.First(L"name");
+        if (info.name.empty()) info.name = FirstRdnValue(entry.dn);
+        info.dnsHostName = entry.First(L"dNSHostName");
+        info.dn = entry.dn;
+        info.site = site;
+        topology.servers.push_back(std::move(info));
+        serverDns.push_back(dn);
+    }
+    std::vector<uint32_t> order(topology.servers.size());
+    for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        const ServerInfo& x = topology.servers[a];
+        const ServerInfo& y = topology.servers[b];
+        return x.site != y.site ? x.site < y.site : x.name < y.name;
+    });
+    std::vector<ServerInfo> sorted;
+    sorted.reserve(order.size());
+    for (uint32_t i = 0; i < order.size(); i++) {
+        sorted.push_back(std::move(topology.servers[order[i]]));
+        set(serverByDn, serverDns[order[i]], i);
+    }
+    topology.servers = std::move(sorted);
+
+    // NTDS Settings objects mark the servers that are actual DCs
+    for (const auto& entry : dsas) {
+        const DnId dn = dns.Intern(entry.dn);
+        const uint32_t srv = get(serverByDn, dns.Parent(dn));
+        if (srv == kNone) continue;
+        ServerInfo& info = topology.servers[srv];
+        info.ntdsDsaDn = entry.dn;
+        info.invocationId = entry.First(L"invocationId");
+        const auto* ncs = entry.Find(L"msDS-hasMasterNCs");
+        if (!ncs || ncs->empty()) ncs = entry.Find(L"hasMasterNCs");
+        if (ncs) info.masterNCs = *ncs;
+        set(serverByDsa, dn, srv);
+    }
+
+    // Connections live under the destination's NTDS Settings
+    for (const auto& entry : connections) {
+        const uint32_t to = get(serverByDsa, dns.Parent(dns.Intern(entry.dn)));
+        const uint32_t from = get(serverByDsa, dns.Intern(entry.First(L"fromServer")));
+        if (to == kNone || from == kNone) continue;
+
+        ConnectionInfo conn;
+        conn.fromServer = from;
+        conn.toServer = to;
+        std::wstring enabled = entry.First(L"enabledConnection");
+        conn.enabled = enabled.empty() || DnTextEquals(enabled, L"true");
+        conn.options = static_cast<uint32_t>(std::wcstoul(entry.First(L"options").c_str(), nullptr, 10));
+        topology.connections.push_back(conn);
+    }
+
+    for (const auto& entry : siteLinks) {
+        SiteLinkInfo link;
+        link.name = entry.First(L"name");
+        if (link.name.empty()) link.name = FirstRdnValue(entry.dn);
+        if (const auto* list = entry.Find(L"siteList")) {
+            for (const auto& dn : *list) {
+                const uint32_t site = get(siteByDn, dns.Intern(dn));
+                if (site != kNone) link.sites.push_back(site);
+            }
+        }
+        std::wstring cost = entry.First(L"cost"), interval = entry.First(L"replInterval");
+        if (!cost.empty()) link.cost = static_cast<uint32_t>(std::wcstoul(cost.c_str(), nullptr, 10));
+        if (!interval.empty()) link.replIntervalMin = static_cast<uint32_t>(std::wcstoul(interval.c_str(), nullptr, 10));
+        if (link.sites.size() > 1) topology.siteLinks.push_back(std::move(link));
+    }
+
+    return true;
+}
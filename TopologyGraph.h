@@ -0,0 +1,566 @@
+// TopologyGraph.h
+// Graphe de réplication en CSR : sauts, délais de propagation, bornes de fraîcheur transitives, points d'articulation
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "LatencyMatrix.h"
+#include "ParallelFor.h"
+#include "ReplicationModel.h"
+#include "ScanSnapshot.h"
+#include "TopologyDiscovery.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Delay charged to a link by configuration alone
+struct LinkScheduleOptions {
+    uint32_t intraSiteSec = 5 * 60;     // change notification, with margin for the partner stagger
+    uint32_t interSiteSec = 180 * 60;   // replInterval of a site link that does not set one
+};
+
+// Replication links of the scan from its enabled nTDSConnection objects.
+// dcOfServer maps topology.servers indices to DcIds (kInvalidId for member
+// servers). Between sites the schedule is the shortest replInterval of the
+// site links joining both sites, the default interval when none does.
+inline std::vector<ReplicationLink> BuildReplicationLinks(const ForestTopology& topology, const std::vector<DcId>& dcOfServer,
+                                                          const LinkScheduleOptions& options = LinkScheduleOptions()) {
+    std::unordered_map<uint64_t, uint32_t> intervalOfSites;
+    for (const SiteLinkInfo& link : topology.siteLinks) {
+        uint32_t sec = link.replIntervalMin ? link.replIntervalMin * 60 : options.interSiteSec;
+        for (uint32_t a : link.sites) {
+            for (uint32_t b : link.sites) {
+                if (a == b) continue;
+                auto it = intervalOfSites.emplace((static_cast<uint64_t>(a) << 32) | b, sec).first;
+                it->second = std::min(it->second, sec);
+            }
+        }
+    }
+
+    std::vector<ReplicationLink> links;
+    for (const ConnectionInfo& c : topology.connections) {
+        if (!c.enabled || c.fromServer >= dcOfServer.size() || c.toServer >= dcOfServer.size()) continue;
+        ReplicationLink link;
+        link.source = dcOfServer[c.fromServer];
+        link.dest = dcOfServer[c.toServer];
+        if (link.source == kInvalidId || link.dest == kInvalidId || link.source == link.dest) continue;
+        uint32_t from = topology.servers[c.fromServer].site, to = topology.servers[c.toServer].site;
+        if (from == to) {
+            link.scheduleSec = options.intraSiteSec;
+        } else {
+            auto it = intervalOfSites.find((static_cast<uint64_t>(from) << 32) | to);
+            link.scheduleSec = it != intervalOfSites.end() ? it->second : options.interSiteSec;
+        }
+        links.push_back(link);
+    }
+    std::sort(links.begin(), links.end(), [](const ReplicationLink& a, const ReplicationLink& b) {
+        return a.dest != b.dest ? a.dest < b.dest : a.source < b.source;
+    });
+    links.erase(std::unique(links.begin(), links.end(), [](const ReplicationLink& a, const ReplicationLink& b) {
+        return a.dest == b.dest && a.source == b.source;
+    }), links.end());
+    return links;
+}
+
+// Directed replication graph, source -> destination, in compressed sparse
+// row form (out-edges sorted by destination, plus an in-edge index).
+// Delays are seconds. For every DC the graph keeps its staleness bound:
+// the longest shortest-path delay and hop count from any DC whose changes
+// reach it, the DC that sets it (the witness) and how many DCs reach it.
+// The worst bound is the forest's end-to-end convergence time.
+//
+// Bounds are computed per destination on the reversed graph, in parallel.
+// UpdateEdge() changes one delay and only re-runs the sources whose
+// shortest-path trees the edge can be on, then the destinations that lost
+// their witness. Weakly connected structure (articulation points, islands)
+// ignores direction: replication between two DCs needs a live path, and a
+// KCC rebuild would route around a one-way cut.
+class TopologyGraph {
+public:
+    static constexpr uint32_t kUnreachable = std::numeric_limits<uint32_t>::max();
+    static constexpr uint32_t kNoEdge = std::numeric_limits<uint32_t>::max();
+
+    enum class Metric : uint8_t { Delay, Hops };
+
+    struct Edge {
+        DcId source = kInvalidId;
+        DcId dest = kInvalidId;
+        uint32_t delaySec = 0;          // kUnreachable: the link is down
+    };
+
+    struct StalenessBound {
+        uint32_t delaySec = 0;          // longest shortest-path delay from a DC reaching this one
+        DcId worstSource = kInvalidId;  // the DC that sets it
+        uint32_t hops = 0;              // longest shortest hop count from a DC reaching this one
+        uint32_t sources = 0;           // DCs whose changes reach this one
+    };
+
+    struct UpdateStats {
+        size_t sourcesRerun = 0;
+        size_t destinationsRerun = 0;
+        bool full = false;              // fell back to ComputeBounds()
+    };
+
+    // Islands left when one DC goes away, within the component it belonged
+    // to: the mainland is the largest piece left, isolated sites have DCs on
+    // the other pieces and none on the mainland. Parts of the forest already
+    // cut off from that DC are not counted.
+    struct Partition {
+        std::vector<std::vector<DcId>> islands;
+        std::vector<SiteId> isolatedSites;
+    };
+
+    TopologyGraph() = default;
+
+    // Duplicate (source, dest) pairs keep the shortest delay; self-loops
+    // and DCs outside [0, dcCount) are dropped. siteOfDc may be empty.
+    TopologyGraph(size_t dcCount, std::vector<Edge> edges, std::vector<SiteId> siteOfDc = std::vector<SiteId>())
+        : m_dcCount(dcCount), m_siteOfDc(std::move(siteOfDc)) {
+        edges.erase(std::remove_if(edges.begin(), edges.end(), [&](const Edge& e) {
+            return e.source >= dcCount || e.dest >= dcCount || e.source == e.dest;
+        }), edges.end());
+        std::sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) {
+            if (a.source != b.source) return a.source < b.source;
+            return a.dest != b.dest ? a.dest < b.dest : a.delaySec < b.delaySec;
+        });
+        edges.erase(std::unique(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) {
+            return a.source == b.source && a.dest == b.dest;
+        }), edges.end());
+
+        const size_t edgeCount = edges.size();
+        m_outOffsets.assign(dcCount + 1, 0);
+        m_inOffsets.assign(dcCount + 1, 0);
+        m_source.resize(edgeCount);
+        m_dest.resize(edgeCount);
+        m_delay.resize(edgeCount);
+        for (size_t e = 0; e < edgeCount; e++) {
+            m_source[e] = edges[e].source;
+            m_dest[e] = edges[e].dest;
+            m_delay[e] = edges[e].delaySec;
+            m_outOffsets[edges[e].source + 1]++;
+            m_inOffsets[edges[e].dest + 1]++;
+        }
+        for (size_t v = 0; v < dcCount; v++) {
+            m_outOffsets[v + 1] += m_outOffsets[v];
+            m_inOffsets[v + 1] += m_inOffsets[v];
+        }
+        m_inEdges.resize(edgeCount);
+        std::vector<uint32_t> fill(m_inOffsets.begin(), m_inOffsets.end() - 1);
+        for (size_t e = 0; e < edgeCount; e++) m_inEdges[fill[m_dest[e]]++] = static_cast<uint32_t>(e);
+
+        for (size_t m = 0; m < 2; m++) m_bound[m].reset(new std::atomic<uint64_t>[dcCount]());
+        m_sources.reset(new std::atomic<uint32_t>[dcCount]());
+    }
+
+    TopologyGraph(TopologyGraph&&) = default;
+    TopologyGraph& operator=(TopologyGraph&&) = default;
+
+    size_t DcCount() const { return m_dcCount; }
+    size_t EdgeCount() const { return m_dest.size(); }
+    DcId EdgeSource(uint32_t edge) const { return m_source[edge]; }
+    DcId EdgeDest(uint32_t edge) const { return m_dest[edge]; }
+    uint32_t EdgeDelay(uint32_t edge) const { return m_delay[edge]; }
+    SiteId SiteOf(DcId dc) const { return dc < m_siteOfDc.size() ? m_siteOfDc[dc] : kInvalidId; }
+
+    uint32_t FindEdge(DcId source, DcId dest) const {
+        if (source >= m_dcCount) return kNoEdge;
+        auto begin = m_dest.begin() + m_outOffsets[source], end = m_dest.begin() + m_outOffsets[source + 1];
+        auto it = std::lower_bound(begin, end, dest);
+        return (it != end && *it == dest) ? static_cast<uint32_t>(it - m_dest.begin()) : kNoEdge;
+    }
+
+    // Shortest hop counts / delays from source along the replication
+    // direction; kUnreachable where its changes never arrive
+    std::vector<uint32_t> HopsFrom(DcId source) const {
+        std::vector<uint32_t> dist;
+        Distances(source, false, Metric::Hops, kNoEdge, 0, dist);
+        return dist;
+    }
+
+    std::vector<uint32_t> DelaysFrom(DcId source) const {
+        std::vector<uint32_t> dist;
+        Distances(source, false, Metric::Delay, kNoEdge, 0, dist);
+        return dist;
+    }
+
+    // Every DC's bound, one reversed search per destination and metric
+    void ComputeBounds(unsigned workers) {
+        ParallelFor(m_dcCount, workers, [&](size_t v) {
+            std::vector<uint32_t> dist;
+            RecomputeDestination(static_cast<DcId>(v), Metric::Delay, dist);
+            RecomputeDestination(static_cast<DcId>(v), Metric::Hops, dist);
+        });
+    }
+
+    StalenessBound Bound(DcId dc) const {
+        StalenessBound b;
+        uint64_t delay = m_bound[0][dc].load(std::memory_order_relaxed);
+        uint64_t hops = m_bound[1][dc].load(std::memory_order_relaxed);
+        if (delay) {
+            b.delaySec = static_cast<uint32_t>((delay >> 32) - 1);
+            b.worstSource = static_cast<DcId>(delay & 0xFFFFFFFFu);
+        }
+        if (hops) b.hops = static_cast<uint32_t>((hops >> 32) - 1);
+        b.sources = m_sources[dc].load(std::memory_order_relaxed);
+        return b;
+    }
+
+    // Worst bound over all DCs: how long a change can take to reach every
+    // DC it can reach at all
+    uint32_t ConvergenceSec() const {
+        uint32_t worst = 0;
+        for (DcId v = 0; v < m_dcCount; v++) worst = std::max(worst, Bound(v).delaySec);
+        return worst;
+    }
+
+    // Ordered (source, dest) pairs where dest never sees source's changes
+    uint64_t UnreachablePairs() const {
+        uint64_t n = 0;
+        for (DcId v = 0; v < m_dcCount; v++) n += (m_dcCount - 1) - Bound(v).sources;
+        return n;
+    }
+
+    // Sets one link's delay (kUnreachable takes it down) and brings the
+    // bounds up to date. Falls back to ComputeBounds() when the link sits
+    // on the shortest-path trees of more than half the DCs.
+    UpdateStats UpdateEdge(uint32_t edge, uint32_t delaySec, unsigned workers) {
+        UpdateStats stats;
+        if (edge >= m_delay.size() || m_delay[edge] == delaySec) return stats;
+        const uint32_t old = m_delay[edge];
+
+        // Hop counts only change when the link goes down or comes back
+        const uint32_t oldHop = old == kUnreachable ? kUnreachable : 1;
+        const uint32_t newHop = delaySec == kUnreachable ? kUnreachable : 1;
+        std::vector<DcId> delaySources = AffectedSources(edge, Metric::Delay, old, delaySec);
+        std::vector<DcId> hopSources;
+        if (oldHop != newHop) hopSources = AffectedSources(edge, Metric::Hops, oldHop, newHop);
+        m_delay[edge] = delaySec;
+
+        if (std::max(delaySources.size(), hopSources.size()) * 2 > m_dcCount) {
+            ComputeBounds(workers);
+            stats.full = true;
+            stats.sourcesRerun = m_dcCount;
+            stats.destinationsRerun = m_dcCount;
+            return stats;
+        }
+        UpdateMetric(edge, Metric::Delay, old, delaySec, delaySources, workers, stats);
+        UpdateMetric(edge, Metric::Hops, oldHop, newHop, hopSources, workers, stats);
+        return stats;
+    }
+
+    // DCs whose loss disconnects the rest (iterative Tarjan), ascending
+    std::vector<DcId> ArticulationPoints() const {
+        const uint32_t n = static_cast<uint32_t>(m_dcCount);
+        std::vector<uint32_t> order(n, kUnreachable), low(n, 0), parent(n, kInvalidId), cursor(n, 0);
+        std::vector<uint8_t> cut(n, 0);
+        std::vector<DcId> stack;
+        uint32_t counter = 0;
+        for (DcId root = 0; root < n; root++) {
+            if (order[root] != kUnreachable) continue;
+            uint32_t rootChildren = 0;
+            order[root] = low[root] = counter++;
+            stack.push_back(root);
+            while (!stack.empty()) {
+                DcId v = stack.back();
+                DcId next = kInvalidId;
+                while (next == kInvalidId && cursor[v] < Degree(v)) {
+                    DcId w = Neighbor(v, cursor[v]++);
+                    if (w == kInvalidId || w == parent[v]) continue;
+                    if (order[w] == kUnreachable) {
+                        next = w;
+                    } else {
+                        low[v] = std::min(low[v], order[w]);
+                    }
+                }
+                if (next != kInvalidId) {
+                    parent[next] = v;
+                    order[next] = low[next] = counter++;
+                    if (v == root) rootChildren++;
+                    stack.push_back(next);
+                    continue;
+                }
+                stack.pop_back();
+                DcId p = parent[v];
+                if (p == kInvalidId) continue;
+                low[p] = std::min(low[p], low[v]);
+                if (p != root && low[v] >= order[p]) cut[p] = 1;
+            }
+            if (rootChildren > 1) cut[root] = 1;
+        }
+        std::vector<DcId> points;
+        for (DcId v = 0; v < n; v++) {
+            if (cut[v]) points.push_back(v);
+        }
+        return points;
+    }
+
+    Partition IslandsWithout(DcId removed) const {
+        Partition partition;
+        std::vector<uint32_t> component(m_dcCount, kUnreachable);
+        std::vector<std::vector<DcId>> components;
+        std::vector<DcId> queue;
+        if (removed >= m_dcCount) return partition;
+        for (uint32_t i = 0; i < Degree(removed); i++) {
+            DcId start = Neighbor(removed, i);
+            if (start == kInvalidId || start == removed || component[start] != kUnreachable) continue;
+            const uint32_t id = static_cast<uint32_t>(components.size());
+            components.emplace_back();
+            queue.assign(1, start);
+            component[start] = id;
+            for (size_t head = 0; head < queue.size(); head++) {
+                DcId v = queue[head];
+                components.back().push_back(v);
+                for (uint32_t k = 0; k < Degree(v); k++) {
+                    DcId w = Neighbor(v, k);
+                    if (w == kInvalidId || w == removed || component[w] != kUnreachable) continue;
+                    component[w] = id;
+                    queue.push_back(w);
+                }
+            }
+        }
+        if (components.empty()) return partition;
+
+        size_t mainland = 0;
+        for (size_t c = 1; c < components.size(); c++) {
+            if (components[c].size() > components[mainland].size()) mainland = c;
+        }
+
+        // Sites on the islands with no DC on the mainland
+        std::vector<SiteId> stranded, kept;
+        for (size_t c = 0; c < components.size(); c++) {
+            std::vector<SiteId>& into = c == mainland ? kept : stranded;
+            for (DcId v : components[c]) {
+                if (v < m_siteOfDc.size() && m_siteOfDc[v] != kInvalidId) into.push_back(m_siteOfDc[v]);
+            }
+        }
+        std::sort(stranded.begin(), stranded.end());
+        stranded.erase(std::unique(stranded.begin(), stranded.end()), stranded.end());
+        std::sort(kept.begin(), kept.end());
+        for (SiteId s : stranded) {
+            if (!std::binary_search(kept.begin(), kept.end(), s)) partition.isolatedSites.push_back(s);
+        }
+
+        for (size_t c = 0; c < components.size(); c++) {
+            if (c == mainland) continue;
+            std::sort(components[c].begin(), components[c].end());
+            partition.islands.push_back(std::move(components[c]));
+        }
+        return partition;
+    }
+
+private:
+    static uint32_t Add(uint32_t a, uint32_t b) {
+        if (a == kUnreachable || b == kUnreachable) return kUnreachable;
+        uint64_t sum = static_cast<uint64_t>(a) + b;
+        return sum >= kUnreachable ? kUnreachable - 1 : static_cast<uint32_t>(sum);
+    }
+
+    // value + 1 in the high word so that 0 means "no source"; ties go to
+    // the highest DcId, which keeps incremental and full results identical
+    static uint64_t Pack(uint32_t value, DcId witness) {
+        return ((static_cast<uint64_t>(value) + 1) << 32) | witness;
+    }
+
+    static DcId Witness(uint64_t packed) {
+        return packed ? static_cast<DcId>(packed & 0xFFFFFFFFu) : kInvalidId;
+    }
+
+    static void AtomicMax(std::atomic<uint64_t>& slot, uint64_t value) {
+        uint64_t current = slot.load(std::memory_order_relaxed);
+        while (value > current && !slot.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+    }
+
+    uint32_t WeightOf(uint32_t edge, Metric metric, uint32_t overrideEdge, uint32_t overrideWeight) const {
+        uint32_t delay = edge == overrideEdge ? overrideWeight : m_delay[edge];
+        if (metric == Metric::Delay || edge == overrideEdge) return delay;
+        return delay == kUnreachable ? kUnreachable : 1;
+    }
+
+    // Single-root shortest paths, forward (root = source) or reversed
+    // (root = destination). overrideEdge takes overrideWeight instead of its
+    // stored delay, already in the metric's unit. Hops run a plain BFS.
+    void Distances(DcId root, bool reverse, Metric metric, uint32_t overrideEdge, uint32_t overrideWeight,
+                   std::vector<uint32_t>& dist) const {
+        dist.assign(m_dcCount, kUnreachable);
+        if (root >= m_dcCount) return;
+        dist[root] = 0;
+        const std::vector<uint32_t>& offsets = reverse ? m_inOffsets : m_outOffsets;
+
+        if (metric == Metric::Hops) {
+            std::vector<DcId> queue(1, root);
+            for (size_t head = 0; head < queue.size(); head++) {
+                DcId v = queue[head];
+                for (uint32_t k = offsets[v]; k < offsets[v + 1]; k++) {
+                    uint32_t e = reverse ? m_inEdges[k] : k;
+                    DcId w = reverse ? m_source[e] : m_dest[e];
+                    if (dist[w] != kUnreachable || WeightOf(e, metric, overrideEdge, overrideWeight) == kUnreachable) continue;
+                    dist[w] = dist[v] + 1;
+                    queue.push_back(w);
+                }
+            }
+            return;
+        }
+
+        // Binary heap of (distance << 32 | dc), stale entries skipped
+        std::vector<uint64_t> heap(1, static_cast<uint64_t>(root));
+        auto later = [](uint64_t a, uint64_t b) { return a > b; };
+        while (!heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end(), later);
+            uint64_t top = heap.back();
+            heap.pop_back();
+            DcId v = static_cast<DcId>(top & 0xFFFFFFFFu);
+            uint32_t d = static_cast<uint32_t>(top >> 32);
+            if (d != dist[v]) continue;
+            for (uint32_t k = offsets[v]; k < offsets[v + 1]; k++) {
+                uint32_t e = reverse ? m_inEdges[k] : k;
+                DcId w = reverse ? m_source[e] : m_dest[e];
+                uint32_t nd = Add(d, WeightOf(e, metric, overrideEdge, overrideWeight));
+                if (nd >= dist[w]) continue;
+                dist[w] = nd;
+                heap.push_back((static_cast<uint64_t>(nd) << 32) | w);
+                std::push_heap(heap.begin(), heap.end(), later);
+            }
+        }
+    }
+
+    void RecomputeDestination(DcId v, Metric metric, std::vector<uint32_t>& dist) {
+        Distances(v, true, metric, kNoEdge, 0, dist);
+        uint64_t best = 0;
+        uint32_t sources = 0;
+        for (DcId s = 0; s < m_dcCount; s++) {
+            if (s == v || dist[s] == kUnreachable) continue;
+            sources++;
+            best = std::max(best, Pack(dist[s], s));
+        }
+        m_bound[static_cast<size_t>(metric)][v].store(best, std::memory_order_relaxed);
+        if (metric == Metric::Delay) m_sources[v].store(sources, std::memory_order_relaxed);
+    }
+
+    // Sources whose distances the change can alter: the edge is tight on
+    // their shortest path to its head (increase), or now beats it (decrease)
+    std::vector<DcId> AffectedSources(uint32_t edge, Metric metric, uint32_t oldWeight, uint32_t newWeight) const {
+        std::vector<uint32_t> toTail, toHead;
+        Distances(m_source[edge], true, metric, kNoEdge, 0, toTail);
+        Distances(m_dest[edge], true, metric, edge, oldWeight, toHead);
+        std::vector<DcId> affected;
+        for (DcId s = 0; s < m_dcCount; s++) {
+            if (toTail[s] == kUnreachable) continue;
+            bool hit = newWeight > oldWeight ? (oldWeight != kUnreachable && Add(toTail[s], oldWeight) == toHead[s])
+                                             : Add(toTail[s], newWeight) < toHead[s];
+            if (hit) affected.push_back(s);
+        }
+        return affected;
+    }
+
+    // Runs after the edge holds its new delay. Re-runs the affected sources
+    // with the old and new weight (in the metric's unit): their new
+    // distances raise the bounds, reachability changes adjust the source
+    // counts, and destinations whose witness got closer (or lost the path)
+    // are recomputed from scratch. Bounds set by a witness that only got
+    // further are reset first, since that witness still dominates every
+    // unaffected source.
+    void UpdateMetric(uint32_t edge, Metric metric, uint32_t oldWeight, uint32_t newWeight,
+                      const std::vector<DcId>& affected, unsigned workers, UpdateStats& stats) {
+        if (affected.empty()) return;
+        std::atomic<uint64_t>* bound = m_bound[static_cast<size_t>(metric)].get();
+        std::vector<uint8_t> isAffected(m_dcCount, 0);
+        for (DcId s : affected) isAffected[s] = 1;
+        std::vector<DcId> witness(m_dcCount);
+        for (DcId v = 0; v < m_dcCount; v++) {
+            witness[v] = Witness(bound[v].load(std::memory_order_relaxed));
+            if (newWeight > oldWeight && witness[v] != kInvalidId && isAffected[witness[v]]) {
+                bound[v].store(0, std::memory_order_relaxed);
+            }
+        }
+
+        std::unique_ptr<std::atomic<uint8_t>[]> dirty(new std::atomic<uint8_t>[m_dcCount]());
+        ParallelFor(affected.size(), workers, [&](size_t i) {
+            const DcId s = affected[i];
+            std::vector<uint32_t> before, after;
+            Distances(s, false, metric, edge, oldWeight, before);
+            Distances(s, false, metric, edge, newWeight, after);
+            for (DcId v = 0; v < m_dcCount; v++) {
+                if (v == s) continue;
+                if (metric == Metric::Delay && (before[v] == kUnreachable) != (after[v] == kUnreachable)) {
+                    if (after[v] == kUnreachable) {
+                        m_sources[v].fetch_sub(1, std::memory_order_relaxed);
+                    } else {
+                        m_sources[v].fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+                if (after[v] != kUnreachable) AtomicMax(bound[v], Pack(after[v], s));
+                if (witness[v] == s && (after[v] < before[v] || after[v] == kUnreachable)) {
+                    dirty[v].store(1, std::memory_order_relaxed);
+                }
+            }
+        });
+        stats.sourcesRerun += affected.size();
+
+        std::vector<DcId> recompute;
+        for (DcId v = 0; v < m_dcCount; v++) {
+            if (dirty[v].load(std::memory_order_relaxed)) recompute.push_back(v);
+        }
+        ParallelFor(recompute.size(), workers, [&](size_t i) {
+            std::vector<uint32_t> dist;
+            RecomputeDestination(recompute[i], metric, dist);
+        });
+        stats.destinationsRerun += recompute.size();
+    }
+
+    // Undirected adjacency: out-edges then in-edges; kInvalidId for links
+    // that are down
+    uint32_t Degree(DcId v) const {
+        return (m_outOffsets[v + 1] - m_outOffsets[v]) + (m_inOffsets[v + 1] - m_inOffsets[v]);
+    }
+
+    DcId Neighbor(DcId v, uint32_t k) const {
+        uint32_t out = m_outOffsets[v + 1] - m_outOffsets[v];
+        uint32_t e = k < out ? m_outOffsets[v] + k : m_inEdges[m_inOffsets[v] + (k - out)];
+        if (m_delay[e] == kUnreachable) return kInvalidId;
+        return k < out ? m_dest[e] : m_source[e];
+    }
+
+    size_t m_dcCount = 0;
+    std::vector<SiteId> m_siteOfDc;
+    std::vector<uint32_t> m_outOffsets;             // out-edges of v: [m_outOffsets[v], m_outOffsets[v + 1])
+    std::vector<uint32_t> m_inOffsets;              // in-edges of v, as indices into m_inEdges
+    std::vector<uint32_t> m_inEdges;
+    std::vector<DcId> m_source;                     // per edge, edges sorted by (source, dest)
+    std::vector<DcId> m_dest;
+    std::vector<uint32_t> m_delay;
+    std::unique_ptr<std::atomic<uint64_t>[]> m_bound[2];   // per Metric: Pack(value, witness), 0 = no source
+    std::unique_ptr<std::atomic<uint32_t>[]> m_sources;
+};
+
+// Graph of a completed scan. A link's delay is its schedule, or the time
+// since its oldest successful inbound sync across NCs when that is longer:
+// a link that has not synced for two days is at least two days behind.
+inline TopologyGraph BuildTopologyGraph(const ScanSnapshot& snapshot) {
+    const ReplicationModel& model = snapshot.model;
+    std::vector<TopologyGraph::Edge> edges;
+    edges.reserve(snapshot.links.size());
+    for (const ReplicationLink& link : snapshot.links) {
+        TopologyGraph::Edge e;
+        e.source = link.source;
+        e.dest = link.dest;
+        e.delaySec = link.scheduleSec;
+        if (const DestinationRow* row = snapshot.latency.Row(link.dest)) {
+            for (const NeighborCell& n : row->neighbors) {
+                if (n.source != link.source || n.lastSuccess <= 0) continue;
+                int64_t age = std::max<int64_t>(0, row->observedAt - n.lastSuccess) / 1000;
+                e.delaySec = std::max(e.delaySec, static_cast<uint32_t>(std::min<int64_t>(age, TopologyGraph::kUnreachable - 1)));
+            }
+        }
+        edges.push_back(e);
+    }
+    std::vector<SiteId> siteOfDc(model.Size());
+    for (DcId id = 0; id < model.Size(); id++) siteOfDc[id] = model.records[id].site;
+    return TopologyGraph(model.Size(), std::move(edges), std::move(siteOfDc));
+}
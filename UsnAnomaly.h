@@ -0,0 +1,445 @@
+// UsnAnomaly.h
+// Détection d'anomalies USN en flux par DC (vitesse EWMA, quantiles t-digest, invocationId) : blocage, retour arrière, rafale
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "HistoryRecorder.h"
+#include "ReplicationModel.h"
+#include "ScanSnapshot.h"
+#include "TimeSeriesStore.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Merging t-digest (Dunning) in fixed storage: up to kCentroids centroids
+// and a kBuffer-value insert buffer, merged when full. The k1 scale
+// function keeps centroids small at both ends, where the burst threshold
+// reads. Each merge first multiplies the older weight by the decay, so
+// quantiles follow recent values rather than the whole history.
+class TDigest {
+public:
+    static const size_t kCentroids = 48;
+    static const size_t kBuffer = 32;
+    static constexpr double kCompression = 40;      // at most kCompression + 1 centroids after a merge
+
+    // Half-life in values; 0 keeps every value at full weight
+    void SetHalfLife(double values) {
+        m_decay = values > 0 ? static_cast<float>(std::pow(0.5, kBuffer / values)) : 1.0f;
+    }
+
+    // True when the value completed the buffer and was merged
+    bool Add(float value) {
+        m_buffer[m_buffered++] = value;
+        if (m_buffered < kBuffer) return false;
+        Merge();
+        return true;
+    }
+
+    void Merge() {
+        if (m_buffered == 0) return;
+        std::sort(m_buffer, m_buffer + m_buffered);
+        float mean[kCentroids + kBuffer];
+        float weight[kCentroids + kBuffer];
+        size_t n = 0, a = 0, b = 0;
+        double total = 0;
+        while (a < m_count || b < m_buffered) {
+            if (b == m_buffered || (a < m_count && m_mean[a] <= m_buffer[b])) {
+                mean[n] = m_mean[a];
+                weight[n] = m_weight[a++] * m_decay;
+            } else {
+                mean[n] = m_buffer[b++];
+                weight[n] = 1.0f;
+            }
+            total += weight[n++];
+        }
+        m_buffered = 0;
+
+        // Left to right, a centroid grows while it spans at most one unit of k
+        m_count = 0;
+        double before = 0;                              // weight left of the current centroid
+        double limit = total * KInverse(K(0) + 1);
+        double currentMean = mean[0];
+        double currentWeight = weight[0];
+        for (size_t i = 1; i < n; i++) {
+            if (before + currentWeight + weight[i] <= limit || m_count + 1 == kCentroids) {
+                currentWeight += weight[i];
+                currentMean += (mean[i] - currentMean) * weight[i] / currentWeight;
+                continue;
+            }
+            m_mean[m_count] = static_cast<float>(currentMean);
+            m_weight[m_count++] = static_cast<float>(currentWeight);
+            before += currentWeight;
+            limit = total * KInverse(K(before / total) + 1);
+            currentMean = mean[i];
+            currentWeight = weight[i];
+        }
+        m_mean[m_count] = static_cast<float>(currentMean);
+        m_weight[m_count++] = static_cast<float>(currentWeight);
+        m_total = total;
+    }
+
+    // Interpolated between centroid centres; NaN when empty
+    double Quantile(double q) {
+        Merge();
+        if (m_count == 0) return std::numeric_limits<double>::quiet_NaN();
+        const double target = std::min(1.0, std::max(0.0, q)) * m_total;
+        double left = m_weight[0] / 2;
+        if (target <= left) return m_mean[0];
+        for (size_t i = 0; i + 1 < m_count; i++) {
+            const double right = left + (static_cast<double>(m_weight[i]) + m_weight[i + 1]) / 2;
+            if (target <= right) return m_mean[i] + (m_mean[i + 1] - m_mean[i]) * (target - left) / (right - left);
+            left = right;
+        }
+        return m_mean[m_count - 1];
+    }
+
+    double Weight() const { return m_total + m_buffered; }
+    size_t Centroids() const { return m_count; }
+
+private:
+    static constexpr double kPi = 3.14159265358979323846;
+
+    static double K(double q) { return kCompression / (2 * kPi) * std::asin(std::min(1.0, std::max(-1.0, 2 * q - 1))); }
+
+    static double KInverse(double k) {
+        if (k >= kCompression / 4) return 1;
+        return (1 + std::sin(2 * kPi * k / kCompression)) / 2;
+    }
+
+    float m_mean[kCentroids];
+    float m_weight[kCentroids];
+    float m_buffer[kBuffer];
+    double m_total = 0;
+    float m_decay = 1.0f;
+    uint32_t m_count = 0;
+    uint32_t m_buffered = 0;
+};
+
+enum class UsnAnomalyKind : uint8_t {
+    Stall,                              // USN unchanged far longer than its velocity allows
+    Rollback,                           // USN went backwards under the same invocation ID
+    Burst,                              // change rate far above the DC's recent quantile
+    Restore                             // new invocation ID: a restored or reinstalled DC, baselines restart
+};
+
+inline const char* UsnAnomalyKindName(UsnAnomalyKind kind) {
+    switch (kind) {
+        case UsnAnomalyKind::Stall:    return "stall";
+        case UsnAnomalyKind::Rollback: return "rollback";
+        case UsnAnomalyKind::Burst:    return "burst";
+        default:                       return "restore";
+    }
+}
+
+// One highestCommittedUSN read
+struct UsnSample {
+    int64_t time = 0;                   // Unix ms
+    uint64_t usn = 0;
+    uint64_t invocation = 0;            // InvocationKey; 0 unknown, matches any
+};
+
+struct UsnAnomaly {
+    UsnAnomalyKind kind = UsnAnomalyKind::Stall;
+    uint32_t dc = 0;                    // the caller's index
+    int64_t time = 0;                   // sample that raised it
+    int64_t since = 0;                  // stall: last USN change; otherwise the previous sample
+    uint64_t usn = 0;
+    uint64_t previousUsn = 0;
+    double rate = 0;                    // USN/s: burst, over the last interval; stall, velocity before it
+    double threshold = 0;               // burst: USN/s limit crossed; stall: changes expected since `since`
+};
+
+struct UsnAnomalyOptions {
+    std::chrono::seconds velocityHalfLife{300};     // EWMA of USN changes per second
+    double sketchHalfLife = 3600;                   // intervals, in the t-digest of per-interval rates
+    unsigned warmup = 30;                           // intervals seen before stalls and bursts are judged
+    std::chrono::seconds minStall{600};             // a stall lasts at least this long...
+    double stallChanges = 100;                      // ... and the velocity before it predicted this many changes
+    double burstQuantile = 0.99;
+    double burstFactor = 4;                         // a burst is above factor x that quantile...
+    double burstMinRate = 50;                       // ... and above this many USN/s
+};
+
+// Streaming USN checks with fixed-size state per DC: the last sample and
+// invocation ID, an EWMA of the velocity (USN/s) and a t-digest of the
+// rate over each sampling interval. Each sample is judged as it arrives:
+//   rollback  the USN decreased and the invocation ID did not change
+//   restore   the invocation ID changed (the DC was restored or rebuilt)
+//   stall     no change for minStall while the velocity at the last change
+//             predicted stallChanges of them
+//   burst     the interval's rate exceeds burstFactor x the burstQuantile of
+//             recent rates (and burstMinRate), until it drops under the
+//             quantile again
+// Stalls and bursts are raised once per episode. Samples must come in time
+// order per DC; older or repeated ones are ignored.
+class UsnAnomalyDetector {
+public:
+    explicit UsnAnomalyDetector(const UsnAnomalyOptions& options = UsnAnomalyOptions()) : m_options(options) {}
+
+    const UsnAnomalyOptions& Options() const { return m_options; }
+
+    void Resize(size_t dcs) {
+        const size_t before = m_states.size();
+        m_states.resize(dcs);
+        for (size_t i = before; i < dcs; i++) m_states[i].rates.SetHalfLife(m_options.sketchHalfLife);
+    }
+
+    size_t Size() const { return m_states.size(); }
+    static size_t BytesPerDc() { return sizeof(State); }
+
+    // Appends what the sample raises for dc to out; returns how many
+    size_t Observe(uint32_t dc, const UsnSample& sample, std::vector<UsnAnomaly>& out) {
+        if (dc >= m_states.size()) Resize(dc + 1);
+        State& s = m_states[dc];
+        if (s.time == 0) {
+            Restart(s, sample);
+            return 0;
+        }
+        if (sample.time <= s.time) return 0;
+
+        const size_t before = out.size();
+        if (sample.invocation && s.invocation && sample.invocation != s.invocation) {
+            out.push_back(Raise(UsnAnomalyKind::Restore, dc, s, sample));
+            Restart(s, sample);
+            return 1;
+        }
+        if (!s.invocation) s.invocation = sample.invocation;
+        if (sample.usn < s.usn) {
+            out.push_back(Raise(UsnAnomalyKind::Rollback, dc, s, sample));
+            Restart(s, sample);
+            return 1;
+        }
+
+        const int64_t elapsed = sample.time - s.time;
+        const double rate = static_cast<double>(sample.usn - s.usn) * 1000.0 / static_cast<double>(elapsed);
+        s.velocity += (rate - s.velocity) * Alpha(elapsed);
+        const bool judged = ++s.intervals > m_options.warmup;
+
+        // A burst lasts until the rate is back under the quantile itself
+        if (judged && rate > (s.bursting ? s.burstLimit / m_options.burstFactor : s.burstLimit)) {
+            if (!s.bursting) {
+                UsnAnomaly a = Raise(UsnAnomalyKind::Burst, dc, s, sample);
+                a.rate = rate;
+                a.threshold = s.burstLimit;
+                out.push_back(a);
+            }
+            s.bursting = true;
+        } else {
+            s.bursting = false;
+        }
+        if (s.rates.Add(static_cast<float>(rate))) {
+            s.burstLimit = std::max(m_options.burstMinRate, m_options.burstFactor * s.rates.Quantile(m_options.burstQuantile));
+        }
+
+        if (sample.usn != s.usn) {
+            s.advancedAt = sample.time;
+            s.velocityAtChange = s.velocity;
+            s.stalled = false;
+        } else if (judged && !s.stalled) {
+            const int64_t stalledMs = sample.time - s.advancedAt;
+            const double expected = s.velocityAtChange * static_cast<double>(stalledMs) / 1000.0;
+            if (stalledMs >= m_options.minStall.count() * 1000 && expected >= m_options.stallChanges) {
+                UsnAnomaly a = Raise(UsnAnomalyKind::Stall, dc, s, sample);
+                a.since = s.advancedAt;
+                a.rate = s.velocityAtChange;
+                a.threshold = expected;
+                out.push_back(a);
+                s.stalled = true;
+            }
+        }
+        s.usn = sample.usn;
+        s.time = sample.time;
+        return out.size() - before;
+    }
+
+    // Current state of one DC, for reports
+    double Velocity(uint32_t dc) const { return dc < m_states.size() ? m_states[dc].velocity : 0; }
+    bool Stalled(uint32_t dc) const { return dc < m_states.size() && m_states[dc].stalled; }
+    bool Bursting(uint32_t dc) const { return dc < m_states.size() && m_states[dc].bursting; }
+    double RateQuantile(uint32_t dc, double q) { return dc < m_states.size() ? m_states[dc].rates.Quantile(q) : 0; }
+
+private:
+    struct State {
+        int64_t time = 0;               // last sample, 0 before the first
+        int64_t advancedAt = 0;         // last USN change
+        uint64_t usn = 0;
+        uint64_t invocation = 0;
+        double velocity = 0;            // EWMA, USN/s
+        double velocityAtChange = 0;    // velocity when the USN last changed: the stall baseline
+        double burstLimit = std::numeric_limits<double>::infinity();   // refreshed at each digest merge
+        uint32_t intervals = 0;
+        bool stalled = false;
+        bool bursting = false;
+        TDigest rates;
+    };
+
+    // The rates and velocity describe the DC's workload and survive a
+    // restore; the USN baseline does not
+    static void Restart(State& s, const UsnSample& sample) {
+        s.time = sample.time;
+        s.advancedAt = sample.time;
+        s.usn = sample.usn;
+        s.invocation = sample.invocation;
+        s.stalled = false;
+        s.bursting = false;
+    }
+
+    static UsnAnomaly Raise(UsnAnomalyKind kind, uint32_t dc, const State& s, const UsnSample& sample) {
+        UsnAnomaly a;
+        a.kind = kind;
+        a.dc = dc;
+        a.time = sample.time;
+        a.since = s.time;
+        a.usn = sample.usn;
+        a.previousUsn = s.usn;
+        return a;
+    }
+
+    // EWMA weight of an interval; samples usually come at a fixed period,
+    // so the last one is cached
+    double Alpha(int64_t elapsedMs) {
+        if (elapsedMs != m_alphaMs) {
+            const double halfLifeMs = std::max<double>(1.0, static_cast<double>(m_options.velocityHalfLife.count()) * 1000.0);
+            m_alpha = 1.0 - std::exp2(-static_cast<double>(elapsedMs) / halfLifeMs);
+            m_alphaMs = elapsedMs;
+        }
+        return m_alpha;
+    }
+
+    UsnAnomalyOptions m_options;
+    std::vector<State> m_states;
+    int64_t m_alphaMs = -1;
+    double m_alpha = 0;
+};
+
+struct UsnAnomalyEntry {
+    UsnAnomaly anomaly;
+    std::wstring dc;
+};
+
+// Feeds a detector from scans. A row with a USN is a sample taken when its
+// DC was probed, so a DC streamed then completed, or carried unchanged into
+// a poll snapshot, counts once per probe. DCs are keyed by name across
+// topology changes. With a history store, a DC seen for the first time is
+// first replayed from its recorded samples, silently; the history keeps no
+// invocation ID, so a restore right after that replay reads as a rollback.
+// Anomalies go to the callback (scanner thread) and to a bounded list of
+// the latest ones.
+class UsnAnomalyMonitor : public IScanSubscriber {
+public:
+    using Callback = std::function<void(const UsnAnomalyEntry&)>;
+
+    explicit UsnAnomalyMonitor(const UsnAnomalyOptions& options = UsnAnomalyOptions(), Callback callback = nullptr,
+                               size_t keep = 1000)
+        : m_detector(options), m_callback(std::move(callback)), m_keep(keep) {}
+
+    // Before the first scan
+    void SetHistory(std::shared_ptr<const TimeSeriesStore> history, std::chrono::hours window = std::chrono::hours(24)) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_history = std::move(history);
+        m_window = window;
+    }
+
+    void OnScanStarted(const SnapshotPtr& topology) override {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Map(*topology);
+    }
+
+    void OnRows(const RowBatch& batch) override {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_slots.size() != batch.topology->model.Size()) Map(*batch.topology);
+        for (const RowUpdate& row : batch.rows) Observe(row.id, row.record);
+        Publish();
+    }
+
+    // Poll snapshots stream no rows: their re-polled DCs are read here
+    void OnScanCompleted(const SnapshotPtr& snapshot) override {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const ReplicationModel& model = snapshot->model;
+        if (m_slots.size() != model.Size()) Map(*snapshot);
+        for (DcId id = 0; id < model.Size(); id++) Observe(id, model.records[id]);
+        Publish();
+    }
+
+    // Latest anomalies, oldest first
+    std::vector<UsnAnomalyEntry> Recent() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return std::vector<UsnAnomalyEntry>(m_recent.begin(), m_recent.end());
+    }
+
+    size_t Raised() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_raised;
+    }
+
+private:
+    void Map(const ScanSnapshot& topology) {
+        const ReplicationModel& model = topology.model;
+        m_slots.assign(model.Size(), kInvalidId);
+        for (DcId id = 0; id < model.Size(); id++) {
+            const size_t known = m_names.Size();
+            m_slots[id] = m_names.Intern(model.DcName(id));
+            if (m_slots[id] == known) Replay(m_slots[id], model.DcName(id), topology.startedAt);
+        }
+        m_detector.Resize(m_names.Size());
+    }
+
+    void Replay(uint32_t slot, const std::wstring& dc, int64_t before) {
+        if (!m_history || before <= 0) return;
+        const uint32_t series = m_history->FindSeries(DcSeriesName(dc));
+        if (series == TimeSeriesStore::kNoRecord) return;
+        m_samples.clear();
+        m_history->Query(series, before - std::chrono::duration_cast<std::chrono::milliseconds>(m_window).count(),
+                         before - 1, m_samples);
+        for (const TimeSample& t : m_samples) {
+            UsnSample sample;
+            sample.time = t.time;
+            sample.usn = t.usn;
+            m_detector.Observe(slot, sample, m_pending);
+        }
+        m_pending.clear();
+    }
+
+    void Observe(DcId id, const DcRecord& r) {
+        if (id >= m_slots.size() || !r.HasUsn() || r.probedAt <= 0) return;
+        UsnSample sample;
+        sample.time = r.probedAt;
+        sample.usn = r.usn;
+        sample.invocation = r.invocation;
+        m_detector.Observe(m_slots[id], sample, m_pending);
+    }
+
+    void Publish() {
+        for (const UsnAnomaly& a : m_pending) {
+            UsnAnomalyEntry entry{a, m_names.Name(a.dc)};
+            if (m_callback) m_callback(entry);
+            m_recent.push_back(std::move(entry));
+            if (m_recent.size() > m_keep) m_recent.pop_front();
+            m_raised++;
+        }
+        m_pending.clear();
+    }
+
+    mutable std::mutex m_mutex;
+    UsnAnomalyDetector m_detector;
+    Callback m_callback;
+    size_t m_keep;
+    StringInterner m_names;                     // detector slot of each DC name
+    std::vector<uint32_t> m_slots;              // slot of each DcId of the current topology
+    std::shared_ptr<const TimeSeriesStore> m_history;
+    std::chrono::hours m_window{24};
+    std::vector<TimeSample> m_samples;
+    std::vector<UsnAnomaly> m_pending;
+    std::deque<UsnAnomalyEntry> m_recent;
+    size_t m_raised = 0;
+};
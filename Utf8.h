@@ -0,0 +1,89 @@
+// Utf8.h
+// Conversions UTF-8 <-> wstring portables (wchar_t 16 bits sous Windows, 32 bits ailleurs)
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Appends the UTF-8 encoding of s to out. Lone surrogates become U+FFFD.
+inline void AppendUtf8(std::string& out, const wchar_t* s, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        uint32_t cp = static_cast<uint32_t>(s[i]);
+        if (sizeof(wchar_t) == 2 && cp >= 0xD800 && cp <= 0xDFFF) {
+            if (cp <= 0xDBFF && i + 1 < len) {
+                uint32_t lo = static_cast<uint32_t>(s[i + 1]);
+                if (lo >= 0xDC00 && lo <= 0xDFFF) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    i++;
+                } else {
+                    cp = 0xFFFD;
+                }
+            } else {
+                cp = 0xFFFD;
+            }
+        }
+        if (cp < 0x80) {
+            out.push_back(static_cast<char>(cp));
+        } else if (cp < 0x800) {
+            out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else if (cp < 0x10000) {
+            out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else {
+            out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+    }
+}
+
+inline std::string WideToUtf8(const std::wstring& s) {
+    std::string out;
+    out.reserve(s.size());
+    AppendUtf8(out, s.data(), s.size());
+    return out;
+}
+
+// Invalid sequences decode to U+FFFD.
+inline std::wstring Utf8ToWide(const char* s, size_t len) {
+    std::wstring out;
+    out.reserve(len);
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(s);
+    size_t i = 0;
+    while (i < len) {
+        uint32_t c = p[i];
+        uint32_t cp = 0xFFFD;
+        size_t n = 1;
+        if (c < 0x80) {
+            cp = c;
+        } else if ((c >> 5) == 0x6 && i + 1 < len && (p[i + 1] & 0xC0) == 0x80) {
+            cp = ((c & 0x1F) << 6) | (p[i + 1] & 0x3F);
+            n = 2;
+        } else if ((c >> 4) == 0xE && i + 2 < len && (p[i + 1] & 0xC0) == 0x80 && (p[i + 2] & 0xC0) == 0x80) {
+            cp = ((c & 0x0F) << 12) | ((p[i + 1] & 0x3F) << 6) | (p[i + 2] & 0x3F);
+            n = 3;
+        } else if ((c >> 3) == 0x1E && i + 3 < len && (p[i + 1] & 0xC0) == 0x80 &&
+                   (p[i + 2] & 0xC0) == 0x80 && (p[i + 3] & 0xC0) == 0x80) {
+            cp = ((c & 0x07) << 18) | ((p[i + 1] & 0x3F) << 12) | ((p[i + 2] & 0x3F) << 6) | (p[i + 3] & 0x3F);
+            n = 4;
+        }
+        if (sizeof(wchar_t) == 2 && cp >= 0x10000) {
+            cp -= 0x10000;
+            out.push_back(static_cast<wchar_t>(0xD800 + (cp >> 10)));
+            out.push_back(static_cast<wchar_t>(0xDC00 + (cp & 0x3FF)));
+        } else {
+            out.push_back(static_cast<wchar_t>(cp));
+        }
+        i += n;
+    }
+    return out;
+}
+
+inline std::wstring Utf8ToWide(const std::string& s) {
+    return Utf8ToWide(s.data(), s.size());
+}
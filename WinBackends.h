@@ -0,0 +1,645 @@
+// WinBackends.h
+// Implémentations Windows des backends : ADSI/LDAP, DsReplicaGetInfo et journal d'événements (EvtQuery)
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+// Windows only. The including translation unit defines UNICODE and
+// NOMINMAX and includes <windows.h> first.
+
+#include "ConnectionPool.h"
+#include "DirectoryBackend.h"
+#include "DistinguishedName.h"
+#include "EventCollector.h"
+#include "ScanMetrics.h"
+
+#include <activeds.h>
+#include <lm.h>
+#include <winevt.h>
+#include <ntdsapi.h>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#pragma comment(lib, "activeds.lib")
+#pragma comment(lib, "adsiid.lib")
+#pragma comment(lib, "netapi32.lib")
+#pragma comment(lib, "wevtapi.lib")
+#pragma comment(lib, "ntdsapi.lib")
+#pragma comment(lib, "ole32.lib")
+#pragma comment(lib, "oleaut32.lib")
+
+// Domain DN of the machine's domain through the DC locator, empty when the
+// machine is not joined
+inline std::wstring GetDomainDN() {
+    wchar_t computerName[256];
+    DWORD size = 256;
+    GetComputerNameW(computerName, &size);
+
+    PDOMAIN_CONTROLLER_INFOW dcInfo = nullptr;
+    PhaseTimer timer(MetricPhase::DcLocate);
+    DWORD result = DsGetDcNameW(nullptr, nullptr, nullptr, nullptr, 0, &dcInfo);
+    timer.Stop();
+
+    if (result == ERROR_SUCCESS && dcInfo) {
+        std::wstring dn = DomainDnFromDns(dcInfo->DomainName);
+        NetApiBufferFree(dcInfo);
+        return dn;
+    }
+
+    return L"";
+}
+
+// COM must be initialised on every probe worker thread that touches ADSI
+struct ComThreadScope {
+    HRESULT hr;
+    ComThreadScope() : hr(CoInitializeEx(0, COINIT_MULTITHREADED)) {}
+    ~ComThreadScope() { if (SUCCEEDED(hr)) CoUninitialize(); }
+};
+
+// Win32 and HRESULT codes meaning the connection to the DC is gone, as
+// opposed to a failed operation on a live connection
+inline bool IsConnectionLost(int32_t error) {
+    uint32_t code = (uint32_t)error;
+    if ((code & 0xFFFF0000u) == 0x80070000u) code &= 0xFFFF;   // HRESULT_FROM_WIN32
+    switch (code) {
+        case ERROR_NETNAME_DELETED:
+        case ERROR_CONNECTION_ABORTED:
+        case ERROR_DS_UNAVAILABLE:
+        case ERROR_DS_SERVER_DOWN:
+        case RPC_S_SERVER_UNAVAILABLE:
+        case RPC_S_CALL_FAILED:
+        case RPC_S_CALL_FAILED_DNE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// A server bind to one DC. Keeping the rootDSE object open keeps ADSI's
+// cached LDAP connection; the DRS handle is bound on first use.
+struct AdsiSession : IDirectorySession {
+    std::wstring dc;
+    IADs* rootDse = nullptr;
+    HANDLE hDs = nullptr;
+
+    ~AdsiSession() {
+        if (hDs) DsUnBindW(&hDs);
+        if (rootDse) rootDse->Release();
+    }
+
+    DWORD BindDrs() {
+        if (hDs) return ERROR_SUCCESS;
+        PhaseTimer bind(MetricPhase::Bind);
+        return DsBindW(dc.c_str(), nullptr, &hDs);
+    }
+
+    // Reloads the named attributes into the object's property cache: one
+    // search on the bound connection
+    HRESULT Refresh(const wchar_t* const* names, DWORD count) {
+        VARIANT list;
+        VariantInit(&list);
+        HRESULT hr = ADsBuildVarArrayStr((LPWSTR*)names, count, &list);
+        if (SUCCEEDED(hr)) hr = rootDse->GetInfoEx(list, 0);
+        VariantClear(&list);
+        return hr;
+    }
+};
+
+// Binds pooled sessions. Pooled COM objects outlive the scan threads that
+// created them, so the transport holds the process MTA open while it has
+// sessions out (CoIncrementMTAUsage).
+class AdsiTransport : public IDirectoryTransport {
+public:
+    std::unique_ptr<IDirectorySession> Bind(const std::wstring& dc, std::chrono::milliseconds, int32_t& error) override {
+        HoldMta();
+        std::wstring ldapPath = L"LDAP://" + dc + L"/rootDSE";
+        IADs* pADs = nullptr;
+        PhaseTimer bind(MetricPhase::Bind);
+        HRESULT hr = ADsOpenObject(ldapPath.c_str(), nullptr, nullptr, ADS_SECURE_AUTHENTICATION | ADS_SERVER_BIND,
+                                   IID_IADs, (void**)&pADs);
+        if (FAILED(hr)) {
+            error = hr;
+            return nullptr;
+        }
+        auto session = std::make_unique<AdsiSession>();
+        session->dc = dc;
+        session->rootDse = pADs;
+        return session;
+    }
+
+    // One attribute read on a session idle since the previous scan
+    bool Check(IDirectorySession& session) override {
+        static const wchar_t* const names[] = {L"currentTime"};
+        return SUCCEEDED(static_cast<AdsiSession&>(session).Refresh(names, 1));
+    }
+
+    bool IsConnectionError(int32_t error) const override { return IsConnectionLost(error); }
+
+    void ReleaseMta() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_mtaHeld) CoDecrementMTAUsage(m_cookie);
+        m_mtaHeld = false;
+    }
+
+private:
+    void HoldMta() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_mtaHeld) m_mtaHeld = SUCCEEDED(CoIncrementMTAUsage(&m_cookie));
+    }
+
+    std::mutex m_mutex;
+    CO_MTA_USAGE_COOKIE m_cookie = nullptr;
+    bool m_mtaHeld = false;
+};
+
+// ADSI backend: rootDSE reads and replica metadata (DsReplicaGetInfo) go
+// through per-DC sessions pooled across reads and scans, so repeated scans
+// bind once per DC; discovery uses IDirectorySearch paging. ADSI offers no
+// per-call timeout for binds, the probe engine enforces it. A serverless
+// bind goes through the DC locator and is timed as DcLocate, a server bind
+// as Bind.
+class AdsiDirectoryBackend : public IDirectoryBackend {
+public:
+    explicit AdsiDirectoryBackend(ConnectionPoolOptions options = ConnectionPoolOptions())
+        : m_transport(std::make_shared<AdsiTransport>()), m_pool(m_transport, options) {}
+
+    ConnectionPoolStats PoolStats() const { return m_pool.Stats(); }
+
+    void CloseSessions() override {
+        m_pool.Clear();
+        m_transport->ReleaseMta();
+    }
+
+    RootDseReply ReadRootDse(const std::wstring& dcName, std::chrono::milliseconds timeout) override {
+        thread_local ComThreadScope com;
+        if (dcName.empty()) return ReadLocatorRootDse();
+
+        // A reused session may have lost its DC since the last scan: one rebind
+        RootDseReply reply;
+        for (int attempt = 0; attempt < 2; attempt++) {
+            int32_t error = 0;
+            ConnectionPool::Lease lease = m_pool.Acquire(dcName, timeout, error);
+            if (!lease) {
+                reply.error = error;
+                return reply;
+            }
+            AdsiSession& session = lease.As<AdsiSession>();
+            PhaseTimer read(MetricPhase::RootDseRead);
+            HRESULT hr = session.Refresh(kRootDseAttributes, kRootDseAttributeCount);
+            if (SUCCEEDED(hr)) hr = ReadAttributes(session.rootDse, reply);
+            if (SUCCEEDED(hr)) return reply;
+            reply.error = hr;
+            lease.Fail(hr);
+            if (!lease.Reused() || !IsConnectionLost(hr)) break;
+        }
+        return reply;
+    }
+
+    bool SearchSubtree(const SearchRequest& request, const std::function<void(const DirectoryEntry&)>& onEntry) override {
+        thread_local ComThreadScope com;
+
+        std::wstring path = AdsPath(request.server, request.baseDn);
+        DWORD flags = ADS_SECURE_AUTHENTICATION | (request.server.empty() ? 0 : ADS_SERVER_BIND);
+
+        IDirectorySearch* pSearch = nullptr;
+        PhaseTimer bind(request.server.empty() ? MetricPhase::DcLocate : MetricPhase::Bind);
+        HRESULT hr = ADsOpenObject(path.c_str(), nullptr, nullptr, flags, IID_IDirectorySearch, (void**)&pSearch);
+        bind.Stop();
+        if (FAILED(hr)) return false;
+
+        PhaseTimer search(MetricPhase::Search);
+
+        ADS_SEARCHPREF_INFO prefs[3] = {};
+        prefs[0].dwSearchPref = ADS_SEARCHPREF_SEARCH_SCOPE;
+        prefs[0].vValue.dwType = ADSTYPE_INTEGER;
+        prefs[0].vValue.Integer = ADS_SCOPE_SUBTREE;
+        prefs[1].dwSearchPref = ADS_SEARCHPREF_PAGESIZE;
+        prefs[1].vValue.dwType = ADSTYPE_INTEGER;
+        prefs[1].vValue.Integer = request.pageSize;
+        prefs[2].dwSearchPref = ADS_SEARCHPREF_CACHE_RESULTS;
+        prefs[2].vValue.dwType = ADSTYPE_BOOLEAN;
+        prefs[2].vValue.Boolean = FALSE;
+        pSearch->SetSearchPreference(prefs, 3);
+
+        std::vector<LPWSTR> attrs;
+        for (const auto& a : request.attributes) attrs.push_back((LPWSTR)a.c_str());
+
+        ADS_SEARCH_HANDLE hSearch = nullptr;
+        hr = pSearch->ExecuteSearch((LPWSTR)request.filter.c_str(), attrs.empty() ? nullptr : attrs.data(),
+                                    attrs.empty() ? (DWORD)-1 : (DWORD)attrs.size(), &hSearch);
+        if (FAILED(hr)) {
+            pSearch->Release();
+            return false;
+        }
+
+        DirectoryEntry entry;
+        while ((hr = pSearch->GetNextRow(hSearch)) != S_ADS_NOMORE_ROWS && SUCCEEDED(hr)) {
+            entry.dn.clear();
+            entry.attributes.clear();
+
+            ADS_SEARCH_COLUMN col;
+            if (SUCCEEDED(pSearch->GetColumn(hSearch, (LPWSTR)L"distinguishedName", &col))) {
+                if (col.dwNumValues > 0) entry.dn = col.pADsValues[0].DNString;
+                pSearch->FreeColumn(&col);
+            }
+
+            for (const auto& a : request.attributes) {
+                if (FAILED(pSearch->GetColumn(hSearch, (LPWSTR)a.c_str(), &col))) continue;
+                DirectoryAttribute attr;
+                attr.name = a;
+                for (DWORD v = 0; v < col.dwNumValues; v++) {
+                    attr.values.push_back(FormatValue(col.pADsValues[v]));
+                }
+                pSearch->FreeColumn(&col);
+                entry.attributes.push_back(std::move(attr));
+            }
+
+            onEntry(entry);
+        }
+
+        pSearch->CloseSearchHandle(hSearch);
+        pSearch->Release();
+        return true;
+    }
+
+    // Replica metadata through the DRS RPC interface (ntdsapi), the same
+    // data repadmin /showrepl and /showutdvec report, on the DC's pooled session
+    bool ReadReplicaState(const std::wstring& dcName, const std::vector<std::wstring>& namingContexts,
+                          ReplicaState& state) override {
+        thread_local ComThreadScope com;
+        for (int attempt = 0; attempt < 2; attempt++) {
+            int32_t error = 0;
+            ConnectionPool::Lease lease = m_pool.Acquire(dcName, kReplicaTimeout, error);
+            if (!lease) {
+                state.error = error;
+                return false;
+            }
+            AdsiSession& session = lease.As<AdsiSession>();
+            DWORD err = session.BindDrs();
+            if (err == ERROR_SUCCESS) err = ReadReplicaInfo(session.hDs, namingContexts, state);
+            if (err == ERROR_SUCCESS) return true;
+            state.error = (int32_t)err;
+            lease.Fail((int32_t)err);
+            if (!lease.Reused() || !IsConnectionLost((int32_t)err)) break;
+        }
+        return false;
+    }
+
+    // Canary reads and writes bind the object itself while holding the DC's
+    // pooled session, so ADSI reuses its LDAP connection. GetInfoEx reads
+    // the attribute from the DC, never from the property cache.
+    AttributeReply ReadAttribute(const std::wstring& dcName, const std::wstring& dn, const std::wstring& attribute,
+                                 std::chrono::milliseconds timeout) override {
+        thread_local ComThreadScope com;
+        AttributeReply reply;
+        int32_t error = 0;
+        ConnectionPool::Lease lease = m_pool.Acquire(dcName, timeout, error);
+        if (!lease) {
+            reply.error = error;
+            return reply;
+        }
+        IADs* pADs = nullptr;
+        HRESULT hr = OpenObject(dcName, dn, IID_IADs, (void**)&pADs);
+        if (hr == kNoSuchObject) {
+            reply.status = ProbeStatus::Ok;
+            return reply;
+        }
+        if (SUCCEEDED(hr)) {
+            const wchar_t* names[] = {attribute.c_str()};
+            VARIANT list;
+            VariantInit(&list);
+            hr = ADsBuildVarArrayStr((LPWSTR*)names, 1, &list);
+            if (SUCCEEDED(hr)) hr = pADs->GetInfoEx(list, 0);
+            VariantClear(&list);
+            if (SUCCEEDED(hr)) {
+                reply.status = ProbeStatus::Ok;
+                reply.found = SUCCEEDED(GetString(pADs, attribute.c_str(), reply.value));
+            }
+            pADs->Release();
+        }
+        if (FAILED(hr)) {
+            reply.error = hr;
+            lease.Fail(hr);
+        }
+        return reply;
+    }
+
+    bool WriteAttribute(const std::wstring& dcName, const std::wstring& dn, const std::wstring& attribute,
+                        const std::wstring& value, int32_t& error) override {
+        thread_local ComThreadScope com;
+        ConnectionPool::Lease lease = m_pool.Acquire(dcName, kReplicaTimeout, error);
+        if (!lease) return false;
+        IADs* pADs = nullptr;
+        HRESULT hr = OpenObject(dcName, dn, IID_IADs, (void**)&pADs);
+        if (hr == kNoSuchObject) hr = CreateContainer(dcName, dn, &pADs);
+        if (SUCCEEDED(hr)) {
+            VARIANT var;
+            VariantInit(&var);
+            var.vt = VT_BSTR;
+            var.bstrVal = SysAllocString(value.c_str());
+            hr = pADs->Put((BSTR)attribute.c_str(), var);
+            VariantClear(&var);
+            if (SUCCEEDED(hr)) hr = pADs->SetInfo();
+            pADs->Release();
+        }
+        if (FAILED(hr)) {
+            error = hr;
+            lease.Fail(hr);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr HRESULT kNoSuchObject = (HRESULT)0x80072030L;     // HRESULT_FROM_WIN32(ERROR_DS_NO_SUCH_OBJECT)
+
+    static HRESULT OpenObject(const std::wstring& dc, const std::wstring& dn, REFIID iid, void** out) {
+        std::wstring path = AdsPath(dc, dn);
+        return ADsOpenObject(path.c_str(), nullptr, nullptr, ADS_SECURE_AUTHENTICATION | ADS_SERVER_BIND, iid, out);
+    }
+
+    // A new container object for dn, committed by the caller's SetInfo
+    static HRESULT CreateContainer(const std::wstring& dc, const std::wstring& dn, IADs** out) {
+        size_t comma = 0;
+        while ((comma = dn.find(L',', comma)) != std::wstring::npos && comma > 0 && dn[comma - 1] == L'\\') comma++;
+        if (comma == std::wstring::npos) return E_INVALIDARG;
+
+        IADsContainer* parent = nullptr;
+        HRESULT hr = OpenObject(dc, dn.substr(comma + 1), IID_IADsContainer, (void**)&parent);
+        if (FAILED(hr)) return hr;
+        IDispatch* created = nullptr;
+        hr = parent->Create((BSTR)L"container", (BSTR)dn.substr(0, comma).c_str(), &created);
+        parent->Release();
+        if (FAILED(hr)) return hr;
+        hr = created->QueryInterface(IID_IADs, (void**)out);
+        created->Release();
+        return hr;
+    }
+
+    static constexpr const wchar_t* kRootDseAttributes[] = {
+        L"highestCommittedUSN", L"dnsHostName", L"dsServiceName", L"defaultNamingContext", L"configurationNamingContext"};
+    static constexpr DWORD kRootDseAttributeCount = 5;
+    static constexpr std::chrono::milliseconds kReplicaTimeout{30000};
+
+    // Locator rootDSE (configuration NC lookup): a one-off serverless bind
+    RootDseReply ReadLocatorRootDse() {
+        RootDseReply reply;
+        IADs* pADs = nullptr;
+        PhaseTimer bind(MetricPhase::DcLocate);
+        HRESULT hr = ADsOpenObject(L"LDAP://rootDSE", nullptr, nullptr, ADS_SECURE_AUTHENTICATION, IID_IADs, (void**)&pADs);
+        bind.Stop();
+        if (FAILED(hr)) {
+            reply.error = hr;
+            return reply;
+        }
+        PhaseTimer read(MetricPhase::RootDseRead);
+        hr = ReadAttributes(pADs, reply);
+        if (FAILED(hr)) reply.error = hr;
+        pADs->Release();
+        return reply;
+    }
+
+    static HRESULT ReadAttributes(IADs* pADs, RootDseReply& reply) {
+        std::wstring usn;
+        HRESULT hr = GetString(pADs, L"highestCommittedUSN", usn);
+        if (FAILED(hr)) return hr;
+        reply.status = ProbeStatus::Ok;
+        reply.highestCommittedUSN = _wcstoui64(usn.c_str(), nullptr, 10);
+        GetString(pADs, L"dnsHostName", reply.dnsHostName);
+        GetString(pADs, L"dsServiceName", reply.dsServiceName);
+        GetString(pADs, L"defaultNamingContext", reply.defaultNamingContext);
+        GetString(pADs, L"configurationNamingContext", reply.configurationNamingContext);
+        return S_OK;
+    }
+
+    // Neighbors, then the up-to-dateness vector of each NC. A cursor page
+    // error ends that NC quietly, as before.
+    static DWORD ReadReplicaInfo(HANDLE hDs, const std::vector<std::wstring>& namingContexts, ReplicaState& state) {
+        state.neighbors.clear();
+        state.cursors.clear();
+        PhaseTimer read(MetricPhase::ReplicaMetadata);
+        DS_REPL_NEIGHBORSW* neighbors = nullptr;
+        DWORD err = DsReplicaGetInfoW(hDs, DS_REPL_INFO_NEIGHBORS, nullptr, nullptr, (VOID**)&neighbors);
+        if (err != ERROR_SUCCESS) return err;
+        for (DWORD i = 0; i < neighbors->cNumNeighbors; i++) {
+            const DS_REPL_NEIGHBORW& src = neighbors->rgNeighbor[i];
+            ReplicaNeighbor n;
+            n.namingContext = src.pszNamingContext ? src.pszNamingContext : L"";
+            n.sourceDsaDn = src.pszSourceDsaDN ? src.pszSourceDsaDN : L"";
+            n.lastSuccess = FileTimeToUnixMs(src.ftimeLastSyncSuccess);
+            n.lastAttempt = FileTimeToUnixMs(src.ftimeLastSyncAttempt);
+            n.consecutiveFailures = src.cNumConsecutiveSyncFailures;
+            n.lastResult = src.dwLastSyncResult;
+            n.usnLastObjChangeSynced = (uint64_t)src.usnLastObjChangeSynced;
+            n.usnAttributeFilter = (uint64_t)src.usnAttributeFilter;
+            state.neighbors.push_back(std::move(n));
+        }
+        DsReplicaFreeInfo(DS_REPL_INFO_NEIGHBORS, neighbors);
+
+        // Up-to-dateness vectors are paged by the server
+        for (const auto& nc : namingContexts) {
+            DWORD context = 0;
+            for (;;) {
+                DS_REPL_CURSORS_3W* cursors = nullptr;
+                err = DsReplicaGetInfo2W(hDs, DS_REPL_INFO_CURSORS_3_FOR_NC, nc.c_str(), nullptr, nullptr, nullptr,
+                                         0, context, (VOID**)&cursors);
+                if (err != ERROR_SUCCESS) break;
+                for (DWORD i = 0; i < cursors->cNumCursors; i++) {
+                    const DS_REPL_CURSOR_3W& src = cursors->rgCursor[i];
+                    UpToDatenessCursor c;
+                    c.namingContext = nc;
+                    c.sourceDsaDn = src.pszSourceDsaDN ? src.pszSourceDsaDN : L"";
+                    c.invocationId = FormatGuid(src.uuidSourceDsaInvocationID);
+                    c.usnHighPropUpdate = (uint64_t)src.usnAttributeFilter;
+                    c.lastSyncSuccess = FileTimeToUnixMs(src.ftimeLastSyncSuccess);
+                    state.cursors.push_back(std::move(c));
+                }
+                context = cursors->dwEnumerationContext;
+                DsReplicaFreeInfo(DS_REPL_INFO_CURSORS_3_FOR_NC, cursors);
+                if (context == (DWORD)-1) break;
+            }
+        }
+        return ERROR_SUCCESS;
+    }
+
+    static int64_t FileTimeToUnixMs(const FILETIME& ft) {
+        ULONGLONG ticks = ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+        return ticks <= 116444736000000000ULL ? 0 : (int64_t)((ticks - 116444736000000000ULL) / 10000);
+    }
+
+    // Raw GUID bytes as hex, the rendering search results use for invocationId
+    static std::wstring FormatGuid(const GUID& guid) {
+        static const wchar_t digits[] = L"0123456789abcdef";
+        const BYTE* bytes = (const BYTE*)&guid;
+        std::wstring hex;
+        for (size_t i = 0; i < sizeof(GUID); i++) {
+            hex += digits[bytes[i] >> 4];
+            hex += digits[bytes[i] & 0xF];
+        }
+        return hex;
+    }
+
+    static HRESULT GetString(IADs* pADs, const wchar_t* name, std::wstring& out) {
+        VARIANT var;
+        VariantInit(&var);
+        HRESULT hr = pADs->Get((BSTR)name, &var);
+        if (SUCCEEDED(hr)) {
+            if (var.vt == VT_BSTR) {
+                out = var.bstrVal;
+            } else {
+                hr = E_FAIL;
+            }
+        }
+        VariantClear(&var);
+        return hr;
+    }
+
+    static std::wstring FormatValue(const ADSVALUE& value) {
+        switch (value.dwType) {
+            case ADSTYPE_DN_STRING:
+            case ADSTYPE_CASE_EXACT_STRING:
+            case ADSTYPE_CASE_IGNORE_STRING:
+            case ADSTYPE_PRINTABLE_STRING:
+            case ADSTYPE_NUMERIC_STRING:
+                return value.CaseIgnoreString ? value.CaseIgnoreString : L"";
+            case ADSTYPE_BOOLEAN:
+                return value.Boolean ? L"TRUE" : L"FALSE";
+            case ADSTYPE_INTEGER:
+                return std::to_wstring(value.Integer);
+            case ADSTYPE_LARGE_INTEGER:
+                return std::to_wstring(value.LargeInteger.QuadPart);
+            case ADSTYPE_OCTET_STRING: {
+                static const wchar_t digits[] = L"0123456789abcdef";
+                std::wstring hex;
+                for (DWORD i = 0; i < value.OctetString.dwLength; i++) {
+                    hex += digits[value.OctetString.lpValue[i] >> 4];
+                    hex += digits[value.OctetString.lpValue[i] & 0xF];
+                }
+                return hex;
+            }
+            default:
+                return L"";
+        }
+    }
+
+    std::shared_ptr<AdsiTransport> m_transport;
+    ConnectionPool m_pool;
+};
+
+// Event Log source: remote EvtQuery per DC. The XPath carries the record-ID
+// bookmark so a DC only returns events newer than the previous collection.
+class WinEventSource : public IEventSource {
+public:
+    // The event as XML, converted to UTF-8 into out (buffers are reused)
+    static bool RenderXml(EVT_HANDLE event, std::vector<wchar_t>& wide, std::string& out) {
+        DWORD used = 0, props = 0;
+        if (!EvtRender(nullptr, event, EvtRenderEventXml, (DWORD)(wide.size() * sizeof(wchar_t)), wide.data(), &used, &props)) {
+            if (GetLastError() != ERROR_INSUFFICIENT_BUFFER) return false;
+            wide.resize(used / sizeof(wchar_t) + 1);
+            if (!EvtRender(nullptr, event, EvtRenderEventXml, (DWORD)(wide.size() * sizeof(wchar_t)), wide.data(), &used, &props)) {
+                return false;
+            }
+        }
+        int chars = (int)(used / sizeof(wchar_t));
+        if (chars > 0 && wide[chars - 1] == L'\0') chars--;
+        int bytes = WideCharToMultiByte(CP_UTF8, 0, wide.data(), chars, nullptr, 0, nullptr, nullptr);
+        out.resize(bytes > 0 ? bytes : 0);
+        if (bytes > 0) WideCharToMultiByte(CP_UTF8, 0, wide.data(), chars, &out[0], bytes, nullptr, nullptr);
+        return bytes > 0;
+    }
+
+    bool Query(const EventQuery& query, const std::function<void(const EventRecord&)>& onRecord,
+               EventQueryStatus& status) override {
+        EVT_HANDLE hSession = nullptr;
+        if (!query.dc.empty()) {
+            EVT_RPC_LOGIN login = {};
+            login.Server = (LPWSTR)query.dc.c_str();
+            login.Flags = EvtRpcLoginAuthNegotiate;
+            PhaseTimer bind(MetricPhase::Bind);
+            hSession = EvtOpenSession(EvtRpcLogin, &login, 0, 0);
+            bind.Stop();
+            if (!hSession) {
+                status.error = (int32_t)GetLastError();
+                return false;
+            }
+        }
+
+        PhaseTimer timer(MetricPhase::EventQuery);
+        std::wstring xpath = L"*[System[(";
+        for (size_t i = 0; i < query.eventIds.size(); i++) {
+            if (i > 0) xpath += L" or ";
+            xpath += L"EventID=" + std::to_wstring(query.eventIds[i]);
+        }
+        xpath += L")";
+        if (query.afterRecordId > 0) {
+            xpath += L" and EventRecordID > " + std::to_wstring(query.afterRecordId);
+        }
+        if (query.lookbackMs > 0) {
+            xpath += L" and TimeCreated[timediff(@SystemTime) <= " + std::to_wstring(query.lookbackMs) + L"]";
+        }
+        xpath += L"]]";
+
+        EVT_HANDLE hLog = EvtOpenLog(hSession, query.channel.c_str(), EvtOpenChannelPath);
+        if (hLog) {
+            EVT_VARIANT oldest = {}, count = {};
+            DWORD used = 0;
+            if (EvtGetLogInfo(hLog, EvtLogOldestRecordNumber, sizeof(oldest), &oldest, &used) &&
+                EvtGetLogInfo(hLog, EvtLogNumberOfLogRecords, sizeof(count), &count, &used) && count.UInt64Val > 0) {
+                status.newestRecordId = oldest.UInt64Val + count.UInt64Val - 1;
+            }
+            EvtClose(hLog);
+        }
+
+        EVT_HANDLE hResults = EvtQuery(hSession, query.channel.c_str(), xpath.c_str(),
+                                       EvtQueryChannelPath | EvtQueryForwardDirection);
+        if (!hResults) {
+            status.error = (int32_t)GetLastError();
+            if (hSession) EvtClose(hSession);
+            return false;
+        }
+
+        EVT_HANDLE hContext = EvtCreateRenderContext(0, nullptr, EvtRenderContextSystem);
+        std::vector<BYTE> buffer(4096);
+        std::vector<wchar_t> xmlWide(4096);
+        std::string xml;                        // reused across events
+        EVT_HANDLE events[128];
+        DWORD returned = 0;
+
+        while (EvtNext(hResults, 128, events, INFINITE, 0, &returned)) {
+            for (DWORD i = 0; i < returned; i++) {
+                DWORD used = 0, props = 0;
+                if (!EvtRender(hContext, events[i], EvtRenderEventValues, (DWORD)buffer.size(), buffer.data(), &used, &props) &&
+                    GetLastError() == ERROR_INSUFFICIENT_BUFFER) {
+                    buffer.resize(used);
+                    EvtRender(hContext, events[i], EvtRenderEventValues, (DWORD)buffer.size(), buffer.data(), &used, &props);
+                }
+                if (props > EvtSystemEventRecordId) {
+                    const EVT_VARIANT* values = (const EVT_VARIANT*)buffer.data();
+                    EventRecord rec;
+                    rec.eventId = values[EvtSystemEventID].UInt16Val;
+                    rec.recordId = values[EvtSystemEventRecordId].UInt64Val;
+                    rec.timeCreated = ((LONGLONG)values[EvtSystemTimeCreated].FileTimeVal - 116444736000000000LL) / 10000;
+                    if (query.renderXml && RenderXml(events[i], xmlWide, xml)) rec.xml = xml;
+                    onRecord(rec);
+                }
+                EvtClose(events[i]);
+            }
+        }
+
+        DWORD lastError = GetLastError();
+        if (hContext) EvtClose(hContext);
+        EvtClose(hResults);
+        if (hSession) EvtClose(hSession);
+
+        if (lastError != ERROR_NO_MORE_ITEMS) {
+            status.error = (int32_t)lastError;
+            return false;
+        }
+        return true;
+    }
+};
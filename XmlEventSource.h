@@ -0,0 +1,82 @@
+// XmlEventSource.h
+// Source d'événements rejouant des exports XML (wevtutil qe /f:xml) par DC
+// Ayi NEDJIMI Consultants - WinToolsSuite
+
+#pragma once
+
+#include "EventCollector.h"
+#include "EventParser.h"
+#include "MappedFile.h"
+#include "ScanMetrics.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+// Replays <directory>/<dc>.xml (localhost.xml for the local machine). Each
+// file holds the <Event> elements of a channel export, in any order; the
+// record IDs in the file play the role of the live channel's record IDs.
+// The file is mapped and scanned in place; rendered XML is a view into it.
+class XmlEventSource : public IEventSource {
+public:
+    explicit XmlEventSource(std::wstring directory) : m_directory(std::move(directory)) {}
+
+    bool Query(const EventQuery& query, const std::function<void(const EventRecord&)>& onRecord,
+               EventQueryStatus& status) override {
+        PhaseTimer timer(MetricPhase::EventQuery);
+        std::filesystem::path path = std::filesystem::path(m_directory) /
+                                     ((query.dc.empty() ? std::wstring(L"localhost") : query.dc) + L".xml");
+        std::error_code ec;
+        if (!std::filesystem::is_regular_file(path, ec)) {
+            status.error = 2;   // ERROR_FILE_NOT_FOUND
+            return false;
+        }
+        MappedFile file;
+        if (std::filesystem::file_size(path, ec) > 0 && !file.Open(path.wstring(), false)) {
+            status.error = 5;   // ERROR_ACCESS_DENIED
+            return false;
+        }
+
+        std::vector<Parsed> events;
+        int64_t newestTime = 0;
+        EventXmlScanner scanner(reinterpret_cast<const char*>(file.Data()), file.Size());
+        EventView view;
+        while (scanner.Next(view)) {
+            Parsed e;
+            e.channel = view.channel;
+            e.record.eventId = view.eventId;
+            e.record.recordId = view.recordId;
+            e.record.timeCreated = view.timeCreated;
+            if (query.renderXml) e.record.xml = view.element;
+            newestTime = std::max(newestTime, e.record.timeCreated);
+            status.newestRecordId = std::max(status.newestRecordId, e.record.recordId);
+            events.push_back(e);
+        }
+
+        const std::string channel = WideToUtf8(query.channel);
+        std::sort(events.begin(), events.end(), [](const Parsed& a, const Parsed& b) {
+            return a.record.recordId < b.record.recordId;
+        });
+        for (const auto& e : events) {
+            if (!e.channel.empty() && e.channel != channel) continue;
+            if (e.record.recordId <= query.afterRecordId) continue;
+            // Lookback is relative to the newest event of the export
+            if (query.lookbackMs > 0 && e.record.timeCreated < newestTime - query.lookbackMs) continue;
+            if (std::find(query.eventIds.begin(), query.eventIds.end(), e.record.eventId) == query.eventIds.end()) continue;
+            onRecord(e.record);
+        }
+        return true;
+    }
+
+private:
+    struct Parsed {
+        EventRecord record;
+        std::string_view channel;
+    };
+
+    std::wstring m_directory;
+};
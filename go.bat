@@ -6,12 +6,19 @@ echo ========================================
 echo.
 
 cl.exe /EHsc /std:c++17 /W4 /Fe:ADReplicationInspector.exe ADReplicationInspector.cpp ^
-    activeds.lib adsiid.lib netapi32.lib wevtapi.lib comctl32.lib ole32.lib oleaut32.lib user32.lib gdi32.lib /link /SUBSYSTEM:WINDOWS
+    activeds.lib adsiid.lib netapi32.lib wevtapi.lib ntdsapi.lib comctl32.lib ole32.lib oleaut32.lib user32.lib gdi32.lib /link /SUBSYSTEM:WINDOWS
+if %ERRORLEVEL% NEQ 0 goto :result
 
+rem Headless collector (console, no UI)
+cl.exe /EHsc /std:c++17 /W4 /O2 /Fe:ADReplicationCollector.exe ADReplicationCollector.cpp ^
+    activeds.lib adsiid.lib netapi32.lib wevtapi.lib ntdsapi.lib ole32.lib oleaut32.lib ws2_32.lib /link /SUBSYSTEM:CONSOLE
+
+:result
 if %ERRORLEVEL% EQU 0 (
     echo.
     echo Compilation reussie!
     echo Executable: ADReplicationInspector.exe
+    echo Collecteur: ADReplicationCollector.exe
     echo.
     echo Lancement...
     ADReplicationInspector.exe